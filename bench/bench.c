@@ -0,0 +1,213 @@
+/* bench.c: timing samples and JSON reports for the benchmarks */
+
+#include "bench.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/* Macros */
+
+/* glibc lets a program replace malloc and reaches the originals by these names */
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS 1
+#endif
+
+/* Structures */
+
+#ifdef BENCH_COUNT_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static atomic_uint_fast64_t bench_alloc_count;
+#endif
+
+/* Forward Declaration of static Functions */
+
+static int bench_compare(const void *a, const void *b);
+
+/* Functions */
+
+/**
+ * bench_result - Adds a named result to a report.
+ *
+ * @param report The report owning the result.
+ * @param name   Operation name, as printed in the JSON.
+ * @return The new, empty result; valid until the next bench_result().
+ */
+BenchResult *bench_result(BenchReport *report, const char *name){
+    if (report->count == report->capacity){
+        report->capacity = report->capacity ? 2 * report->capacity : 16;
+        report->results = realloc(report->results, report->capacity * sizeof(BenchResult));
+        MALLOC_CHECK(report->results);
+    }
+    BenchResult *result = &report->results[report->count++];
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    return result;
+}
+
+/**
+ * bench_sample - Records the duration of one operation.
+ */
+void bench_sample(BenchResult *result, uint64_t ns){
+    if (result->count == result->capacity){
+        result->capacity = result->capacity ? 2 * result->capacity : 64;
+        result->samples = realloc(result->samples, result->capacity * sizeof(uint64_t));
+        MALLOC_CHECK(result->samples);
+    }
+    result->samples[result->count++] = ns;
+}
+
+/**
+ * bench_loop - Times an operation in batches.
+ *
+ * Each sample is the time taken by batch consecutive calls, so that
+ * operations far shorter than the clock's overhead can still be measured;
+ * result->items counts the calls, which makes ns_per_op the figure to read.
+ * Allocations are counted across all calls when the allocator allows it.
+ *
+ * @param result  Receives one sample per batch.
+ * @param samples Number of batches.
+ * @param batch   Calls per batch.
+ * @param op      The operation, passed arg and the running call number.
+ * @param arg     Passed through to op.
+ * @return False as soon as op fails.
+ */
+bool bench_loop(BenchResult *result, size_t samples, size_t batch, BenchOp op, void *arg){
+    /* reserve up front, so bench_sample() never allocates between calls */
+    if (result->count + samples > result->capacity){
+        result->capacity = result->count + samples;
+        result->samples = realloc(result->samples, result->capacity * sizeof(uint64_t));
+        MALLOC_CHECK(result->samples);
+    }
+
+    uint64_t before = 0, after = 0;
+    result->allocs_counted = bench_allocs(&before);
+    size_t call = 0;
+    for (size_t s = 0; s < samples; s++){
+        uint64_t start = bench_now();
+        for (size_t b = 0; b < batch; b++){
+            if (!op(arg, call++)) { return false; }
+        }
+        bench_sample(result, bench_now() - start);
+    }
+    if (bench_allocs(&after)) { result->allocs += after - before; }
+    result->items += (uint64_t)samples * batch;
+    return true;
+}
+
+/**
+ * bench_allocs - Reads the number of malloc, calloc and realloc calls so far.
+ *
+ * @param count Output for the count, from every thread.
+ * @return False if allocations are not counted on this platform.
+ */
+bool bench_allocs(uint64_t *count){
+#ifdef BENCH_COUNT_ALLOCS
+    *count = atomic_load_explicit(&bench_alloc_count, memory_order_relaxed);
+    return true;
+#else
+    *count = 0;
+    return false;
+#endif
+}
+
+#ifdef BENCH_COUNT_ALLOCS
+/**
+ * malloc - Counts the call and forwards to glibc; calloc and realloc likewise.
+ *
+ * Defining these in the benchmark replaces the allocator for the whole
+ * process, libc's own allocations included.
+ */
+void *malloc(size_t size){
+    atomic_fetch_add_explicit(&bench_alloc_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size){
+    atomic_fetch_add_explicit(&bench_alloc_count, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size){
+    atomic_fetch_add_explicit(&bench_alloc_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr){
+    __libc_free(ptr);
+}
+#endif
+
+/**
+ * bench_percentile - Nearest-rank percentile of the samples.
+ *
+ * @param result  A result whose samples are sorted.
+ * @param percent Between 0 and 100.
+ * @return The sample at that rank, 0 if there are none.
+ */
+uint64_t bench_percentile(const BenchResult *result, double percent){
+    if (!result->count) { return 0; }
+    size_t rank = (size_t)(percent / 100.0 * (double)result->count + 0.999999);
+    if (rank == 0) { rank = 1; }
+    if (rank > result->count) { rank = result->count; }
+    return result->samples[rank - 1];
+}
+
+/**
+ * bench_report_json - Prints a report as one JSON object.
+ *
+ * Times are in nanoseconds. ops_per_sec counts samples, or items when the
+ * result has them (commits per second for a walk), which also adds
+ * ns_per_op; bytes_per_sec is only printed for results that processed
+ * bytes, and allocs_per_op for results whose allocations were counted.
+ *
+ * @param fp     Where to print.
+ * @param report The report; its samples are sorted in place.
+ * @param config A JSON object describing the run, printed as "config".
+ */
+void bench_report_json(FILE *fp, BenchReport *report, const char *config){
+    fprintf(fp, "{\n  \"config\": %s,\n  \"results\": [", config);
+    for (size_t i = 0; i < report->count; i++){
+        BenchResult *result = &report->results[i];
+        qsort(result->samples, result->count, sizeof(uint64_t), bench_compare);
+
+        uint64_t total = 0;
+        for (size_t s = 0; s < result->count; s++) { total += result->samples[s]; }
+        double seconds = (double)total / 1e9;
+        double ops = (double)(result->items ? result->items : result->count);
+
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"samples\": %zu, \"total_ns\": %llu, ", i ? "," : "", result->name, result->count, (unsigned long long)total);
+        fprintf(fp, "\"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, ",
+                (unsigned long long)bench_percentile(result, 0), (unsigned long long)bench_percentile(result, 50),
+                (unsigned long long)bench_percentile(result, 90), (unsigned long long)bench_percentile(result, 99),
+                (unsigned long long)bench_percentile(result, 100));
+        fprintf(fp, "\"mean_ns\": %.0f, \"ops_per_sec\": %.1f", result->count ? (double)total / (double)result->count : 0.0, seconds > 0 ? ops / seconds : 0.0);
+        if (result->items) { fprintf(fp, ", \"ns_per_op\": %.1f", (double)total / (double)result->items); }
+        if (result->bytes) { fprintf(fp, ", \"bytes_per_sec\": %.0f", seconds > 0 ? (double)result->bytes / seconds : 0.0); }
+        if (result->allocs_counted) { fprintf(fp, ", \"allocs_per_op\": %.2f", ops > 0 ? (double)result->allocs / ops : 0.0); }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/**
+ * bench_report_free - Frees every result of a report.
+ */
+void bench_report_free(BenchReport *report){
+    for (size_t i = 0; i < report->count; i++) { free(report->results[i].samples); }
+    free(report->results);
+    memset(report, 0, sizeof(*report));
+}
+
+/* Static Functions */
+
+static int bench_compare(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
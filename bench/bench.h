@@ -0,0 +1,52 @@
+/* bench.h: timing samples and JSON reports for the benchmarks */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Macros */
+
+#define BENCH_NAME_SIZE 64
+
+/* Structures */
+
+typedef struct {
+    char     name[BENCH_NAME_SIZE];
+    uint64_t *samples;          /* nanoseconds per operation */
+    size_t   count;
+    size_t   capacity;
+    uint64_t bytes;             /* processed by all samples, 0 if not meaningful */
+    uint64_t items;             /* e.g. commits walked, 0 means one per sample */
+    uint64_t allocs;            /* malloc-family calls made by all samples */
+    bool     allocs_counted;    /* allocs was measured, so 0 means none */
+} BenchResult;
+
+typedef struct {
+    BenchResult *results;
+    size_t      count;
+    size_t      capacity;
+} BenchReport;
+
+typedef bool (*BenchOp)(void *arg, size_t i);
+
+/* Functions */
+
+static inline uint64_t bench_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+BenchResult *bench_result(BenchReport *report, const char *name);
+void         bench_sample(BenchResult *result, uint64_t ns);
+bool         bench_loop(BenchResult *result, size_t samples, size_t batch, BenchOp op, void *arg);
+bool         bench_allocs(uint64_t *count);
+uint64_t     bench_percentile(const BenchResult *result, double percent);
+void         bench_report_json(FILE *fp, BenchReport *report, const char *config);
+void         bench_report_free(BenchReport *report);
+
+#endif
@@ -0,0 +1,363 @@
+/* bench_parse.c: micro-benchmarks of the object, pack and config parsers */
+
+#include "bench.h"
+#include "config.h"
+#include "kvlm.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define BENCH_TREE_ENTRIES    256     /* entries of the parsed tree */
+#define BENCH_HEADERS         4096    /* pack entry headers decoded in turn */
+#define BENCH_ARENA_REUSE     1024    /* parses sharing an arena before it is cleared */
+#define BENCH_CONFIG_BRANCHES 16      /* [branch] sections in the parsed config */
+#define BENCH_FILE_DIVISOR    100     /* batch shrink for operations that open a file */
+
+/* Structures */
+
+typedef struct {
+    size_t      iterations;     /* samples per operation */
+    size_t      batch;          /* calls per sample */
+    size_t      seed;
+    const char  *dir;           /* workspace, created and removed by the run */
+    const char  *output;        /* JSON report, stdout if NULL */
+} BenchOptions;
+
+typedef struct {
+    const BenchOptions *options;
+    char          config[MAX_PATH];
+    unsigned char *commit;
+    size_t        commit_size;
+    unsigned char *tree;
+    size_t        tree_size;
+    char          names[BENCH_TREE_ENTRIES][16];
+    unsigned char *headers;     /* BENCH_HEADERS encoded entry headers, back to back */
+    size_t        offsets[BENCH_HEADERS];
+    size_t        headers_size;
+    Tree          parsed;       /* the tree, parsed once for lookups */
+    Arena         parsed_arena;
+    Arena         arena;        /* cleared every BENCH_ARENA_REUSE parses */
+    uint64_t      rng;
+    size_t        sink;         /* results folded here so no call is optimised out */
+} BenchParse;
+
+/* Forward Declaration of static Functions */
+
+static bool bench_parse_options(int argc, char *argv[], BenchOptions *options);
+static bool bench_setup(BenchParse *bench);
+static bool bench_run(BenchParse *bench, BenchReport *report);
+static bool bench_time(BenchParse *bench, BenchReport *report, const char *name, size_t divisor, BenchOp op);
+static bool bench_path_join(void *arg, size_t i);
+static bool bench_path_join_buf(void *arg, size_t i);
+static bool bench_config(void *arg, size_t i);
+static bool bench_commit(void *arg, size_t i);
+static bool bench_tree(void *arg, size_t i);
+static bool bench_tree_find(void *arg, size_t i);
+static bool bench_pack_header(void *arg, size_t i);
+static uint64_t bench_random(BenchParse *bench);
+
+/* Functions */
+
+int main(int argc, char *argv[]){
+    BenchOptions options = { .iterations = 200, .batch = 1000, .seed = 1 };
+    if (!bench_parse_options(argc, argv, &options)) { return EXIT_FAILURE; }
+
+    char dir[MAX_PATH];
+    if (!options.dir){
+        snprintf(dir, sizeof(dir), "/tmp/git_bench_parse.%ld", (long)getpid());
+        options.dir = dir;
+    }
+    if (file_exists(options.dir)){
+        fprintf(stderr, "bench_parse: %s already exists\n", options.dir);
+        return EXIT_FAILURE;
+    }
+    if (!mkdir_p(options.dir, 0777)) { return EXIT_FAILURE; }
+
+    /* only the file under test is read, not the user's settings */
+    setenv("GIT_CONFIG_GLOBAL", "/dev/null", 1);
+
+    BenchParse *bench = safe_calloc(1, sizeof(BenchParse));
+    bench->options = &options;
+    bench->rng = options.seed * 0x9e3779b97f4a7c15ull + 1;
+    BenchReport report = { 0 };
+    bool status = bench_setup(bench) && bench_run(bench, &report);
+
+    if (status){
+        uint64_t allocs;
+        char config[256];
+        snprintf(config, sizeof(config), "{\"iterations\": %zu, \"batch\": %zu, \"seed\": %zu, \"allocs_counted\": %s}",
+                 options.iterations, options.batch, options.seed, bench_allocs(&allocs) ? "true" : "false");
+        FILE *fp = options.output ? safe_fopen(options.output, "w") : stdout;
+        bench_report_json(fp, &report, config);
+        if (fp != stdout) { fclose(fp); }
+    }
+
+    bench_report_free(&report);
+    arena_clear(&bench->arena);
+    arena_clear(&bench->parsed_arena);
+    free(bench->commit);
+    free(bench->tree);
+    free(bench->headers);
+    free(bench);
+    remove_directory(options.dir);
+    return status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Static Functions */
+
+/**
+ * bench_parse_options - Reads --name=value options.
+ */
+static bool bench_parse_options(int argc, char *argv[], BenchOptions *options){
+    struct { const char *name; size_t *value; } sizes[] = {
+        { "--iterations=", &options->iterations }, { "--batch=", &options->batch }, { "--seed=", &options->seed },
+    };
+
+    for (int i = 1; i < argc; i++){
+        bool known = false;
+        for (size_t s = 0; !known && s < sizeof(sizes) / sizeof(sizes[0]); s++){
+            size_t len = strlen(sizes[s].name);
+            if (strncmp(argv[i], sizes[s].name, len) == 0){
+                known = parse_size(argv[i] + len, sizes[s].value);
+            }
+        }
+        if (known) { continue; }
+
+        if (strncmp(argv[i], "--dir=", 6) == 0 && argv[i][6]){
+            options->dir = argv[i] + 6;
+        } else if (strncmp(argv[i], "--output=", 9) == 0 && argv[i][9]){
+            options->output = argv[i] + 9;
+        } else if (strncmp(argv[i], "--objects=", 10) == 0 || strncmp(argv[i], "--depth=", 8) == 0 ||
+                   strncmp(argv[i], "--blob-size=", 12) == 0 || strncmp(argv[i], "--fanout=", 9) == 0 || streq(argv[i], "--keep")){
+            continue;   /* bench_repo's, so one BENCH_ARGS can drive every benchmark */
+        } else {
+            fprintf(stderr, "usage: %s [--iterations=N] [--batch=N] [--seed=N] [--dir=PATH] [--output=FILE]\n", argv[0]);
+            return false;
+        }
+    }
+
+    if (!options->iterations || !options->batch){
+        fprintf(stderr, "bench_parse: iterations and batch must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * bench_setup - Builds the inputs: a config file, a signed merge commit,
+ * a sorted tree and a run of pack entry headers.
+ *
+ * Header sizes are spread over a few orders of magnitude, the way a pack's
+ * small trees and commits mix with larger blobs, so every varint length
+ * between one and five bytes is decoded.
+ */
+static bool bench_setup(BenchParse *bench){
+    path_join_buf(bench->config, sizeof(bench->config), bench->options->dir, "config", NULL);
+    FILE *fp = fopen(bench->config, "w");
+    if (!fp){
+        fprintf(stderr, "bench_parse: cannot write %s\n", bench->config);
+        return false;
+    }
+    fprintf(fp, "[core]\n\trepositoryformatversion = 0\n\tfilemode = true\n\tbare = false\n\tlogallrefupdates = true\n");
+    fprintf(fp, "[remote \"origin\"]\n\turl = https://example.com/project.git\n\tfetch = +refs/heads/*:refs/remotes/origin/*\n");
+    for (size_t b = 0; b < BENCH_CONFIG_BRANCHES; b++){
+        fprintf(fp, "[branch \"topic-%zu\"]\n\tremote = origin\n\tmerge = refs/heads/topic-%zu\n", b, b);
+    }
+    if (fclose(fp) != 0) { return false; }
+
+    char hex[SHA_HEX_SIZE];
+    unsigned char sha[SHA_SIZE];
+    size_t cap = 4096, len = 0;
+    bench->commit = safe_malloc(cap, 1);
+    char *body = (char *)bench->commit;
+    for (size_t b = 0; b < SHA_SIZE; b++) { sha[b] = (unsigned char)bench_random(bench); }
+    sha_to_hex(sha, hex);
+    len += (size_t)snprintf(body + len, cap - len, "tree %s\n", hex);
+    for (int p = 0; p < 2; p++){
+        sha[0]++;
+        sha_to_hex(sha, hex);
+        len += (size_t)snprintf(body + len, cap - len, "parent %s\n", hex);
+    }
+    len += (size_t)snprintf(body + len, cap - len, "author A U Thor <author@example.com> 1700000000 +0100\n"
+                                                   "committer C O Mitter <committer@example.com> 1700000100 +0100\n"
+                                                   "gpgsig -----BEGIN PGP SIGNATURE-----\n \n");
+    for (int l = 0; l < 12; l++) { len += (size_t)snprintf(body + len, cap - len, " iQIzBAABCAAdFiEE%048d\n", l); }
+    len += (size_t)snprintf(body + len, cap - len, " -----END PGP SIGNATURE-----\n\nMerge branch 'topic'\n\n"
+                                                   "Bring in the topic branch, which reworks the parser.\n");
+    bench->commit_size = len;
+
+    cap = BENCH_TREE_ENTRIES * (16 + SHA_SIZE + 8);
+    bench->tree = safe_malloc(cap, 1);
+    len = 0;
+    for (size_t e = 0; e < BENCH_TREE_ENTRIES; e++){
+        bool dir = e % 8 == 0;
+        snprintf(bench->names[e], sizeof(bench->names[e]), "entry%05zu", e);
+        len += (size_t)sprintf((char *)bench->tree + len, "%s %s", dir ? "40000" : "100644", bench->names[e]) + 1;
+        for (size_t b = 0; b < SHA_SIZE; b++) { bench->tree[len++] = (unsigned char)bench_random(bench); }
+    }
+    bench->tree_size = len;
+    if (!tree_parse(&bench->parsed, bench->tree, bench->tree_size, &bench->parsed_arena)) { return false; }
+
+    bench->headers = safe_malloc(BENCH_HEADERS, 8);
+    len = 0;
+    for (size_t h = 0; h < BENCH_HEADERS; h++){
+        uint64_t r = bench_random(bench);
+        int type = 1 + (int)(r % 4);
+        size_t size = (size_t)(r >> 8) & (((size_t)1 << (4 + 7 * (r >> 4) % 5)) - 1);
+        bench->offsets[h] = len;
+        unsigned char c = (unsigned char)((type << 4) | (size & 15));
+        for (size >>= 4; size; size >>= 7){
+            bench->headers[len++] = c | 0x80;
+            c = size & 0x7f;
+        }
+        bench->headers[len++] = c;
+    }
+    bench->headers_size = len;
+    return true;
+}
+
+/**
+ * bench_run - Times each parser.
+ */
+static bool bench_run(BenchParse *bench, BenchReport *report){
+    return bench_time(bench, report, "path_join", 1, bench_path_join)
+        && bench_time(bench, report, "path_join_buf", 1, bench_path_join_buf)
+        && bench_time(bench, report, "repo_config_create", BENCH_FILE_DIVISOR, bench_config)
+        && bench_time(bench, report, "commit parse", 1, bench_commit)
+        && bench_time(bench, report, "tree parse", 1, bench_tree)
+        && bench_time(bench, report, "tree_find", 1, bench_tree_find)
+        && bench_time(bench, report, "pack_entry_header", 1, bench_pack_header);
+}
+
+/**
+ * bench_time - Adds a result for one operation, after a warm-up batch.
+ *
+ * @param divisor Shrinks the batch for operations much slower than the rest.
+ */
+static bool bench_time(BenchParse *bench, BenchReport *report, const char *name, size_t divisor, BenchOp op){
+    size_t batch = bench->options->batch / divisor ? bench->options->batch / divisor : 1;
+    bool status = true;
+    for (size_t i = 0; status && i < batch; i++) { status = op(bench, i); }
+    BenchResult *result = bench_result(report, name);
+    if (!status || !bench_loop(result, bench->options->iterations, batch, op, bench)){
+        fprintf(stderr, "bench_parse: %s failed\n", name);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * bench_path_join - Builds a loose object path, as one lookup does.
+ */
+static bool bench_path_join(void *arg, size_t i){
+    BenchParse *bench = arg;
+    char *path = path_join(bench->options->dir, ".git", "objects", bench->names[i % BENCH_TREE_ENTRIES],
+                           "8a7c1f0e9d6b5a4c3b2a19081726354453627180", NULL);
+    if (!path) { return false; }
+    bench->sink += strlen(path);
+    free(path);
+    return true;
+}
+
+/**
+ * bench_path_join_buf - The same path, built without allocating.
+ */
+static bool bench_path_join_buf(void *arg, size_t i){
+    BenchParse *bench = arg;
+    char path[MAX_PATH];
+    size_t len = path_join_buf(path, sizeof(path), bench->options->dir, ".git", "objects", bench->names[i % BENCH_TREE_ENTRIES],
+                               "8a7c1f0e9d6b5a4c3b2a19081726354453627180", NULL);
+    bench->sink += len;
+    return len != 0;
+}
+
+/**
+ * bench_config - Loads the config file through inih, as every repository open does.
+ */
+static bool bench_config(void *arg, size_t i){
+    (void)i;
+    BenchParse *bench = arg;
+    Configuration *config = repo_config_create(bench->config);
+    if (!config) { return false; }
+    bench->sink += config->count;
+    config_free(config);
+    return true;
+}
+
+/**
+ * bench_commit - Indexes a commit and decodes what a history walk reads.
+ *
+ * The arena is only cleared every BENCH_ARENA_REUSE parses, so its blocks
+ * are amortised the way they are in a repository's arena.
+ */
+static bool bench_commit(void *arg, size_t i){
+    BenchParse *bench = arg;
+    if (i % BENCH_ARENA_REUSE == 0) { arena_clear(&bench->arena); }
+
+    GitCommit commit = { .object = { .type = OBJ_COMMIT, .size = bench->commit_size, .data = bench->commit } };
+    unsigned char sha[SHA_SIZE];
+    if (!kvlm_parse(&commit.kvlm, bench->commit, bench->commit_size, &bench->arena) || !commit_tree(&commit, sha)){
+        return false;
+    }
+    bench->sink += commit_parent_count(&commit) + commit_date(&commit) + sha[0];
+    return true;
+}
+
+/**
+ * bench_tree - Indexes a tree of BENCH_TREE_ENTRIES entries.
+ */
+static bool bench_tree(void *arg, size_t i){
+    BenchParse *bench = arg;
+    if (i % BENCH_ARENA_REUSE == 0) { arena_clear(&bench->arena); }
+
+    Tree tree;
+    if (!tree_parse(&tree, bench->tree, bench->tree_size, &bench->arena) || !tree.sorted) { return false; }
+    bench->sink += tree.count;
+    return true;
+}
+
+/**
+ * bench_tree_find - Looks up one entry of the parsed tree, as a path walk does.
+ */
+static bool bench_tree_find(void *arg, size_t i){
+    BenchParse *bench = arg;
+    const char *name = bench->names[(i * 7919) % BENCH_TREE_ENTRIES];
+    const TreeLeaf *leaf = tree_find(&bench->parsed, name, strlen(name));
+    if (!leaf) { return false; }
+    bench->sink += leaf->mode;
+    return true;
+}
+
+/**
+ * bench_pack_header - Decodes one pack entry header; the figure includes the indirect call.
+ */
+static bool bench_pack_header(void *arg, size_t i){
+    BenchParse *bench = arg;
+    size_t offset = bench->offsets[i % BENCH_HEADERS];
+    int type;
+    size_t size, header_len;
+    if (!pack_entry_header(bench->headers + offset, bench->headers_size - offset, &type, &size, &header_len)) { return false; }
+    bench->sink += (size_t)type + size + header_len;
+    return true;
+}
+
+/**
+ * bench_random - xorshift64*, so runs with the same seed parse the same inputs.
+ */
+static uint64_t bench_random(BenchParse *bench){
+    bench->rng ^= bench->rng >> 12;
+    bench->rng ^= bench->rng << 25;
+    bench->rng ^= bench->rng >> 27;
+    return bench->rng * 0x2545f4914f6cdd1dull;
+}
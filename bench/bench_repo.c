@@ -0,0 +1,501 @@
+/* bench_repo.c: end-to-end benchmarks on a synthetic repository */
+
+#include "bench.h"
+#include "commit_graph.h"
+#include "objects.h"
+#include "pack.h"
+#include "repack.h"
+#include "repository.h"
+#include "revwalk.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define BENCH_EPOCH     1700000000ull   /* committer date of the first commit */
+
+/* Structures */
+
+typedef struct {
+    size_t      objects;        /* blobs in the newest tree */
+    size_t      blob_size;      /* bytes per blob */
+    size_t      fanout;         /* entries per tree */
+    size_t      depth;          /* commits in the history */
+    size_t      iterations;     /* samples per operation */
+    size_t      seed;
+    const char  *dir;           /* workspace, created and removed by the run */
+    const char  *output;        /* JSON report, stdout if NULL */
+    bool        keep;           /* leave the workspace behind */
+} BenchOptions;
+
+typedef struct {
+    size_t        lo, hi;       /* blobs [lo, hi) live below this tree */
+    size_t        chunk;        /* blobs per child tree, 0 for a tree of blobs */
+    size_t        first;        /* index of the first child tree */
+    size_t        children;
+    unsigned char sha[SHA_SIZE];
+} BenchTree;
+
+typedef struct {
+    Repository    *repo;
+    const BenchOptions *options;
+    BenchTree     *trees;
+    size_t        tree_count;
+    size_t        tree_capacity;
+    unsigned char (*blobs)[SHA_SIZE];
+    unsigned char head[SHA_SIZE];
+    unsigned char *buf;         /* blob bodies and tree bodies are built here */
+    size_t        buf_size;
+    uint64_t      rng;
+    uint64_t      bytes;        /* blob bytes written */
+    size_t        written;      /* objects written */
+    size_t        path_commits; /* commits shown by the first path-limited walk */
+} BenchRepo;
+
+/* Forward Declaration of static Functions */
+
+static bool bench_parse(int argc, char *argv[], BenchOptions *options);
+static bool bench_generate(BenchRepo *gen);
+static void bench_tree_layout(BenchRepo *gen, size_t index, size_t lo, size_t hi);
+static bool bench_tree_write(BenchRepo *gen, BenchTree *tree);
+static bool bench_blob_write(BenchRepo *gen, size_t index, size_t version, unsigned char sha[SHA_SIZE]);
+static bool bench_commit_write(BenchRepo *gen, const unsigned char *parent, size_t serial, unsigned char sha[SHA_SIZE]);
+static bool bench_run(BenchRepo *gen, BenchReport *report);
+static bool bench_log(BenchRepo *gen, BenchReport *report, const char *name);
+static bool bench_log_path(BenchRepo *gen, BenchReport *report, const char *name);
+static bool bench_cat_file(BenchRepo *gen, BenchReport *report, const char *name);
+static uint64_t bench_random(BenchRepo *gen);
+
+/* Functions */
+
+int main(int argc, char *argv[]){
+    BenchOptions options = {
+        .objects = 10000, .blob_size = 1024, .fanout = 16, .depth = 200, .iterations = 100, .seed = 1,
+    };
+    if (!bench_parse(argc, argv, &options)) { return EXIT_FAILURE; }
+
+    char dir[MAX_PATH];
+    if (!options.dir){
+        snprintf(dir, sizeof(dir), "/tmp/git_bench.%ld", (long)getpid());
+        options.dir = dir;
+    }
+    if (file_exists(options.dir)){
+        fprintf(stderr, "bench_repo: %s already exists\n", options.dir);
+        return EXIT_FAILURE;
+    }
+    if (!mkdir_p(options.dir, 0777)) { return EXIT_FAILURE; }
+
+    char path[MAX_PATH];
+    path_join_buf(path, sizeof(path), options.dir, "repo", NULL);
+    BenchRepo gen = { .options = &options, .rng = options.seed * 0x9e3779b97f4a7c15ull + 1 };
+    BenchReport report = { 0 };
+    bool status = (gen.repo = repo_init(path)) != NULL && bench_generate(&gen) && bench_run(&gen, &report);
+
+    if (status){
+        char config[512];
+        snprintf(config, sizeof(config),
+                 "{\"objects\": %zu, \"blob_size\": %zu, \"fanout\": %zu, \"depth\": %zu, \"iterations\": %zu, \"seed\": %zu, \"trees\": %zu, \"written\": %zu}",
+                 options.objects, options.blob_size, options.fanout, options.depth, options.iterations, options.seed, gen.tree_count, gen.written);
+        FILE *fp = options.output ? safe_fopen(options.output, "w") : stdout;
+        bench_report_json(fp, &report, config);
+        if (fp != stdout) { fclose(fp); }
+    }
+
+    bench_report_free(&report);
+    repo_destroy(gen.repo);
+    free(gen.trees);
+    free(gen.blobs);
+    free(gen.buf);
+    if (!options.keep) { remove_directory(options.dir); }
+    return status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Static Functions */
+
+/**
+ * bench_parse - Reads --name=value options.
+ */
+static bool bench_parse(int argc, char *argv[], BenchOptions *options){
+    struct { const char *name; size_t *value; } sizes[] = {
+        { "--objects=", &options->objects }, { "--blob-size=", &options->blob_size }, { "--fanout=", &options->fanout },
+        { "--depth=", &options->depth }, { "--iterations=", &options->iterations }, { "--seed=", &options->seed },
+    };
+
+    for (int i = 1; i < argc; i++){
+        bool known = false;
+        for (size_t s = 0; !known && s < sizeof(sizes) / sizeof(sizes[0]); s++){
+            size_t len = strlen(sizes[s].name);
+            if (strncmp(argv[i], sizes[s].name, len) == 0){
+                known = parse_size(argv[i] + len, sizes[s].value);
+            }
+        }
+        if (known) { continue; }
+
+        if (strncmp(argv[i], "--dir=", 6) == 0 && argv[i][6]){
+            options->dir = argv[i] + 6;
+        } else if (strncmp(argv[i], "--output=", 9) == 0 && argv[i][9]){
+            options->output = argv[i] + 9;
+        } else if (streq(argv[i], "--keep")){
+            options->keep = true;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0){
+            continue;   /* bench_parse's, so one BENCH_ARGS can drive every benchmark */
+        } else {
+            fprintf(stderr, "usage: %s [--objects=N] [--blob-size=N] [--fanout=N] [--depth=N] [--iterations=N]\n"
+                            "       [--seed=N] [--dir=PATH] [--output=FILE] [--keep]\n", argv[0]);
+            return false;
+        }
+    }
+
+    if (!options->objects || options->fanout < 2 || !options->depth || !options->iterations){
+        fprintf(stderr, "bench_repo: objects, depth and iterations must be positive and fanout at least 2\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * bench_generate - Writes the history of the synthetic repository.
+ *
+ * The first commit holds every blob, spread over a tree of the requested
+ * fan-out. Each later commit rewrites one blob and the trees above it, so
+ * history grows the way an edited project does: one blob and a few trees
+ * per commit. refs/heads/master points at the newest commit.
+ */
+static bool bench_generate(BenchRepo *gen){
+    const BenchOptions *options = gen->options;
+    uint64_t start = bench_now();
+
+    gen->buf_size = (options->blob_size > 64 ? options->blob_size : 64) + 64 * options->fanout;
+    gen->buf = safe_malloc(gen->buf_size, 1);
+    gen->blobs = safe_malloc(options->objects, SHA_SIZE);
+    gen->tree_capacity = 64;
+    gen->trees = safe_malloc(gen->tree_capacity, sizeof(BenchTree));
+    gen->tree_count = 1;
+    bench_tree_layout(gen, 0, 0, options->objects);
+
+    for (size_t i = 0; i < options->objects; i++){
+        if (!bench_blob_write(gen, i, 0, gen->blobs[i])) { return false; }
+    }
+    /* children come after their parent, so writing backwards is bottom-up */
+    for (size_t t = gen->tree_count; t-- > 0;){
+        if (!bench_tree_write(gen, &gen->trees[t])) { return false; }
+    }
+    if (!bench_commit_write(gen, NULL, 0, gen->head)) { return false; }
+
+    size_t path[64];
+    for (size_t serial = 1; serial < options->depth; serial++){
+        size_t blob = (serial * 2654435761u) % options->objects;
+        if (!bench_blob_write(gen, blob, serial, gen->blobs[blob])) { return false; }
+
+        size_t depth = 0;
+        for (size_t t = 0; ; ){
+            path[depth++] = t;
+            BenchTree *tree = &gen->trees[t];
+            if (!tree->chunk) { break; }
+            t = tree->first + (blob - tree->lo) / tree->chunk;
+        }
+        while (depth-- > 0){
+            if (!bench_tree_write(gen, &gen->trees[path[depth]])) { return false; }
+        }
+        unsigned char parent[SHA_SIZE];
+        memcpy(parent, gen->head, SHA_SIZE);
+        if (!bench_commit_write(gen, parent, serial, gen->head)) { return false; }
+    }
+
+    char ref[MAX_PATH], hex[SHA_HEX_SIZE];
+    sha_to_hex(gen->head, hex);
+    repo_path_buf(gen->repo, ref, sizeof(ref), "refs", "heads", "master", NULL);
+    FILE *fp = fopen(ref, "w");
+    if (!fp || fprintf(fp, "%s\n", hex) < 0 || fclose(fp) != 0){
+        fprintf(stderr, "bench_repo: cannot write %s\n", ref);
+        return false;
+    }
+
+    fprintf(stderr, "bench_repo: wrote %zu objects (%zu trees, %zu commits) in %.2fs\n",
+            gen->written, gen->tree_count, options->depth, (double)(bench_now() - start) / 1e9);
+    return true;
+}
+
+/**
+ * bench_tree_layout - Splits the blobs [lo, hi) into a tree and its subtrees.
+ *
+ * The children of a tree are contiguous and always come after it.
+ *
+ * @param index Slot of the tree in gen->trees, already reserved.
+ */
+static void bench_tree_layout(BenchRepo *gen, size_t index, size_t lo, size_t hi){
+    size_t fanout = gen->options->fanout;
+    BenchTree tree = { .lo = lo, .hi = hi };
+    if (hi - lo > fanout){
+        tree.chunk = (hi - lo + fanout - 1) / fanout;
+        tree.children = (hi - lo + tree.chunk - 1) / tree.chunk;
+        tree.first = gen->tree_count;
+        gen->tree_count += tree.children;
+        if (gen->tree_count > gen->tree_capacity){
+            gen->tree_capacity = 2 * gen->tree_count;
+            gen->trees = realloc(gen->trees, gen->tree_capacity * sizeof(BenchTree));
+            MALLOC_CHECK(gen->trees);
+        }
+    }
+    gen->trees[index] = tree;
+
+    for (size_t c = 0; c < tree.children; c++){
+        size_t child_lo = lo + c * tree.chunk;
+        bench_tree_layout(gen, tree.first + c, child_lo, min(child_lo + tree.chunk, hi));
+    }
+}
+
+/**
+ * bench_tree_write - Writes a tree from the current shas of its entries.
+ *
+ * Names are zero-padded so that numeric order is tree order.
+ */
+static bool bench_tree_write(BenchRepo *gen, BenchTree *tree){
+    size_t len = 0;
+    size_t entries = tree->chunk ? tree->children : tree->hi - tree->lo;
+    for (size_t e = 0; e < entries; e++){
+        const unsigned char *sha = tree->chunk ? gen->trees[tree->first + e].sha : gen->blobs[tree->lo + e];
+        len += (size_t)sprintf((char *)gen->buf + len, tree->chunk ? "40000 d%04zu" : "100644 f%08zu", tree->chunk ? e : tree->lo + e) + 1;
+        memcpy(gen->buf + len, sha, SHA_SIZE);
+        len += SHA_SIZE;
+    }
+    gen->written++;
+    return object_write_buffer(gen->repo, OBJ_TREE, gen->buf, len, tree->sha);
+}
+
+/**
+ * bench_blob_write - Writes one version of a blob.
+ *
+ * The body starts with its index and version, so every blob is distinct,
+ * and is filled with lowercase words so that it compresses like text.
+ */
+static bool bench_blob_write(BenchRepo *gen, size_t index, size_t version, unsigned char sha[SHA_SIZE]){
+    size_t len = (size_t)snprintf((char *)gen->buf, gen->buf_size, "blob %zu version %zu\n", index, version);
+    size_t size = gen->options->blob_size > len ? gen->options->blob_size : len;
+    while (len < size){
+        uint64_t r = bench_random(gen);
+        size_t word = 2 + r % 8;
+        for (size_t i = 0; i < word && len < size; i++, r >>= 5) { gen->buf[len++] = (unsigned char)('a' + r % 26); }
+        if (len < size) { gen->buf[len++] = (r & 7) ? ' ' : '\n'; }
+    }
+    gen->bytes += size;
+    gen->written++;
+    return object_write_buffer(gen->repo, OBJ_BLOB, gen->buf, size, sha);
+}
+
+/**
+ * bench_commit_write - Writes a commit of the root tree, one second after its parent.
+ */
+static bool bench_commit_write(BenchRepo *gen, const unsigned char *parent, size_t serial, unsigned char sha[SHA_SIZE]){
+    char body[512], hex[SHA_HEX_SIZE];
+    sha_to_hex(gen->trees[0].sha, hex);
+    int len = snprintf(body, sizeof(body), "tree %s\n", hex);
+    if (parent){
+        sha_to_hex(parent, hex);
+        len += snprintf(body + len, sizeof(body) - (size_t)len, "parent %s\n", hex);
+    }
+    unsigned long long date = BENCH_EPOCH + serial;
+    len += snprintf(body + len, sizeof(body) - (size_t)len,
+                    "author Bench <bench@example.com> %llu +0000\ncommitter Bench <bench@example.com> %llu +0000\n\ncommit %zu\n",
+                    date, date, serial);
+    gen->written++;
+    return object_write_buffer(gen->repo, OBJ_COMMIT, body, (size_t)len, sha);
+}
+
+/**
+ * bench_run - Times each operation against the generated repository.
+ *
+ * Reads are timed first from loose objects, then again once everything has
+ * been packed, and history walks a third time with a commit-graph, then
+ * once more with changed-path filters.
+ */
+static bool bench_run(BenchRepo *gen, BenchReport *report){
+    const BenchOptions *options = gen->options;
+    char path[MAX_PATH];
+
+    BenchResult *result = bench_result(report, "init");
+    for (size_t i = 0; i < options->iterations; i++){
+        snprintf(path, sizeof(path), "%s/init/%zu", options->dir, i);
+        uint64_t start = bench_now();
+        Repository *repo = repo_init(path);
+        bench_sample(result, bench_now() - start);
+        if (!repo) { return false; }
+        repo_destroy(repo);
+    }
+    snprintf(path, sizeof(path), "%s/init", options->dir);
+    remove_directory(path);
+
+    /* from a few directories down, as a command run inside a project would */
+    path_join_buf(path, sizeof(path), gen->repo->worktree, "src", "lib", "deep", "dir", NULL);
+    if (!mkdir_p(path, 0777)) { return false; }
+    /* each command is a new process, so the cold upward walk is the real cost */
+    result = bench_result(report, "repo_find");
+    for (size_t i = 0; i < options->iterations; i++){
+        repo_discovery_reset();
+        uint64_t start = bench_now();
+        Repository *repo = repo_find(path, true);
+        bench_sample(result, bench_now() - start);
+        if (!repo) { return false; }
+        repo_destroy(repo);
+    }
+    result = bench_result(report, "repo_find (in-process cache)");
+    for (size_t i = 0; i < options->iterations; i++){
+        uint64_t start = bench_now();
+        Repository *repo = repo_find(path, true);
+        bench_sample(result, bench_now() - start);
+        if (!repo) { return false; }
+        repo_destroy(repo);
+    }
+
+    result = bench_result(report, "hash-object");
+    for (size_t i = 0; i < options->iterations; i++){
+        unsigned char sha[SHA_SIZE];
+        uint64_t bytes = gen->bytes;
+        uint64_t start = bench_now();
+        bool ok = bench_blob_write(gen, options->objects + i, 0, sha);
+        bench_sample(result, bench_now() - start);
+        if (!ok) { return false; }
+        result->bytes += gen->bytes - bytes;
+    }
+
+    if (!bench_cat_file(gen, report, "cat-file (loose)") || !bench_log(gen, report, "log (loose)")) { return false; }
+
+    RepackOptions repack = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true };
+    RepackResult packed;
+    result = bench_result(report, "repack");
+    uint64_t start = bench_now();
+    if (!repack_loose(gen->repo, &repack, &packed)) { return false; }
+    bench_sample(result, bench_now() - start);
+    result->items = packed.objects;
+    pack_list_free(gen->repo);
+
+    if (!bench_cat_file(gen, report, "cat-file (packed)")) { return false; }
+
+    if (!pack_list(gen->repo)) { return false; }
+    result = bench_result(report, "pack lookup");
+    for (size_t i = 0; i < options->iterations; i++){
+        const unsigned char *sha = gen->blobs[bench_random(gen) % options->objects];
+        uint64_t offset;
+        start = bench_now();
+        bool found = pack_lookup(gen->repo, sha, &offset) != NULL;
+        bench_sample(result, bench_now() - start);
+        if (!found) { return false; }
+    }
+    result = bench_result(report, "pack lookup (missing)");
+    for (size_t i = 0; i < options->iterations; i++){
+        unsigned char sha[SHA_SIZE];
+        for (size_t b = 0; b < SHA_SIZE; b += 8){
+            uint64_t r = bench_random(gen);
+            memcpy(sha + b, &r, min(8, SHA_SIZE - b));
+        }
+        uint64_t offset;
+        start = bench_now();
+        pack_lookup(gen->repo, sha, &offset);
+        bench_sample(result, bench_now() - start);
+    }
+
+    if (!bench_log(gen, report, "log (packed)") || !bench_log_path(gen, report, "log -- path (packed)")) { return false; }
+    if (!commit_graph_write(gen->repo, false, NULL)) { return false; }
+    commit_graph_free(gen->repo);
+    if (!bench_log(gen, report, "log (commit-graph)") || !bench_log_path(gen, report, "log -- path (commit-graph)")) { return false; }
+    if (!commit_graph_write(gen->repo, true, NULL)) { return false; }
+    commit_graph_free(gen->repo);
+    return bench_log_path(gen, report, "log -- path (changed-paths)");
+}
+
+/**
+ * bench_log - Times walks of the whole history, parsing every commit again each time.
+ */
+static bool bench_log(BenchRepo *gen, BenchReport *report, const char *name){
+    BenchResult *result = bench_result(report, name);
+    for (size_t i = 0; i < gen->options->iterations; i++){
+        object_cache_free(gen->repo);
+        RevWalk walk;
+        RevCommit commit;
+        size_t count = 0;
+        uint64_t start = bench_now();
+        revwalk_init(&walk, gen->repo);
+        bool status = revwalk_push(&walk, gen->head);
+        while (status && revwalk_next(&walk, &commit)) { count++; }
+        status = status && !walk.error;
+        revwalk_release(&walk);
+        bench_sample(result, bench_now() - start);
+        if (!status || count != gen->options->depth){
+            fprintf(stderr, "bench_repo: %s walked %zu of %zu commits\n", name, count, gen->options->depth);
+            return false;
+        }
+        result->items += count;
+    }
+    return true;
+}
+
+/**
+ * bench_log_path - Times walks limited to the first entry of the root tree.
+ *
+ * Every version of a walk must show the same commits as the first one.
+ */
+static bool bench_log_path(BenchRepo *gen, BenchReport *report, const char *name){
+    BenchResult *result = bench_result(report, name);
+    char path[32];
+    snprintf(path, sizeof(path), gen->trees[0].chunk ? "d%04d" : "f%08d", 0);
+    char *paths[1] = { path };
+    for (size_t i = 0; i < gen->options->iterations; i++){
+        object_cache_free(gen->repo);
+        RevWalk walk;
+        RevCommit commit;
+        size_t count = 0;
+        uint64_t start = bench_now();
+        revwalk_init(&walk, gen->repo);
+        revwalk_limit_paths(&walk, paths, 1);
+        bool status = revwalk_push(&walk, gen->head);
+        while (status && revwalk_next(&walk, &commit)) { count++; }
+        status = status && !walk.error;
+        revwalk_release(&walk);
+        bench_sample(result, bench_now() - start);
+        if (!gen->path_commits) { gen->path_commits = count; }
+        if (!status || count != gen->path_commits){
+            fprintf(stderr, "bench_repo: %s showed %zu commits instead of %zu\n", name, count, gen->path_commits);
+            return false;
+        }
+        result->items += count;
+    }
+    return true;
+}
+
+/**
+ * bench_cat_file - Times reading whole blobs picked at random.
+ */
+static bool bench_cat_file(BenchRepo *gen, BenchReport *report, const char *name){
+    BenchResult *result = bench_result(report, name);
+    for (size_t i = 0; i < gen->options->iterations; i++){
+        const unsigned char *sha = gen->blobs[bench_random(gen) % gen->options->objects];
+        ObjectType type;
+        size_t size;
+        uint64_t start = bench_now();
+        unsigned char *data = object_read(gen->repo, sha, &type, &size);
+        bench_sample(result, bench_now() - start);
+        if (!data){
+            fprintf(stderr, "bench_repo: %s could not read a blob\n", name);
+            return false;
+        }
+        free(data);
+        result->bytes += size;
+    }
+    return true;
+}
+
+/**
+ * bench_random - xorshift64*, so runs with the same seed read the same objects.
+ */
+static uint64_t bench_random(BenchRepo *gen){
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545f4914f6cdd1dull;
+}
@@ -0,0 +1,26 @@
+/* fuzz.h: libFuzzer entry point shared by the fuzz targets and the replay driver */
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Macros */
+
+/* an invariant the parser broke; abort so libFuzzer keeps the input */
+#define FUZZ_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: FUZZ_CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            abort(); \
+        } \
+    } while (0)
+
+/* Functions */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
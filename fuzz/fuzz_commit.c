@@ -0,0 +1,73 @@
+/* fuzz_commit.c: fuzz target for kvlm_parse and the commit and tag accessors */
+
+#include "fuzz.h"
+#include "kvlm.h"
+#include "objects.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Functions */
+
+/**
+ * LLVMFuzzerTestOneInput - Parses the input as a commit body.
+ *
+ * Every field must be a view inside the body whose key holds no space or
+ * newline and is found again by kvlm_get(); the message must run to the
+ * end of the body. The commit and tag accessors must cope with whatever
+ * values the fields hold.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    Arena arena = { 0 };
+    GitCommit commit = { .object = { .type = OBJ_COMMIT, .size = size, .data = data } };
+    if (!kvlm_parse(&commit.kvlm, data, size, &arena)){
+        arena_clear(&arena);
+        return 0;
+    }
+
+    Kvlm *kvlm = &commit.kvlm;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < kvlm->count; i++){
+        KvlmField *field = &kvlm->fields[i];
+        FUZZ_CHECK(field->key_len > 0 && field->key_off >= previous);
+        FUZZ_CHECK((size_t)field->key_off + field->key_len < size && data[field->key_off + field->key_len] == ' ');
+        FUZZ_CHECK(field->value_off == field->key_off + field->key_len + 1);
+        FUZZ_CHECK((size_t)field->value_off + field->value_len <= kvlm->message_off);
+        FUZZ_CHECK(!memchr(data + field->key_off, ' ', field->key_len) && !memchr(data + field->key_off, '\n', field->key_len));
+        previous = field->value_off + field->value_len;
+
+        size_t len;
+        const unsigned char *value = kvlm_value(kvlm, field, &arena, &len);
+        FUZZ_CHECK(value != NULL && len <= field->value_len);
+        if (!field->multiline) { FUZZ_CHECK(len == field->value_len && memcmp(value, data + field->value_off, len) == 0); }
+
+        char key[64];
+        if (field->key_len < sizeof(key) && !memchr(data + field->key_off, '\0', field->key_len)){
+            memcpy(key, data + field->key_off, field->key_len);
+            key[field->key_len] = '\0';
+            KvlmField *first = kvlm_get(kvlm, key, 0);
+            FUZZ_CHECK(first != NULL && first <= field && kvlm_count(kvlm, key) >= 1);
+        }
+    }
+    FUZZ_CHECK((size_t)kvlm->message_off + kvlm->message_len == size);
+
+    size_t len;
+    const unsigned char *message = kvlm_message(kvlm, &len);
+    FUZZ_CHECK(len == kvlm->message_len && (!len || message == data + kvlm->message_off));
+    const unsigned char *summary = kvlm_summary(kvlm, &len);
+    FUZZ_CHECK(!len || (summary >= data && summary + len <= data + size));
+
+    unsigned char sha[SHA_SIZE];
+    commit_tree(&commit, sha);
+    size_t parents = commit_parent_count(&commit);
+    for (size_t p = 0; p < parents; p++) { commit_parent(&commit, p, sha); }
+    FUZZ_CHECK(!commit_parent(&commit, parents, sha));
+    commit_date(&commit);
+
+    GitTag tag = { .object = { .type = OBJ_TAG, .size = size, .data = data }, .kvlm = commit.kvlm };
+    tag_target(&tag, sha);
+
+    arena_clear(&arena);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* fuzz_config.c: fuzz target for ini_parse through repo_config_create */
+
+#include "fuzz.h"
+#include "config.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Structures */
+
+static char fuzz_config_path[MAX_PATH];    /* scratch file, named on the first input */
+
+/* Forward Declaration of static Functions */
+
+static void fuzz_config_remove(void);
+
+/* Functions */
+
+/**
+ * LLVMFuzzerTestOneInput - Loads the input as a repository's config file.
+ *
+ * repo_config_create() only reads files, so the input is written to one
+ * scratch file first, and the global files are skipped. Every key stored
+ * must then be found again, in the table and in a copy of it, including
+ * keys given without a value.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    if (!fuzz_config_path[0]){
+        setenv("GIT_CONFIG_GLOBAL", "/dev/null", 1);
+        snprintf(fuzz_config_path, sizeof(fuzz_config_path), "/tmp/fuzz_config.%ld", (long)getpid());
+        atexit(fuzz_config_remove);
+    }
+
+    FILE *fp = fopen(fuzz_config_path, "wb");
+    FUZZ_CHECK(fp != NULL);
+    FUZZ_CHECK(fwrite(data, 1, size, fp) == size && fclose(fp) == 0);
+
+    Configuration *config = repo_config_create(fuzz_config_path);
+    if (!config) { return 0; }
+
+    Configuration *copy = config_copy(config);
+    FUZZ_CHECK(copy != NULL && copy->count == config->count && 2 * config->count <= config->capacity);
+    size_t seen = 0;
+    for (size_t i = 0; i < config->capacity; i++){
+        const ConfigEntry *entry = &config->entries[i];
+        if (!entry->key) { continue; }
+        seen++;
+        FUZZ_CHECK(config_has(config, entry->key) && config_get(config, entry->key) == entry->value);
+        const char *value = config_get(copy, entry->key);
+        FUZZ_CHECK(config_has(copy, entry->key) && (value && entry->value ? strcmp(value, entry->value) == 0 : value == entry->value));
+    }
+    FUZZ_CHECK(seen == config->count);
+
+    config_free(copy);
+    config_free(config);
+    return 0;
+}
+
+/* Static Functions */
+
+static void fuzz_config_remove(void){
+    unlink(fuzz_config_path);
+}
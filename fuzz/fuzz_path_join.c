@@ -0,0 +1,54 @@
+/* fuzz_path_join.c: fuzz target for path_join and path_join_buf */
+
+#include "fuzz.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Macros */
+
+#define FUZZ_PARTS 4
+
+/* Functions */
+
+/**
+ * LLVMFuzzerTestOneInput - Joins the NUL-separated parts of the input.
+ *
+ * The first byte picks the size of a small buffer. path_join_buf() must
+ * build exactly what path_join() allocates whenever the result fits, and
+ * return 0 with an empty buffer when it does not.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    if (size == 0) { return 0; }
+    size_t small = data[0];
+    char *copy = safe_malloc(size, 1);
+    memcpy(copy, data + 1, size - 1);
+    copy[size - 1] = '\0';
+
+    const char *parts[FUZZ_PARTS] = { "", "", "", "" };
+    char *p = copy;
+    for (size_t i = 0; i < FUZZ_PARTS && p < copy + size - 1; i++){
+        parts[i] = p;
+        p += strlen(p) + 1;
+    }
+
+    char *joined = path_join(parts[0], parts[1], parts[2], parts[3], NULL);
+    FUZZ_CHECK(joined != NULL);
+    size_t expected = strlen(joined);
+
+    char *buf = safe_malloc(expected + 1, 1);
+    FUZZ_CHECK(path_join_buf(buf, expected + 1, parts[0], parts[1], parts[2], parts[3], NULL) == expected);
+    FUZZ_CHECK(strcmp(buf, joined) == 0);
+    free(buf);
+
+    buf = safe_malloc(small ? small : 1, 1);
+    size_t len = path_join_buf(buf, small, parts[0], parts[1], parts[2], parts[3], NULL);
+    if (small > expected) { FUZZ_CHECK(len == expected && strcmp(buf, joined) == 0); }
+    else if (small) { FUZZ_CHECK(len == 0 && buf[0] == '\0'); }
+    free(buf);
+
+    free(joined);
+    free(copy);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/* fuzz_tree.c: fuzz target for tree_parse and tree_find */
+
+#include "fuzz.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Functions */
+
+/**
+ * LLVMFuzzerTestOneInput - Parses the input as a tree body.
+ *
+ * Each leaf must name a NUL-terminated run of the body followed by its
+ * SHA, the sorted flag must agree with tree_name_compare(), and looking a
+ * leaf's name up again must find an entry of that name, by bisection in
+ * sorted trees and by scanning in the rest.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    Arena arena = { 0 };
+    Tree tree;
+    if (!tree_parse(&tree, data, size, &arena)){
+        arena_clear(&arena);
+        return 0;
+    }
+
+    bool ascending = true;
+    for (size_t i = 0; i < tree.count; i++){
+        const TreeLeaf *leaf = &tree.leaves[i];
+        FUZZ_CHECK(leaf->name_len > 0 && (size_t)leaf->name_off + leaf->name_len + 1 + SHA_SIZE <= size);
+        FUZZ_CHECK(data[leaf->name_off + leaf->name_len] == '\0' && !memchr(data + leaf->name_off, '\0', leaf->name_len));
+        FUZZ_CHECK(memcmp(leaf->sha, data + leaf->name_off + leaf->name_len + 1, SHA_SIZE) == 0);
+        FUZZ_CHECK(tree_leaf_type(leaf) != NULL);
+        if (i){
+            const TreeLeaf *prev = leaf - 1;
+            FUZZ_CHECK(leaf->name_off > prev->name_off + prev->name_len + SHA_SIZE);
+            ascending = ascending && tree_name_compare(tree_leaf_name(&tree, prev), prev->name_len, prev->mode,
+                                                       tree_leaf_name(&tree, leaf), leaf->name_len, leaf->mode) < 0;
+        }
+    }
+    FUZZ_CHECK(tree.sorted == ascending);
+
+    for (size_t i = 0; i < tree.count; i++){
+        const TreeLeaf *leaf = &tree.leaves[i];
+        const TreeLeaf *found = tree_find(&tree, tree_leaf_name(&tree, leaf), leaf->name_len);
+        FUZZ_CHECK(found != NULL && found->name_len == leaf->name_len);
+        FUZZ_CHECK(memcmp(tree_leaf_name(&tree, found), tree_leaf_name(&tree, leaf), leaf->name_len) == 0);
+    }
+
+    arena_clear(&arena);
+    return 0;
+}
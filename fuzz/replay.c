@@ -0,0 +1,95 @@
+/* replay.c: runs fuzz inputs through a target without libFuzzer */
+
+#include "fuzz.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Forward Declaration of static Functions */
+
+static bool replay_path(const char *path, size_t *count);
+static bool replay_file(const char *path);
+
+/* Functions */
+
+/**
+ * main - Feeds every file named on the command line, and every file in the
+ * directories named there, to LLVMFuzzerTestOneInput() once.
+ *
+ * Linked against the normal objects in place of libFuzzer, this keeps the
+ * corpus passing with any compiler; a failed FUZZ_CHECK aborts the run.
+ */
+int main(int argc, char *argv[]){
+    if (argc < 2){
+        fprintf(stderr, "usage: %s FILE|DIR...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t count = 0;
+    for (int i = 1; i < argc; i++){
+        if (!replay_path(argv[i], &count)) { return EXIT_FAILURE; }
+    }
+    printf("%s: %zu inputs passed\n", argv[0], count);
+    return EXIT_SUCCESS;
+}
+
+/* Static Functions */
+
+/**
+ * replay_path - Runs a file, or the files of a directory in name order.
+ */
+static bool replay_path(const char *path, size_t *count){
+    struct stat sb;
+    if (stat(path, &sb) != 0){
+        fprintf(stderr, "replay: cannot stat %s\n", path);
+        return false;
+    }
+    if (!S_ISDIR(sb.st_mode)){
+        (*count)++;
+        return replay_file(path);
+    }
+
+    struct dirent **names;
+    int n = scandir(path, &names, NULL, alphasort);
+    if (n < 0){
+        fprintf(stderr, "replay: cannot list %s\n", path);
+        return false;
+    }
+    bool status = true;
+    for (int i = 0; i < n; i++){
+        char child[PATH_MAX];
+        if (status && names[i]->d_name[0] != '.' && path_join_buf(child, sizeof(child), path, names[i]->d_name, NULL)){
+            status = replay_path(child, count);
+        }
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+/**
+ * replay_file - Runs one input, from a buffer of exactly its size.
+ */
+static bool replay_file(const char *path){
+    FILE *fp = fopen(path, "rb");
+    if (!fp){
+        fprintf(stderr, "replay: cannot open %s\n", path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    uint8_t *data = safe_malloc(size > 0 ? (size_t)size : 1, 1);
+    bool status = size >= 0 && fread(data, 1, (size_t)size, fp) == (size_t)size;
+    fclose(fp);
+    if (status) { LLVMFuzzerTestOneInput(data, (size_t)size); }
+    else { fprintf(stderr, "replay: cannot read %s\n", path); }
+    free(data);
+    return status;
+}
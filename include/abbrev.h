@@ -0,0 +1,54 @@
+/* abbrev.h: abbreviated object names */
+
+#ifndef ABBREV_H
+#define ABBREV_H
+
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Macros */
+
+#define ABBREV_MIN_LEN      4           /* shorter prefixes are not looked up, as in git */
+#define ABBREV_DEFAULT_LEN  7           /* fewest digits of an automatic core.abbrev */
+
+/* Structures */
+
+typedef enum {
+    ABBREV_NONE,                        /* no object starts with the prefix */
+    ABBREV_UNIQUE,
+    ABBREV_AMBIGUOUS,
+} AbbrevStatus;
+
+typedef struct {
+    unsigned char   (*shas)[SHA_SIZE];  /* sorted loose object names of objects/xx */
+    size_t          count;
+    bool            loaded;
+    struct timespec mtime;              /* of the directory when it was listed */
+} LooseBucket;
+
+typedef struct LooseObjectCache {
+    LooseBucket buckets[REPO_FANOUT_DIRS];
+} LooseObjectCache;
+
+typedef struct {
+    unsigned char (*shas)[SHA_SIZE];    /* distinct objects, in the order found */
+    size_t        count;
+    size_t        capacity;
+} AbbrevMatches;
+
+/* Functions */
+
+bool         abbrev_matches(Repository *repo, const char *hex, size_t len, size_t limit, AbbrevMatches *matches);
+AbbrevStatus abbrev_resolve(Repository *repo, const char *hex, size_t len, ObjectType type, unsigned char sha[SHA_SIZE]);
+size_t       abbrev_unique_len(Repository *repo, const unsigned char sha[SHA_SIZE], size_t min_len);
+size_t       abbrev_default_len(Repository *repo);
+void         abbrev_matches_free(AbbrevMatches *matches);
+void         loose_cache_free(Repository *repo);
+
+#endif
@@ -0,0 +1,55 @@
+/* bloom.h: changed-path Bloom filters */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define BLOOM_HASH_VERSION          1
+#define BLOOM_NUM_HASHES            7
+#define BLOOM_BITS_PER_ENTRY        10
+#define BLOOM_MAX_CHANGED_PATHS     512         /* more and the filter says "maybe" for everything */
+#define BLOOM_HEADER_SIZE           12          /* BDAT: version, hashes, bits per entry */
+#define BLOOM_SEED0                 0x293ae76fu
+#define BLOOM_SEED1                 0x7e646e2cu
+
+/* Structures */
+
+typedef struct {
+    const unsigned char *data;
+    size_t               len;               /* bytes; 0 means not computed */
+} BloomFilter;
+
+typedef struct {
+    uint32_t hashes[BLOOM_NUM_HASHES];
+} BloomKey;
+
+typedef struct {
+    char   *names;                          /* NUL-terminated paths, back to back */
+    size_t  len;
+    size_t  capacity;
+    size_t  *offsets;                       /* start of each path in names */
+    size_t  count;
+    size_t  offset_capacity;
+    size_t  changes;                        /* files added, removed or modified */
+} BloomPaths;
+
+/* Functions */
+
+uint32_t bloom_murmur3(uint32_t seed, const char *data, size_t len);
+void     bloom_key(BloomKey *key, const char *path, size_t len);
+void     bloom_add(unsigned char *data, size_t len, const BloomKey *key);
+bool     bloom_maybe_contains(const BloomFilter *filter, const BloomKey *key);
+
+bool     bloom_changed_paths(Repository *repo, const unsigned char *old_tree, const unsigned char *new_tree, BloomPaths *paths);
+size_t   bloom_filter_build(const BloomPaths *paths, unsigned char **data);
+void     bloom_paths_clear(BloomPaths *paths);
+
+#endif
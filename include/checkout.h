@@ -0,0 +1,33 @@
+/* checkout.h: writing trees out to a directory */
+
+#ifndef CHECKOUT_H
+#define CHECKOUT_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define CHECKOUT_BATCH          32          /* files per worker job */
+#define CHECKOUT_WRITE_BUFFER   (1 << 20)   /* inflated bytes gathered per write() */
+#define CHECKOUT_PARALLEL_MIN   100         /* fewer files are written on the calling thread */
+
+/* Structures */
+
+typedef struct {
+    size_t   files;         /* regular files written */
+    size_t   symlinks;
+    size_t   dirs;          /* directories created, gitlinks included */
+    uint64_t bytes;         /* file contents written */
+    size_t   threads;       /* workers used */
+} CheckoutStats;
+
+/* Functions */
+
+bool checkout_tree(Repository *repo, const unsigned char tree[SHA_SIZE], const char *path, size_t threads, CheckoutStats *stats);
+
+#endif
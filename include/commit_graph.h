@@ -0,0 +1,81 @@
+/* commit_graph.h: objects/info/commit-graph reader and writer */
+
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include "bloom.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define COMMIT_GRAPH_SIGNATURE      "CGPH"
+#define COMMIT_GRAPH_VERSION        1
+#define COMMIT_GRAPH_HASH_VERSION   1           /* SHA-1 */
+#define COMMIT_GRAPH_HEADER_SIZE    8
+#define COMMIT_GRAPH_FANOUT         256
+#define COMMIT_GRAPH_DATA_SIZE      (SHA_SIZE + 16)
+
+#define COMMIT_GRAPH_CHUNK_OIDF     0x4f494446  /* "OIDF" */
+#define COMMIT_GRAPH_CHUNK_OIDL     0x4f49444c  /* "OIDL" */
+#define COMMIT_GRAPH_CHUNK_CDAT     0x43444154  /* "CDAT" */
+#define COMMIT_GRAPH_CHUNK_EDGE     0x45444745  /* "EDGE" */
+#define COMMIT_GRAPH_CHUNK_BIDX     0x42494458  /* "BIDX" */
+#define COMMIT_GRAPH_CHUNK_BDAT     0x42444154  /* "BDAT" */
+
+#define COMMIT_GRAPH_NO_PARENT      0x70000000u
+#define COMMIT_GRAPH_EXTRA_EDGES    0x80000000u /* in parent 2: index into EDGE */
+#define COMMIT_GRAPH_LAST_EDGE      0x80000000u /* in EDGE: last parent of the commit */
+#define COMMIT_GRAPH_GENERATION_MAX 0x3fffffffu
+#define COMMIT_GRAPH_GENERATION_INFINITY 0xffffffffu  /* commits missing from the graph */
+
+/* Structures */
+
+typedef struct CommitGraph {
+    const unsigned char *map;
+    size_t               size;
+    uint32_t             count;         /* number of commits */
+    const unsigned char *fanout;
+    const unsigned char *oids;          /* count sorted 20-byte SHAs */
+    const unsigned char *commit_data;   /* count fixed-width CDAT records */
+    const unsigned char *edges;         /* extra parents of octopus merges */
+    size_t               edge_count;
+    const unsigned char *bloom_index;   /* count cumulative filter ends, NULL without filters */
+    const unsigned char *bloom_data;    /* filters, after the BDAT header */
+    size_t               bloom_size;
+} CommitGraph;
+
+typedef struct {
+    const unsigned char *tree;          /* raw SHA inside the mapping */
+    uint32_t             generation;    /* topological level; roots are 1 */
+    uint64_t             date;          /* committer time */
+} CommitGraphCommit;
+
+typedef struct {
+    size_t commits;
+    size_t edges;                       /* EDGE entries written for octopus merges */
+    size_t filters;                     /* changed-path filters written */
+    size_t filters_large;               /* of which too many paths changed to be useful */
+} CommitGraphStats;
+
+/* Functions */
+
+CommitGraph *commit_graph_open(const char *path);
+void         commit_graph_close(CommitGraph *graph);
+CommitGraph *commit_graph_load(Repository *repo);
+void         commit_graph_free(Repository *repo);
+
+bool         commit_graph_find(const CommitGraph *graph, const unsigned char sha[SHA_SIZE], uint32_t *pos);
+bool         commit_graph_commit(const CommitGraph *graph, uint32_t pos, CommitGraphCommit *commit);
+size_t       commit_graph_parents(const CommitGraph *graph, uint32_t pos, uint32_t *parents, size_t max);
+bool         commit_graph_bloom(const CommitGraph *graph, uint32_t pos, BloomFilter *filter);
+
+bool         commit_graph_write(Repository *repo, bool changed_paths, CommitGraphStats *stats);
+
+static inline const unsigned char *commit_graph_oid(const CommitGraph *graph, uint32_t pos) { return graph->oids + (size_t)pos * SHA_SIZE; }
+
+#endif
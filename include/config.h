@@ -0,0 +1,67 @@
+/* config.h: git config files */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Macros */
+
+#define CONFIG_TABLE_INITIAL  64    /* slots; the table doubles at half load */
+#define CONFIG_KEY_MAX        256   /* longest "section.subsection.name" looked up */
+#define CONFIG_INCLUDE_DEPTH  10    /* nested include.path followed, as git does */
+#define CONFIG_MAX_SOURCES    16    /* files remembered for config_is_current() */
+
+/* Structures */
+
+typedef struct {
+    char     *key;          /* section and name lowercased, subsection kept */
+    char     *value;
+    uint32_t hash;
+} ConfigEntry;
+
+typedef struct {
+    char     *path;
+    bool     exists;        /* absent files are recorded too, so creating one is noticed */
+    dev_t    dev;
+    ino_t    ino;
+    off_t    size;
+    struct timespec mtime;
+} ConfigSource;
+
+typedef struct {
+    int repo_format_version;
+    bool filemode;
+    bool bare;
+    size_t delta_base_cache_limit;   /* byte budget for cached delta bases */
+
+    ConfigEntry  *entries;          /* open-addressed on hash, NULL key marks a free slot */
+    size_t       capacity;
+    size_t       count;
+    ConfigSource sources[CONFIG_MAX_SOURCES];
+    size_t       source_count;
+    bool         sources_dropped;   /* more files than slots; never reported current */
+} Configuration;
+
+/* Functions */
+
+bool           config_read_file(Configuration *config, const char *path);
+bool           config_read_global(Configuration *config);
+bool           config_set(Configuration *config, const char *key, const char *value);
+const char    *config_get(const Configuration *config, const char *key);
+bool           config_has(const Configuration *config, const char *key);
+bool           config_get_bool(const Configuration *config, const char *key, bool fallback);
+long           config_get_int(const Configuration *config, const char *key, long fallback);
+size_t         config_get_size(const Configuration *config, const char *key, size_t fallback);
+bool           config_parse_bool(const char *value, bool *result);
+bool           config_parse_int(const char *value, long *result);
+bool           config_is_current(const Configuration *config);
+Configuration *config_copy(const Configuration *config);
+void           config_free(Configuration *config);
+
+#endif
@@ -0,0 +1,36 @@
+/* delta.h: git delta encoding */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define DELTA_COPY_MAX      0x10000     /* a copy op with size bits 0 copies this much */
+#define DELTA_INSERT_MAX    0x7f        /* longest literal run of one insert op */
+#define DELTA_BLOCK         16          /* bytes hashed per base index entry */
+#define DELTA_BUCKET_LIMIT  64          /* entries kept per hash bucket */
+
+/* Structures */
+
+typedef struct {
+    const unsigned char *base;
+    size_t               base_len;
+    uint32_t             mask;          /* bucket count - 1 */
+    uint32_t            *heads;         /* first entry + 1 per bucket, 0 when empty */
+    uint32_t            *next;          /* next entry + 1 in the same bucket */
+    uint32_t            *offsets;       /* base offset of each indexed block */
+} DeltaIndex;
+
+/* Functions */
+
+bool           delta_header(const unsigned char *delta, size_t len, size_t *base_size, size_t *result_size, size_t *used);
+DeltaIndex    *delta_index_create(const unsigned char *base, size_t len);
+void           delta_index_free(DeltaIndex *index);
+unsigned char *delta_create(const DeltaIndex *index, const unsigned char *target, size_t len, size_t max_size, size_t *delta_len);
+unsigned char *delta_apply(const unsigned char *base, size_t base_len, const unsigned char *delta, size_t delta_len, size_t *result_len);
+
+#endif
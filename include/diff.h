@@ -0,0 +1,83 @@
+/* diff.h: tree and worktree comparison, rename detection and patches */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "linediff.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define DIFF_CONTEXT            3
+#define DIFF_MAX_SCORE          60000u      /* similarity scale, as in git */
+#define DIFF_RENAME_SCORE       30000u      /* -M without a number: 50% */
+#define DIFF_RENAME_LIMIT       1000        /* diff.renameLimit: inexact detection runs below its square */
+#define DIFF_RENAME_CANDIDATES  4           /* best sources kept per destination */
+#define DIFF_BINARY_PEEK        8000        /* bytes searched for a NUL, as in git */
+#define DIFF_FUNC_LINE          80          /* bytes of a hunk header's function line */
+#define DIFF_BATCH              256         /* pairs formatted per round on the worker pool */
+#define DIFF_WORKTREE_CHUNK     256         /* worktree files checked per job */
+#define DIFF_SPAN_MAX           64          /* similarity: longest chunk hashed */
+#define DIFF_SPAN_HASHBASE      107927u
+
+/* Structures */
+
+typedef enum {
+    DIFF_FORMAT_PATCH,
+    DIFF_FORMAT_NAME_ONLY,
+    DIFF_FORMAT_NAME_STATUS,
+} DiffFormat;
+
+typedef struct {
+    const char    *path;            /* in the queue's arena, NULL when the side is missing */
+    uint32_t      mode;             /* 0 when the side is missing */
+    unsigned char sha[SHA_SIZE];
+    bool          worktree;         /* contents are the file at path, not a blob */
+} DiffSide;
+
+typedef struct {
+    DiffSide old;
+    DiffSide new;
+    char     status;                /* 'A', 'D', 'M', 'T' or 'R' */
+    uint32_t score;                 /* similarity of a rename, out of DIFF_MAX_SCORE */
+} DiffPair;
+
+typedef struct {
+    DiffPair *pairs;                /* in path order, of the new side for renames */
+    size_t   count;
+    size_t   capacity;
+    Arena    arena;
+
+    size_t   trees_skipped;         /* subtrees with one SHA on both sides, never read */
+    size_t   files_hashed;          /* worktree files whose contents had to be hashed */
+    size_t   renames;
+    bool     renames_skipped;       /* too many candidates for inexact detection */
+} DiffQueue;
+
+typedef struct {
+    DiffFormat        format;
+    LineDiffAlgorithm algorithm;    /* diff.algorithm */
+    size_t            context;      /* diff.context */
+    bool              renames;      /* diff.renames */
+    uint32_t          rename_score; /* least similarity of an inexact rename */
+    size_t            rename_limit; /* diff.renameLimit */
+    size_t            threads;
+    size_t            abbrev;       /* fewest hex digits on an index line */
+} DiffOptions;
+
+/* Functions */
+
+void     diff_options_init(DiffOptions *options, Repository *repo);
+bool     diff_tree_to_tree(Repository *repo, const unsigned char *old_tree, const unsigned char *new_tree, DiffQueue *queue);
+bool     diff_tree_to_worktree(Repository *repo, const unsigned char *tree, const DiffOptions *options, DiffQueue *queue);
+bool     diff_renames(Repository *repo, DiffQueue *queue, const DiffOptions *options);
+bool     diff_print(Repository *repo, const DiffQueue *queue, const DiffOptions *options, FILE *out);
+uint32_t diff_similarity(const unsigned char *a, size_t a_size, const unsigned char *b, size_t b_size, uint32_t minimum);
+void     diff_queue_free(DiffQueue *queue);
+
+#endif
@@ -0,0 +1,64 @@
+/* ewah.h: plain and EWAH-compressed bitmaps */
+
+#ifndef EWAH_H
+#define EWAH_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define EWAH_RUNNING_BITS   32          /* run length field of a marker word */
+#define EWAH_LITERAL_BITS   31          /* literal word count field */
+#define EWAH_RUNNING_MAX    0xffffffffull
+#define EWAH_LITERAL_MAX    0x7fffffffull
+#define EWAH_HEADER_SIZE    8           /* bit count, word count */
+#define EWAH_WORD_BITS      64
+
+/* Structures */
+
+typedef struct {
+    uint64_t *words;                    /* bit i is bit i % 64 of word i / 64 */
+    size_t    len;                      /* words in use; the rest are zero */
+    size_t    capacity;
+} Bitmap;
+
+/*
+ * A sequence of marker words, each followed by its literal words. A marker
+ * holds a run bit (bit 0), a count of words that are all run bits (bits
+ * 1-32) and the number of literal words copied verbatim after it (33-63).
+ */
+typedef struct {
+    uint64_t *words;
+    size_t    len;
+    size_t    capacity;
+    uint32_t  bits;                     /* size of the bitmap in bits */
+    size_t    marker;                   /* last marker word, where runs and literals are added */
+} Ewah;
+
+/* Functions */
+
+void     bitmap_set(Bitmap *bitmap, size_t bit);
+void     bitmap_or(Bitmap *dst, const Bitmap *src);
+void     bitmap_and_not(Bitmap *dst, const Bitmap *src);
+size_t   bitmap_count(const Bitmap *bitmap);
+size_t   bitmap_count_and(const Bitmap *a, const Bitmap *b);
+void     bitmap_clear(Bitmap *bitmap);
+void     bitmap_free(Bitmap *bitmap);
+
+void     ewah_encode(Ewah *ewah, const Bitmap *bitmap);
+void     ewah_or(Bitmap *dst, const Ewah *ewah);
+void     ewah_xor(Bitmap *dst, const Ewah *ewah);
+size_t   ewah_parse(Ewah *ewah, const unsigned char *data, size_t len);
+size_t   ewah_serialized_size(const Ewah *ewah);
+void     ewah_serialize(const Ewah *ewah, unsigned char *out);
+void     ewah_free(Ewah *ewah);
+
+static inline bool bitmap_test(const Bitmap *bitmap, size_t bit){
+    return bit / EWAH_WORD_BITS < bitmap->len && (bitmap->words[bit / EWAH_WORD_BITS] >> (bit % EWAH_WORD_BITS)) & 1;
+}
+
+#endif
@@ -9,5 +9,24 @@
 /* Functions */
 
 bool cmd_init(int arg_count, char *args[]);
+bool cmd_cat_file(int arg_count, char *args[]);
+bool cmd_hash_object(int arg_count, char *args[]);
+bool cmd_repack(int arg_count, char *args[]);
+bool cmd_ls_tree(int arg_count, char *args[]);
+bool cmd_log(int arg_count, char *args[]);
+bool cmd_commit_graph(int arg_count, char *args[]);
+bool cmd_multi_pack_index(int arg_count, char *args[]);
+bool cmd_merge_base(int arg_count, char *args[]);
+bool cmd_config(int arg_count, char *args[]);
+bool cmd_ls_files(int arg_count, char *args[]);
+bool cmd_add(int arg_count, char *args[]);
+bool cmd_status(int arg_count, char *args[]);
+bool cmd_checkout(int arg_count, char *args[]);
+bool cmd_diff(int arg_count, char *args[]);
+bool cmd_serve(int arg_count, char *args[]);
+bool cmd_rev_list(int arg_count, char *args[]);
+bool cmd_show_ref(int arg_count, char *args[]);
+bool cmd_pack_refs(int arg_count, char *args[]);
+bool cmd_rev_parse(int arg_count, char *args[]);
 
 #endif
@@ -0,0 +1,48 @@
+/* ignore.h: .gitignore patterns */
+
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define IGNORE_NEGATE     0x01      /* "!pattern" re-includes */
+#define IGNORE_DIR_ONLY   0x02      /* "pattern/" matches directories only */
+#define IGNORE_BASENAME   0x04      /* no slash: matched against the last component at any depth */
+#define IGNORE_LITERAL    0x08      /* no wildcards: a plain comparison */
+#define IGNORE_SUFFIX     0x10      /* "*" and a literal: compared against the end */
+
+/* Structures */
+
+typedef struct {
+    const char *pattern;            /* NUL-terminated, in the list's arena */
+    uint32_t   len;
+    uint32_t   flags;
+} IgnorePattern;
+
+typedef struct IgnoreList {
+    const struct IgnoreList *parent;    /* rules of the enclosing directory, lower precedence */
+    const char    *base;                /* directory the patterns are relative to, with '/'; "" at the top */
+    size_t        base_len;
+    IgnorePattern *patterns;
+    size_t        count;
+    size_t        capacity;
+    Arena         arena;
+} IgnoreList;
+
+/* Functions */
+
+IgnoreList *ignore_list_new(const IgnoreList *parent, const char *base, size_t base_len);
+bool        ignore_list_read(IgnoreList *list, int dir_fd, const char *path, struct stat *sb);
+void        ignore_list_add(IgnoreList *list, const char *line, size_t len);
+bool        ignore_path(const IgnoreList *list, const char *path, size_t len, bool is_dir);
+bool        wildmatch(const char *pattern, const char *text);
+void        ignore_list_free(IgnoreList *list);
+
+#endif
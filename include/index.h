@@ -0,0 +1,97 @@
+/* index.h: the staging area (.git/index) */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define INDEX_SIGNATURE         0x44495243u /* "DIRC" */
+#define INDEX_HEADER_SIZE       12
+#define INDEX_ENTRY_FIXED       62          /* stat data, SHA and flags before the name */
+#define INDEX_FLAG_VALID        0x8000      /* assume-valid */
+#define INDEX_FLAG_EXTENDED     0x4000      /* a second flags word follows (v3+) */
+#define INDEX_FLAG_STAGE        0x3000
+#define INDEX_STAGE_SHIFT       12
+#define INDEX_NAME_MASK         0x0fff      /* name length, saturated */
+#define INDEX_EXT_SKIP_WORKTREE 0x4000
+#define INDEX_EXT_INTENT_TO_ADD 0x2000
+#define INDEX_EXT_HEADER        8           /* signature and size */
+#define INDEX_EOIE_SIZE         (4 + SHA_SIZE)
+#define INDEX_IEOT_VERSION      1
+#define INDEX_IEOT_BLOCK        10000       /* entries per offset-table block we write */
+#define INDEX_TREE_DEPTH        1024        /* nested cache-tree levels accepted */
+
+/* Structures */
+
+typedef struct {
+    uint32_t      ctime_sec;
+    uint32_t      ctime_nsec;
+    uint32_t      mtime_sec;
+    uint32_t      mtime_nsec;
+    uint32_t      dev;
+    uint32_t      ino;
+    uint32_t      mode;
+    uint32_t      uid;
+    uint32_t      gid;
+    uint32_t      size;
+    unsigned char sha[SHA_SIZE];
+    uint16_t      flags;            /* assume-valid, extended and stage as on disk */
+    uint16_t      flags_extended;   /* skip-worktree, intent-to-add */
+    uint32_t      name_len;
+    const char    *name;            /* NUL-terminated; in the mapping (v2/v3) or an arena */
+} IndexEntry;
+
+typedef struct IndexTree {
+    const char    *name;            /* path component (NUL-terminated); "" at the root */
+    uint32_t      name_len;
+    int32_t       entry_count;      /* entries covered by sha, -1 once invalidated */
+    unsigned char sha[SHA_SIZE];    /* tree object for those entries */
+    struct IndexTree **children;
+    size_t        child_count;
+} IndexTree;
+
+typedef struct {
+    const unsigned char *map;       /* whole file, NULL for a new index */
+    size_t        size;
+    uint32_t      version;
+    IndexEntry    *entries;         /* sorted by name, then stage */
+    size_t        count;
+    size_t        capacity;
+    size_t        entries_end;      /* offset of the first extension */
+    size_t        blocks;           /* IEOT blocks decoded in parallel, 0 if read serially */
+    struct timespec mtime;          /* of the file read; entries this new are racily clean */
+    unsigned char checksum[SHA_SIZE];   /* trailer of the file read or last written */
+    IndexTree     *cache_tree;      /* TREE extension, NULL if absent */
+    Arena         arena;            /* names rebuilt from v4 prefixes or added later */
+    Arena         *block_arenas;    /* one per IEOT block of a v4 index */
+} Index;
+
+/* Functions */
+
+Index      *index_read(Repository *repo);
+Index      *index_open(const char *path, size_t threads);
+Index      *index_new(void);
+bool        index_write(Repository *repo, Index *index);
+bool        index_verify(const Index *index);
+IndexEntry *index_find(const Index *index, const char *name, size_t len, int stage);
+IndexEntry *index_add(Index *index, const IndexEntry *entry);
+size_t      index_position(const Index *index, const char *name, size_t len);
+bool        index_has_path(const Index *index, const char *name, size_t len);
+bool        index_has_dir(const Index *index, const char *dir, size_t len);
+const IndexTree *index_tree_find(const Index *index, const char *dir, size_t len);
+void        index_entry_set_stat(IndexEntry *entry, const struct stat *sb);
+bool        index_entry_stat_matches(const IndexEntry *entry, const struct stat *sb);
+int         index_name_compare(const char *a, size_t a_len, int a_stage, const char *b, size_t b_len, int b_stage);
+void        index_free(Index *index);
+
+static inline int index_entry_stage(const IndexEntry *entry) { return (entry->flags & INDEX_FLAG_STAGE) >> INDEX_STAGE_SHIFT; }
+
+#endif
@@ -0,0 +1,41 @@
+/* kvlm.h: key-value list with message (commit and tag headers) */
+
+#ifndef KVLM_H
+#define KVLM_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Structures */
+
+typedef struct {
+    uint32_t            key_off;
+    uint32_t            key_len;
+    uint32_t            value_off;     /* raw value, continuation lines included */
+    uint32_t            value_len;
+    bool                multiline;     /* value has "\n " continuations to fold */
+    const unsigned char *folded;       /* folded value, decoded on first request */
+    size_t              folded_len;
+} KvlmField;
+
+typedef struct {
+    const unsigned char *data;         /* the object body all offsets refer to */
+    KvlmField           *fields;       /* in header order; arena-allocated */
+    size_t              count;
+    uint32_t            message_off;   /* everything after the blank line */
+    uint32_t            message_len;
+} Kvlm;
+
+/* Functions */
+
+bool                 kvlm_parse(Kvlm *kvlm, const unsigned char *data, size_t size, Arena *arena);
+KvlmField           *kvlm_get(const Kvlm *kvlm, const char *key, size_t nth);
+size_t               kvlm_count(const Kvlm *kvlm, const char *key);
+const unsigned char *kvlm_value(const Kvlm *kvlm, KvlmField *field, Arena *arena, size_t *len);
+const unsigned char *kvlm_message(const Kvlm *kvlm, size_t *len);
+const unsigned char *kvlm_summary(const Kvlm *kvlm, size_t *len);
+
+#endif
@@ -0,0 +1,61 @@
+/* linediff.h: line diffs of two buffers (histogram and Myers) */
+
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define LINEDIFF_MAX_CHAIN      64      /* histogram: lines more frequent than this hand a range to Myers */
+#define LINEDIFF_SNAKE_CNT      20      /* Myers: a diagonal run this long is a good snake */
+#define LINEDIFF_HEUR_MIN       256     /* Myers: edit cost before good snakes are sampled */
+#define LINEDIFF_MAX_COST_MIN   256     /* Myers: edit cost always spent looking for the minimum */
+#define LINEDIFF_K_HEUR         4
+#define LINEDIFF_MAX_MATCHES    1024    /* Myers: lines this frequent may be dropped before the search */
+#define LINEDIFF_SIMSCAN_WINDOW 100     /* Myers: lines looked at around a frequent one */
+#define LINEDIFF_KPDIS_RUN      4
+
+/* Structures */
+
+typedef enum {
+    LINEDIFF_HISTOGRAM,
+    LINEDIFF_MYERS,
+} LineDiffAlgorithm;
+
+typedef struct {
+    const unsigned char *data;          /* not owned; may be a mapping */
+    size_t              size;
+    size_t              *lines;         /* offset of each line, then size: count + 1 entries */
+    size_t              count;
+} LineText;
+
+typedef struct {
+    size_t old_start;                   /* 0-based first line of the change */
+    size_t old_count;
+    size_t new_start;
+    size_t new_count;
+} LineChange;
+
+typedef struct {
+    LineText   old;
+    LineText   new;
+    LineChange *changes;                /* in file order, separated by unchanged lines */
+    size_t     count;
+    size_t     capacity;
+} LineDiff;
+
+/* Functions */
+
+bool linediff_compute(LineDiff *diff, const unsigned char *old_data, size_t old_size,
+                      const unsigned char *new_data, size_t new_size, LineDiffAlgorithm algorithm);
+void linediff_free(LineDiff *diff);
+
+static inline const unsigned char *linediff_line(const LineText *text, size_t i) { return text->data + text->lines[i]; }
+static inline size_t linediff_line_len(const LineText *text, size_t i) { return text->lines[i + 1] - text->lines[i]; }
+
+#endif
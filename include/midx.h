@@ -0,0 +1,62 @@
+/* midx.h: objects/pack/multi-pack-index reader and writer */
+
+#ifndef MIDX_H
+#define MIDX_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define MIDX_SIGNATURE          "MIDX"
+#define MIDX_VERSION            1
+#define MIDX_HASH_VERSION       1           /* SHA-1 */
+#define MIDX_HEADER_SIZE        12
+#define MIDX_FANOUT             256
+#define MIDX_OFFSET_SIZE        8           /* pack id, offset */
+
+#define MIDX_CHUNK_PNAM         0x504e414d  /* "PNAM" */
+#define MIDX_CHUNK_OIDF         0x4f494446  /* "OIDF" */
+#define MIDX_CHUNK_OIDL         0x4f49444c  /* "OIDL" */
+#define MIDX_CHUNK_OOFF         0x4f4f4646  /* "OOFF" */
+#define MIDX_CHUNK_LOFF         0x4c4f4646  /* "LOFF" */
+
+#define MIDX_LARGE_OFFSET       0x80000000u /* in OOFF: index into LOFF */
+
+/* Structures */
+
+struct Pack;
+
+typedef struct MultiPackIndex {
+    const unsigned char *map;
+    size_t               size;
+    uint32_t             count;         /* number of objects */
+    uint32_t             pack_count;
+    const char         **pack_names;    /* sorted .idx names, inside the mapping */
+    struct Pack        **packs;         /* the mapped pack of each name, set by pack_list() */
+    const unsigned char *fanout;
+    const unsigned char *oids;          /* count sorted 20-byte SHAs */
+    const unsigned char *offsets;       /* count OOFF records */
+    const unsigned char *large_offsets; /* 8-byte offsets for packs > 2GB */
+    size_t               large_count;
+} MultiPackIndex;
+
+typedef struct {
+    size_t packs;
+    size_t objects;
+    size_t duplicates;                  /* copies dropped in favour of a newer pack */
+} MidxStats;
+
+/* Functions */
+
+MultiPackIndex *midx_open(const char *path);
+void            midx_close(MultiPackIndex *midx);
+
+bool            midx_find(const MultiPackIndex *midx, const unsigned char sha[SHA_SIZE], uint32_t *pack_id, uint64_t *offset);
+bool            midx_write(Repository *repo, MidxStats *stats);
+
+#endif
@@ -3,13 +3,157 @@
 #ifndef OBJECTS_H
 #define OBJECTS_H
 
+#include "kvlm.h"
+#include "repository.h"
+#include "sha1.h"
+#include "tree.h"
+#include "utils.h"
+
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+/* Macros */
+
+#define OBJECT_CHUNK_SIZE  (1<<16)
+#define OBJECT_HEADER_MAX  32
+#define OBJECT_LOOSE_LEVEL Z_BEST_SPEED
+#define OBJECT_CACHE_INITIAL 1024       /* slots; the table doubles at half load */
+#define OBJECT_PEEL_DEPTH  16           /* tags of tags followed by object_peel() */
+#define OBJECT_TMP_NAME    64
+#define OBJECT_TMP_ATTEMPTS 16          /* name collisions tolerated before giving up */
+#define OBJECT_BATCH_INITIAL 256        /* staged objects; the list doubles when full */
 
 /* Structures */
+
+typedef enum {
+    OBJ_NONE   = 0,
+    OBJ_COMMIT = 1,
+    OBJ_TREE   = 2,
+    OBJ_BLOB   = 3,
+    OBJ_TAG    = 4,
+} ObjectType;
+
+typedef struct {
+    ObjectType          type;
+    unsigned char       sha[SHA_SIZE];
+    size_t              size;
+    const unsigned char *data;      /* raw body, in the repository arena */
+} GitObject;
+
 typedef struct {
-    
-} Object;
+    GitObject           object;
+} GitBlob;
+
+typedef struct {
+    GitObject           object;
+    Kvlm                kvlm;       /* views into object.data */
+} GitCommit;
+
+typedef struct {
+    GitObject           object;
+    Tree                tree;       /* leaves over object.data */
+} GitTree;
+
+typedef struct {
+    GitObject           object;
+    Kvlm                kvlm;
+} GitTag;
+
+typedef struct ObjectCache {
+    GitObject           **slots;    /* open addressing on the SHA's leading bytes */
+    size_t              capacity;   /* power of two */
+    size_t              count;
+    size_t              hits;
+    size_t              misses;
+} ObjectCache;
+
+typedef struct {
+    ObjectType    type;         /* type parsed from the "<type> <size>\0" header */
+    size_t        size;         /* body size announced by the header */
+    size_t        remaining;    /* body bytes not yet handed to the caller */
+    int           fd;           /* loose object file, or -1 */
+    const unsigned char *map;   /* compressed input mapped from a pack, when fd is -1 */
+    size_t        map_left;
+    bool          input_eof;
+    bool          stream_end;
+    z_stream      zs;
+    unsigned char *pending;     /* body bytes inflated together with the header */
+    size_t        pending_len;
+    unsigned char *resolved;    /* whole body of a resolved delta, served via pending */
+    unsigned char in[OBJECT_CHUNK_SIZE];
+    unsigned char out[OBJECT_CHUNK_SIZE];
+} ObjectStream;
+
+typedef struct {
+    Repository    *repo;        /* NULL when only hashing */
+    size_t        size;         /* body size promised in the header */
+    size_t        written;      /* body bytes fed so far */
+    Sha1Context   sha;
+    z_stream      zs;
+    int           fd;           /* temp file under objects/, -1 when hashing only */
+    int           dir_fd;       /* objects/ handle owned by repo */
+    char          tmp_name[OBJECT_TMP_NAME];  /* relative to dir_fd */
+    unsigned char out[OBJECT_CHUNK_SIZE];
+} ObjectWriter;
+
+typedef struct {
+    char          tmp_name[OBJECT_TMP_NAME];  /* under objects/ */
+    unsigned char sha[SHA_SIZE];
+} ObjectBatchEntry;
+
+typedef struct ObjectBatch {
+    bool          sync;         /* core.fsyncObjectFiles, read when the batch began */
+    atomic_bool   dirty[REPO_FANOUT_DIRS];  /* objects/xx that gained an object */
+    atomic_size_t objects;      /* objects moved into place */
+    pthread_mutex_t lock;       /* guards staged */
+    ObjectBatchEntry *staged;   /* synced objects awaiting object_batch_commit() */
+    size_t        count;
+    size_t        alloc;
+} ObjectBatch;
+
+typedef struct {
+    size_t        objects;      /* objects written while the batch was open */
+    size_t        dirs;         /* directories synced when it was committed */
+} ObjectBatchStats;
 
 /* Functions */
 
+const char   *object_type_name(ObjectType type);
+ObjectType    object_type_from_name(const char *name, size_t len);
+
+bool          object_read_header(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size);
+unsigned char *object_read(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size);
+bool          object_find(Repository *repo, const char *name, ObjectType type, unsigned char sha[SHA_SIZE]);
+
+bool          object_writer_begin(ObjectWriter *writer, Repository *repo, ObjectType type, size_t size);
+bool          object_writer_update(ObjectWriter *writer, const void *data, size_t len);
+bool          object_writer_finish(ObjectWriter *writer, unsigned char sha[SHA_SIZE]);
+void          object_writer_abort(ObjectWriter *writer);
+bool          object_write_buffer(Repository *repo, ObjectType type, const void *data, size_t len, unsigned char sha[SHA_SIZE]);
+bool          object_hash_fd(Repository *repo, int fd, ObjectType type, unsigned char sha[SHA_SIZE]);
+bool          object_batch_begin(Repository *repo);
+bool          object_batch_commit(Repository *repo, ObjectBatchStats *stats);
+
+GitObject    *object_get(Repository *repo, const unsigned char sha[SHA_SIZE]);
+GitObject    *object_peel(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type);
+bool          object_peel_name(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type, unsigned char peeled[SHA_SIZE]);
+GitObject    *object_parse(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type, const unsigned char *data, size_t size);
+void          object_cache_free(Repository *repo);
+
+bool          commit_tree(const GitCommit *commit, unsigned char sha[SHA_SIZE]);
+size_t        commit_parent_count(const GitCommit *commit);
+bool          commit_parent(const GitCommit *commit, size_t nth, unsigned char sha[SHA_SIZE]);
+uint64_t      commit_date(const GitCommit *commit);
+bool          tag_target(const GitTag *tag, unsigned char sha[SHA_SIZE]);
+bool          tree_lookup_path(Repository *repo, const GitTree *tree, const char *path, TreeLeaf *leaf);
+
+ObjectStream *object_stream_open(Repository *repo, const unsigned char sha[SHA_SIZE]);
+ssize_t       object_stream_next(ObjectStream *stream, const unsigned char **chunk);
+void          object_stream_close(ObjectStream *stream);
+
 #endif
@@ -0,0 +1,95 @@
+/* pack.h: packfile and pack index (.idx v2) reader */
+
+#ifndef PACK_H
+#define PACK_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Macros */
+
+#define PACK_SIGNATURE      "PACK"
+#define PACK_IDX_SIGNATURE  "\377tOc"
+#define PACK_HEADER_SIZE    12
+#define PACK_IDX_FANOUT     256
+
+#define PACK_OFS_DELTA      6
+#define PACK_REF_DELTA      7
+#define PACK_DELTA_DEPTH_MAX 10000  /* guards against REF_DELTA cycles */
+
+#define DELTA_BASE_CACHE_BUCKETS 1024
+
+/* Structures */
+
+typedef struct Pack {
+    char                 path[MAX_PATH];   /* path of the .pack file */
+    const unsigned char *idx_map;
+    size_t               idx_size;
+    const unsigned char *pack_map;
+    size_t               pack_size;
+    uint32_t             count;            /* number of objects */
+    const unsigned char *fanout;           /* 256 big-endian cumulative counts */
+    const unsigned char *oids;             /* count sorted 20-byte SHAs */
+    const unsigned char *offsets;          /* count 4-byte offsets (MSB: large) */
+    const unsigned char *large_offsets;    /* 8-byte offsets for packs > 2GB */
+    size_t               large_count;
+    bool                 in_midx;          /* lookups go through the multi-pack-index */
+    struct Pack         *next;
+} Pack;
+
+typedef struct {
+    const Pack *pack;
+    uint64_t    offset;     /* the delta entry */
+    uint64_t    data;       /* offset of its compressed delta data */
+    size_t      size;       /* inflated delta size */
+} DeltaLink;
+
+typedef struct DeltaBaseEntry {
+    const Pack            *pack;
+    uint64_t               offset;     /* entry the base was read or rebuilt from */
+    int                    type;
+    unsigned char         *data;
+    size_t                 size;
+    struct DeltaBaseEntry *chain;      /* next in hash bucket */
+    struct DeltaBaseEntry *newer;      /* LRU neighbours */
+    struct DeltaBaseEntry *older;
+} DeltaBaseEntry;
+
+typedef struct DeltaBaseCache {
+    pthread_mutex_t  lock;
+    size_t           limit;            /* byte budget (core.deltaBaseCacheLimit) */
+    size_t           used;
+    DeltaBaseEntry  *buckets[DELTA_BASE_CACHE_BUCKETS];
+    DeltaBaseEntry  *newest;
+    DeltaBaseEntry  *oldest;
+    size_t           hits;
+    size_t           misses;
+} DeltaBaseCache;
+
+/* Functions */
+
+Pack   *pack_open(const char *idx_path);
+void    pack_close(Pack *pack);
+bool    pack_find(const Pack *pack, const unsigned char sha[SHA_SIZE], uint64_t *offset);
+bool    pack_position(const Pack *pack, const unsigned char sha[SHA_SIZE], uint32_t *pos);
+uint64_t pack_offset_at(const Pack *pack, uint32_t pos);
+bool    pack_entry_header(const unsigned char *p, size_t left, int *type, size_t *size, size_t *header_len);
+
+Pack   *pack_list(Repository *repo);
+Pack   *pack_lookup(Repository *repo, const unsigned char sha[SHA_SIZE], uint64_t *offset);
+void    pack_list_free(Repository *repo);
+
+unsigned char *pack_read_object(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size);
+bool    pack_read_header(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size);
+
+DeltaBaseCache *delta_base_cache_create(size_t limit);
+bool    delta_base_cache_get(DeltaBaseCache *cache, const Pack *pack, uint64_t offset, int *type, unsigned char **data, size_t *size);
+void    delta_base_cache_put(DeltaBaseCache *cache, const Pack *pack, uint64_t offset, int type, unsigned char *data, size_t size);
+void    delta_base_cache_destroy(DeltaBaseCache *cache);
+
+#endif
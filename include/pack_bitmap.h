@@ -0,0 +1,93 @@
+/* pack_bitmap.h: reachability bitmaps (.bitmap) of a pack */
+
+#ifndef PACK_BITMAP_H
+#define PACK_BITMAP_H
+
+#include "ewah.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define PACK_BITMAP_SIGNATURE       "BITM"
+#define PACK_BITMAP_VERSION         1
+#define PACK_BITMAP_HEADER_SIZE     (12 + SHA_SIZE)     /* signature, version, flags, count, pack checksum */
+#define PACK_BITMAP_ENTRY_SIZE      6                   /* commit position, XOR offset, flags */
+#define PACK_BITMAP_FULL_DAG        0x1                 /* every bitmap is closed under reachability */
+#define PACK_BITMAP_HASH_CACHE      0x4                 /* name hashes follow the entries */
+#define PACK_BITMAP_XOR_MAX         160                 /* entries an XOR offset may reach back */
+#define PACK_BITMAP_INTERVAL        100                 /* a commit in this many gets a bitmap */
+
+/* Structures */
+
+typedef struct {
+    uint32_t pos;                       /* the commit's position in the .idx */
+    uint8_t  xor_offset;                /* stored as XOR against the entry this many before, or 0 */
+    uint8_t  flags;
+    Ewah     ewah;
+} PackBitmapEntry;
+
+typedef struct {
+    Pack            *pack;              /* not owned; must outlive the bitmap */
+    uint32_t        count;              /* objects in the pack, one bit each */
+    uint32_t        *order;             /* bit (pack offset order) -> .idx position */
+    uint32_t        *bits;              /* .idx position -> bit */
+    Bitmap          types[4];           /* commits, trees, blobs, tags */
+    PackBitmapEntry *entries;
+    size_t          entry_count;
+    size_t          entry_capacity;
+    int32_t         *entry_of;          /* .idx position -> entry, -1 if none */
+} PackBitmap;
+
+typedef struct {
+    unsigned char sha[SHA_SIZE];
+    ObjectType    type;
+} BitmapObject;
+
+typedef struct {
+    Repository   *repo;
+    PackBitmap   *bitmap;               /* NULL walks every object */
+    bool         commits_only;          /* trees and blobs are not needed; skip reading trees */
+    Bitmap       have, want;            /* objects of the bitmapped pack, by bit */
+    ShaSet       have_extra, want_extra;/* objects outside it */
+    BitmapObject *extra;                /* wanted objects outside the pack, in walk order */
+    size_t       extra_count;
+    size_t       extra_capacity;
+    unsigned char (*tips)[SHA_SIZE];
+    bool         *excluded;             /* tip was given as ^<rev> */
+    size_t       tip_count;
+    size_t       tip_capacity;
+    size_t       bitmaps_used;          /* stored bitmaps that replaced a walk */
+    size_t       commits_walked;
+    size_t       trees_read;
+    bool         error;
+} BitmapWalk;
+
+typedef struct {
+    size_t objects;
+    size_t commits;                     /* commits with a stored bitmap */
+} PackBitmapStats;
+
+typedef bool (*BitmapCallback)(const unsigned char sha[SHA_SIZE], ObjectType type, void *ctx);
+
+/* Functions */
+
+PackBitmap *pack_bitmap_open(Pack *pack);
+PackBitmap *pack_bitmap_load(Repository *repo);
+void        pack_bitmap_close(PackBitmap *bitmap);
+bool        pack_bitmap_write(Repository *repo, Pack *pack, PackBitmapStats *stats);
+
+void        bitmap_walk_init(BitmapWalk *walk, Repository *repo, PackBitmap *bitmap);
+bool        bitmap_walk_push(BitmapWalk *walk, const unsigned char sha[SHA_SIZE], bool exclude);
+bool        bitmap_walk_run(BitmapWalk *walk);
+size_t      bitmap_walk_count(const BitmapWalk *walk, ObjectType type);
+bool        bitmap_walk_for_each(const BitmapWalk *walk, ObjectType type, BitmapCallback callback, void *ctx);
+void        bitmap_walk_release(BitmapWalk *walk);
+
+#endif
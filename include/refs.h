@@ -0,0 +1,56 @@
+/* refs.h: references */
+
+#ifndef REFS_H
+#define REFS_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Macros */
+
+#define REFS_SYMREF_DEPTH   5       /* "ref: " indirections followed before giving up */
+#define REFS_PACKED_FILE    "packed-refs"
+#define REFS_PACKED_LOCK    REFS_PACKED_FILE ".lock"
+#define REFS_PACKED_HEADER  "# pack-refs with: peeled fully-peeled sorted \n"
+
+/* Structures */
+
+typedef bool (*RefCallback)(const char *name, const unsigned char sha[SHA_SIZE], void *ctx);
+
+typedef struct {
+    const char    *name;                /* points into PackedRefs.data */
+    unsigned char sha[SHA_SIZE];
+    unsigned char peeled[SHA_SIZE];     /* what an annotated tag finally points to */
+    bool          has_peeled;
+} PackedRef;
+
+typedef struct PackedRefs {
+    char      *data;                    /* the file, with each name NUL-terminated in place */
+    PackedRef *refs;                    /* sorted by name */
+    size_t    count;
+    size_t    capacity;
+    bool      fully_peeled;             /* every tag has its peeled line, so no line means no tag */
+} PackedRefs;
+
+typedef struct {
+    size_t packed;                      /* refs in the new packed-refs */
+    size_t pruned;                      /* loose files removed */
+} PackRefsStats;
+
+/* Functions */
+
+bool ref_read(Repository *repo, const char *name, unsigned char sha[SHA_SIZE]);
+bool ref_resolve(Repository *repo, const char *name, unsigned char sha[SHA_SIZE]);
+bool refs_for_each(Repository *repo, RefCallback callback, void *ctx);
+bool refs_for_each_prefix(Repository *repo, const char *prefix, RefCallback callback, void *ctx);
+bool refs_pack(Repository *repo, bool all, bool prune, PackRefsStats *stats);
+bool ref_peeled(Repository *repo, const char *name, const unsigned char sha[SHA_SIZE], unsigned char peeled[SHA_SIZE]);
+
+PackedRefs      *packed_refs_load(Repository *repo);
+void             packed_refs_free(Repository *repo);
+const PackedRef *packed_refs_find(const PackedRefs *packed, const char *name);
+
+#endif
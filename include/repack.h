@@ -0,0 +1,77 @@
+/* repack.h: packing loose objects */
+
+#ifndef REPACK_H
+#define REPACK_H
+
+#include "delta.h"
+#include "objects.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+
+/* Macros */
+
+#define REPACK_WINDOW           10
+#define REPACK_DEPTH            50
+#define REPACK_DELTA_MIN        64              /* smaller objects are never deltified */
+#define REPACK_DELTA_MAX        (512 << 20)     /* nor larger ones (core.bigFileThreshold) */
+#define REPACK_LARGE_OFFSET     0x80000000u     /* offsets from here on go to the 64-bit table */
+
+/* Structures */
+
+typedef struct {
+    size_t window;          /* objects tried as delta bases; 0 disables deltas */
+    size_t depth;           /* longest delta chain allowed */
+    bool   prune;           /* remove loose objects once they are packed (and old packs, for repack_all) */
+    bool   bitmap;          /* write a reachability bitmap of the new pack (repack_all only) */
+} RepackOptions;
+
+typedef struct {
+    unsigned char sha[SHA_SIZE];
+    ObjectType    type;
+    size_t        size;
+    uint32_t      name_hash;    /* from the tree entry naming the object, 0 if unknown */
+    bool          packed;       /* already in an existing pack; not written again */
+    uint64_t      offset;       /* in the new pack */
+    uint32_t      crc;          /* of the raw entry, for the index */
+} RepackEntry;
+
+typedef struct {
+    RepackEntry   *entry;
+    unsigned char *data;
+    DeltaIndex    *index;       /* built the first time the slot is tried as a base */
+    size_t        depth;        /* delta chain length of this object */
+} RepackSlot;
+
+typedef struct {
+    int           fd;
+    char          path[MAX_PATH];
+    Sha1Context   sha;
+    uint64_t      offset;       /* bytes written so far */
+    uint32_t      crc;          /* of the entry being written */
+    z_stream      zs;
+    size_t        buf_len;
+    unsigned char buf[OBJECT_CHUNK_SIZE];
+} PackOutput;
+
+typedef struct {
+    size_t objects;         /* written to the new pack */
+    size_t deltas;          /* of which stored as deltas */
+    size_t pruned;          /* loose files removed */
+    size_t packs_removed;   /* packs replaced by the new one */
+    size_t bitmaps;         /* commits given a reachability bitmap */
+    char   name[SHA_HEX_SIZE];  /* pack-<name>.pack, empty if nothing was written */
+} RepackResult;
+
+/* Functions */
+
+bool     repack_loose(Repository *repo, const RepackOptions *options, RepackResult *result);
+bool     repack_all(Repository *repo, const RepackOptions *options, RepackResult *result);
+uint32_t repack_name_hash(const char *name, size_t len);
+
+#endif
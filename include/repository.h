@@ -3,25 +3,49 @@
 #ifndef REPOSITORY_H
 #define REPOSITORY_H
 
+#include "config.h"
+#include "utils.h"
+
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 /* Macros */
 
 #define MAX_PATH 4096 
+#define DELTA_BASE_CACHE_LIMIT ((size_t)96 << 20)  /* git's default core.deltaBaseCacheLimit */
+#define REPO_FANOUT_DIRS 256
 
 /* Structures */
 
-typedef struct {
-   int repo_format_version;
-   bool filemode;
-   bool bare;
-} Configuration;
+struct Pack;
+struct DeltaBaseCache;
+struct ObjectCache;
+struct CommitGraph;
+struct MultiPackIndex;
+struct PackedRefs;
+struct LooseObjectCache;
+struct ObjectBatch;
 
 typedef struct {
     char worktree[MAX_PATH];
     char gitdir[MAX_PATH];
     Configuration *config; 
+    struct Pack *packs;         /* mapped packs, loaded on first lookup */
+    bool packs_loaded;
+    struct DeltaBaseCache *delta_cache;   /* shared by all packs, created with the list */
+    struct MultiPackIndex *midx;          /* objects/pack/multi-pack-index, mapped with the list */
+    struct ObjectCache *object_cache;     /* parsed objects, created on first object_get() */
+    struct CommitGraph *commit_graph;     /* objects/info/commit-graph, mapped on first use */
+    bool commit_graph_loaded;
+    struct PackedRefs *packed_refs;       /* packed-refs, parsed on the first ref lookup it may answer */
+    bool packed_refs_loaded;
+    struct LooseObjectCache *loose_objects;   /* sorted listings of objects/xx, for abbreviated names */
+    struct ObjectBatch *object_batch;     /* open write batch deferring fsync, see object_batch_begin() */
+    Arena arena;                /* backs every parsed object; freed in repo_destroy() */
+    atomic_int gitdir_fd;       /* directory handles opened on first use, -1 until then */
+    atomic_int objects_fd;
+    atomic_int fanout_fds[REPO_FANOUT_DIRS];  /* objects/xx */
 } Repository;
 
 /* Functions */
@@ -29,10 +53,16 @@ typedef struct {
 Repository    *repo_create(const char *path, bool force);
 Repository    *repo_init(const char *path);
 Repository    *repo_find(const char *path, bool required);
+void           repo_discovery_reset(void);
 Configuration *repo_config_create(const char *path);
 void           repo_destroy(Repository *repo);
-char          *repo_path(Repository *repo, ...);
-char          *repo_file(Repository *repo, bool mkdir, ...);
-char          *repo_dir(Repository *repo, bool mkdir, ...);
+char          *repo_path(Repository *repo, ...) SENTINEL;
+char          *repo_path_buf(Repository *repo, char *buf, size_t size, ...) SENTINEL;
+char          *repo_file(Repository *repo, bool mkdir, ...) SENTINEL;
+char          *repo_dir(Repository *repo, bool mkdir, ...) SENTINEL;
+int            repo_gitdir_fd(Repository *repo);
+int            repo_objects_fd(Repository *repo);
+int            repo_fanout_fd(Repository *repo, unsigned int byte, bool create);
+void           repo_fanout_forget(Repository *repo, unsigned int byte);
 
 #endif
@@ -0,0 +1,72 @@
+/* revwalk.h: walking commit history */
+
+#ifndef REVWALK_H
+#define REVWALK_H
+
+#include "bloom.h"
+#include "commit_graph.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define REVWALK_NO_POS  UINT32_MAX      /* commit is not in the commit-graph */
+
+/* Structures */
+
+typedef struct {
+    unsigned char sha[SHA_SIZE];
+    unsigned char tree[SHA_SIZE];
+    uint64_t      date;                 /* committer time */
+    uint32_t      generation;           /* COMMIT_GRAPH_GENERATION_INFINITY outside the graph */
+    uint32_t      pos;                  /* graph position, or REVWALK_NO_POS */
+    size_t        parent_count;
+    const unsigned char (*parents)[SHA_SIZE];   /* valid until the walk moves on */
+    GitCommit     *commit;              /* parsed object, NULL when served from the graph */
+} RevCommit;
+
+typedef struct {
+    uint64_t      date;
+    uint64_t      order;                /* insertion counter: equal dates pop oldest first */
+    uint32_t      pos;                  /* graph position, or REVWALK_NO_POS */
+    unsigned char sha[SHA_SIZE];
+} RevQueueEntry;
+
+typedef struct {
+    Repository    *repo;
+    CommitGraph   *graph;               /* NULL if the repository has none */
+    RevQueueEntry *queue;               /* binary max-heap on (date, -order) */
+    size_t        count;
+    size_t        capacity;
+    uint64_t      order;
+    ShaSet        seen;
+    unsigned char (*parents)[SHA_SIZE];
+    uint32_t      *positions;
+    size_t        parent_capacity;
+    size_t        from_graph;           /* commits answered by the graph */
+    size_t        from_objects;         /* commits that had to be parsed */
+    char          **paths;              /* only show commits changing these; NULL for all */
+    size_t        path_count;
+    BloomKey      *keys;                /* every leading directory of every path */
+    size_t        *key_ends;            /* keys of path i end at key_ends[i] */
+    size_t        bloom_checked;        /* first-parent comparisons with a filter */
+    size_t        bloom_skipped;        /* of which the filter ruled out the paths */
+    bool          error;                /* set when a commit could not be read */
+} RevWalk;
+
+/* Functions */
+
+void revwalk_init(RevWalk *walk, Repository *repo);
+bool revwalk_push(RevWalk *walk, const unsigned char sha[SHA_SIZE]);
+void revwalk_limit_paths(RevWalk *walk, char *const *paths, size_t count);
+bool revwalk_next(RevWalk *walk, RevCommit *commit);
+bool revwalk_lookup(RevWalk *walk, const unsigned char sha[SHA_SIZE], RevCommit *commit);
+void revwalk_release(RevWalk *walk);
+bool revwalk_is_ancestor(Repository *repo, const unsigned char ancestor[SHA_SIZE], const unsigned char descendant[SHA_SIZE], bool *result);
+
+#endif
@@ -0,0 +1,31 @@
+/* serve.h: answering object requests from a long-running process */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define SERVE_INPUT_BUFFER  (1 << 16)   /* grows for longer request lines */
+#define SERVE_OUTPUT_BUFFER (1 << 16)   /* flushed whenever the input would block */
+
+/* Structures */
+
+typedef struct {
+    size_t   requests;
+    size_t   missing;           /* answered "<name> missing" */
+    uint64_t bytes;             /* object contents written */
+    size_t   rescans;           /* pack directory changes picked up */
+} ServeStats;
+
+/* Functions */
+
+bool serve_batch(Repository *repo, int in_fd, int out_fd, bool check, ServeStats *stats);
+
+#endif
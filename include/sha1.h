@@ -0,0 +1,43 @@
+/* sha1.h: SHA-1 hashing with runtime backend selection */
+
+#ifndef SHA1_H
+#define SHA1_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define SHA1_BLOCK_SIZE 64
+
+/* Structures */
+
+typedef enum {
+    SHA1_BACKEND_PORTABLE = 0,
+    SHA1_BACKEND_SHANI    = 1,
+    SHA1_BACKEND_ARMV8    = 2,
+} Sha1Backend;
+
+typedef struct {
+    uint32_t      state[5];
+    uint64_t      length;                   /* total bytes fed so far */
+    unsigned char buffer[SHA1_BLOCK_SIZE];  /* partial block awaiting compression */
+    size_t        buffer_len;
+} Sha1Context;
+
+/* Functions */
+
+void        sha1_init(Sha1Context *ctx);
+void        sha1_update(Sha1Context *ctx, const void *data, size_t len);
+void        sha1_final(Sha1Context *ctx, unsigned char digest[SHA_SIZE]);
+void        sha1_buffer(const void *data, size_t len, unsigned char digest[SHA_SIZE]);
+
+Sha1Backend sha1_backend(void);
+const char *sha1_backend_name(Sha1Backend backend);
+bool        sha1_backend_supported(Sha1Backend backend);
+bool        sha1_set_backend(Sha1Backend backend);
+
+#endif
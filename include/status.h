@@ -0,0 +1,64 @@
+/* status.h: worktree, index and HEAD comparison */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "index.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define STATUS_CHUNK            1024        /* index entries per lstat job */
+#define STATUS_CACHE_FILE       "untracked-cache"
+#define STATUS_CACHE_SIGNATURE  0x554e5443u /* "UNTC" */
+#define STATUS_CACHE_VERSION    1
+#define STATUS_HOOK_VERSION     "2"         /* fsmonitor hook protocol */
+
+/* Structures */
+
+typedef enum {
+    UNTRACKED_NO,
+    UNTRACKED_NORMAL,       /* untracked directories collapsed to "dir/" */
+    UNTRACKED_ALL,
+} UntrackedMode;
+
+typedef struct {
+    const char *path;       /* relative to the top; untracked directories end in '/' */
+    char       staged;      /* HEAD against the index: ' ', 'A', 'M', 'T', 'D', 'U', '?' */
+    char       worktree;    /* index against the worktree: ' ', 'M', 'T', 'D', 'U', '?' */
+} StatusItem;
+
+typedef struct {
+    UntrackedMode untracked;
+    size_t        threads;
+    bool          refresh;          /* write refreshed stat data back to the index */
+    bool          untracked_cache;  /* keep per-directory listings in .git/untracked-cache */
+    const char    *fsmonitor;       /* hook reporting changed paths, NULL for none */
+} StatusOptions;
+
+typedef struct {
+    StatusItem *items;      /* tracked changes in path order, then untracked in path order */
+    size_t     count;
+    size_t     capacity;
+    Arena      arena;
+
+    size_t     checked;     /* index entries lstat'd */
+    size_t     hashed;      /* entries whose content had to be read */
+    size_t     refreshed;   /* entries whose stat data was refreshed */
+    size_t     dirs_read;   /* directories listed with readdir */
+    size_t     dirs_cached; /* directories answered by the untracked cache */
+    bool       fsmonitor_used;
+} StatusResult;
+
+/* Functions */
+
+void status_options_init(StatusOptions *options, const Repository *repo);
+bool status_collect(Repository *repo, const StatusOptions *options, StatusResult *result);
+void status_result_free(StatusResult *result);
+
+#endif
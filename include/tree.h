@@ -0,0 +1,45 @@
+/* tree.h: tree object entries */
+
+#ifndef TREE_H
+#define TREE_H
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Macros */
+
+#define TREE_MODE_TREE      0040000
+#define TREE_MODE_SYMLINK   0120000
+#define TREE_MODE_GITLINK   0160000
+#define TREE_MODE_TYPE      0170000
+
+/* Structures */
+
+typedef struct {
+    uint32_t            mode;
+    uint32_t            name_off;      /* NUL-terminated name inside the tree body */
+    uint32_t            name_len;
+    unsigned char       sha[SHA_SIZE]; /* raw, straight from the body */
+} TreeLeaf;
+
+typedef struct {
+    const unsigned char *data;         /* the tree body all offsets refer to */
+    TreeLeaf            *leaves;       /* in body order; arena-allocated */
+    size_t              count;
+    bool                sorted;        /* body is in git order, so lookups can bisect */
+} Tree;
+
+/* Functions */
+
+bool            tree_parse(Tree *tree, const unsigned char *data, size_t size, Arena *arena);
+const TreeLeaf *tree_find(const Tree *tree, const char *name, size_t len);
+int             tree_name_compare(const char *a, size_t a_len, uint32_t a_mode, const char *b, size_t b_len, uint32_t b_mode);
+const char     *tree_leaf_type(const TreeLeaf *leaf);
+
+static inline const char *tree_leaf_name(const Tree *tree, const TreeLeaf *leaf) { return (const char *)tree->data + leaf->name_off; }
+static inline bool tree_leaf_is_tree(const TreeLeaf *leaf) { return (leaf->mode & TREE_MODE_TYPE) == TREE_MODE_TREE; }
+
+#endif
@@ -6,13 +6,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /* Macros */
 
 #define MAX_NAME (1<<8)
+#define SHA_SIZE      20
+#define SHA_HEX_SIZE  (2 * SHA_SIZE + 1)
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define SENTINEL __attribute__((sentinel))   /* variadic list must end with NULL */
+#define TRACE_ENV        "GIT_CLONE_TRACE_PERF"
+#define TRACE_DEPTH      16                  /* nested spans recorded per thread */
+#define TRACE_EVENT_MAX  (1 << 20)           /* spans kept for the Chrome trace */
 
 #define MALLOC_CHECK(ptr) \
     do { \
@@ -30,6 +39,47 @@
         } \
     } while (0)
 
+/* Structures */
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t             size;
+    size_t             used;
+    _Alignas(16) unsigned char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;           /* block currently carved from */
+    ArenaBlock *large;          /* dedicated blocks for oversized requests */
+    size_t      allocated;      /* bytes handed out */
+} Arena;
+
+typedef struct {
+    unsigned char (*slots)[SHA_SIZE];   /* open addressing; the null SHA marks a free slot */
+    size_t        capacity;             /* power of two */
+    size_t        count;
+} ShaSet;
+
+typedef enum {
+    TRACE_REPO_CREATE,
+    TRACE_REPO_FIND,
+    TRACE_CONFIG_CREATE,
+    TRACE_INI_PARSE,
+    TRACE_OBJECT_READ,
+    TRACE_OBJECT_STREAM,
+    TRACE_OBJECT_WRITE,
+    TRACE_PACK_LOOKUP,
+    TRACE_PHASES,
+} TracePhase;
+
+typedef enum {
+    TRACE_SYSCALLS,             /* issued by the instrumented code */
+    TRACE_INFLATED,             /* bytes produced by inflate() */
+    TRACE_COUNTERS,
+} TraceCounter;
+
+extern bool trace_enabled;
+
 /* Memory & IO */
 
 static inline FILE *safe_fopen(const char *f, const char *s){
@@ -56,14 +106,80 @@ static inline void *safe_strdup(const char *s){
     return ptr; 
 }
 
+/* Byte Order */
+
+static inline uint16_t get_be16(const unsigned char *p){
+    return (uint16_t)(((unsigned)p[0] << 8) | p[1]);
+}
+
+static inline void put_be16(unsigned char *p, uint16_t v){
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+static inline uint32_t get_be32(const unsigned char *p){
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t get_be64(const unsigned char *p){
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static inline void put_be32(unsigned char *p, uint32_t v){
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static inline void put_be64(unsigned char *p, uint64_t v){
+    put_be32(p, (uint32_t)(v >> 32));
+    put_be32(p + 4, (uint32_t)v);
+}
+
+/* Tracing */
+
+bool     trace_init(void);
+uint64_t trace_push(TracePhase phase);
+void     trace_pop(uint64_t start);
+void     trace_add(TraceCounter counter, uint64_t n);
+
+/* Starts a span; pass the result to trace_end(). Costs one load when tracing is off. */
+static inline uint64_t trace_begin(TracePhase phase){ return trace_enabled ? trace_push(phase) : 0; }
+
+static inline void trace_end(uint64_t start){ if (start) { trace_pop(start); } }
+
+static inline void trace_count(TraceCounter counter, uint64_t n){ if (trace_enabled) { trace_add(counter, n); } }
+
+static inline void trace_scope_end(uint64_t *start){ trace_end(*start); }
+
+/* Traces the rest of the enclosing block; every return path closes the span */
+#define TRACE_SCOPE(phase) \
+    uint64_t trace_scope __attribute__((cleanup(trace_scope_end))) = trace_begin(phase)
+
 /* Functions */
 
-char *path_join(const char *s1, ...);
+char  *path_join(const char *s1, ...) SENTINEL;
+size_t path_join_buf(char *buf, size_t size, const char *s1, ...) SENTINEL;
+size_t path_vjoin_buf(char *buf, size_t size, const char *s1, va_list args);
 bool is_directory(const char *path);
 bool file_exists(const char *path);
 bool mkdir_p(const char *path, mode_t mode); 
 bool is_directory_empty(const char *path);
 bool remove_directory(const char *path);
+bool write_all(int fd, const void *buf, size_t len);
+bool hex_to_sha(const char *hex, unsigned char sha[SHA_SIZE]);
+void sha_to_hex(const unsigned char sha[SHA_SIZE], char hex[SHA_HEX_SIZE]);
+bool parse_size(const char *s, size_t *value);
+const unsigned char *map_file(const char *path, size_t *size);
+
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_memdup(Arena *arena, const void *data, size_t size);
+void  arena_clear(Arena *arena);
+
+bool  sha_set_insert(ShaSet *set, const unsigned char sha[SHA_SIZE]);
+bool  sha_set_contains(const ShaSet *set, const unsigned char sha[SHA_SIZE]);
+void  sha_set_free(ShaSet *set);
 
 /* Miscellaneous */
 
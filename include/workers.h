@@ -0,0 +1,19 @@
+/* workers.h: fixed-size thread pool for data-parallel jobs */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Structures */
+
+typedef void (*WorkerFn)(void *ctx, size_t index);
+
+/* Functions */
+
+size_t workers_default_count(void);
+size_t workers_parse_count(const char *s);
+bool   workers_run(size_t threads, size_t jobs, WorkerFn fn, void *ctx);
+
+#endif
@@ -35,7 +35,7 @@ TESTS_MAX=$(bin/$UNIT 2>&1 | tail -n 1 | awk '{print $1}' | tr -d '.')
 TOTAL_COUNT=$((TESTS_MAX + 1))
 
 for t in $(seq 0 $TESTS_MAX); do
-    desc=$(bin/$UNIT 2>&1 | awk "/$t\./ { \$1=\$2=\"\"; print \$0 }")
+    desc=$(bin/$UNIT 2>&1 | awk "\$1 == \"$t.\" { \$1=\$2=\"\"; print \$0 }")
 
     printf "%-60s... " "$desc"
     
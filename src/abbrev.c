@@ -0,0 +1,358 @@
+/* abbrev.c: abbreviated object names */
+
+#include "abbrev.h"
+#include "midx.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    const unsigned char *oids;          /* sorted 20-byte names */
+    size_t              lo;             /* the range sharing the key's first byte */
+    size_t              hi;
+} OidTable;
+
+/* Forward Declaration of static Functions */
+
+static bool         prefix_parse(const char *hex, size_t len, unsigned char key[SHA_SIZE]);
+static bool         prefix_match(const unsigned char *sha, const unsigned char key[SHA_SIZE], size_t len);
+static size_t       common_nibbles(const unsigned char *a, const unsigned char *b);
+static OidTable    *tables_collect(Repository *repo, unsigned char byte, size_t *count);
+static OidTable     table_from_fanout(const unsigned char *fanout, const unsigned char *oids, size_t count, unsigned char byte);
+static size_t       table_lower_bound(const OidTable *table, const unsigned char key[SHA_SIZE]);
+static LooseBucket *loose_bucket(Repository *repo, unsigned char byte);
+static void         match_add(AbbrevMatches *matches, const unsigned char sha[SHA_SIZE]);
+static int          compare_shas(const void *a, const void *b);
+
+/* Functions */
+
+/**
+ * abbrev_matches - Lists the objects whose name starts with a hex prefix.
+ *
+ * Every pack index (or the multi-pack-index covering it) is searched with
+ * a binary search inside the prefix's fan-out range. Loose objects come
+ * from a sorted listing of objects/xx, made once per directory and kept
+ * with the repository until the directory's mtime changes, so repeated
+ * lookups cost one fstat() instead of a readdir().
+ *
+ * @param repo    The repository.
+ * @param hex     The prefix, ABBREV_MIN_LEN to 40 hex digits.
+ * @param len     Digits of hex used.
+ * @param limit   Stop once this many distinct objects are found.
+ * @param matches Output; objects are appended, each once.
+ * @return True if the prefix is valid, false otherwise.
+ */
+bool abbrev_matches(Repository *repo, const char *hex, size_t len, size_t limit, AbbrevMatches *matches){
+    unsigned char key[SHA_SIZE];
+    if (!repo || !matches || !prefix_parse(hex, len, key)) { return false; }
+
+    size_t count;
+    OidTable *tables = tables_collect(repo, key[0], &count);
+    for (size_t t = 0; t < count && matches->count < limit; t++){
+        const OidTable *table = &tables[t];
+        for (size_t pos = table_lower_bound(table, key); pos < table->hi && matches->count < limit; pos++){
+            const unsigned char *sha = table->oids + pos * SHA_SIZE;
+            if (!prefix_match(sha, key, len)) { break; }
+            match_add(matches, sha);
+        }
+    }
+    free(tables);
+    return true;
+}
+
+/**
+ * abbrev_resolve - Resolves a hex prefix to the one object it names.
+ *
+ * When several objects match and a type is given, only those that peel to
+ * that type count (commits and tags of commits for OBJ_COMMIT, as git's
+ * "commit-ish" disambiguation does).
+ *
+ * @param repo The repository.
+ * @param hex  The prefix.
+ * @param len  Digits of hex used.
+ * @param type Type used to choose between several matches, or OBJ_NONE.
+ * @param sha  Output for the object, when unique.
+ * @return ABBREV_UNIQUE with sha set, ABBREV_NONE if nothing matches (or the
+ * prefix is not hex), ABBREV_AMBIGUOUS if several objects remain.
+ */
+AbbrevStatus abbrev_resolve(Repository *repo, const char *hex, size_t len, ObjectType type, unsigned char sha[SHA_SIZE]){
+    AbbrevMatches matches = { 0 };
+    if (!sha || !abbrev_matches(repo, hex, len, type == OBJ_NONE ? 2 : SIZE_MAX, &matches)) { return ABBREV_NONE; }
+
+    size_t kept = matches.count;
+    if (kept > 1 && type != OBJ_NONE){
+        kept = 0;
+        for (size_t i = 0; i < matches.count; i++){
+            if (object_peel(repo, matches.shas[i], type)) { memcpy(matches.shas[kept++], matches.shas[i], SHA_SIZE); }
+        }
+    }
+
+    AbbrevStatus status = kept == 0 ? ABBREV_NONE : kept == 1 ? ABBREV_UNIQUE : ABBREV_AMBIGUOUS;
+    if (status == ABBREV_UNIQUE) { memcpy(sha, matches.shas[0], SHA_SIZE); }
+    if (status == ABBREV_NONE && matches.count) { status = ABBREV_AMBIGUOUS; }
+    abbrev_matches_free(&matches);
+    return status;
+}
+
+/**
+ * abbrev_unique_len - Finds how many hex digits name an object unambiguously.
+ *
+ * Only the neighbours of the object in each sorted table can share a
+ * longer prefix with it, so this is one binary search per table.
+ *
+ * @param repo    The repository.
+ * @param sha     The object (it need not exist).
+ * @param min_len Fewest digits to use.
+ * @return The length, between min_len and 40.
+ */
+size_t abbrev_unique_len(Repository *repo, const unsigned char sha[SHA_SIZE], size_t min_len){
+    if (!repo || !sha) { return 2 * SHA_SIZE; }
+
+    size_t len = min_len, count;
+    OidTable *tables = tables_collect(repo, sha[0], &count);
+    for (size_t t = 0; t < count; t++){
+        const OidTable *table = &tables[t];
+        size_t pos = table_lower_bound(table, sha);
+        if (pos > table->lo){
+            size_t common = common_nibbles(table->oids + (pos - 1) * SHA_SIZE, sha);
+            if (common + 1 > len) { len = common + 1; }
+        }
+        if (pos < table->hi && memcmp(table->oids + pos * SHA_SIZE, sha, SHA_SIZE) == 0) { pos++; }
+        if (pos < table->hi){
+            size_t common = common_nibbles(table->oids + pos * SHA_SIZE, sha);
+            if (common + 1 > len) { len = common + 1; }
+        }
+    }
+    free(tables);
+    return min(len, (size_t)2 * SHA_SIZE);
+}
+
+/**
+ * abbrev_default_len - Digits an abbreviation starts from in this repository.
+ *
+ * core.abbrev if it is a number; otherwise (unset or "auto") half the bits
+ * of the packed object count, rounded up, but at least ABBREV_DEFAULT_LEN,
+ * which is how git scales it.
+ *
+ * @param repo The repository.
+ * @return The length, between ABBREV_MIN_LEN and 40.
+ */
+size_t abbrev_default_len(Repository *repo){
+    const char *value = repo ? config_get(repo->config, "core.abbrev") : NULL;
+    if (value && !streq(value, "auto")){
+        char *end;
+        unsigned long n = strtoul(value, &end, 10);
+        if (end != value && !*end) { return n < ABBREV_MIN_LEN ? ABBREV_MIN_LEN : min(n, 2ul * SHA_SIZE); }
+    }
+    if (!repo) { return ABBREV_DEFAULT_LEN; }
+
+    size_t count = 0, bits = 0;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { count += pack->in_midx ? 0 : pack->count; }
+    if (repo->midx) { count += repo->midx->count; }
+    while (bits < 64 && count >> bits) { bits++; }
+    size_t len = (bits + 1) / 2;
+    return len < ABBREV_DEFAULT_LEN ? ABBREV_DEFAULT_LEN : len;
+}
+
+/**
+ * abbrev_matches_free - Releases a match list; it is left empty.
+ */
+void abbrev_matches_free(AbbrevMatches *matches){
+    free(matches->shas);
+    memset(matches, 0, sizeof(*matches));
+}
+
+/**
+ * loose_cache_free - Drops the listings of loose objects.
+ *
+ * @param repo The repository; directories are listed again when next needed.
+ */
+void loose_cache_free(Repository *repo){
+    if (!repo || !repo->loose_objects) { return; }
+
+    for (size_t b = 0; b < REPO_FANOUT_DIRS; b++) { free(repo->loose_objects->buckets[b].shas); }
+    free(repo->loose_objects);
+    repo->loose_objects = NULL;
+}
+
+/* Static Functions */
+
+/**
+ * prefix_parse - Decodes a hex prefix into a zero-padded key.
+ *
+ * @return True if hex has len (ABBREV_MIN_LEN to 40) valid digits.
+ */
+static bool prefix_parse(const char *hex, size_t len, unsigned char key[SHA_SIZE]){
+    if (!hex || len < ABBREV_MIN_LEN || len > 2 * SHA_SIZE) { return false; }
+
+    memset(key, 0, SHA_SIZE);
+    for (size_t i = 0; i < len; i++){
+        char c = hex[i];
+        unsigned char nibble;
+        if (c >= '0' && c <= '9')       { nibble = (unsigned char)(c - '0'); }
+        else if (c >= 'a' && c <= 'f')  { nibble = (unsigned char)(c - 'a' + 10); }
+        else if (c >= 'A' && c <= 'F')  { nibble = (unsigned char)(c - 'A' + 10); }
+        else                            { return false; }
+        key[i / 2] |= i % 2 ? nibble : (unsigned char)(nibble << 4);
+    }
+    return true;
+}
+
+/**
+ * prefix_match - Tells whether the first len hex digits of sha are those of key.
+ */
+static bool prefix_match(const unsigned char *sha, const unsigned char key[SHA_SIZE], size_t len){
+    if (memcmp(sha, key, len / 2) != 0) { return false; }
+    return len % 2 == 0 || (sha[len / 2] & 0xf0) == key[len / 2];
+}
+
+/**
+ * common_nibbles - Counts the leading hex digits two names share.
+ */
+static size_t common_nibbles(const unsigned char *a, const unsigned char *b){
+    for (size_t i = 0; i < SHA_SIZE; i++){
+        if (a[i] != b[i]) { return 2 * i + ((a[i] ^ b[i]) & 0xf0 ? 0 : 1); }
+    }
+    return 2 * SHA_SIZE;
+}
+
+/**
+ * tables_collect - Gathers the sorted name tables an object starting with byte may be in.
+ *
+ * @param repo  The repository.
+ * @param byte  First byte of the names looked for.
+ * @param count Output for the number of tables.
+ * @return The tables: the multi-pack-index, each pack it does not cover
+ * and the loose objects of objects/xx. The caller frees the array.
+ */
+static OidTable *tables_collect(Repository *repo, unsigned char byte, size_t *count){
+    size_t capacity = 2;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { capacity++; }
+    OidTable *tables = safe_malloc(sizeof(OidTable), capacity);
+
+    *count = 0;
+    if (repo->midx) { tables[(*count)++] = table_from_fanout(repo->midx->fanout, repo->midx->oids, repo->midx->count, byte); }
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next){
+        if (!pack->in_midx) { tables[(*count)++] = table_from_fanout(pack->fanout, pack->oids, pack->count, byte); }
+    }
+    LooseBucket *bucket = loose_bucket(repo, byte);
+    if (bucket->count) { tables[(*count)++] = (OidTable){ (const unsigned char *)bucket->shas, 0, bucket->count }; }
+    return tables;
+}
+
+/**
+ * table_from_fanout - The range of an index table whose names start with byte.
+ *
+ * The range is clamped to the count names of the table, so a corrupt
+ * fan-out never reaches past it.
+ */
+static OidTable table_from_fanout(const unsigned char *fanout, const unsigned char *oids, size_t count, unsigned char byte){
+    size_t hi = get_be32(fanout + 4 * byte);
+    size_t lo = byte ? get_be32(fanout + 4 * (byte - 1)) : 0;
+    if (hi > count) { hi = count; }
+    if (lo > hi) { lo = hi; }
+    OidTable table = { oids, lo, hi };
+    return table;
+}
+
+/**
+ * table_lower_bound - Position of the first name in the table not below key.
+ */
+static size_t table_lower_bound(const OidTable *table, const unsigned char key[SHA_SIZE]){
+    size_t lo = table->lo, hi = table->hi;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (memcmp(table->oids + mid * SHA_SIZE, key, SHA_SIZE) < 0) { lo = mid + 1; }
+        else                                                         { hi = mid; }
+    }
+    return lo;
+}
+
+/**
+ * loose_bucket - Returns the sorted loose object names of objects/xx.
+ *
+ * The directory is listed on first use and again whenever its mtime has
+ * moved, which creating or removing an object inside it does.
+ */
+static LooseBucket *loose_bucket(Repository *repo, unsigned char byte){
+    if (!repo->loose_objects) { repo->loose_objects = safe_calloc(sizeof(LooseObjectCache), 1); }
+    LooseBucket *bucket = &repo->loose_objects->buckets[byte];
+
+    int dir_fd = repo_fanout_fd(repo, byte, false);
+    struct stat sb;
+    if (dir_fd < 0 || fstat(dir_fd, &sb) != 0){
+        bucket->count = 0;
+        bucket->loaded = false;
+        return bucket;
+    }
+    trace_count(TRACE_SYSCALLS, 1);
+    if (bucket->loaded && sb.st_mtim.tv_sec == bucket->mtime.tv_sec && sb.st_mtim.tv_nsec == bucket->mtime.tv_nsec){
+        return bucket;
+    }
+
+    bucket->count = 0;
+    bucket->loaded = true;
+    bucket->mtime = sb.st_mtim;
+    int fd = openat(dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd < 0 ? NULL : fdopendir(fd);
+    if (!dir){
+        if (fd >= 0) { close(fd); }
+        bucket->loaded = false;
+        return bucket;
+    }
+
+    size_t capacity = 0;
+    for (struct dirent *e = readdir(dir); e; e = readdir(dir)){
+        char hex[SHA_HEX_SIZE];
+        if (strlen(e->d_name) != 2 * SHA_SIZE - 2) { continue; }
+        snprintf(hex, 3, "%02x", byte);
+        memcpy(hex + 2, e->d_name, 2 * SHA_SIZE - 1);
+        if (bucket->count == capacity){
+            capacity = capacity ? 2 * capacity : 16;
+            bucket->shas = realloc(bucket->shas, capacity * SHA_SIZE);
+            MALLOC_CHECK(bucket->shas);
+        }
+        if (hex_to_sha(hex, bucket->shas[bucket->count])) { bucket->count++; }
+    }
+    closedir(dir);
+    trace_count(TRACE_SYSCALLS, 3);
+
+    qsort(bucket->shas, bucket->count, SHA_SIZE, compare_shas);
+    return bucket;
+}
+
+/**
+ * match_add - Appends an object to a match list unless it is already there.
+ */
+static void match_add(AbbrevMatches *matches, const unsigned char sha[SHA_SIZE]){
+    for (size_t i = 0; i < matches->count; i++){
+        if (memcmp(matches->shas[i], sha, SHA_SIZE) == 0) { return; }
+    }
+    if (matches->count == matches->capacity){
+        matches->capacity = matches->capacity ? 2 * matches->capacity : 4;
+        matches->shas = realloc(matches->shas, matches->capacity * SHA_SIZE);
+        MALLOC_CHECK(matches->shas);
+    }
+    memcpy(matches->shas[matches->count++], sha, SHA_SIZE);
+}
+
+/**
+ * compare_shas - qsort comparator for raw object names.
+ */
+static int compare_shas(const void *a, const void *b){
+    return memcmp(a, b, SHA_SIZE);
+}
@@ -0,0 +1,295 @@
+/* bloom.c: changed-path Bloom filters */
+
+#include "bloom.h"
+#include "objects.h"
+#include "repository.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Structures */
+
+typedef struct {
+    Repository *repo;
+    BloomPaths *paths;
+    char       path[MAX_PATH];          /* directory being compared, with a trailing '/' */
+    size_t     len;
+    bool       status;
+} PathDiff;
+
+/* Forward Declaration of static Functions */
+
+static bool        diff_trees(PathDiff *diff, const unsigned char *old_sha, const unsigned char *new_sha);
+static void        diff_entry(PathDiff *diff, const Tree *tree, const TreeLeaf *leaf, const TreeLeaf *match);
+static const Tree *diff_load(PathDiff *diff, const unsigned char *sha);
+static void        paths_add(BloomPaths *paths, const char *path, size_t len);
+static int         compare_paths(const void *a, const void *b);
+
+static inline uint32_t rotl32(uint32_t x, unsigned r) { return (x << r) | (x >> (32 - r)); }
+
+/* Functions */
+
+/**
+ * bloom_murmur3 - 32-bit MurmurHash3 as used by version 1 filters.
+ *
+ * Bytes are read as (signed) char, so bytes above 0x7f are sign-extended
+ * exactly as git does; filters stay interchangeable with git's.
+ *
+ * @param seed Hash seed.
+ * @param data The bytes to hash.
+ * @param len  Their number.
+ * @return The hash.
+ */
+uint32_t bloom_murmur3(uint32_t seed, const char *data, size_t len){
+    const uint32_t c1 = 0xcc9e2d51u, c2 = 0x1b873593u;
+    uint32_t h = seed;
+
+    size_t blocks = len / 4;
+    for (size_t i = 0; i < blocks; i++){
+        const signed char *p = (const signed char *)data + 4 * i;
+        uint32_t k = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        k = rotl32(k * c1, 15) * c2;
+        h = rotl32(h ^ k, 13) * 5 + 0xe6546b64u;
+    }
+
+    const signed char *tail = (const signed char *)data + 4 * blocks;
+    uint32_t k = 0;
+    switch (len & 3){
+        case 3: k ^= (uint32_t)tail[2] << 16;   /* fall through */
+        case 2: k ^= (uint32_t)tail[1] << 8;    /* fall through */
+        case 1:
+            k ^= (uint32_t)tail[0];
+            h ^= rotl32(k * c1, 15) * c2;
+            break;
+        default: break;
+    }
+
+    h ^= (uint32_t)len;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * bloom_key - Derives the bit positions of a path by double hashing.
+ *
+ * @param key  Output.
+ * @param path The path, without a trailing slash.
+ * @param len  Its length.
+ */
+void bloom_key(BloomKey *key, const char *path, size_t len){
+    uint32_t h0 = bloom_murmur3(BLOOM_SEED0, path, len), h1 = bloom_murmur3(BLOOM_SEED1, path, len);
+    for (uint32_t i = 0; i < BLOOM_NUM_HASHES; i++) { key->hashes[i] = h0 + i * h1; }
+}
+
+/**
+ * bloom_add - Sets the bits of a key in a filter.
+ *
+ * @param data The filter's bytes.
+ * @param len  Their number; must not be 0.
+ * @param key  The key.
+ */
+void bloom_add(unsigned char *data, size_t len, const BloomKey *key){
+    uint64_t bits = (uint64_t)len * 8;
+    for (size_t i = 0; i < BLOOM_NUM_HASHES; i++){
+        uint64_t bit = key->hashes[i] % bits;
+        data[bit / 8] |= (unsigned char)(1u << (bit & 7));
+    }
+}
+
+/**
+ * bloom_maybe_contains - Tests a key against a filter.
+ *
+ * @param filter The filter; an empty one (not computed) answers maybe.
+ * @param key    The key.
+ * @return False if the path was certainly not changed, true if it may have been.
+ */
+bool bloom_maybe_contains(const BloomFilter *filter, const BloomKey *key){
+    if (!filter->len) { return true; }
+
+    uint64_t bits = (uint64_t)filter->len * 8;
+    for (size_t i = 0; i < BLOOM_NUM_HASHES; i++){
+        uint64_t bit = key->hashes[i] % bits;
+        if (!(filter->data[bit / 8] & (1u << (bit & 7)))) { return false; }
+    }
+    return true;
+}
+
+/**
+ * bloom_changed_paths - Lists the paths that differ between two trees.
+ *
+ * Subtrees with the same SHA on both sides are skipped without being read.
+ * Every changed file is listed along with each of its leading directories,
+ * once. The comparison stops once more than BLOOM_MAX_CHANGED_PATHS files
+ * changed, since such a filter is not stored anyway.
+ *
+ * @param repo     The repository.
+ * @param old_tree The parent's root tree, or NULL for a root commit.
+ * @param new_tree The commit's root tree.
+ * @param paths    Output; reset first, released with bloom_paths_clear().
+ * @return True on success, false if a tree cannot be read.
+ */
+bool bloom_changed_paths(Repository *repo, const unsigned char *old_tree, const unsigned char *new_tree, BloomPaths *paths){
+    paths->len = paths->count = paths->changes = 0;
+
+    PathDiff diff = { .repo = repo, .paths = paths, .status = true };
+    if (!diff_trees(&diff, old_tree, new_tree)) { return false; }
+    if (paths->changes > BLOOM_MAX_CHANGED_PATHS || paths->count < 2) { return true; }
+
+    /* a file replaced by a directory of the same name (or the reverse) is listed twice */
+    const char **sorted = safe_malloc(sizeof(char *), paths->count);
+    for (size_t i = 0; i < paths->count; i++) { sorted[i] = paths->names + paths->offsets[i]; }
+    qsort(sorted, paths->count, sizeof(char *), compare_paths);
+    size_t unique = 1;
+    paths->offsets[0] = (size_t)(sorted[0] - paths->names);
+    for (size_t i = 1; i < paths->count; i++){
+        if (!streq(sorted[i], sorted[i - 1])) { paths->offsets[unique++] = (size_t)(sorted[i] - paths->names); }
+    }
+    paths->count = unique;
+    free(sorted);
+    return true;
+}
+
+/**
+ * bloom_filter_build - Builds the filter of a list of changed paths.
+ *
+ * The filter has BLOOM_BITS_PER_ENTRY bits per path, rounded up to whole
+ * bytes. No change gives a single zero byte; too many changes a single
+ * 0xff byte, which matches everything.
+ *
+ * @param paths The paths, from bloom_changed_paths().
+ * @param data  Output for the heap-allocated filter; the caller frees it.
+ * @return Its length in bytes.
+ */
+size_t bloom_filter_build(const BloomPaths *paths, unsigned char **data){
+    if (paths->changes > BLOOM_MAX_CHANGED_PATHS || paths->count > BLOOM_MAX_CHANGED_PATHS){
+        *data = safe_malloc(1, 1);
+        **data = 0xff;
+        return 1;
+    }
+
+    size_t len = (paths->count * BLOOM_BITS_PER_ENTRY + 7) / 8;
+    if (!len) { len = 1; }
+    *data = safe_calloc(1, len);
+    for (size_t i = 0; i < paths->count; i++){
+        const char *path = paths->names + paths->offsets[i];
+        BloomKey key;
+        bloom_key(&key, path, strlen(path));
+        bloom_add(*data, len, &key);
+    }
+    return len;
+}
+
+/**
+ * bloom_paths_clear - Frees the buffers of a path list.
+ */
+void bloom_paths_clear(BloomPaths *paths){
+    free(paths->names);
+    free(paths->offsets);
+    memset(paths, 0, sizeof(*paths));
+}
+
+/* Static Functions */
+
+/**
+ * diff_trees - Compares two trees below diff->path, merging their sorted entries.
+ *
+ * Either side may be NULL (the directory was added or removed). Trees that
+ * are out of git order only cause spurious changes, never missed ones.
+ */
+static bool diff_trees(PathDiff *diff, const unsigned char *old_sha, const unsigned char *new_sha){
+    const Tree *a = old_sha ? diff_load(diff, old_sha) : NULL;
+    const Tree *b = new_sha ? diff_load(diff, new_sha) : NULL;
+    if (!diff->status) { return false; }
+
+    size_t i = 0, j = 0, na = a ? a->count : 0, nb = b ? b->count : 0;
+    while ((i < na || j < nb) && diff->status && diff->paths->changes <= BLOOM_MAX_CHANGED_PATHS){
+        const TreeLeaf *x = i < na ? &a->leaves[i] : NULL, *y = j < nb ? &b->leaves[j] : NULL;
+        int cmp = !x ? 1 : !y ? -1 : tree_name_compare(tree_leaf_name(a, x), x->name_len, x->mode,
+                                                       tree_leaf_name(b, y), y->name_len, y->mode);
+        if (cmp < 0)      { diff_entry(diff, a, x, NULL); i++; }
+        else if (cmp > 0) { diff_entry(diff, b, y, NULL); j++; }
+        else {
+            if (x->mode != y->mode || memcmp(x->sha, y->sha, SHA_SIZE) != 0) { diff_entry(diff, a, x, y); }
+            i++;
+            j++;
+        }
+    }
+    return diff->status;
+}
+
+/**
+ * diff_entry - Records a changed entry, descending into directories.
+ *
+ * @param match The entry of the same name and kind on the other side, or
+ *              NULL if the entry exists on one side only.
+ */
+static void diff_entry(PathDiff *diff, const Tree *tree, const TreeLeaf *leaf, const TreeLeaf *match){
+    size_t saved = diff->len;
+    if (diff->len + leaf->name_len + 2 > sizeof(diff->path)){
+        fprintf(stderr, "bloom_changed_paths: path too long\n");
+        diff->status = false;
+        return;
+    }
+    memcpy(diff->path + diff->len, tree_leaf_name(tree, leaf), leaf->name_len);
+    diff->len += leaf->name_len;
+    paths_add(diff->paths, diff->path, diff->len);
+
+    if (!tree_leaf_is_tree(leaf)){
+        diff->paths->changes++;
+    } else {
+        /* without a match the whole directory was added or removed; which does not matter here */
+        diff->path[diff->len++] = '/';
+        diff_trees(diff, leaf->sha, match ? match->sha : NULL);
+    }
+    diff->len = saved;
+}
+
+/**
+ * diff_load - Reads a tree through the object cache.
+ */
+static const Tree *diff_load(PathDiff *diff, const unsigned char *sha){
+    GitTree *tree = (GitTree *)object_get(diff->repo, sha);
+    if (tree && tree->object.type == OBJ_TREE) { return &tree->tree; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    fprintf(stderr, "bloom_changed_paths: cannot read tree %s\n", hex);
+    diff->status = false;
+    return NULL;
+}
+
+/**
+ * paths_add - Appends a path to the list.
+ */
+static void paths_add(BloomPaths *paths, const char *path, size_t len){
+    if (paths->len + len + 1 > paths->capacity){
+        while (paths->len + len + 1 > paths->capacity) { paths->capacity = paths->capacity ? 2 * paths->capacity : 4096; }
+        paths->names = realloc(paths->names, paths->capacity);
+        MALLOC_CHECK(paths->names);
+    }
+    if (paths->count == paths->offset_capacity){
+        paths->offset_capacity = paths->offset_capacity ? 2 * paths->offset_capacity : 256;
+        paths->offsets = realloc(paths->offsets, paths->offset_capacity * sizeof(size_t));
+        MALLOC_CHECK(paths->offsets);
+    }
+    paths->offsets[paths->count++] = paths->len;
+    memcpy(paths->names + paths->len, path, len);
+    paths->len += len;
+    paths->names[paths->len++] = '\0';
+}
+
+/**
+ * compare_paths - qsort comparator ordering path pointers.
+ */
+static int compare_paths(const void *a, const void *b){
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
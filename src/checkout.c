@@ -0,0 +1,313 @@
+/* checkout.c: writing trees out to a directory */
+
+#include "checkout.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "tree.h"
+#include "utils.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define CHECKOUT_DEPTH  4096        /* nested trees accepted */
+
+/* Structures */
+
+typedef struct {
+    const char    *path;            /* relative to the target, in the walk arena */
+    uint32_t      mode;
+    unsigned char sha[SHA_SIZE];
+} CheckoutItem;
+
+typedef struct {
+    Repository    *repo;
+    int           root_fd;
+    CheckoutItem  *files;           /* blobs and symlinks */
+    size_t        file_count;
+    size_t        file_capacity;
+    const char    **dirs;           /* in walk order, so parents come first */
+    size_t        dir_count;
+    size_t        dir_capacity;
+    Arena         arena;
+    atomic_size_t failures;
+    atomic_size_t written;          /* regular files */
+    atomic_size_t symlinks;
+    atomic_uint_fast64_t bytes;
+} Checkout;
+
+/* Forward Declaration of static Functions */
+
+static bool checkout_walk(Checkout *co, const unsigned char sha[SHA_SIZE], char *path, size_t len, size_t depth);
+static void checkout_add_dir(Checkout *co, const char *path, size_t len);
+static void checkout_job(void *ctx, size_t batch);
+static bool checkout_blob(Checkout *co, const CheckoutItem *item, unsigned char *buf);
+static bool checkout_symlink(Checkout *co, const CheckoutItem *item);
+
+/* Functions */
+
+/**
+ * checkout_tree - Writes the contents of a tree into an empty or missing directory.
+ *
+ * The tree is walked once on the calling thread to list directories and
+ * files. Every directory is then created in a single pass, parents first,
+ * so the workers never race to create one. Files are written by the worker
+ * pool in CHECKOUT_BATCH jobs: each blob is inflated straight from its loose
+ * object or pack and gathered into CHECKOUT_WRITE_BUFFER writes, so many
+ * files are in flight at once and large ones cost few syscalls. Gitlinks
+ * become empty directories.
+ *
+ * @param repo    The repository holding the objects.
+ * @param tree    The tree to check out.
+ * @param path    Target directory; created if missing, refused if not empty.
+ * @param threads Workers to use; small trees are written serially anyway.
+ * @param stats   Receives counts of what was written; may be NULL.
+ * @return true if everything was written, false on error (what was written stays).
+ */
+bool checkout_tree(Repository *repo, const unsigned char tree[SHA_SIZE], const char *path, size_t threads, CheckoutStats *stats){
+    if (!repo || !tree || !path) { return false; }
+
+    if (file_exists(path)){
+        if (!is_directory(path)){
+            fprintf(stderr, "checkout_tree: %s is not a directory\n", path);
+            return false;
+        }
+        if (!is_directory_empty(path)){
+            fprintf(stderr, "checkout_tree: %s is not empty\n", path);
+            return false;
+        }
+    } else if (!mkdir_p(path, 0777)){
+        return false;
+    }
+
+    Checkout co = { .repo = repo };
+    atomic_init(&co.failures, 0);
+    atomic_init(&co.written, 0);
+    atomic_init(&co.symlinks, 0);
+    atomic_init(&co.bytes, 0);
+    co.root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (co.root_fd < 0){
+        fprintf(stderr, "checkout_tree: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char walk[MAX_PATH];
+    walk[0] = '\0';
+    bool status = checkout_walk(&co, tree, walk, 0, 0);
+
+    for (size_t i = 0; status && i < co.dir_count; i++){
+        if (mkdirat(co.root_fd, co.dirs[i], 0777) != 0 && errno != EEXIST){
+            fprintf(stderr, "checkout_tree: cannot create %s/%s: %s\n", path, co.dirs[i], strerror(errno));
+            status = false;
+        }
+    }
+
+    size_t batches = (co.file_count + CHECKOUT_BATCH - 1) / CHECKOUT_BATCH;
+    if (co.file_count < CHECKOUT_PARALLEL_MIN) { threads = 1; }
+    threads = threads ? min(threads, batches) : 1;
+    if (status && batches){
+        /* reads from several threads are only safe once the pack list exists */
+        pack_list(repo);
+        workers_run(threads, batches, checkout_job, &co);
+        status = atomic_load(&co.failures) == 0;
+    }
+
+    if (stats){
+        stats->symlinks = atomic_load(&co.symlinks);
+        stats->files = atomic_load(&co.written);
+        stats->dirs = co.dir_count;
+        stats->bytes = atomic_load(&co.bytes);
+        stats->threads = threads ? threads : 1;
+    }
+
+    close(co.root_fd);
+    free(co.files);
+    free(co.dirs);
+    arena_clear(&co.arena);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * checkout_walk - Lists the directories and files below a tree.
+ *
+ * @param path Directory of the tree relative to the target, no trailing
+ *             '/'; a MAX_PATH buffer extended in place.
+ */
+static bool checkout_walk(Checkout *co, const unsigned char sha[SHA_SIZE], char *path, size_t len, size_t depth){
+    if (depth > CHECKOUT_DEPTH){
+        fprintf(stderr, "checkout_tree: trees nested too deeply at %s\n", path);
+        return false;
+    }
+
+    GitObject *object = object_get(co->repo, sha);
+    if (!object || object->type != OBJ_TREE){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(sha, hex);
+        fprintf(stderr, "checkout_tree: %s is not a tree (at '%s')\n", hex, path);
+        return false;
+    }
+    const Tree *tree = &((GitTree *)object)->tree;
+
+    for (size_t i = 0; i < tree->count; i++){
+        const TreeLeaf *leaf = &tree->leaves[i];
+        const char *name = tree_leaf_name(tree, leaf);
+        if (!leaf->name_len || strchr(name, '/') || streq(name, ".") || streq(name, "..") || streq(name, ".git")){
+            fprintf(stderr, "checkout_tree: refusing entry '%s' in '%s'\n", name, path);
+            return false;
+        }
+
+        size_t child = len + (len ? 1 : 0) + leaf->name_len;
+        if (child >= MAX_PATH){
+            fprintf(stderr, "checkout_tree: path too long below '%s'\n", path);
+            return false;
+        }
+        if (len) { path[len] = '/'; }
+        memcpy(path + child - leaf->name_len, name, leaf->name_len + 1);
+
+        uint32_t type = leaf->mode & TREE_MODE_TYPE;
+        if (type == TREE_MODE_TREE){
+            checkout_add_dir(co, path, child);
+            if (!checkout_walk(co, leaf->sha, path, child, depth + 1)) { return false; }
+        } else if (type == TREE_MODE_GITLINK){
+            checkout_add_dir(co, path, child);
+        } else {
+            if (co->file_count == co->file_capacity){
+                co->file_capacity = co->file_capacity ? 2 * co->file_capacity : 256;
+                co->files = realloc(co->files, co->file_capacity * sizeof(CheckoutItem));
+                MALLOC_CHECK(co->files);
+            }
+            CheckoutItem *item = &co->files[co->file_count++];
+            item->path = arena_memdup(&co->arena, path, child + 1);
+            item->mode = leaf->mode;
+            memcpy(item->sha, leaf->sha, SHA_SIZE);
+        }
+        path[len] = '\0';
+    }
+    return true;
+}
+
+/**
+ * checkout_add_dir - Queues a directory for creation.
+ */
+static void checkout_add_dir(Checkout *co, const char *path, size_t len){
+    if (co->dir_count == co->dir_capacity){
+        co->dir_capacity = co->dir_capacity ? 2 * co->dir_capacity : 64;
+        co->dirs = realloc(co->dirs, co->dir_capacity * sizeof(char *));
+        MALLOC_CHECK(co->dirs);
+    }
+    co->dirs[co->dir_count++] = arena_memdup(&co->arena, path, len + 1);
+}
+
+/**
+ * checkout_job - Worker job writing one CHECKOUT_BATCH of files.
+ *
+ * @param ctx   The Checkout.
+ * @param batch Index of the batch.
+ */
+static void checkout_job(void *ctx, size_t batch){
+    Checkout *co = ctx;
+    size_t start = batch * CHECKOUT_BATCH;
+    size_t end = min(start + CHECKOUT_BATCH, co->file_count);
+    unsigned char *buf = safe_malloc(CHECKOUT_WRITE_BUFFER, 1);
+
+    for (size_t i = start; i < end; i++){
+        const CheckoutItem *item = &co->files[i];
+        bool ok = (item->mode & TREE_MODE_TYPE) == TREE_MODE_SYMLINK ? checkout_symlink(co, item) : checkout_blob(co, item, buf);
+        if (!ok) { atomic_fetch_add(&co->failures, 1); }
+    }
+    free(buf);
+}
+
+/**
+ * checkout_blob - Inflates a blob into a new file.
+ *
+ * A body that arrives in one chunk is written directly; larger ones are
+ * gathered into buf and written CHECKOUT_WRITE_BUFFER bytes at a time.
+ */
+static bool checkout_blob(Checkout *co, const CheckoutItem *item, unsigned char *buf){
+    ObjectStream *stream = object_stream_open(co->repo, item->sha);
+    if (!stream || stream->type != OBJ_BLOB){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(item->sha, hex);
+        fprintf(stderr, "checkout_tree: missing blob %s for %s\n", hex, item->path);
+        object_stream_close(stream);
+        return false;
+    }
+
+    mode_t mode = (item->mode & 0100) ? 0777 : 0666;
+    int fd = openat(co->root_fd, item->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    if (fd < 0){
+        fprintf(stderr, "checkout_tree: cannot create %s: %s\n", item->path, strerror(errno));
+        object_stream_close(stream);
+        return false;
+    }
+
+    const unsigned char *chunk;
+    ssize_t n;
+    size_t used = 0;
+    uint64_t total = 0;
+    bool status = true;
+    while (status && (n = object_stream_next(stream, &chunk)) > 0){
+        total += (uint64_t)n;
+        if (!used && !stream->remaining){
+            status = write_all(fd, chunk, (size_t)n);
+            continue;
+        }
+        if (used + (size_t)n > CHECKOUT_WRITE_BUFFER){
+            status = write_all(fd, buf, used);
+            used = 0;
+        }
+        memcpy(buf + used, chunk, (size_t)n);
+        used += (size_t)n;
+    }
+    if (status && n < 0) { status = false; }
+    if (status && used) { status = write_all(fd, buf, used); }
+    if (close(fd) != 0) { status = false; }
+    object_stream_close(stream);
+
+    if (!status){
+        fprintf(stderr, "checkout_tree: cannot write %s\n", item->path);
+        return false;
+    }
+    atomic_fetch_add(&co->bytes, total);
+    atomic_fetch_add(&co->written, 1);
+    return true;
+}
+
+/**
+ * checkout_symlink - Creates a symbolic link whose target is the blob's content.
+ */
+static bool checkout_symlink(Checkout *co, const CheckoutItem *item){
+    ObjectType type;
+    size_t size;
+    unsigned char *data = object_read(co->repo, item->sha, &type, &size);
+    if (!data || type != OBJ_BLOB || size >= MAX_PATH || memchr(data, '\0', size)){
+        fprintf(stderr, "checkout_tree: bad symlink target for %s\n", item->path);
+        free(data);
+        return false;
+    }
+
+    char target[MAX_PATH];
+    memcpy(target, data, size);
+    target[size] = '\0';
+    free(data);
+    if (symlinkat(target, co->root_fd, item->path) != 0){
+        fprintf(stderr, "checkout_tree: cannot link %s: %s\n", item->path, strerror(errno));
+        return false;
+    }
+    atomic_fetch_add(&co->symlinks, 1);
+    return true;
+}
@@ -0,0 +1,638 @@
+/* commit_graph.c: objects/info/commit-graph reader and writer */
+
+#include "commit_graph.h"
+#include "bloom.h"
+#include "objects.h"
+#include "refs.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    unsigned char sha[SHA_SIZE];
+    unsigned char tree[SHA_SIZE];
+    uint64_t      date;
+    size_t        parent_start;     /* into GraphBuilder.parents */
+    size_t        parent_count;
+    uint32_t      generation;
+    size_t        bloom_end;        /* end of its filter in GraphBuilder.bloom */
+} GraphCommit;
+
+typedef struct {
+    Repository    *repo;
+    GraphCommit   *commits;
+    size_t        count;
+    size_t        capacity;
+    unsigned char (*parents)[SHA_SIZE];
+    uint32_t      *parent_pos;      /* parents as positions, once commits are sorted */
+    size_t        parent_count;
+    size_t        parent_capacity;
+    unsigned char (*stack)[SHA_SIZE];
+    size_t        depth;
+    size_t        stack_capacity;
+    ShaSet        seen;
+    bool          changed_paths;
+    unsigned char *bloom;           /* changed-path filters, in commit order */
+    size_t        bloom_len;
+    size_t        bloom_capacity;
+    size_t        bloom_large;
+} GraphBuilder;
+
+/* Forward Declaration of static Functions */
+
+static bool     builder_push(GraphBuilder *builder, const unsigned char sha[SHA_SIZE]);
+static bool     builder_push_ref(const char *name, const unsigned char sha[SHA_SIZE], void *ctx);
+static bool     builder_collect(GraphBuilder *builder);
+static bool     builder_link(GraphBuilder *builder);
+static void     builder_generations(GraphBuilder *builder);
+static bool     builder_bloom(GraphBuilder *builder);
+static bool     builder_write(GraphBuilder *builder, CommitGraphStats *stats);
+static void     builder_free(GraphBuilder *builder);
+static int      compare_commits(const void *a, const void *b);
+static bool     parent_valid(const CommitGraph *graph, uint32_t pos);
+
+/* Functions */
+
+/**
+ * commit_graph_open - Maps a commit-graph file.
+ *
+ * Only the layout is validated here (signature, version, chunk table and
+ * chunk sizes against the commit count); the trailing checksum is not.
+ *
+ * @param path Path of the commit-graph file.
+ * @return A heap-allocated CommitGraph, or NULL if the file is missing or
+ * malformed.
+ * @note The caller is responsible for calling commit_graph_close().
+ */
+CommitGraph *commit_graph_open(const char *path){
+    if (!path) { return NULL; }
+
+    CommitGraph *graph = safe_calloc(sizeof(CommitGraph), 1);
+    graph->map = map_file(path, &graph->size);
+    if (!graph->map) { goto fail; }
+
+    const unsigned char *map = graph->map;
+    if (graph->size < COMMIT_GRAPH_HEADER_SIZE + 12 + SHA_SIZE || memcmp(map, COMMIT_GRAPH_SIGNATURE, 4) != 0 ||
+        map[4] != COMMIT_GRAPH_VERSION || map[5] != COMMIT_GRAPH_HASH_VERSION){
+        fprintf(stderr, "commit_graph_open: %s is not a version 1 SHA-1 commit-graph\n", path);
+        goto fail;
+    }
+
+    size_t chunks = map[6];
+    size_t table_end = COMMIT_GRAPH_HEADER_SIZE + (chunks + 1) * 12;
+    if (table_end > graph->size - SHA_SIZE) { goto malformed; }
+
+    size_t oids_size = 0, data_size = 0, edges_size = 0, index_size = 0;
+    const unsigned char *bloom = NULL;
+    for (size_t i = 0; i < chunks; i++){
+        const unsigned char *entry = map + COMMIT_GRAPH_HEADER_SIZE + i * 12;
+        uint32_t id = get_be32(entry);
+        uint64_t offset = get_be64(entry + 4), next = get_be64(entry + 16);
+        if (offset < table_end || next < offset || next > graph->size - SHA_SIZE) { goto malformed; }
+
+        size_t len = (size_t)(next - offset);
+        switch (id){
+            case COMMIT_GRAPH_CHUNK_OIDF:
+                if (len < COMMIT_GRAPH_FANOUT * 4) { goto malformed; }
+                graph->fanout = map + offset;
+                break;
+            case COMMIT_GRAPH_CHUNK_OIDL: graph->oids = map + offset;        oids_size = len;  break;
+            case COMMIT_GRAPH_CHUNK_CDAT: graph->commit_data = map + offset; data_size = len;  break;
+            case COMMIT_GRAPH_CHUNK_EDGE: graph->edges = map + offset;       edges_size = len; break;
+            case COMMIT_GRAPH_CHUNK_BIDX: graph->bloom_index = map + offset; index_size = len; break;
+            case COMMIT_GRAPH_CHUNK_BDAT:
+                if (len < BLOOM_HEADER_SIZE) { goto malformed; }
+                bloom = map + offset;
+                graph->bloom_size = len - BLOOM_HEADER_SIZE;
+                break;
+            default: break;     /* optional chunks we do not use */
+        }
+    }
+
+    if (!graph->fanout || !graph->oids || !graph->commit_data) { goto malformed; }
+    graph->count = get_be32(graph->fanout + 4 * (COMMIT_GRAPH_FANOUT - 1));
+    if (oids_size < (size_t)graph->count * SHA_SIZE || data_size < (size_t)graph->count * COMMIT_GRAPH_DATA_SIZE){
+        goto malformed;
+    }
+    graph->edge_count = edges_size / 4;
+
+    /* filters with other hash settings would need other keys: walk without them */
+    if (!bloom || index_size < (size_t)graph->count * 4 || get_be32(bloom) != BLOOM_HASH_VERSION ||
+        get_be32(bloom + 4) != BLOOM_NUM_HASHES || get_be32(bloom + 8) != BLOOM_BITS_PER_ENTRY){
+        graph->bloom_index = NULL;
+    } else {
+        graph->bloom_data = bloom + BLOOM_HEADER_SIZE;
+    }
+    return graph;
+
+malformed:
+    fprintf(stderr, "commit_graph_open: %s is malformed\n", path);
+fail:
+    commit_graph_close(graph);
+    return NULL;
+}
+
+/**
+ * commit_graph_close - Unmaps a commit-graph and frees it.
+ *
+ * @param graph The graph; NULL is ignored.
+ */
+void commit_graph_close(CommitGraph *graph){
+    if (!graph) { return; }
+
+    if (graph->map) { munmap((void *)graph->map, graph->size); }
+    free(graph);
+}
+
+/**
+ * commit_graph_load - Returns the repository's commit-graph, mapping it on first use.
+ *
+ * @param repo The repository.
+ * @return The graph, or NULL if objects/info/commit-graph does not exist or
+ * cannot be used; callers then parse commit objects instead.
+ * @note Not safe to call concurrently before the first call has returned.
+ */
+CommitGraph *commit_graph_load(Repository *repo){
+    if (!repo) { return NULL; }
+    if (repo->commit_graph_loaded) { return repo->commit_graph; }
+    repo->commit_graph_loaded = true;
+
+    char *path = repo_path(repo, "objects", "info", "commit-graph", NULL);
+    if (file_exists(path)) { repo->commit_graph = commit_graph_open(path); }
+    free(path);
+    return repo->commit_graph;
+}
+
+/**
+ * commit_graph_free - Unmaps the repository's commit-graph.
+ *
+ * @param repo The repository; the graph is reloaded on the next commit_graph_load().
+ */
+void commit_graph_free(Repository *repo){
+    if (!repo) { return; }
+
+    commit_graph_close(repo->commit_graph);
+    repo->commit_graph = NULL;
+    repo->commit_graph_loaded = false;
+}
+
+/**
+ * commit_graph_find - Looks up a commit's position in the graph.
+ *
+ * @param graph The graph.
+ * @param sha   The commit's SHA.
+ * @param pos   Output for its position (may be NULL).
+ * @return True if the commit is in the graph, false otherwise.
+ */
+bool commit_graph_find(const CommitGraph *graph, const unsigned char sha[SHA_SIZE], uint32_t *pos){
+    if (!graph || !sha) { return false; }
+
+    uint32_t lo = sha[0] ? get_be32(graph->fanout + 4 * (sha[0] - 1)) : 0;
+    uint32_t hi = get_be32(graph->fanout + 4 * sha[0]);
+    if (hi > graph->count) { hi = graph->count; }
+
+    while (lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(commit_graph_oid(graph, mid), sha, SHA_SIZE);
+        if (cmp == 0){
+            if (pos) { *pos = mid; }
+            return true;
+        }
+        if (cmp < 0) { lo = mid + 1; }
+        else         { hi = mid; }
+    }
+    return false;
+}
+
+/**
+ * commit_graph_commit - Reads the fixed-width record of a commit.
+ *
+ * @param graph  The graph.
+ * @param pos    Position from commit_graph_find() or a parent list.
+ * @param commit Output for its tree, generation number and committer date.
+ * @return True on success, false if pos is out of range.
+ */
+bool commit_graph_commit(const CommitGraph *graph, uint32_t pos, CommitGraphCommit *commit){
+    if (!graph || !commit || pos >= graph->count) { return false; }
+
+    const unsigned char *p = graph->commit_data + (size_t)pos * COMMIT_GRAPH_DATA_SIZE;
+    uint32_t high = get_be32(p + SHA_SIZE + 8);
+    commit->tree = p;
+    commit->generation = high >> 2;
+    commit->date = ((uint64_t)(high & 3) << 32) | get_be32(p + SHA_SIZE + 12);
+    return true;
+}
+
+/**
+ * commit_graph_parents - Lists the parents of a commit as graph positions.
+ *
+ * @param graph   The graph.
+ * @param pos     The commit's position.
+ * @param parents Output array.
+ * @param max     Capacity of parents; extra parents are counted but not stored.
+ * @return The number of parents, or SIZE_MAX if the record is corrupt.
+ */
+size_t commit_graph_parents(const CommitGraph *graph, uint32_t pos, uint32_t *parents, size_t max){
+    if (!graph || pos >= graph->count) { return SIZE_MAX; }
+
+    const unsigned char *p = graph->commit_data + (size_t)pos * COMMIT_GRAPH_DATA_SIZE + SHA_SIZE;
+    uint32_t first = get_be32(p), second = get_be32(p + 4);
+    if (first == COMMIT_GRAPH_NO_PARENT) { return 0; }
+    if (!parent_valid(graph, first)) { return SIZE_MAX; }
+    if (max) { parents[0] = first; }
+    if (second == COMMIT_GRAPH_NO_PARENT) { return 1; }
+
+    if (!(second & COMMIT_GRAPH_EXTRA_EDGES)){
+        if (!parent_valid(graph, second)) { return SIZE_MAX; }
+        if (max > 1) { parents[1] = second; }
+        return 2;
+    }
+
+    size_t count = 1;
+    for (size_t edge = second & ~COMMIT_GRAPH_EXTRA_EDGES; ; edge++){
+        if (edge >= graph->edge_count) { return SIZE_MAX; }
+        uint32_t value = get_be32(graph->edges + edge * 4);
+        uint32_t parent = value & ~COMMIT_GRAPH_LAST_EDGE;
+        if (!parent_valid(graph, parent)) { return SIZE_MAX; }
+        if (count < max) { parents[count] = parent; }
+        count++;
+        if (value & COMMIT_GRAPH_LAST_EDGE) { return count; }
+    }
+}
+
+/**
+ * commit_graph_bloom - Returns the changed-path filter of a commit.
+ *
+ * The filter holds every path that differs between the commit and its
+ * first parent (or the empty tree, for a root), with all leading
+ * directories.
+ *
+ * @param graph  The graph.
+ * @param pos    The commit's position.
+ * @param filter Output; points into the mapping.
+ * @return True if the graph has a filter for the commit, false otherwise.
+ */
+bool commit_graph_bloom(const CommitGraph *graph, uint32_t pos, BloomFilter *filter){
+    if (!graph || !graph->bloom_index || pos >= graph->count) { return false; }
+
+    uint32_t start = pos ? get_be32(graph->bloom_index + 4 * (pos - 1)) : 0;
+    uint32_t end = get_be32(graph->bloom_index + 4 * pos);
+    if (end < start || end > graph->bloom_size) { return false; }
+    filter->data = graph->bloom_data + start;
+    filter->len = end - start;
+    return true;
+}
+
+/**
+ * commit_graph_write - Writes objects/info/commit-graph for every reachable commit.
+ *
+ * Commits are collected from HEAD and every ref under refs/ (tags are
+ * peeled), sorted by SHA, and given topological levels as generation numbers
+ * (1 for roots, one more than the highest parent otherwise). With
+ * changed_paths, each commit also gets a Bloom filter of the paths it
+ * changed against its first parent, so path-limited walks can skip it
+ * without reading a tree. The file is
+ * written to a temporary name and renamed into place; the repository's
+ * mapped graph, if any, is dropped so the new one is used from then on.
+ *
+ * @param repo          The repository.
+ * @param changed_paths Also write the BIDX and BDAT chunks.
+ * @param stats         Output counts (may be NULL).
+ * @return True on success, false if a reachable commit or tree is missing
+ * or the file could not be written.
+ */
+bool commit_graph_write(Repository *repo, bool changed_paths, CommitGraphStats *stats){
+    if (!repo) { return false; }
+
+    GraphBuilder builder = { .repo = repo, .changed_paths = changed_paths };
+    unsigned char head[SHA_SIZE];
+    bool status = (!ref_read(repo, "HEAD", head) || builder_push_ref("HEAD", head, &builder)) &&
+                  refs_for_each(repo, builder_push_ref, &builder);
+
+    status = status && builder_collect(&builder) && builder_link(&builder);
+    if (status){
+        builder_generations(&builder);
+        status = (!changed_paths || builder_bloom(&builder)) && builder_write(&builder, stats);
+    }
+    builder_free(&builder);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * builder_push - Queues a commit to be collected, once.
+ */
+static bool builder_push(GraphBuilder *builder, const unsigned char sha[SHA_SIZE]){
+    if (!sha_set_insert(&builder->seen, sha)) { return true; }
+
+    if (builder->depth == builder->stack_capacity){
+        builder->stack_capacity = builder->stack_capacity ? 2 * builder->stack_capacity : 256;
+        builder->stack = realloc(builder->stack, builder->stack_capacity * SHA_SIZE);
+        MALLOC_CHECK(builder->stack);
+    }
+    memcpy(builder->stack[builder->depth++], sha, SHA_SIZE);
+    return true;
+}
+
+/**
+ * builder_push_ref - refs_for_each() callback queueing the commit a ref names.
+ *
+ * Refs to trees or blobs are ignored, as git does.
+ */
+static bool builder_push_ref(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    (void)name;
+    GraphBuilder *builder = ctx;
+    GitObject *commit = object_peel(builder->repo, sha, OBJ_COMMIT);
+    return !commit || builder_push(builder, commit->sha);
+}
+
+/**
+ * builder_collect - Walks every queued commit and its ancestors.
+ *
+ * @return False if a commit is missing or cannot be parsed.
+ */
+static bool builder_collect(GraphBuilder *builder){
+    while (builder->depth){
+        unsigned char sha[SHA_SIZE];
+        memcpy(sha, builder->stack[--builder->depth], SHA_SIZE);
+
+        GitCommit *commit = (GitCommit *)object_get(builder->repo, sha);
+        if (!commit || commit->object.type != OBJ_COMMIT){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(sha, hex);
+            fprintf(stderr, "commit_graph_write: cannot read commit %s\n", hex);
+            return false;
+        }
+
+        if (builder->count == builder->capacity){
+            builder->capacity = builder->capacity ? 2 * builder->capacity : 256;
+            builder->commits = realloc(builder->commits, builder->capacity * sizeof(GraphCommit));
+            MALLOC_CHECK(builder->commits);
+        }
+        GraphCommit *c = &builder->commits[builder->count++];
+        memset(c, 0, sizeof(*c));
+        memcpy(c->sha, sha, SHA_SIZE);
+        c->date = commit_date(commit);
+        c->parent_start = builder->parent_count;
+        c->parent_count = commit_parent_count(commit);
+        if (!commit_tree(commit, c->tree)) { goto malformed; }
+
+        if (builder->parent_count + c->parent_count > builder->parent_capacity){
+            while (builder->parent_count + c->parent_count > builder->parent_capacity){
+                builder->parent_capacity = builder->parent_capacity ? 2 * builder->parent_capacity : 256;
+            }
+            builder->parents = realloc(builder->parents, builder->parent_capacity * SHA_SIZE);
+            MALLOC_CHECK(builder->parents);
+        }
+        for (size_t i = 0; i < c->parent_count; i++){
+            if (!commit_parent(commit, i, builder->parents[builder->parent_count])) { goto malformed; }
+            builder_push(builder, builder->parents[builder->parent_count++]);
+        }
+        continue;
+
+malformed:;
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(sha, hex);
+        fprintf(stderr, "commit_graph_write: malformed commit %s\n", hex);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * builder_link - Sorts the commits and turns parent SHAs into positions.
+ */
+static bool builder_link(GraphBuilder *builder){
+    if (builder->count >= COMMIT_GRAPH_NO_PARENT){
+        fprintf(stderr, "commit_graph_write: too many commits\n");
+        return false;
+    }
+
+    qsort(builder->commits, builder->count, sizeof(GraphCommit), compare_commits);
+    builder->parent_pos = safe_malloc(sizeof(uint32_t), builder->parent_count ? builder->parent_count : 1);
+
+    for (size_t i = 0; i < builder->parent_count; i++){
+        GraphCommit key;
+        memcpy(key.sha, builder->parents[i], SHA_SIZE);
+        GraphCommit *found = bsearch(&key, builder->commits, builder->count, sizeof(GraphCommit), compare_commits);
+        if (!found) { return false; }   /* every parent was collected */
+        builder->parent_pos[i] = (uint32_t)(found - builder->commits);
+    }
+    return true;
+}
+
+/**
+ * builder_generations - Assigns topological levels with an explicit stack.
+ *
+ * A commit stays on the stack until all of its parents have a level, so
+ * histories of any depth are handled without recursion.
+ */
+static void builder_generations(GraphBuilder *builder){
+    uint32_t *stack = safe_malloc(sizeof(uint32_t), builder->count ? builder->count : 1);
+
+    for (size_t start = 0; start < builder->count; start++){
+        if (builder->commits[start].generation) { continue; }
+
+        size_t depth = 0;
+        stack[depth++] = (uint32_t)start;
+        while (depth){
+            GraphCommit *c = &builder->commits[stack[depth - 1]];
+            uint32_t level = 0;
+            bool ready = true;
+            for (size_t i = 0; i < c->parent_count; i++){
+                GraphCommit *parent = &builder->commits[builder->parent_pos[c->parent_start + i]];
+                if (!parent->generation){
+                    /* The stack is a chain of parents, so in a DAG it never
+                     * holds a commit twice and count slots are enough. */
+                    stack[depth++] = builder->parent_pos[c->parent_start + i];
+                    ready = false;
+                    break;
+                }
+                if (parent->generation > level) { level = parent->generation; }
+            }
+            if (!ready) { continue; }
+
+            c->generation = level < COMMIT_GRAPH_GENERATION_MAX ? level + 1 : COMMIT_GRAPH_GENERATION_MAX;
+            depth--;
+        }
+    }
+    free(stack);
+}
+
+/**
+ * builder_bloom - Computes the changed-path filter of every commit, in file order.
+ */
+static bool builder_bloom(GraphBuilder *builder){
+    BloomPaths paths = { 0 };
+    bool status = true;
+    for (size_t i = 0; status && i < builder->count; i++){
+        GraphCommit *c = &builder->commits[i];
+        const unsigned char *parent = c->parent_count ? builder->commits[builder->parent_pos[c->parent_start]].tree : NULL;
+        if (!(status = bloom_changed_paths(builder->repo, parent, c->tree, &paths))) { break; }
+
+        unsigned char *filter;
+        size_t len = bloom_filter_build(&paths, &filter);
+        builder->bloom_large += paths.changes > BLOOM_MAX_CHANGED_PATHS || paths.count > BLOOM_MAX_CHANGED_PATHS;
+        if (builder->bloom_len + len > UINT32_MAX){
+            fprintf(stderr, "commit_graph_write: changed-path filters too large\n");
+            status = false;
+        } else {
+            if (builder->bloom_len + len > builder->bloom_capacity){
+                while (builder->bloom_len + len > builder->bloom_capacity){
+                    builder->bloom_capacity = builder->bloom_capacity ? 2 * builder->bloom_capacity : 4096;
+                }
+                builder->bloom = realloc(builder->bloom, builder->bloom_capacity);
+                MALLOC_CHECK(builder->bloom);
+            }
+            memcpy(builder->bloom + builder->bloom_len, filter, len);
+            builder->bloom_len += len;
+            c->bloom_end = builder->bloom_len;
+        }
+        free(filter);
+    }
+    bloom_paths_clear(&paths);
+    return status;
+}
+
+/**
+ * builder_write - Serializes the sorted commits and renames the file into place.
+ */
+static bool builder_write(GraphBuilder *builder, CommitGraphStats *stats){
+    size_t count = builder->count, edges = 0;
+    for (size_t i = 0; i < count; i++){
+        if (builder->commits[i].parent_count > 2) { edges += builder->commits[i].parent_count - 1; }
+    }
+
+    bool bloom = builder->changed_paths;
+    size_t chunks = 3 + (edges != 0) + 2 * bloom;
+    size_t table = COMMIT_GRAPH_HEADER_SIZE + (chunks + 1) * 12;
+    size_t oidf = table, oidl = oidf + COMMIT_GRAPH_FANOUT * 4, cdat = oidl + count * SHA_SIZE;
+    size_t edge = cdat + count * COMMIT_GRAPH_DATA_SIZE, bidx = edge + edges * 4;
+    size_t bdat = bidx + (bloom ? count * 4 : 0), end = bdat + (bloom ? BLOOM_HEADER_SIZE + builder->bloom_len : 0);
+    size_t len = end + SHA_SIZE;
+
+    unsigned char *buf = safe_calloc(sizeof(unsigned char), len);
+    memcpy(buf, COMMIT_GRAPH_SIGNATURE, 4);
+    buf[4] = COMMIT_GRAPH_VERSION;
+    buf[5] = COMMIT_GRAPH_HASH_VERSION;
+    buf[6] = (unsigned char)chunks;
+
+    uint32_t ids[] = { COMMIT_GRAPH_CHUNK_OIDF, COMMIT_GRAPH_CHUNK_OIDL, COMMIT_GRAPH_CHUNK_CDAT,
+                       COMMIT_GRAPH_CHUNK_EDGE, COMMIT_GRAPH_CHUNK_BIDX, COMMIT_GRAPH_CHUNK_BDAT };
+    size_t offsets[] = { oidf, oidl, cdat, edge, bidx, bdat };
+    bool present[] = { true, true, true, edges != 0, bloom, bloom };
+    for (size_t i = 0, n = 0; i < sizeof(ids) / sizeof(ids[0]); i++){
+        if (!present[i]) { continue; }
+        put_be32(buf + COMMIT_GRAPH_HEADER_SIZE + n * 12, ids[i]);
+        put_be64(buf + COMMIT_GRAPH_HEADER_SIZE + n * 12 + 4, offsets[i]);
+        n++;
+    }
+    put_be64(buf + COMMIT_GRAPH_HEADER_SIZE + chunks * 12 + 4, end);
+
+    for (size_t b = 0, i = 0; b < COMMIT_GRAPH_FANOUT; b++){
+        while (i < count && builder->commits[i].sha[0] <= b) { i++; }
+        put_be32(buf + oidf + 4 * b, (uint32_t)i);
+    }
+
+    size_t next_edge = 0;
+    for (size_t i = 0; i < count; i++){
+        const GraphCommit *c = &builder->commits[i];
+        const uint32_t *parents = builder->parent_pos + c->parent_start;
+        unsigned char *p = buf + cdat + i * COMMIT_GRAPH_DATA_SIZE;
+        memcpy(buf + oidl + i * SHA_SIZE, c->sha, SHA_SIZE);
+        memcpy(p, c->tree, SHA_SIZE);
+
+        put_be32(p + SHA_SIZE, c->parent_count > 0 ? parents[0] : COMMIT_GRAPH_NO_PARENT);
+        if (c->parent_count <= 2){
+            put_be32(p + SHA_SIZE + 4, c->parent_count == 2 ? parents[1] : COMMIT_GRAPH_NO_PARENT);
+        } else {
+            put_be32(p + SHA_SIZE + 4, COMMIT_GRAPH_EXTRA_EDGES | (uint32_t)next_edge);
+            for (size_t j = 1; j < c->parent_count; j++){
+                uint32_t value = parents[j] | (j + 1 == c->parent_count ? COMMIT_GRAPH_LAST_EDGE : 0);
+                put_be32(buf + edge + 4 * next_edge++, value);
+            }
+        }
+
+        uint64_t date = c->date < ((uint64_t)1 << 34) ? c->date : ((uint64_t)1 << 34) - 1;
+        put_be32(p + SHA_SIZE + 8, (c->generation << 2) | (uint32_t)(date >> 32));
+        put_be32(p + SHA_SIZE + 12, (uint32_t)date);
+        if (bloom) { put_be32(buf + bidx + 4 * i, (uint32_t)c->bloom_end); }
+    }
+    if (bloom){
+        put_be32(buf + bdat, BLOOM_HASH_VERSION);
+        put_be32(buf + bdat + 4, BLOOM_NUM_HASHES);
+        put_be32(buf + bdat + 8, BLOOM_BITS_PER_ENTRY);
+        if (builder->bloom_len) { memcpy(buf + bdat + BLOOM_HEADER_SIZE, builder->bloom, builder->bloom_len); }
+    }
+    sha1_buffer(buf, end, buf + end);
+
+    bool status = false;
+    char *info = repo_dir(builder->repo, true, "objects", "info", NULL);
+    char *path = repo_path(builder->repo, "objects", "info", "commit-graph", NULL);
+    char tmp[MAX_PATH];
+    int n = info ? snprintf(tmp, sizeof(tmp), "%s/tmp_graph_XXXXXX", info) : -1;
+    int fd = n > 0 && (size_t)n < sizeof(tmp) ? mkstemp(tmp) : -1;
+    if (fd < 0){
+        fprintf(stderr, "commit_graph_write: cannot create a temporary file: %s\n", strerror(errno));
+    } else {
+        status = write_all(fd, buf, len);
+        fchmod(fd, 0444);
+        close(fd);
+        if (status && rename(tmp, path) < 0){
+            fprintf(stderr, "commit_graph_write: cannot rename to %s: %s\n", path, strerror(errno));
+            status = false;
+        }
+        if (!status) { unlink(tmp); }
+    }
+
+    if (status){
+        commit_graph_free(builder->repo);
+        if (stats){
+            *stats = (CommitGraphStats){ .commits = count, .edges = edges, .filters = bloom ? count : 0,
+                                         .filters_large = builder->bloom_large };
+        }
+    }
+    free(info);
+    free(path);
+    free(buf);
+    return status;
+}
+
+/**
+ * builder_free - Releases everything a builder allocated.
+ */
+static void builder_free(GraphBuilder *builder){
+    free(builder->commits);
+    free(builder->parents);
+    free(builder->parent_pos);
+    free(builder->stack);
+    free(builder->bloom);
+    sha_set_free(&builder->seen);
+}
+
+/**
+ * compare_commits - qsort/bsearch comparator ordering commits by SHA.
+ */
+static int compare_commits(const void *a, const void *b){
+    return memcmp(((const GraphCommit *)a)->sha, ((const GraphCommit *)b)->sha, SHA_SIZE);
+}
+
+/**
+ * parent_valid - Checks a parent position read from the file.
+ */
+static bool parent_valid(const CommitGraph *graph, uint32_t pos){
+    return pos < graph->count;
+}
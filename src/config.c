@@ -0,0 +1,557 @@
+/* config.c: git config files */
+
+#include "config.h"
+#include "ini.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    Configuration *config;
+    const char    *path;        /* file being parsed; include.path is relative to it */
+    int           depth;        /* include nesting */
+} ConfigParse;
+
+/* Forward Declaration of static Functions */
+
+static int          config_handler(void *user, const char *section, const char *name, const char *value);
+static bool         config_read(Configuration *config, const char *path, int depth);
+static bool         config_key(const char *section, const char *name, char key[CONFIG_KEY_MAX]);
+static bool         config_normalize(const char *key, char out[CONFIG_KEY_MAX]);
+static uint32_t     config_hash(const char *key);
+static ConfigEntry *config_slot(ConfigEntry *entries, size_t capacity, const char *key, uint32_t hash);
+static ConfigEntry *config_lookup(const Configuration *config, const char *key);
+static void         config_unquote(char *value);
+static bool         config_include_path(const char *target, const char *from, char out[PATH_MAX]);
+static void         config_add_source(Configuration *config, const char *path);
+
+/* Functions */
+
+/**
+ * config_read_file - Adds every value of a config file to the table.
+ *
+ * The file is parsed once with inih; "[section \"sub\"]" headers become
+ * "section.sub.name" keys and include.path is followed where it appears, so
+ * later lines override included ones as in git. Values seen again replace
+ * earlier ones.
+ *
+ * @param config The configuration to fill.
+ * @param path   The file to read.
+ * @return True if the file was read, false if it cannot be opened.
+ * @note Lines inih cannot parse are skipped with a message, like the old reader.
+ */
+bool config_read_file(Configuration *config, const char *path){
+    if (!config || !path) { return false; }
+    return config_read(config, path, 0);
+}
+
+/**
+ * config_read_global - Adds the user's global config files.
+ *
+ * GIT_CONFIG_GLOBAL names a single file (git's override, "/dev/null" reads
+ * nothing); otherwise $XDG_CONFIG_HOME/git/config (default ~/.config) and
+ * then ~/.gitconfig are read. Missing files are not an error.
+ *
+ * @param config The configuration to fill; read this before the repository's.
+ * @return True unless an existing file could not be read.
+ */
+bool config_read_global(Configuration *config){
+    if (!config) { return false; }
+
+    const char *global = getenv("GIT_CONFIG_GLOBAL");
+    if (global){
+        return !*global || !file_exists(global) || config_read(config, global, 0);
+    }
+
+    bool status = true;
+    char path[PATH_MAX];
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    int n = -1;
+    if (xdg && *xdg){
+        n = snprintf(path, sizeof(path), "%s/git/config", xdg);
+    } else if (home && *home){
+        n = snprintf(path, sizeof(path), "%s/.config/git/config", home);
+    }
+    if (n > 0 && (size_t)n < sizeof(path)){
+        if (file_exists(path)) { status = config_read(config, path, 0) && status; }
+        else { config_add_source(config, path); }
+    }
+
+    if (home && *home){
+        n = snprintf(path, sizeof(path), "%s/.gitconfig", home);
+        if (n > 0 && (size_t)n < sizeof(path)){
+            if (file_exists(path)) { status = config_read(config, path, 0) && status; }
+            else { config_add_source(config, path); }
+        }
+    }
+    return status;
+}
+
+/**
+ * config_set - Stores a value, replacing any earlier one for the same key.
+ *
+ * @param config The configuration.
+ * @param key    "section.name" or "section.subsection.name"; section and
+ * name are case-insensitive, the subsection is not.
+ * @param value  The value, copied; NULL for a key given without '=', which
+ * git reads as boolean true.
+ * @return True on success, false if the key is malformed or too long.
+ */
+bool config_set(Configuration *config, const char *key, const char *value){
+    char normal[CONFIG_KEY_MAX];
+    if (!config || !config_normalize(key, normal)) { return false; }
+
+    if (2 * (config->count + 1) > config->capacity){
+        size_t capacity = config->capacity ? 2 * config->capacity : CONFIG_TABLE_INITIAL;
+        ConfigEntry *entries = safe_calloc(sizeof(ConfigEntry), capacity);
+        for (size_t i = 0; i < config->capacity; i++){
+            ConfigEntry *old = &config->entries[i];
+            if (old->key) { *config_slot(entries, capacity, old->key, old->hash) = *old; }
+        }
+        free(config->entries);
+        config->entries = entries;
+        config->capacity = capacity;
+    }
+
+    uint32_t hash = config_hash(normal);
+    ConfigEntry *slot = config_slot(config->entries, config->capacity, normal, hash);
+    if (slot->key){
+        free(slot->value);
+    } else {
+        slot->key = safe_strdup(normal);
+        slot->hash = hash;
+        config->count++;
+    }
+    slot->value = value ? safe_strdup(value) : NULL;
+    return true;
+}
+
+/**
+ * config_get - Looks a value up in O(1).
+ *
+ * @param config The configuration (may be NULL).
+ * @param key    The key, in any case for section and name.
+ * @return The last value set for key, or NULL if it is not set or was
+ * given without a value (see config_has()).
+ */
+const char *config_get(const Configuration *config, const char *key){
+    const ConfigEntry *entry = config_lookup(config, key);
+    return entry ? entry->value : NULL;
+}
+
+/**
+ * config_has - Checks whether a key is set, with or without a value.
+ *
+ * @param config The configuration (may be NULL).
+ * @param key    The key, in any case for section and name.
+ * @return True if key is set.
+ */
+bool config_has(const Configuration *config, const char *key){
+    return config_lookup(config, key) != NULL;
+}
+
+/**
+ * config_get_bool - Reads a boolean the way git does.
+ *
+ * @param config   The configuration.
+ * @param key      The key.
+ * @param fallback Returned when the key is unset or not a boolean.
+ * @return The value; true for a key given without a value.
+ */
+bool config_get_bool(const Configuration *config, const char *key, bool fallback){
+    const ConfigEntry *entry = config_lookup(config, key);
+    const char *value = entry ? entry->value : NULL;
+    bool result;
+    if (!entry) { return fallback; }
+    if (!value) { return true; }
+    if (!config_parse_bool(value, &result)){
+        fprintf(stderr, "config_get_bool: bad boolean '%s' for %s, keeping default\n", value, key);
+        return fallback;
+    }
+    return result;
+}
+
+/**
+ * config_get_int - Reads an integer with an optional k/m/g suffix.
+ *
+ * @param config   The configuration.
+ * @param key      The key.
+ * @param fallback Returned when the key is unset or not an integer.
+ * @return The value.
+ */
+long config_get_int(const Configuration *config, const char *key, long fallback){
+    const char *value = config_get(config, key);
+    long result;
+    if (!value) { return fallback; }
+    if (!config_parse_int(value, &result)){
+        fprintf(stderr, "config_get_int: bad number '%s' for %s, keeping default\n", value, key);
+        return fallback;
+    }
+    return result;
+}
+
+/**
+ * config_get_size - Reads a non-negative byte count or limit (see parse_size()).
+ *
+ * @param config   The configuration.
+ * @param key      The key.
+ * @param fallback Returned when the key is unset or not a size.
+ * @return The value.
+ */
+size_t config_get_size(const Configuration *config, const char *key, size_t fallback){
+    const char *value = config_get(config, key);
+    size_t result;
+    if (!value) { return fallback; }
+    if (!parse_size(value, &result)){
+        fprintf(stderr, "config_get_size: bad size '%s' for %s, keeping default\n", value, key);
+        return fallback;
+    }
+    return result;
+}
+
+/**
+ * config_parse_bool - Parses true/yes/on, false/no/off, "" or a number.
+ *
+ * @param value  The string, case-insensitive.
+ * @param result Output.
+ * @return True if value was a boolean.
+ */
+bool config_parse_bool(const char *value, bool *result){
+    if (!value || !result) { return false; }
+    if (!strcasecmp(value, "true") || !strcasecmp(value, "yes") || !strcasecmp(value, "on")){
+        *result = true;
+        return true;
+    }
+    if (!*value || !strcasecmp(value, "false") || !strcasecmp(value, "no") || !strcasecmp(value, "off")){
+        *result = false;
+        return true;
+    }
+    long n;
+    if (!config_parse_int(value, &n)) { return false; }
+    *result = n != 0;
+    return true;
+}
+
+/**
+ * config_parse_int - Parses a signed integer with an optional k/m/g suffix.
+ *
+ * @param value  The string.
+ * @param result Output; suffixes scale by 1024.
+ * @return True if value was a complete integer that fits in a long.
+ */
+bool config_parse_int(const char *value, long *result){
+    if (!value || !result || !*value) { return false; }
+
+    errno = 0;
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (errno || end == value) { return false; }
+
+    unsigned shift = 0;
+    switch (*end){
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+    }
+    if (*end != '\0' || n > (LONG_MAX >> shift) || n < (LONG_MIN >> shift)) { return false; }
+
+    *result = n * (1L << shift);
+    return true;
+}
+
+/**
+ * config_is_current - Tells whether no file this configuration came from changed.
+ *
+ * One stat() per file, including those that were absent when read.
+ *
+ * @param config The configuration.
+ * @return True if every source still has the same identity, size and mtime.
+ */
+bool config_is_current(const Configuration *config){
+    if (!config || config->sources_dropped) { return false; }
+    for (size_t i = 0; i < config->source_count; i++){
+        const ConfigSource *source = &config->sources[i];
+        struct stat sb;
+        trace_count(TRACE_SYSCALLS, 1);
+        bool exists = stat(source->path, &sb) == 0;
+        if (exists != source->exists) { return false; }
+        if (exists && (sb.st_dev != source->dev || sb.st_ino != source->ino || sb.st_size != source->size ||
+                       sb.st_mtim.tv_sec != source->mtime.tv_sec || sb.st_mtim.tv_nsec != source->mtime.tv_nsec)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * config_copy - Duplicates a configuration, table and sources included.
+ *
+ * @param config The configuration to copy.
+ * @return The copy, or NULL if config is NULL.
+ * @note The caller must release the copy with config_free().
+ */
+Configuration *config_copy(const Configuration *config){
+    if (!config) { return NULL; }
+
+    Configuration *copy = safe_malloc(sizeof(Configuration), 1);
+    *copy = *config;
+    if (config->capacity){
+        copy->entries = safe_calloc(sizeof(ConfigEntry), config->capacity);
+        for (size_t i = 0; i < config->capacity; i++){
+            const ConfigEntry *entry = &config->entries[i];
+            if (!entry->key) { continue; }
+            copy->entries[i].key = safe_strdup(entry->key);
+            copy->entries[i].value = entry->value ? safe_strdup(entry->value) : NULL;
+            copy->entries[i].hash = entry->hash;
+        }
+    }
+    for (size_t i = 0; i < config->source_count; i++){
+        copy->sources[i].path = safe_strdup(config->sources[i].path);
+    }
+    return copy;
+}
+
+/**
+ * config_free - Frees a configuration and every value it holds.
+ *
+ * @param config The configuration (may be NULL).
+ */
+void config_free(Configuration *config){
+    if (!config) { return; }
+    for (size_t i = 0; i < config->capacity; i++){
+        free(config->entries[i].key);
+        free(config->entries[i].value);
+    }
+    free(config->entries);
+    for (size_t i = 0; i < config->source_count; i++){
+        free(config->sources[i].path);
+    }
+    free(config);
+}
+
+/* Static Functions */
+
+/**
+ * config_read - Parses one file, following includes up to CONFIG_INCLUDE_DEPTH.
+ */
+static bool config_read(Configuration *config, const char *path, int depth){
+    config_add_source(config, path);
+    ConfigParse parse = { .config = config, .path = path, .depth = depth };
+    TRACE_SCOPE(TRACE_INI_PARSE);
+    trace_count(TRACE_SYSCALLS, 3);     /* fopen, read, fclose */
+    int ret = ini_parse(path, config_handler, &parse);
+    if (ret < 0) { return false; }
+    if (ret > 0) { fprintf(stderr, "config_read: %s: bad line %d skipped\n", path, ret); }
+    return true;
+}
+
+/**
+ * config_handler - inih callback storing one section/name/value triplet.
+ *
+ * @return 1 to continue, 0 to report the line as bad.
+ */
+static int config_handler(void *user, const char *section, const char *name, const char *value){
+    ConfigParse *parse = user;
+
+    char key[CONFIG_KEY_MAX];
+    if (!config_key(section, name, key)) { return 0; }
+
+    /* a bare "name" line (INI_ALLOW_NO_VALUE) arrives with a NULL value */
+    char *copy = value ? safe_strdup(value) : NULL;
+    if (copy) { config_unquote(copy); }
+    bool ok = config_set(parse->config, key, copy);
+
+    if (ok && copy && streq(key, "include.path")){
+        char target[PATH_MAX];
+        if (parse->depth + 1 > CONFIG_INCLUDE_DEPTH){
+            fprintf(stderr, "config_handler: %s: include.path nested too deeply\n", parse->path);
+            ok = false;
+        } else if (config_include_path(copy, parse->path, target) && file_exists(target)){
+            ok = config_read(parse->config, target, parse->depth + 1);
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+/**
+ * config_key - Builds "section[.subsection].name" from an inih section and name.
+ *
+ * inih hands over the text between the brackets, so [remote "origin"]
+ * arrives as `remote "origin"`; the quoted part keeps its case and loses its
+ * quotes and backslash escapes.
+ *
+ * @return True if the key fits in CONFIG_KEY_MAX.
+ */
+static bool config_key(const char *section, const char *name, char key[CONFIG_KEY_MAX]){
+    size_t n = 0;
+    const char *s = section;
+    for (; *s && *s != ' ' && *s != '\t'; s++){
+        if (n + 1 >= CONFIG_KEY_MAX) { return false; }
+        key[n++] = (char)tolower((unsigned char)*s);
+    }
+    if (n == 0) { return false; }
+
+    while (*s == ' ' || *s == '\t') { s++; }
+    if (*s == '"'){
+        key[n++] = '.';
+        for (s++; *s && *s != '"'; s++){
+            if (*s == '\\' && s[1]) { s++; }
+            if (n + 1 >= CONFIG_KEY_MAX) { return false; }
+            key[n++] = *s;
+        }
+        if (*s != '"') { return false; }
+    } else if (*s){
+        return false;
+    }
+
+    if (n + 1 + strlen(name) >= CONFIG_KEY_MAX) { return false; }
+    key[n++] = '.';
+    for (; *name; name++) { key[n++] = (char)tolower((unsigned char)*name); }
+    key[n] = '\0';
+    return true;
+}
+
+/**
+ * config_normalize - Lowercases the section and name of a dotted key.
+ *
+ * @return True if key has a section and a name and fits in CONFIG_KEY_MAX.
+ */
+static bool config_normalize(const char *key, char out[CONFIG_KEY_MAX]){
+    if (!key) { return false; }
+    size_t len = strlen(key);
+    const char *first = strchr(key, '.');
+    const char *last = strrchr(key, '.');
+    if (!first || first == key || !last[1] || len >= CONFIG_KEY_MAX) { return false; }
+
+    for (size_t i = 0; i <= len; i++){
+        bool keep_case = key + i > first && key + i < last;
+        out[i] = keep_case ? key[i] : (char)tolower((unsigned char)key[i]);
+    }
+    return true;
+}
+
+/**
+ * config_hash - FNV-1a over the normalized key.
+ */
+static uint32_t config_hash(const char *key){
+    uint32_t hash = 2166136261u;
+    for (; *key; key++){
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * config_slot - Linear probe for key, stopping at its entry or a free slot.
+ *
+ * @note capacity is a power of two and the table is never more than half full.
+ */
+static ConfigEntry *config_slot(ConfigEntry *entries, size_t capacity, const char *key, uint32_t hash){
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask){
+        ConfigEntry *slot = &entries[i];
+        if (!slot->key || (slot->hash == hash && streq(slot->key, key))) { return slot; }
+    }
+}
+
+/**
+ * config_lookup - Finds the entry of a key, normalizing it first.
+ *
+ * @return The entry, or NULL if the key is not set or malformed.
+ */
+static ConfigEntry *config_lookup(const Configuration *config, const char *key){
+    char normal[CONFIG_KEY_MAX];
+    if (!config || !config->count || !config_normalize(key, normal)) { return NULL; }
+    ConfigEntry *slot = config_slot(config->entries, config->capacity, normal, config_hash(normal));
+    return slot->key ? slot : NULL;
+}
+
+/**
+ * config_unquote - Applies git's value syntax in place.
+ *
+ * Double quotes are dropped, \\, \", \n, \t and \b resolved, and an unquoted
+ * '#' or ';' starts a comment, with the blanks before it trimmed; inih's own
+ * comment stripping is disabled since it cannot see quotes.
+ */
+static void config_unquote(char *value){
+    char *out = value, *end = value;
+    bool quoted = false;
+    for (const char *in = value; *in; in++){
+        if (*in == '"') { quoted = !quoted; end = out; continue; }
+        if ((*in == '#' || *in == ';') && !quoted) { break; }
+        if (*in == '\\' && in[1]){
+            in++;
+            switch (*in){
+                case 'n': *out++ = '\n'; break;
+                case 't': *out++ = '\t'; break;
+                case 'b': if (out > value) { out--; } break;
+                default:  *out++ = *in; break;
+            }
+            end = out;
+            continue;
+        }
+        *out++ = *in;
+        if (quoted || (*in != ' ' && *in != '\t')) { end = out; }
+    }
+    *end = '\0';
+}
+
+/**
+ * config_include_path - Resolves an include.path value.
+ *
+ * "~/" is expanded from $HOME; relative paths are taken from the directory
+ * of the including file.
+ *
+ * @return True if the result fits in PATH_MAX.
+ */
+static bool config_include_path(const char *target, const char *from, char out[PATH_MAX]){
+    int n;
+    if (target[0] == '~' && target[1] == '/'){
+        const char *home = getenv("HOME");
+        if (!home) { return false; }
+        n = snprintf(out, PATH_MAX, "%s%s", home, target + 1);
+    } else if (target[0] == '/'){
+        n = snprintf(out, PATH_MAX, "%s", target);
+    } else {
+        const char *slash = strrchr(from, '/');
+        n = slash ? snprintf(out, PATH_MAX, "%.*s/%s", (int)(slash - from), from, target)
+                  : snprintf(out, PATH_MAX, "%s", target);
+    }
+    return n > 0 && n < PATH_MAX;
+}
+
+/**
+ * config_add_source - Records a file's identity for config_is_current().
+ */
+static void config_add_source(Configuration *config, const char *path){
+    if (config->source_count == CONFIG_MAX_SOURCES){
+        config->sources_dropped = true;
+        return;
+    }
+    ConfigSource *source = &config->sources[config->source_count++];
+    memset(source, 0, sizeof(*source));
+    source->path = safe_strdup(path);
+
+    struct stat sb;
+    trace_count(TRACE_SYSCALLS, 1);
+    source->exists = stat(path, &sb) == 0;
+    if (source->exists){
+        source->dev = sb.st_dev;
+        source->ino = sb.st_ino;
+        source->size = sb.st_size;
+        source->mtime = sb.st_mtim;
+    }
+}
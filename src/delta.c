@@ -0,0 +1,342 @@
+/* delta.c: git delta encoding */
+
+#include "delta.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Macros */
+
+#define HASH_MULT   0x01000193u     /* rolling hash multiplier */
+
+/* Forward Declaration of static Functions */
+
+static bool read_varint(const unsigned char **p, const unsigned char *end, size_t *value);
+static size_t put_varint(unsigned char *p, size_t value);
+static uint32_t block_hash(const unsigned char *p);
+static uint32_t hash_bucket(uint32_t hash, uint32_t mask);
+
+/* Functions */
+
+/**
+ * delta_header - Decodes the base and result sizes that open a delta.
+ *
+ * @param delta       The delta data.
+ * @param len         Number of bytes available at delta.
+ * @param base_size   Output for the size the base must have.
+ * @param result_size Output for the size of the reconstructed object.
+ * @param used        Output for the bytes consumed (may be NULL).
+ * @return True if both sizes were decoded, false if the data is truncated.
+ */
+bool delta_header(const unsigned char *delta, size_t len, size_t *base_size, size_t *result_size, size_t *used){
+    if (!delta) { return false; }
+
+    const unsigned char *p = delta;
+    const unsigned char *end = delta + len;
+    if (!read_varint(&p, end, base_size) || !read_varint(&p, end, result_size)) { return false; }
+    if (used) { *used = (size_t)(p - delta); }
+    return true;
+}
+
+/**
+ * delta_index_create - Indexes a base object for delta_create().
+ *
+ * Every DELTA_BLOCK-aligned block of the base is hashed into a bucket table
+ * sized to the block count. Buckets are capped at DELTA_BUCKET_LIMIT entries
+ * so highly repetitive bases cannot make matching quadratic.
+ *
+ * @param base The base object body; it must outlive the index.
+ * @param len  Size of base (below 4 GiB).
+ * @return The index, or NULL if base is NULL or too large.
+ * @note The caller is responsible for calling delta_index_free().
+ */
+DeltaIndex *delta_index_create(const unsigned char *base, size_t len){
+    if (!base || len > UINT32_MAX) { return NULL; }
+
+    size_t blocks = len / DELTA_BLOCK;
+    uint32_t buckets = 16;
+    while (buckets < blocks && buckets < (1u << 30)) { buckets <<= 1; }
+
+    DeltaIndex *index = safe_calloc(sizeof(DeltaIndex), 1);
+    index->base = base;
+    index->base_len = len;
+    index->mask = buckets - 1;
+    index->heads = safe_calloc(sizeof(uint32_t), buckets);
+    index->next = safe_malloc(sizeof(uint32_t), blocks ? blocks : 1);
+    index->offsets = safe_malloc(sizeof(uint32_t), blocks ? blocks : 1);
+    uint32_t *depth = safe_calloc(sizeof(uint32_t), buckets);
+
+    /* A full bucket keeps its earliest blocks, whose matches can run longest. */
+    size_t count = 0;
+    for (size_t b = 0; b < blocks; b++){
+        uint32_t bucket = hash_bucket(block_hash(base + b * DELTA_BLOCK), index->mask);
+        if (depth[bucket] == DELTA_BUCKET_LIMIT) { continue; }
+        depth[bucket]++;
+        index->offsets[count] = (uint32_t)(b * DELTA_BLOCK);
+        index->next[count] = index->heads[bucket];
+        index->heads[bucket] = (uint32_t)++count;
+    }
+
+    free(depth);
+    return index;
+}
+
+/**
+ * delta_index_free - Frees an index created by delta_index_create().
+ *
+ * @param index The index; NULL is ignored. The base itself is not freed.
+ */
+void delta_index_free(DeltaIndex *index){
+    if (!index) { return; }
+
+    free(index->heads);
+    free(index->next);
+    free(index->offsets);
+    free(index);
+}
+
+/**
+ * delta_create - Encodes target as copies from an indexed base plus inserts.
+ *
+ * A rolling hash over DELTA_BLOCK bytes of the target is looked up in the
+ * index at every position; the longest verified match is extended forwards
+ * and back into pending literals, then emitted as copy ops. Unmatched bytes
+ * become insert ops.
+ *
+ * @param index     Index of the base.
+ * @param target    The object to encode.
+ * @param len       Size of target.
+ * @param max_size  Give up once the delta would exceed this many bytes (0: no limit).
+ * @param delta_len Output for the delta size.
+ * @return A heap-allocated delta, or NULL if it would exceed max_size.
+ * @note The caller MUST free() the returned buffer.
+ */
+unsigned char *delta_create(const DeltaIndex *index, const unsigned char *target, size_t len, size_t max_size, size_t *delta_len){
+    if (!index || !target || !delta_len) { return NULL; }
+
+    const unsigned char *base = index->base;
+    size_t capacity = 64 + len / 4;
+    unsigned char *out = safe_malloc(sizeof(unsigned char), capacity);
+    size_t used = put_varint(out, index->base_len);
+    used += put_varint(out + used, len);
+
+    uint32_t drop = 1;
+    for (int i = 1; i < DELTA_BLOCK; i++) { drop *= HASH_MULT; }
+
+    size_t pos = 0, literal = 0;    /* literal bytes end at pos */
+    uint32_t hash = len >= DELTA_BLOCK ? block_hash(target) : 0;
+
+    while (pos < len){
+        /* Worst case per step: a flushed literal run, then a split copy. */
+        while (capacity - used < 2 * (DELTA_INSERT_MAX + 1) + 8 * (len / DELTA_COPY_MAX + 2)){
+            capacity = 2 * capacity + len / DELTA_COPY_MAX * 8;
+            out = realloc(out, capacity);
+            MALLOC_CHECK(out);
+        }
+
+        size_t best_len = 0, best_off = 0;
+        if (pos + DELTA_BLOCK <= len){
+            for (uint32_t e = index->heads[hash_bucket(hash, index->mask)]; e; e = index->next[e - 1]){
+                size_t off = index->offsets[e - 1];
+                size_t n = 0, limit = min(index->base_len - off, len - pos);
+                while (n < limit && base[off + n] == target[pos + n]) { n++; }
+                if (n > best_len){
+                    best_len = n;
+                    best_off = off;
+                }
+            }
+        }
+
+        if (best_len < DELTA_BLOCK){
+            literal++;
+            if (literal == DELTA_INSERT_MAX){
+                out[used++] = DELTA_INSERT_MAX;
+                memcpy(out + used, target + pos + 1 - literal, literal);
+                used += literal;
+                literal = 0;
+            }
+            if (pos + DELTA_BLOCK < len){
+                hash = (hash - target[pos] * drop) * HASH_MULT + target[pos + DELTA_BLOCK];
+            }
+            pos++;
+        } else {
+            while (literal && best_off && base[best_off - 1] == target[pos - 1]){
+                literal--;
+                best_off--;
+                best_len++;
+                pos--;
+            }
+            if (literal){
+                out[used++] = (unsigned char)literal;
+                memcpy(out + used, target + pos - literal, literal);
+                used += literal;
+                literal = 0;
+            }
+
+            pos += best_len;
+            while (best_len){
+                size_t n = min(best_len, (size_t)DELTA_COPY_MAX);
+                unsigned char *cmd = out + used++;
+                *cmd = 0x80;
+                for (int i = 0; i < 4; i++){
+                    unsigned char byte = (unsigned char)(best_off >> (8 * i));
+                    if (byte) { *cmd |= (unsigned char)(1 << i); out[used++] = byte; }
+                }
+                for (int i = 0; n != DELTA_COPY_MAX && i < 3; i++){
+                    unsigned char byte = (unsigned char)(n >> (8 * i));
+                    if (byte) { *cmd |= (unsigned char)(0x10 << i); out[used++] = byte; }
+                }
+                best_off += n;
+                best_len -= n;
+            }
+            if (pos + DELTA_BLOCK <= len) { hash = block_hash(target + pos); }
+        }
+
+        if (max_size && used > max_size){
+            free(out);
+            return NULL;
+        }
+    }
+
+    if (literal){
+        out[used++] = (unsigned char)literal;
+        memcpy(out + used, target + len - literal, literal);
+        used += literal;
+    }
+    if (max_size && used > max_size){
+        free(out);
+        return NULL;
+    }
+
+    *delta_len = used;
+    return out;
+}
+
+/**
+ * delta_apply - Reconstructs an object from its base and a delta.
+ *
+ * Every copy and insert op is bounds checked against the base and the
+ * announced result size, so a corrupt delta cannot read or write out of
+ * range.
+ *
+ * @param base       The base object body.
+ * @param base_len   Size of base; must match the size recorded in the delta.
+ * @param delta      The delta data.
+ * @param delta_len  Size of delta.
+ * @param result_len Output for the size of the result.
+ * @return A heap-allocated result, or NULL if the delta is malformed.
+ * @note The caller MUST free() the returned buffer.
+ */
+unsigned char *delta_apply(const unsigned char *base, size_t base_len, const unsigned char *delta, size_t delta_len, size_t *result_len){
+    if (!base || !delta || !result_len) { return NULL; }
+
+    size_t expect_base, size, used;
+    if (!delta_header(delta, delta_len, &expect_base, &size, &used) || expect_base != base_len){
+        fprintf(stderr, "delta_apply: base size mismatch\n");
+        return NULL;
+    }
+
+    const unsigned char *p = delta + used;
+    const unsigned char *end = delta + delta_len;
+    unsigned char *result = safe_malloc(sizeof(unsigned char), size ? size : 1);
+    size_t out = 0;
+
+    while (p < end){
+        unsigned char cmd = *p++;
+        if (cmd & 0x80){
+            size_t off = 0, n = 0;
+            for (int i = 0; i < 4; i++){
+                if (!(cmd & (1 << i))) { continue; }
+                if (p >= end) { goto fail; }
+                off |= (size_t)*p++ << (8 * i);
+            }
+            for (int i = 0; i < 3; i++){
+                if (!(cmd & (0x10 << i))) { continue; }
+                if (p >= end) { goto fail; }
+                n |= (size_t)*p++ << (8 * i);
+            }
+            if (n == 0) { n = DELTA_COPY_MAX; }
+            if (off > base_len || n > base_len - off || n > size - out) { goto fail; }
+            memcpy(result + out, base + off, n);
+            out += n;
+        } else if (cmd){
+            if (cmd > (size_t)(end - p) || cmd > size - out) { goto fail; }
+            memcpy(result + out, p, cmd);
+            p += cmd;
+            out += cmd;
+        } else {
+            goto fail;
+        }
+    }
+
+    if (out != size) { goto fail; }
+    *result_len = size;
+    return result;
+
+fail:
+    fprintf(stderr, "delta_apply: malformed delta\n");
+    free(result);
+    return NULL;
+}
+
+/* Static Functions */
+
+/**
+ * read_varint - Reads a little-endian base-128 size from a delta header.
+ *
+ * @param p     In/out cursor.
+ * @param end   End of the available data.
+ * @param value Output for the decoded value.
+ * @return True on success, false on truncation or overflow.
+ */
+static bool read_varint(const unsigned char **p, const unsigned char *end, size_t *value){
+    size_t v = 0;
+    unsigned shift = 0;
+    unsigned char c;
+
+    do {
+        if (*p >= end || shift > 8 * sizeof(size_t) - 7) { return false; }
+        c = *(*p)++;
+        v |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    *value = v;
+    return true;
+}
+
+/**
+ * put_varint - Writes a little-endian base-128 size for a delta header.
+ *
+ * @param p     Output; at least 10 bytes.
+ * @param value The value.
+ * @return Bytes written.
+ */
+static size_t put_varint(unsigned char *p, size_t value){
+    size_t n = 0;
+    while (value >= 0x80){
+        p[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (unsigned char)value;
+    return n;
+}
+
+/**
+ * block_hash - Computes the rolling hash of DELTA_BLOCK bytes from scratch.
+ */
+static uint32_t block_hash(const unsigned char *p){
+    uint32_t h = 0;
+    for (int i = 0; i < DELTA_BLOCK; i++) { h = h * HASH_MULT + p[i]; }
+    return h;
+}
+
+/**
+ * hash_bucket - Mixes a rolling hash down to a bucket number.
+ */
+static uint32_t hash_bucket(uint32_t hash, uint32_t mask){
+    return (hash ^ (hash >> 15) ^ (hash >> 7)) & mask;
+}
@@ -0,0 +1,1304 @@
+/* diff.c: tree and worktree comparison, rename detection and patches */
+
+#include "diff.h"
+#include "abbrev.h"
+#include "config.h"
+#include "index.h"
+#include "linediff.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "tree.h"
+#include "utils.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    unsigned char *data;
+    size_t        len;
+    size_t        capacity;
+} DiffBuffer;
+
+typedef struct {
+    const unsigned char *data;
+    size_t        size;
+    unsigned char *heap;            /* owned copy behind data, or NULL */
+    void          *map;             /* owned mapping behind data, or NULL */
+} DiffContent;
+
+typedef struct {
+    Repository    *repo;
+    DiffQueue     *queue;
+    char          path[MAX_PATH];
+    bool          status;
+} TreeWalk;
+
+typedef struct {
+    const char    *path;            /* NUL-terminated */
+    size_t        len;
+    uint32_t      mode;
+    unsigned char sha[SHA_SIZE];
+} TreeFile;
+
+typedef struct {
+    const char    *path;
+    size_t        len;
+    uint32_t      old_mode;         /* 0 if the path is not in the tree */
+    unsigned char old_sha[SHA_SIZE];
+    IndexEntry    *entry;           /* NULL if the path is only in the tree */
+    uint32_t      new_mode;         /* 0 once the worktree file is gone */
+    unsigned char new_sha[SHA_SIZE];
+    bool          hashed;           /* new_sha was computed from the file */
+    bool          failed;
+} WorktreeItem;
+
+typedef struct {
+    Repository    *repo;
+    DiffQueue     *queue;
+    Index         *index;
+    int           worktree_fd;
+    bool          filemode;
+    bool          status;
+    char          path[MAX_PATH];
+
+    TreeFile      *files;
+    size_t        file_count;
+    size_t        file_capacity;
+    WorktreeItem  *items;
+    size_t        item_count;
+} WorktreeContext;
+
+typedef struct {
+    uint32_t      hash;
+    uint32_t      count;            /* bytes in chunks with this hash */
+} SpanCount;
+
+typedef struct {
+    SpanCount     *spans;           /* sorted by hash */
+    size_t        count;
+    size_t        size;             /* of the contents hashed */
+    bool          ok;
+} SpanSignature;
+
+typedef struct {
+    unsigned char sha[SHA_SIZE];
+    size_t        position;         /* in the queue */
+    bool          used;
+} ExactSource;
+
+typedef struct {
+    size_t        src;              /* positions in the source and destination lists */
+    size_t        dst;
+    uint32_t      score;
+    int           name_score;       /* 1 when the basenames agree */
+} RenameCandidate;
+
+typedef struct {
+    Repository    *repo;
+    const DiffQueue *queue;
+    int           worktree_fd;
+    uint32_t      minimum;
+    size_t        *src;             /* queue positions of unmatched deletions */
+    size_t        src_count;
+    size_t        *dst;             /* queue positions of unmatched additions */
+    size_t        dst_count;
+    SpanSignature *signatures;      /* sources, then destinations */
+    RenameCandidate *candidates;    /* DIFF_RENAME_CANDIDATES per destination */
+} RenameContext;
+
+typedef struct {
+    const DiffPair *pair;
+    char          old_hex[SHA_HEX_SIZE];
+    char          new_hex[SHA_HEX_SIZE];
+    DiffBuffer    out;
+    bool          ok;
+} PrintJob;
+
+typedef struct {
+    Repository    *repo;
+    const DiffOptions *options;
+    int           worktree_fd;
+    char          zero_hex[SHA_HEX_SIZE];
+    PrintJob      *jobs;
+} PrintContext;
+
+/* Forward Declaration of static Functions */
+
+static DiffPair *queue_add(DiffQueue *queue, char status);
+static void     side_set(DiffQueue *queue, DiffSide *side, const char *path, size_t len, uint32_t mode, const unsigned char *sha, bool worktree);
+static bool     tree_walk(TreeWalk *walk, const unsigned char *old_sha, const unsigned char *new_sha, size_t len, size_t depth);
+static bool     tree_entry(TreeWalk *walk, const Tree *tree, const TreeLeaf *leaf, const TreeLeaf *match, bool old_side, size_t len, size_t depth);
+static const Tree *tree_load(Repository *repo, const unsigned char *sha, const char *path, size_t len);
+static bool     worktree_flatten(WorktreeContext *w, const unsigned char *sha, size_t len, size_t depth);
+static bool     worktree_skip(WorktreeContext *w, const IndexTree *node, size_t len);
+static void     worktree_file(WorktreeContext *w, const char *path, size_t len, uint32_t mode, const unsigned char *sha);
+static void     worktree_merge(WorktreeContext *w);
+static void     worktree_job(void *ctx, size_t chunk);
+static void     worktree_check(WorktreeContext *w, WorktreeItem *item);
+static void     worktree_pairs(WorktreeContext *w);
+static int      file_compare(const void *a, const void *b);
+static bool     content_load(Repository *repo, int worktree_fd, const DiffSide *side, DiffContent *content);
+static void     content_free(DiffContent *content);
+static bool     content_is_binary(const DiffContent *content);
+static bool     rename_eligible(const DiffSide *side);
+static size_t   rename_exact(DiffQueue *queue, size_t *src, size_t src_count, size_t *dst, size_t dst_count, size_t *matches, uint32_t *scores);
+static void     rename_signature_job(void *ctx, size_t index);
+static void     rename_score_job(void *ctx, size_t index);
+static int      candidate_compare(const void *a, const void *b);
+static int      exact_compare(const void *a, const void *b);
+static const char *path_basename(const char *path);
+static void     signature_build(SpanSignature *signature, const unsigned char *data, size_t size, bool text);
+static uint32_t signature_score(const SpanSignature *src, const SpanSignature *dst, uint32_t minimum);
+static int      span_compare(const void *a, const void *b);
+static void     print_job(void *ctx, size_t index);
+static bool     patch_format(PrintContext *p, const DiffPair *pair, const char *old_hex, const char *new_hex, DiffBuffer *out);
+static void     patch_hunks(const LineDiff *diff, size_t context, DiffBuffer *out);
+static void     patch_lines(const LineText *text, size_t from, size_t to, char prefix, DiffBuffer *out);
+static long     patch_func_line(const LineText *text, long start, long limit, char *buf, size_t *len);
+static void     patch_range(DiffBuffer *out, size_t start, size_t count);
+static void     abbrev_hex(Repository *repo, const DiffSide *side, size_t min_len, const char *zero_hex, char hex[SHA_HEX_SIZE]);
+static void     buffer_put(DiffBuffer *buf, const void *data, size_t len);
+static void     buffer_printf(DiffBuffer *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Functions */
+
+/**
+ * diff_options_init - Fills diff options from defaults and config.
+ *
+ * Reads diff.algorithm, diff.renames, diff.renameLimit and diff.context.
+ * Histogram is the default algorithm; "myers", "default" and "minimal"
+ * select Myers and "patience" falls back to histogram.
+ *
+ * @param options The options to fill.
+ * @param repo    Repository whose config applies; may be NULL.
+ */
+void diff_options_init(DiffOptions *options, Repository *repo){
+    options->format = DIFF_FORMAT_PATCH;
+    options->algorithm = LINEDIFF_HISTOGRAM;
+    options->context = DIFF_CONTEXT;
+    options->renames = true;
+    options->rename_score = DIFF_RENAME_SCORE;
+    options->rename_limit = DIFF_RENAME_LIMIT;
+    options->threads = workers_default_count();
+    options->abbrev = abbrev_default_len(repo);
+
+    const Configuration *config = repo ? repo->config : NULL;
+    if (!config) { return; }
+
+    const char *algorithm = config_get(config, "diff.algorithm");
+    if (algorithm && (streq(algorithm, "myers") || streq(algorithm, "default") || streq(algorithm, "minimal"))){
+        options->algorithm = LINEDIFF_MYERS;
+    }
+    options->renames = config_get_bool(config, "diff.renames", true);
+    long limit = config_get_int(config, "diff.renameLimit", DIFF_RENAME_LIMIT);
+    if (limit > 0) { options->rename_limit = (size_t)limit; }
+    long context = config_get_int(config, "diff.context", DIFF_CONTEXT);
+    if (context >= 0) { options->context = (size_t)context; }
+}
+
+/**
+ * diff_tree_to_tree - Lists the files that differ between two trees.
+ *
+ * Both trees are walked in step and an entry whose mode and SHA agree on
+ * both sides is passed over without reading it, so an unchanged subtree
+ * costs one comparison however large it is.
+ *
+ * @param repo     The repository.
+ * @param old_tree Tree of the old side.
+ * @param new_tree Tree of the new side.
+ * @param queue    Receives the pairs; zero it first, release with diff_queue_free().
+ * @return true on success, false if a tree could not be read.
+ */
+bool diff_tree_to_tree(Repository *repo, const unsigned char *old_tree, const unsigned char *new_tree, DiffQueue *queue){
+    if (!repo || !old_tree || !new_tree || !queue) { return false; }
+
+    TreeWalk *walk = safe_malloc(1, sizeof(TreeWalk));
+    walk->repo = repo;
+    walk->queue = queue;
+    walk->path[0] = '\0';
+    walk->status = true;
+    bool status = tree_walk(walk, old_tree, new_tree, 0, 0) && walk->status;
+    free(walk);
+    return status;
+}
+
+/**
+ * diff_tree_to_worktree - Lists the files that differ between a tree and the worktree.
+ *
+ * The tree is flattened, skipping subtrees whose cache-tree entry still
+ * names them, and merged with the index. Files are then lstat'd in
+ * DIFF_WORKTREE_CHUNK batches across the worker pool and only hashed when
+ * their stat data disagrees with the index or they are racily clean.
+ *
+ * @param repo    The repository.
+ * @param tree    Tree of the old side.
+ * @param options Supplies the thread count.
+ * @param queue   Receives the pairs; zero it first, release with diff_queue_free().
+ * @return true on success, false on error.
+ */
+bool diff_tree_to_worktree(Repository *repo, const unsigned char *tree, const DiffOptions *options, DiffQueue *queue){
+    if (!repo || !tree || !options || !queue) { return false; }
+
+    WorktreeContext *w = safe_calloc(1, sizeof(WorktreeContext));
+    w->repo = repo;
+    w->queue = queue;
+    w->worktree_fd = -1;
+    w->filemode = repo->config ? repo->config->filemode : true;
+    w->status = false;
+
+    w->index = index_read(repo);
+    if (!w->index) { goto done; }
+    w->worktree_fd = open(repo->worktree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (w->worktree_fd < 0){
+        fprintf(stderr, "diff_tree_to_worktree: cannot open %s: %s\n", repo->worktree, strerror(errno));
+        goto done;
+    }
+
+    w->status = true;
+    if (!worktree_flatten(w, tree, 0, 0) || !w->status) { w->status = false; goto done; }
+    for (size_t i = 1; i < w->file_count; i++){
+        const TreeFile *a = &w->files[i - 1], *b = &w->files[i];
+        if (index_name_compare(a->path, a->len, 0, b->path, b->len, 0) > 0){
+            qsort(w->files, w->file_count, sizeof(TreeFile), file_compare);
+            break;
+        }
+    }
+
+    worktree_merge(w);
+    pack_list(repo);
+    size_t chunks = (w->item_count + DIFF_WORKTREE_CHUNK - 1) / DIFF_WORKTREE_CHUNK;
+    if (!workers_run(options->threads, chunks, worktree_job, w)) { w->status = false; goto done; }
+    worktree_pairs(w);
+
+done:;
+    bool status = w->status;
+    if (w->worktree_fd >= 0) { close(w->worktree_fd); }
+    index_free(w->index);
+    free(w->files);
+    free(w->items);
+    free(w);
+    return status;
+}
+
+/**
+ * diff_renames - Pairs deleted and added files into renames.
+ *
+ * Files with identical contents pair up first, preferring a source with
+ * the same basename. The rest are compared with git's similarity index:
+ * the span signatures of every candidate are built across the worker pool,
+ * then each destination is scored against all sources as one job keeping
+ * its DIFF_RENAME_CANDIDATES best matches, and the candidates are
+ * assigned best first, each source used once. The inexact step is skipped
+ * with a warning when sources times destinations exceed the square of
+ * options->rename_limit.
+ *
+ * @param repo    The repository.
+ * @param queue   Pairs from diff_tree_to_tree() or diff_tree_to_worktree();
+ *                renames replace their addition and deletion in place.
+ * @param options Supplies renames, rename_score, rename_limit and threads.
+ * @return true on success, false on error.
+ */
+bool diff_renames(Repository *repo, DiffQueue *queue, const DiffOptions *options){
+    if (!repo || !queue || !options) { return false; }
+    if (!options->renames || !queue->count) { return true; }
+
+    size_t *src = safe_malloc(queue->count, sizeof(size_t));
+    size_t *dst = safe_malloc(queue->count, sizeof(size_t));
+    size_t src_count = 0, dst_count = 0;
+    for (size_t i = 0; i < queue->count; i++){
+        const DiffPair *pair = &queue->pairs[i];
+        if (pair->status == 'D' && rename_eligible(&pair->old)) { src[src_count++] = i; }
+        if (pair->status == 'A' && rename_eligible(&pair->new)) { dst[dst_count++] = i; }
+    }
+    if (!src_count || !dst_count) { free(src); free(dst); return true; }
+
+    size_t *matches = safe_malloc(queue->count, sizeof(size_t));   /* source of each destination */
+    uint32_t *scores = safe_calloc(queue->count, sizeof(uint32_t));
+    for (size_t i = 0; i < queue->count; i++) { matches[i] = SIZE_MAX; }
+    bool status = true;
+
+    size_t renames = rename_exact(queue, src, src_count, dst, dst_count, matches, scores);
+    bool *used = safe_calloc(queue->count, sizeof(bool));
+    for (size_t i = 0; i < queue->count; i++){ if (matches[i] != SIZE_MAX) { used[matches[i]] = true; } }
+
+    RenameContext r = { .repo = repo, .queue = queue, .worktree_fd = -1, .minimum = options->rename_score };
+    r.src = safe_malloc(src_count, sizeof(size_t));
+    r.dst = safe_malloc(dst_count, sizeof(size_t));
+    for (size_t i = 0; i < src_count; i++){
+        if (!used[src[i]] && S_ISREG(queue->pairs[src[i]].old.mode)) { r.src[r.src_count++] = src[i]; }
+    }
+    for (size_t i = 0; i < dst_count; i++){
+        if (matches[dst[i]] == SIZE_MAX && S_ISREG(queue->pairs[dst[i]].new.mode)) { r.dst[r.dst_count++] = dst[i]; }
+    }
+
+    size_t limit = options->rename_limit;
+    if (r.src_count && r.dst_count && r.src_count * r.dst_count > limit * limit){
+        size_t needed = r.src_count > r.dst_count ? r.src_count : r.dst_count;
+        fprintf(stderr, "warning: exhaustive rename detection was skipped due to too many files.\n");
+        fprintf(stderr, "warning: you may want to set your diff.renameLimit variable to at least %zu and retry the command.\n", needed);
+        queue->renames_skipped = true;
+    } else if (r.src_count && r.dst_count){
+        pack_list(repo);
+        r.worktree_fd = open(repo->worktree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        r.signatures = safe_calloc(r.src_count + r.dst_count, sizeof(SpanSignature));
+        r.candidates = safe_malloc(r.dst_count * DIFF_RENAME_CANDIDATES, sizeof(RenameCandidate));
+        status = workers_run(options->threads, r.src_count + r.dst_count, rename_signature_job, &r) &&
+                 workers_run(options->threads, r.dst_count, rename_score_job, &r);
+
+        if (status){
+            size_t count = r.dst_count * DIFF_RENAME_CANDIDATES;
+            qsort(r.candidates, count, sizeof(RenameCandidate), candidate_compare);
+            for (size_t i = 0; i < count && r.candidates[i].score >= r.minimum; i++){
+                const RenameCandidate *c = &r.candidates[i];
+                if (c->src == SIZE_MAX) { break; }
+                size_t s = r.src[c->src], d = r.dst[c->dst];
+                if (used[s] || matches[d] != SIZE_MAX) { continue; }
+                used[s] = true;
+                matches[d] = s;
+                scores[d] = c->score;
+                renames++;
+            }
+        }
+        for (size_t i = 0; i < r.src_count + r.dst_count; i++) { free(r.signatures[i].spans); }
+        free(r.signatures);
+        free(r.candidates);
+        if (r.worktree_fd >= 0) { close(r.worktree_fd); }
+    }
+
+    if (status && renames){
+        DiffPair *pairs = safe_malloc(queue->count, sizeof(DiffPair));
+        size_t out = 0;
+        for (size_t i = 0; i < queue->count; i++){
+            DiffPair pair = queue->pairs[i];
+            if (pair.status == 'D' && used[i]) { continue; }
+            if (pair.status == 'A' && matches[i] != SIZE_MAX){
+                pair.old = queue->pairs[matches[i]].old;
+                pair.status = 'R';
+                pair.score = scores[i];
+            }
+            pairs[out++] = pair;
+        }
+        free(queue->pairs);
+        queue->pairs = pairs;
+        queue->count = out;
+        queue->capacity = queue->count;
+        queue->renames += renames;
+    }
+
+    free(r.src);
+    free(r.dst);
+    free(used);
+    free(matches);
+    free(scores);
+    free(src);
+    free(dst);
+    return status;
+}
+
+/**
+ * diff_print - Writes the pairs as a patch, names or names with status.
+ *
+ * Patches are formatted DIFF_BATCH pairs at a time across the worker pool,
+ * each into its own buffer, and written in queue order; blobs are read
+ * (or worktree files mapped) by the workers and line diffs never copy
+ * their lines.
+ *
+ * @param repo    The repository.
+ * @param queue   The pairs to print.
+ * @param options Supplies format, algorithm, context, threads and abbrev.
+ * @param out     Stream to write to.
+ * @return true on success, false if a blob could not be read.
+ */
+bool diff_print(Repository *repo, const DiffQueue *queue, const DiffOptions *options, FILE *out){
+    if (!repo || !queue || !options || !out) { return false; }
+
+    if (options->format != DIFF_FORMAT_PATCH){
+        for (size_t i = 0; i < queue->count; i++){
+            const DiffPair *pair = &queue->pairs[i];
+            const char *path = pair->new.path ? pair->new.path : pair->old.path;
+            if (options->format == DIFF_FORMAT_NAME_ONLY) { fprintf(out, "%s\n", path); }
+            else if (pair->status == 'R') { fprintf(out, "R%03u\t%s\t%s\n", pair->score * 100 / DIFF_MAX_SCORE, pair->old.path, path); }
+            else { fprintf(out, "%c\t%s\n", pair->status, path); }
+        }
+        return true;
+    }
+
+    PrintContext p = { .repo = repo, .options = options, .worktree_fd = -1 };
+    size_t zeros = options->abbrev < 2 * SHA_SIZE ? options->abbrev : 2 * SHA_SIZE;
+    memset(p.zero_hex, '0', zeros);
+    p.zero_hex[zeros] = '\0';
+    p.jobs = safe_calloc(DIFF_BATCH, sizeof(PrintJob));
+    pack_list(repo);
+    p.worktree_fd = open(repo->worktree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bool status = true;
+
+    for (size_t start = 0; status && start < queue->count; start += DIFF_BATCH){
+        size_t count = queue->count - start < DIFF_BATCH ? queue->count - start : DIFF_BATCH;
+        /* abbreviations consult caches the workers must not touch */
+        for (size_t i = 0; i < count; i++){
+            PrintJob *job = &p.jobs[i];
+            job->pair = &queue->pairs[start + i];
+            job->out.len = 0;
+            job->ok = false;
+            abbrev_hex(repo, &job->pair->old, options->abbrev, p.zero_hex, job->old_hex);
+            abbrev_hex(repo, &job->pair->new, options->abbrev, p.zero_hex, job->new_hex);
+        }
+        if (!workers_run(options->threads, count, print_job, &p)) { status = false; break; }
+        for (size_t i = 0; status && i < count; i++){
+            status = p.jobs[i].ok;
+            if (status && p.jobs[i].out.len && fwrite(p.jobs[i].out.data, 1, p.jobs[i].out.len, out) != p.jobs[i].out.len){
+                fprintf(stderr, "diff_print: write failed: %s\n", strerror(errno));
+                status = false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < DIFF_BATCH; i++) { free(p.jobs[i].out.data); }
+    free(p.jobs);
+    if (p.worktree_fd >= 0) { close(p.worktree_fd); }
+    return status;
+}
+
+/**
+ * diff_similarity - Scores how much of one buffer survives in another.
+ *
+ * This is git's similarity index: both buffers are cut into chunks ending
+ * at a newline or after DIFF_SPAN_MAX bytes (a CR before LF is ignored in
+ * text), and the bytes of a's chunks also found in b are divided by the
+ * larger size. Pairs whose sizes alone rule out minimum score 0.
+ *
+ * @param minimum Least interesting score, out of DIFF_MAX_SCORE.
+ * @return The score, out of DIFF_MAX_SCORE.
+ */
+uint32_t diff_similarity(const unsigned char *a, size_t a_size, const unsigned char *b, size_t b_size, uint32_t minimum){
+    SpanSignature src = { 0 }, dst = { 0 };
+    DiffContent left = { .data = a, .size = a_size }, right = { .data = b, .size = b_size };
+    signature_build(&src, a, a_size, !content_is_binary(&left));
+    signature_build(&dst, b, b_size, !content_is_binary(&right));
+    uint32_t score = signature_score(&src, &dst, minimum);
+    free(src.spans);
+    free(dst.spans);
+    return score;
+}
+
+/**
+ * diff_queue_free - Releases the pairs of a diff.
+ *
+ * @param queue The queue; may be NULL.
+ */
+void diff_queue_free(DiffQueue *queue){
+    if (!queue) { return; }
+    free(queue->pairs);
+    arena_clear(&queue->arena);
+    memset(queue, 0, sizeof(*queue));
+}
+
+/* Static Functions */
+
+/**
+ * queue_add - Appends a pair with both sides missing.
+ */
+static DiffPair *queue_add(DiffQueue *queue, char status){
+    if (queue->count == queue->capacity){
+        queue->capacity = queue->capacity ? 2 * queue->capacity : 64;
+        queue->pairs = realloc(queue->pairs, queue->capacity * sizeof(DiffPair));
+        MALLOC_CHECK(queue->pairs);
+    }
+    DiffPair *pair = &queue->pairs[queue->count++];
+    memset(pair, 0, sizeof(*pair));
+    pair->status = status;
+    return pair;
+}
+
+/**
+ * side_set - Fills one side of a pair, copying its path into the queue's arena.
+ */
+static void side_set(DiffQueue *queue, DiffSide *side, const char *path, size_t len, uint32_t mode, const unsigned char *sha, bool worktree){
+    char *copy = arena_alloc(&queue->arena, len + 1);
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    side->path = copy;
+    side->mode = mode;
+    memcpy(side->sha, sha, SHA_SIZE);
+    side->worktree = worktree;
+}
+
+/**
+ * tree_walk - Compares two trees entry by entry, in git order.
+ *
+ * @param old_sha Old tree, or NULL if the directory is new.
+ * @param new_sha New tree, or NULL if the directory is gone.
+ * @param len     Length of walk->path, the directory with a trailing '/' (or "").
+ */
+static bool tree_walk(TreeWalk *walk, const unsigned char *old_sha, const unsigned char *new_sha, size_t len, size_t depth){
+    if (depth > INDEX_TREE_DEPTH){
+        fprintf(stderr, "diff_tree_to_tree: trees nested too deeply\n");
+        return false;
+    }
+    const Tree *a = old_sha ? tree_load(walk->repo, old_sha, walk->path, len) : NULL;
+    const Tree *b = new_sha ? tree_load(walk->repo, new_sha, walk->path, len) : NULL;
+    if ((old_sha && !a) || (new_sha && !b)) { return false; }
+
+    size_t i = 0, j = 0, na = a ? a->count : 0, nb = b ? b->count : 0;
+    while (i < na || j < nb){
+        const TreeLeaf *x = i < na ? &a->leaves[i] : NULL, *y = j < nb ? &b->leaves[j] : NULL;
+        int cmp = !x ? 1 : !y ? -1 : tree_name_compare(tree_leaf_name(a, x), x->name_len, x->mode,
+                                                       tree_leaf_name(b, y), y->name_len, y->mode);
+        bool ok = true;
+        if (cmp < 0)      { ok = tree_entry(walk, a, x, NULL, true, len, depth); i++; }
+        else if (cmp > 0) { ok = tree_entry(walk, b, y, NULL, false, len, depth); j++; }
+        else {
+            if (x->mode != y->mode || memcmp(x->sha, y->sha, SHA_SIZE) != 0) { ok = tree_entry(walk, a, x, y, true, len, depth); }
+            else if (tree_leaf_is_tree(x)) { walk->queue->trees_skipped++; }
+            i++;
+            j++;
+        }
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+/**
+ * tree_entry - Records a changed entry, descending into directories.
+ *
+ * @param match    The entry of the same name and kind on the new side, or
+ *                 NULL if the entry exists on one side only.
+ * @param old_side Whether leaf comes from the old tree.
+ */
+static bool tree_entry(TreeWalk *walk, const Tree *tree, const TreeLeaf *leaf, const TreeLeaf *match, bool old_side, size_t len, size_t depth){
+    size_t child = len + leaf->name_len;
+    if (child + 2 > sizeof(walk->path)){
+        fprintf(stderr, "diff_tree_to_tree: path too long\n");
+        return false;
+    }
+    memcpy(walk->path + child - leaf->name_len, tree_leaf_name(tree, leaf), leaf->name_len);
+    walk->path[child] = '\0';
+
+    bool status = true;
+    if (tree_leaf_is_tree(leaf)){
+        walk->path[child] = '/';
+        walk->path[child + 1] = '\0';
+        const unsigned char *other = match ? match->sha : NULL;
+        status = old_side ? tree_walk(walk, leaf->sha, other, child + 1, depth + 1)
+                          : tree_walk(walk, NULL, leaf->sha, child + 1, depth + 1);
+    } else if (match){
+        bool same_type = (leaf->mode & TREE_MODE_TYPE) == (match->mode & TREE_MODE_TYPE);
+        DiffPair *pair = queue_add(walk->queue, same_type ? 'M' : 'T');
+        side_set(walk->queue, &pair->old, walk->path, child, leaf->mode, leaf->sha, false);
+        side_set(walk->queue, &pair->new, walk->path, child, match->mode, match->sha, false);
+    } else {
+        DiffPair *pair = queue_add(walk->queue, old_side ? 'D' : 'A');
+        side_set(walk->queue, old_side ? &pair->old : &pair->new, walk->path, child, leaf->mode, leaf->sha, false);
+    }
+    walk->path[len] = '\0';
+    return status;
+}
+
+/**
+ * tree_load - Reads a tree through the object cache.
+ */
+static const Tree *tree_load(Repository *repo, const unsigned char *sha, const char *path, size_t len){
+    GitTree *tree = (GitTree *)object_get(repo, sha);
+    if (tree && tree->object.type == OBJ_TREE) { return &tree->tree; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    fprintf(stderr, "diff: cannot read tree %s for '%.*s'\n", hex, (int)len, path);
+    return NULL;
+}
+
+/**
+ * worktree_flatten - Lists the files of a tree, copying cache-tree ranges from the index.
+ *
+ * @param len Length of w->path, the directory without a trailing '/' (0 at the top).
+ */
+static bool worktree_flatten(WorktreeContext *w, const unsigned char *sha, size_t len, size_t depth){
+    if (depth > INDEX_TREE_DEPTH) { return false; }
+
+    const IndexTree *node = index_tree_find(w->index, w->path, len);
+    if (node && node->entry_count >= 0 && memcmp(node->sha, sha, SHA_SIZE) == 0 && worktree_skip(w, node, len)){
+        w->queue->trees_skipped++;
+        return true;
+    }
+
+    const Tree *tree = tree_load(w->repo, sha, w->path, len);
+    if (!tree) { return false; }
+
+    for (size_t i = 0; i < tree->count; i++){
+        const TreeLeaf *leaf = &tree->leaves[i];
+        size_t child = len + (len ? 1 : 0) + leaf->name_len;
+        if (child >= MAX_PATH) { return false; }
+        if (len) { w->path[len] = '/'; }
+        memcpy(w->path + child - leaf->name_len, tree_leaf_name(tree, leaf), leaf->name_len);
+        w->path[child] = '\0';
+
+        if (tree_leaf_is_tree(leaf)){
+            if (!worktree_flatten(w, leaf->sha, child, depth + 1)) { return false; }
+        } else {
+            worktree_file(w, arena_memdup(&w->queue->arena, w->path, child + 1), child, leaf->mode, leaf->sha);
+        }
+        w->path[len] = '\0';
+    }
+    return true;
+}
+
+/**
+ * worktree_skip - Copies the index range a matching cache-tree node covers.
+ *
+ * The range is only trusted if it really spans exactly the entries below
+ * the directory; otherwise nothing is copied and the tree must be read.
+ */
+static bool worktree_skip(WorktreeContext *w, const IndexTree *node, size_t len){
+    const Index *index = w->index;
+    char prefix[MAX_PATH];
+    memcpy(prefix, w->path, len);
+    prefix[len] = '/';
+    size_t prefix_len = len ? len + 1 : 0;
+
+    size_t start = prefix_len ? index_position(index, prefix, prefix_len) : 0;
+    size_t count = (size_t)node->entry_count;
+    if (start + count > index->count) { return false; }
+    if (count && (index->entries[start + count - 1].name_len < prefix_len ||
+                  memcmp(index->entries[start + count - 1].name, prefix, prefix_len) != 0)) { return false; }
+    if (start + count < index->count && index->entries[start + count].name_len >= prefix_len &&
+        memcmp(index->entries[start + count].name, prefix, prefix_len) == 0) { return false; }
+
+    for (size_t i = start; i < start + count; i++){
+        const IndexEntry *entry = &index->entries[i];
+        worktree_file(w, entry->name, entry->name_len, entry->mode, entry->sha);
+    }
+    return true;
+}
+
+/**
+ * worktree_file - Appends a file of the flattened tree.
+ */
+static void worktree_file(WorktreeContext *w, const char *path, size_t len, uint32_t mode, const unsigned char *sha){
+    if (w->file_count == w->file_capacity){
+        w->file_capacity = w->file_capacity ? 2 * w->file_capacity : 256;
+        w->files = realloc(w->files, w->file_capacity * sizeof(TreeFile));
+        MALLOC_CHECK(w->files);
+    }
+    TreeFile *file = &w->files[w->file_count++];
+    file->path = path;
+    file->len = len;
+    file->mode = mode;
+    memcpy(file->sha, sha, SHA_SIZE);
+}
+
+/**
+ * worktree_merge - Pairs the flattened tree with the index, one item per path.
+ *
+ * Unmerged paths keep their first stage; the worktree file is what gets compared.
+ */
+static void worktree_merge(WorktreeContext *w){
+    const Index *index = w->index;
+    w->items = safe_malloc(w->file_count + index->count + 1, sizeof(WorktreeItem));
+    size_t i = 0, j = 0;
+
+    while (i < w->file_count || j < index->count){
+        IndexEntry *entry = j < index->count ? &index->entries[j] : NULL;
+        if (entry && j > 0 && index_entry_stage(entry) != 0 && entry->name_len == index->entries[j - 1].name_len &&
+            memcmp(entry->name, index->entries[j - 1].name, entry->name_len) == 0) { j++; continue; }
+
+        const TreeFile *file = i < w->file_count ? &w->files[i] : NULL;
+        int cmp = !file ? 1 : !entry ? -1 : index_name_compare(file->path, file->len, 0, entry->name, entry->name_len, 0);
+        WorktreeItem *item = &w->items[w->item_count++];
+        memset(item, 0, sizeof(*item));
+        if (cmp <= 0){
+            item->path = file->path;
+            item->len = file->len;
+            item->old_mode = file->mode;
+            memcpy(item->old_sha, file->sha, SHA_SIZE);
+            i++;
+        }
+        if (cmp >= 0){
+            item->path = entry->name;
+            item->len = entry->name_len;
+            item->entry = entry;
+            j++;
+        }
+    }
+}
+
+/**
+ * worktree_job - Checks one DIFF_WORKTREE_CHUNK batch of items.
+ */
+static void worktree_job(void *ctx, size_t chunk){
+    WorktreeContext *w = ctx;
+    size_t start = chunk * DIFF_WORKTREE_CHUNK;
+    size_t end = start + DIFF_WORKTREE_CHUNK < w->item_count ? start + DIFF_WORKTREE_CHUNK : w->item_count;
+    for (size_t i = start; i < end; i++){
+        if (w->items[i].entry) { worktree_check(w, &w->items[i]); }
+    }
+}
+
+/**
+ * worktree_check - Finds the mode and SHA of an indexed path in the worktree.
+ *
+ * Clean stat data vouches for the index SHA unless the entry is racily
+ * clean. Assume-valid and skip-worktree entries, and submodules, keep the
+ * index side. A missing file, or a directory in its place, leaves new_mode 0.
+ */
+static void worktree_check(WorktreeContext *w, WorktreeItem *item){
+    const IndexEntry *entry = item->entry;
+    item->new_mode = entry->mode;
+    memcpy(item->new_sha, entry->sha, SHA_SIZE);
+    uint32_t type = entry->mode & TREE_MODE_TYPE;
+    if ((entry->flags & INDEX_FLAG_VALID) || (entry->flags_extended & INDEX_EXT_SKIP_WORKTREE)) { return; }
+    if (type == TREE_MODE_GITLINK) { return; }
+
+    struct stat sb;
+    if (fstatat(w->worktree_fd, entry->name, &sb, AT_SYMLINK_NOFOLLOW) != 0 || !(S_ISREG(sb.st_mode) || S_ISLNK(sb.st_mode))){
+        item->new_mode = 0;
+        return;
+    }
+    if (S_ISLNK(sb.st_mode)) { item->new_mode = TREE_MODE_SYMLINK; }
+    else if (w->filemode) { item->new_mode = (sb.st_mode & S_IXUSR) ? 0100755 : 0100644; }
+    else { item->new_mode = type == 0100000 ? entry->mode : 0100644; }
+
+    const struct timespec *written = &w->index->mtime;
+    bool racy = entry->mtime_sec > (uint32_t)written->tv_sec ||
+                (entry->mtime_sec == (uint32_t)written->tv_sec && entry->mtime_nsec >= (uint32_t)written->tv_nsec);
+    if ((item->new_mode & TREE_MODE_TYPE) == type && index_entry_stage(entry) == 0 &&
+        index_entry_stat_matches(entry, &sb) && !racy) { return; }
+
+    item->hashed = true;
+    if (S_ISLNK(sb.st_mode)){
+        char target[MAX_PATH];
+        ssize_t len = readlinkat(w->worktree_fd, entry->name, target, sizeof(target));
+        item->failed = len < 0 || !object_write_buffer(NULL, OBJ_BLOB, target, (size_t)len, item->new_sha);
+    } else {
+        int fd = openat(w->worktree_fd, entry->name, O_RDONLY | O_CLOEXEC);
+        item->failed = fd < 0 || !object_hash_fd(NULL, fd, OBJ_BLOB, item->new_sha);
+        if (fd >= 0) { close(fd); }
+    }
+}
+
+/**
+ * worktree_pairs - Turns the checked items into pairs, dropping unchanged paths.
+ */
+static void worktree_pairs(WorktreeContext *w){
+    DiffQueue *queue = w->queue;
+    for (size_t i = 0; i < w->item_count; i++){
+        const WorktreeItem *item = &w->items[i];
+        if (item->failed){
+            fprintf(stderr, "diff_tree_to_worktree: cannot read '%s'\n", item->path);
+            w->status = false;
+            return;
+        }
+        if (item->hashed) { queue->files_hashed++; }
+
+        uint32_t new_mode = item->entry ? item->new_mode : 0;
+        if (!item->old_mode && !new_mode) { continue; }
+        if (item->old_mode == new_mode && memcmp(item->old_sha, item->new_sha, SHA_SIZE) == 0) { continue; }
+
+        char status = !item->old_mode ? 'A' : !new_mode ? 'D' :
+                      (item->old_mode & TREE_MODE_TYPE) == (new_mode & TREE_MODE_TYPE) ? 'M' : 'T';
+        DiffPair *pair = queue_add(queue, status);
+        if (item->old_mode) { side_set(queue, &pair->old, item->path, item->len, item->old_mode, item->old_sha, false); }
+        if (new_mode) { side_set(queue, &pair->new, item->path, item->len, new_mode, item->new_sha, item->hashed); }
+    }
+}
+
+/**
+ * file_compare - qsort comparator putting flattened files in index order.
+ */
+static int file_compare(const void *a, const void *b){
+    const TreeFile *x = a, *y = b;
+    return index_name_compare(x->path, x->len, 0, y->path, y->len, 0);
+}
+
+/**
+ * content_load - Reads the contents of one side of a pair.
+ *
+ * Worktree files are mapped, symlinks yield their target and submodules
+ * the "Subproject commit" line git diffs them as. A missing side is empty.
+ */
+static bool content_load(Repository *repo, int worktree_fd, const DiffSide *side, DiffContent *content){
+    memset(content, 0, sizeof(*content));
+    if (!side->mode) { return true; }
+
+    if ((side->mode & TREE_MODE_TYPE) == TREE_MODE_GITLINK){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(side->sha, hex);
+        content->heap = safe_malloc(1, SHA_HEX_SIZE + 32);
+        content->size = (size_t)sprintf((char *)content->heap, "Subproject commit %s\n", hex);
+        content->data = content->heap;
+        return true;
+    }
+
+    if (!side->worktree){
+        ObjectType type;
+        content->heap = object_read(repo, side->sha, &type, &content->size);
+        content->data = content->heap;
+        if (content->heap && type == OBJ_BLOB) { return true; }
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(side->sha, hex);
+        fprintf(stderr, "diff: cannot read blob %s for '%s'\n", hex, side->path);
+        content_free(content);
+        return false;
+    }
+
+    if ((side->mode & TREE_MODE_TYPE) == TREE_MODE_SYMLINK){
+        content->heap = safe_malloc(1, MAX_PATH);
+        ssize_t len = readlinkat(worktree_fd, side->path, (char *)content->heap, MAX_PATH);
+        content->size = len > 0 ? (size_t)len : 0;
+        content->data = content->heap;
+        if (len >= 0) { return true; }
+    } else {
+        struct stat sb;
+        int fd = openat(worktree_fd, side->path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && fstat(fd, &sb) == 0){
+            content->size = (size_t)sb.st_size;
+            void *map = content->size ? mmap(NULL, content->size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+            close(fd);
+            if (map != MAP_FAILED){
+                content->map = map;
+                content->data = map;
+                return true;
+            }
+            content->size = 0;
+        } else if (fd >= 0){
+            close(fd);
+        }
+    }
+    fprintf(stderr, "diff: cannot read '%s': %s\n", side->path, strerror(errno));
+    content_free(content);
+    return false;
+}
+
+/**
+ * content_free - Releases loaded contents.
+ */
+static void content_free(DiffContent *content){
+    free(content->heap);
+    if (content->map) { munmap(content->map, content->size); }
+    memset(content, 0, sizeof(*content));
+}
+
+/**
+ * content_is_binary - Whether contents have a NUL within their first DIFF_BINARY_PEEK bytes.
+ */
+static bool content_is_binary(const DiffContent *content){
+    size_t peek = content->size < DIFF_BINARY_PEEK ? content->size : DIFF_BINARY_PEEK;
+    return peek && memchr(content->data, 0, peek) != NULL;
+}
+
+/**
+ * rename_eligible - Whether a side may take part in a rename (files and symlinks).
+ */
+static bool rename_eligible(const DiffSide *side){
+    return S_ISREG(side->mode) || (side->mode & TREE_MODE_TYPE) == TREE_MODE_SYMLINK;
+}
+
+/**
+ * rename_exact - Pairs destinations with unused sources of the same SHA.
+ *
+ * Sources are sorted by SHA so each destination bisects for its run of
+ * identical contents; within it, an unused source of the same basename
+ * wins over the first unused one. Files never pair with symlinks.
+ *
+ * @return The number of renames found.
+ */
+static size_t rename_exact(DiffQueue *queue, size_t *src, size_t src_count, size_t *dst, size_t dst_count, size_t *matches, uint32_t *scores){
+    ExactSource *sorted = safe_malloc(src_count, sizeof(ExactSource));
+    for (size_t i = 0; i < src_count; i++){
+        memcpy(sorted[i].sha, queue->pairs[src[i]].old.sha, SHA_SIZE);
+        sorted[i].position = src[i];
+        sorted[i].used = false;
+    }
+    qsort(sorted, src_count, sizeof(ExactSource), exact_compare);
+    size_t renames = 0;
+
+    for (size_t i = 0; i < dst_count; i++){
+        const DiffSide *target = &queue->pairs[dst[i]].new;
+        size_t lo = 0, hi = src_count;
+        while (lo < hi){
+            size_t mid = lo + (hi - lo) / 2;
+            if (memcmp(sorted[mid].sha, target->sha, SHA_SIZE) < 0) { lo = mid + 1; }
+            else { hi = mid; }
+        }
+
+        size_t best = SIZE_MAX;
+        for (size_t k = lo; k < src_count && memcmp(sorted[k].sha, target->sha, SHA_SIZE) == 0; k++){
+            const DiffSide *source = &queue->pairs[sorted[k].position].old;
+            if (sorted[k].used || S_ISREG(source->mode) != S_ISREG(target->mode)) { continue; }
+            if (best == SIZE_MAX) { best = k; }
+            if (streq(path_basename(source->path), path_basename(target->path))) { best = k; break; }
+        }
+        if (best == SIZE_MAX) { continue; }
+        sorted[best].used = true;
+        matches[dst[i]] = sorted[best].position;
+        scores[dst[i]] = DIFF_MAX_SCORE;
+        renames++;
+    }
+
+    free(sorted);
+    return renames;
+}
+
+/**
+ * rename_signature_job - Builds the span signature of one source or destination.
+ */
+static void rename_signature_job(void *ctx, size_t index){
+    RenameContext *r = ctx;
+    const DiffPair *pair = &r->queue->pairs[index < r->src_count ? r->src[index] : r->dst[index - r->src_count]];
+    const DiffSide *side = index < r->src_count ? &pair->old : &pair->new;
+
+    DiffContent content;
+    if (!content_load(r->repo, r->worktree_fd, side, &content)) { return; }
+    signature_build(&r->signatures[index], content.data, content.size, !content_is_binary(&content));
+    content_free(&content);
+}
+
+/**
+ * rename_score_job - Scores one destination against every source, keeping the best few.
+ */
+static void rename_score_job(void *ctx, size_t index){
+    RenameContext *r = ctx;
+    RenameCandidate *best = &r->candidates[index * DIFF_RENAME_CANDIDATES];
+    for (size_t k = 0; k < DIFF_RENAME_CANDIDATES; k++){
+        best[k] = (RenameCandidate){ .src = SIZE_MAX, .dst = index, .score = 0, .name_score = -1 };
+    }
+
+    const SpanSignature *target = &r->signatures[r->src_count + index];
+    if (!target->ok) { return; }
+    const char *name = path_basename(r->queue->pairs[r->dst[index]].new.path);
+
+    for (size_t i = 0; i < r->src_count; i++){
+        const SpanSignature *source = &r->signatures[i];
+        if (!source->ok) { continue; }
+        uint32_t score = signature_score(source, target, r->minimum);
+        if (score < r->minimum) { continue; }
+        RenameCandidate c = { .src = i, .dst = index, .score = score };
+        c.name_score = streq(path_basename(r->queue->pairs[r->src[i]].old.path), name);
+
+        size_t worst = 0;
+        for (size_t k = 1; k < DIFF_RENAME_CANDIDATES; k++){
+            if (candidate_compare(&best[k], &best[worst]) > 0) { worst = k; }
+        }
+        if (candidate_compare(&c, &best[worst]) < 0) { best[worst] = c; }
+    }
+}
+
+/**
+ * candidate_compare - qsort comparator putting the best rename candidates first.
+ *
+ * Higher scores win, then matching basenames, then the earlier destination
+ * and source so equal candidates resolve the same way on every run.
+ */
+static int candidate_compare(const void *a, const void *b){
+    const RenameCandidate *x = a, *y = b;
+    if (x->score != y->score) { return x->score > y->score ? -1 : 1; }
+    if (x->name_score != y->name_score) { return x->name_score > y->name_score ? -1 : 1; }
+    if (x->dst != y->dst) { return x->dst < y->dst ? -1 : 1; }
+    return x->src < y->src ? -1 : x->src > y->src;
+}
+
+/**
+ * exact_compare - qsort comparator ordering sources by SHA, then queue position.
+ */
+static int exact_compare(const void *a, const void *b){
+    const ExactSource *x = a, *y = b;
+    int cmp = memcmp(x->sha, y->sha, SHA_SIZE);
+    if (cmp) { return cmp; }
+    return x->position < y->position ? -1 : x->position > y->position;
+}
+
+/**
+ * path_basename - The last component of a path.
+ */
+static const char *path_basename(const char *path){
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/**
+ * signature_build - Counts the bytes of each chunk hash in a buffer.
+ *
+ * Chunks end after a newline or DIFF_SPAN_MAX bytes and are hashed as
+ * git's diffcore-delta does, so scores agree with git's; like git, a last
+ * chunk cut short by the end of the buffer is not counted.
+ */
+static void signature_build(SpanSignature *signature, const unsigned char *data, size_t size, bool text){
+    size_t capacity = size / 16 + 16;
+    SpanCount *spans = safe_malloc(capacity, sizeof(SpanCount));
+    size_t count = 0;
+    uint32_t accum1 = 0, accum2 = 0, n = 0;
+
+    for (size_t i = 0; i < size; i++){
+        uint32_t c = data[i], old = accum1;
+        if (text && c == '\r' && i + 1 < size && data[i + 1] == '\n') { continue; }
+        accum1 = (accum1 << 7) ^ (accum2 >> 25);
+        accum2 = (accum2 << 7) ^ (old >> 25);
+        accum1 += c;
+        if (++n < DIFF_SPAN_MAX && c != '\n') { continue; }
+
+        if (count == capacity){
+            capacity *= 2;
+            spans = realloc(spans, capacity * sizeof(SpanCount));
+            MALLOC_CHECK(spans);
+        }
+        spans[count].hash = (accum1 + accum2 * 0x61) % DIFF_SPAN_HASHBASE;
+        spans[count++].count = n;
+        n = accum1 = accum2 = 0;
+    }
+    qsort(spans, count, sizeof(SpanCount), span_compare);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++){
+        if (merged && spans[merged - 1].hash == spans[i].hash) { spans[merged - 1].count += spans[i].count; }
+        else { spans[merged++] = spans[i]; }
+    }
+
+    signature->spans = spans;
+    signature->count = merged;
+    signature->size = size;
+    signature->ok = true;
+}
+
+/**
+ * signature_score - git's estimate_similarity() over two signatures.
+ *
+ * @return The bytes of src found in dst over the larger size, out of
+ * DIFF_MAX_SCORE; 0 if the sizes alone rule out minimum.
+ */
+static uint32_t signature_score(const SpanSignature *src, const SpanSignature *dst, uint32_t minimum){
+    size_t max_size = src->size > dst->size ? src->size : dst->size;
+    size_t base_size = src->size < dst->size ? src->size : dst->size;
+    if (!max_size) { return 0; }
+    if ((uint64_t)max_size * (DIFF_MAX_SCORE - minimum) < (uint64_t)(max_size - base_size) * DIFF_MAX_SCORE) { return 0; }
+
+    uint64_t copied = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < src->count; i++){
+        while (j < dst->count && dst->spans[j].hash < src->spans[i].hash) { j++; }
+        if (j < dst->count && dst->spans[j].hash == src->spans[i].hash){
+            copied += src->spans[i].count < dst->spans[j].count ? src->spans[i].count : dst->spans[j].count;
+            j++;
+        }
+    }
+    return (uint32_t)(copied * DIFF_MAX_SCORE / max_size);
+}
+
+/**
+ * span_compare - qsort comparator ordering chunk counts by hash.
+ */
+static int span_compare(const void *a, const void *b){
+    const SpanCount *x = a, *y = b;
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+/**
+ * print_job - Formats the patch of one pair into its job's buffer.
+ *
+ * A type change is shown as a deletion followed by an addition.
+ */
+static void print_job(void *ctx, size_t index){
+    PrintContext *p = ctx;
+    PrintJob *job = &p->jobs[index];
+    const DiffPair *pair = job->pair;
+
+    if (pair->status != 'T'){
+        job->ok = patch_format(p, pair, job->old_hex, job->new_hex, &job->out);
+        return;
+    }
+    DiffPair removed = { .old = pair->old, .status = 'D' }, added = { .new = pair->new, .status = 'A' };
+    job->ok = patch_format(p, &removed, job->old_hex, p->zero_hex, &job->out) &&
+              patch_format(p, &added, p->zero_hex, job->new_hex, &job->out);
+}
+
+/**
+ * patch_format - Writes the header and hunks of one pair as git does.
+ */
+static bool patch_format(PrintContext *p, const DiffPair *pair, const char *old_hex, const char *new_hex, DiffBuffer *out){
+    const DiffSide *old = &pair->old, *new = &pair->new;
+    const char *a = old->mode ? old->path : new->path, *b = new->mode ? new->path : old->path;
+
+    buffer_printf(out, "diff --git a/%s b/%s\n", a, b);
+    if (!old->mode) { buffer_printf(out, "new file mode %06o\n", new->mode); }
+    else if (!new->mode) { buffer_printf(out, "deleted file mode %06o\n", old->mode); }
+    else if (old->mode != new->mode) { buffer_printf(out, "old mode %06o\nnew mode %06o\n", old->mode, new->mode); }
+    if (pair->status == 'R'){
+        buffer_printf(out, "similarity index %u%%\nrename from %s\nrename to %s\n", pair->score * 100 / DIFF_MAX_SCORE, a, b);
+    }
+    bool same = old->mode && new->mode && memcmp(old->sha, new->sha, SHA_SIZE) == 0;
+    if (same) { return true; }
+    buffer_printf(out, "index %s..%s", old_hex, new_hex);
+    if (old->mode == new->mode) { buffer_printf(out, " %06o", old->mode); }
+    buffer_put(out, "\n", 1);
+
+    DiffContent before, after;
+    if (!content_load(p->repo, p->worktree_fd, old, &before)) { return false; }
+    if (!content_load(p->repo, p->worktree_fd, new, &after)) { content_free(&before); return false; }
+
+    bool status = true;
+    if (content_is_binary(&before) || content_is_binary(&after)){
+        buffer_printf(out, "Binary files %s%s and %s%s differ\n", old->mode ? "a/" : "", old->mode ? a : "/dev/null",
+                      new->mode ? "b/" : "", new->mode ? b : "/dev/null");
+    } else {
+        LineDiff diff;
+        status = linediff_compute(&diff, before.data, before.size, after.data, after.size, p->options->algorithm);
+        if (status && diff.count){
+            buffer_printf(out, "--- %s%s\n", old->mode ? "a/" : "", old->mode ? a : "/dev/null");
+            buffer_printf(out, "+++ %s%s\n", new->mode ? "b/" : "", new->mode ? b : "/dev/null");
+            patch_hunks(&diff, p->options->context, out);
+        }
+        if (status) { linediff_free(&diff); }
+    }
+    content_free(&before);
+    content_free(&after);
+    return status;
+}
+
+/**
+ * patch_hunks - Writes the changes of a line diff as unified hunks.
+ *
+ * Changes separated by at most twice the context are merged into one hunk.
+ * The header repeats the nearest line above the hunk that starts with a
+ * letter, '_' or '$', searching no further back than the previous hunk and
+ * reusing its line when none is found, exactly as git's default does.
+ */
+static void patch_hunks(const LineDiff *diff, size_t context, DiffBuffer *out){
+    const LineText *old = &diff->old, *new = &diff->new;
+    char func[DIFF_FUNC_LINE];
+    size_t func_len = 0;
+    long func_limit = -1;
+
+    for (size_t i = 0; i < diff->count; ){
+        size_t last = i;
+        while (last + 1 < diff->count &&
+               diff->changes[last + 1].old_start - (diff->changes[last].old_start + diff->changes[last].old_count) <= 2 * context) { last++; }
+
+        const LineChange *first = &diff->changes[i], *end = &diff->changes[last];
+        size_t old_from = first->old_start > context ? first->old_start - context : 0;
+        size_t new_from = first->new_start > context ? first->new_start - context : 0;
+        size_t post = context;
+        if (post > old->count - (end->old_start + end->old_count)) { post = old->count - (end->old_start + end->old_count); }
+        if (post > new->count - (end->new_start + end->new_count)) { post = new->count - (end->new_start + end->new_count); }
+        size_t old_to = end->old_start + end->old_count + post, new_to = end->new_start + end->new_count + post;
+
+        patch_func_line(old, (long)old_from - 1, func_limit, func, &func_len);
+        func_limit = (long)old_from - 1;
+
+        buffer_put(out, "@@ -", 4);
+        patch_range(out, old_from, old_to - old_from);
+        buffer_put(out, " +", 2);
+        patch_range(out, new_from, new_to - new_from);
+        buffer_put(out, " @@", 3);
+        if (func_len) { buffer_put(out, " ", 1); buffer_put(out, func, func_len); }
+        buffer_put(out, "\n", 1);
+
+        size_t o = old_from;
+        for (size_t k = i; k <= last; k++){
+            const LineChange *change = &diff->changes[k];
+            patch_lines(old, o, change->old_start, ' ', out);
+            patch_lines(old, change->old_start, change->old_start + change->old_count, '-', out);
+            patch_lines(new, change->new_start, change->new_start + change->new_count, '+', out);
+            o = change->old_start + change->old_count;
+        }
+        patch_lines(old, o, old_to, ' ', out);
+        i = last + 1;
+    }
+}
+
+/**
+ * patch_lines - Writes lines [from, to) of one side behind a prefix.
+ */
+static void patch_lines(const LineText *text, size_t from, size_t to, char prefix, DiffBuffer *out){
+    for (size_t i = from; i < to; i++){
+        const unsigned char *line = linediff_line(text, i);
+        size_t len = linediff_line_len(text, i);
+        buffer_put(out, &prefix, 1);
+        buffer_put(out, line, len);
+        if (!len || line[len - 1] != '\n') { buffer_put(out, "\n\\ No newline at end of file\n", 29); }
+    }
+}
+
+/**
+ * patch_func_line - Finds the function line of a hunk, git's def_ff().
+ *
+ * Searches from start towards limit (exclusive) and keeps buf unchanged
+ * when no line qualifies.
+ *
+ * @return The line found, or -1.
+ */
+static long patch_func_line(const LineText *text, long start, long limit, char *buf, size_t *len){
+    long step = start > limit ? -1 : 1;
+    for (long l = start; l != limit && l >= 0 && (size_t)l < text->count; l += step){
+        const unsigned char *line = linediff_line(text, (size_t)l);
+        size_t n = linediff_line_len(text, (size_t)l);
+        if (!n || !(isalpha(line[0]) || line[0] == '_' || line[0] == '$')) { continue; }
+        if (n > DIFF_FUNC_LINE) { n = DIFF_FUNC_LINE; }
+        while (n && isspace(line[n - 1])) { n--; }
+        memcpy(buf, line, n);
+        *len = n;
+        return l;
+    }
+    return -1;
+}
+
+/**
+ * patch_range - Writes "start,count" of a hunk header (1-based, ",1" implied).
+ */
+static void patch_range(DiffBuffer *out, size_t start, size_t count){
+    if (count == 1) { buffer_printf(out, "%zu", start + 1); }
+    else { buffer_printf(out, "%zu,%zu", count ? start + 1 : start, count); }
+}
+
+/**
+ * abbrev_hex - The shortest unique hex of at least min_len digits for a side.
+ */
+static void abbrev_hex(Repository *repo, const DiffSide *side, size_t min_len, const char *zero_hex, char hex[SHA_HEX_SIZE]){
+    if (!side->mode) { strcpy(hex, zero_hex); return; }
+    sha_to_hex(side->sha, hex);
+    size_t len = abbrev_unique_len(repo, side->sha, min_len);
+    if (len < 2 * SHA_SIZE) { hex[len] = '\0'; }
+}
+
+/**
+ * buffer_put - Appends bytes to a buffer.
+ */
+static void buffer_put(DiffBuffer *buf, const void *data, size_t len){
+    if (buf->len + len > buf->capacity){
+        while (buf->len + len > buf->capacity) { buf->capacity = buf->capacity ? 2 * buf->capacity : 4096; }
+        buf->data = realloc(buf->data, buf->capacity);
+        MALLOC_CHECK(buf->data);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+/**
+ * buffer_printf - Appends formatted text to a buffer.
+ */
+static void buffer_printf(DiffBuffer *buf, const char *fmt, ...){
+    va_list args;
+    va_start(args, fmt);
+    char small[256];
+    int n = vsnprintf(small, sizeof(small), fmt, args);
+    va_end(args);
+    if (n < 0) { return; }
+    if ((size_t)n < sizeof(small)) { buffer_put(buf, small, (size_t)n); return; }
+
+    char *large = safe_malloc(1, (size_t)n + 1);
+    va_start(args, fmt);
+    vsnprintf(large, (size_t)n + 1, fmt, args);
+    va_end(args);
+    buffer_put(buf, large, (size_t)n);
+    free(large);
+}
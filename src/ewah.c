@@ -0,0 +1,283 @@
+/* ewah.c: plain and EWAH-compressed bitmaps */
+
+#include "ewah.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Forward Declaration of static Functions */
+
+static void bitmap_grow(Bitmap *bitmap, size_t len);
+static void ewah_push(Ewah *ewah, uint64_t word);
+static void ewah_add_run(Ewah *ewah, bool bit, uint64_t count);
+static void ewah_add_literal(Ewah *ewah, uint64_t word);
+
+static inline bool     marker_bit(uint64_t word) { return word & 1; }
+static inline uint64_t marker_run(uint64_t word) { return (word >> 1) & EWAH_RUNNING_MAX; }
+static inline uint64_t marker_literals(uint64_t word) { return word >> (1 + EWAH_RUNNING_BITS); }
+
+/* Functions */
+
+/**
+ * bitmap_set - Sets one bit, growing the bitmap as needed.
+ */
+void bitmap_set(Bitmap *bitmap, size_t bit){
+    bitmap_grow(bitmap, bit / EWAH_WORD_BITS + 1);
+    bitmap->words[bit / EWAH_WORD_BITS] |= 1ull << (bit % EWAH_WORD_BITS);
+}
+
+/**
+ * bitmap_or - Adds the bits of src to dst.
+ */
+void bitmap_or(Bitmap *dst, const Bitmap *src){
+    bitmap_grow(dst, src->len);
+    for (size_t i = 0; i < src->len; i++) { dst->words[i] |= src->words[i]; }
+}
+
+/**
+ * bitmap_and_not - Removes the bits of src from dst.
+ */
+void bitmap_and_not(Bitmap *dst, const Bitmap *src){
+    size_t len = min(dst->len, src->len);
+    for (size_t i = 0; i < len; i++) { dst->words[i] &= ~src->words[i]; }
+}
+
+/**
+ * bitmap_count - Counts the bits set.
+ */
+size_t bitmap_count(const Bitmap *bitmap){
+    size_t count = 0;
+    for (size_t i = 0; i < bitmap->len; i++) { count += (size_t)__builtin_popcountll(bitmap->words[i]); }
+    return count;
+}
+
+/**
+ * bitmap_count_and - Counts the bits set in both bitmaps.
+ */
+size_t bitmap_count_and(const Bitmap *a, const Bitmap *b){
+    size_t count = 0, len = min(a->len, b->len);
+    for (size_t i = 0; i < len; i++) { count += (size_t)__builtin_popcountll(a->words[i] & b->words[i]); }
+    return count;
+}
+
+/**
+ * bitmap_clear - Unsets every bit, keeping the buffer for reuse.
+ */
+void bitmap_clear(Bitmap *bitmap){
+    if (bitmap->words) { memset(bitmap->words, 0, bitmap->len * sizeof(uint64_t)); }
+    bitmap->len = 0;
+}
+
+/**
+ * bitmap_free - Releases a bitmap's buffer; it is left empty.
+ */
+void bitmap_free(Bitmap *bitmap){
+    free(bitmap->words);
+    memset(bitmap, 0, sizeof(*bitmap));
+}
+
+/**
+ * ewah_encode - Compresses a plain bitmap.
+ *
+ * Trailing zero words are dropped, so the size in bits is a multiple of 64
+ * that ends at the last word with a bit set, as git's writer produces.
+ *
+ * @param ewah   Output; any previous content is replaced.
+ * @param bitmap The bitmap.
+ */
+void ewah_encode(Ewah *ewah, const Bitmap *bitmap){
+    ewah->len = 0;
+    ewah->bits = 0;
+    ewah->marker = 0;
+    ewah_push(ewah, 0);
+
+    size_t len = bitmap->len;
+    while (len && !bitmap->words[len - 1]) { len--; }
+    for (size_t i = 0; i < len; ){
+        uint64_t word = bitmap->words[i];
+        if (word == 0 || word == ~0ull){
+            size_t run = 1;
+            while (i + run < len && bitmap->words[i + run] == word) { run++; }
+            ewah_add_run(ewah, word != 0, run);
+            i += run;
+        } else {
+            ewah_add_literal(ewah, word);
+            i++;
+        }
+    }
+    ewah->bits = (uint32_t)(len * EWAH_WORD_BITS);
+}
+
+/**
+ * ewah_or - Adds the bits of a compressed bitmap to a plain one.
+ */
+void ewah_or(Bitmap *dst, const Ewah *ewah){
+    size_t pos = 0;
+    for (size_t i = 0; i < ewah->len; ){
+        uint64_t marker = ewah->words[i++];
+        uint64_t run = marker_run(marker), literals = min(marker_literals(marker), ewah->len - i);
+        if (marker_bit(marker) && run){
+            bitmap_grow(dst, pos + run);
+            memset(dst->words + pos, 0xff, run * sizeof(uint64_t));
+        }
+        pos += run;
+        if (literals) { bitmap_grow(dst, pos + literals); }
+        for (uint64_t k = 0; k < literals; k++) { dst->words[pos++] |= ewah->words[i++]; }
+    }
+}
+
+/**
+ * ewah_xor - Flips the bits of a plain bitmap that are set in a compressed one.
+ */
+void ewah_xor(Bitmap *dst, const Ewah *ewah){
+    size_t pos = 0;
+    for (size_t i = 0; i < ewah->len; ){
+        uint64_t marker = ewah->words[i++];
+        uint64_t run = marker_run(marker), literals = min(marker_literals(marker), ewah->len - i);
+        if (marker_bit(marker) && run){
+            bitmap_grow(dst, pos + run);
+            for (uint64_t k = 0; k < run; k++) { dst->words[pos + k] ^= ~0ull; }
+        }
+        pos += run;
+        if (literals) { bitmap_grow(dst, pos + literals); }
+        for (uint64_t k = 0; k < literals; k++) { dst->words[pos++] ^= ewah->words[i++]; }
+    }
+}
+
+/**
+ * ewah_parse - Reads a serialized compressed bitmap.
+ *
+ * The format is git's: the size in bits and the number of words (32-bit
+ * big-endian), the words (64-bit big-endian), then the index of the last
+ * marker word.
+ *
+ * @param ewah Output; any previous content is replaced.
+ * @param data The serialized bitmap.
+ * @param len  Bytes available.
+ * @return The number of bytes used, or 0 if data is truncated or invalid.
+ */
+size_t ewah_parse(Ewah *ewah, const unsigned char *data, size_t len){
+    if (len < EWAH_HEADER_SIZE + 4) { return 0; }
+    uint32_t bits = get_be32(data), count = get_be32(data + 4);
+    if ((len - EWAH_HEADER_SIZE - 4) / 8 < count) { return 0; }
+
+    size_t used = EWAH_HEADER_SIZE + (size_t)count * 8 + 4;
+    uint32_t marker = get_be32(data + used - 4);
+    if (count && marker >= count) { return 0; }
+
+    /* the words must not describe more than bits, or a damaged run could ask for gigabytes */
+    uint64_t expanded = 0;
+    for (uint32_t i = 0; i < count; ){
+        uint64_t word = get_be64(data + EWAH_HEADER_SIZE + (size_t)i * 8);
+        uint64_t literals = marker_literals(word);
+        if (literals > count - i - 1) { return 0; }
+        expanded += marker_run(word) + literals;
+        i += 1 + (uint32_t)literals;
+    }
+    if (expanded > ((uint64_t)bits + EWAH_WORD_BITS - 1) / EWAH_WORD_BITS) { return 0; }
+
+    ewah->len = 0;
+    for (uint32_t i = 0; i < count; i++) { ewah_push(ewah, get_be64(data + EWAH_HEADER_SIZE + (size_t)i * 8)); }
+    ewah->bits = bits;
+    ewah->marker = marker;
+    return used;
+}
+
+/**
+ * ewah_serialized_size - Number of bytes ewah_serialize() writes.
+ */
+size_t ewah_serialized_size(const Ewah *ewah){
+    return EWAH_HEADER_SIZE + ewah->len * 8 + 4;
+}
+
+/**
+ * ewah_serialize - Writes a compressed bitmap in the format ewah_parse() reads.
+ *
+ * @param ewah The bitmap.
+ * @param out  Room for ewah_serialized_size() bytes.
+ */
+void ewah_serialize(const Ewah *ewah, unsigned char *out){
+    put_be32(out, ewah->bits);
+    put_be32(out + 4, (uint32_t)ewah->len);
+    for (size_t i = 0; i < ewah->len; i++) { put_be64(out + EWAH_HEADER_SIZE + i * 8, ewah->words[i]); }
+    put_be32(out + EWAH_HEADER_SIZE + ewah->len * 8, (uint32_t)ewah->marker);
+}
+
+/**
+ * ewah_free - Releases a compressed bitmap's buffer; it is left empty.
+ */
+void ewah_free(Ewah *ewah){
+    free(ewah->words);
+    memset(ewah, 0, sizeof(*ewah));
+}
+
+/* Static Functions */
+
+/**
+ * bitmap_grow - Makes words [0, len) addressable, zeroing the new ones.
+ */
+static void bitmap_grow(Bitmap *bitmap, size_t len){
+    if (len <= bitmap->len) { return; }
+    if (len > bitmap->capacity){
+        size_t capacity = bitmap->capacity ? bitmap->capacity : 16;
+        while (capacity < len) { capacity *= 2; }
+        bitmap->words = realloc(bitmap->words, capacity * sizeof(uint64_t));
+        MALLOC_CHECK(bitmap->words);
+        bitmap->capacity = capacity;
+    }
+    memset(bitmap->words + bitmap->len, 0, (len - bitmap->len) * sizeof(uint64_t));
+    bitmap->len = len;
+}
+
+/**
+ * ewah_push - Appends a raw word.
+ */
+static void ewah_push(Ewah *ewah, uint64_t word){
+    if (ewah->len == ewah->capacity){
+        ewah->capacity = ewah->capacity ? 2 * ewah->capacity : 16;
+        ewah->words = realloc(ewah->words, ewah->capacity * sizeof(uint64_t));
+        MALLOC_CHECK(ewah->words);
+    }
+    ewah->words[ewah->len++] = word;
+}
+
+/**
+ * ewah_add_run - Appends count words that are all zeros or all ones.
+ *
+ * The run extends the last marker when nothing follows it yet and its run
+ * has the same bit (or is empty); otherwise a new marker is started.
+ */
+static void ewah_add_run(Ewah *ewah, bool bit, uint64_t count){
+    while (count){
+        uint64_t marker = ewah->words[ewah->marker];
+        uint64_t run = marker_run(marker);
+        bool fits = !marker_literals(marker) && (!run || marker_bit(marker) == bit) && run < EWAH_RUNNING_MAX;
+        if (!fits){
+            ewah->marker = ewah->len;
+            ewah_push(ewah, 0);
+            marker = 0;
+            run = 0;
+        }
+        uint64_t add = min(count, EWAH_RUNNING_MAX - run);
+        ewah->words[ewah->marker] = (marker_literals(marker) << (1 + EWAH_RUNNING_BITS)) | ((run + add) << 1) | (uint64_t)bit;
+        count -= add;
+    }
+}
+
+/**
+ * ewah_add_literal - Appends a word that mixes zeros and ones.
+ */
+static void ewah_add_literal(Ewah *ewah, uint64_t word){
+    uint64_t marker = ewah->words[ewah->marker];
+    if (marker_literals(marker) == EWAH_LITERAL_MAX){
+        ewah->marker = ewah->len;
+        ewah_push(ewah, 0);
+        marker = 0;
+    }
+    ewah->words[ewah->marker] = marker + (1ull << (1 + EWAH_RUNNING_BITS));
+    ewah_push(ewah, word);
+}
@@ -11,6 +11,7 @@
 int main(int argc, char *argv[]){
     int argind = 1;
     bool status = true;
+    trace_init();
     if (argc == argind){
         // TODO: usage message, return exit_failure 
     }
@@ -21,7 +22,45 @@ int main(int argc, char *argv[]){
     const char *command = argv[argind++];
 
     if (streq(command, "init")){
-        status = cmd_init(argind - argc, &argv[argind]);
+        status = cmd_init(argc - argind, &argv[argind]);
+    } else if (streq(command, "cat-file")){
+        status = cmd_cat_file(argc - argind, &argv[argind]);
+    } else if (streq(command, "hash-object")){
+        status = cmd_hash_object(argc - argind, &argv[argind]);
+    } else if (streq(command, "repack")){
+        status = cmd_repack(argc - argind, &argv[argind]);
+    } else if (streq(command, "ls-tree")){
+        status = cmd_ls_tree(argc - argind, &argv[argind]);
+    } else if (streq(command, "log")){
+        status = cmd_log(argc - argind, &argv[argind]);
+    } else if (streq(command, "commit-graph")){
+        status = cmd_commit_graph(argc - argind, &argv[argind]);
+    } else if (streq(command, "multi-pack-index")){
+        status = cmd_multi_pack_index(argc - argind, &argv[argind]);
+    } else if (streq(command, "merge-base")){
+        status = cmd_merge_base(argc - argind, &argv[argind]);
+    } else if (streq(command, "config")){
+        status = cmd_config(argc - argind, &argv[argind]);
+    } else if (streq(command, "ls-files")){
+        status = cmd_ls_files(argc - argind, &argv[argind]);
+    } else if (streq(command, "add")){
+        status = cmd_add(argc - argind, &argv[argind]);
+    } else if (streq(command, "status")){
+        status = cmd_status(argc - argind, &argv[argind]);
+    } else if (streq(command, "checkout")){
+        status = cmd_checkout(argc - argind, &argv[argind]);
+    } else if (streq(command, "diff")){
+        status = cmd_diff(argc - argind, &argv[argind]);
+    } else if (streq(command, "serve")){
+        status = cmd_serve(argc - argind, &argv[argind]);
+    } else if (streq(command, "rev-list")){
+        status = cmd_rev_list(argc - argind, &argv[argind]);
+    } else if (streq(command, "show-ref")){
+        status = cmd_show_ref(argc - argind, &argv[argind]);
+    } else if (streq(command, "pack-refs")){
+        status = cmd_pack_refs(argc - argind, &argv[argind]);
+    } else if (streq(command, "rev-parse")){
+        status = cmd_rev_parse(argc - argind, &argv[argind]);
     }
 
 
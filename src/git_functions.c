@@ -1,12 +1,96 @@
 /* git_functions: functions for main git driver */
 
 #include "git_functions.h"
+#include "abbrev.h"
+#include "checkout.h"
+#include "commit_graph.h"
+#include "config.h"
+#include "diff.h"
+#include "index.h"
+#include "midx.h"
+#include "objects.h"
+#include "pack_bitmap.h"
+#include "repack.h"
+#include "refs.h"
 #include "repository.h"
+#include "revwalk.h"
+#include "serve.h"
+#include "status.h"
+#include "utils.h"
+#include "workers.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define HASH_BATCH_SIZE 4096
+
+/* Structures */
+
+typedef enum {
+    LOG_MEDIUM,
+    LOG_ONELINE,
+    LOG_HASH,
+    LOG_GRAPHVIZ,
+} LogFormat;
+
+typedef struct {
+    Repository    *repo;
+    ObjectType    type;
+    char          **paths;
+    unsigned char (*shas)[SHA_SIZE];
+    bool          *ok;
+} HashBatch;
+
+typedef struct {
+    char          *path;        /* as given, relative to the current directory */
+    char          *name;        /* relative to the top of the worktree */
+    struct stat   sb;
+} AddItem;
+
+typedef struct {
+    Repository    *repo;
+    AddItem       *items;
+    unsigned char (*shas)[SHA_SIZE];
+    bool          *ok;
+    size_t        count;
+    size_t        capacity;
+} AddBatch;
+
+typedef struct {
+    Repository    *repo;
+    char          **patterns;
+    int           pattern_count;
+    bool          dereference;
+    bool          hash_only;
+    size_t        shown;
+} ShowRef;
+
+/* Forward Declaration of static Functions */
+
+static bool hash_object_stdin_paths(Repository *repo, ObjectType type, size_t threads);
+static void hash_object_job(void *ctx, size_t index);
+static bool log_print(Repository *repo, const RevCommit *commit, LogFormat format, size_t abbrev, bool first);
+static void log_print_ident(const char *label, const unsigned char *value, size_t len);
+static bool ls_tree_print(Repository *repo, const GitTree *tree, char *prefix, size_t prefix_len, bool recursive, bool name_only);
+static bool add_walk(AddBatch *batch, const Index *index, char *path, size_t path_len, char *name, size_t name_len);
+static void add_collect(AddBatch *batch, const Index *index, const char *path, const char *name, const struct stat *sb);
+static void add_job(void *ctx, size_t index);
+static int  add_compare(const void *a, const void *b);
+static bool path_normalize(char *name);
+static bool rev_list_push_ref(const char *name, const unsigned char sha[SHA_SIZE], void *ctx);
+static bool rev_list_print(const unsigned char sha[SHA_SIZE], ObjectType type, void *ctx);
+static bool show_ref_print(const char *name, const unsigned char sha[SHA_SIZE], void *ctx);
+static bool diff_rename_score(const char *value, uint32_t *score);
 
 /**
  * cmd_init - Initialize a new repository.
@@ -40,4 +124,1525 @@ bool cmd_init(int arg_count, char *argv[]){
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+/**
+ * cmd_cat_file - Print the contents, type or size of a repository object.
+ *
+ * This function implements the `cat-file` command. With a type argument it
+ * streams the object's body to stdout after checking that the stored type
+ * matches. With -t or -s only the object header is inflated, so probing the
+ * type or size costs the same regardless of how large the object is.
+ * --batch and --batch-check read object names from stdin (see cmd_serve()).
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the object was found and printed, false otherwise.
+ */
+bool cmd_cat_file(int arg_count, char *argv[]){
+    if (arg_count == 1 && (streq(argv[0], "--batch") || streq(argv[0], "--batch-check"))){
+        char *check[] = { "--check" };
+        return cmd_serve(streq(argv[0], "--batch") ? 0 : 1, check);
+    }
+    if (arg_count != 2){
+        fprintf(stderr, "usage: git cat-file (-t | -s | <type>) <object>\n");
+        fprintf(stderr, "       git cat-file (--batch | --batch-check)\n");
+        return false;
+    }
+
+    const char *mode = argv[0];
+    ObjectType expected = OBJ_NONE;
+    if (!streq(mode, "-t") && !streq(mode, "-s")){
+        expected = object_type_from_name(mode, strlen(mode));
+        if (expected == OBJ_NONE){
+            fprintf(stderr, "cat-file: invalid object type \"%s\"\n", mode);
+            return false;
+        }
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    bool status = false;
+    unsigned char sha[SHA_SIZE];
+    if (!object_find(repo, argv[1], expected, sha)) { goto done; }
+
+    if (expected == OBJ_NONE){
+        ObjectType type;
+        size_t size;
+        if (!object_read_header(repo, sha, &type, &size)){
+            fprintf(stderr, "cat-file: Not a valid object name %s\n", argv[1]);
+            goto done;
+        }
+        if (streq(mode, "-t")) { printf("%s\n", object_type_name(type)); }
+        else                   { printf("%zu\n", size); }
+        status = true;
+        goto done;
+    }
+
+    ObjectStream *stream = object_stream_open(repo, sha);
+    if (!stream){
+        fprintf(stderr, "cat-file: Not a valid object name %s\n", argv[1]);
+        goto done;
+    }
+    if (stream->type != expected){
+        fprintf(stderr, "cat-file: %s is a %s, not a %s\n", argv[1], object_type_name(stream->type), mode);
+        object_stream_close(stream);
+        goto done;
+    }
+
+    const unsigned char *chunk;
+    ssize_t n;
+    while ((n = object_stream_next(stream, &chunk)) > 0){
+        if (fwrite(chunk, 1, (size_t)n, stdout) != (size_t)n) { break; }
+    }
+    status = n == 0;
+    object_stream_close(stream);
+
+done:
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_hash_object - Compute an object ID and optionally store the object.
+ *
+ * This function implements the `hash-object` command. The file is read
+ * once; every chunk is hashed and, with -w, compressed into the object
+ * store in the same pass.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the object was hashed (and written), false otherwise.
+ */
+bool cmd_hash_object(int arg_count, char *argv[]){
+    ObjectType type = OBJ_BLOB;
+    bool write = false;
+    bool stdin_paths = false;
+    size_t threads = workers_default_count();
+    const char *path = NULL;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        if (streq(argv[i], "-w")){
+            write = true;
+        } else if (streq(argv[i], "--stdin-paths")){
+            stdin_paths = true;
+        } else if (streq(argv[i], "-t") && i + 1 < arg_count){
+            i++;
+            type = object_type_from_name(argv[i], strlen(argv[i]));
+            if (type == OBJ_NONE){
+                fprintf(stderr, "hash-object: invalid object type \"%s\"\n", argv[i]);
+                return false;
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0){
+            const char *count = argv[i][2] ? argv[i] + 2 : (i + 1 < arg_count ? argv[++i] : NULL);
+            threads = workers_parse_count(count);
+            usage = threads == 0;
+        } else if (!path && argv[i][0] != '-'){
+            path = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+
+    if (usage || (stdin_paths == (path != NULL))){
+        fprintf(stderr, "usage: git hash-object [-t <type>] [-w] <file>\n");
+        fprintf(stderr, "   or: git hash-object [-t <type>] [-w] [-j <n>] --stdin-paths\n");
+        return false;
+    }
+
+    Repository *repo = write ? repo_find(".", true) : NULL;
+    if (write && !repo) { return false; }
+
+    bool status = false;
+    if (stdin_paths){
+        status = hash_object_stdin_paths(repo, type, threads);
+        repo_destroy(repo);
+        return status;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        fprintf(stderr, "hash-object: cannot open %s: %s\n", path, strerror(errno));
+    } else {
+        unsigned char sha[SHA_SIZE];
+        if (object_hash_fd(repo, fd, type, sha)){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(sha, hex);
+            printf("%s\n", hex);
+            status = true;
+        }
+        close(fd);
+    }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_repack - Pack loose objects.
+ *
+ * This function implements the `repack` command. Every loose object is
+ * written into a single new pack, with deltas found by a sliding window
+ * search; with -d the loose files are then removed. With -a packed objects
+ * are written into the new pack as well, and -d then also removes the old
+ * packs. -b (or repack.writeBitmaps) writes a reachability bitmap of the
+ * new pack, which needs -a so that the pack holds every reachable object.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the pack was written (or there was nothing to pack),
+ *         false otherwise.
+ */
+bool cmd_repack(int arg_count, char *argv[]){
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = false };
+    bool window_set = false, depth_set = false, bitmap_set = false, all = false;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        char *end = NULL;
+        if (streq(argv[i], "-d")){
+            options.prune = true;
+        } else if (streq(argv[i], "-a")){
+            all = true;
+        } else if (streq(argv[i], "-ad")){
+            all = options.prune = true;
+        } else if (streq(argv[i], "-b") || streq(argv[i], "--write-bitmap-index")){
+            options.bitmap = bitmap_set = true;
+        } else if (streq(argv[i], "--no-write-bitmap-index")){
+            options.bitmap = false;
+            bitmap_set = true;
+        } else if (strncmp(argv[i], "--window=", 9) == 0){
+            options.window = strtoul(argv[i] + 9, &end, 10);
+            window_set = true;
+        } else if (strncmp(argv[i], "--depth=", 8) == 0){
+            options.depth = strtoul(argv[i] + 8, &end, 10);
+            depth_set = true;
+        } else {
+            usage = true;
+        }
+        if (end && (*end || end == strchr(argv[i], '=') + 1)) { usage = true; }
+    }
+
+    if (usage){
+        fprintf(stderr, "usage: git repack [-a] [-d] [-b | --[no-]write-bitmap-index] [--window=<n>] [--depth=<n>]\n");
+        return false;
+    }
+    if (options.bitmap && !all){
+        fprintf(stderr, "repack: bitmap indexes need -a; an incremental pack does not hold every reachable object\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+    if (!window_set) { options.window = config_get_size(repo->config, "pack.window", REPACK_WINDOW); }
+    if (!depth_set) { options.depth = config_get_size(repo->config, "pack.depth", REPACK_DEPTH); }
+    if (!bitmap_set && all) { options.bitmap = config_get_bool(repo->config, "repack.writeBitmaps", false); }
+
+    RepackResult result;
+    bool status = all ? repack_all(repo, &options, &result) : repack_loose(repo, &options, &result);
+    if (status && result.name[0]){
+        fprintf(stderr, "Total %zu (delta %zu)\n", result.objects, result.deltas);
+        if (options.bitmap) { fprintf(stderr, "Selected %zu commits for bitmaps\n", result.bitmaps); }
+        printf("pack-%s\n", result.name);
+    } else if (status){
+        fprintf(stderr, "Nothing new to pack.\n");
+    }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_ls_tree - List the contents of a tree object.
+ *
+ * This function implements the `ls-tree` command. The tree (or the tree of
+ * a commit) is parsed into its leaf array once; SHAs are only turned into
+ * hex as each line is printed. With -r subtrees are descended into instead
+ * of being listed.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the tree was listed, false otherwise.
+ */
+bool cmd_ls_tree(int arg_count, char *argv[]){
+    bool recursive = false, name_only = false;
+    const char *name = NULL;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        if (streq(argv[i], "-r")){
+            recursive = true;
+        } else if (streq(argv[i], "--name-only")){
+            name_only = true;
+        } else if (!name && argv[i][0] != '-'){
+            name = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+
+    if (usage || !name){
+        fprintf(stderr, "usage: git ls-tree [-r] [--name-only] <tree-ish>\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    bool status = false;
+    unsigned char sha[SHA_SIZE];
+    if (!object_find(repo, name, OBJ_NONE, sha)) { goto done; }
+
+    GitObject *object = object_peel(repo, sha, OBJ_TREE);
+    if (!object){
+        fprintf(stderr, "ls-tree: not a tree object: %s\n", name);
+        goto done;
+    }
+
+    char prefix[MAX_PATH];
+    status = ls_tree_print(repo, (GitTree *)object, prefix, 0, recursive, name_only);
+
+done:
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_log - Show commit history.
+ *
+ * This function implements the `log` command. Commits reachable from the
+ * given revision (HEAD by default) are listed newest first. Parents, dates
+ * and trees come from objects/info/commit-graph when one has been written,
+ * so --format=%H never inflates a commit object; the other formats only
+ * parse the commits they print. --graphviz prints the history as a dot
+ * graph, like the Python version's log. Paths after "--" limit the history
+ * to commits changing them; with `commit-graph write --changed-paths`
+ * most commits are ruled out by their Bloom filter without reading a tree.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the history was printed, false otherwise.
+ */
+bool cmd_log(int arg_count, char *argv[]){
+    LogFormat format = LOG_MEDIUM;
+    size_t max_count = SIZE_MAX;
+    const char *name = NULL;
+    char **paths = NULL;
+    size_t path_count = 0;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        char *end = NULL;
+        if (streq(argv[i], "--")){
+            paths = &argv[i + 1];
+            path_count = (size_t)(arg_count - i - 1);
+            break;
+        } else if (streq(argv[i], "--oneline")){
+            format = LOG_ONELINE;
+        } else if (streq(argv[i], "--format=%H") || streq(argv[i], "--pretty=format:%H")){
+            format = LOG_HASH;
+        } else if (streq(argv[i], "--graphviz")){
+            format = LOG_GRAPHVIZ;
+        } else if (streq(argv[i], "-n") && i + 1 < arg_count){
+            max_count = strtoul(argv[++i], &end, 10);
+            usage = *end != '\0';
+        } else if (strncmp(argv[i], "--max-count=", 12) == 0){
+            max_count = strtoul(argv[i] + 12, &end, 10);
+            usage = *end != '\0';
+        } else if (!name && argv[i][0] != '-'){
+            name = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+
+    if (usage){
+        fprintf(stderr, "usage: git log [--oneline | --format=%%H | --graphviz] [-n <count>] [<commit>] [-- <path>...]\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    RevWalk walk;
+    revwalk_init(&walk, repo);
+    revwalk_limit_paths(&walk, paths, path_count);
+
+    unsigned char sha[SHA_SIZE];
+    bool status = object_find(repo, name ? name : "HEAD", OBJ_COMMIT, sha) && revwalk_push(&walk, sha);
+    size_t abbrev = format == LOG_ONELINE ? abbrev_default_len(repo) : ABBREV_DEFAULT_LEN;
+
+    if (status && format == LOG_GRAPHVIZ) { printf("digraph wyaglog{\n  node[shape=rect]\n"); }
+
+    RevCommit commit;
+    for (size_t n = 0; status && n < max_count && revwalk_next(&walk, &commit); n++){
+        status = log_print(repo, &commit, format, abbrev, n == 0);
+    }
+    status = status && !walk.error;
+
+    if (status && format == LOG_GRAPHVIZ) { printf("}\n"); }
+
+    revwalk_release(&walk);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_rev_list - List the objects reachable from some commits.
+ *
+ * This function implements `rev-list`. The commits reachable from the
+ * given revisions (or every ref with --all) but not from those given as
+ * ^<rev> are listed, or only counted with --count; --objects adds the
+ * trees and blobs they reach. When a pack has a reachability bitmap the
+ * answer is assembled from stored bitmaps, walking only the commits and
+ * trees added since; pack.useBitmaps=false turns that off. Objects are
+ * listed in pack order rather than by date, and without path names.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true on success, false if a revision cannot be resolved or an
+ *         object is missing.
+ */
+bool cmd_rev_list(int arg_count, char *argv[]){
+    bool count = false, objects = false, all = false, usage = false;
+    int revs = 0;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        if (streq(argv[i], "--count"))                  { count = true; }
+        else if (streq(argv[i], "--objects"))           { objects = true; }
+        else if (streq(argv[i], "--all"))               { all = true; }
+        else if (streq(argv[i], "--use-bitmap-index"))  { continue; }
+        else if (argv[i][0] == '-')                     { usage = true; }
+        else                                            { revs++; }
+    }
+    if (usage || (!revs && !all)){
+        fprintf(stderr, "usage: git rev-list [--count] [--objects] [--all] [<rev>...] [^<rev>...]\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    PackBitmap *bitmap = config_get_bool(repo->config, "pack.useBitmaps", true) ? pack_bitmap_load(repo) : NULL;
+    BitmapWalk walk;
+    bitmap_walk_init(&walk, repo, bitmap);
+    walk.commits_only = !objects;
+
+    unsigned char sha[SHA_SIZE];
+    bool status = true;
+    if (all){
+        status = (!ref_read(repo, "HEAD", sha) || bitmap_walk_push(&walk, sha, false)) &&
+                 refs_for_each(repo, rev_list_push_ref, &walk);
+    }
+    for (int i = 0; status && i < arg_count; i++){
+        if (argv[i][0] == '-') { continue; }
+        bool exclude = argv[i][0] == '^';
+        status = object_find(repo, argv[i] + exclude, OBJ_NONE, sha) && bitmap_walk_push(&walk, sha, exclude);
+    }
+    status = status && bitmap_walk_run(&walk);
+
+    ObjectType type = objects ? OBJ_NONE : OBJ_COMMIT;
+    if (status && count){
+        printf("%zu\n", bitmap_walk_count(&walk, type));
+    } else if (status){
+        status = bitmap_walk_for_each(&walk, type, rev_list_print, NULL);
+    }
+
+    bitmap_walk_release(&walk);
+    pack_bitmap_close(bitmap);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_show_ref - List references and the objects they point to.
+ *
+ * This function implements `show-ref`. Every reference under refs/ is
+ * printed (--heads and --tags narrow that to one namespace), or those
+ * whose name ends in one of the patterns at a '/' boundary. --verify
+ * instead takes exact names. -d adds the peeled object of annotated tags
+ * and --hash prints only the SHAs. Loose and packed references are merged.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if some reference was shown, false otherwise.
+ */
+bool cmd_show_ref(int arg_count, char *argv[]){
+    ShowRef show = { 0 };
+    const char *prefix = "refs/";
+    bool verify = false, usage = false;
+    int first = 0;
+
+    for (; first < arg_count && argv[first][0] == '-' && !usage; first++){
+        const char *arg = argv[first];
+        if (streq(arg, "--heads"))                                { prefix = "refs/heads/"; }
+        else if (streq(arg, "--tags"))                            { prefix = "refs/tags/"; }
+        else if (streq(arg, "-d") || streq(arg, "--dereference")) { show.dereference = true; }
+        else if (streq(arg, "-s") || streq(arg, "--hash"))        { show.hash_only = true; }
+        else if (streq(arg, "--verify"))                          { verify = true; }
+        else if (streq(arg, "--"))                                { first++; break; }
+        else                                                      { usage = true; }
+    }
+    if (usage || (verify && first == arg_count)){
+        fprintf(stderr, "usage: git show-ref [--heads] [--tags] [-d] [--hash] [<pattern>...]\n"
+                        "       git show-ref --verify [-d] [--hash] <ref>...\n");
+        return false;
+    }
+
+    show.repo = repo_find(".", true);
+    if (!show.repo) { return false; }
+
+    bool status = true;
+    if (verify){
+        for (int i = first; status && i < arg_count; i++){
+            unsigned char sha[SHA_SIZE];
+            status = (streq(argv[i], "HEAD") || strncmp(argv[i], "refs/", 5) == 0) && ref_read(show.repo, argv[i], sha);
+            if (!status) { fprintf(stderr, "show-ref: '%s' - not a valid ref\n", argv[i]); }
+            else         { status = show_ref_print(argv[i], sha, &show); }
+        }
+    } else {
+        show.patterns = argv + first;
+        show.pattern_count = arg_count - first;
+        status = refs_for_each_prefix(show.repo, prefix, show_ref_print, &show) && show.shown > 0;
+    }
+
+    repo_destroy(show.repo);
+    return status;
+}
+
+/**
+ * cmd_pack_refs - Move loose references into packed-refs.
+ *
+ * This function implements `pack-refs`. Tags are packed, and with --all
+ * every other reference too; the loose files are removed unless
+ * --no-prune is given. Symbolic refs such as HEAD are never packed.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true on success, false otherwise.
+ */
+bool cmd_pack_refs(int arg_count, char *argv[]){
+    bool all = false, prune = true;
+    for (int i = 0; i < arg_count; i++){
+        if (streq(argv[i], "--all"))            { all = true; }
+        else if (streq(argv[i], "--no-prune"))  { prune = false; }
+        else if (streq(argv[i], "--prune"))     { prune = true; }
+        else {
+            fprintf(stderr, "usage: git pack-refs [--all] [--no-prune]\n");
+            return false;
+        }
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    PackRefsStats stats;
+    bool status = refs_pack(repo, all, prune, &stats);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_rev_parse - Print the object names that revisions resolve to.
+ *
+ * This function implements `rev-parse`. Each name may be a full SHA, a
+ * reference or an abbreviated SHA of at least ABBREV_MIN_LEN digits.
+ * --short prints the shortest prefix that no other object shares, of at
+ * least abbrev_default_len() digits (N with --short=N); --verify takes
+ * exactly one name.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if every name resolved, false otherwise.
+ */
+bool cmd_rev_parse(int arg_count, char *argv[]){
+    size_t abbrev = 0;
+    bool verify = false, usage = false;
+    int names = 0;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        if (streq(argv[i], "--verify"))             { verify = true; }
+        else if (streq(argv[i], "--short"))         { abbrev = SIZE_MAX; }
+        else if (strncmp(argv[i], "--short=", 8) == 0){
+            char *end;
+            unsigned long n = strtoul(argv[i] + 8, &end, 10);
+            usage = end == argv[i] + 8 || *end;
+            abbrev = n < ABBREV_MIN_LEN ? ABBREV_MIN_LEN : min(n, 2ul * SHA_SIZE);
+        }
+        else if (argv[i][0] == '-')                 { usage = true; }
+        else                                        { names++; }
+    }
+    if (usage || !names || (verify && names != 1)){
+        fprintf(stderr, "usage: git rev-parse [--verify] [--short[=<n>]] <name>...\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    if (abbrev == SIZE_MAX) { abbrev = abbrev_default_len(repo); }
+    bool status = true;
+    for (int i = 0; status && i < arg_count; i++){
+        if (argv[i][0] == '-') { continue; }
+        unsigned char sha[SHA_SIZE];
+        char hex[SHA_HEX_SIZE];
+        status = object_find(repo, argv[i], OBJ_NONE, sha);
+        if (!status) { break; }
+        sha_to_hex(sha, hex);
+        printf("%.*s\n", (int)(abbrev ? abbrev_unique_len(repo, sha, abbrev) : 2 * SHA_SIZE), hex);
+    }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_commit_graph - Write the commit-graph file.
+ *
+ * This function implements `commit-graph write`, which records the parents,
+ * root tree, committer date and generation number of every commit reachable
+ * from the refs in objects/info/commit-graph. With --changed-paths a Bloom
+ * filter of the paths each commit touched is stored as well, for
+ * `log -- <path>`. --reachable is accepted for git compatibility; it is
+ * what is always done.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the file was written, false otherwise.
+ */
+bool cmd_commit_graph(int arg_count, char *argv[]){
+    bool changed_paths = false;
+    bool usage = arg_count < 1 || !streq(argv[0], "write");
+
+    for (int i = 1; i < arg_count && !usage; i++){
+        if (streq(argv[i], "--changed-paths"))  { changed_paths = true; }
+        else if (!streq(argv[i], "--reachable")) { usage = true; }
+    }
+
+    if (usage){
+        fprintf(stderr, "usage: git commit-graph write [--reachable] [--changed-paths]\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    CommitGraphStats stats;
+    bool status = commit_graph_write(repo, changed_paths, &stats);
+    if (status) { fprintf(stderr, "Wrote %zu commits to the commit-graph\n", stats.commits); }
+    if (status && changed_paths){
+        fprintf(stderr, "Computed %zu changed-path filters (%zu too large)\n", stats.filters, stats.filters_large);
+    }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_multi_pack_index - Write the multi-pack-index file.
+ *
+ * This function implements `multi-pack-index write`, which merges the
+ * object tables of every pack into objects/pack/multi-pack-index so that
+ * a lookup is one binary search however many packs there are.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the file was written, false otherwise.
+ */
+bool cmd_multi_pack_index(int arg_count, char *argv[]){
+    if (arg_count != 1 || !streq(argv[0], "write")){
+        fprintf(stderr, "usage: git multi-pack-index write\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    MidxStats stats;
+    bool status = midx_write(repo, &stats);
+    if (status) { fprintf(stderr, "Wrote %zu objects from %zu packs to the multi-pack-index\n", stats.objects, stats.packs); }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_merge_base - Answer ancestry questions.
+ *
+ * This function implements `merge-base --is-ancestor <a> <b>`, which
+ * succeeds if <a> is an ancestor of (or equal to) <b>. Generation numbers
+ * from the commit-graph prune the search.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if a is an ancestor of b, false otherwise.
+ */
+bool cmd_merge_base(int arg_count, char *argv[]){
+    if (arg_count != 3 || !streq(argv[0], "--is-ancestor")){
+        fprintf(stderr, "usage: git merge-base --is-ancestor <commit> <commit>\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    unsigned char a[SHA_SIZE], b[SHA_SIZE];
+    bool result = false;
+    bool status = object_find(repo, argv[1], OBJ_COMMIT, a) && object_find(repo, argv[2], OBJ_COMMIT, b) &&
+                  revwalk_is_ancestor(repo, a, b, &result);
+
+    repo_destroy(repo);
+    return status && result;
+}
+
+/**
+ * cmd_config - Print a configuration value.
+ *
+ * This function implements `config [--bool | --int] <key>`. The global and
+ * repository files are merged as on every open, so the value printed is the
+ * one the other commands see; --bool and --int print it in canonical form.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the key is set (and valid for the type), false otherwise.
+ */
+bool cmd_config(int arg_count, char *argv[]){
+    bool as_bool = false, as_int = false;
+    const char *key = NULL;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        if (streq(argv[i], "--bool")){
+            as_bool = true;
+        } else if (streq(argv[i], "--int")){
+            as_int = true;
+        } else if (streq(argv[i], "--get") && !key){
+            continue;
+        } else if (!key && argv[i][0] != '-'){
+            key = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+
+    if (usage || !key || (as_bool && as_int)){
+        fprintf(stderr, "usage: git config [--bool | --int] [--get] <key>\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    /* a key given without '=' has no value: true as a boolean, else empty */
+    const char *value = config_get(repo->config, key);
+    bool status = value != NULL || config_has(repo->config, key);
+    if (status && as_bool){
+        bool result = true;
+        status = !value || config_parse_bool(value, &result);
+        if (status) { printf("%s\n", result ? "true" : "false"); }
+        else { fprintf(stderr, "config: bad boolean value '%s' for '%s'\n", value, key); }
+    } else if (status && as_int){
+        long result;
+        if (!value) { value = ""; }
+        status = config_parse_int(value, &result);
+        if (status) { printf("%ld\n", result); }
+        else { fprintf(stderr, "config: bad numeric value '%s' for '%s'\n", value, key); }
+    } else if (status){
+        printf("%s\n", value ? value : "");
+    }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_ls_files - List the paths in the index.
+ *
+ * This function implements the `ls-files` command. With -s (--stage) the
+ * mode, object name and stage of every entry are printed too.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the index was read, false otherwise.
+ */
+bool cmd_ls_files(int arg_count, char *argv[]){
+    bool stage = false;
+    for (int i = 0; i < arg_count; i++){
+        if (streq(argv[i], "-s") || streq(argv[i], "--stage")){
+            stage = true;
+        } else {
+            fprintf(stderr, "usage: git ls-files [-s | --stage]\n");
+            return false;
+        }
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    Index *index = index_read(repo);
+    bool status = index != NULL;
+    for (size_t i = 0; status && i < index->count; i++){
+        const IndexEntry *entry = &index->entries[i];
+        if (stage){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(entry->sha, hex);
+            printf("%06o %s %d\t%s\n", entry->mode, hex, index_entry_stage(entry), entry->name);
+        } else if (i == 0 || !streq(entry->name, index->entries[i - 1].name)){
+            printf("%s\n", entry->name);
+        }
+    }
+
+    index_free(index);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_add - Add file contents to the index.
+ *
+ * This function implements the `add` command. Directories are walked
+ * recursively (skipping .git). Files whose stat data still matches their
+ * index entry are not read again; the rest are hashed into the object store
+ * on a thread pool as one object batch, synced (with core.fsyncObjectFiles)
+ * before the index that names them is rewritten once at the end. Paths that
+ * were deleted from the worktree are left in the index.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if every path was added, false otherwise.
+ */
+bool cmd_add(int arg_count, char *argv[]){
+    if (arg_count == 0){
+        fprintf(stderr, "usage: git add <pathspec>...\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    char cwd[MAX_PATH];
+    size_t top_len = strlen(repo->worktree);
+    if (!getcwd(cwd, sizeof(cwd)) || strncmp(cwd, repo->worktree, top_len) != 0 ||
+        (cwd[top_len] != '\0' && cwd[top_len] != '/')){
+        fprintf(stderr, "add: current directory is outside the worktree %s\n", repo->worktree);
+        repo_destroy(repo);
+        return false;
+    }
+    const char *prefix = cwd[top_len] ? cwd + top_len + 1 : "";
+
+    Index *index = index_read(repo);
+    if (!index){
+        repo_destroy(repo);
+        return false;
+    }
+
+    AddBatch batch = { .repo = repo };
+    bool status = true;
+    for (int i = 0; i < arg_count && status; i++){
+        char path[MAX_PATH], name[MAX_PATH];
+        size_t path_len = (size_t)snprintf(path, sizeof(path), "%s", argv[i]);
+        while (path_len > 1 && path[path_len - 1] == '/') { path[--path_len] = '\0'; }
+
+        size_t name_len = (size_t)snprintf(name, sizeof(name), "%s/%s", prefix, path);
+        bool inside = path_len < sizeof(path) && name_len < sizeof(name) && path[0] != '/' && path_normalize(name);
+        name_len = strlen(name);
+
+        struct stat sb;
+        if (!inside){
+            fprintf(stderr, "add: '%s' is outside repository\n", argv[i]);
+            status = false;
+        } else if (lstat(path, &sb) != 0){
+            fprintf(stderr, "add: pathspec '%s' did not match any files\n", argv[i]);
+            status = false;
+        } else if (S_ISDIR(sb.st_mode)){
+            status = add_walk(&batch, index, path, path_len, name, name_len);
+        } else {
+            add_collect(&batch, index, path, name, &sb);
+        }
+    }
+
+    if (status && batch.count){
+        batch.shas = safe_malloc(SHA_SIZE, batch.count);
+        batch.ok = safe_calloc(sizeof(bool), batch.count);
+        qsort(batch.items, batch.count, sizeof(AddItem), add_compare);
+        status = object_batch_begin(repo);
+        if (status) { workers_run(workers_default_count(), batch.count, add_job, &batch); }
+        if (status) { status = object_batch_commit(repo, NULL); }
+
+        for (size_t i = 0; i < batch.count; i++){
+            const AddItem *item = &batch.items[i];
+            if (!batch.ok[i]){
+                fprintf(stderr, "add: cannot hash %s\n", item->path);
+                status = false;
+                continue;
+            }
+            size_t len = strlen(item->name);
+            const IndexEntry *old = index_find(index, item->name, len, 0);
+            IndexEntry entry = { .name = item->name, .name_len = (uint32_t)len };
+            index_entry_set_stat(&entry, &item->sb);
+            if (!repo->config->filemode && S_ISREG(item->sb.st_mode)) { entry.mode = old ? old->mode : 0100644; }
+            memcpy(entry.sha, batch.shas[i], SHA_SIZE);
+            index_add(index, &entry);
+        }
+        if (status) { status = index_write(repo, index); }
+    }
+
+    for (size_t i = 0; i < batch.count; i++){
+        free(batch.items[i].path);
+        free(batch.items[i].name);
+    }
+    free(batch.items);
+    free(batch.shas);
+    free(batch.ok);
+    index_free(index);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_status - Show the working tree status.
+ *
+ * This function implements the `status` command in its short format
+ * (-s, --short and --porcelain all print "XY path"). -u[<mode>] or
+ * --untracked-files[=<mode>] picks no, normal or all; a bare -u means all.
+ * Renames are not detected and paths are printed unquoted.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the status was collected, false otherwise.
+ */
+bool cmd_status(int arg_count, char *argv[]){
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    StatusOptions options;
+    status_options_init(&options, repo);
+    bool status = true;
+    for (int i = 0; status && i < arg_count; i++){
+        const char *arg = argv[i], *mode = NULL;
+        if (streq(arg, "-s") || streq(arg, "--short") || streq(arg, "--porcelain")) { continue; }
+        if (streq(arg, "-u") || streq(arg, "--untracked-files")) { mode = "all"; }
+        else if (strncmp(arg, "-u", 2) == 0) { mode = arg + 2; }
+        else if (strncmp(arg, "--untracked-files=", 18) == 0) { mode = arg + 18; }
+
+        if (mode && streq(mode, "no")) { options.untracked = UNTRACKED_NO; }
+        else if (mode && streq(mode, "normal")) { options.untracked = UNTRACKED_NORMAL; }
+        else if (mode && streq(mode, "all")) { options.untracked = UNTRACKED_ALL; }
+        else {
+            fprintf(stderr, "usage: git status [-s | --short | --porcelain] [-u[<mode>] | --untracked-files[=<mode>]]\n");
+            status = false;
+        }
+    }
+
+    StatusResult result;
+    if (status) { status = status_collect(repo, &options, &result); }
+    for (size_t i = 0; status && i < result.count; i++){
+        const StatusItem *item = &result.items[i];
+        printf("%c%c %s\n", item->staged, item->worktree, item->path);
+    }
+
+    if (status) { status_result_free(&result); }
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_checkout - Check out a commit (or tree) into an empty directory.
+ *
+ * This function implements the `checkout` command as `checkout <commit>
+ * <dir>`; neither HEAD nor the index change. Files are written by
+ * checkout.workers threads (the number of cores when unset or below 1).
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the whole tree was written, false otherwise.
+ */
+bool cmd_checkout(int arg_count, char *argv[]){
+    if (arg_count != 2){
+        fprintf(stderr, "usage: git checkout <commit> <dir>\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    unsigned char sha[SHA_SIZE];
+    bool status = object_find(repo, argv[0], OBJ_TREE, sha);
+    GitObject *tree = status ? object_peel(repo, sha, OBJ_TREE) : NULL;
+    if (status && !tree){
+        fprintf(stderr, "checkout: %s does not name a commit or tree\n", argv[0]);
+        status = false;
+    }
+
+    long workers = config_get_int(repo->config, "checkout.workers", 0);
+    size_t threads = workers > 0 ? (size_t)workers : workers_default_count();
+    if (status) { status = checkout_tree(repo, tree->sha, argv[1], threads, NULL); }
+
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_diff - Show changes between trees, or between a tree and the worktree.
+ *
+ * This function implements `diff <tree-ish> [<tree-ish>]`: with one name
+ * the worktree is the new side, with two the second tree is. Output is a
+ * patch unless --name-only or --name-status is given. -U<n> sets the
+ * context, --histogram, --myers and --diff-algorithm=<name> pick the line
+ * diff, -M[<n>] (or --find-renames[=<n>]) sets the rename threshold and
+ * --no-renames turns detection off; -j <n> sets the worker threads. Paths
+ * are printed unquoted and there is no indent heuristic.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if the diff was produced, false otherwise.
+ */
+bool cmd_diff(int arg_count, char *argv[]){
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    DiffOptions options;
+    diff_options_init(&options, repo);
+    const char *names[2] = { NULL, NULL };
+    int name_count = 0;
+    bool usage = false;
+
+    for (int i = 0; i < arg_count && !usage; i++){
+        const char *arg = argv[i];
+        if (streq(arg, "--name-only"))              { options.format = DIFF_FORMAT_NAME_ONLY; }
+        else if (streq(arg, "--name-status"))       { options.format = DIFF_FORMAT_NAME_STATUS; }
+        else if (streq(arg, "--histogram"))         { options.algorithm = LINEDIFF_HISTOGRAM; }
+        else if (streq(arg, "--myers") || streq(arg, "--minimal")) { options.algorithm = LINEDIFF_MYERS; }
+        else if (streq(arg, "--no-renames"))        { options.renames = false; }
+        else if (strncmp(arg, "--diff-algorithm=", 17) == 0){
+            arg += 17;
+            if (streq(arg, "histogram") || streq(arg, "patience")) { options.algorithm = LINEDIFF_HISTOGRAM; }
+            else if (streq(arg, "myers") || streq(arg, "default") || streq(arg, "minimal")) { options.algorithm = LINEDIFF_MYERS; }
+            else { usage = true; }
+        }
+        else if (strncmp(arg, "-U", 2) == 0 || strncmp(arg, "--unified=", 10) == 0){
+            const char *value = arg[1] == 'U' ? arg + 2 : arg + 10;
+            char *end;
+            long n = strtol(value, &end, 10);
+            usage = !*value || *end || n < 0;
+            options.context = (size_t)n;
+        }
+        else if (strncmp(arg, "-M", 2) == 0 || strncmp(arg, "--find-renames", 14) == 0){
+            const char *value = arg[1] == 'M' ? arg + 2 : arg + 14;
+            if (arg[1] != 'M' && *value && *value++ != '=') { usage = true; }
+            options.renames = true;
+            if (*value) { usage = usage || !diff_rename_score(value, &options.rename_score); }
+        }
+        else if (strncmp(arg, "-j", 2) == 0){
+            const char *count = arg[2] ? arg + 2 : (i + 1 < arg_count ? argv[++i] : NULL);
+            options.threads = workers_parse_count(count);
+            usage = options.threads == 0;
+        }
+        else if (arg[0] != '-' && name_count < 2) { names[name_count++] = arg; }
+        else                                      { usage = true; }
+    }
+    if (usage || !name_count){
+        fprintf(stderr, "usage: git diff [<options>] <tree-ish> [<tree-ish>]\n");
+        fprintf(stderr, "options: --name-only | --name-status, -U<n>, -M[<n>] | --no-renames,\n");
+        fprintf(stderr, "         --histogram | --myers | --diff-algorithm=<name>, -j <n>\n");
+        repo_destroy(repo);
+        return false;
+    }
+
+    unsigned char trees[2][SHA_SIZE];
+    bool status = true;
+    for (int i = 0; status && i < name_count; i++){
+        status = object_find(repo, names[i], OBJ_TREE, trees[i]);
+        GitObject *tree = status ? object_peel(repo, trees[i], OBJ_TREE) : NULL;
+        if (status && !tree){
+            fprintf(stderr, "diff: %s does not name a commit or tree\n", names[i]);
+            status = false;
+        }
+        if (status) { memcpy(trees[i], tree->sha, SHA_SIZE); }
+    }
+
+    DiffQueue queue = { 0 };
+    if (status && name_count == 2) { status = diff_tree_to_tree(repo, trees[0], trees[1], &queue); }
+    if (status && name_count == 1) { status = diff_tree_to_worktree(repo, trees[0], &options, &queue); }
+    if (status) { status = diff_renames(repo, &queue, &options); }
+    if (status) { status = diff_print(repo, &queue, &options, stdout); }
+
+    diff_queue_free(&queue);
+    repo_destroy(repo);
+    return status;
+}
+
+/**
+ * cmd_serve - Answer object requests from stdin until it is closed.
+ *
+ * This function implements `serve`, a persistent cat-file --batch: one
+ * process keeps the repository, its packs, config and object cache open
+ * and answers "<object>" or "<object> <type>" lines on stdout (see
+ * serve_batch()). --check answers with headers only.
+ *
+ * @param arg_count  Number of command-line arguments.
+ * @param args       Array of argument strings.
+ *
+ * @return true if every request was answered, false otherwise.
+ */
+bool cmd_serve(int arg_count, char *argv[]){
+    if (arg_count > 1 || (arg_count == 1 && !streq(argv[0], "--check"))){
+        fprintf(stderr, "usage: git serve [--check]\n");
+        return false;
+    }
+
+    Repository *repo = repo_find(".", true);
+    if (!repo) { return false; }
+
+    fflush(stdout);
+    bool status = serve_batch(repo, STDIN_FILENO, STDOUT_FILENO, arg_count == 1, NULL);
+    repo_destroy(repo);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * hash_object_stdin_paths - Hashes every path read from stdin on a thread pool.
+ *
+ * Paths are read in batches of HASH_BATCH_SIZE lines; each batch is hashed
+ * (and written, as one object batch) in parallel and its results printed
+ * in input order before the next batch is read, so memory stays bounded
+ * for any number of paths and a printed name is already durable.
+ *
+ * @param repo    Repository to write into, or NULL to only hash.
+ * @param type    Object type for every path.
+ * @param threads Number of worker threads.
+ * @return true if every path was hashed, false if any failed.
+ */
+static bool hash_object_stdin_paths(Repository *repo, ObjectType type, size_t threads){
+    HashBatch batch = {
+        .repo  = repo,
+        .type  = type,
+        .paths = safe_calloc(sizeof(char *), HASH_BATCH_SIZE),
+        .shas  = safe_malloc(sizeof(*batch.shas), HASH_BATCH_SIZE),
+        .ok    = safe_calloc(sizeof(bool), HASH_BATCH_SIZE),
+    };
+    bool status = true;
+    bool done = false;
+
+    while (!done){
+        size_t count = 0;
+        while (count < HASH_BATCH_SIZE){
+            char *line = NULL;
+            size_t cap = 0;
+            ssize_t n = getline(&line, &cap, stdin);
+            if (n < 0){
+                free(line);
+                done = true;
+                break;
+            }
+            if (n > 0 && line[n - 1] == '\n') { line[n - 1] = '\0'; }
+            batch.paths[count++] = line;
+        }
+
+        bool batched = repo && object_batch_begin(repo);
+        workers_run(threads, count, hash_object_job, &batch);
+        if (batched && !object_batch_commit(repo, NULL)) { status = false; }
+
+        for (size_t i = 0; i < count; i++){
+            if (batch.ok[i]){
+                char hex[SHA_HEX_SIZE];
+                sha_to_hex(batch.shas[i], hex);
+                printf("%s\n", hex);
+            } else {
+                fprintf(stderr, "hash-object: cannot hash %s\n", batch.paths[i]);
+                status = false;
+            }
+            free(batch.paths[i]);
+        }
+    }
+
+    free(batch.paths);
+    free(batch.shas);
+    free(batch.ok);
+    return status;
+}
+
+/**
+ * hash_object_job - Worker job hashing one path of a HashBatch.
+ *
+ * @param ctx   The HashBatch.
+ * @param index Index of the path within the batch.
+ */
+static void hash_object_job(void *ctx, size_t index){
+    HashBatch *batch = ctx;
+    batch->ok[index] = false;
+
+    int fd = open(batch->paths[index], O_RDONLY);
+    if (fd < 0) { return; }
+    batch->ok[index] = object_hash_fd(batch->repo, fd, batch->type, batch->shas[index]);
+    close(fd);
+}
+
+/**
+ * ls_tree_print - Prints the leaves of a tree, recursing into subtrees on request.
+ *
+ * @param repo       Repository holding the subtrees.
+ * @param tree       The tree to list.
+ * @param prefix     Path of the tree followed by '/', built up in place.
+ * @param prefix_len Bytes of prefix in use.
+ * @param recursive  Descend into subtrees instead of listing them.
+ * @param name_only  Print only the paths.
+ * @return true on success, false if a subtree is missing or a path too long.
+ */
+static bool ls_tree_print(Repository *repo, const GitTree *tree, char *prefix, size_t prefix_len, bool recursive, bool name_only){
+    for (size_t i = 0; i < tree->tree.count; i++){
+        const TreeLeaf *leaf = &tree->tree.leaves[i];
+        const char *name = tree_leaf_name(&tree->tree, leaf);
+
+        if (recursive && tree_leaf_is_tree(leaf)){
+            if (prefix_len + leaf->name_len + 2 > MAX_PATH){
+                fprintf(stderr, "ls-tree: path too long: %.*s%s\n", (int)prefix_len, prefix, name);
+                return false;
+            }
+            GitObject *subtree = object_get(repo, leaf->sha);
+            if (!subtree || subtree->type != OBJ_TREE){
+                fprintf(stderr, "ls-tree: bad tree entry %.*s%s\n", (int)prefix_len, prefix, name);
+                return false;
+            }
+            memcpy(prefix + prefix_len, name, leaf->name_len);
+            prefix[prefix_len + leaf->name_len] = '/';
+            if (!ls_tree_print(repo, (GitTree *)subtree, prefix, prefix_len + leaf->name_len + 1, recursive, name_only)) { return false; }
+            continue;
+        }
+
+        if (name_only){
+            printf("%.*s%s\n", (int)prefix_len, prefix, name);
+        } else {
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(leaf->sha, hex);
+            printf("%06o %s %s\t%.*s%s\n", (unsigned)leaf->mode, tree_leaf_type(leaf), hex, (int)prefix_len, prefix, name);
+        }
+    }
+    return true;
+}
+
+/**
+ * log_print - Prints one commit in the requested log format.
+ *
+ * @param repo   Repository, for commits that came from the commit-graph.
+ * @param commit The commit.
+ * @param format Output format.
+ * @param first  Whether this is the first commit printed.
+ * @return true on success, false if the commit object cannot be read.
+ */
+static bool log_print(Repository *repo, const RevCommit *commit, LogFormat format, size_t abbrev, bool first){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(commit->sha, hex);
+    if (format == LOG_HASH){
+        printf("%s\n", hex);
+        return true;
+    }
+
+    GitCommit *object = commit->commit ? commit->commit : (GitCommit *)object_get(repo, commit->sha);
+    if (!object || object->object.type != OBJ_COMMIT) { return false; }
+
+    size_t len;
+    const unsigned char *message = kvlm_message(&object->kvlm, &len);
+    while (len && (message[len - 1] == '\n' || message[len - 1] == ' ')) { len--; }
+    const unsigned char *nl = memchr(message, '\n', len);
+    int summary = (int)(nl ? (size_t)(nl - message) : len);
+
+    if (format == LOG_ONELINE){
+        printf("%.*s %.*s\n", (int)abbrev_unique_len(repo, commit->sha, abbrev), hex, summary, (const char *)message);
+        return true;
+    }
+
+    if (format == LOG_GRAPHVIZ){
+        printf("  c_%s [label=\"%.7s: ", hex, hex);
+        for (int i = 0; i < summary; i++){
+            if (message[i] == '\\' || message[i] == '"') { putchar('\\'); }
+            putchar(message[i]);
+        }
+        printf("\"]\n");
+        for (size_t i = 0; i < commit->parent_count; i++){
+            char parent[SHA_HEX_SIZE];
+            sha_to_hex(commit->parents[i], parent);
+            printf("  c_%s -> c_%s;\n", hex, parent);
+        }
+        return true;
+    }
+
+    printf("%scommit %s\n", first ? "" : "\n", hex);
+    if (commit->parent_count > 1){
+        printf("Merge:");
+        for (size_t i = 0; i < commit->parent_count; i++){
+            char parent[SHA_HEX_SIZE];
+            sha_to_hex(commit->parents[i], parent);
+            printf(" %.7s", parent);
+        }
+        printf("\n");
+    }
+
+    KvlmField *author = kvlm_get(&object->kvlm, "author", 0);
+    if (author) { log_print_ident("Author", object->kvlm.data + author->value_off, author->value_len); }
+    printf("\n");
+
+    const unsigned char *line = message, *end = message + len;
+    while (line < end){
+        const unsigned char *stop = memchr(line, '\n', (size_t)(end - line));
+        if (!stop) { stop = end; }
+        printf("    %.*s\n", (int)(stop - line), (const char *)line);
+        line = stop + 1;
+    }
+    return true;
+}
+
+/**
+ * log_print_ident - Prints "Author: name <email>" and its "Date:" line.
+ *
+ * @param label Header label.
+ * @param value Raw ident, "Name <email> <time> <+hhmm>".
+ * @param len   Length of value.
+ */
+static void log_print_ident(const char *label, const unsigned char *value, size_t len){
+    static const char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    const unsigned char *gt = value + len;
+    while (gt > value && gt[-1] != '>') { gt--; }
+    if (gt == value){
+        printf("%s: %.*s\n", label, (int)len, (const char *)value);
+        return;
+    }
+    printf("%s: %.*s\n", label, (int)(gt - value), (const char *)value);
+
+    char tail[64];
+    size_t tail_len = min((size_t)(value + len - gt), sizeof(tail) - 1);
+    memcpy(tail, gt, tail_len);
+    tail[tail_len] = '\0';
+
+    long long when;
+    char tz[8] = "+0000";
+    if (sscanf(tail, " %lld %7s", &when, tz) < 1) { return; }
+
+    int offset = atoi(tz + 1);
+    time_t local = (time_t)when + (tz[0] == '-' ? -1 : 1) * ((offset / 100) * 3600 + (offset % 100) * 60);
+    struct tm tm;
+    if (!gmtime_r(&local, &tm)) { return; }
+    printf("Date:   %s %s %d %02d:%02d:%02d %d %s\n", days[tm.tm_wday], months[tm.tm_mon], tm.tm_mday,
+           tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_year + 1900, tz);
+}
+
+/**
+ * add_walk - Collects every file below a directory for cmd_add().
+ *
+ * @param batch    The batch being built.
+ * @param index    The current index, to skip unchanged files.
+ * @param path     Directory path as given, extended in place.
+ * @param path_len Bytes of path in use.
+ * @param name     The same directory relative to the top, extended in place.
+ * @param name_len Bytes of name in use (0 at the top).
+ * @return true on success, false if a directory cannot be read or a path is too long.
+ */
+static bool add_walk(AddBatch *batch, const Index *index, char *path, size_t path_len, char *name, size_t name_len){
+    DIR *dir = opendir(path);
+    if (!dir){
+        fprintf(stderr, "add: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool status = true;
+    struct dirent *de;
+    while (status && (de = readdir(dir))){
+        if (streq(de->d_name, ".") || streq(de->d_name, "..") || streq(de->d_name, ".git")) { continue; }
+
+        size_t len = strlen(de->d_name);
+        if (path_len + len + 2 > MAX_PATH || name_len + len + 2 > MAX_PATH){
+            fprintf(stderr, "add: path too long in %s\n", path);
+            status = false;
+            break;
+        }
+        path[path_len] = '/';
+        memcpy(path + path_len + 1, de->d_name, len + 1);
+        size_t sub_len = name_len ? name_len + 1 + len : len;
+        if (name_len) { name[name_len] = '/'; }
+        memcpy(name + (name_len ? name_len + 1 : 0), de->d_name, len + 1);
+
+        struct stat sb;
+        if (lstat(path, &sb) != 0){
+            fprintf(stderr, "add: cannot stat %s: %s\n", path, strerror(errno));
+            status = false;
+        } else if (S_ISDIR(sb.st_mode)){
+            status = add_walk(batch, index, path, path_len + 1 + len, name, sub_len);
+        } else if (S_ISREG(sb.st_mode) || S_ISLNK(sb.st_mode)){
+            add_collect(batch, index, path, name, &sb);
+        }
+    }
+    path[path_len] = '\0';
+    name[name_len] = '\0';
+    closedir(dir);
+    return status;
+}
+
+/**
+ * add_collect - Queues a file for hashing unless its index entry is still fresh.
+ */
+static void add_collect(AddBatch *batch, const Index *index, const char *path, const char *name, const struct stat *sb){
+    const IndexEntry *entry = index_find(index, name, strlen(name), 0);
+    if (entry && index_entry_stat_matches(entry, sb)) { return; }
+
+    if (batch->count == batch->capacity){
+        batch->capacity = batch->capacity ? batch->capacity * 2 : HASH_BATCH_SIZE;
+        batch->items = realloc(batch->items, batch->capacity * sizeof(AddItem));
+        MALLOC_CHECK(batch->items);
+    }
+    AddItem *item = &batch->items[batch->count++];
+    item->path = safe_strdup(path);
+    item->name = safe_strdup(name);
+    item->sb = *sb;
+}
+
+/**
+ * add_job - Worker job writing one file of an AddBatch as a blob.
+ *
+ * Symbolic links are stored as their target, as git does.
+ *
+ * @param ctx   The AddBatch.
+ * @param index Index of the file within the batch.
+ */
+static void add_job(void *ctx, size_t index){
+    AddBatch *batch = ctx;
+    const AddItem *item = &batch->items[index];
+
+    if (S_ISLNK(item->sb.st_mode)){
+        char target[MAX_PATH];
+        ssize_t len = readlink(item->path, target, sizeof(target));
+        batch->ok[index] = len >= 0 && (size_t)len < sizeof(target) &&
+                           object_write_buffer(batch->repo, OBJ_BLOB, target, (size_t)len, batch->shas[index]);
+        return;
+    }
+
+    int fd = open(item->path, O_RDONLY);
+    if (fd < 0) { return; }
+    batch->ok[index] = object_hash_fd(batch->repo, fd, OBJ_BLOB, batch->shas[index]);
+    close(fd);
+}
+
+/**
+ * add_compare - qsort() comparator putting AddItems in index order.
+ *
+ * Adding in order turns every new entry into an append to the index.
+ */
+static int add_compare(const void *a, const void *b){
+    return strcmp(((const AddItem *)a)->name, ((const AddItem *)b)->name);
+}
+
+/**
+ * path_normalize - Collapses "." and ".." components and repeated slashes in place.
+ *
+ * @param name A path relative to the top of the worktree.
+ * @return false if a ".." climbs above the top.
+ */
+static bool path_normalize(char *name){
+    char *out = name;
+    for (const char *p = name; *p; ){
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.'){
+            if (out == name) { return false; }
+            while (out > name && *--out != '/') { }
+        } else if (len && !(len == 1 && p[0] == '.')){
+            if (out != name) { *out++ = '/'; }
+            memmove(out, p, len);
+            out += len;
+        }
+        p += len;
+        while (*p == '/') { p++; }
+    }
+    *out = '\0';
+    return true;
+}
+
+/**
+ * rev_list_push_ref - refs_for_each() callback adding a ref as a tip.
+ */
+static bool rev_list_push_ref(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    (void)name;
+    return bitmap_walk_push(ctx, sha, false);
+}
+
+/**
+ * rev_list_print - bitmap_walk_for_each() callback printing one object.
+ */
+static bool rev_list_print(const unsigned char sha[SHA_SIZE], ObjectType type, void *ctx){
+    (void)type;
+    (void)ctx;
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    return printf("%s\n", hex) >= 0;
+}
+
+/**
+ * show_ref_print - refs_for_each_prefix() callback printing a matching ref.
+ */
+static bool show_ref_print(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    ShowRef *show = ctx;
+
+    bool match = show->pattern_count == 0;
+    size_t len = strlen(name);
+    for (int i = 0; !match && i < show->pattern_count; i++){
+        size_t plen = strlen(show->patterns[i]);
+        match = plen <= len && streq(name + len - plen, show->patterns[i]) && (plen == len || name[len - plen - 1] == '/');
+    }
+    if (!match) { return true; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    if (show->hash_only) { printf("%s\n", hex); }
+    else                 { printf("%s %s\n", hex, name); }
+    show->shown++;
+
+    unsigned char peeled[SHA_SIZE];
+    if (show->dereference && ref_peeled(show->repo, name, sha, peeled)){
+        sha_to_hex(peeled, hex);
+        if (show->hash_only) { printf("%s\n", hex); }
+        else                 { printf("%s %s^{}\n", hex, name); }
+    }
+    return true;
+}
+
+/**
+ * diff_rename_score - Parses the threshold of -M<n>, as git's parse_rename_score().
+ *
+ * Digits are a fraction ("5" and "50" are both 50%) unless a '%' follows them.
+ */
+static bool diff_rename_score(const char *value, uint32_t *score){
+    unsigned long num = 0, scale = 1;
+    bool dot = false;
+    for (; *value; value++){
+        if (!dot && *value == '.')                  { scale = 1; dot = true; }
+        else if (*value == '%')                     { scale = dot ? scale * 100 : 100; value++; break; }
+        else if (*value >= '0' && *value <= '9'){
+            if (scale < 100000) { scale *= 10; num = num * 10 + (unsigned long)(*value - '0'); }
+        }
+        else                                        { return false; }
+    }
+    *score = num >= scale ? DIFF_MAX_SCORE : (uint32_t)(DIFF_MAX_SCORE * num / scale);
+    return *value == '\0';
+}
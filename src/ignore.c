@@ -0,0 +1,362 @@
+/* ignore.c: .gitignore patterns */
+
+#include "ignore.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define WILD_MATCH              0
+#define WILD_NOMATCH            1
+#define WILD_ABORT_ALL          -1
+#define WILD_ABORT_TO_STARSTAR  -2
+
+/* Forward Declaration of static Functions */
+
+static int  dowild(const unsigned char *p, const unsigned char *text, const unsigned char *pattern);
+static bool class_match(const unsigned char **p, unsigned char c, bool *matched);
+static bool pattern_match(const IgnorePattern *pattern, const char *text, size_t len);
+
+/* Functions */
+
+/**
+ * ignore_list_new - Creates an empty pattern list.
+ *
+ * @param parent   Rules of the enclosing directory (or the global excludes),
+ *                 consulted when none of this list's patterns match; may be NULL.
+ * @param base     Directory the patterns apply to, relative to the top and
+ *                 ending in '/', or "" at the top. Copied.
+ * @param base_len Bytes of base.
+ * @return A heap-allocated IgnoreList.
+ * @note The caller is responsible for calling ignore_list_free(); parent
+ * must outlive the list.
+ */
+IgnoreList *ignore_list_new(const IgnoreList *parent, const char *base, size_t base_len){
+    IgnoreList *list = safe_calloc(sizeof(IgnoreList), 1);
+    list->parent = parent;
+    char *copy = arena_alloc(&list->arena, base_len + 1);
+    memcpy(copy, base, base_len);
+    copy[base_len] = '\0';
+    list->base = copy;
+    list->base_len = base_len;
+    return list;
+}
+
+/**
+ * ignore_list_read - Adds the patterns of an ignore file.
+ *
+ * @param list   The list.
+ * @param dir_fd Directory path is relative to, or AT_FDCWD.
+ * @param path   The file, e.g. ".gitignore" or ".git/info/exclude".
+ * @param sb     Receives the file's stat data, zeroed if it was not read; may be NULL.
+ * @return true if the file was read, false if it is missing or unreadable.
+ */
+bool ignore_list_read(IgnoreList *list, int dir_fd, const char *path, struct stat *sb){
+    struct stat local;
+    if (!sb) { sb = &local; }
+    memset(sb, 0, sizeof(*sb));
+    if (!list || !path) { return false; }
+
+    int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+
+    if (fstat(fd, sb) != 0 || !S_ISREG(sb->st_mode)){
+        memset(sb, 0, sizeof(*sb));
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)sb->st_size, len = 0;
+    char *buf = safe_malloc(size ? size : 1, 1);
+    while (len < size){
+        ssize_t n = read(fd, buf + len, size - len);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        len += (size_t)n;
+    }
+    close(fd);
+
+    for (size_t start = 0; start < len; ){
+        const char *nl = memchr(buf + start, '\n', len - start);
+        size_t end = nl ? (size_t)(nl - buf) : len;
+        ignore_list_add(list, buf + start, end - start);
+        start = end + 1;
+    }
+    free(buf);
+    return true;
+}
+
+/**
+ * ignore_list_add - Parses one line of an ignore file.
+ *
+ * Blank lines and '#' comments are skipped, unescaped trailing spaces
+ * dropped. A leading '!' negates, a trailing '/' restricts the pattern to
+ * directories, and a pattern without any other '/' matches the last path
+ * component at any depth below the list's base; otherwise it is anchored
+ * to the base (a leading '/' only anchors).
+ *
+ * @param list The list.
+ * @param line The line, without its newline; need not be NUL-terminated.
+ * @param len  Bytes of line.
+ */
+void ignore_list_add(IgnoreList *list, const char *line, size_t len){
+    if (!list || !line || len == 0 || line[0] == '#') { return; }
+
+    while (len && line[len - 1] == ' ' && !(len >= 2 && line[len - 2] == '\\')) { len--; }
+
+    uint32_t flags = 0;
+    if (len && line[0] == '!'){
+        flags |= IGNORE_NEGATE;
+        line++;
+        len--;
+    }
+    if (len && line[len - 1] == '/'){
+        flags |= IGNORE_DIR_ONLY;
+        len--;
+    }
+    if (!memchr(line, '/', len)){
+        flags |= IGNORE_BASENAME;
+    } else if (line[0] == '/'){
+        line++;
+        len--;
+    }
+    if (len == 0) { return; }
+
+    char *copy = arena_alloc(&list->arena, len + 1);
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+
+    if (strcspn(copy, "*?[\\") == len){
+        flags |= IGNORE_LITERAL;
+    } else if ((flags & IGNORE_BASENAME) && copy[0] == '*' && len > 1 && strcspn(copy + 1, "*?[\\") == len - 1){
+        flags |= IGNORE_SUFFIX;
+    }
+
+    if (list->count == list->capacity){
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->patterns = realloc(list->patterns, list->capacity * sizeof(IgnorePattern));
+        MALLOC_CHECK(list->patterns);
+    }
+    list->patterns[list->count++] = (IgnorePattern){ copy, (uint32_t)len, flags };
+}
+
+/**
+ * ignore_path - Decides whether a path is ignored.
+ *
+ * Lists are consulted from the innermost outwards and, within a list, the
+ * last matching pattern wins, as in git. Lists whose base the path is not
+ * below are skipped.
+ *
+ * @param list   Rules of the directory containing the path.
+ * @param path   Path relative to the top, NUL-terminated.
+ * @param len    Bytes of path.
+ * @param is_dir Whether the path is a directory.
+ * @return true if the last matching pattern excludes the path.
+ */
+bool ignore_path(const IgnoreList *list, const char *path, size_t len, bool is_dir){
+    if (!path) { return false; }
+
+    size_t name_off = len;
+    while (name_off && path[name_off - 1] != '/') { name_off--; }
+    const char *name = path + name_off;
+    size_t name_len = len - name_off;
+
+    for (; list; list = list->parent){
+        if (list->base_len && (len <= list->base_len || memcmp(path, list->base, list->base_len) != 0)) { continue; }
+
+        for (size_t i = list->count; i-- > 0; ){
+            const IgnorePattern *pattern = &list->patterns[i];
+            if ((pattern->flags & IGNORE_DIR_ONLY) && !is_dir) { continue; }
+
+            bool match = pattern->flags & IGNORE_BASENAME ? pattern_match(pattern, name, name_len) :
+                         pattern_match(pattern, path + list->base_len, len - list->base_len);
+            if (match) { return !(pattern->flags & IGNORE_NEGATE); }
+        }
+    }
+    return false;
+}
+
+/**
+ * wildmatch - Matches a path against a glob as git's wildmatch does with WM_PATHNAME.
+ *
+ * '*' and '?' do not match '/', "**" between slashes (or at either end)
+ * matches any number of directories, "[...]" classes support ranges, '!'
+ * or '^' negation and [:alpha:]-style names, and '\' quotes the next
+ * character.
+ *
+ * @param pattern The glob, NUL-terminated.
+ * @param text    The path, NUL-terminated.
+ * @return true if the whole text matches.
+ */
+bool wildmatch(const char *pattern, const char *text){
+    if (!pattern || !text) { return false; }
+    return dowild((const unsigned char *)pattern, (const unsigned char *)text, (const unsigned char *)pattern) == WILD_MATCH;
+}
+
+/**
+ * ignore_list_free - Releases a pattern list (not its parents).
+ *
+ * @param list The list; may be NULL.
+ */
+void ignore_list_free(IgnoreList *list){
+    if (!list) { return; }
+
+    free(list->patterns);
+    arena_clear(&list->arena);
+    free(list);
+}
+
+/* Static Functions */
+
+/**
+ * dowild - Recursive core of wildmatch().
+ *
+ * @param p       Current position in the pattern.
+ * @param text    Current position in the text.
+ * @param pattern Start of the pattern, to tell whether "**" follows a slash.
+ * @return WILD_MATCH, WILD_NOMATCH, or one of the abort codes that stop
+ * outer '*' loops from retrying pointlessly.
+ */
+static int dowild(const unsigned char *p, const unsigned char *text, const unsigned char *pattern){
+    for (; *p; text++, p++){
+        unsigned char t = *text;
+        if (t == '\0' && *p != '*') { return WILD_ABORT_ALL; }
+
+        switch (*p){
+            case '\\':
+                p++;
+                if (t != *p) { return WILD_NOMATCH; }
+                continue;
+
+            case '?':
+                if (t == '/') { return WILD_NOMATCH; }
+                continue;
+
+            case '*': {
+                bool match_slash = false;
+                if (*++p == '*'){
+                    const unsigned char *prev = p - 2;
+                    while (*++p == '*') { }
+                    if ((prev < pattern || *prev == '/') && (*p == '\0' || *p == '/' || (p[0] == '\\' && p[1] == '/'))){
+                        if (p[0] == '/' && dowild(p + 1, text, pattern) == WILD_MATCH) { return WILD_MATCH; }
+                        match_slash = true;
+                    }
+                }
+
+                if (*p == '\0'){
+                    return match_slash || !strchr((const char *)text, '/') ? WILD_MATCH : WILD_NOMATCH;
+                }
+                if (!match_slash && *p == '/'){
+                    const char *slash = strchr((const char *)text, '/');
+                    if (!slash) { return WILD_NOMATCH; }
+                    text = (const unsigned char *)slash;
+                    break;
+                }
+
+                for (;;){
+                    if (t == '\0') { break; }
+                    if (!strchr("*?[\\", *p)){
+                        while ((t = *text) != '\0' && (match_slash || t != '/') && t != *p) { text++; }
+                        if (t != *p) { return WILD_NOMATCH; }
+                    }
+                    int matched = dowild(p, text, pattern);
+                    if (matched != WILD_NOMATCH){
+                        if (!match_slash || matched != WILD_ABORT_TO_STARSTAR) { return matched; }
+                    } else if (!match_slash && t == '/'){
+                        return WILD_ABORT_TO_STARSTAR;
+                    }
+                    t = *++text;
+                }
+                return WILD_ABORT_ALL;
+            }
+
+            case '[': {
+                unsigned char c = *++p;
+                bool negated = c == '!' || c == '^';
+                if (negated) { c = *++p; }
+
+                bool matched = false;
+                unsigned char prev = 0;
+                do {
+                    if (!c) { return WILD_ABORT_ALL; }
+                    if (c == '\\'){
+                        c = *++p;
+                        if (!c) { return WILD_ABORT_ALL; }
+                        if (t == c) { matched = true; }
+                    } else if (c == '-' && prev && p[1] && p[1] != ']'){
+                        c = *++p;
+                        if (c == '\\' && !(c = *++p)) { return WILD_ABORT_ALL; }
+                        if (t >= prev && t <= c) { matched = true; }
+                        c = 0;
+                    } else if (c == '[' && p[1] == ':'){
+                        if (!class_match(&p, t, &matched)) { return WILD_ABORT_ALL; }
+                        c = 0;
+                    } else if (t == c){
+                        matched = true;
+                    }
+                    prev = c;
+                } while ((c = *++p) != ']');
+
+                if (matched == negated || t == '/') { return WILD_NOMATCH; }
+                continue;
+            }
+
+            default:
+                if (t != *p) { return WILD_NOMATCH; }
+                continue;
+        }
+    }
+    return *text ? WILD_NOMATCH : WILD_MATCH;
+}
+
+/**
+ * class_match - Matches a "[:name:]" character class inside a bracket expression.
+ *
+ * @param p       At the '[' of the class; left on its closing ']'.
+ * @param c       The text character.
+ * @param matched Set when c belongs to the class.
+ * @return false for an unterminated or unknown class.
+ */
+static bool class_match(const unsigned char **p, unsigned char c, bool *matched){
+    const char *name = (const char *)*p + 2;
+    const char *end = strstr(name, ":]");
+    if (!end) { return false; }
+
+    static const struct { const char *name; int (*fn)(int); } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank }, { "cntrl", iscntrl },
+        { "digit", isdigit }, { "graph", isgraph }, { "lower", islower }, { "print", isprint },
+        { "punct", ispunct }, { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    size_t len = (size_t)(end - name);
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++){
+        if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0){
+            if (classes[i].fn(c)) { *matched = true; }
+            *p = (const unsigned char *)end + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * pattern_match - Matches one pattern against a component or a base-relative path.
+ */
+static bool pattern_match(const IgnorePattern *pattern, const char *text, size_t len){
+    if (pattern->flags & IGNORE_LITERAL){
+        return len == pattern->len && memcmp(text, pattern->pattern, len) == 0;
+    }
+    if (pattern->flags & IGNORE_SUFFIX){
+        size_t tail = pattern->len - 1;
+        return len >= tail && memcmp(text + len - tail, pattern->pattern + 1, tail) == 0;
+    }
+    return wildmatch(pattern->pattern, text);
+}
@@ -0,0 +1,1035 @@
+/* index.c: .git/index reader and writer */
+
+#include "index.h"
+#include "config.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define INDEX_LOCK          "index.lock"
+#define INDEX_WRITE_BUFFER  (128 * 1024)
+#define INDEX_VARINT_MAX    16
+
+/* Structures */
+
+typedef struct {
+    size_t offset;          /* of the block's first entry */
+    size_t end;             /* offset of the next block, or entries_end */
+    size_t first;           /* position of the first entry in Index.entries */
+    size_t count;
+} IndexBlock;
+
+typedef struct {
+    Index      *index;
+    IndexBlock *blocks;
+    bool       *ok;
+} DecodeJob;
+
+typedef struct {
+    unsigned char *data;
+    size_t        len;
+    size_t        capacity;
+} IndexBuffer;
+
+typedef struct {
+    int           fd;
+    Sha1Context   sha;
+    unsigned char buf[INDEX_WRITE_BUFFER];
+    size_t        used;
+    size_t        offset;   /* bytes emitted so far, buffered ones included */
+    bool          failed;
+} IndexWriter;
+
+/* Forward Declaration of static Functions */
+
+static size_t decode_entries(Index *index, const IndexBlock *block, Arena *arena);
+static void   decode_job(void *ctx, size_t index);
+static bool   decode_parallel(Index *index, const unsigned char *ieot, size_t ieot_len, size_t entries_end, size_t threads);
+static size_t read_eoie(const Index *index, const unsigned char **ieot, size_t *ieot_len);
+static bool   read_extensions(Index *index);
+static IndexTree *tree_read(Index *index, const unsigned char **pos, const unsigned char *end, size_t depth);
+static void   tree_invalidate(IndexTree *tree, const char *name, size_t len);
+static IndexTree *tree_child(const IndexTree *tree, const char *name, size_t len);
+static void   tree_write(IndexBuffer *buf, const IndexTree *tree);
+static void   buffer_put(IndexBuffer *buf, const void *data, size_t len);
+static bool   decode_varint(const unsigned char *map, size_t *pos, size_t end, uint64_t *value);
+static size_t encode_varint(uint64_t value, unsigned char *buf);
+static size_t index_pos(const Index *index, const char *name, size_t len, int stage, bool *found);
+static size_t index_threads(const Repository *repo);
+static void   writer_put(IndexWriter *writer, const void *data, size_t len);
+static bool   writer_flush(IndexWriter *writer);
+static void   writer_entry(IndexWriter *writer, const IndexEntry *entry, uint32_t version, const IndexEntry *prev, bool block_start);
+
+/* Functions */
+
+/**
+ * index_read - Loads the repository's index.
+ *
+ * The thread count comes from index.threads (a number, 0 or true for one per
+ * CPU, false for a serial decode), as in git.
+ *
+ * @param repo The repository.
+ * @return The index, an empty one if .git/index does not exist yet, or NULL
+ * if it exists but is malformed.
+ * @note The caller is responsible for calling index_free().
+ */
+Index *index_read(Repository *repo){
+    if (!repo) { return NULL; }
+
+    char path[MAX_PATH];
+    if (!repo_path_buf(repo, path, sizeof(path), "index", NULL)) { return NULL; }
+    if (!file_exists(path)) { return index_new(); }
+    return index_open(path, index_threads(repo));
+}
+
+/**
+ * index_open - Maps and decodes an index file.
+ *
+ * The entries are decoded straight out of the mapping: for v2 and v3 the
+ * names point into it, for v4 they are rebuilt from their prefix-compressed
+ * form into arenas. When the file ends with a valid EOIE extension that
+ * leads to an IEOT (index entry offset table), each IEOT block is decoded
+ * by its own worker; the first v4 name of a block shares no prefix with
+ * the entry before it, which git guarantees when writing one. Without one, or with threads <= 1, the entries are
+ * decoded in a single pass. The cache-tree (TREE) is loaded; other
+ * optional extensions are skipped and unknown required ones (lowercase
+ * signature) are an error. The trailing checksum
+ * is not verified here, see index_verify().
+ *
+ * @param path    Path of the index file.
+ * @param threads Workers for the entry decode.
+ * @return A heap-allocated Index, or NULL if the file is missing or malformed.
+ * @note The caller is responsible for calling index_free().
+ */
+Index *index_open(const char *path, size_t threads){
+    if (!path) { return NULL; }
+
+    Index *index = index_new();
+    index->map = map_file(path, &index->size);
+    if (!index->map) { goto fail; }
+
+    struct stat sb;
+    if (stat(path, &sb) == 0) { index->mtime = sb.st_mtim; }
+
+    const unsigned char *map = index->map;
+    if (index->size < INDEX_HEADER_SIZE + SHA_SIZE || get_be32(map) != INDEX_SIGNATURE){
+        fprintf(stderr, "index_open: %s: bad signature\n", path);
+        goto fail;
+    }
+    memcpy(index->checksum, map + index->size - SHA_SIZE, SHA_SIZE);
+    index->version = get_be32(map + 4);
+    if (index->version < 2 || index->version > 4){
+        fprintf(stderr, "index_open: %s: unsupported version %u\n", path, index->version);
+        goto fail;
+    }
+    size_t count = get_be32(map + 8);
+    if (count > (index->size - INDEX_HEADER_SIZE - SHA_SIZE) / INDEX_ENTRY_FIXED){
+        fprintf(stderr, "index_open: %s: entry count %zu does not fit the file\n", path, count);
+        goto fail;
+    }
+
+    index->entries = safe_malloc(sizeof(IndexEntry), count ? count : 1);
+    index->count = index->capacity = count;
+
+    const unsigned char *ieot = NULL;
+    size_t ieot_len = 0;
+    size_t entries_end = read_eoie(index, &ieot, &ieot_len);
+
+    if (threads > 1 && ieot && decode_parallel(index, ieot, ieot_len, entries_end, threads)){
+        index->entries_end = entries_end;
+    } else {
+        IndexBlock all = { INDEX_HEADER_SIZE, index->size - SHA_SIZE, 0, count };
+        index->entries_end = decode_entries(index, &all, &index->arena);
+        if (!index->entries_end || (entries_end && index->entries_end != entries_end)){
+            fprintf(stderr, "index_open: %s: corrupt entries\n", path);
+            goto fail;
+        }
+    }
+
+    if (!read_extensions(index)){
+        fprintf(stderr, "index_open: %s: corrupt or unsupported extension\n", path);
+        goto fail;
+    }
+    return index;
+
+fail:
+    index_free(index);
+    return NULL;
+}
+
+/**
+ * index_new - Creates an empty index.
+ *
+ * @return A heap-allocated Index with no entries; written as version 2
+ * unless extended flags require version 3.
+ * @note The caller is responsible for calling index_free().
+ */
+Index *index_new(void){ return safe_calloc(sizeof(Index), 1); }
+
+/**
+ * index_write - Writes an index to .git/index.
+ *
+ * The file is written to index.lock and renamed over the index, so readers
+ * never see a partial file and a concurrent writer fails on the lock. The
+ * version of the index read is kept (v2 is bumped to v3 when an entry has
+ * extended flags), and so is the cache-tree with the paths index_add()
+ * touched invalidated. Indexes larger than one INDEX_IEOT_BLOCK get an IEOT
+ * and an EOIE extension so the next read can decode in parallel; other
+ * extensions of the file read are not carried over.
+ *
+ * @param repo  The repository.
+ * @param index The index; entries must be sorted, as index_add() keeps them.
+ * Its checksum is updated to the new file's.
+ * @return true on success, false on error (the lock is removed).
+ */
+bool index_write(Repository *repo, Index *index){
+    if (!repo || !index) { return false; }
+
+    int dir_fd = repo_gitdir_fd(repo);
+    if (dir_fd < 0) { return false; }
+
+    IndexWriter *writer = safe_malloc(sizeof(IndexWriter), 1);
+    writer->fd = openat(dir_fd, INDEX_LOCK, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (writer->fd < 0){
+        if (errno == EEXIST){
+            fprintf(stderr, "index_write: %s/%s exists; is another process running?\n", repo->gitdir, INDEX_LOCK);
+        } else {
+            fprintf(stderr, "index_write: cannot create %s: %s\n", INDEX_LOCK, strerror(errno));
+        }
+        free(writer);
+        return false;
+    }
+    sha1_init(&writer->sha);
+    writer->used = writer->offset = 0;
+    writer->failed = false;
+
+    uint32_t version = index->version ? index->version : 2;
+    for (size_t i = 0; version == 2 && i < index->count; i++){
+        if (index->entries[i].flags_extended) { version = 3; }
+    }
+
+    unsigned char header[INDEX_HEADER_SIZE];
+    put_be32(header, INDEX_SIGNATURE);
+    put_be32(header + 4, version);
+    put_be32(header + 8, (uint32_t)index->count);
+    writer_put(writer, header, sizeof(header));
+
+    IndexBuffer tree = { 0 };
+    if (index->cache_tree) { tree_write(&tree, index->cache_tree); }
+
+    size_t blocks = (index->count + INDEX_IEOT_BLOCK - 1) / INDEX_IEOT_BLOCK;
+    unsigned char *ieot = blocks > 1 ? safe_malloc(4 + 8 * blocks, 1) : NULL;
+    if (ieot) { put_be32(ieot, INDEX_IEOT_VERSION); }
+
+    for (size_t i = 0; i < index->count; i++){
+        if (ieot && i % INDEX_IEOT_BLOCK == 0){
+            size_t block = i / INDEX_IEOT_BLOCK;
+            size_t n = index->count - i < INDEX_IEOT_BLOCK ? index->count - i : INDEX_IEOT_BLOCK;
+            put_be32(ieot + 4 + 8 * block, (uint32_t)writer->offset);
+            put_be32(ieot + 8 + 8 * block, (uint32_t)n);
+        }
+        bool block_start = ieot && i % INDEX_IEOT_BLOCK == 0;
+        writer_entry(writer, &index->entries[i], version, i ? &index->entries[i - 1] : NULL, block_start);
+    }
+
+    unsigned char ext[INDEX_EXT_HEADER + INDEX_EOIE_SIZE];
+    uint32_t entries_end = (uint32_t)writer->offset;
+    Sha1Context eoie;
+    sha1_init(&eoie);
+
+    if (index->cache_tree){
+        memcpy(ext, "TREE", 4);
+        put_be32(ext + 4, (uint32_t)tree.len);
+        writer_put(writer, ext, INDEX_EXT_HEADER);
+        writer_put(writer, tree.data, tree.len);
+        sha1_update(&eoie, ext, INDEX_EXT_HEADER);
+        free(tree.data);
+    }
+
+    if (ieot){
+        size_t ieot_len = 4 + 8 * blocks;
+        memcpy(ext, "IEOT", 4);
+        put_be32(ext + 4, (uint32_t)ieot_len);
+        writer_put(writer, ext, INDEX_EXT_HEADER);
+        writer_put(writer, ieot, ieot_len);
+        sha1_update(&eoie, ext, INDEX_EXT_HEADER);
+
+        memcpy(ext, "EOIE", 4);
+        put_be32(ext + 4, INDEX_EOIE_SIZE);
+        put_be32(ext + 8, entries_end);
+        sha1_final(&eoie, ext + 12);
+        writer_put(writer, ext, sizeof(ext));
+        free(ieot);
+    }
+
+    unsigned char trailer[SHA_SIZE];
+    bool status = writer_flush(writer);
+    if (status){
+        sha1_final(&writer->sha, trailer);
+        status = write_all(writer->fd, trailer, SHA_SIZE);
+    }
+    if (status) { memcpy(index->checksum, trailer, SHA_SIZE); }
+    if (close(writer->fd) != 0) { status = false; }
+    if (status && renameat(dir_fd, INDEX_LOCK, dir_fd, "index") != 0){
+        fprintf(stderr, "index_write: cannot rename %s: %s\n", INDEX_LOCK, strerror(errno));
+        status = false;
+    }
+    if (!status){
+        if (writer->failed) { fprintf(stderr, "index_write: write failed: %s\n", strerror(errno)); }
+        unlinkat(dir_fd, INDEX_LOCK, 0);
+    }
+
+    free(writer);
+    return status;
+}
+
+/**
+ * index_verify - Checks the trailing SHA-1 of a mapped index.
+ *
+ * @param index An index returned by index_open().
+ * @return true if the checksum matches or is all zeros (index.skipHash),
+ * false otherwise or for an index that was not read from a file.
+ */
+bool index_verify(const Index *index){
+    if (!index || !index->map) { return false; }
+
+    const unsigned char *stored = index->map + index->size - SHA_SIZE;
+    static const unsigned char null_sha[SHA_SIZE];
+    if (memcmp(stored, null_sha, SHA_SIZE) == 0) { return true; }
+
+    unsigned char sha[SHA_SIZE];
+    sha1_buffer(index->map, index->size - SHA_SIZE, sha);
+    return memcmp(sha, stored, SHA_SIZE) == 0;
+}
+
+/**
+ * index_find - Looks up an entry by path and stage.
+ *
+ * @param index The index.
+ * @param name  Path relative to the top of the worktree, not NUL-terminated.
+ * @param len   Bytes of name.
+ * @param stage 0 for a merged entry, 1-3 for a conflict side.
+ * @return The entry, or NULL if there is none.
+ */
+IndexEntry *index_find(const Index *index, const char *name, size_t len, int stage){
+    if (!index || !name) { return NULL; }
+
+    bool found;
+    size_t pos = index_pos(index, name, len, stage, &found);
+    return found ? &index->entries[pos] : NULL;
+}
+
+/**
+ * index_add - Adds or replaces an entry, keeping the index sorted.
+ *
+ * The name is copied into the index's arena unless the entry replaces one
+ * of the same path. Cache-tree nodes above the path are invalidated. Adding a stage 0 entry drops the conflict stages of the
+ * same path, which is how git marks a conflict resolved.
+ *
+ * @param index The index.
+ * @param entry The entry; its name need not outlive the call.
+ * @return The entry as stored in the index, valid until the next index_add().
+ */
+IndexEntry *index_add(Index *index, const IndexEntry *entry){
+    if (!index || !entry || !entry->name) { return NULL; }
+
+    int stage = index_entry_stage(entry);
+    bool found;
+    size_t pos = index_pos(index, entry->name, entry->name_len, stage, &found);
+    if (index->cache_tree) { tree_invalidate(index->cache_tree, entry->name, entry->name_len); }
+
+    if (found){
+        const char *name = index->entries[pos].name;
+        index->entries[pos] = *entry;
+        index->entries[pos].name = name;
+        return &index->entries[pos];
+    }
+
+    if (stage == 0){
+        size_t end = pos;
+        while (end < index->count && index->entries[end].name_len == entry->name_len &&
+               memcmp(index->entries[end].name, entry->name, entry->name_len) == 0){
+            end++;
+        }
+        if (end > pos){
+            memmove(&index->entries[pos], &index->entries[end], (index->count - end) * sizeof(IndexEntry));
+            index->count -= end - pos;
+        }
+    }
+
+    if (index->count == index->capacity){
+        index->capacity = index->capacity ? index->capacity * 2 : 64;
+        index->entries = realloc(index->entries, index->capacity * sizeof(IndexEntry));
+        MALLOC_CHECK(index->entries);
+    }
+    memmove(&index->entries[pos + 1], &index->entries[pos], (index->count - pos) * sizeof(IndexEntry));
+    index->count++;
+
+    char *name = arena_alloc(&index->arena, entry->name_len + 1);
+    memcpy(name, entry->name, entry->name_len);
+    name[entry->name_len] = '\0';
+    index->entries[pos] = *entry;
+    index->entries[pos].name = name;
+    return &index->entries[pos];
+}
+
+/**
+ * index_position - Finds where a path is, or would be, in the index.
+ *
+ * @param index The index.
+ * @param name  Path (or path prefix) relative to the top.
+ * @param len   Bytes of name.
+ * @return Position of the first entry not ordered before name at stage 0;
+ * index->count if there is none.
+ */
+size_t index_position(const Index *index, const char *name, size_t len){
+    if (!index || !name) { return 0; }
+
+    bool found;
+    return index_pos(index, name, len, 0, &found);
+}
+
+/**
+ * index_has_path - Checks whether a path has an entry at any stage.
+ *
+ * @param index The index.
+ * @param name  Path relative to the top of the worktree.
+ * @param len   Bytes of name.
+ * @return true if the path is tracked (merged or conflicted).
+ */
+bool index_has_path(const Index *index, const char *name, size_t len){
+    if (!index || !name) { return false; }
+
+    bool found;
+    size_t pos = index_pos(index, name, len, 0, &found);
+    return found || (pos < index->count && index->entries[pos].name_len == len && memcmp(index->entries[pos].name, name, len) == 0);
+}
+
+/**
+ * index_has_dir - Checks whether any entry lies below a directory.
+ *
+ * @param index The index.
+ * @param dir   Directory relative to the top, without a trailing slash; "" for the top.
+ * @param len   Bytes of dir.
+ * @return true if some entry's path starts with "dir/".
+ */
+bool index_has_dir(const Index *index, const char *dir, size_t len){
+    if (!index || !dir) { return false; }
+    if (len == 0) { return index->count > 0; }
+
+    char prefix[MAX_PATH];
+    if (len + 1 >= sizeof(prefix)) { return false; }
+    memcpy(prefix, dir, len);
+    prefix[len] = '/';
+
+    size_t pos = index_position(index, prefix, len + 1);
+    return pos < index->count && index->entries[pos].name_len > len + 1 && memcmp(index->entries[pos].name, prefix, len + 1) == 0;
+}
+
+/**
+ * index_tree_find - Looks up the cache-tree node of a directory.
+ *
+ * @param index The index.
+ * @param dir   Directory relative to the top, without a trailing slash; "" for the top.
+ * @param len   Bytes of dir.
+ * @return The node, or NULL if there is no cache-tree or no node for dir.
+ * A node with entry_count < 0 exists but is invalid.
+ */
+const IndexTree *index_tree_find(const Index *index, const char *dir, size_t len){
+    if (!index || !dir) { return NULL; }
+
+    const IndexTree *tree = index->cache_tree;
+    while (tree && len){
+        const char *slash = memchr(dir, '/', len);
+        size_t part = slash ? (size_t)(slash - dir) : len;
+        tree = tree_child(tree, dir, part);
+        dir += part + (slash ? 1 : 0);
+        len -= part + (slash ? 1 : 0);
+    }
+    return tree;
+}
+
+/**
+ * index_entry_set_stat - Fills the stat data and mode of an entry.
+ *
+ * Fields are truncated to 32 bits as on disk. Regular files get 100755 if
+ * the owner may execute them and 100644 otherwise.
+ *
+ * @param entry The entry to update.
+ * @param sb    lstat() of the worktree file.
+ */
+void index_entry_set_stat(IndexEntry *entry, const struct stat *sb){
+    entry->ctime_sec  = (uint32_t)sb->st_ctim.tv_sec;
+    entry->ctime_nsec = (uint32_t)sb->st_ctim.tv_nsec;
+    entry->mtime_sec  = (uint32_t)sb->st_mtim.tv_sec;
+    entry->mtime_nsec = (uint32_t)sb->st_mtim.tv_nsec;
+    entry->dev  = (uint32_t)sb->st_dev;
+    entry->ino  = (uint32_t)sb->st_ino;
+    entry->uid  = (uint32_t)sb->st_uid;
+    entry->gid  = (uint32_t)sb->st_gid;
+    entry->size = (uint32_t)sb->st_size;
+
+    if (S_ISLNK(sb->st_mode)){
+        entry->mode = 0120000;
+    } else if (S_ISDIR(sb->st_mode)){
+        entry->mode = 0160000;
+    } else {
+        entry->mode = (sb->st_mode & S_IXUSR) ? 0100755 : 0100644;
+    }
+}
+
+/**
+ * index_entry_stat_matches - Checks whether a file still has the stat data recorded.
+ *
+ * A match means the file is assumed unchanged without reading it. Files
+ * modified within the same second as the index write ("racily clean") can
+ * still match; callers that care compare against the index mtime.
+ *
+ * @param entry The index entry.
+ * @param sb    lstat() of the worktree file.
+ * @return true if type, size, times, inode and owner all match.
+ */
+bool index_entry_stat_matches(const IndexEntry *entry, const struct stat *sb){
+    IndexEntry now = { 0 };
+    index_entry_set_stat(&now, sb);
+
+    return (now.mode & 0170000) == (entry->mode & 0170000) && now.size == entry->size &&
+           now.mtime_sec == entry->mtime_sec && now.mtime_nsec == entry->mtime_nsec &&
+           now.ctime_sec == entry->ctime_sec && now.ctime_nsec == entry->ctime_nsec &&
+           now.ino == entry->ino && now.dev == entry->dev && now.uid == entry->uid && now.gid == entry->gid;
+}
+
+/**
+ * index_name_compare - Orders index entries by path bytes, then path length, then stage.
+ *
+ * @return Negative, zero or positive like memcmp().
+ */
+int index_name_compare(const char *a, size_t a_len, int a_stage, const char *b, size_t b_len, int b_stage){
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (cmp) { return cmp; }
+    if (a_len != b_len) { return a_len < b_len ? -1 : 1; }
+    return a_stage - b_stage;
+}
+
+/**
+ * index_free - Releases an index and its mapping.
+ *
+ * @param index The index; may be NULL.
+ */
+void index_free(Index *index){
+    if (!index) { return; }
+
+    if (index->map) { munmap((void *)index->map, index->size); }
+    if (index->block_arenas){
+        for (size_t i = 0; i < index->blocks; i++){
+            arena_clear(&index->block_arenas[i]);
+        }
+        free(index->block_arenas);
+    }
+    arena_clear(&index->arena);
+    free(index->entries);
+    free(index);
+}
+
+/* Static Functions */
+
+/**
+ * decode_entries - Decodes a run of consecutive on-disk entries.
+ *
+ * @param index The index being read; entries[block->first...] are filled.
+ * @param block Where the run starts, where it must stay within and how many entries it holds.
+ * @param arena Arena for v4 names; only this caller may use it.
+ * @return Offset just past the last entry, or 0 if an entry is malformed.
+ */
+static size_t decode_entries(Index *index, const IndexBlock *block, Arena *arena){
+    const unsigned char *map = index->map;
+    size_t offset = block->offset, end = block->end;
+    const char *prev = "";
+    size_t prev_len = 0;
+
+    for (size_t i = 0; i < block->count; i++){
+        if (end - offset < INDEX_ENTRY_FIXED) { return 0; }
+
+        const unsigned char *p = map + offset;
+        IndexEntry *entry = &index->entries[block->first + i];
+        entry->ctime_sec  = get_be32(p);
+        entry->ctime_nsec = get_be32(p + 4);
+        entry->mtime_sec  = get_be32(p + 8);
+        entry->mtime_nsec = get_be32(p + 12);
+        entry->dev  = get_be32(p + 16);
+        entry->ino  = get_be32(p + 20);
+        entry->mode = get_be32(p + 24);
+        entry->uid  = get_be32(p + 28);
+        entry->gid  = get_be32(p + 32);
+        entry->size = get_be32(p + 36);
+        memcpy(entry->sha, p + 40, SHA_SIZE);
+        entry->flags = get_be16(p + 60);
+        entry->flags_extended = 0;
+
+        size_t pos = offset + INDEX_ENTRY_FIXED;
+        if (entry->flags & INDEX_FLAG_EXTENDED){
+            if (index->version < 3 || end - pos < 2) { return 0; }
+            entry->flags_extended = get_be16(map + pos);
+            pos += 2;
+        }
+
+        uint64_t strip = 0;
+        if (index->version == 4 && !decode_varint(map, &pos, end, &strip)) { return 0; }
+        if (i == 0) { strip = 0; }
+        if (strip > prev_len) { return 0; }
+
+        const unsigned char *nul = memchr(map + pos, '\0', end - pos);
+        if (!nul) { return 0; }
+        size_t tail = (size_t)(nul - (map + pos));
+
+        if (index->version == 4){
+            size_t keep = prev_len - (size_t)strip;
+            char *name = arena_alloc(arena, keep + tail + 1);
+            memcpy(name, prev, keep);
+            memcpy(name + keep, map + pos, tail + 1);
+            entry->name = prev = name;
+            entry->name_len = (uint32_t)(prev_len = keep + tail);
+            offset = pos + tail + 1;
+        } else {
+            size_t size = (pos - offset + tail + 8) & ~(size_t)7;
+            if (size > end - offset) { return 0; }
+            entry->name = (const char *)(map + pos);
+            entry->name_len = (uint32_t)tail;
+            offset += size;
+        }
+
+        size_t flag_len = entry->flags & INDEX_NAME_MASK;
+        if (entry->name_len == 0 || (flag_len < INDEX_NAME_MASK && flag_len != entry->name_len) ||
+            (flag_len == INDEX_NAME_MASK && entry->name_len < INDEX_NAME_MASK)){
+            return 0;
+        }
+    }
+    return offset;
+}
+
+/**
+ * decode_job - Worker job decoding one IEOT block.
+ *
+ * @param ctx   The DecodeJob.
+ * @param index Index of the block.
+ */
+static void decode_job(void *ctx, size_t index){
+    DecodeJob *job = ctx;
+    const IndexBlock *block = &job->blocks[index];
+    Arena *arena = job->index->block_arenas ? &job->index->block_arenas[index] : NULL;
+    job->ok[index] = decode_entries(job->index, block, arena) == block->end;
+}
+
+/**
+ * decode_parallel - Decodes the entries block by block as listed in the IEOT.
+ *
+ * The table must start at the first entry, ascend, stay below entries_end
+ * and account for exactly the header's entry count; each block must end
+ * exactly where the next begins.
+ *
+ * @param index       The index being read.
+ * @param ieot        IEOT payload.
+ * @param ieot_len    Bytes of payload.
+ * @param entries_end Offset of the first extension, from EOIE.
+ * @param threads     Workers to use.
+ * @return true if every block decoded, false to fall back to a serial decode.
+ */
+static bool decode_parallel(Index *index, const unsigned char *ieot, size_t ieot_len, size_t entries_end, size_t threads){
+    if (ieot_len < 4 || (ieot_len - 4) % 8 != 0 || get_be32(ieot) != INDEX_IEOT_VERSION) { return false; }
+
+    size_t count = (ieot_len - 4) / 8;
+    if (count < 2) { return false; }
+
+    IndexBlock *blocks = safe_malloc(sizeof(IndexBlock), count);
+    size_t first = 0;
+    bool valid = true;
+    for (size_t i = 0; i < count && valid; i++){
+        blocks[i].offset = get_be32(ieot + 4 + 8 * i);
+        blocks[i].count = get_be32(ieot + 8 + 8 * i);
+        blocks[i].first = first;
+        first += blocks[i].count;
+        valid = first <= index->count && blocks[i].offset < entries_end &&
+                (i ? blocks[i].offset > blocks[i - 1].offset : blocks[i].offset == INDEX_HEADER_SIZE);
+        if (i) { blocks[i - 1].end = blocks[i].offset; }
+    }
+    if (!valid || first != index->count){
+        free(blocks);
+        return false;
+    }
+    blocks[count - 1].end = entries_end;
+
+    if (index->version == 4) { index->block_arenas = safe_calloc(sizeof(Arena), count); }
+    index->blocks = count;
+
+    DecodeJob job = { index, blocks, safe_calloc(sizeof(bool), count) };
+    bool status = workers_run(threads, count, decode_job, &job);
+    for (size_t i = 0; i < count && status; i++){
+        status = job.ok[i];
+    }
+
+    if (!status){
+        for (size_t i = 0; index->block_arenas && i < count; i++){
+            arena_clear(&index->block_arenas[i]);
+        }
+        free(index->block_arenas);
+        index->block_arenas = NULL;
+        index->blocks = 0;
+    }
+    free(job.ok);
+    free(blocks);
+    return status;
+}
+
+/**
+ * read_eoie - Reads the end of index entries extension and finds the IEOT.
+ *
+ * EOIE is the last extension; it records where the entries end and a SHA-1
+ * over the signature and size of every extension before it, which is
+ * checked while walking them.
+ *
+ * @param index    The index being read.
+ * @param ieot     Output for the IEOT payload, NULL if there is none.
+ * @param ieot_len Output for the IEOT payload size.
+ * @return Offset of the first extension, or 0 if there is no valid EOIE.
+ */
+static size_t read_eoie(const Index *index, const unsigned char **ieot, size_t *ieot_len){
+    *ieot = NULL;
+    *ieot_len = 0;
+    if (index->size < INDEX_HEADER_SIZE + INDEX_EXT_HEADER + INDEX_EOIE_SIZE + SHA_SIZE) { return 0; }
+
+    const unsigned char *map = index->map;
+    size_t eoie = index->size - SHA_SIZE - INDEX_EXT_HEADER - INDEX_EOIE_SIZE;
+    if (memcmp(map + eoie, "EOIE", 4) != 0 || get_be32(map + eoie + 4) != INDEX_EOIE_SIZE) { return 0; }
+
+    size_t offset = get_be32(map + eoie + 8);
+    if (offset < INDEX_HEADER_SIZE || offset > eoie) { return 0; }
+
+    Sha1Context ctx;
+    sha1_init(&ctx);
+    const unsigned char *found = NULL;
+    size_t found_len = 0;
+    size_t pos = offset;
+    while (pos < eoie){
+        if (eoie - pos < INDEX_EXT_HEADER) { return 0; }
+        size_t len = get_be32(map + pos + 4);
+        if (len > eoie - pos - INDEX_EXT_HEADER) { return 0; }
+        if (memcmp(map + pos, "IEOT", 4) == 0){
+            found = map + pos + INDEX_EXT_HEADER;
+            found_len = len;
+        }
+        sha1_update(&ctx, map + pos, INDEX_EXT_HEADER);
+        pos += INDEX_EXT_HEADER + len;
+    }
+
+    unsigned char sha[SHA_SIZE];
+    sha1_final(&ctx, sha);
+    if (memcmp(sha, map + eoie + 12, SHA_SIZE) != 0) { return 0; }
+
+    *ieot = found;
+    *ieot_len = found_len;
+    return offset;
+}
+
+/**
+ * read_extensions - Validates the extension area after the entries and loads the cache-tree.
+ *
+ * @return true if every extension fits and is optional (uppercase signature),
+ * and a TREE extension present parses.
+ */
+static bool read_extensions(Index *index){
+    size_t pos = index->entries_end, end = index->size - SHA_SIZE;
+    while (pos < end){
+        if (end - pos < INDEX_EXT_HEADER) { return false; }
+        const unsigned char *sig = index->map + pos;
+        size_t len = get_be32(sig + 4);
+        if (len > end - pos - INDEX_EXT_HEADER) { return false; }
+        if (sig[0] < 'A' || sig[0] > 'Z'){
+            fprintf(stderr, "index_open: unsupported extension '%.4s'\n", (const char *)sig);
+            return false;
+        }
+        if (memcmp(sig, "TREE", 4) == 0 && len){
+            const unsigned char *p = sig + INDEX_EXT_HEADER, *ext_end = p + len;
+            index->cache_tree = tree_read(index, &p, ext_end, 0);
+            if (!index->cache_tree || p != ext_end) { return false; }
+        }
+        pos += INDEX_EXT_HEADER + len;
+    }
+    return pos == end;
+}
+
+/**
+ * tree_read - Parses one cache-tree node and its subtrees.
+ *
+ * Each node is "<name>\0<entry count> <subtree count>\n", then the tree SHA
+ * when the count is not negative, then its subtrees.
+ *
+ * @param index The index whose arena holds the nodes.
+ * @param pos   Cursor into the extension, advanced past the node.
+ * @param end   End of the extension.
+ * @param depth Nesting so far.
+ * @return The node, or NULL if it is malformed.
+ */
+static IndexTree *tree_read(Index *index, const unsigned char **pos, const unsigned char *end, size_t depth){
+    const unsigned char *p = *pos;
+    const unsigned char *nul = memchr(p, '\0', (size_t)(end - p));
+    const unsigned char *lf = nul ? memchr(nul, '\n', (size_t)(end - nul)) : NULL;
+    if (!lf || depth > INDEX_TREE_DEPTH) { return NULL; }
+
+    IndexTree *tree = arena_alloc(&index->arena, sizeof(IndexTree));
+    tree->name = (const char *)p;
+    tree->name_len = (uint32_t)(nul - p);
+
+    char counts[32];
+    size_t counts_len = (size_t)(lf - nul - 1);
+    if (counts_len >= sizeof(counts)) { return NULL; }
+    memcpy(counts, nul + 1, counts_len);
+    counts[counts_len] = '\0';
+    long entries;
+    unsigned long children;
+    char *rest;
+    entries = strtol(counts, &rest, 10);
+    if (rest == counts || *rest != ' ' || entries < -1 || entries > INT32_MAX) { return NULL; }
+    children = strtoul(rest + 1, &rest, 10);
+    if (*rest != '\0' || children > (size_t)(end - lf)) { return NULL; }
+    tree->entry_count = (int32_t)entries;
+
+    p = lf + 1;
+    if (entries >= 0){
+        if ((size_t)(end - p) < SHA_SIZE) { return NULL; }
+        memcpy(tree->sha, p, SHA_SIZE);
+        p += SHA_SIZE;
+    }
+
+    tree->child_count = children;
+    tree->children = children ? arena_alloc(&index->arena, children * sizeof(IndexTree *)) : NULL;
+    for (size_t i = 0; i < children; i++){
+        tree->children[i] = tree_read(index, &p, end, depth + 1);
+        if (!tree->children[i]) { return NULL; }
+    }
+    *pos = p;
+    return tree;
+}
+
+/**
+ * tree_invalidate - Marks every cache-tree node on the way to a path invalid.
+ */
+static void tree_invalidate(IndexTree *tree, const char *name, size_t len){
+    while (tree){
+        tree->entry_count = -1;
+        const char *slash = memchr(name, '/', len);
+        if (!slash) { return; }
+        size_t part = (size_t)(slash - name);
+        tree = tree_child(tree, name, part);
+        name += part + 1;
+        len -= part + 1;
+    }
+}
+
+/**
+ * tree_child - Finds the subtree of a cache-tree node by name.
+ */
+static IndexTree *tree_child(const IndexTree *tree, const char *name, size_t len){
+    for (size_t i = 0; i < tree->child_count; i++){
+        IndexTree *child = tree->children[i];
+        if (child->name_len == len && memcmp(child->name, name, len) == 0) { return child; }
+    }
+    return NULL;
+}
+
+/**
+ * tree_write - Serializes a cache-tree node and its subtrees in TREE format.
+ */
+static void tree_write(IndexBuffer *buf, const IndexTree *tree){
+    char counts[48];
+    int n = snprintf(counts, sizeof(counts), "%d %zu\n", tree->entry_count < 0 ? -1 : tree->entry_count, tree->child_count);
+    buffer_put(buf, tree->name, tree->name_len);
+    buffer_put(buf, "", 1);
+    buffer_put(buf, counts, (size_t)n);
+    if (tree->entry_count >= 0) { buffer_put(buf, tree->sha, SHA_SIZE); }
+    for (size_t i = 0; i < tree->child_count; i++){
+        tree_write(buf, tree->children[i]);
+    }
+}
+
+/**
+ * buffer_put - Appends bytes to a growable buffer.
+ */
+static void buffer_put(IndexBuffer *buf, const void *data, size_t len){
+    if (buf->len + len > buf->capacity){
+        while (buf->len + len > buf->capacity) { buf->capacity = buf->capacity ? buf->capacity * 2 : 1024; }
+        buf->data = realloc(buf->data, buf->capacity);
+        MALLOC_CHECK(buf->data);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+/**
+ * decode_varint - Reads git's offset varint (as used for v4 name prefixes).
+ *
+ * @return false if the number runs past end or overflows.
+ */
+static bool decode_varint(const unsigned char *map, size_t *pos, size_t end, uint64_t *value){
+    if (*pos >= end) { return false; }
+
+    unsigned char c = map[(*pos)++];
+    uint64_t v = c & 127;
+    while (c & 128){
+        if (*pos >= end || v + 1 > (UINT64_MAX >> 7)) { return false; }
+        c = map[(*pos)++];
+        v = ((v + 1) << 7) | (c & 127);
+    }
+    *value = v;
+    return true;
+}
+
+/**
+ * encode_varint - Writes git's offset varint.
+ *
+ * @param buf At least INDEX_VARINT_MAX bytes.
+ * @return Bytes written.
+ */
+static size_t encode_varint(uint64_t value, unsigned char *buf){
+    unsigned char tmp[INDEX_VARINT_MAX];
+    size_t pos = sizeof(tmp) - 1;
+    tmp[pos] = value & 127;
+    while (value >>= 7){
+        tmp[--pos] = 128 | (--value & 127);
+    }
+    memcpy(buf, tmp + pos, sizeof(tmp) - pos);
+    return sizeof(tmp) - pos;
+}
+
+/**
+ * index_pos - Binary search for a path and stage.
+ *
+ * @param found Output: whether the entry exists.
+ * @return Its position, or where it would be inserted.
+ */
+static size_t index_pos(const Index *index, const char *name, size_t len, int stage, bool *found){
+    size_t lo = 0, hi = index->count;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        const IndexEntry *entry = &index->entries[mid];
+        int cmp = index_name_compare(entry->name, entry->name_len, index_entry_stage(entry), name, len, stage);
+        if (cmp == 0){
+            *found = true;
+            return mid;
+        }
+        if (cmp < 0) { lo = mid + 1; } else { hi = mid; }
+    }
+    *found = false;
+    return lo;
+}
+
+/**
+ * index_threads - Worker count for reading the index, from index.threads.
+ */
+static size_t index_threads(const Repository *repo){
+    const char *value = repo->config ? config_get(repo->config, "index.threads") : NULL;
+    long count;
+    bool enabled;
+
+    if (!value) { return workers_default_count(); }
+    if (config_parse_int(value, &count) && count >= 0) { return count ? (size_t)count : workers_default_count(); }
+    if (config_parse_bool(value, &enabled)) { return enabled ? workers_default_count() : 1; }
+    return workers_default_count();
+}
+
+/**
+ * writer_put - Appends bytes to the index being written, hashing them.
+ */
+static void writer_put(IndexWriter *writer, const void *data, size_t len){
+    const unsigned char *p = data;
+    writer->offset += len;
+    while (len && !writer->failed){
+        if (writer->used == sizeof(writer->buf) && !writer_flush(writer)) { return; }
+        size_t n = sizeof(writer->buf) - writer->used;
+        if (n > len) { n = len; }
+        memcpy(writer->buf + writer->used, p, n);
+        writer->used += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/**
+ * writer_flush - Hashes and writes out the buffered bytes.
+ *
+ * @return false if this or an earlier write failed.
+ */
+static bool writer_flush(IndexWriter *writer){
+    if (writer->failed) { return false; }
+
+    sha1_update(&writer->sha, writer->buf, writer->used);
+    if (!write_all(writer->fd, writer->buf, writer->used)) { writer->failed = true; }
+    writer->used = 0;
+    return !writer->failed;
+}
+
+/**
+ * writer_entry - Serializes one entry.
+ *
+ * @param writer      The writer.
+ * @param entry       The entry.
+ * @param version     2, 3 or 4.
+ * @param prev        Previous entry for v4 prefix compression, NULL for the first.
+ * @param block_start First entry of an IEOT block: v4 shares no prefix with
+ *                    prev but strips all of it, so serial readers agree.
+ */
+static void writer_entry(IndexWriter *writer, const IndexEntry *entry, uint32_t version, const IndexEntry *prev, bool block_start){
+    unsigned char buf[INDEX_ENTRY_FIXED + 2 + INDEX_VARINT_MAX];
+    put_be32(buf, entry->ctime_sec);
+    put_be32(buf + 4, entry->ctime_nsec);
+    put_be32(buf + 8, entry->mtime_sec);
+    put_be32(buf + 12, entry->mtime_nsec);
+    put_be32(buf + 16, entry->dev);
+    put_be32(buf + 20, entry->ino);
+    put_be32(buf + 24, entry->mode);
+    put_be32(buf + 28, entry->uid);
+    put_be32(buf + 32, entry->gid);
+    put_be32(buf + 36, entry->size);
+    memcpy(buf + 40, entry->sha, SHA_SIZE);
+
+    uint16_t flags = entry->flags & (INDEX_FLAG_VALID | INDEX_FLAG_STAGE);
+    flags |= entry->name_len < INDEX_NAME_MASK ? (uint16_t)entry->name_len : INDEX_NAME_MASK;
+    if (entry->flags_extended) { flags |= INDEX_FLAG_EXTENDED; }
+    put_be16(buf + 60, flags);
+
+    size_t len = INDEX_ENTRY_FIXED;
+    if (entry->flags_extended){
+        put_be16(buf + len, entry->flags_extended);
+        len += 2;
+    }
+
+    if (version == 4){
+        size_t common = 0;
+        if (prev && !block_start){
+            size_t max = prev->name_len < entry->name_len ? prev->name_len : entry->name_len;
+            while (common < max && prev->name[common] == entry->name[common]) { common++; }
+        }
+        len += encode_varint(prev ? prev->name_len - common : 0, buf + len);
+        writer_put(writer, buf, len);
+        writer_put(writer, entry->name + common, entry->name_len - common + 1);
+        return;
+    }
+
+    static const unsigned char padding[8];
+    writer_put(writer, buf, len);
+    writer_put(writer, entry->name, entry->name_len);
+    writer_put(writer, padding, ((len + entry->name_len + 8) & ~(size_t)7) - len - entry->name_len);
+}
@@ -0,0 +1,204 @@
+/* kvlm.c: key-value list with message (commit and tag headers) */
+
+#include "kvlm.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Forward Declaration of static Functions */
+
+static const unsigned char *field_end(const unsigned char *p, const unsigned char *end, bool *multiline);
+
+/* Functions */
+
+/**
+ * kvlm_parse - Indexes the header fields and message of a commit or tag body.
+ *
+ * Unlike the recursive Python kvlm_parse, nothing is copied: every key and
+ * value is recorded as an (offset, length) view into data, in one forward
+ * pass. Continuation lines (a value line followed by lines starting with a
+ * space, as in gpgsig or mergetag) are kept raw and only folded if a caller
+ * asks for the value with kvlm_value().
+ *
+ * @param kvlm  Output index; kvlm->data is set to data.
+ * @param data  The object body; it must outlive the index.
+ * @param size  Size of data (below 4 GiB).
+ * @param arena Arena the field table is allocated from.
+ * @return True on success, false if a header line is malformed.
+ */
+bool kvlm_parse(Kvlm *kvlm, const unsigned char *data, size_t size, Arena *arena){
+    if (!kvlm || (!data && size) || !arena || size > UINT32_MAX) { return false; }
+
+    const unsigned char *end = data + size;
+    bool multiline;
+
+    /* First pass only counts fields, so the table is sized exactly. */
+    size_t count = 0;
+    const unsigned char *p = data;
+    while (p < end && *p != '\n'){
+        p = field_end(p, end, &multiline);
+        count++;
+    }
+
+    memset(kvlm, 0, sizeof(*kvlm));
+    kvlm->data = data;
+    kvlm->fields = count ? arena_alloc(arena, count * sizeof(KvlmField)) : NULL;
+
+    p = data;
+    while (p < end && *p != '\n'){
+        const unsigned char *stop = field_end(p, end, &multiline);
+        const unsigned char *line_end = stop[-1] == '\n' ? stop - 1 : stop;
+        const unsigned char *space = memchr(p, ' ', (size_t)(line_end - p));
+        /* the key ends on the field's first line, not in a continuation */
+        if (!space || space == p || memchr(p, '\n', (size_t)(space - p))){
+            fprintf(stderr, "kvlm_parse: malformed header line at offset %zu\n", (size_t)(p - data));
+            return false;
+        }
+
+        KvlmField *field = &kvlm->fields[kvlm->count++];
+        *field = (KvlmField){
+            .key_off   = (uint32_t)(p - data),
+            .key_len   = (uint32_t)(space - p),
+            .value_off = (uint32_t)(space + 1 - data),
+            .value_len = (uint32_t)(line_end - space - 1),
+            .multiline = multiline,
+        };
+        p = stop;
+    }
+
+    if (p < end) { p++; }   /* the blank line */
+    kvlm->message_off = (uint32_t)(p - data);
+    kvlm->message_len = (uint32_t)(end - p);
+    return true;
+}
+
+/**
+ * kvlm_get - Finds the nth field with the given key.
+ *
+ * @param kvlm The parsed index.
+ * @param key  The key, e.g. "parent".
+ * @param nth  Which occurrence (0 for the first).
+ * @return The field, or NULL if there are not that many.
+ */
+KvlmField *kvlm_get(const Kvlm *kvlm, const char *key, size_t nth){
+    if (!kvlm || !key) { return NULL; }
+
+    size_t len = strlen(key);
+    for (size_t i = 0; i < kvlm->count; i++){
+        KvlmField *field = &kvlm->fields[i];
+        if (field->key_len == len && memcmp(kvlm->data + field->key_off, key, len) == 0 && nth-- == 0){
+            return field;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * kvlm_count - Counts the fields with the given key.
+ *
+ * @param kvlm The parsed index.
+ * @param key  The key.
+ * @return The number of occurrences.
+ */
+size_t kvlm_count(const Kvlm *kvlm, const char *key){
+    if (!kvlm || !key) { return 0; }
+
+    size_t len = strlen(key), count = 0;
+    for (size_t i = 0; i < kvlm->count; i++){
+        const KvlmField *field = &kvlm->fields[i];
+        if (field->key_len == len && memcmp(kvlm->data + field->key_off, key, len) == 0) { count++; }
+    }
+    return count;
+}
+
+/**
+ * kvlm_value - Returns a field's value with continuation lines folded.
+ *
+ * Single-line values are returned as a view into the object body. A
+ * multi-line value is folded ("\n " becomes "\n") into the arena the first
+ * time it is requested, and the result is remembered in the field.
+ *
+ * @param kvlm  The parsed index.
+ * @param field A field of kvlm.
+ * @param arena Arena for the folded copy.
+ * @param len   Output for the value length.
+ * @return The value (not NUL terminated).
+ */
+const unsigned char *kvlm_value(const Kvlm *kvlm, KvlmField *field, Arena *arena, size_t *len){
+    if (!kvlm || !field || !len) { return NULL; }
+
+    const unsigned char *raw = kvlm->data + field->value_off;
+    if (!field->multiline){
+        *len = field->value_len;
+        return raw;
+    }
+
+    if (!field->folded){
+        unsigned char *out = arena_alloc(arena, field->value_len);
+        size_t n = 0;
+        for (size_t i = 0; i < field->value_len; i++){
+            out[n++] = raw[i];
+            if (raw[i] == '\n' && i + 1 < field->value_len && raw[i + 1] == ' ') { i++; }
+        }
+        field->folded = out;
+        field->folded_len = n;
+    }
+    *len = field->folded_len;
+    return field->folded;
+}
+
+/**
+ * kvlm_message - Returns the message that follows the header fields.
+ *
+ * @param kvlm The parsed index.
+ * @param len  Output for the message length.
+ * @return A view into the object body.
+ */
+const unsigned char *kvlm_message(const Kvlm *kvlm, size_t *len){
+    if (!kvlm || !len) { return NULL; }
+
+    *len = kvlm->message_len;
+    return kvlm->data + kvlm->message_off;
+}
+
+/**
+ * kvlm_summary - Returns the first line of the message.
+ *
+ * @param kvlm The parsed index.
+ * @param len  Output for the line length, without its newline.
+ * @return A view into the object body.
+ */
+const unsigned char *kvlm_summary(const Kvlm *kvlm, size_t *len){
+    size_t message_len;
+    const unsigned char *message = kvlm_message(kvlm, &message_len);
+    if (!message) { return NULL; }
+
+    const unsigned char *nl = memchr(message, '\n', message_len);
+    *len = nl ? (size_t)(nl - message) : message_len;
+    return message;
+}
+
+/* Static Functions */
+
+/**
+ * field_end - Finds the end of a header field, continuation lines included.
+ *
+ * @param p         Start of the field's first line.
+ * @param end       End of the body.
+ * @param multiline Output, true if continuation lines were found.
+ * @return Pointer just past the field's final newline (or end).
+ */
+static const unsigned char *field_end(const unsigned char *p, const unsigned char *end, bool *multiline){
+    *multiline = false;
+    for (;;){
+        const unsigned char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) { return end; }
+        p = nl + 1;
+        if (p == end || *p != ' ') { return p; }
+        *multiline = true;
+    }
+}
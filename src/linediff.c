@@ -0,0 +1,719 @@
+/* linediff.c: line diffs of two buffers (histogram and Myers) */
+
+#include "linediff.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+/* Structures */
+
+typedef struct {
+    const unsigned char *line;
+    size_t              len;
+    uint32_t            hash;
+    uint32_t            id;                 /* UINT32_MAX marks a free slot */
+} LineSlot;
+
+typedef struct {
+    uint32_t *a;                            /* line ids of each side; equal lines share an id */
+    uint32_t *b;
+    long     na;
+    long     nb;
+    bool     *ca;                           /* changed flags, one false sentinel on each end */
+    bool     *cb;
+    uint32_t ids;                           /* distinct lines over both sides */
+
+    uint32_t *cnt;                          /* histogram: occurrences per id in the scanned range */
+    uint32_t *head;                         /* histogram: first occurrence per id, plus one */
+    uint32_t *next;                         /* histogram: next occurrence per line of a, plus one */
+
+    uint32_t *count1;                       /* Myers: occurrences per id in each side of the range */
+    uint32_t *count2;
+} LineWork;
+
+typedef struct {
+    uint32_t *a;                            /* ids of the lines left after discarding */
+    uint32_t *b;
+    bool     *ca;                           /* their changed flags */
+    bool     *cb;
+    long     *kvd;                          /* furthest points of both searches */
+    long     *kvdf;
+    long     *kvdb;
+    long     mxcost;
+} MyersEnv;
+
+typedef struct {
+    long i1;
+    long i2;
+    bool min_lo;
+    bool min_hi;
+} MyersSplit;
+
+typedef struct {
+    long begin1;                            /* inclusive bounds of the common run */
+    long end1;
+    long begin2;
+    long end2;
+    bool found;
+} HistogramRegion;
+
+typedef struct {
+    long start;
+    long end;
+} ChangeGroup;
+
+/* Forward Declaration of static Functions */
+
+static bool     text_split(LineText *text, const unsigned char *data, size_t size);
+static void     lines_intern(LineWork *work, const LineText *old, const LineText *new);
+static uint32_t line_hash(const unsigned char *line, size_t len);
+static void     histogram_diff(LineWork *work, long lo1, long hi1, long lo2, long hi2);
+static bool     histogram_lcs(LineWork *work, long lo1, long hi1, long lo2, long hi2, HistogramRegion *lcs);
+static long     histogram_try(LineWork *work, long b, long lo1, long hi1, long lo2, long hi2, HistogramRegion *lcs, uint32_t *best, bool *common);
+static void     myers_diff(LineWork *work, long off1, long lim1, long off2, long lim2);
+static long     myers_discard(const uint32_t *ids, long start, long end, const uint32_t *other_count, long lines,
+                              bool *rchg, uint32_t *kept, long *rindex);
+static bool     myers_multimatch_discard(const char *dis, long i, long s, long e);
+static long     myers_bogosqrt(long n);
+static void     myers_compare(MyersEnv *env, long off1, long lim1, long off2, long lim2, bool need_min);
+static void     myers_split(MyersEnv *env, long off1, long lim1, long off2, long lim2, bool need_min, MyersSplit *spl);
+static void     group_init(const bool *rchg, ChangeGroup *g);
+static bool     group_next(const bool *rchg, long n, ChangeGroup *g);
+static bool     group_previous(const bool *rchg, ChangeGroup *g);
+static bool     group_slide_down(const uint32_t *ids, bool *rchg, long n, ChangeGroup *g);
+static bool     group_slide_up(const uint32_t *ids, bool *rchg, ChangeGroup *g);
+static void     change_compact(const uint32_t *ids, bool *rchg, long n, const bool *rchg_other, long n_other);
+static void     changes_build(LineDiff *diff, const LineWork *work);
+
+/* Functions */
+
+/**
+ * linediff_compute - Finds the lines changed between two buffers.
+ *
+ * Each line (with its newline, so a missing final newline is a change) is
+ * interned once into an integer id, and the algorithms only compare ids.
+ * Histogram diff anchors on the least frequent common lines and hands
+ * ranges whose every common line is too frequent to Myers, as git's does.
+ * Myers first trims the common ends of its range and drops the lines it
+ * cannot match, as git's xdl_cleanup_records() does. Change groups are then slid to
+ * the last position they can take, lined up with a change on the other
+ * side when possible, the way git compacts them without the indent
+ * heuristic.
+ *
+ * There is one allocation per array, never one per line; the buffers are
+ * only referenced, so they may be mappings.
+ *
+ * @param diff      Output; released with linediff_free().
+ * @param old_data  The old contents.
+ * @param old_size  Bytes of old_data.
+ * @param new_data  The new contents.
+ * @param new_size  Bytes of new_data.
+ * @param algorithm LINEDIFF_HISTOGRAM or LINEDIFF_MYERS.
+ * @return True on success, false if a side has more lines than ids can count.
+ */
+bool linediff_compute(LineDiff *diff, const unsigned char *old_data, size_t old_size,
+                      const unsigned char *new_data, size_t new_size, LineDiffAlgorithm algorithm){
+    memset(diff, 0, sizeof(*diff));
+    if (!text_split(&diff->old, old_data, old_size) || !text_split(&diff->new, new_data, new_size)){
+        fprintf(stderr, "linediff_compute: too many lines\n");
+        linediff_free(diff);
+        return false;
+    }
+
+    LineWork work = { .na = (long)diff->old.count, .nb = (long)diff->new.count };
+    work.ca = (bool *)safe_calloc(sizeof(bool), (size_t)work.na + 2) + 1;
+    work.cb = (bool *)safe_calloc(sizeof(bool), (size_t)work.nb + 2) + 1;
+    lines_intern(&work, &diff->old, &diff->new);
+
+    if (algorithm == LINEDIFF_MYERS){
+        myers_diff(&work, 0, work.na, 0, work.nb);
+    } else {
+        work.cnt = safe_calloc(sizeof(uint32_t), work.ids ? work.ids : 1);
+        work.head = safe_malloc(sizeof(uint32_t), work.ids ? work.ids : 1);
+        work.next = safe_malloc(sizeof(uint32_t), work.na ? (size_t)work.na : 1);
+        histogram_diff(&work, 0, work.na, 0, work.nb);
+    }
+
+    change_compact(work.a, work.ca, work.na, work.cb, work.nb);
+    change_compact(work.b, work.cb, work.nb, work.ca, work.na);
+    changes_build(diff, &work);
+
+    free(work.a);
+    free(work.b);
+    free(work.ca - 1);
+    free(work.cb - 1);
+    free(work.cnt);
+    free(work.head);
+    free(work.next);
+    free(work.count1);
+    free(work.count2);
+    return true;
+}
+
+/**
+ * linediff_free - Releases a diff; the compared buffers are not touched.
+ */
+void linediff_free(LineDiff *diff){
+    free(diff->old.lines);
+    free(diff->new.lines);
+    free(diff->changes);
+    memset(diff, 0, sizeof(*diff));
+}
+
+/* Static Functions */
+
+/**
+ * text_split - Records where each line of a buffer starts.
+ *
+ * A final line without a newline still counts as a line.
+ */
+static bool text_split(LineText *text, const unsigned char *data, size_t size){
+    text->data = data;
+    text->size = size;
+
+    size_t count = 0;
+    for (const unsigned char *p = data, *end = data + size; p < end; count++){
+        const unsigned char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    if (count >= UINT32_MAX) { return false; }
+
+    text->count = count;
+    text->lines = safe_malloc(sizeof(size_t), count + 1);
+    size_t n = 0;
+    for (const unsigned char *p = data, *end = data + size; p < end; ){
+        text->lines[n++] = (size_t)(p - data);
+        const unsigned char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    text->lines[count] = size;
+    return true;
+}
+
+/**
+ * lines_intern - Gives every distinct line of both sides an id.
+ *
+ * One open-addressing table over both sides, twice the line count, so the
+ * rest of the diff compares integers instead of bytes.
+ */
+static void lines_intern(LineWork *work, const LineText *old, const LineText *new){
+    size_t total = old->count + new->count, capacity = 16;
+    while (capacity < 2 * total) { capacity *= 2; }
+    LineSlot *slots = safe_malloc(sizeof(LineSlot), capacity);
+    for (size_t i = 0; i < capacity; i++) { slots[i].id = UINT32_MAX; }
+
+    work->a = safe_malloc(sizeof(uint32_t), old->count ? old->count : 1);
+    work->b = safe_malloc(sizeof(uint32_t), new->count ? new->count : 1);
+    for (int side = 0; side < 2; side++){
+        const LineText *text = side ? new : old;
+        uint32_t *ids = side ? work->b : work->a;
+        for (size_t i = 0; i < text->count; i++){
+            const unsigned char *line = linediff_line(text, i);
+            size_t len = linediff_line_len(text, i);
+            uint32_t hash = line_hash(line, len);
+            size_t pos = hash & (capacity - 1);
+            while (slots[pos].id != UINT32_MAX &&
+                   (slots[pos].hash != hash || slots[pos].len != len || memcmp(slots[pos].line, line, len) != 0)){
+                pos = (pos + 1) & (capacity - 1);
+            }
+            if (slots[pos].id == UINT32_MAX){
+                slots[pos] = (LineSlot){ .line = line, .len = len, .hash = hash, .id = work->ids++ };
+            }
+            ids[i] = slots[pos].id;
+        }
+    }
+    free(slots);
+}
+
+/**
+ * line_hash - FNV-1a over the bytes of a line.
+ */
+static uint32_t line_hash(const unsigned char *line, size_t len){
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++){
+        hash ^= line[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * histogram_diff - Marks the changes between a[lo1, hi1) and b[lo2, hi2).
+ *
+ * Splits around the longest common run of the rarest common lines, then
+ * recurses on the left part and loops on the right one.
+ */
+static void histogram_diff(LineWork *work, long lo1, long hi1, long lo2, long hi2){
+    for (;;){
+        if (lo1 == hi1 || lo2 == hi2){
+            for (long i = lo1; i < hi1; i++) { work->ca[i] = true; }
+            for (long i = lo2; i < hi2; i++) { work->cb[i] = true; }
+            return;
+        }
+
+        HistogramRegion lcs = { 0 };
+        if (histogram_lcs(work, lo1, hi1, lo2, hi2, &lcs)){
+            myers_diff(work, lo1, hi1, lo2, hi2);
+            return;
+        }
+        if (!lcs.found){
+            for (long i = lo1; i < hi1; i++) { work->ca[i] = true; }
+            for (long i = lo2; i < hi2; i++) { work->cb[i] = true; }
+            return;
+        }
+
+        histogram_diff(work, lo1, lcs.begin1, lo2, lcs.begin2);
+        lo1 = lcs.end1 + 1;
+        lo2 = lcs.end2 + 1;
+    }
+}
+
+/**
+ * histogram_lcs - Finds the common run to split a range around.
+ *
+ * The occurrences of each line of a's range are chained (in order) and
+ * counted; every line of b found there is extended into a common run whose
+ * weight is the count of its rarest line. The run with the lowest weight
+ * wins, the longest among equals.
+ *
+ * @return True if common lines exist but all occur more than
+ * LINEDIFF_MAX_CHAIN times, so the range should go to Myers instead.
+ */
+static bool histogram_lcs(LineWork *work, long lo1, long hi1, long lo2, long hi2, HistogramRegion *lcs){
+    for (long i = hi1 - 1; i >= lo1; i--){
+        uint32_t id = work->a[i];
+        work->next[i] = work->cnt[id] ? work->head[id] : 0;
+        work->head[id] = (uint32_t)i + 1;
+        if (work->cnt[id] < UINT32_MAX) { work->cnt[id]++; }
+    }
+
+    uint32_t best = LINEDIFF_MAX_CHAIN + 1;
+    bool common = false;
+    for (long b = lo2; b < hi2; ){
+        b = histogram_try(work, b, lo1, hi1, lo2, hi2, lcs, &best, &common);
+    }
+
+    for (long i = lo1; i < hi1; i++) { work->cnt[work->a[i]] = 0; }
+    return common && best > LINEDIFF_MAX_CHAIN;
+}
+
+/**
+ * histogram_try - Extends every occurrence in a of line b into a common run.
+ *
+ * @return The next line of b worth trying, past the runs just found.
+ */
+static long histogram_try(LineWork *work, long b, long lo1, long hi1, long lo2, long hi2, HistogramRegion *lcs, uint32_t *best, bool *common){
+    long b_next = b + 1;
+    uint32_t id = work->b[b];
+    if (!work->cnt[id]) { return b_next; }
+    *common = true;
+    if (work->cnt[id] > *best) { return b_next; }
+
+    long as = (long)work->head[id] - 1;
+    for (;;){
+        long np = work->next[as];
+        long bs = b, ae = as, be = b;
+        uint32_t rc = work->cnt[id];
+
+        while (lo1 < as && lo2 < bs && work->a[as - 1] == work->b[bs - 1]){
+            as--;
+            bs--;
+            if (rc > 1) { rc = min(rc, work->cnt[work->a[as]]); }
+        }
+        while (ae + 1 < hi1 && be + 1 < hi2 && work->a[ae + 1] == work->b[be + 1]){
+            ae++;
+            be++;
+            if (rc > 1) { rc = min(rc, work->cnt[work->a[ae]]); }
+        }
+
+        if (b_next <= be) { b_next = be + 1; }
+        if (!lcs->found || lcs->end1 - lcs->begin1 < ae - as || rc < *best){
+            *lcs = (HistogramRegion){ .begin1 = as, .end1 = ae, .begin2 = bs, .end2 = be, .found = true };
+            *best = rc;
+        }
+
+        /* the next occurrence that is not inside the run just taken */
+        while (np && np - 1 <= ae) { np = work->next[np - 1]; }
+        if (!np) { break; }
+        as = np - 1;
+    }
+    return b_next;
+}
+
+/**
+ * myers_diff - Marks the changes between a[off1, lim1) and b[off2, lim2) with Myers.
+ *
+ * The range is handled as git handles a whole file: its common ends are
+ * trimmed, lines with no match on the other side (and runs of lines with
+ * too many) are marked changed up front, and only the lines left are
+ * searched, which keeps the search small and its output git's.
+ */
+static void myers_diff(LineWork *work, long off1, long lim1, long off2, long lim2){
+    if (!work->count1){
+        work->count1 = safe_calloc(sizeof(uint32_t), work->ids ? work->ids : 1);
+        work->count2 = safe_calloc(sizeof(uint32_t), work->ids ? work->ids : 1);
+    }
+    for (long i = off1; i < lim1; i++) { work->count1[work->a[i]]++; }
+    for (long i = off2; i < lim2; i++) { work->count2[work->b[i]]++; }
+
+    long n1 = lim1 - off1, n2 = lim2 - off2, head = 0, tail = 0;
+    while (head < n1 && head < n2 && work->a[off1 + head] == work->b[off2 + head]) { head++; }
+    while (tail < n1 - head && tail < n2 - head && work->a[lim1 - 1 - tail] == work->b[lim2 - 1 - tail]) { tail++; }
+
+    MyersEnv env = { 0 };
+    long *rindex1 = safe_malloc(sizeof(long), (size_t)n1 + 1), *rindex2 = safe_malloc(sizeof(long), (size_t)n2 + 1);
+    env.a = safe_malloc(sizeof(uint32_t), (size_t)n1 + 1);
+    env.b = safe_malloc(sizeof(uint32_t), (size_t)n2 + 1);
+    long nr1 = myers_discard(work->a, off1 + head, lim1 - tail, work->count2, n1, work->ca, env.a, rindex1);
+    long nr2 = myers_discard(work->b, off2 + head, lim2 - tail, work->count1, n2, work->cb, env.b, rindex2);
+    for (long i = off1; i < lim1; i++) { work->count1[work->a[i]] = 0; }
+    for (long i = off2; i < lim2; i++) { work->count2[work->b[i]] = 0; }
+
+    long ndiags = nr1 + nr2 + 3;
+    env.ca = safe_calloc(sizeof(bool), (size_t)nr1 + 1);
+    env.cb = safe_calloc(sizeof(bool), (size_t)nr2 + 1);
+    env.kvd = safe_malloc(sizeof(long), 2 * (size_t)ndiags + 2);
+    env.kvdf = env.kvd + nr2 + 1;
+    env.kvdb = env.kvd + ndiags + nr2 + 1;
+    /* past about the square root of the diagonals, settle for a good path */
+    env.mxcost = myers_bogosqrt(ndiags);
+    if (env.mxcost < LINEDIFF_MAX_COST_MIN) { env.mxcost = LINEDIFF_MAX_COST_MIN; }
+    myers_compare(&env, 0, nr1, 0, nr2, false);
+
+    for (long i = 0; i < nr1; i++) { if (env.ca[i]) { work->ca[rindex1[i]] = true; } }
+    for (long i = 0; i < nr2; i++) { if (env.cb[i]) { work->cb[rindex2[i]] = true; } }
+    free(env.a);
+    free(env.b);
+    free(env.ca);
+    free(env.cb);
+    free(env.kvd);
+    free(rindex1);
+    free(rindex2);
+}
+
+/**
+ * myers_discard - Keeps the lines of [start, end) worth searching, marking the rest changed.
+ *
+ * A line with no match on the other side is always changed. A line with
+ * LINEDIFF_MAX_MATCHES or more (capped by the square root of the side's
+ * lines) is dropped too when it sits in a run of such lines that is mostly
+ * unmatched.
+ *
+ * @param other_count Occurrences of each id on the other side.
+ * @param lines       Lines of the whole side, which set the cap.
+ * @return The number of lines kept in kept and rindex.
+ */
+static long myers_discard(const uint32_t *ids, long start, long end, const uint32_t *other_count, long lines,
+                          bool *rchg, uint32_t *kept, long *rindex){
+    long mlim = myers_bogosqrt(lines), n = end - start, count = 0;
+    if (mlim > LINEDIFF_MAX_MATCHES) { mlim = LINEDIFF_MAX_MATCHES; }
+    char *dis = safe_calloc(1, (size_t)n + 1);
+    for (long i = 0; i < n; i++){
+        uint32_t matches = other_count[ids[start + i]];
+        dis[i] = !matches ? 0 : matches >= (uint32_t)mlim ? 2 : 1;
+    }
+    for (long i = 0; i < n; i++){
+        if (dis[i] == 1 || (dis[i] == 2 && !myers_multimatch_discard(dis, i, 0, n - 1))){
+            rindex[count] = start + i;
+            kept[count++] = ids[start + i];
+        } else {
+            rchg[start + i] = true;
+        }
+    }
+    free(dis);
+    return count;
+}
+
+/**
+ * myers_multimatch_discard - git's xdl_clean_mmatch(): whether a frequent line is dropped.
+ *
+ * Looks at most LINEDIFF_SIMSCAN_WINDOW lines each way for the run of
+ * unmatched and frequent lines around i; the line goes if unmatched lines
+ * lie on both sides and frequent ones are under a LINEDIFF_KPDIS_RUN'th of the run.
+ */
+static bool myers_multimatch_discard(const char *dis, long i, long s, long e){
+    if (i - s > LINEDIFF_SIMSCAN_WINDOW) { s = i - LINEDIFF_SIMSCAN_WINDOW; }
+    if (e - i > LINEDIFF_SIMSCAN_WINDOW) { e = i + LINEDIFF_SIMSCAN_WINDOW; }
+
+    long r, rdis0 = 0, rpdis0 = 1, rdis1 = 0, rpdis1 = 1;
+    for (r = 1; i - r >= s; r++){
+        if (!dis[i - r]) { rdis0++; }
+        else if (dis[i - r] == 2) { rpdis0++; }
+        else { break; }
+    }
+    if (!rdis0) { return false; }
+    for (r = 1; i + r <= e; r++){
+        if (!dis[i + r]) { rdis1++; }
+        else if (dis[i + r] == 2) { rpdis1++; }
+        else { break; }
+    }
+    if (!rdis1) { return false; }
+    rdis1 += rdis0;
+    rpdis1 += rpdis0;
+    return rpdis1 * LINEDIFF_KPDIS_RUN < rpdis1 + rdis1;
+}
+
+/**
+ * myers_bogosqrt - A power of two near the square root of n, as git computes it.
+ */
+static long myers_bogosqrt(long n){
+    long root = 1;
+    for (; n > 0; n >>= 2) { root <<= 1; }
+    return root;
+}
+
+/**
+ * myers_compare - Divides a range at a middle snake and conquers both halves.
+ */
+static void myers_compare(MyersEnv *env, long off1, long lim1, long off2, long lim2, bool need_min){
+    const uint32_t *a = env->a, *b = env->b;
+    while (off1 < lim1 && off2 < lim2 && a[off1] == b[off2]) { off1++; off2++; }
+    while (off1 < lim1 && off2 < lim2 && a[lim1 - 1] == b[lim2 - 1]) { lim1--; lim2--; }
+
+    if (off1 == lim1){
+        for (; off2 < lim2; off2++) { env->cb[off2] = true; }
+    } else if (off2 == lim2){
+        for (; off1 < lim1; off1++) { env->ca[off1] = true; }
+    } else {
+        MyersSplit spl = { 0 };
+        myers_split(env, off1, lim1, off2, lim2, need_min, &spl);
+        myers_compare(env, off1, spl.i1, off2, spl.i2, spl.min_lo);
+        myers_compare(env, spl.i1, lim1, spl.i2, lim2, spl.min_hi);
+    }
+}
+
+/**
+ * myers_split - Finds where the forward and backward searches meet.
+ *
+ * Unless need_min is set, an expensive search is cut short: first by a
+ * diagonal that got far with a long snake, then, past mxcost, by the
+ * furthest reaching point, which is how git bounds its Myers diff.
+ */
+static void myers_split(MyersEnv *env, long off1, long lim1, long off2, long lim2, bool need_min, MyersSplit *spl){
+    const uint32_t *a = env->a, *b = env->b;
+    long *kvdf = env->kvdf, *kvdb = env->kvdb;
+    long dmin = off1 - lim2, dmax = lim1 - off2;
+    long fmid = off1 - off2, bmid = lim1 - lim2;
+    bool odd = (fmid - bmid) & 1;
+    long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+
+    kvdf[fmid] = off1;
+    kvdb[bmid] = lim1;
+
+    for (long ec = 1;; ec++){
+        bool got_snake = false;
+
+        /* widen the forward diagonals by one, bouncing off the box */
+        if (fmin > dmin) { kvdf[--fmin - 1] = -1; } else { ++fmin; }
+        if (fmax < dmax) { kvdf[++fmax + 1] = -1; } else { --fmax; }
+
+        for (long d = fmax; d >= fmin; d -= 2){
+            long i1 = kvdf[d - 1] >= kvdf[d + 1] ? kvdf[d - 1] + 1 : kvdf[d + 1];
+            long prev1 = i1, i2 = i1 - d;
+            for (; i1 < lim1 && i2 < lim2 && a[i1] == b[i2]; i1++, i2++) { }
+            if (i1 - prev1 > LINEDIFF_SNAKE_CNT) { got_snake = true; }
+            kvdf[d] = i1;
+            if (odd && bmin <= d && d <= bmax && kvdb[d] <= i1){
+                *spl = (MyersSplit){ .i1 = i1, .i2 = i2, .min_lo = true, .min_hi = true };
+                return;
+            }
+        }
+
+        if (bmin > dmin) { kvdb[--bmin - 1] = LONG_MAX; } else { ++bmin; }
+        if (bmax < dmax) { kvdb[++bmax + 1] = LONG_MAX; } else { --bmax; }
+
+        for (long d = bmax; d >= bmin; d -= 2){
+            long i1 = kvdb[d - 1] < kvdb[d + 1] ? kvdb[d - 1] : kvdb[d + 1] - 1;
+            long prev1 = i1, i2 = i1 - d;
+            for (; i1 > off1 && i2 > off2 && a[i1 - 1] == b[i2 - 1]; i1--, i2--) { }
+            if (prev1 - i1 > LINEDIFF_SNAKE_CNT) { got_snake = true; }
+            kvdb[d] = i1;
+            if (!odd && fmin <= d && d <= fmax && i1 <= kvdf[d]){
+                *spl = (MyersSplit){ .i1 = i1, .i2 = i2, .min_lo = true, .min_hi = true };
+                return;
+            }
+        }
+
+        if (need_min) { continue; }
+
+        if (got_snake && ec > LINEDIFF_HEUR_MIN){
+            long best = 0;
+            for (long d = fmax; d >= fmin; d -= 2){
+                long dd = d > fmid ? d - fmid : fmid - d;
+                long i1 = kvdf[d], i2 = i1 - d;
+                long v = (i1 - off1) + (i2 - off2) - dd;
+                if (v > LINEDIFF_K_HEUR * ec && v > best &&
+                    off1 + LINEDIFF_SNAKE_CNT <= i1 && i1 < lim1 && off2 + LINEDIFF_SNAKE_CNT <= i2 && i2 < lim2){
+                    for (long k = 1; a[i1 - k] == b[i2 - k]; k++){
+                        if (k == LINEDIFF_SNAKE_CNT){
+                            best = v;
+                            spl->i1 = i1;
+                            spl->i2 = i2;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (best > 0){
+                spl->min_lo = true;
+                spl->min_hi = false;
+                return;
+            }
+
+            for (long d = bmax; d >= bmin; d -= 2){
+                long dd = d > bmid ? d - bmid : bmid - d;
+                long i1 = kvdb[d], i2 = i1 - d;
+                long v = (lim1 - i1) + (lim2 - i2) - dd;
+                if (v > LINEDIFF_K_HEUR * ec && v > best &&
+                    off1 < i1 && i1 <= lim1 - LINEDIFF_SNAKE_CNT && off2 < i2 && i2 <= lim2 - LINEDIFF_SNAKE_CNT){
+                    for (long k = 0; a[i1 + k] == b[i2 + k]; k++){
+                        if (k == LINEDIFF_SNAKE_CNT - 1){
+                            best = v;
+                            spl->i1 = i1;
+                            spl->i2 = i2;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (best > 0){
+                spl->min_lo = false;
+                spl->min_hi = true;
+                return;
+            }
+        }
+
+        if (ec >= env->mxcost){
+            long fbest = -1, fbest1 = -1;
+            for (long d = fmax; d >= fmin; d -= 2){
+                long i1 = min(kvdf[d], lim1), i2 = i1 - d;
+                if (lim2 < i2) { i1 = lim2 + d; i2 = lim2; }
+                if (fbest < i1 + i2) { fbest = i1 + i2; fbest1 = i1; }
+            }
+
+            long bbest = LONG_MAX, bbest1 = LONG_MAX;
+            for (long d = bmax; d >= bmin; d -= 2){
+                long i1 = kvdb[d] > off1 ? kvdb[d] : off1, i2 = i1 - d;
+                if (i2 < off2) { i1 = off2 + d; i2 = off2; }
+                if (i1 + i2 < bbest) { bbest = i1 + i2; bbest1 = i1; }
+            }
+
+            if ((lim1 + lim2) - bbest < fbest - (off1 + off2)){
+                *spl = (MyersSplit){ .i1 = fbest1, .i2 = fbest - fbest1, .min_lo = true, .min_hi = false };
+            } else {
+                *spl = (MyersSplit){ .i1 = bbest1, .i2 = bbest - bbest1, .min_lo = false, .min_hi = true };
+            }
+            return;
+        }
+    }
+}
+
+/* A group is a run of changed lines, possibly empty, between two unchanged ones */
+
+static void group_init(const bool *rchg, ChangeGroup *g){
+    g->start = g->end = 0;
+    while (rchg[g->end]) { g->end++; }
+}
+
+static bool group_next(const bool *rchg, long n, ChangeGroup *g){
+    if (g->end == n) { return false; }
+    g->start = g->end + 1;
+    for (g->end = g->start; rchg[g->end]; g->end++) { }
+    return true;
+}
+
+static bool group_previous(const bool *rchg, ChangeGroup *g){
+    if (g->start == 0) { return false; }
+    g->end = g->start - 1;
+    for (g->start = g->end; rchg[g->start - 1]; g->start--) { }
+    return true;
+}
+
+static bool group_slide_down(const uint32_t *ids, bool *rchg, long n, ChangeGroup *g){
+    if (g->end >= n || ids[g->start] != ids[g->end]) { return false; }
+    rchg[g->start++] = false;
+    rchg[g->end++] = true;
+    while (rchg[g->end]) { g->end++; }
+    return true;
+}
+
+static bool group_slide_up(const uint32_t *ids, bool *rchg, ChangeGroup *g){
+    if (g->start == 0 || ids[g->start - 1] != ids[g->end - 1]) { return false; }
+    rchg[--g->start] = true;
+    rchg[--g->end] = false;
+    while (rchg[g->start - 1]) { g->start--; }
+    return true;
+}
+
+/**
+ * change_compact - Slides each group of changes to a canonical position.
+ *
+ * A group that can move is first moved up as far as it goes, merging with
+ * the groups it meets, then down as far as it goes; it stays at the bottom
+ * unless on the way it passed a spot facing a change of the other side, in
+ * which case it goes back up to the last such spot. The other side's
+ * groups are followed in step, since both sides have the same unchanged
+ * lines between corresponding groups.
+ */
+static void change_compact(const uint32_t *ids, bool *rchg, long n, const bool *rchg_other, long n_other){
+    ChangeGroup g, go;
+    group_init(rchg, &g);
+    group_init(rchg_other, &go);
+
+    for (;;){
+        if (g.end != g.start){
+            long size, earliest_end, end_matching_other;
+            do {
+                size = g.end - g.start;
+                end_matching_other = -1;
+                while (group_slide_up(ids, rchg, &g)) { group_previous(rchg_other, &go); }
+                earliest_end = g.end;
+                if (go.end > go.start) { end_matching_other = g.end; }
+                while (group_slide_down(ids, rchg, n, &g)){
+                    group_next(rchg_other, n_other, &go);
+                    if (go.end > go.start) { end_matching_other = g.end; }
+                }
+            } while (size != g.end - g.start);
+
+            if (g.end != earliest_end && end_matching_other != -1){
+                while (go.end == go.start){
+                    group_slide_up(ids, rchg, &g);
+                    group_previous(rchg_other, &go);
+                }
+            }
+        }
+        if (!group_next(rchg, n, &g)) { break; }
+        group_next(rchg_other, n_other, &go);
+    }
+}
+
+/**
+ * changes_build - Turns the changed flags into a list of changes.
+ */
+static void changes_build(LineDiff *diff, const LineWork *work){
+    long i1 = 0, i2 = 0;
+    while (i1 < work->na || i2 < work->nb){
+        if (!work->ca[i1] && !work->cb[i2]){
+            i1++;
+            i2++;
+            continue;
+        }
+        long s1 = i1, s2 = i2;
+        while (work->ca[i1]) { i1++; }
+        while (work->cb[i2]) { i2++; }
+        if (diff->count == diff->capacity){
+            diff->capacity = diff->capacity ? 2 * diff->capacity : 16;
+            diff->changes = realloc(diff->changes, diff->capacity * sizeof(LineChange));
+            MALLOC_CHECK(diff->changes);
+        }
+        diff->changes[diff->count++] = (LineChange){
+            .old_start = (size_t)s1, .old_count = (size_t)(i1 - s1),
+            .new_start = (size_t)s2, .new_count = (size_t)(i2 - s2),
+        };
+    }
+}
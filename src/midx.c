@@ -0,0 +1,385 @@
+/* midx.c: objects/pack/multi-pack-index reader and writer */
+
+#include "midx.h"
+#include "pack.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    const Pack      *pack;
+    char            name[MAX_PATH];     /* pack-<sha>.idx */
+    struct timespec mtime;
+    uint32_t        rank;               /* 0 for the pack preferred for duplicates */
+} MidxPack;
+
+typedef struct {
+    const unsigned char *sha;           /* inside the pack's index */
+    uint64_t             offset;
+    uint32_t             pack_id;
+    uint32_t             rank;
+} MidxEntry;
+
+/* Forward Declaration of static Functions */
+
+static bool     midx_collect(MidxPack *packs, size_t pack_count, MidxEntry **entries, size_t *count, size_t *duplicates);
+static bool     midx_serialize(Repository *repo, const MidxPack *packs, size_t pack_count, const MidxEntry *entries, size_t count);
+static bool     pack_newer(const MidxPack *a, const MidxPack *b);
+static int      compare_names(const void *a, const void *b);
+static int      compare_entries(const void *a, const void *b);
+
+/* Functions */
+
+/**
+ * midx_open - Maps a multi-pack-index file.
+ *
+ * Only the layout is validated here (signature, version, chunk table, pack
+ * names and chunk sizes against the object count); the trailing checksum
+ * is not, and the packs are only matched to their names by pack_list().
+ *
+ * @param path Path of the multi-pack-index file.
+ * @return A heap-allocated MultiPackIndex, or NULL if the file is missing
+ * or malformed.
+ * @note The caller is responsible for calling midx_close().
+ */
+MultiPackIndex *midx_open(const char *path){
+    if (!path) { return NULL; }
+
+    MultiPackIndex *midx = safe_calloc(sizeof(MultiPackIndex), 1);
+    midx->map = map_file(path, &midx->size);
+    if (!midx->map) { goto fail; }
+
+    const unsigned char *map = midx->map;
+    if (midx->size < MIDX_HEADER_SIZE + 12 + SHA_SIZE || memcmp(map, MIDX_SIGNATURE, 4) != 0 ||
+        map[4] != MIDX_VERSION || map[5] != MIDX_HASH_VERSION || map[7] != 0){
+        fprintf(stderr, "midx_open: %s is not a version 1 SHA-1 multi-pack-index\n", path);
+        goto fail;
+    }
+
+    size_t chunks = map[6];
+    size_t table_end = MIDX_HEADER_SIZE + (chunks + 1) * 12;
+    if (table_end > midx->size - SHA_SIZE) { goto malformed; }
+    midx->pack_count = get_be32(map + 8);
+
+    const unsigned char *names = NULL;
+    size_t names_size = 0, oids_size = 0, offsets_size = 0;
+    for (size_t i = 0; i < chunks; i++){
+        const unsigned char *entry = map + MIDX_HEADER_SIZE + i * 12;
+        uint32_t id = get_be32(entry);
+        uint64_t offset = get_be64(entry + 4), next = get_be64(entry + 16);
+        if (offset < table_end || next < offset || next > midx->size - SHA_SIZE) { goto malformed; }
+
+        size_t len = (size_t)(next - offset);
+        switch (id){
+            case MIDX_CHUNK_PNAM: names = map + offset;                 names_size = len;   break;
+            case MIDX_CHUNK_OIDF:
+                if (len < MIDX_FANOUT * 4) { goto malformed; }
+                midx->fanout = map + offset;
+                break;
+            case MIDX_CHUNK_OIDL: midx->oids = map + offset;           oids_size = len;    break;
+            case MIDX_CHUNK_OOFF: midx->offsets = map + offset;        offsets_size = len; break;
+            case MIDX_CHUNK_LOFF: midx->large_offsets = map + offset;  midx->large_count = len / 8; break;
+            default: break;     /* optional chunks we do not use (RIDX, BTMP...) */
+        }
+    }
+
+    if (!names || !midx->fanout || !midx->oids || !midx->offsets) { goto malformed; }
+    midx->count = get_be32(midx->fanout + 4 * (MIDX_FANOUT - 1));
+    if (oids_size < (size_t)midx->count * SHA_SIZE || offsets_size < (size_t)midx->count * MIDX_OFFSET_SIZE){
+        goto malformed;
+    }
+
+    /* names are NUL-terminated .idx names that must all lie inside the chunk */
+    if (midx->pack_count > names_size) { goto malformed; }
+    midx->pack_names = safe_calloc(sizeof(char *), midx->pack_count ? midx->pack_count : 1);
+    midx->packs = safe_calloc(sizeof(Pack *), midx->pack_count ? midx->pack_count : 1);
+    for (size_t i = 0, at = 0; i < midx->pack_count; i++){
+        const unsigned char *end = memchr(names + at, '\0', names_size - at);
+        size_t len = end ? (size_t)(end - names) - at : 0;
+        if (len < 5 || memcmp(end - 4, ".idx", 4) != 0) { goto malformed; }
+        midx->pack_names[i] = (const char *)names + at;
+        at = (size_t)(end - names) + 1;
+    }
+    return midx;
+
+malformed:
+    fprintf(stderr, "midx_open: %s is malformed\n", path);
+fail:
+    midx_close(midx);
+    return NULL;
+}
+
+/**
+ * midx_close - Unmaps a multi-pack-index and frees it.
+ *
+ * @param midx The index; NULL is ignored. The packs it points to are not closed.
+ */
+void midx_close(MultiPackIndex *midx){
+    if (!midx) { return; }
+
+    if (midx->map) { munmap((void *)midx->map, midx->size); }
+    free(midx->pack_names);
+    free(midx->packs);
+    free(midx);
+}
+
+/**
+ * midx_find - Looks up an object in the merged object table.
+ *
+ * One fan-out bucket and one binary search, however many packs there are.
+ *
+ * @param midx    The index.
+ * @param sha     The 20-byte binary SHA.
+ * @param pack_id Output for the position of the object's pack in pack_names.
+ * @param offset  Output for the entry's offset in that packfile.
+ * @return True if the object is indexed, false otherwise or if its record is corrupt.
+ */
+bool midx_find(const MultiPackIndex *midx, const unsigned char sha[SHA_SIZE], uint32_t *pack_id, uint64_t *offset){
+    if (!midx || !sha) { return false; }
+
+    uint32_t lo = sha[0] ? get_be32(midx->fanout + 4 * (sha[0] - 1)) : 0;
+    uint32_t hi = get_be32(midx->fanout + 4 * sha[0]);
+    if (hi > midx->count) { hi = midx->count; }
+
+    while (lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(midx->oids + (size_t)mid * SHA_SIZE, sha, SHA_SIZE);
+        if (cmp == 0){
+            const unsigned char *p = midx->offsets + (size_t)mid * MIDX_OFFSET_SIZE;
+            uint32_t id = get_be32(p), off = get_be32(p + 4);
+            if (id >= midx->pack_count) { return false; }
+
+            uint64_t value = off;
+            if (off & MIDX_LARGE_OFFSET){
+                size_t large = off & ~MIDX_LARGE_OFFSET;
+                if (large >= midx->large_count) { return false; }
+                value = get_be64(midx->large_offsets + large * 8);
+            }
+            if (pack_id) { *pack_id = id; }
+            if (offset) { *offset = value; }
+            return true;
+        }
+        if (cmp < 0) { lo = mid + 1; }
+        else         { hi = mid; }
+    }
+    return false;
+}
+
+/**
+ * midx_write - Writes objects/pack/multi-pack-index covering every pack.
+ *
+ * The pack list is reloaded first so packs written since it was mapped are
+ * included. Packs are numbered in name order; an object present in several
+ * packs is recorded once, for the most recently modified pack, so the
+ * freshest copy is read. The file is written to a temporary name and
+ * renamed into place, then the pack list is dropped so the next lookup
+ * maps the new index.
+ *
+ * @param repo  The repository.
+ * @param stats Output counts (may be NULL).
+ * @return True on success, false if there are no packs, an index is
+ * corrupt or the file could not be written.
+ */
+bool midx_write(Repository *repo, MidxStats *stats){
+    if (!repo) { return false; }
+
+    pack_list_free(repo);
+    size_t pack_count = 0;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { pack_count++; }
+    if (!pack_count){
+        fprintf(stderr, "midx_write: no packs to index\n");
+        return false;
+    }
+
+    MidxPack *packs = safe_calloc(sizeof(MidxPack), pack_count);
+    size_t i = 0;
+    for (Pack *pack = repo->packs; pack; pack = pack->next, i++){
+        const char *base = strrchr(pack->path, '/');
+        base = base ? base + 1 : pack->path;
+        snprintf(packs[i].name, sizeof(packs[i].name), "%.*s.idx", (int)(strlen(base) - 5), base);
+        struct stat sb;
+        packs[i].pack = pack;
+        packs[i].mtime = stat(pack->path, &sb) == 0 ? sb.st_mtim : (struct timespec){ 0 };
+    }
+    qsort(packs, pack_count, sizeof(MidxPack), compare_names);
+    for (size_t a = 0; a < pack_count; a++){
+        for (size_t b = 0; b < pack_count; b++) { packs[a].rank += pack_newer(&packs[b], &packs[a]); }
+    }
+
+    MidxEntry *entries = NULL;
+    size_t count = 0, duplicates = 0;
+    bool status = midx_collect(packs, pack_count, &entries, &count, &duplicates) &&
+                  midx_serialize(repo, packs, pack_count, entries, count);
+
+    if (status){
+        pack_list_free(repo);
+        if (stats) { *stats = (MidxStats){ .packs = pack_count, .objects = count, .duplicates = duplicates }; }
+    }
+    free(entries);
+    free(packs);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * midx_collect - Merges the objects of every pack, keeping one copy of each.
+ *
+ * @param entries    Output for the sorted, unique entries; the caller frees it.
+ * @param count      Output for their number.
+ * @param duplicates Output for the number of copies dropped.
+ */
+static bool midx_collect(MidxPack *packs, size_t pack_count, MidxEntry **entries, size_t *count, size_t *duplicates){
+    size_t total = 0;
+    for (size_t p = 0; p < pack_count; p++) { total += packs[p].pack->count; }
+    if (total >= UINT32_MAX){
+        fprintf(stderr, "midx_write: too many objects\n");
+        return false;
+    }
+
+    MidxEntry *all = safe_malloc(sizeof(MidxEntry), total ? total : 1);
+    size_t n = 0;
+    for (size_t p = 0; p < pack_count; p++){
+        const Pack *pack = packs[p].pack;
+        for (uint32_t pos = 0; pos < pack->count; pos++){
+            uint64_t offset = pack_offset_at(pack, pos);
+            if (offset < PACK_HEADER_SIZE || offset >= pack->pack_size - SHA_SIZE){
+                fprintf(stderr, "midx_write: %s has a corrupt offset table\n", packs[p].name);
+                free(all);
+                return false;
+            }
+            all[n++] = (MidxEntry){ .sha = pack->oids + (size_t)pos * SHA_SIZE, .offset = offset,
+                                    .pack_id = (uint32_t)p, .rank = packs[p].rank };
+        }
+    }
+
+    qsort(all, n, sizeof(MidxEntry), compare_entries);
+    size_t unique = 0;
+    for (size_t e = 0; e < n; e++){
+        if (unique && memcmp(all[unique - 1].sha, all[e].sha, SHA_SIZE) == 0) { continue; }
+        all[unique++] = all[e];
+    }
+
+    *entries = all;
+    *count = unique;
+    *duplicates = n - unique;
+    return true;
+}
+
+/**
+ * midx_serialize - Lays out the chunks and renames the file into place.
+ */
+static bool midx_serialize(Repository *repo, const MidxPack *packs, size_t pack_count, const MidxEntry *entries, size_t count){
+    size_t names_len = 0, large = 0;
+    for (size_t p = 0; p < pack_count; p++) { names_len += strlen(packs[p].name) + 1; }
+    names_len = (names_len + 3) & ~(size_t)3;
+    for (size_t i = 0; i < count; i++) { large += entries[i].offset >= MIDX_LARGE_OFFSET; }
+
+    size_t chunks = large ? 5 : 4;
+    size_t table = MIDX_HEADER_SIZE + (chunks + 1) * 12;
+    size_t pnam = table, oidf = pnam + names_len, oidl = oidf + MIDX_FANOUT * 4, ooff = oidl + count * SHA_SIZE;
+    size_t loff = ooff + count * MIDX_OFFSET_SIZE, end = loff + large * 8;
+    size_t len = end + SHA_SIZE;
+
+    unsigned char *buf = safe_calloc(sizeof(unsigned char), len);
+    memcpy(buf, MIDX_SIGNATURE, 4);
+    buf[4] = MIDX_VERSION;
+    buf[5] = MIDX_HASH_VERSION;
+    buf[6] = (unsigned char)chunks;
+    put_be32(buf + 8, (uint32_t)pack_count);
+
+    uint32_t ids[] = { MIDX_CHUNK_PNAM, MIDX_CHUNK_OIDF, MIDX_CHUNK_OIDL, MIDX_CHUNK_OOFF, MIDX_CHUNK_LOFF, 0 };
+    size_t offsets[] = { pnam, oidf, oidl, ooff, loff, end };
+    for (size_t i = 0; i < chunks; i++){
+        put_be32(buf + MIDX_HEADER_SIZE + i * 12, ids[i]);
+        put_be64(buf + MIDX_HEADER_SIZE + i * 12 + 4, offsets[i]);
+    }
+    put_be64(buf + MIDX_HEADER_SIZE + chunks * 12 + 4, end);
+
+    for (size_t p = 0, at = pnam; p < pack_count; p++){
+        size_t name_len = strlen(packs[p].name) + 1;
+        memcpy(buf + at, packs[p].name, name_len);
+        at += name_len;
+    }
+
+    for (size_t b = 0, i = 0; b < MIDX_FANOUT; b++){
+        while (i < count && entries[i].sha[0] <= b) { i++; }
+        put_be32(buf + oidf + 4 * b, (uint32_t)i);
+    }
+
+    for (size_t i = 0, next_large = 0; i < count; i++){
+        const MidxEntry *e = &entries[i];
+        unsigned char *p = buf + ooff + i * MIDX_OFFSET_SIZE;
+        memcpy(buf + oidl + i * SHA_SIZE, e->sha, SHA_SIZE);
+        put_be32(p, e->pack_id);
+        if (e->offset < MIDX_LARGE_OFFSET){
+            put_be32(p + 4, (uint32_t)e->offset);
+        } else {
+            put_be32(p + 4, MIDX_LARGE_OFFSET | (uint32_t)next_large);
+            put_be64(buf + loff + 8 * next_large++, e->offset);
+        }
+    }
+    sha1_buffer(buf, end, buf + end);
+
+    bool status = false;
+    char dir[MAX_PATH], path[MAX_PATH], tmp[MAX_PATH];
+    repo_path_buf(repo, dir, sizeof(dir), "objects", "pack", NULL);
+    repo_path_buf(repo, path, sizeof(path), "objects", "pack", "multi-pack-index", NULL);
+    int n = snprintf(tmp, sizeof(tmp), "%s/tmp_midx_XXXXXX", dir);
+    int fd = n > 0 && (size_t)n < sizeof(tmp) ? mkstemp(tmp) : -1;
+    if (fd < 0){
+        fprintf(stderr, "midx_write: cannot create a temporary file: %s\n", strerror(errno));
+    } else {
+        status = write_all(fd, buf, len);
+        fchmod(fd, 0444);
+        close(fd);
+        if (status && rename(tmp, path) < 0){
+            fprintf(stderr, "midx_write: cannot rename to %s: %s\n", path, strerror(errno));
+            status = false;
+        }
+        if (!status) { unlink(tmp); }
+    }
+
+    free(buf);
+    return status;
+}
+
+/**
+ * pack_newer - Tells whether a is preferred over b for objects in both.
+ *
+ * The most recently modified pack wins; ties go to the first name.
+ */
+static bool pack_newer(const MidxPack *a, const MidxPack *b){
+    if (a->mtime.tv_sec != b->mtime.tv_sec) { return a->mtime.tv_sec > b->mtime.tv_sec; }
+    if (a->mtime.tv_nsec != b->mtime.tv_nsec) { return a->mtime.tv_nsec > b->mtime.tv_nsec; }
+    return strcmp(a->name, b->name) < 0;
+}
+
+/**
+ * compare_names - qsort comparator ordering packs by index name, as PNAM requires.
+ */
+static int compare_names(const void *a, const void *b){
+    return strcmp(((const MidxPack *)a)->name, ((const MidxPack *)b)->name);
+}
+
+/**
+ * compare_entries - qsort comparator ordering entries by SHA, preferred pack first.
+ */
+static int compare_entries(const void *a, const void *b){
+    const MidxEntry *x = a, *y = b;
+    int cmp = memcmp(x->sha, y->sha, SHA_SIZE);
+    if (cmp) { return cmp; }
+    return (x->rank > y->rank) - (x->rank < y->rank);
+}
@@ -1,9 +1,1379 @@
 /* objects.c: object functions for git */
 
+#define _GNU_SOURCE                     /* sync_file_range() and syncfs() */
+
 #include "objects.h"
+#include "abbrev.h"
+#include "pack.h"
+#include "refs.h"
 #include "utils.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <zlib.h>
+
+/* Forward Declaration of static Functions */
+
+static int     object_open_loose(Repository *repo, const unsigned char sha[SHA_SIZE]);
+static ObjectStream *stream_open_packed(Repository *repo, Pack *pack, uint64_t offset, const unsigned char sha[SHA_SIZE]);
+static bool    parse_header(const unsigned char *buf, size_t have, ObjectType *type, size_t *size, size_t *header_len);
+static bool    writer_deflate(ObjectWriter *writer, const void *data, size_t len, int flush);
+static int     writer_tmpfile(ObjectWriter *writer);
+static bool    writer_flush(ObjectWriter *writer);
+static bool    object_sync_wanted(Repository *repo);
+static bool    object_place(Repository *repo, int from_fd, const char *tmp_name, const unsigned char sha[SHA_SIZE], bool *renamed, int *dir_fd);
+static bool    batch_stage(ObjectBatch *batch, const char *tmp_name, const unsigned char sha[SHA_SIZE]);
+static ObjectStream *stream_alloc(void);
+static ssize_t stream_inflate(ObjectStream *stream);
+static bool    stream_parse_header(ObjectStream *stream, size_t have);
+static GitObject **cache_slot(ObjectCache *cache, const unsigned char sha[SHA_SIZE]);
+static void    cache_grow(ObjectCache *cache);
+static bool    field_sha(const Kvlm *kvlm, const KvlmField *field, unsigned char sha[SHA_SIZE]);
+
+/* Constants */
+
+static const char *OBJECT_TYPE_NAMES[] = {
+    [OBJ_NONE]   = NULL,
+    [OBJ_COMMIT] = "commit",
+    [OBJ_TREE]   = "tree",
+    [OBJ_BLOB]   = "blob",
+    [OBJ_TAG]    = "tag",
+};
+
+/* Functions */
+
+/**
+ * object_type_name - Returns the canonical header name of an object type.
+ *
+ * @param type The object type.
+ * @return "commit", "tree", "blob" or "tag", or NULL for OBJ_NONE and
+ * out-of-range values.
+ */
+const char *object_type_name(ObjectType type){
+    if (type <= OBJ_NONE || type > OBJ_TAG) { return NULL; }
+    return OBJECT_TYPE_NAMES[type];
+}
+
+/**
+ * object_type_from_name - Maps a type name to its ObjectType.
+ *
+ * @param name The type name, not necessarily NUL terminated.
+ * @param len  Number of bytes of name to consider.
+ * @return The matching ObjectType, or OBJ_NONE if the name is unknown.
+ */
+ObjectType object_type_from_name(const char *name, size_t len){
+    if (!name) { return OBJ_NONE; }
+
+    for (int t = OBJ_COMMIT; t <= OBJ_TAG; t++){
+        const char *s = OBJECT_TYPE_NAMES[t];
+        if (strlen(s) == len && memcmp(s, name, len) == 0){ return (ObjectType)t; }
+    }
+    return OBJ_NONE;
+}
+
+/**
+ * object_get - Returns the parsed form of an object, parsing it at most once.
+ *
+ * Parsed objects live in the repository arena and are indexed by SHA in the
+ * repository's object cache, which is created on first use. Walks that keep
+ * revisiting the same commits and trees (log, tree diffs) then cost one
+ * table probe per visit instead of an inflate and a parse.
+ *
+ * @param repo The repository.
+ * @param sha  The 20-byte binary SHA.
+ * @return The object (cast to GitCommit, GitTree, ... by its type), or NULL
+ * if it is missing or corrupt.
+ * @note The object stays valid until repo_destroy(); never free() it. Not
+ * thread-safe.
+ */
+GitObject *object_get(Repository *repo, const unsigned char sha[SHA_SIZE]){
+    if (!repo || !sha) { return NULL; }
+
+    if (!repo->object_cache){
+        repo->object_cache = safe_calloc(sizeof(ObjectCache), 1);
+        repo->object_cache->capacity = OBJECT_CACHE_INITIAL;
+        repo->object_cache->slots = safe_calloc(sizeof(GitObject *), OBJECT_CACHE_INITIAL);
+    }
+
+    ObjectCache *cache = repo->object_cache;
+    GitObject **slot = cache_slot(cache, sha);
+    if (*slot){
+        cache->hits++;
+        return *slot;
+    }
+    cache->misses++;
+
+    ObjectType type;
+    size_t size;
+    unsigned char *data = object_read(repo, sha, &type, &size);
+    if (!data) { return NULL; }
+
+    GitObject *object = object_parse(repo, sha, type, data, size);
+    free(data);
+    if (!object) { return NULL; }
+
+    if (2 * (cache->count + 1) > cache->capacity){
+        cache_grow(cache);
+        slot = cache_slot(cache, sha);
+    }
+    *slot = object;
+    cache->count++;
+    return object;
+}
+
+/**
+ * object_parse - Builds the parsed form of an object body in the repository arena.
+ *
+ * The body is copied into the arena, and the type-specific structure is
+ * allocated next to it, so the whole object is released with the arena.
+ * The raw bytes stay available through GitObject.data. Commits and tags get
+ * a zero-copy kvlm index over those bytes, trees an array of leaves.
+ *
+ * @param repo The repository whose arena receives the object.
+ * @param sha  The object's SHA.
+ * @param type The object type.
+ * @param data The body.
+ * @param size Size of the body.
+ * @return The object, or NULL if the type is unknown or the body malformed.
+ * @note The result is not added to the object cache; see object_get().
+ */
+GitObject *object_parse(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type, const unsigned char *data, size_t size){
+    if (!repo || !sha || (!data && size)) { return NULL; }
+
+    size_t struct_size;
+    switch (type){
+        case OBJ_COMMIT: struct_size = sizeof(GitCommit); break;
+        case OBJ_TREE:   struct_size = sizeof(GitTree);   break;
+        case OBJ_BLOB:   struct_size = sizeof(GitBlob);   break;
+        case OBJ_TAG:    struct_size = sizeof(GitTag);    break;
+        default:
+            fprintf(stderr, "object_parse: unknown object type %d\n", (int)type);
+            return NULL;
+    }
+
+    GitObject *object = arena_alloc(&repo->arena, struct_size);
+    memset(object, 0, struct_size);
+    object->type = type;
+    memcpy(object->sha, sha, SHA_SIZE);
+    object->size = size;
+    object->data = arena_memdup(&repo->arena, data, size);
+
+    if (type == OBJ_COMMIT || type == OBJ_TAG){
+        Kvlm *kvlm = type == OBJ_COMMIT ? &((GitCommit *)object)->kvlm : &((GitTag *)object)->kvlm;
+        if (!kvlm_parse(kvlm, object->data, size, &repo->arena)) { return NULL; }
+    } else if (type == OBJ_TREE){
+        if (!tree_parse(&((GitTree *)object)->tree, object->data, size, &repo->arena)) { return NULL; }
+    }
+    return object;
+}
+
+/**
+ * object_peel - Follows tags (and a commit's tree) down to an object of a given type.
+ *
+ * @param repo The repository.
+ * @param sha  The object to start from.
+ * @param type OBJ_COMMIT or OBJ_TREE to peel to, or OBJ_NONE to only strip tags.
+ * @return The object, or NULL if it cannot be peeled to that type.
+ */
+GitObject *object_peel(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type){
+    unsigned char peeled[SHA_SIZE];
+    return object_peel_name(repo, sha, type, peeled) ? object_get(repo, peeled) : NULL;
+}
+
+/**
+ * object_peel_name - Finds the name of the object object_peel() would return.
+ *
+ * Only the tags and the commit followed on the way are parsed (and cached);
+ * the object peeled to just has its header read, so a large tree or blob
+ * is not inflated.
+ *
+ * @param repo   The repository.
+ * @param sha    The object to start from.
+ * @param type   The type to peel to, as for object_peel(); any type but a
+ *               tag may be given to strip tags down to it.
+ * @param peeled Output for the peeled object's SHA.
+ * @return True if sha peels to that type, false otherwise.
+ */
+bool object_peel_name(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType type, unsigned char peeled[SHA_SIZE]){
+    if (!repo || !sha || !peeled) { return false; }
+
+    ObjectType current;
+    size_t size;
+    memmove(peeled, sha, SHA_SIZE);      /* peeled may be sha itself */
+    if (!object_read_header(repo, peeled, &current, &size)) { return false; }
+
+    for (size_t depth = 0; depth <= OBJECT_PEEL_DEPTH; depth++){
+        if (current == type || (type == OBJ_NONE && current != OBJ_TAG)) { return true; }
+
+        GitObject *object;
+        if (current == OBJ_TAG){
+            object = object_get(repo, peeled);
+            if (!object || object->type != OBJ_TAG || !tag_target((GitTag *)object, peeled)) { return false; }
+        } else if (current == OBJ_COMMIT && type == OBJ_TREE){
+            object = object_get(repo, peeled);
+            if (!object || object->type != OBJ_COMMIT || !commit_tree((GitCommit *)object, peeled)) { return false; }
+        } else {
+            return false;
+        }
+        if (!object_read_header(repo, peeled, &current, &size)) { return false; }
+    }
+    return false;
+}
+
+/**
+ * commit_tree - Decodes the tree a commit points to.
+ *
+ * @param commit The commit.
+ * @param sha    Output for the tree's SHA.
+ * @return True if the commit has a well-formed tree header, false otherwise.
+ */
+bool commit_tree(const GitCommit *commit, unsigned char sha[SHA_SIZE]){
+    if (!commit || !sha) { return false; }
+    return field_sha(&commit->kvlm, kvlm_get(&commit->kvlm, "tree", 0), sha);
+}
+
+/**
+ * tag_target - Decodes the object a tag points to.
+ *
+ * @param tag The tag.
+ * @param sha Output for the target's SHA.
+ * @return True if the tag has a well-formed object header, false otherwise.
+ */
+bool tag_target(const GitTag *tag, unsigned char sha[SHA_SIZE]){
+    if (!tag || !sha) { return false; }
+    return field_sha(&tag->kvlm, kvlm_get(&tag->kvlm, "object", 0), sha);
+}
+
+/**
+ * commit_parent_count - Counts a commit's parents.
+ *
+ * @param commit The commit.
+ * @return 0 for a root commit, 2 or more for a merge.
+ */
+size_t commit_parent_count(const GitCommit *commit){
+    return commit ? kvlm_count(&commit->kvlm, "parent") : 0;
+}
+
+/**
+ * commit_parent - Decodes one of a commit's parents.
+ *
+ * @param commit The commit.
+ * @param nth    Which parent, in header order.
+ * @param sha    Output for the parent's SHA.
+ * @return True on success, false if there is no such parent or it is malformed.
+ */
+bool commit_parent(const GitCommit *commit, size_t nth, unsigned char sha[SHA_SIZE]){
+    if (!commit || !sha) { return false; }
+    return field_sha(&commit->kvlm, kvlm_get(&commit->kvlm, "parent", nth), sha);
+}
+
+/**
+ * object_cache_free - Drops every parsed object of a repository.
+ *
+ * @param repo The repository; its cache and arena are reset, so pointers
+ * previously returned by object_get() become invalid.
+ */
+void object_cache_free(Repository *repo){
+    if (!repo) { return; }
+
+    if (repo->object_cache){
+        free(repo->object_cache->slots);
+        free(repo->object_cache);
+        repo->object_cache = NULL;
+    }
+    arena_clear(&repo->arena);
+}
+
+/**
+ * object_stream_open - Opens a loose object for streaming decompression.
+ *
+ * Packs are consulted first; a packed entry is inflated straight out of the
+ * mapped packfile. For a loose object only the first chunk is inflated here,
+ * which is enough to parse and validate the "<type> <size>\0" header. The
+ * body is produced in OBJECT_CHUNK_SIZE pieces by object_stream_next(), so
+ * peak memory is bounded by the stream itself regardless of object size.
+ *
+ * @param repo The repository containing the object.
+ * @param sha  The 20-byte binary SHA of the object.
+ * @return A heap-allocated stream with type and size populated, or NULL if
+ * the object does not exist or its header is malformed.
+ * @note The caller is responsible for calling object_stream_close().
+ */
+ObjectStream *object_stream_open(Repository *repo, const unsigned char sha[SHA_SIZE]){
+    if (!repo || !sha) { return NULL; }
+    TRACE_SCOPE(TRACE_OBJECT_STREAM);
+
+    uint64_t offset;
+    Pack *pack = pack_lookup(repo, sha, &offset);
+    if (pack) { return stream_open_packed(repo, pack, offset, sha); }
+
+    int fd = object_open_loose(repo, sha);
+    if (fd < 0) { return NULL; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+
+    ObjectStream *stream = stream_alloc();
+    stream->fd = fd;
+
+    if (inflateInit(&stream->zs) != Z_OK){
+        fprintf(stderr, "object_stream_open: inflateInit failed for %s\n", hex);
+        close(fd);
+        free(stream);
+        return NULL;
+    }
+
+    ssize_t have = stream_inflate(stream);
+    if (have <= 0 || !stream_parse_header(stream, (size_t)have)){
+        fprintf(stderr, "object_stream_open: malformed object %s\n", hex);
+        object_stream_close(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+/**
+ * object_read_header - Reads the type and size of a loose object without its body.
+ *
+ * For packed objects the entry header already carries type and size; deltas
+ * only need their chain's headers and a few bytes of delta data. For
+ * loose objects only enough compressed input to produce OBJECT_HEADER_MAX
+ * bytes of output is read and inflated, so the cost is independent of the
+ * object's size. The body length is not validated; use object_stream_open()
+ * for that.
+ *
+ * @param repo The repository containing the object.
+ * @param sha  The 20-byte binary SHA of the object.
+ * @param type Output for the object type.
+ * @param size Output for the body size announced in the header.
+ * @return True if the object exists and has a well-formed header, false otherwise.
+ */
+bool object_read_header(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size){
+    if (!repo || !sha || !type || !size) { return false; }
+    TRACE_SCOPE(TRACE_OBJECT_READ);
+
+    uint64_t offset;
+    Pack *pack = pack_lookup(repo, sha, &offset);
+    if (pack){
+        int entry_type;
+        if (!pack_read_header(repo, pack, offset, &entry_type, size)) { return false; }
+        *type = (ObjectType)entry_type;
+        return true;
+    }
+
+    int fd = object_open_loose(repo, sha);
+    if (fd < 0) { return false; }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK){
+        close(fd);
+        return false;
+    }
+
+    unsigned char in[OBJECT_HEADER_MAX * 4];
+    unsigned char out[OBJECT_HEADER_MAX];
+    size_t have = 0;
+    size_t header_len = 0;
+    bool found = false;
+
+    zs.next_out = out;
+    zs.avail_out = sizeof(out);
+
+    while (!found && zs.avail_out > 0){
+        if (zs.avail_in == 0){
+            ssize_t n = read(fd, in, sizeof(in));
+            trace_count(TRACE_SYSCALLS, 1);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { break; }
+            zs.next_in = in;
+            zs.avail_in = (uInt)n;
+        }
+
+        int ret = inflate(&zs, Z_SYNC_FLUSH);
+        trace_count(TRACE_INFLATED, sizeof(out) - zs.avail_out - have);
+        have = sizeof(out) - zs.avail_out;
+        found = memchr(out, '\0', have) != NULL;
+        if (ret == Z_STREAM_END) { break; }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) { break; }
+    }
+
+    inflateEnd(&zs);
+    close(fd);
+    trace_count(TRACE_SYSCALLS, 1);
+
+    if (!found || !parse_header(out, have, type, size, &header_len)){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(sha, hex);
+        fprintf(stderr, "object_read_header: malformed object %s\n", hex);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * object_read - Reads a whole object body into memory.
+ *
+ * Packed entries, deltas included, are read through the pack layer (and its
+ * delta base cache); loose objects are streamed into a buffer of the size
+ * announced by their header.
+ *
+ * @param repo The repository.
+ * @param sha  The 20-byte binary SHA.
+ * @param type Output for the object type.
+ * @param size Output for the body size.
+ * @return A heap-allocated body, or NULL if the object is missing or corrupt.
+ * @note The caller MUST free() the returned buffer.
+ */
+unsigned char *object_read(Repository *repo, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size){
+    if (!repo || !sha || !type || !size) { return NULL; }
+    TRACE_SCOPE(TRACE_OBJECT_READ);
+
+    uint64_t offset;
+    Pack *pack = pack_lookup(repo, sha, &offset);
+    if (pack){
+        int entry_type;
+        unsigned char *body = pack_read_object(repo, pack, offset, &entry_type, size);
+        if (body) { *type = (ObjectType)entry_type; }
+        return body;
+    }
+
+    ObjectStream *stream = object_stream_open(repo, sha);
+    if (!stream) { return NULL; }
+
+    unsigned char *body = safe_malloc(sizeof(unsigned char), stream->size ? stream->size : 1);
+    size_t have = 0;
+    const unsigned char *chunk;
+    ssize_t n;
+    while ((n = object_stream_next(stream, &chunk)) > 0){
+        memcpy(body + have, chunk, (size_t)n);
+        have += (size_t)n;
+    }
+
+    if (n < 0){
+        free(body);
+        body = NULL;
+    } else {
+        *type = stream->type;
+        *size = stream->size;
+    }
+    object_stream_close(stream);
+    return body;
+}
+
+/**
+ * object_find - Resolves an object name to a binary SHA.
+ *
+ * Full 40-digit hexadecimal names are taken as they are; anything else is
+ * looked up as a reference, then as an abbreviated object name.
+ *
+ * @param repo The repository in which to resolve the name.
+ * @param name The object name given by the user.
+ * @param type Type that settles an ambiguous abbreviation, or OBJ_NONE.
+ * @param sha  Output for the resolved SHA.
+ * @return True if the name could be resolved, false otherwise.
+ */
+bool object_find(Repository *repo, const char *name, ObjectType type, unsigned char sha[SHA_SIZE]){
+    if (!name || !sha) { return false; }
+    if (hex_to_sha(name, sha) || ref_resolve(repo, name, sha)) { return true; }
+
+    AbbrevStatus status = abbrev_resolve(repo, name, strlen(name), type, sha);
+    if (status == ABBREV_AMBIGUOUS){
+        fprintf(stderr, "object_find: short object ID %s is ambiguous\n", name);
+    } else if (status == ABBREV_NONE){
+        fprintf(stderr, "object_find: not a valid object name %s\n", name);
+    }
+    return status == ABBREV_UNIQUE;
+}
+
+/**
+ * object_stream_next - Produces the next chunk of an object's body.
+ *
+ * @param stream The stream returned by object_stream_open().
+ * @param chunk  Set to point at the inflated bytes; valid until the next call.
+ * @return The number of bytes in chunk (at most OBJECT_CHUNK_SIZE), 0 once the
+ * whole body has been produced, or -1 if the object is corrupt or its length
+ * disagrees with the header.
+ */
+ssize_t object_stream_next(ObjectStream *stream, const unsigned char **chunk){
+    if (!stream || !chunk) { return -1; }
+    TRACE_SCOPE(TRACE_OBJECT_STREAM);
+
+    if (stream->pending_len){
+        size_t len = min(stream->pending_len, (size_t)OBJECT_CHUNK_SIZE);
+        *chunk = stream->pending;
+        stream->pending += len;
+        stream->pending_len -= len;
+        stream->remaining -= len;
+        return (ssize_t)len;
+    }
+
+    if (stream->stream_end){
+        if (stream->remaining){
+            fprintf(stderr, "object_stream_next: malformed object: bad length\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    ssize_t have = stream_inflate(stream);
+    if (have < 0) { return -1; }
+    if ((size_t)have > stream->remaining){
+        fprintf(stderr, "object_stream_next: malformed object: bad length\n");
+        return -1;
+    }
+    if (have == 0) { return object_stream_next(stream, chunk); }
+
+    *chunk = stream->out;
+    stream->remaining -= (size_t)have;
+    return have;
+}
+
+/**
+ * object_stream_close - Releases a stream and its file descriptor.
+ *
+ * @param stream The stream to close; NULL is ignored.
+ */
+void object_stream_close(ObjectStream *stream){
+    if (!stream) { return; }
+
+    if (!stream->resolved) { inflateEnd(&stream->zs); }
+    if (stream->fd >= 0){
+        close(stream->fd);
+        trace_count(TRACE_SYSCALLS, 1);
+    }
+    free(stream->resolved);
+    free(stream);
+}
+
+/**
+ * object_writer_begin - Starts hashing (and optionally storing) an object.
+ *
+ * The "<type> <size>\0" header is emitted immediately, so the body size must
+ * be known up front. When repo is given, the compressed object is written to
+ * a temporary file in objects/ as the data arrives; it only becomes visible
+ * under objects/xx/ once object_writer_finish() knows its SHA.
+ *
+ * @param writer The writer state to initialize.
+ * @param repo   Repository to store the object in, or NULL to only hash.
+ * @param type   The object type.
+ * @param size   Exact number of body bytes that will be fed.
+ * @return True on success, false if the temporary file cannot be created.
+ * @note On failure the writer needs no cleanup.
+ */
+bool object_writer_begin(ObjectWriter *writer, Repository *repo, ObjectType type, size_t size){
+    const char *name = object_type_name(type);
+    if (!writer || !name) { return false; }
+
+    writer->repo = repo;
+    writer->size = size;
+    writer->written = 0;
+    writer->fd = -1;
+    writer->dir_fd = -1;
+    writer->tmp_name[0] = '\0';
+    sha1_init(&writer->sha);
+
+    char header[OBJECT_HEADER_MAX];
+    size_t header_len = (size_t)snprintf(header, sizeof(header), "%s %zu", name, size) + 1;
+
+    if (repo){
+        writer->dir_fd = repo_objects_fd(repo);
+        if (writer->dir_fd < 0){
+            fprintf(stderr, "object_writer_begin: cannot open %s/objects: %s\n", repo->gitdir, strerror(errno));
+            return false;
+        }
+
+        writer->fd = writer_tmpfile(writer);
+        if (writer->fd < 0){
+            fprintf(stderr, "object_writer_begin: cannot create objects/%s: %s\n", writer->tmp_name, strerror(errno));
+            return false;
+        }
+
+        memset(&writer->zs, 0, sizeof(writer->zs));
+        if (deflateInit(&writer->zs, OBJECT_LOOSE_LEVEL) != Z_OK){
+            fprintf(stderr, "object_writer_begin: deflateInit failed\n");
+            close(writer->fd);
+            unlinkat(writer->dir_fd, writer->tmp_name, 0);
+            return false;
+        }
+    }
+
+    sha1_update(&writer->sha, header, header_len);
+    if (repo && !writer_deflate(writer, header, header_len, Z_NO_FLUSH)){
+        object_writer_abort(writer);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * object_writer_update - Feeds body bytes to the hash and the deflate stream.
+ *
+ * @param writer The writer started with object_writer_begin().
+ * @param data   The body bytes.
+ * @param len    Number of bytes in data.
+ * @return True on success, false if more bytes than announced were fed or
+ * the temporary file cannot be written. The writer is aborted on failure.
+ */
+bool object_writer_update(ObjectWriter *writer, const void *data, size_t len){
+    if (!writer) { return false; }
+
+    if (len > writer->size - writer->written){
+        fprintf(stderr, "object_writer_update: more data than announced\n");
+        object_writer_abort(writer);
+        return false;
+    }
+    writer->written += len;
+
+    sha1_update(&writer->sha, data, len);
+    if (writer->repo && !writer_deflate(writer, data, len, Z_NO_FLUSH)){
+        object_writer_abort(writer);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * object_writer_finish - Completes the object and moves it into place.
+ *
+ * The temporary file is renamed to objects/xx/yyyy... now that the SHA is
+ * known. If that object already exists the temporary copy is discarded.
+ * Inside a syncing batch the file keeps its temporary name until
+ * object_batch_commit().
+ *
+ * @param writer The writer started with object_writer_begin().
+ * @param sha    Output for the object's binary SHA.
+ * @return True on success, false if fewer bytes than announced were fed or
+ * the object could not be stored. The writer is aborted on failure.
+ */
+bool object_writer_finish(ObjectWriter *writer, unsigned char sha[SHA_SIZE]){
+    if (!writer || !sha) { return false; }
+
+    if (writer->written != writer->size){
+        fprintf(stderr, "object_writer_finish: expected %zu bytes, got %zu\n", writer->size, writer->written);
+        object_writer_abort(writer);
+        return false;
+    }
+
+    sha1_final(&writer->sha, sha);
+    if (!writer->repo) { return true; }
+
+    if (!writer_deflate(writer, NULL, 0, Z_FINISH)){
+        object_writer_abort(writer);
+        return false;
+    }
+    deflateEnd(&writer->zs);
+    fchmod(writer->fd, 0444);
+    bool flushed = writer_flush(writer);
+    close(writer->fd);
+    writer->fd = -1;
+    trace_count(TRACE_SYSCALLS, 2);
+    if (!flushed){
+        fprintf(stderr, "object_writer_finish: cannot sync objects/%s: %s\n", writer->tmp_name, strerror(errno));
+        unlinkat(writer->dir_fd, writer->tmp_name, 0);
+        return false;
+    }
+
+    ObjectBatch *batch = writer->repo->object_batch;
+    if (batch && batch->sync) { return batch_stage(batch, writer->tmp_name, sha); }
+
+    bool renamed = false;
+    int dir_fd = -1;
+    bool status = object_place(writer->repo, writer->dir_fd, writer->tmp_name, sha, &renamed, &dir_fd);
+    if (renamed && batch){
+        atomic_store(&batch->dirty[sha[0]], true);
+        atomic_fetch_add(&batch->objects, 1);
+    } else if (renamed && object_sync_wanted(writer->repo)){
+        trace_count(TRACE_SYSCALLS, 1);
+        if (fsync(dir_fd) != 0){
+            fprintf(stderr, "object_writer_finish: cannot sync objects/%02x: %s\n", sha[0], strerror(errno));
+            status = false;
+        }
+    }
+    return status;
+}
+
+/**
+ * object_writer_abort - Discards a partially written object.
+ *
+ * @param writer The writer to abort; safe to call more than once.
+ */
+void object_writer_abort(ObjectWriter *writer){
+    if (!writer || !writer->repo || writer->fd < 0) { return; }
+
+    deflateEnd(&writer->zs);
+    close(writer->fd);
+    unlinkat(writer->dir_fd, writer->tmp_name, 0);
+    writer->fd = -1;
+}
+
+/**
+ * object_write_buffer - Hashes an in-memory object body and optionally stores it.
+ *
+ * @param repo Repository to store the object in, or NULL to only hash.
+ * @param type The object type.
+ * @param data The object body (without header).
+ * @param len  Number of bytes in data.
+ * @param sha  Output for the object's binary SHA.
+ * @return True on success, false otherwise.
+ */
+bool object_write_buffer(Repository *repo, ObjectType type, const void *data, size_t len, unsigned char sha[SHA_SIZE]){
+    TRACE_SCOPE(TRACE_OBJECT_WRITE);
+    ObjectWriter *writer = safe_malloc(sizeof(ObjectWriter), 1);
+    bool status = object_writer_begin(writer, repo, type, len) &&
+                  object_writer_update(writer, data, len) &&
+                  object_writer_finish(writer, sha);
+    free(writer);
+    return status;
+}
+
+/**
+ * object_batch_begin - Starts deferring the durability of new loose objects.
+ *
+ * With core.fsyncObjectFiles set, every object written outside a batch is
+ * fsync()ed along with its objects/xx directory. Inside a batch a written
+ * object only has its writeback started and stays under its temporary name
+ * in objects/; object_batch_commit() flushes the filesystem once, then
+ * renames every staged object into place and syncs each directory that
+ * gained one. This is git's core.fsyncMethod=batch: no object becomes
+ * visible before its data is on disk, whatever the filesystem orders.
+ * Objects written inside a syncing batch cannot be read until the commit;
+ * without core.fsyncObjectFiles they are visible as soon as they are written.
+ *
+ * @param repo The repository; writers may run on several threads.
+ * @return True on success, false if a batch is already open.
+ */
+bool object_batch_begin(Repository *repo){
+    if (!repo) { return false; }
+    if (repo->object_batch){
+        fprintf(stderr, "object_batch_begin: a batch is already open\n");
+        return false;
+    }
+
+    ObjectBatch *batch = safe_calloc(sizeof(ObjectBatch), 1);
+    batch->sync = object_sync_wanted(repo);
+    pthread_mutex_init(&batch->lock, NULL);
+    repo->object_batch = batch;
+    return true;
+}
+
+/**
+ * object_batch_commit - Makes the objects of the open batch durable and closes it.
+ *
+ * Costs one syncfs() for the staged data, plus one fsync() per objects/xx
+ * written to and one of objects/, instead of two per object. If the data
+ * cannot be flushed the staged objects are discarded rather than exposed.
+ *
+ * @param repo  The repository, with no writer still running.
+ * @param stats Output for what the batch wrote and synced, or NULL.
+ * @return True if every object was moved into place and every directory
+ * synced (or syncing is off), false otherwise; the batch is closed in both
+ * cases.
+ */
+bool object_batch_commit(Repository *repo, ObjectBatchStats *stats){
+    ObjectBatch *batch = repo ? repo->object_batch : NULL;
+    if (!batch) { return false; }
+    repo->object_batch = NULL;
+
+    bool flushed = true;
+    int objects_fd = batch->count ? repo_objects_fd(repo) : -1;
+#ifdef SYNC_FILE_RANGE_WRITE
+    /* Staged files only had their writeback started; wait for all of it. */
+    if (batch->count){
+        trace_count(TRACE_SYSCALLS, 1);
+        flushed = objects_fd >= 0 && syncfs(objects_fd) == 0;
+        if (!flushed) { fprintf(stderr, "object_batch_commit: cannot sync %s/objects: %s\n", repo->gitdir, strerror(errno)); }
+    }
+#endif
+    bool status = flushed;
+    for (size_t i = 0; i < batch->count; i++){
+        const ObjectBatchEntry *entry = &batch->staged[i];
+        bool renamed = false;
+        int dir_fd = -1;
+        if (!flushed){
+            if (objects_fd >= 0) { unlinkat(objects_fd, entry->tmp_name, 0); }
+        } else if (!object_place(repo, objects_fd, entry->tmp_name, entry->sha, &renamed, &dir_fd)){
+            status = false;
+        } else if (renamed){
+            atomic_store(&batch->dirty[entry->sha[0]], true);
+            atomic_fetch_add(&batch->objects, 1);
+        }
+    }
+
+    ObjectBatchStats counts = { .objects = atomic_load(&batch->objects) };
+    for (unsigned int byte = 0; batch->sync && byte < REPO_FANOUT_DIRS; byte++){
+        if (!atomic_load(&batch->dirty[byte])) { continue; }
+        int fd = repo_fanout_fd(repo, byte, false);
+        trace_count(TRACE_SYSCALLS, 1);
+        if (fd < 0 || fsync(fd) != 0){
+            fprintf(stderr, "object_batch_commit: cannot sync objects/%02x: %s\n", byte, strerror(errno));
+            status = false;
+        }
+        counts.dirs++;
+    }
+    if (counts.dirs){
+        int fd = repo_objects_fd(repo);
+        trace_count(TRACE_SYSCALLS, 1);
+        if (fd < 0 || fsync(fd) != 0){
+            fprintf(stderr, "object_batch_commit: cannot sync %s/objects: %s\n", repo->gitdir, strerror(errno));
+            status = false;
+        }
+        counts.dirs++;
+    }
+
+    if (stats) { *stats = counts; }
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->staged);
+    free(batch);
+    return status;
+}
+
+/**
+ * object_hash_fd - Hashes the contents of a file descriptor as an object.
+ *
+ * Regular files are read exactly once in OBJECT_CHUNK_SIZE pieces, and each
+ * piece goes to both the SHA-1 state and the deflate stream, so memory use
+ * is constant in the file size. Pipes and other unsized inputs are read
+ * into memory first because the header needs the size before any data.
+ *
+ * @param repo Repository to store the object in, or NULL to only hash.
+ * @param fd   The descriptor to read from, positioned at the start of the data.
+ * @param type The object type.
+ * @param sha  Output for the object's binary SHA.
+ * @return True on success, false on read errors, if the file changed size
+ * while being read, or if the object could not be stored.
+ */
+bool object_hash_fd(Repository *repo, int fd, ObjectType type, unsigned char sha[SHA_SIZE]){
+    struct stat sb;
+    if (fstat(fd, &sb) < 0){
+        fprintf(stderr, "object_hash_fd: %s\n", strerror(errno));
+        return false;
+    }
+
+    unsigned char *buffer = safe_malloc(sizeof(unsigned char), OBJECT_CHUNK_SIZE);
+
+    if (!S_ISREG(sb.st_mode)){
+        size_t len = 0, capacity = OBJECT_CHUNK_SIZE;
+        ssize_t n;
+        while ((n = read(fd, buffer + len, capacity - len)) != 0){
+            if (n < 0){
+                if (errno == EINTR) { continue; }
+                fprintf(stderr, "object_hash_fd: read failed: %s\n", strerror(errno));
+                free(buffer);
+                return false;
+            }
+            len += (size_t)n;
+            if (len == capacity){
+                capacity *= 2;
+                buffer = realloc(buffer, capacity);
+                MALLOC_CHECK(buffer);
+            }
+        }
+        bool status = object_write_buffer(repo, type, buffer, len, sha);
+        free(buffer);
+        return status;
+    }
+
+    /* pipes went through object_write_buffer(), which traces itself */
+    TRACE_SCOPE(TRACE_OBJECT_WRITE);
+    ObjectWriter *writer = safe_malloc(sizeof(ObjectWriter), 1);
+    bool status = object_writer_begin(writer, repo, type, (size_t)sb.st_size);
+
+    while (status){
+        ssize_t n = read(fd, buffer, OBJECT_CHUNK_SIZE);
+        trace_count(TRACE_SYSCALLS, 1);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0){
+            fprintf(stderr, "object_hash_fd: read failed: %s\n", strerror(errno));
+            object_writer_abort(writer);
+            status = false;
+            break;
+        }
+        if (n == 0) { break; }
+        status = object_writer_update(writer, buffer, (size_t)n);
+    }
+    if (status) { status = object_writer_finish(writer, sha); }
+
+    free(writer);
+    free(buffer);
+    return status;
+}
+
+/**
+ * commit_date - Decodes a commit's committer timestamp.
+ *
+ * @param commit The commit.
+ * @return Seconds since the epoch from the committer line, or 0 if it is
+ * missing or malformed.
+ */
+uint64_t commit_date(const GitCommit *commit){
+    if (!commit) { return 0; }
+
+    const KvlmField *field = kvlm_get(&commit->kvlm, "committer", 0);
+    if (!field || field->multiline) { return 0; }
+
+    /* "Name <email> 1527025044 +0200": the time follows the last '>'. */
+    const unsigned char *p = commit->kvlm.data + field->value_off;
+    const unsigned char *end = p + field->value_len;
+    const unsigned char *gt = end;
+    while (gt > p && gt[-1] != '>') { gt--; }
+    if (gt == p) { return 0; }
+
+    uint64_t date = 0;
+    for (p = gt; p < end && *p == ' '; p++) { }
+    for (; p < end && *p >= '0' && *p <= '9'; p++) { date = date * 10 + (uint64_t)(*p - '0'); }
+    return date;
+}
+
+/**
+ * tree_lookup_path - Resolves a slash-separated path below a tree.
+ *
+ * Each component is found with tree_find(); intermediate trees are loaded
+ * through the object cache.
+ *
+ * @param repo The repository holding the subtrees.
+ * @param tree The tree the path is relative to.
+ * @param path The path, e.g. "src/objects.c".
+ * @param leaf Output for a copy of the entry found.
+ * @return True if the path exists, false otherwise.
+ */
+bool tree_lookup_path(Repository *repo, const GitTree *tree, const char *path, TreeLeaf *leaf){
+    if (!repo || !tree || !path || !leaf) { return false; }
+
+    for (;;){
+        while (*path == '/') { path++; }
+        const char *slash = strchr(path, '/');
+        size_t len = slash ? (size_t)(slash - path) : strlen(path);
+        if (!len) { return false; }
+
+        const TreeLeaf *found = tree_find(&tree->tree, path, len);
+        if (!found) { return false; }
+
+        path += len;
+        while (*path == '/') { path++; }
+        if (!*path){
+            *leaf = *found;
+            return true;
+        }
+
+        if (!tree_leaf_is_tree(found)) { return false; }
+        tree = (const GitTree *)object_get(repo, found->sha);
+        if (!tree || tree->object.type != OBJ_TREE) { return false; }
+    }
+}
+
+/* Static Functions */
+
+/**
+ * object_open_loose - Opens the file backing a loose object.
+ *
+ * @param repo The repository containing the object.
+ * @param sha  The 20-byte binary SHA of the object.
+ * @return A read-only file descriptor, or -1 if the object does not exist
+ * (silently) or cannot be opened (with a message).
+ */
+static int object_open_loose(Repository *repo, const unsigned char sha[SHA_SIZE]){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+
+    int dir_fd = repo_fanout_fd(repo, sha[0], false);
+    if (dir_fd < 0){
+        if (errno != ENOENT) { fprintf(stderr, "object_open_loose: cannot open objects/%.2s: %s\n", hex, strerror(errno)); }
+        return -1;
+    }
+
+    int fd = openat(dir_fd, hex + 2, O_RDONLY | O_CLOEXEC);
+    trace_count(TRACE_SYSCALLS, 1);
+    if (fd < 0 && errno != ENOENT){
+        fprintf(stderr, "object_open_loose: cannot open objects/%.2s/%s: %s\n", hex, hex + 2, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * stream_open_packed - Opens a stream over an entry of a mapped pack.
+ *
+ * A whole object is inflated straight out of the mapping as it is read. A
+ * delta has to be resolved in full first; the result is then handed out from
+ * memory in OBJECT_CHUNK_SIZE slices.
+ *
+ * @param repo   The repository, for delta bases and the delta base cache.
+ * @param pack   The pack holding the entry.
+ * @param offset Offset of the entry in the packfile.
+ * @param sha    The object's SHA, for error messages.
+ * @return The stream, or NULL if the entry or its delta chain is malformed.
+ */
+static ObjectStream *stream_open_packed(Repository *repo, Pack *pack, uint64_t offset, const unsigned char sha[SHA_SIZE]){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+
+    int type;
+    size_t size, header_len;
+    size_t end = pack->pack_size - SHA_SIZE;
+    if (!pack_entry_header(pack->pack_map + offset, end - offset, &type, &size, &header_len)){
+        fprintf(stderr, "stream_open_packed: bad entry header for %s\n", hex);
+        return NULL;
+    }
+    if (type == PACK_OFS_DELTA || type == PACK_REF_DELTA){
+        unsigned char *body = pack_read_object(repo, pack, offset, &type, &size);
+        if (!body){
+            fprintf(stderr, "stream_open_packed: cannot resolve delta for %s\n", hex);
+            return NULL;
+        }
+        ObjectStream *stream = stream_alloc();
+        stream->fd = -1;
+        stream->type = (ObjectType)type;
+        stream->size = size;
+        stream->remaining = size;
+        stream->resolved = body;
+        stream->pending = body;
+        stream->pending_len = size;
+        stream->input_eof = true;
+        stream->stream_end = true;
+        return stream;
+    }
+
+    ObjectStream *stream = stream_alloc();
+    stream->fd = -1;
+    stream->type = (ObjectType)type;
+    stream->size = size;
+    stream->remaining = size;
+    stream->map = pack->pack_map + offset + header_len;
+    stream->map_left = end - offset - header_len;
+
+    if (inflateInit(&stream->zs) != Z_OK){
+        fprintf(stderr, "stream_open_packed: inflateInit failed for %s\n", hex);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+/**
+ * parse_header - Parses an object header of the form "<type> <size>\0".
+ *
+ * @param buf        Inflated bytes starting at the beginning of the object.
+ * @param have       Number of valid bytes in buf.
+ * @param type       Output for the object type.
+ * @param size       Output for the announced body size.
+ * @param header_len Output for the header length including the NUL byte.
+ * @return True if the header is well formed and of a known type, false otherwise.
+ */
+static bool parse_header(const unsigned char *buf, size_t have, ObjectType *type, size_t *size, size_t *header_len){
+    size_t limit = min(have, (size_t)OBJECT_HEADER_MAX);
+    const unsigned char *space = memchr(buf, ' ', limit);
+    const unsigned char *nul = memchr(buf, '\0', limit);
+    if (!space || !nul || nul < space + 2) { return false; }
+
+    *type = object_type_from_name((const char *)buf, (size_t)(space - buf));
+    if (*type == OBJ_NONE) { return false; }
+
+    size_t value = 0;
+    for (const unsigned char *p = space + 1; p < nul; p++){
+        if (*p < '0' || *p > '9') { return false; }
+        value = value * 10 + (size_t)(*p - '0');
+    }
+
+    *size = value;
+    *header_len = (size_t)(nul + 1 - buf);
+    return true;
+}
+
+/**
+ * writer_deflate - Compresses bytes into the writer's temporary file.
+ *
+ * @param writer The writer.
+ * @param data   Bytes to compress (may be NULL when len is 0).
+ * @param len    Number of bytes in data.
+ * @param flush  Z_NO_FLUSH while streaming, Z_FINISH to end the stream.
+ * @return True if all output was written, false on zlib or I/O errors.
+ */
+static bool writer_deflate(ObjectWriter *writer, const void *data, size_t len, int flush){
+    z_stream *zs = &writer->zs;
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+
+    int ret;
+    do {
+        zs->next_out = writer->out;
+        zs->avail_out = OBJECT_CHUNK_SIZE;
+        ret = deflate(zs, flush);
+        if (ret == Z_STREAM_ERROR){
+            fprintf(stderr, "writer_deflate: deflate failed\n");
+            return false;
+        }
+        trace_count(TRACE_SYSCALLS, 1);
+        if (!write_all(writer->fd, writer->out, OBJECT_CHUNK_SIZE - zs->avail_out)){
+            fprintf(stderr, "writer_deflate: write to objects/%s failed: %s\n", writer->tmp_name, strerror(errno));
+            return false;
+        }
+    } while (zs->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+    return true;
+}
+
+/**
+ * writer_tmpfile - Creates the writer's temporary file in objects/.
+ *
+ * mkstemp() has no *at() form, so a pid plus a process-wide serial gives
+ * the unique name and O_EXCL catches leftovers from a dead process.
+ *
+ * @param writer The writer; dir_fd must be set, tmp_name receives the name.
+ * @return The file descriptor, or -1 with errno set.
+ */
+static int writer_tmpfile(ObjectWriter *writer){
+    static atomic_uint serial;
+    for (int attempt = 0; attempt < OBJECT_TMP_ATTEMPTS; attempt++){
+        snprintf(writer->tmp_name, sizeof(writer->tmp_name), "tmp_obj_%ld_%u", (long)getpid(), atomic_fetch_add(&serial, 1));
+        int fd = openat(writer->dir_fd, writer->tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        trace_count(TRACE_SYSCALLS, 1);
+        if (fd >= 0 || errno != EEXIST) { return fd; }
+    }
+    errno = EEXIST;
+    return -1;
+}
+
+/**
+ * writer_flush - Pushes the finished temporary file towards the disk.
+ *
+ * Inside a syncing batch only the writeback is started, so the writer does
+ * not wait for the device; object_batch_commit() does, once. Elsewhere
+ * (or without sync_file_range()) the file is fsync()ed.
+ *
+ * @param writer The writer, whose file is still open.
+ * @return True on success (or when syncing is off), false with errno set.
+ */
+static bool writer_flush(ObjectWriter *writer){
+    const ObjectBatch *batch = writer->repo->object_batch;
+    if (batch ? !batch->sync : !object_sync_wanted(writer->repo)) { return true; }
+
+    trace_count(TRACE_SYSCALLS, 1);
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (batch && sync_file_range(writer->fd, 0, 0, SYNC_FILE_RANGE_WRITE) == 0) { return true; }
+#endif
+    return fsync(writer->fd) == 0;
+}
+
+/**
+ * object_place - Renames a finished temporary file to its objects/xx/yyyy... name.
+ *
+ * If the object already exists the temporary file is removed instead.
+ *
+ * @param repo     The repository.
+ * @param from_fd  objects/ handle the temporary file lives under.
+ * @param tmp_name The temporary file's name relative to from_fd.
+ * @param sha      The object's binary SHA.
+ * @param renamed  Output, true if the file was moved into place.
+ * @param dir_fd   Output for the objects/xx handle, or -1.
+ * @return True if the object is now stored, false otherwise.
+ */
+static bool object_place(Repository *repo, int from_fd, const char *tmp_name, const unsigned char sha[SHA_SIZE], bool *renamed, int *dir_fd){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+
+    /* A second attempt covers objects/xx removed under a cached handle. */
+    bool status = false;
+    *renamed = false;
+    for (int attempt = 0; attempt < 2 && !status; attempt++){
+        *dir_fd = repo_fanout_fd(repo, sha[0], true);
+        if (*dir_fd < 0){
+            fprintf(stderr, "object_place: cannot create objects/%.2s: %s\n", hex, strerror(errno));
+            break;
+        }
+        trace_count(TRACE_SYSCALLS, 1);
+        if (faccessat(*dir_fd, hex + 2, F_OK, 0) == 0){
+            status = true;
+        } else if (renameat(from_fd, tmp_name, *dir_fd, hex + 2) == 0){
+            status = *renamed = true;
+        } else if (errno == ENOENT && attempt == 0){
+            repo_fanout_forget(repo, sha[0]);
+        } else {
+            fprintf(stderr, "object_place: cannot rename to objects/%.2s/%s: %s\n", hex, hex + 2, strerror(errno));
+            break;
+        }
+    }
+
+    if (!*renamed) { unlinkat(from_fd, tmp_name, 0); }
+    trace_count(TRACE_SYSCALLS, 1);     /* the rename, or the unlink */
+    return status;
+}
+
+/**
+ * batch_stage - Records a finished temporary file for object_batch_commit() to move into place.
+ *
+ * @param batch    The open, syncing batch.
+ * @param tmp_name The temporary file's name under objects/.
+ * @param sha      The object's binary SHA.
+ * @return True.
+ */
+static bool batch_stage(ObjectBatch *batch, const char *tmp_name, const unsigned char sha[SHA_SIZE]){
+    pthread_mutex_lock(&batch->lock);
+    if (batch->count == batch->alloc){
+        batch->alloc = batch->alloc ? batch->alloc * 2 : OBJECT_BATCH_INITIAL;
+        batch->staged = realloc(batch->staged, batch->alloc * sizeof(ObjectBatchEntry));
+        MALLOC_CHECK(batch->staged);
+    }
+    ObjectBatchEntry *entry = &batch->staged[batch->count++];
+    snprintf(entry->tmp_name, sizeof(entry->tmp_name), "%s", tmp_name);
+    memcpy(entry->sha, sha, SHA_SIZE);
+    pthread_mutex_unlock(&batch->lock);
+    return true;
+}
+
+/**
+ * object_sync_wanted - Tells whether new objects must reach the disk (core.fsyncObjectFiles).
+ */
+static bool object_sync_wanted(Repository *repo){
+    return config_get_bool(repo->config, "core.fsyncObjectFiles", false);
+}
+
+/**
+ * stream_alloc - Allocates a stream with every field but its buffers zeroed.
+ *
+ * The in/out buffers are 128KiB together; clearing them cost more than
+ * inflating a typical object, and they are always written before being read.
+ */
+static ObjectStream *stream_alloc(void){
+    ObjectStream *stream = safe_malloc(sizeof(ObjectStream), 1);
+    memset(stream, 0, offsetof(ObjectStream, in));
+    return stream;
+}
+
+/**
+ * stream_inflate - Inflates up to OBJECT_CHUNK_SIZE bytes into stream->out.
+ *
+ * Input is refilled from the file descriptor (or the pack mapping) whenever
+ * zlib has consumed the previous piece. The function returns as soon as any output was produced so
+ * that callers see data with the minimum amount of buffering.
+ *
+ * @param stream The stream to advance.
+ * @return The number of bytes written to stream->out, 0 if the deflate
+ * stream ended without further output, or -1 on I/O or zlib errors.
+ */
+static ssize_t stream_inflate(ObjectStream *stream){
+    z_stream *zs = &stream->zs;
+    zs->next_out = stream->out;
+    zs->avail_out = OBJECT_CHUNK_SIZE;
+
+    while (zs->avail_out == OBJECT_CHUNK_SIZE && !stream->stream_end){
+        if (zs->avail_in == 0 && !stream->input_eof && stream->fd < 0){
+            size_t take = min(stream->map_left, (size_t)UINT32_MAX);
+            zs->next_in = (Bytef *)stream->map;
+            zs->avail_in = (uInt)take;
+            stream->map += take;
+            stream->map_left -= take;
+            stream->input_eof = stream->map_left == 0;
+        } else if (zs->avail_in == 0 && !stream->input_eof){
+            ssize_t n = read(stream->fd, stream->in, OBJECT_CHUNK_SIZE);
+            trace_count(TRACE_SYSCALLS, 1);
+            if (n < 0){
+                if (errno == EINTR) { continue; }
+                fprintf(stderr, "stream_inflate: read failed: %s\n", strerror(errno));
+                return -1;
+            }
+            if (n == 0) { stream->input_eof = true; }
+            zs->next_in = stream->in;
+            zs->avail_in = (uInt)n;
+        }
+
+        int ret = inflate(zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END){
+            stream->stream_end = true;
+        } else if (ret == Z_BUF_ERROR && stream->input_eof && zs->avail_in == 0){
+            fprintf(stderr, "stream_inflate: truncated object\n");
+            return -1;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR){
+            fprintf(stderr, "stream_inflate: inflate failed: %s\n", zs->msg ? zs->msg : "unknown error");
+            return -1;
+        }
+    }
+
+    trace_count(TRACE_INFLATED, OBJECT_CHUNK_SIZE - zs->avail_out);
+    return (ssize_t)(OBJECT_CHUNK_SIZE - zs->avail_out);
+}
+
+/**
+ * stream_parse_header - Parses "<type> <size>\0" out of the first inflated chunk.
+ *
+ * Whatever follows the NUL byte in the chunk is kept as pending body data
+ * so no inflated bytes are discarded.
+ *
+ * @param stream The stream whose out buffer holds the first chunk.
+ * @param have   Number of valid bytes in stream->out.
+ * @return True if the header is well formed and of a known type, false otherwise.
+ */
+static bool stream_parse_header(ObjectStream *stream, size_t have){
+    size_t header_len;
+    if (!parse_header(stream->out, have, &stream->type, &stream->size, &header_len)){ return false; }
+
+    stream->remaining = stream->size;
+    stream->pending = stream->out + header_len;
+    stream->pending_len = have - header_len;
+
+    return stream->pending_len <= stream->size;
+}
+
+/**
+ * cache_slot - Finds the slot holding sha, or the empty slot where it belongs.
+ *
+ * SHAs are uniformly distributed, so their leading bytes make a good hash.
+ *
+ * @param cache The object cache (never full).
+ * @param sha   The 20-byte binary SHA.
+ * @return Pointer to the slot.
+ */
+static GitObject **cache_slot(ObjectCache *cache, const unsigned char sha[SHA_SIZE]){
+    uint64_t h;
+    memcpy(&h, sha, sizeof(h));
+    size_t mask = cache->capacity - 1;
+
+    for (size_t i = (size_t)h & mask; ; i = (i + 1) & mask){
+        GitObject **slot = &cache->slots[i];
+        if (!*slot || memcmp((*slot)->sha, sha, SHA_SIZE) == 0) { return slot; }
+    }
+}
+
+/**
+ * cache_grow - Doubles the object cache and reinserts every object.
+ *
+ * @param cache The object cache.
+ */
+static void cache_grow(ObjectCache *cache){
+    GitObject **old = cache->slots;
+    size_t old_capacity = cache->capacity;
+
+    cache->capacity *= 2;
+    cache->slots = safe_calloc(sizeof(GitObject *), cache->capacity);
+    for (size_t i = 0; i < old_capacity; i++){
+        if (old[i]) { *cache_slot(cache, old[i]->sha) = old[i]; }
+    }
+    free(old);
+}
+
+/**
+ * field_sha - Decodes a kvlm value holding a 40-digit hex object name.
+ *
+ * @param kvlm  The index the field belongs to.
+ * @param field The field, or NULL.
+ * @param sha   Output for the binary SHA.
+ * @return True if the value is exactly one hex object name.
+ */
+static bool field_sha(const Kvlm *kvlm, const KvlmField *field, unsigned char sha[SHA_SIZE]){
+    if (!field || field->multiline || field->value_len != SHA_HEX_SIZE - 1) { return false; }
 
-/* Functions */
\ No newline at end of file
+    char hex[SHA_HEX_SIZE];
+    memcpy(hex, kvlm->data + field->value_off, SHA_HEX_SIZE - 1);
+    hex[SHA_HEX_SIZE - 1] = '\0';
+    return hex_to_sha(hex, sha);
+}
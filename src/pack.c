@@ -0,0 +1,765 @@
+/* pack.c: packfile and pack index (.idx v2) reader */
+
+#include "pack.h"
+#include "delta.h"
+#include "midx.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <zlib.h>
+
+/* Forward Declaration of static Functions */
+
+static void     midx_attach(Repository *repo, const char *dir_path);
+static bool     entry_locate(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size,
+                             uint64_t *data, const Pack **base_pack, uint64_t *base_offset);
+static unsigned char *entry_inflate(const Pack *pack, uint64_t data, size_t size);
+static size_t   entry_inflate_prefix(const Pack *pack, uint64_t data, unsigned char *out, size_t want);
+static size_t   cache_bucket(const Pack *pack, uint64_t offset);
+static void     cache_unlink(DeltaBaseCache *cache, DeltaBaseEntry *entry);
+static void     cache_push(DeltaBaseCache *cache, DeltaBaseEntry *entry);
+
+/* Functions */
+
+/**
+ * pack_open - Maps a pack index and its packfile.
+ *
+ * Both files are mapped read-only in full. The index layout is validated
+ * (version 2, a non-decreasing fan-out, sizes consistent with the object
+ * count) and the packfile header must agree with the index; checksums are
+ * not verified here.
+ *
+ * @param idx_path Path of the .idx file; the .pack is found next to it.
+ * @return A heap-allocated Pack, or NULL if either file is missing or
+ * malformed.
+ * @note The caller is responsible for calling pack_close().
+ */
+Pack *pack_open(const char *idx_path){
+    if (!idx_path) { return NULL; }
+
+    size_t len = strlen(idx_path);
+    if (len < 4 || len >= MAX_PATH || !streq(idx_path + len - 4, ".idx")) { return NULL; }
+
+    Pack *pack = safe_calloc(sizeof(Pack), 1);
+    memcpy(pack->path, idx_path, len - 4);
+    memcpy(pack->path + len - 4, ".pack", 6);
+
+    pack->idx_map = map_file(idx_path, &pack->idx_size);
+    pack->pack_map = map_file(pack->path, &pack->pack_size);
+    if (!pack->idx_map || !pack->pack_map) { goto fail; }
+
+    const unsigned char *idx = pack->idx_map;
+    size_t min_size = 8 + PACK_IDX_FANOUT * 4 + 2 * SHA_SIZE;
+    if (pack->idx_size < min_size || memcmp(idx, PACK_IDX_SIGNATURE, 4) != 0 || get_be32(idx + 4) != 2){
+        fprintf(stderr, "pack_open: %s is not a version 2 pack index\n", idx_path);
+        goto fail;
+    }
+
+    pack->fanout = idx + 8;
+    pack->count = get_be32(pack->fanout + 4 * (PACK_IDX_FANOUT - 1));
+    /* Lookups trust every bucket to end within the table. */
+    for (int i = 1; i < PACK_IDX_FANOUT; i++){
+        if (get_be32(pack->fanout + 4 * (i - 1)) > get_be32(pack->fanout + 4 * i)){
+            fprintf(stderr, "pack_open: %s has a corrupt fan-out table\n", idx_path);
+            goto fail;
+        }
+    }
+    size_t table_size = (size_t)pack->count * (SHA_SIZE + 4 + 4);
+    if (pack->idx_size < min_size + table_size){
+        fprintf(stderr, "pack_open: %s is truncated\n", idx_path);
+        goto fail;
+    }
+
+    pack->oids = pack->fanout + PACK_IDX_FANOUT * 4;
+    pack->offsets = pack->oids + (size_t)pack->count * (SHA_SIZE + 4);
+    pack->large_offsets = pack->offsets + (size_t)pack->count * 4;
+    pack->large_count = (pack->idx_size - min_size - table_size) / 8;
+
+    const unsigned char *hdr = pack->pack_map;
+    if (pack->pack_size < PACK_HEADER_SIZE + SHA_SIZE || memcmp(hdr, PACK_SIGNATURE, 4) != 0 ||
+        (get_be32(hdr + 4) != 2 && get_be32(hdr + 4) != 3) || get_be32(hdr + 8) != pack->count){
+        fprintf(stderr, "pack_open: %s does not match its index\n", pack->path);
+        goto fail;
+    }
+
+    return pack;
+
+fail:
+    pack_close(pack);
+    return NULL;
+}
+
+/**
+ * pack_close - Unmaps a pack and frees it.
+ *
+ * @param pack The pack to close; NULL is ignored. The next pointer is not followed.
+ */
+void pack_close(Pack *pack){
+    if (!pack) { return; }
+
+    if (pack->idx_map)  { munmap((void *)pack->idx_map, pack->idx_size); }
+    if (pack->pack_map) { munmap((void *)pack->pack_map, pack->pack_size); }
+    free(pack);
+}
+
+/**
+ * pack_find - Looks up an object in a single pack index.
+ *
+ * The first byte of the SHA selects a fan-out bucket, which bounds a binary
+ * search over the sorted object names. No file I/O is involved.
+ *
+ * @param pack   The pack to search.
+ * @param sha    The 20-byte binary SHA.
+ * @param offset Output for the entry's offset in the packfile (may be NULL).
+ * @return True if the object is in this pack, false otherwise.
+ */
+bool pack_find(const Pack *pack, const unsigned char sha[SHA_SIZE], uint64_t *offset){
+    uint32_t pos;
+    if (!pack_position(pack, sha, &pos)) { return false; }
+
+    uint64_t off = pack_offset_at(pack, pos);
+    if (off < PACK_HEADER_SIZE || off >= pack->pack_size - SHA_SIZE) { return false; }
+    if (offset) { *offset = off; }
+    return true;
+}
+
+/**
+ * pack_position - Finds where an object sits in a pack index's sorted table.
+ *
+ * @param pack The pack to search.
+ * @param sha  The 20-byte binary SHA.
+ * @param pos  Output for its position.
+ * @return True if the object is in this pack, false otherwise.
+ */
+bool pack_position(const Pack *pack, const unsigned char sha[SHA_SIZE], uint32_t *pos){
+    if (!pack || !sha) { return false; }
+
+    uint32_t lo = sha[0] ? get_be32(pack->fanout + 4 * (sha[0] - 1)) : 0;
+    uint32_t hi = get_be32(pack->fanout + 4 * sha[0]);
+
+    while (lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(pack->oids + (size_t)mid * SHA_SIZE, sha, SHA_SIZE);
+        if (cmp == 0){
+            *pos = mid;
+            return true;
+        }
+        if (cmp < 0) { lo = mid + 1; }
+        else         { hi = mid; }
+    }
+    return false;
+}
+
+/**
+ * pack_offset_at - Reads the packfile offset of the pos-th index entry.
+ *
+ * @param pack The pack.
+ * @param pos  Position in the sorted object table.
+ * @return The offset, or 0 if it points outside the large offset table.
+ */
+uint64_t pack_offset_at(const Pack *pack, uint32_t pos){
+    uint32_t off = get_be32(pack->offsets + (size_t)pos * 4);
+    if (!(off & 0x80000000u)) { return off; }
+
+    size_t large = off & 0x7fffffffu;
+    if (large >= pack->large_count) { return 0; }
+    return get_be64(pack->large_offsets + large * 8);
+}
+
+/**
+ * pack_entry_header - Decodes the type and size varint at the start of a pack entry.
+ *
+ * @param p          Pointer to the first byte of the entry.
+ * @param left       Bytes available from p to the end of the pack data.
+ * @param type       Output for the 3-bit entry type (1-4, or a delta type).
+ * @param size       Output for the inflated size (of the delta for delta entries).
+ * @param header_len Output for the number of bytes consumed.
+ * @return True if a complete, valid header was decoded, false otherwise.
+ */
+bool pack_entry_header(const unsigned char *p, size_t left, int *type, size_t *size, size_t *header_len){
+    if (!p || left == 0) { return false; }
+
+    size_t used = 0;
+    unsigned char c = p[used++];
+    *type = (c >> 4) & 7;
+    size_t value = c & 15;
+    unsigned shift = 4;
+
+    while (c & 0x80){
+        if (used >= left || shift > 8 * sizeof(size_t) - 7) { return false; }
+        c = p[used++];
+        value |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    if (*type == 0 || *type == 5) { return false; }
+    *size = value;
+    *header_len = used;
+    return true;
+}
+
+/**
+ * pack_list - Returns the repository's packs, mapping them on first use.
+ *
+ * Every .idx under objects/pack with a matching .pack is opened once and kept
+ * for the lifetime of the repository, together with the delta base cache
+ * sized from core.deltaBaseCacheLimit and the multi-pack-index, if any.
+ *
+ * @param repo The repository.
+ * @return The head of the pack list, or NULL if the repository has no packs.
+ * @note Not safe to call concurrently before the first call has returned.
+ */
+Pack *pack_list(Repository *repo){
+    if (!repo) { return NULL; }
+    if (repo->packs_loaded) { return repo->packs; }
+    repo->packs_loaded = true;
+    repo->delta_cache = delta_base_cache_create(repo->config ? repo->config->delta_base_cache_limit : DELTA_BASE_CACHE_LIMIT);
+
+    char *dir_path = repo_path(repo, "objects", "pack", NULL);
+    DIR *d = opendir(dir_path);
+    if (!d){
+        free(dir_path);
+        return NULL;
+    }
+
+    for (struct dirent *e = readdir(d); e; e = readdir(d)){
+        size_t len = strlen(e->d_name);
+        if (len < 4 || !streq(e->d_name + len - 4, ".idx")) { continue; }
+
+        char *idx_path = path_join(dir_path, e->d_name, NULL);
+        Pack *pack = pack_open(idx_path);
+        free(idx_path);
+        if (!pack) { continue; }
+
+        pack->next = repo->packs;
+        repo->packs = pack;
+    }
+
+    closedir(d);
+    trace_count(TRACE_SYSCALLS, 3);    /* opendir, getdents, closedir */
+    midx_attach(repo, dir_path);
+    free(dir_path);
+    return repo->packs;
+}
+
+/**
+ * pack_lookup - Finds the pack holding an object.
+ *
+ * Packs covered by the multi-pack-index are searched with a single binary
+ * search over its merged table; only packs added since it was written are
+ * probed one by one.
+ *
+ * @param repo   The repository.
+ * @param sha    The 20-byte binary SHA.
+ * @param offset Output for the entry's offset within the returned pack.
+ * @return The pack containing the object, or NULL if no pack has it.
+ */
+Pack *pack_lookup(Repository *repo, const unsigned char sha[SHA_SIZE], uint64_t *offset){
+    TRACE_SCOPE(TRACE_PACK_LOOKUP);
+    Pack *packs = pack_list(repo);
+
+    uint32_t id;
+    uint64_t off;
+    if (repo->midx && midx_find(repo->midx, sha, &id, &off)){
+        Pack *pack = repo->midx->packs[id];
+        if (off < PACK_HEADER_SIZE || off >= pack->pack_size - SHA_SIZE) { return NULL; }
+        if (offset) { *offset = off; }
+        return pack;
+    }
+    for (Pack *pack = packs; pack; pack = pack->next){
+        if (!pack->in_midx && pack_find(pack, sha, offset)) { return pack; }
+    }
+    return NULL;
+}
+
+/**
+ * pack_list_free - Unmaps all packs of a repository.
+ *
+ * @param repo The repository; its pack list and delta base cache are reset so
+ * they may be reloaded.
+ */
+void pack_list_free(Repository *repo){
+    if (!repo) { return; }
+
+    Pack *pack = repo->packs;
+    while (pack){
+        Pack *next = pack->next;
+        pack_close(pack);
+        pack = next;
+    }
+    repo->packs = NULL;
+    repo->packs_loaded = false;
+    midx_close(repo->midx);
+    repo->midx = NULL;
+    delta_base_cache_destroy(repo->delta_cache);
+    repo->delta_cache = NULL;
+}
+
+/**
+ * pack_read_object - Reads a pack entry in full, resolving delta chains.
+ *
+ * The chain is walked iteratively from the requested entry towards its base,
+ * stopping early at the first link found in the repository's delta base
+ * cache. Deltas are then applied base-first; every intermediate object is
+ * offered to the cache so that siblings sharing a base (the common case in a
+ * tree or history walk) only inflate it once.
+ *
+ * @param repo   The repository, used to resolve REF_DELTA bases in other packs.
+ * @param pack   The pack holding the entry.
+ * @param offset Offset of the entry in the packfile.
+ * @param type   Output for the object type (1-4).
+ * @param size   Output for the object size.
+ * @return A heap-allocated object body, or NULL if the entry or any link of
+ * its chain is corrupt or missing.
+ * @note The caller MUST free() the returned buffer. Safe to call from
+ * several threads once pack_list() has returned.
+ */
+unsigned char *pack_read_object(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size){
+    if (!repo || !pack || !type || !size) { return NULL; }
+
+    DeltaBaseCache *cache = repo->delta_cache;
+    DeltaLink *links = NULL;
+    size_t count = 0, capacity = 0;
+    unsigned char *base = NULL;
+    size_t base_size = 0;
+    int base_type = 0;
+    const Pack *at_pack = pack;
+    uint64_t at = offset;
+
+    for (;;){
+        if (cache && delta_base_cache_get(cache, at_pack, at, &base_type, &base, &base_size)) { break; }
+
+        int t;
+        size_t sz;
+        uint64_t data, base_offset;
+        const Pack *base_pack;
+        if (!entry_locate(repo, at_pack, at, &t, &sz, &data, &base_pack, &base_offset)) { goto fail; }
+
+        if (t != PACK_OFS_DELTA && t != PACK_REF_DELTA){
+            base = entry_inflate(at_pack, data, sz);
+            if (!base) { goto fail; }
+            base_type = t;
+            base_size = sz;
+            break;
+        }
+
+        if (count == PACK_DELTA_DEPTH_MAX){
+            fprintf(stderr, "pack_read_object: delta chain too deep in %s\n", pack->path);
+            goto fail;
+        }
+        if (count == capacity){
+            capacity = capacity ? 2 * capacity : 16;
+            links = realloc(links, capacity * sizeof(DeltaLink));
+            MALLOC_CHECK(links);
+        }
+        links[count++] = (DeltaLink){ .pack = at_pack, .offset = at, .data = data, .size = sz };
+        at_pack = base_pack;
+        at = base_offset;
+    }
+
+    while (count){
+        DeltaLink *link = &links[--count];
+        unsigned char *delta = entry_inflate(link->pack, link->data, link->size);
+        if (!delta) { goto fail; }
+
+        size_t result_size;
+        unsigned char *result = delta_apply(base, base_size, delta, link->size, &result_size);
+        free(delta);
+        if (!result) { goto fail; }
+
+        if (cache) { delta_base_cache_put(cache, at_pack, at, base_type, base, base_size); }
+        else       { free(base); }
+        base = result;
+        base_size = result_size;
+        at_pack = link->pack;
+        at = link->offset;
+    }
+
+    free(links);
+    *type = base_type;
+    *size = base_size;
+    return base;
+
+fail:
+    free(base);
+    free(links);
+    return NULL;
+}
+
+/**
+ * pack_read_header - Determines the type and size of a pack entry cheaply.
+ *
+ * For a delta the size comes from the first bytes of its own delta header
+ * and the type from the end of its chain, whose entry headers are decoded
+ * without inflating any bodies.
+ *
+ * @param repo   The repository, used to resolve REF_DELTA bases in other packs.
+ * @param pack   The pack holding the entry.
+ * @param offset Offset of the entry in the packfile.
+ * @param type   Output for the object type (1-4).
+ * @param size   Output for the object size.
+ * @return True on success, false if the entry or its chain is corrupt.
+ */
+bool pack_read_header(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size){
+    if (!repo || !pack || !type || !size) { return false; }
+
+    int t;
+    size_t sz;
+    uint64_t data, base_offset;
+    const Pack *base_pack;
+    if (!entry_locate(repo, pack, offset, &t, &sz, &data, &base_pack, &base_offset)) { return false; }
+
+    if (t != PACK_OFS_DELTA && t != PACK_REF_DELTA){
+        *type = t;
+        *size = sz;
+        return true;
+    }
+
+    unsigned char prefix[2 * 10];
+    size_t have = entry_inflate_prefix(pack, data, prefix, min(sizeof(prefix), sz));
+    size_t base_size;
+    if (!delta_header(prefix, have, &base_size, size, NULL)){
+        fprintf(stderr, "pack_read_header: bad delta header in %s\n", pack->path);
+        return false;
+    }
+
+    for (size_t depth = 0; depth < PACK_DELTA_DEPTH_MAX; depth++){
+        pack = base_pack;
+        offset = base_offset;
+        if (!entry_locate(repo, pack, offset, &t, &sz, &data, &base_pack, &base_offset)) { return false; }
+        if (t != PACK_OFS_DELTA && t != PACK_REF_DELTA){
+            *type = t;
+            return true;
+        }
+    }
+
+    fprintf(stderr, "pack_read_header: delta chain too deep in %s\n", pack->path);
+    return false;
+}
+
+/**
+ * delta_base_cache_create - Allocates an empty delta base cache.
+ *
+ * @param limit Byte budget; bodies larger than this are never cached.
+ * @return The cache.
+ * @note The caller is responsible for calling delta_base_cache_destroy().
+ */
+DeltaBaseCache *delta_base_cache_create(size_t limit){
+    DeltaBaseCache *cache = safe_calloc(sizeof(DeltaBaseCache), 1);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->limit = limit;
+    return cache;
+}
+
+/**
+ * delta_base_cache_get - Looks up a cached base and marks it recently used.
+ *
+ * The body is copied out under the lock, so the caller's buffer stays valid
+ * even if another thread evicts the entry right after.
+ *
+ * @param cache  The cache.
+ * @param pack   Pack of the entry.
+ * @param offset Offset of the entry.
+ * @param type   Output for the object type.
+ * @param data   Output for a heap-allocated copy of the body.
+ * @param size   Output for the body size.
+ * @return True on a hit, false otherwise (outputs untouched).
+ * @note The caller MUST free() *data after a hit.
+ */
+bool delta_base_cache_get(DeltaBaseCache *cache, const Pack *pack, uint64_t offset, int *type, unsigned char **data, size_t *size){
+    if (!cache) { return false; }
+
+    pthread_mutex_lock(&cache->lock);
+    DeltaBaseEntry *entry = cache->buckets[cache_bucket(pack, offset)];
+    while (entry && (entry->pack != pack || entry->offset != offset)) { entry = entry->chain; }
+
+    if (!entry){
+        cache->misses++;
+        pthread_mutex_unlock(&cache->lock);
+        return false;
+    }
+
+    cache_unlink(cache, entry);
+    cache_push(cache, entry);
+    cache->hits++;
+    *type = entry->type;
+    *size = entry->size;
+    *data = safe_malloc(sizeof(unsigned char), entry->size ? entry->size : 1);
+    memcpy(*data, entry->data, entry->size);
+    pthread_mutex_unlock(&cache->lock);
+    return true;
+}
+
+/**
+ * delta_base_cache_put - Adds a base, evicting least recently used ones.
+ *
+ * @param cache  The cache; when NULL, data is simply freed.
+ * @param pack   Pack of the entry.
+ * @param offset Offset of the entry.
+ * @param type   Object type of the body.
+ * @param data   Heap-allocated body; ownership passes to the cache.
+ * @param size   Body size.
+ */
+void delta_base_cache_put(DeltaBaseCache *cache, const Pack *pack, uint64_t offset, int type, unsigned char *data, size_t size){
+    if (!cache || size > cache->limit){
+        free(data);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    size_t bucket = cache_bucket(pack, offset);
+    for (DeltaBaseEntry *e = cache->buckets[bucket]; e; e = e->chain){
+        if (e->pack == pack && e->offset == offset){
+            cache_unlink(cache, e);
+            cache_push(cache, e);
+            pthread_mutex_unlock(&cache->lock);
+            free(data);
+            return;
+        }
+    }
+
+    DeltaBaseEntry *entry = safe_malloc(sizeof(DeltaBaseEntry), 1);
+    *entry = (DeltaBaseEntry){ .pack = pack, .offset = offset, .type = type, .data = data, .size = size };
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache_push(cache, entry);
+    cache->used += size;
+
+    while (cache->used > cache->limit){
+        DeltaBaseEntry *victim = cache->oldest;
+        DeltaBaseEntry **link = &cache->buckets[cache_bucket(victim->pack, victim->offset)];
+        while (*link != victim) { link = &(*link)->chain; }
+        *link = victim->chain;
+        cache_unlink(cache, victim);
+        cache->used -= victim->size;
+        free(victim->data);
+        free(victim);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * delta_base_cache_destroy - Frees a cache and every body it holds.
+ *
+ * @param cache The cache; NULL is ignored.
+ */
+void delta_base_cache_destroy(DeltaBaseCache *cache){
+    if (!cache) { return; }
+
+    DeltaBaseEntry *entry = cache->newest;
+    while (entry){
+        DeltaBaseEntry *older = entry->older;
+        free(entry->data);
+        free(entry);
+        entry = older;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/* Static Functions */
+
+/**
+ * midx_attach - Maps the multi-pack-index and matches its names to the opened packs.
+ *
+ * If any pack it names is gone (removed by hand, or by a repack that did
+ * not rewrite the index), the index is ignored and every pack is probed.
+ */
+static void midx_attach(Repository *repo, const char *dir_path){
+    char path[MAX_PATH];
+    if (!path_join_buf(path, sizeof(path), dir_path, "multi-pack-index", NULL) || !file_exists(path)) { return; }
+    MultiPackIndex *midx = midx_open(path);
+    if (!midx) { return; }
+
+    for (uint32_t i = 0; i < midx->pack_count; i++){
+        size_t len = strlen(midx->pack_names[i]) - 4;   /* without ".idx" */
+        for (Pack *pack = repo->packs; pack && !midx->packs[i]; pack = pack->next){
+            const char *base = strrchr(pack->path, '/') + 1;
+            if (strncmp(base, midx->pack_names[i], len) == 0 && streq(base + len, ".pack")) { midx->packs[i] = pack; }
+        }
+        if (!midx->packs[i]){
+            midx_close(midx);
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < midx->pack_count; i++) { midx->packs[i]->in_midx = true; }
+    repo->midx = midx;
+}
+
+/**
+ * entry_locate - Decodes an entry header and, for deltas, finds the base.
+ *
+ * @param repo        The repository, for REF_DELTA bases outside this pack.
+ * @param pack        The pack.
+ * @param offset      Offset of the entry.
+ * @param type        Output for the entry type.
+ * @param size        Output for the inflated size of the entry's data.
+ * @param data        Output for the offset of the compressed data.
+ * @param base_pack   Output for the pack holding the base (deltas only).
+ * @param base_offset Output for the base entry's offset (deltas only).
+ * @return True on success, false if the entry is malformed or its base is missing.
+ */
+static bool entry_locate(Repository *repo, const Pack *pack, uint64_t offset, int *type, size_t *size,
+                         uint64_t *data, const Pack **base_pack, uint64_t *base_offset){
+    size_t end = pack->pack_size - SHA_SIZE;
+    size_t header_len;
+    if (offset < PACK_HEADER_SIZE || offset >= end ||
+        !pack_entry_header(pack->pack_map + offset, end - offset, type, size, &header_len)){
+        fprintf(stderr, "entry_locate: bad entry at %llu in %s\n", (unsigned long long)offset, pack->path);
+        return false;
+    }
+
+    const unsigned char *p = pack->pack_map + offset + header_len;
+    const unsigned char *limit = pack->pack_map + end;
+
+    if (*type == PACK_OFS_DELTA){
+        if (p >= limit) { return false; }
+        unsigned char c = *p++;
+        uint64_t distance = c & 0x7f;
+        while (c & 0x80){
+            if (p >= limit || distance > (UINT64_MAX >> 7) - 1) { return false; }
+            c = *p++;
+            distance = ((distance + 1) << 7) | (c & 0x7f);
+        }
+        if (distance == 0 || distance > offset - PACK_HEADER_SIZE){
+            fprintf(stderr, "entry_locate: bad delta base offset in %s\n", pack->path);
+            return false;
+        }
+        *base_pack = pack;
+        *base_offset = offset - distance;
+    } else if (*type == PACK_REF_DELTA){
+        if ((size_t)(limit - p) < SHA_SIZE) { return false; }
+        if (pack_find(pack, p, base_offset)) { *base_pack = pack; }
+        else                                 { *base_pack = pack_lookup(repo, p, base_offset); }
+        if (!*base_pack){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(p, hex);
+            fprintf(stderr, "entry_locate: delta base %s not found in any pack\n", hex);
+            return false;
+        }
+        p += SHA_SIZE;
+    }
+
+    *data = (uint64_t)(p - pack->pack_map);
+    return true;
+}
+
+/**
+ * entry_inflate - Inflates an entry's data, which must be exactly size bytes.
+ *
+ * @param pack The pack.
+ * @param data Offset of the compressed data.
+ * @param size Expected inflated size.
+ * @return A heap-allocated buffer, or NULL if the data is corrupt.
+ */
+static unsigned char *entry_inflate(const Pack *pack, uint64_t data, size_t size){
+    unsigned char *out = safe_malloc(sizeof(unsigned char), size ? size : 1);
+
+    z_stream zs = {0};
+    if (inflateInit(&zs) != Z_OK){
+        free(out);
+        return NULL;
+    }
+
+    const unsigned char *in = pack->pack_map + data;
+    size_t in_left = pack->pack_size - SHA_SIZE - data;
+    size_t out_left = size;
+    zs.next_out = out;
+    int ret;
+
+    /* Once in or out is exhausted inflate() stops with Z_BUF_ERROR, which
+     * catches both truncated data and a body longer than announced. */
+    do {
+        if (zs.avail_in == 0 && in_left){
+            size_t take = min(in_left, (size_t)UINT32_MAX);
+            zs.next_in = (Bytef *)in;
+            zs.avail_in = (uInt)take;
+            in += take;
+            in_left -= take;
+        }
+        if (zs.avail_out == 0 && out_left){
+            size_t take = min(out_left, (size_t)UINT32_MAX);
+            zs.avail_out = (uInt)take;
+            out_left -= take;
+        }
+        ret = inflate(&zs, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+
+    bool ok = ret == Z_STREAM_END && zs.total_out == size;
+    trace_count(TRACE_INFLATED, zs.total_out);
+    inflateEnd(&zs);
+    if (!ok){
+        fprintf(stderr, "entry_inflate: corrupt entry data at %llu in %s\n", (unsigned long long)data, pack->path);
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * entry_inflate_prefix - Inflates only the first bytes of an entry's data.
+ *
+ * @param pack The pack.
+ * @param data Offset of the compressed data.
+ * @param out  Output buffer.
+ * @param want Number of bytes wanted.
+ * @return The number of bytes produced (less than want if the data is short or corrupt).
+ */
+static size_t entry_inflate_prefix(const Pack *pack, uint64_t data, unsigned char *out, size_t want){
+    z_stream zs = {0};
+    if (inflateInit(&zs) != Z_OK) { return 0; }
+
+    size_t in_left = pack->pack_size - SHA_SIZE - data;
+    zs.next_in = (Bytef *)(pack->pack_map + data);
+    zs.avail_in = (uInt)min(in_left, (size_t)UINT32_MAX);
+    zs.next_out = out;
+    zs.avail_out = (uInt)want;
+    while (zs.avail_out && inflate(&zs, Z_SYNC_FLUSH) == Z_OK) {}
+
+    size_t have = want - zs.avail_out;
+    trace_count(TRACE_INFLATED, have);
+    inflateEnd(&zs);
+    return have;
+}
+
+/**
+ * cache_bucket - Hashes a (pack, offset) key into the cache's bucket table.
+ */
+static size_t cache_bucket(const Pack *pack, uint64_t offset){
+    uint64_t h = (uint64_t)(uintptr_t)pack ^ (offset * 0x9e3779b97f4a7c15ull);
+    return (size_t)(h >> 32) % DELTA_BASE_CACHE_BUCKETS;
+}
+
+/**
+ * cache_unlink - Removes an entry from the LRU list (not from its bucket).
+ */
+static void cache_unlink(DeltaBaseCache *cache, DeltaBaseEntry *entry){
+    if (entry->newer) { entry->newer->older = entry->older; }
+    else              { cache->newest = entry->older; }
+    if (entry->older) { entry->older->newer = entry->newer; }
+    else              { cache->oldest = entry->newer; }
+    entry->newer = entry->older = NULL;
+}
+
+/**
+ * cache_push - Makes an entry the most recently used.
+ */
+static void cache_push(DeltaBaseCache *cache, DeltaBaseEntry *entry){
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest) { cache->newest->newer = entry; }
+    else               { cache->oldest = entry; }
+    cache->newest = entry;
+}
@@ -0,0 +1,685 @@
+/* pack_bitmap.c: reachability bitmaps (.bitmap) of a pack */
+
+#include "pack_bitmap.h"
+#include "ewah.h"
+#include "objects.h"
+#include "pack.h"
+#include "refs.h"
+#include "repository.h"
+#include "revwalk.h"
+#include "sha1.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    uint64_t offset;
+    uint32_t pos;
+} PackSlot;
+
+typedef struct {
+    Repository    *repo;
+    RevWalk       *walk;
+    ShaSet        *tips;
+} TipCollector;
+
+typedef struct {
+    unsigned char (*shas)[SHA_SIZE];
+    size_t        count;
+    size_t        capacity;
+} ShaList;
+
+/* Forward Declaration of static Functions */
+
+static PackBitmap      *bitmap_new(Pack *pack);
+static bool             bitmap_path(const Pack *pack, char path[MAX_PATH]);
+static PackBitmapEntry *entry_add(PackBitmap *bitmap, uint32_t pos);
+static void             entry_or(const PackBitmap *bitmap, size_t id, Bitmap *dst, Bitmap *scratch);
+static bool             bitmap_types(Repository *repo, PackBitmap *bitmap);
+static bool             bitmap_select(Repository *repo, PackBitmap *bitmap, ShaList *selected);
+static bool             bitmap_save(PackBitmap *bitmap);
+static bool             collect_tip(const char *name, const unsigned char sha[SHA_SIZE], void *ctx);
+static bool             walk_side(BitmapWalk *walk, bool have);
+static bool             walk_mark(BitmapWalk *walk, bool have, const unsigned char sha[SHA_SIZE], ObjectType type);
+static bool             walk_trees(BitmapWalk *walk, bool have, ShaList *trees);
+static void             list_push(ShaList *list, const unsigned char sha[SHA_SIZE]);
+static int              compare_slots(const void *a, const void *b);
+
+/* Functions */
+
+/**
+ * pack_bitmap_open - Reads the .bitmap file next to a pack.
+ *
+ * The format is git's version 1: a header naming the pack by checksum, the
+ * type bitmaps of commits, trees, blobs and tags, then one entry per
+ * selected commit, each a bitmap of every object it reaches, possibly
+ * stored as the XOR against an earlier entry. Bits follow the order of the
+ * objects in the packfile. The optional name-hash cache is ignored.
+ *
+ * @param pack The pack; it must stay open as long as the bitmap.
+ * @return A heap-allocated PackBitmap, or NULL if the pack has no bitmap or
+ * the file does not belong to it.
+ * @note The caller is responsible for calling pack_bitmap_close().
+ */
+PackBitmap *pack_bitmap_open(Pack *pack){
+    char path[MAX_PATH];
+    if (!pack || !bitmap_path(pack, path)) { return NULL; }
+
+    size_t size;
+    const unsigned char *map = map_file(path, &size);
+    if (!map) { return NULL; }
+
+    PackBitmap *bitmap = NULL;
+    if (size < PACK_BITMAP_HEADER_SIZE + SHA_SIZE || memcmp(map, PACK_BITMAP_SIGNATURE, 4) != 0 ||
+        get_be16(map + 4) != PACK_BITMAP_VERSION || !(get_be16(map + 6) & PACK_BITMAP_FULL_DAG)){
+        fprintf(stderr, "pack_bitmap_open: %s is not a version 1 bitmap index\n", path);
+        goto done;
+    }
+    if (memcmp(map + 12, pack->pack_map + pack->pack_size - SHA_SIZE, SHA_SIZE) != 0){
+        fprintf(stderr, "pack_bitmap_open: %s does not match its pack\n", path);
+        goto done;
+    }
+
+    bitmap = bitmap_new(pack);
+    const unsigned char *p = map + PACK_BITMAP_HEADER_SIZE, *end = map + size - SHA_SIZE;
+    Ewah ewah = { 0 };
+    for (size_t t = 0; t < 4; t++){
+        size_t used = ewah_parse(&ewah, p, (size_t)(end - p));
+        if (!used) { goto malformed; }
+        ewah_or(&bitmap->types[t], &ewah);
+        p += used;
+    }
+    ewah_free(&ewah);
+
+    uint32_t count = get_be32(map + 8);
+    for (uint32_t i = 0; i < count; i++){
+        if ((size_t)(end - p) < PACK_BITMAP_ENTRY_SIZE) { goto malformed; }
+        uint32_t pos = get_be32(p);
+        uint8_t xor_offset = p[4], flags = p[5];
+        p += PACK_BITMAP_ENTRY_SIZE;
+        if (pos >= pack->count || xor_offset > i || xor_offset > PACK_BITMAP_XOR_MAX) { goto malformed; }
+
+        PackBitmapEntry *entry = entry_add(bitmap, pos);
+        entry->xor_offset = xor_offset;
+        entry->flags = flags;
+        size_t used = ewah_parse(&entry->ewah, p, (size_t)(end - p));
+        if (!used) { goto malformed; }
+        p += used;
+    }
+    goto done;
+
+malformed:
+    ewah_free(&ewah);
+    fprintf(stderr, "pack_bitmap_open: %s is malformed\n", path);
+    pack_bitmap_close(bitmap);
+    bitmap = NULL;
+done:
+    munmap((void *)map, size);
+    return bitmap;
+}
+
+/**
+ * pack_bitmap_load - Opens the bitmap of the first pack that has one.
+ *
+ * @param repo The repository.
+ * @return The bitmap, or NULL if no pack has one. It refers to a pack of
+ * repo's pack list, so it must be closed before pack_list_free().
+ * @note The caller is responsible for calling pack_bitmap_close().
+ */
+PackBitmap *pack_bitmap_load(Repository *repo){
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next){
+        PackBitmap *bitmap = pack_bitmap_open(pack);
+        if (bitmap) { return bitmap; }
+    }
+    return NULL;
+}
+
+/**
+ * pack_bitmap_close - Frees a bitmap index.
+ */
+void pack_bitmap_close(PackBitmap *bitmap){
+    if (!bitmap) { return; }
+
+    free(bitmap->order);
+    free(bitmap->bits);
+    for (size_t t = 0; t < 4; t++) { bitmap_free(&bitmap->types[t]); }
+    for (size_t i = 0; i < bitmap->entry_count; i++) { ewah_free(&bitmap->entries[i].ewah); }
+    free(bitmap->entries);
+    free(bitmap->entry_of);
+    free(bitmap);
+}
+
+/**
+ * pack_bitmap_write - Writes the .bitmap file of a pack.
+ *
+ * Every commit a ref points to gets a bitmap, and so does one commit in
+ * PACK_BITMAP_INTERVAL along the history. They are computed oldest first,
+ * each walk stopping at the commits already done, so the work is close to
+ * one walk of the history. The pack must hold everything those commits
+ * reach, as a pack written by repack_all() does.
+ *
+ * @param repo  The repository.
+ * @param pack  The pack, from repo's pack list.
+ * @param stats Output counts (may be NULL).
+ * @return True once the file is in place, false if an object reachable from
+ * the refs is missing from the pack or the file cannot be written.
+ */
+bool pack_bitmap_write(Repository *repo, Pack *pack, PackBitmapStats *stats){
+    if (!repo || !pack) { return false; }
+
+    PackBitmap *bitmap = bitmap_new(pack);
+    ShaList selected = { 0 };
+    bool status = bitmap_types(repo, bitmap) && bitmap_select(repo, bitmap, &selected);
+
+    for (size_t i = selected.count; status && i-- > 0;){
+        BitmapWalk walk;
+        bitmap_walk_init(&walk, repo, bitmap);
+        status = bitmap_walk_push(&walk, selected.shas[i], false) && bitmap_walk_run(&walk);
+        if (status && walk.extra_count){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(walk.extra[0].sha, hex);
+            fprintf(stderr, "pack_bitmap_write: %s is reachable but not in %s\n", hex, pack->path);
+            status = false;
+        }
+        uint32_t pos;
+        if (status && pack_position(pack, selected.shas[i], &pos)){
+            PackBitmapEntry *entry = entry_add(bitmap, pos);
+            ewah_encode(&entry->ewah, &walk.want);
+        }
+        bitmap_walk_release(&walk);
+    }
+
+    status = status && bitmap_save(bitmap);
+    if (status && stats){
+        stats->objects = bitmap->count;
+        stats->commits = bitmap->entry_count;
+    }
+    free(selected.shas);
+    pack_bitmap_close(bitmap);
+    return status;
+}
+
+/**
+ * bitmap_walk_init - Prepares a walk over the objects reachable from some tips.
+ *
+ * @param walk   The walk.
+ * @param repo   The repository.
+ * @param bitmap A bitmap index whose commits end the walk early, or NULL to
+ *               read every commit and tree.
+ * @note Call bitmap_walk_release() when done.
+ */
+void bitmap_walk_init(BitmapWalk *walk, Repository *repo, PackBitmap *bitmap){
+    memset(walk, 0, sizeof(*walk));
+    walk->repo = repo;
+    walk->bitmap = bitmap;
+}
+
+/**
+ * bitmap_walk_push - Adds a tip to the walk.
+ *
+ * @param walk    The walk, before bitmap_walk_run().
+ * @param sha     Any object; tags are followed to their targets.
+ * @param exclude True to leave out everything the tip reaches (^<rev>).
+ * @return True.
+ */
+bool bitmap_walk_push(BitmapWalk *walk, const unsigned char sha[SHA_SIZE], bool exclude){
+    if (walk->tip_count == walk->tip_capacity){
+        walk->tip_capacity = walk->tip_capacity ? 2 * walk->tip_capacity : 16;
+        walk->tips = realloc(walk->tips, walk->tip_capacity * SHA_SIZE);
+        MALLOC_CHECK(walk->tips);
+        walk->excluded = realloc(walk->excluded, walk->tip_capacity * sizeof(bool));
+        MALLOC_CHECK(walk->excluded);
+    }
+    memcpy(walk->tips[walk->tip_count], sha, SHA_SIZE);
+    walk->excluded[walk->tip_count++] = exclude;
+    return true;
+}
+
+/**
+ * bitmap_walk_run - Finds every object reachable from the tips but not from the excluded ones.
+ *
+ * The excluded side is walked first, and the other walk stops at anything
+ * it reached. Each walk goes through commits first; a commit with a stored
+ * bitmap contributes it whole and its ancestors are not visited. Trees of
+ * the commits visited are read afterwards, skipping objects already set.
+ *
+ * @param walk The walk.
+ * @return True on success, false (and walk->error set) if an object is
+ * missing or malformed.
+ */
+bool bitmap_walk_run(BitmapWalk *walk){
+    bool status = walk_side(walk, true) && walk_side(walk, false);
+    if (status) { bitmap_and_not(&walk->want, &walk->have); }
+    walk->error = !status;
+    return status;
+}
+
+/**
+ * bitmap_walk_count - Counts the objects found.
+ *
+ * @param walk The walk, after bitmap_walk_run().
+ * @param type Only objects of this type, or OBJ_NONE for all.
+ * @return The count.
+ */
+size_t bitmap_walk_count(const BitmapWalk *walk, ObjectType type){
+    size_t count = 0;
+    for (size_t i = 0; i < walk->extra_count; i++) { count += type == OBJ_NONE || walk->extra[i].type == type; }
+    if (type == OBJ_NONE) { return count + bitmap_count(&walk->want); }
+    return count + (walk->bitmap ? bitmap_count_and(&walk->want, &walk->bitmap->types[type - 1]) : 0);
+}
+
+/**
+ * bitmap_walk_for_each - Calls a function for every object found.
+ *
+ * Objects of the bitmapped pack come first, in pack order, then the others
+ * in the order they were reached.
+ *
+ * @param walk     The walk, after bitmap_walk_run().
+ * @param type     Only objects of this type, or OBJ_NONE for all.
+ * @param callback Called with each SHA and type; returning false stops.
+ * @param ctx      Passed through to callback.
+ * @return True if every object was visited.
+ */
+bool bitmap_walk_for_each(const BitmapWalk *walk, ObjectType type, BitmapCallback callback, void *ctx){
+    const PackBitmap *bitmap = walk->bitmap;
+    for (size_t w = 0; bitmap && w < walk->want.len; w++){
+        for (uint64_t word = walk->want.words[w]; word; word &= word - 1){
+            size_t bit = w * EWAH_WORD_BITS + (size_t)__builtin_ctzll(word);
+            ObjectType t = OBJ_NONE;
+            for (size_t k = 0; k < 4 && t == OBJ_NONE; k++){
+                if (bitmap_test(&bitmap->types[k], bit)) { t = (ObjectType)(k + 1); }
+            }
+            if (type != OBJ_NONE && t != type) { continue; }
+            if (!callback(bitmap->pack->oids + (size_t)bitmap->order[bit] * SHA_SIZE, t, ctx)) { return false; }
+        }
+    }
+    for (size_t i = 0; i < walk->extra_count; i++){
+        if (type != OBJ_NONE && walk->extra[i].type != type) { continue; }
+        if (!callback(walk->extra[i].sha, walk->extra[i].type, ctx)) { return false; }
+    }
+    return true;
+}
+
+/**
+ * bitmap_walk_release - Frees the buffers of a walk.
+ */
+void bitmap_walk_release(BitmapWalk *walk){
+    bitmap_free(&walk->have);
+    bitmap_free(&walk->want);
+    sha_set_free(&walk->have_extra);
+    sha_set_free(&walk->want_extra);
+    free(walk->extra);
+    free(walk->tips);
+    free(walk->excluded);
+    memset(walk, 0, sizeof(*walk));
+}
+
+/* Static Functions */
+
+/**
+ * bitmap_new - Allocates an empty bitmap index and the pack's offset order.
+ */
+static PackBitmap *bitmap_new(Pack *pack){
+    PackBitmap *bitmap = safe_calloc(sizeof(PackBitmap), 1);
+    bitmap->pack = pack;
+    bitmap->count = pack->count;
+
+    size_t n = pack->count ? pack->count : 1;
+    PackSlot *slots = safe_malloc(sizeof(PackSlot), n);
+    for (uint32_t i = 0; i < pack->count; i++) { slots[i] = (PackSlot){ pack_offset_at(pack, i), i }; }
+    qsort(slots, pack->count, sizeof(PackSlot), compare_slots);
+
+    bitmap->order = safe_malloc(sizeof(uint32_t), n);
+    bitmap->bits = safe_malloc(sizeof(uint32_t), n);
+    bitmap->entry_of = safe_malloc(sizeof(int32_t), n);
+    for (uint32_t bit = 0; bit < pack->count; bit++){
+        bitmap->order[bit] = slots[bit].pos;
+        bitmap->bits[slots[bit].pos] = bit;
+        bitmap->entry_of[bit] = -1;
+    }
+    free(slots);
+    return bitmap;
+}
+
+/**
+ * bitmap_path - Derives pack-<name>.bitmap from pack-<name>.pack.
+ */
+static bool bitmap_path(const Pack *pack, char path[MAX_PATH]){
+    size_t len = strlen(pack->path);
+    if (len < 5 || len + 2 >= MAX_PATH || !streq(pack->path + len - 5, ".pack")) { return false; }
+    memcpy(path, pack->path, len - 5);
+    memcpy(path + len - 5, ".bitmap", 8);
+    return true;
+}
+
+/**
+ * entry_add - Appends an entry for the commit at .idx position pos.
+ */
+static PackBitmapEntry *entry_add(PackBitmap *bitmap, uint32_t pos){
+    if (bitmap->entry_count == bitmap->entry_capacity){
+        bitmap->entry_capacity = bitmap->entry_capacity ? 2 * bitmap->entry_capacity : 64;
+        bitmap->entries = realloc(bitmap->entries, bitmap->entry_capacity * sizeof(PackBitmapEntry));
+        MALLOC_CHECK(bitmap->entries);
+    }
+    PackBitmapEntry *entry = &bitmap->entries[bitmap->entry_count];
+    memset(entry, 0, sizeof(*entry));
+    entry->pos = pos;
+    bitmap->entry_of[pos] = (int32_t)bitmap->entry_count++;
+    return entry;
+}
+
+/**
+ * entry_or - Adds the objects reachable from an entry's commit to dst.
+ *
+ * An XOR-compressed entry is rebuilt in scratch from the start of its chain.
+ */
+static void entry_or(const PackBitmap *bitmap, size_t id, Bitmap *dst, Bitmap *scratch){
+    const PackBitmapEntry *entries = bitmap->entries;
+    if (!entries[id].xor_offset){
+        ewah_or(dst, &entries[id].ewah);
+        return;
+    }
+
+    size_t depth = 1;
+    for (size_t k = id; entries[k].xor_offset; k -= entries[k].xor_offset) { depth++; }
+    size_t *chain = safe_malloc(sizeof(size_t), depth);
+    for (size_t d = 0, k = id; d < depth; k -= entries[k].xor_offset) { chain[d++] = k; }
+
+    /* each link is the XOR against the one before; the first XOR into nothing is a copy */
+    bitmap_clear(scratch);
+    for (size_t d = depth; d-- > 0;) { ewah_xor(scratch, &entries[chain[d]].ewah); }
+    bitmap_or(dst, scratch);
+    free(chain);
+}
+
+/**
+ * bitmap_types - Fills the type bitmaps from the pack's entry headers.
+ */
+static bool bitmap_types(Repository *repo, PackBitmap *bitmap){
+    for (uint32_t bit = 0; bit < bitmap->count; bit++){
+        int type;
+        size_t size;
+        if (!pack_read_header(repo, bitmap->pack, pack_offset_at(bitmap->pack, bitmap->order[bit]), &type, &size) ||
+            type < OBJ_COMMIT || type > OBJ_TAG){
+            fprintf(stderr, "pack_bitmap_write: cannot read object %u of %s\n", bitmap->order[bit], bitmap->pack->path);
+            return false;
+        }
+        bitmap_set(&bitmap->types[type - 1], bit);
+    }
+    return true;
+}
+
+/**
+ * bitmap_select - Picks the commits that get a bitmap, newest first.
+ *
+ * @param repo     The repository.
+ * @param bitmap   The index being built.
+ * @param selected Output list; the caller frees selected->shas.
+ * @return False if the history cannot be walked.
+ */
+static bool bitmap_select(Repository *repo, PackBitmap *bitmap, ShaList *selected){
+    RevWalk walk;
+    ShaSet tips = { 0 };
+    revwalk_init(&walk, repo);
+    TipCollector collector = { repo, &walk, &tips };
+    unsigned char head[SHA_SIZE];
+    bool status = (!ref_read(repo, "HEAD", head) || collect_tip("HEAD", head, &collector)) &&
+                  refs_for_each(repo, collect_tip, &collector);
+
+    RevCommit commit;
+    size_t n = 0;
+    while (status && revwalk_next(&walk, &commit)){
+        uint32_t pos;
+        if (!pack_position(bitmap->pack, commit.sha, &pos)) { continue; }
+        if (n++ % PACK_BITMAP_INTERVAL == 0 || sha_set_contains(&tips, commit.sha)) { list_push(selected, commit.sha); }
+    }
+    status = status && !walk.error;
+    revwalk_release(&walk);
+    sha_set_free(&tips);
+    return status;
+}
+
+/**
+ * bitmap_save - Writes the index as pack-<name>.bitmap.
+ */
+static bool bitmap_save(PackBitmap *bitmap){
+    Ewah types[4] = { { 0 } };
+    size_t len = PACK_BITMAP_HEADER_SIZE + SHA_SIZE;
+    for (size_t t = 0; t < 4; t++){
+        ewah_encode(&types[t], &bitmap->types[t]);
+        len += ewah_serialized_size(&types[t]);
+    }
+    for (size_t i = 0; i < bitmap->entry_count; i++) { len += PACK_BITMAP_ENTRY_SIZE + ewah_serialized_size(&bitmap->entries[i].ewah); }
+
+    unsigned char *buf = safe_malloc(len, 1), *p = buf;
+    memcpy(p, PACK_BITMAP_SIGNATURE, 4);
+    put_be16(p + 4, PACK_BITMAP_VERSION);
+    put_be16(p + 6, PACK_BITMAP_FULL_DAG);
+    put_be32(p + 8, (uint32_t)bitmap->entry_count);
+    memcpy(p + 12, bitmap->pack->pack_map + bitmap->pack->pack_size - SHA_SIZE, SHA_SIZE);
+    p += PACK_BITMAP_HEADER_SIZE;
+    for (size_t t = 0; t < 4; t++){
+        ewah_serialize(&types[t], p);
+        p += ewah_serialized_size(&types[t]);
+        ewah_free(&types[t]);
+    }
+    for (size_t i = 0; i < bitmap->entry_count; i++){
+        const PackBitmapEntry *entry = &bitmap->entries[i];
+        put_be32(p, entry->pos);
+        p[4] = entry->xor_offset;
+        p[5] = entry->flags;
+        ewah_serialize(&entry->ewah, p + PACK_BITMAP_ENTRY_SIZE);
+        p += PACK_BITMAP_ENTRY_SIZE + ewah_serialized_size(&entry->ewah);
+    }
+    sha1_buffer(buf, len - SHA_SIZE, p);
+
+    bool status = false;
+    char path[MAX_PATH], tmp[MAX_PATH];
+    bitmap_path(bitmap->pack, path);
+    const char *slash = strrchr(path, '/');
+    int n = snprintf(tmp, sizeof(tmp), "%.*s/tmp_bitmap_XXXXXX", slash ? (int)(slash - path) : 1, slash ? path : ".");
+    int fd = n > 0 && (size_t)n < sizeof(tmp) ? mkstemp(tmp) : -1;
+    if (fd < 0){
+        fprintf(stderr, "pack_bitmap_write: cannot create a temporary file: %s\n", strerror(errno));
+    } else {
+        status = write_all(fd, buf, len);
+        fchmod(fd, 0444);
+        close(fd);
+        if (status && rename(tmp, path) < 0){
+            fprintf(stderr, "pack_bitmap_write: cannot rename to %s: %s\n", path, strerror(errno));
+            status = false;
+        }
+        if (!status) { unlink(tmp); }
+    }
+
+    free(buf);
+    return status;
+}
+
+/**
+ * collect_tip - refs_for_each() callback queueing the commit a ref names.
+ *
+ * Refs to trees or blobs are ignored, as git does.
+ */
+static bool collect_tip(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    (void)name;
+    TipCollector *collector = ctx;
+    GitObject *commit = object_peel(collector->repo, sha, OBJ_COMMIT);
+    if (!commit) { return true; }
+    sha_set_insert(collector->tips, commit->sha);
+    return revwalk_push(collector->walk, commit->sha);
+}
+
+/**
+ * walk_side - Walks the tips of one side, excluded (have) or not.
+ */
+static bool walk_side(BitmapWalk *walk, bool have){
+    Bitmap *side = have ? &walk->have : &walk->want, scratch = { 0 };
+    ShaList commits = { 0 }, trees = { 0 };
+    bool status = true;
+    char hex[SHA_HEX_SIZE];
+
+    for (size_t i = 0; status && i < walk->tip_count; i++){
+        if (walk->excluded[i] != have) { continue; }
+
+        GitObject *object = object_get(walk->repo, walk->tips[i]);
+        for (size_t depth = 0; object && object->type == OBJ_TAG && depth <= OBJECT_PEEL_DEPTH; depth++){
+            unsigned char target[SHA_SIZE];
+            walk_mark(walk, have, object->sha, OBJ_TAG);
+            object = tag_target((GitTag *)object, target) ? object_get(walk->repo, target) : NULL;
+        }
+        if (!object || object->type == OBJ_TAG){
+            sha_to_hex(walk->tips[i], hex);
+            fprintf(stderr, "bitmap_walk_run: cannot read %s\n", hex);
+            status = false;
+        } else if (object->type == OBJ_COMMIT){
+            list_push(&commits, object->sha);
+        } else if (walk->commits_only){
+            continue;
+        } else if (object->type == OBJ_TREE){
+            list_push(&trees, object->sha);
+        } else {
+            walk_mark(walk, have, object->sha, OBJ_BLOB);
+        }
+    }
+
+    while (status && commits.count){
+        unsigned char sha[SHA_SIZE];
+        memcpy(sha, commits.shas[--commits.count], SHA_SIZE);
+
+        uint32_t pos;
+        if (walk->bitmap && pack_position(walk->bitmap->pack, sha, &pos) && walk->bitmap->entry_of[pos] >= 0){
+            uint32_t bit = walk->bitmap->bits[pos];
+            if (bitmap_test(&walk->have, bit) || bitmap_test(side, bit)) { continue; }
+            entry_or(walk->bitmap, (size_t)walk->bitmap->entry_of[pos], side, &scratch);
+            walk->bitmaps_used++;
+            continue;
+        }
+        if (!walk_mark(walk, have, sha, OBJ_COMMIT)) { continue; }
+
+        GitCommit *commit = (GitCommit *)object_get(walk->repo, sha);
+        unsigned char next[SHA_SIZE];
+        if (!commit || commit->object.type != OBJ_COMMIT || !commit_tree(commit, next)){
+            sha_to_hex(sha, hex);
+            fprintf(stderr, "bitmap_walk_run: cannot read commit %s\n", hex);
+            status = false;
+            break;
+        }
+        walk->commits_walked++;
+        if (!walk->commits_only) { list_push(&trees, next); }
+        for (size_t nth = 0; commit_parent(commit, nth, next); nth++) { list_push(&commits, next); }
+    }
+
+    status = status && walk_trees(walk, have, &trees);
+    bitmap_free(&scratch);
+    free(commits.shas);
+    free(trees.shas);
+    return status;
+}
+
+/**
+ * walk_mark - Marks an object on one side.
+ *
+ * @return True if it was new, false if that side already had it or, for
+ * the tips not excluded, the excluded side reaches it.
+ */
+static bool walk_mark(BitmapWalk *walk, bool have, const unsigned char sha[SHA_SIZE], ObjectType type){
+    uint32_t pos;
+    if (walk->bitmap && pack_position(walk->bitmap->pack, sha, &pos)){
+        uint32_t bit = walk->bitmap->bits[pos];
+        if (bitmap_test(&walk->have, bit) || (!have && bitmap_test(&walk->want, bit))) { return false; }
+        bitmap_set(have ? &walk->have : &walk->want, bit);
+        return true;
+    }
+
+    if (sha_set_contains(&walk->have_extra, sha)) { return false; }
+    if (have) { return sha_set_insert(&walk->have_extra, sha); }
+    if (!sha_set_insert(&walk->want_extra, sha)) { return false; }
+
+    if (walk->extra_count == walk->extra_capacity){
+        walk->extra_capacity = walk->extra_capacity ? 2 * walk->extra_capacity : 256;
+        walk->extra = realloc(walk->extra, walk->extra_capacity * sizeof(BitmapObject));
+        MALLOC_CHECK(walk->extra);
+    }
+    memcpy(walk->extra[walk->extra_count].sha, sha, SHA_SIZE);
+    walk->extra[walk->extra_count++].type = type;
+    return true;
+}
+
+/**
+ * walk_trees - Marks trees and everything below them, reading only new trees.
+ *
+ * Submodule commits (gitlinks) are not followed.
+ */
+static bool walk_trees(BitmapWalk *walk, bool have, ShaList *trees){
+    ShaList stack = { 0 };
+    for (size_t i = 0; i < trees->count; i++){
+        if (walk_mark(walk, have, trees->shas[i], OBJ_TREE)) { list_push(&stack, trees->shas[i]); }
+    }
+
+    Arena arena = { 0 };
+    bool status = true;
+    while (status && stack.count){
+        unsigned char sha[SHA_SIZE];
+        memcpy(sha, stack.shas[--stack.count], SHA_SIZE);
+
+        ObjectType type;
+        size_t size;
+        unsigned char *data = object_read(walk->repo, sha, &type, &size);
+        Tree tree;
+        if (!data || type != OBJ_TREE || !tree_parse(&tree, data, size, &arena)){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(sha, hex);
+            fprintf(stderr, "bitmap_walk_run: cannot read tree %s\n", hex);
+            status = false;
+        } else {
+            walk->trees_read++;
+            for (size_t i = 0; i < tree.count; i++){
+                const TreeLeaf *leaf = &tree.leaves[i];
+                if ((leaf->mode & TREE_MODE_TYPE) == TREE_MODE_GITLINK) { continue; }
+                if (tree_leaf_is_tree(leaf)){
+                    if (walk_mark(walk, have, leaf->sha, OBJ_TREE)) { list_push(&stack, leaf->sha); }
+                } else {
+                    walk_mark(walk, have, leaf->sha, OBJ_BLOB);
+                }
+            }
+        }
+        free(data);
+        arena_clear(&arena);
+    }
+
+    arena_clear(&arena);
+    free(stack.shas);
+    return status;
+}
+
+/**
+ * list_push - Appends a SHA to a list.
+ */
+static void list_push(ShaList *list, const unsigned char sha[SHA_SIZE]){
+    if (list->count == list->capacity){
+        list->capacity = list->capacity ? 2 * list->capacity : 256;
+        list->shas = realloc(list->shas, list->capacity * SHA_SIZE);
+        MALLOC_CHECK(list->shas);
+    }
+    memcpy(list->shas[list->count++], sha, SHA_SIZE);
+}
+
+/**
+ * compare_slots - qsort comparator ordering objects by pack offset.
+ */
+static int compare_slots(const void *a, const void *b){
+    uint64_t x = ((const PackSlot *)a)->offset, y = ((const PackSlot *)b)->offset;
+    return x < y ? -1 : x > y;
+}
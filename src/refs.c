@@ -0,0 +1,557 @@
+/* refs.c: references */
+
+#include "refs.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    char   **names;
+    size_t count;
+    size_t capacity;
+} RefNames;
+
+/* Forward Declaration of static Functions */
+
+static int    loose_read(Repository *repo, const char *name, char *line, size_t size);
+static bool   collect_refs(const char *dir, const char *prefix, RefNames *names);
+static bool   packed_parse(PackedRefs *packed, size_t len);
+static size_t packed_lower_bound(const PackedRefs *packed, const char *name);
+static void   packed_peel(Repository *repo, PackedRef *ref);
+static bool   packed_put(FILE *fp, const PackedRef *ref);
+static void   prune_loose(int dir_fd, const char *name);
+static int    compare_names(const void *a, const void *b);
+static int    compare_packed(const void *a, const void *b);
+
+/* Functions */
+
+/**
+ * ref_read - Reads a reference under gitdir, following symbolic refs.
+ *
+ * A loose file wins; names under refs/ that have none are looked up in
+ * packed-refs, which is parsed once per repository.
+ *
+ * @param repo The repository.
+ * @param name Full name of the reference, e.g. "HEAD" or "refs/heads/main".
+ * @param sha  Output for the SHA it points to.
+ * @return True if the reference exists and resolves to a SHA, false otherwise.
+ */
+bool ref_read(Repository *repo, const char *name, unsigned char sha[SHA_SIZE]){
+    if (!repo || !name || !sha) { return false; }
+
+    char target[MAX_PATH];
+    snprintf(target, sizeof(target), "%s", name);
+
+    for (int depth = 0; depth <= REFS_SYMREF_DEPTH; depth++){
+        /* openat() would ignore the gitdir handle for an absolute name */
+        if (target[0] == '/') { return false; }
+
+        char line[MAX_PATH];
+        int found = loose_read(repo, target, line, sizeof(line));
+        if (found < 0) { return false; }
+        if (found == 0){
+            if (strncmp(target, "refs/", 5) != 0) { return false; }
+            const PackedRef *ref = packed_refs_find(packed_refs_load(repo), target);
+            if (ref) { memcpy(sha, ref->sha, SHA_SIZE); }
+            return ref != NULL;
+        }
+
+        if (strncmp(line, "ref: ", 5) != 0) { return hex_to_sha(line, sha); }
+        snprintf(target, sizeof(target), "%s", line + 5);
+    }
+
+    fprintf(stderr, "ref_read: %s: symbolic refs nested too deeply\n", name);
+    return false;
+}
+
+/**
+ * ref_resolve - Resolves a short or full reference name.
+ *
+ * Names are tried in git's order: as given, then under refs/, refs/tags/,
+ * refs/heads/ and refs/remotes/, and finally as refs/remotes/<name>/HEAD.
+ *
+ * @param repo The repository.
+ * @param name The name given by the user, e.g. "main" or "HEAD".
+ * @param sha  Output for the SHA it points to.
+ * @return True if some candidate resolved, false otherwise.
+ */
+bool ref_resolve(Repository *repo, const char *name, unsigned char sha[SHA_SIZE]){
+    if (!repo || !name || !sha || !*name || strstr(name, "..")) { return false; }
+
+    static const char *rules[] = {
+        "%s", "refs/%s", "refs/tags/%s", "refs/heads/%s", "refs/remotes/%s", "refs/remotes/%s/HEAD",
+    };
+
+    for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++){
+        char full[MAX_PATH];
+        if (snprintf(full, sizeof(full), rules[i], name) >= (int)sizeof(full)) { return false; }
+        if (ref_read(repo, full, sha)) { return true; }
+    }
+    return false;
+}
+
+/**
+ * refs_for_each - Calls a function for every reference under refs/.
+ *
+ * References are visited in name order. Dangling symbolic refs and files
+ * that do not hold a SHA are skipped.
+ *
+ * @param repo     The repository.
+ * @param callback Called with each full name and SHA; returning false stops
+ * the iteration.
+ * @param ctx      Passed through to callback.
+ * @return True if every reference was visited, false if the callback stopped
+ * early or refs/ could not be read.
+ */
+bool refs_for_each(Repository *repo, RefCallback callback, void *ctx){
+    return refs_for_each_prefix(repo, "refs/", callback, ctx);
+}
+
+/**
+ * refs_for_each_prefix - Calls a function for every reference starting with a prefix.
+ *
+ * Loose files are listed from the directory holding the prefix and merged
+ * with the matching range of packed-refs, a loose ref hiding a packed one
+ * of the same name. References are visited in name order.
+ *
+ * @param repo     The repository.
+ * @param prefix   Start of the full names, e.g. "refs/tags/"; it must begin
+ *                 with "refs/".
+ * @param callback Called with each full name and SHA; returning false stops
+ * the iteration.
+ * @param ctx      Passed through to callback.
+ * @return True if every reference was visited, false if the callback stopped
+ * early, refs/ could not be read or packed-refs is malformed.
+ */
+bool refs_for_each_prefix(Repository *repo, const char *prefix, RefCallback callback, void *ctx){
+    if (!repo || !prefix || !callback || strncmp(prefix, "refs/", 5) != 0) { return false; }
+
+    /* loose refs live below the last directory the prefix names */
+    char base[MAX_PATH];
+    snprintf(base, sizeof(base), "%.*s", (int)(strrchr(prefix, '/') - prefix), prefix);
+    RefNames names = {0};
+    char *dir = repo_path(repo, base, NULL);
+    bool status = collect_refs(dir, base, &names) || !streq(base, "refs");
+    free(dir);
+    if (names.count) { qsort(names.names, names.count, sizeof(char *), compare_names); }
+
+    const PackedRefs *packed = packed_refs_load(repo);
+    size_t len = strlen(prefix), p = packed ? packed_lower_bound(packed, prefix) : 0, l = 0;
+    status = status && packed;
+    while (status && (l < names.count || (p < packed->count && strncmp(packed->refs[p].name, prefix, len) == 0))){
+        if (l < names.count && strncmp(names.names[l], prefix, len) != 0){
+            l++;
+            continue;
+        }
+        bool in_packed = p < packed->count && strncmp(packed->refs[p].name, prefix, len) == 0;
+        int cmp = l == names.count ? 1 : !in_packed ? -1 : strcmp(names.names[l], packed->refs[p].name);
+        if (cmp > 0){
+            status = callback(packed->refs[p].name, packed->refs[p].sha, ctx);
+            p++;
+            continue;
+        }
+        unsigned char sha[SHA_SIZE];
+        if (ref_read(repo, names.names[l], sha)) { status = callback(names.names[l], sha, ctx); }
+        l++;
+        if (cmp == 0) { p++; }
+    }
+
+    for (size_t i = 0; i < names.count; i++) { free(names.names[i]); }
+    free(names.names);
+    return status;
+}
+
+/**
+ * ref_peeled - Finds what a reference to an annotated tag finally points to.
+ *
+ * The peeled line of packed-refs answers without reading the tag; other
+ * references have their object's type read.
+ *
+ * @param repo   The repository.
+ * @param name   Full name of the reference.
+ * @param sha    The SHA it points to, as ref_read() gave it.
+ * @param peeled Output for the first object that is not a tag.
+ * @return True if sha is an annotated tag that peels, false for any other
+ * object or if the tag cannot be read.
+ */
+bool ref_peeled(Repository *repo, const char *name, const unsigned char sha[SHA_SIZE], unsigned char peeled[SHA_SIZE]){
+    if (!repo || !name || !sha || !peeled) { return false; }
+
+    const PackedRefs *packed = packed_refs_load(repo);
+    const PackedRef *ref = packed_refs_find(packed, name);
+    if (ref && memcmp(ref->sha, sha, SHA_SIZE) == 0 && (ref->has_peeled || packed->fully_peeled)){
+        if (ref->has_peeled) { memcpy(peeled, ref->peeled, SHA_SIZE); }
+        return ref->has_peeled;
+    }
+
+    PackedRef loose = { name, { 0 }, { 0 }, false };
+    memcpy(loose.sha, sha, SHA_SIZE);
+    packed_peel(repo, &loose);
+    if (loose.has_peeled) { memcpy(peeled, loose.peeled, SHA_SIZE); }
+    return loose.has_peeled;
+}
+
+/**
+ * refs_pack - Moves loose references into packed-refs.
+ *
+ * The new file keeps every packed reference and adds the loose tags (or,
+ * with all, every loose reference), the loose value winning; symbolic refs
+ * stay loose. Annotated tags get their peeled line. The file is written to
+ * packed-refs.lock and renamed into place.
+ *
+ * @param repo  The repository.
+ * @param all   Pack branches and other references too, not only tags.
+ * @param prune Remove the loose files once they are packed.
+ * @param stats Output counts (may be NULL).
+ * @return True on success, false if packed-refs is malformed, is locked by
+ * another process or cannot be written.
+ */
+bool refs_pack(Repository *repo, bool all, bool prune, PackRefsStats *stats){
+    if (!repo) { return false; }
+
+    PackedRefs *packed = packed_refs_load(repo);
+    int dir_fd = repo_gitdir_fd(repo);
+    if (!packed || dir_fd < 0) { return false; }
+
+    int fd = openat(dir_fd, REFS_PACKED_LOCK, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0){
+        if (errno == EEXIST){
+            fprintf(stderr, "refs_pack: %s/%s exists; is another process running?\n", repo->gitdir, REFS_PACKED_LOCK);
+        } else {
+            fprintf(stderr, "refs_pack: cannot create %s: %s\n", REFS_PACKED_LOCK, strerror(errno));
+        }
+        return false;
+    }
+
+    RefNames names = {0};
+    char *dir = repo_path(repo, "refs", NULL);
+    collect_refs(dir, "refs", &names);
+    free(dir);
+    if (names.count) { qsort(names.names, names.count, sizeof(char *), compare_names); }
+
+    PackedRef *loose = safe_calloc(sizeof(PackedRef), names.count + 1);
+    size_t count = 0;
+    for (size_t i = 0; i < names.count; i++){
+        char line[MAX_PATH];
+        if (!all && strncmp(names.names[i], "refs/tags/", 10) != 0) { continue; }
+        if (loose_read(repo, names.names[i], line, sizeof(line)) != 1 || strncmp(line, "ref: ", 5) == 0) { continue; }
+        if (!hex_to_sha(line, loose[count].sha)) { continue; }
+        loose[count].name = names.names[i];
+        packed_peel(repo, &loose[count++]);
+    }
+
+    FILE *fp = fdopen(fd, "w");
+    bool status = fp && fputs(REFS_PACKED_HEADER, fp) >= 0;
+    size_t written = 0;
+    for (size_t p = 0, l = 0; status && (p < packed->count || l < count); written++){
+        int cmp = l == count ? -1 : p == packed->count ? 1 : strcmp(packed->refs[p].name, loose[l].name);
+        if (cmp < 0){
+            PackedRef *ref = &packed->refs[p++];
+            if (!packed->fully_peeled && !ref->has_peeled) { packed_peel(repo, ref); }
+            status = packed_put(fp, ref);
+        } else {
+            status = packed_put(fp, &loose[l++]);
+            if (cmp == 0) { p++; }
+        }
+    }
+    status = fp ? fclose(fp) == 0 && status : (close(fd), false);
+    if (status) { status = renameat(dir_fd, REFS_PACKED_LOCK, dir_fd, REFS_PACKED_FILE) == 0; }
+    if (!status){
+        fprintf(stderr, "refs_pack: cannot write %s: %s\n", REFS_PACKED_FILE, strerror(errno));
+        unlinkat(dir_fd, REFS_PACKED_LOCK, 0);
+    }
+
+    size_t pruned = 0;
+    for (size_t i = 0; status && prune && i < count; i++){
+        if (unlinkat(dir_fd, loose[i].name, 0) == 0){
+            pruned++;
+            prune_loose(dir_fd, loose[i].name);
+        }
+    }
+    if (stats){
+        stats->packed = status ? written : 0;
+        stats->pruned = pruned;
+    }
+
+    free(loose);
+    for (size_t i = 0; i < names.count; i++) { free(names.names[i]); }
+    free(names.names);
+    packed_refs_free(repo);
+    return status;
+}
+
+/**
+ * packed_refs_load - Parses the repository's packed-refs file.
+ *
+ * The whole file is read into memory once and kept with the repository;
+ * names are NUL-terminated in place and the entries sorted, so lookups are
+ * a binary search. Files from git that are not marked sorted are sorted.
+ *
+ * @param repo The repository.
+ * @return The parsed file (empty if there is none), or NULL if it cannot
+ * be read or is malformed. It is owned by repo.
+ */
+PackedRefs *packed_refs_load(Repository *repo){
+    if (!repo) { return NULL; }
+    if (repo->packed_refs_loaded) { return repo->packed_refs; }
+    repo->packed_refs_loaded = true;
+
+    PackedRefs *packed = safe_calloc(sizeof(PackedRefs), 1);
+    int dir_fd = repo_gitdir_fd(repo);
+    int fd = dir_fd < 0 ? -1 : openat(dir_fd, REFS_PACKED_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT){
+        repo->packed_refs = packed;
+        return packed;
+    }
+
+    struct stat sb;
+    bool status = fd >= 0 && fstat(fd, &sb) == 0;
+    size_t len = status ? (size_t)sb.st_size : 0, done = 0;
+    packed->data = safe_malloc(len + 1, 1);
+    while (status && done < len){
+        ssize_t n = read(fd, packed->data + done, len - done);
+        if (n < 0 && errno == EINTR) { continue; }
+        status = n > 0;
+        done += status ? (size_t)n : 0;
+    }
+    if (fd >= 0) { close(fd); }
+
+    if (!status){
+        fprintf(stderr, "packed_refs_load: cannot read %s/%s: %s\n", repo->gitdir, REFS_PACKED_FILE, strerror(errno));
+    } else if (!(status = packed_parse(packed, len))){
+        fprintf(stderr, "packed_refs_load: %s/%s is malformed\n", repo->gitdir, REFS_PACKED_FILE);
+    }
+    if (!status){
+        free(packed->data);
+        free(packed->refs);
+        free(packed);
+        packed = NULL;
+    }
+    repo->packed_refs = packed;
+    return packed;
+}
+
+/**
+ * packed_refs_free - Drops the parsed packed-refs.
+ *
+ * @param repo The repository; the file is parsed again on the next lookup.
+ */
+void packed_refs_free(Repository *repo){
+    if (!repo) { return; }
+
+    if (repo->packed_refs){
+        free(repo->packed_refs->data);
+        free(repo->packed_refs->refs);
+        free(repo->packed_refs);
+    }
+    repo->packed_refs = NULL;
+    repo->packed_refs_loaded = false;
+}
+
+/**
+ * packed_refs_find - Looks up a full reference name in packed-refs.
+ *
+ * @param packed The parsed file (may be NULL).
+ * @param name   Full name, e.g. "refs/tags/v1.0".
+ * @return The entry, or NULL if the name is not packed.
+ */
+const PackedRef *packed_refs_find(const PackedRefs *packed, const char *name){
+    if (!packed || !name) { return NULL; }
+
+    size_t pos = packed_lower_bound(packed, name);
+    return pos < packed->count && streq(packed->refs[pos].name, name) ? &packed->refs[pos] : NULL;
+}
+
+/* Static Functions */
+
+/**
+ * loose_read - Reads the first line of a loose reference file.
+ *
+ * @param repo The repository.
+ * @param name Path of the file relative to gitdir.
+ * @param line Output for the line, without its newline.
+ * @param size Size of line.
+ * @return 1 if the file was read, 0 if it does not exist, -1 on error.
+ */
+static int loose_read(Repository *repo, const char *name, char *line, size_t size){
+    int fd = openat(repo_gitdir_fd(repo), name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return errno == ENOENT || errno == ENOTDIR ? 0 : -1; }
+    FILE *fp = fdopen(fd, "r");
+    if (!fp){
+        close(fd);
+        return -1;
+    }
+
+    bool ok = fgets(line, (int)size, fp) != NULL;
+    fclose(fp);
+    if (!ok) { return -1; }
+    line[strcspn(line, "\n")] = '\0';
+    return 1;
+}
+
+/**
+ * collect_refs - Gathers the names of every file below a refs directory.
+ *
+ * @param dir    Directory on disk.
+ * @param prefix Reference name of dir, e.g. "refs/heads".
+ * @param names  List the full names are appended to.
+ * @return True on success, false if dir could not be opened.
+ */
+static bool collect_refs(const char *dir, const char *prefix, RefNames *names){
+    DIR *d = opendir(dir);
+    if (!d) { return false; }
+
+    for (struct dirent *e = readdir(d); e; e = readdir(d)){
+        size_t len = strlen(e->d_name);
+        if (e->d_name[0] == '.' || (len > 5 && streq(e->d_name + len - 5, ".lock"))) { continue; }
+
+        char *path = path_join(dir, e->d_name, NULL);
+        char *name = path_join(prefix, e->d_name, NULL);
+        if (is_directory(path)){
+            collect_refs(path, name, names);
+            free(name);
+        } else {
+            if (names->count == names->capacity){
+                names->capacity = names->capacity ? 2 * names->capacity : 16;
+                names->names = realloc(names->names, names->capacity * sizeof(char *));
+                MALLOC_CHECK(names->names);
+            }
+            names->names[names->count++] = name;
+        }
+        free(path);
+    }
+
+    closedir(d);
+    return true;
+}
+
+/**
+ * compare_names - qsort comparator for reference names.
+ */
+static int compare_names(const void *a, const void *b){
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * packed_parse - Splits the packed-refs contents into entries.
+ *
+ * Each line is "<sha> <name>", optionally followed by "^<sha>" with the
+ * peeled object; a leading "# pack-refs with:" line lists the traits.
+ *
+ * @param packed Holds the contents in data; refs is filled in and sorted.
+ * @param len    Bytes in data.
+ * @return True on success, false on a malformed line.
+ */
+static bool packed_parse(PackedRefs *packed, size_t len){
+    char *p = packed->data, *end = packed->data + len;
+    bool sorted = false;
+    *end = '\0';
+
+    while (p < end){
+        char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) { eol = end; }
+        *eol = '\0';
+        size_t line = (size_t)(eol - p);
+
+        if (p[0] == '#'){
+            if (strncmp(p, "# pack-refs with:", 17) == 0){
+                sorted = strstr(p, " sorted ") != NULL;
+                packed->fully_peeled = strstr(p, " fully-peeled ") != NULL;
+            }
+        } else if (p[0] == '^'){
+            PackedRef *last = packed->count ? &packed->refs[packed->count - 1] : NULL;
+            if (!last || last->has_peeled || line != SHA_HEX_SIZE || !hex_to_sha(p + 1, last->peeled)) { return false; }
+            last->has_peeled = true;
+        } else if (line){
+            if (line < SHA_HEX_SIZE + 5 || p[SHA_HEX_SIZE - 1] != ' ' || strncmp(p + SHA_HEX_SIZE, "refs/", 5) != 0) { return false; }
+            if (packed->count == packed->capacity){
+                packed->capacity = packed->capacity ? 2 * packed->capacity : 64;
+                packed->refs = realloc(packed->refs, packed->capacity * sizeof(PackedRef));
+                MALLOC_CHECK(packed->refs);
+            }
+            PackedRef *ref = &packed->refs[packed->count++];
+            p[SHA_HEX_SIZE - 1] = '\0';
+            if (!hex_to_sha(p, ref->sha)) { return false; }
+            ref->name = p + SHA_HEX_SIZE;
+            ref->has_peeled = false;
+            if (packed->count > 1 && strcmp(packed->refs[packed->count - 2].name, ref->name) >= 0) { sorted = false; }
+        }
+        p = eol + 1;
+    }
+
+    if (!sorted && packed->count > 1) { qsort(packed->refs, packed->count, sizeof(PackedRef), compare_packed); }
+    return true;
+}
+
+/**
+ * packed_lower_bound - Index of the first packed name not below name.
+ */
+static size_t packed_lower_bound(const PackedRefs *packed, const char *name){
+    size_t lo = 0, hi = packed->count;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(packed->refs[mid].name, name) < 0) { lo = mid + 1; }
+        else                                          { hi = mid; }
+    }
+    return lo;
+}
+
+/**
+ * packed_peel - Fills in the peeled object of a reference to an annotated tag.
+ */
+static void packed_peel(Repository *repo, PackedRef *ref){
+    ObjectType type;
+    size_t size;
+    if (!object_read_header(repo, ref->sha, &type, &size) || type != OBJ_TAG) { return; }
+
+    GitObject *object = object_peel(repo, ref->sha, OBJ_NONE);
+    if (object){
+        memcpy(ref->peeled, object->sha, SHA_SIZE);
+        ref->has_peeled = true;
+    }
+}
+
+/**
+ * packed_put - Writes one entry of packed-refs.
+ */
+static bool packed_put(FILE *fp, const PackedRef *ref){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(ref->sha, hex);
+    if (fprintf(fp, "%s %s\n", hex, ref->name) < 0) { return false; }
+    if (!ref->has_peeled) { return true; }
+    sha_to_hex(ref->peeled, hex);
+    return fprintf(fp, "^%s\n", hex) >= 0;
+}
+
+/**
+ * prune_loose - Removes the directories a pruned reference leaves empty.
+ *
+ * Directories are removed up to, but not including, refs/<kind>.
+ */
+static void prune_loose(int dir_fd, const char *name){
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s", name);
+    for (char *slash = strrchr(path, '/'); slash; slash = strrchr(path, '/')){
+        *slash = '\0';
+        if (!strchr(path + 5, '/') || unlinkat(dir_fd, path, AT_REMOVEDIR) != 0) { return; }
+    }
+}
+
+/**
+ * compare_packed - qsort comparator for packed-refs entries.
+ */
+static int compare_packed(const void *a, const void *b){
+    return strcmp(((const PackedRef *)a)->name, ((const PackedRef *)b)->name);
+}
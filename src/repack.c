@@ -0,0 +1,800 @@
+/* repack.c: packing loose objects */
+
+#include "repack.h"
+#include "delta.h"
+#include "objects.h"
+#include "pack.h"
+#include "pack_bitmap.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/* Forward Declaration of static Functions */
+
+static bool collect_loose(Repository *repo, RepackEntry **entries, size_t *count);
+static size_t collect_packed(Repository *repo, RepackEntry **entries, size_t count);
+static bool read_headers(Repository *repo, RepackEntry *entries, size_t count, size_t *fresh);
+static void remove_packs(Repository *repo, char (*paths)[MAX_PATH], size_t count, const char *keep, RepackResult *result);
+static void assign_name_hashes(Repository *repo, RepackEntry *entries, size_t count);
+static int  compare_sha(const void *a, const void *b);
+static int  compare_delta_order(const void *a, const void *b);
+static bool write_pack(Repository *repo, const RepackOptions *options, RepackEntry *entries, size_t count, RepackResult *result);
+static bool write_entry(Repository *repo, const RepackOptions *options, PackOutput *out, RepackEntry *entry,
+                        RepackSlot *window, size_t *head, RepackResult *result);
+static bool write_index(const char *path, RepackEntry *entries, size_t count, const unsigned char pack_sha[SHA_SIZE]);
+static void prune_loose(Repository *repo, const RepackEntry *entries, size_t count, RepackResult *result);
+static bool output_open(PackOutput *out, const char *dir);
+static bool output_write(PackOutput *out, const void *data, size_t len);
+static bool output_deflate(PackOutput *out, const unsigned char *data, size_t len, bool finish);
+static bool output_flush(PackOutput *out);
+static bool output_entry_header(PackOutput *out, int type, size_t size, uint64_t distance);
+static void output_abort(PackOutput *out);
+
+/* Functions */
+
+/**
+ * repack_loose - Moves every loose object into one new pack.
+ *
+ * Object headers are probed to learn types and sizes without reading bodies;
+ * trees are then read once so that every object they name gets a name hash.
+ * Objects are sorted by type, name hash and decreasing size, which places
+ * likely delta pairs (versions of the same path) next to each other, and
+ * each one is tried against the previous options->window objects. Only the
+ * window is ever held in memory.
+ *
+ * The pack and its .idx are written to temporary files in objects/pack,
+ * fsync()ed and renamed into place, pack first, so readers never see an
+ * index without its pack; objects/pack is synced before anything is pruned.
+ * Loose objects already present in a pack are not written again.
+ *
+ * @param repo    The repository.
+ * @param options Window, depth and prune settings.
+ * @param result  Output statistics and the new pack's name.
+ * @return True on success (including when there was nothing to pack), false
+ * otherwise. On failure no loose object is removed.
+ */
+bool repack_loose(Repository *repo, const RepackOptions *options, RepackResult *result){
+    if (!repo || !options || !result) { return false; }
+    memset(result, 0, sizeof(*result));
+
+    RepackEntry *entries;
+    size_t count;
+    if (!collect_loose(repo, &entries, &count)) { return false; }
+
+    for (size_t i = 0; i < count; i++) { entries[i].packed = pack_lookup(repo, entries[i].sha, NULL) != NULL; }
+    size_t fresh;
+    if (!read_headers(repo, entries, count, &fresh)){
+        free(entries);
+        return false;
+    }
+
+    qsort(entries, count, sizeof(RepackEntry), compare_sha);
+    assign_name_hashes(repo, entries, count);
+
+    /* New objects first, in delta search order. */
+    for (size_t i = 0, j = 0; i < count; i++){
+        if (entries[i].packed) { continue; }
+        RepackEntry tmp = entries[j];
+        entries[j++] = entries[i];
+        entries[i] = tmp;
+    }
+    qsort(entries, fresh, sizeof(RepackEntry), compare_delta_order);
+
+    bool status = fresh == 0 || write_pack(repo, options, entries, fresh, result);
+    if (status && options->prune) { prune_loose(repo, entries, count, result); }
+
+    free(entries);
+    return status;
+}
+
+/**
+ * repack_all - Writes every object, loose or packed, into one new pack.
+ *
+ * The new pack holds everything reachable, so with options->bitmap a
+ * reachability bitmap is written next to it. With options->prune the loose
+ * objects, every other pack and the multi-pack-index naming them are
+ * removed once the new pack is in place and synced. Deltas are searched
+ * again from scratch, as for loose objects.
+ *
+ * @param repo    The repository.
+ * @param options Window, depth, prune and bitmap settings.
+ * @param result  Output statistics and the new pack's name.
+ * @return True on success (including when there was nothing to pack), false
+ * otherwise. On failure nothing is removed.
+ */
+bool repack_all(Repository *repo, const RepackOptions *options, RepackResult *result){
+    if (!repo || !options || !result) { return false; }
+    memset(result, 0, sizeof(*result));
+
+    RepackEntry *loose;
+    size_t loose_count;
+    if (!collect_loose(repo, &loose, &loose_count)) { return false; }
+
+    size_t old_count = 0;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { old_count++; }
+    char (*old_packs)[MAX_PATH] = safe_malloc(MAX_PATH, old_count ? old_count : 1);
+    old_count = 0;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { memcpy(old_packs[old_count++], pack->path, MAX_PATH); }
+
+    RepackEntry *entries = safe_malloc(sizeof(RepackEntry), loose_count ? loose_count : 1);
+    memcpy(entries, loose, loose_count * sizeof(RepackEntry));
+    size_t count = collect_packed(repo, &entries, loose_count);
+
+    /* a loose copy of a packed object, or an object in several packs, is written once */
+    qsort(entries, count, sizeof(RepackEntry), compare_sha);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++){
+        if (unique && memcmp(entries[unique - 1].sha, entries[i].sha, SHA_SIZE) == 0) { continue; }
+        entries[unique++] = entries[i];
+    }
+    count = unique;
+
+    bool status = read_headers(repo, entries, count, &unique);
+    if (status){
+        assign_name_hashes(repo, entries, count);
+        qsort(entries, count, sizeof(RepackEntry), compare_delta_order);
+        status = count == 0 || write_pack(repo, options, entries, count, result);
+    }
+
+    if (status && options->bitmap && result->name[0]){
+        Pack *pack = pack_list(repo);
+        while (pack && !strstr(pack->path, result->name)) { pack = pack->next; }
+        PackBitmapStats stats;
+        status = pack && pack_bitmap_write(repo, pack, &stats);
+        if (status) { result->bitmaps = stats.commits; }
+    }
+    if (status && options->prune){
+        prune_loose(repo, loose, loose_count, result);
+        remove_packs(repo, old_packs, old_count, result->name, result);
+    }
+
+    free(old_packs);
+    free(entries);
+    free(loose);
+    return status;
+}
+
+/**
+ * repack_name_hash - Hashes a path name the way git's pack-objects does.
+ *
+ * The last characters weigh the most, so files sharing a suffix (the same
+ * name in different directories, or the same extension) sort together.
+ *
+ * @param name The name, not necessarily NUL terminated.
+ * @param len  Length of name.
+ * @return The hash.
+ */
+uint32_t repack_name_hash(const char *name, size_t len){
+    uint32_t hash = 0;
+    for (size_t i = 0; i < len; i++){
+        unsigned char c = (unsigned char)name[i];
+        if (isspace(c)) { continue; }
+        hash = (hash >> 2) + ((uint32_t)c << 24);
+    }
+    return hash;
+}
+
+/* Static Functions */
+
+/**
+ * collect_loose - Lists every loose object under objects/xx/.
+ *
+ * @param repo    The repository.
+ * @param entries Output array (types and sizes not filled in yet).
+ * @param count   Output for the number of entries.
+ * @return True on success, false if objects/ cannot be read.
+ * @note The caller MUST free() *entries.
+ */
+static bool collect_loose(Repository *repo, RepackEntry **entries, size_t *count){
+    int objects_fd = repo_objects_fd(repo);
+    int list_fd = objects_fd < 0 ? -1 : openat(objects_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = list_fd < 0 ? NULL : fdopendir(list_fd);
+    if (!d){
+        fprintf(stderr, "collect_loose: cannot open objects directory\n");
+        if (list_fd >= 0) { close(list_fd); }
+        return false;
+    }
+
+    size_t capacity = 256;
+    *entries = safe_malloc(sizeof(RepackEntry), capacity);
+    *count = 0;
+
+    for (struct dirent *e = readdir(d); e; e = readdir(d)){
+        if (strlen(e->d_name) != 2 || !isxdigit((unsigned char)e->d_name[0]) || !isxdigit((unsigned char)e->d_name[1])) { continue; }
+
+        int sub_fd = openat(objects_fd, e->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *sub = sub_fd < 0 ? NULL : fdopendir(sub_fd);
+        if (!sub){
+            if (sub_fd >= 0) { close(sub_fd); }
+            continue;
+        }
+
+        for (struct dirent *f = readdir(sub); f; f = readdir(sub)){
+            char hex[SHA_HEX_SIZE];
+            if (strlen(f->d_name) != SHA_HEX_SIZE - 3) { continue; }
+            memcpy(hex, e->d_name, 2);
+            memcpy(hex + 2, f->d_name, SHA_HEX_SIZE - 2);
+
+            if (*count == capacity){
+                capacity *= 2;
+                *entries = realloc(*entries, capacity * sizeof(RepackEntry));
+                MALLOC_CHECK(*entries);
+            }
+            RepackEntry *entry = &(*entries)[*count];
+            memset(entry, 0, sizeof(*entry));
+            if (hex_to_sha(hex, entry->sha)) { (*count)++; }
+        }
+        closedir(sub);
+    }
+
+    closedir(d);
+    return true;
+}
+
+/**
+ * collect_packed - Appends every object of every pack to a list.
+ *
+ * @param repo    The repository.
+ * @param entries Array holding count entries; grown as needed.
+ * @param count   Number of entries already in it.
+ * @return The new number of entries.
+ */
+static size_t collect_packed(Repository *repo, RepackEntry **entries, size_t count){
+    size_t total = count;
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next) { total += pack->count; }
+    *entries = realloc(*entries, (total ? total : 1) * sizeof(RepackEntry));
+    MALLOC_CHECK(*entries);
+
+    for (Pack *pack = pack_list(repo); pack; pack = pack->next){
+        for (uint32_t i = 0; i < pack->count; i++){
+            RepackEntry *entry = &(*entries)[count++];
+            memset(entry, 0, sizeof(*entry));
+            memcpy(entry->sha, pack->oids + (size_t)i * SHA_SIZE, SHA_SIZE);
+        }
+    }
+    return count;
+}
+
+/**
+ * read_headers - Learns the type and size of every object to be written.
+ *
+ * @param repo    The repository.
+ * @param entries Collected objects; those flagged packed are skipped.
+ * @param count   Number of entries.
+ * @param fresh   Output for the number of objects to write.
+ * @return False if an object cannot be read.
+ */
+static bool read_headers(Repository *repo, RepackEntry *entries, size_t count, size_t *fresh){
+    *fresh = 0;
+    for (size_t i = 0; i < count; i++){
+        RepackEntry *e = &entries[i];
+        if (e->packed) { continue; }
+
+        if (!object_read_header(repo, e->sha, &e->type, &e->size)){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(e->sha, hex);
+            fprintf(stderr, "read_headers: cannot read object %s\n", hex);
+            return false;
+        }
+        (*fresh)++;
+    }
+    return true;
+}
+
+/**
+ * assign_name_hashes - Gives each object the name hash of a tree entry naming it.
+ *
+ * @param repo    The repository.
+ * @param entries All collected objects, sorted by SHA.
+ * @param count   Number of entries.
+ */
+static void assign_name_hashes(Repository *repo, RepackEntry *entries, size_t count){
+    for (size_t i = 0; i < count; i++){
+        if (entries[i].packed || entries[i].type != OBJ_TREE) { continue; }
+
+        ObjectType type;
+        size_t size;
+        unsigned char *tree = object_read(repo, entries[i].sha, &type, &size);
+        if (!tree) { continue; }
+
+        /* "<mode> <name>\0<20-byte sha>" repeated */
+        const unsigned char *p = tree, *end = tree + size;
+        while (p < end){
+            const unsigned char *space = memchr(p, ' ', (size_t)(end - p));
+            const unsigned char *nul = space ? memchr(space, '\0', (size_t)(end - space)) : NULL;
+            if (!nul || (size_t)(end - nul) <= SHA_SIZE) { break; }
+
+            RepackEntry key;
+            memcpy(key.sha, nul + 1, SHA_SIZE);
+            RepackEntry *child = bsearch(&key, entries, count, sizeof(RepackEntry), compare_sha);
+            if (child && !child->name_hash){
+                child->name_hash = repack_name_hash((const char *)space + 1, (size_t)(nul - space - 1));
+            }
+            p = nul + 1 + SHA_SIZE;
+        }
+        free(tree);
+    }
+}
+
+/**
+ * compare_sha - qsort/bsearch comparator on object names.
+ */
+static int compare_sha(const void *a, const void *b){
+    return memcmp(((const RepackEntry *)a)->sha, ((const RepackEntry *)b)->sha, SHA_SIZE);
+}
+
+/**
+ * compare_delta_order - Orders objects by type, name hash, then decreasing size.
+ *
+ * Larger objects come first so that deltas mostly remove data, which keeps
+ * them small, and the newest (usually largest) version stays whole.
+ */
+static int compare_delta_order(const void *a, const void *b){
+    const RepackEntry *x = a, *y = b;
+
+    if (x->type != y->type)           { return x->type > y->type ? -1 : 1; }
+    if (x->name_hash != y->name_hash) { return x->name_hash > y->name_hash ? -1 : 1; }
+    if (x->size != y->size)           { return x->size > y->size ? -1 : 1; }
+    return memcmp(x->sha, y->sha, SHA_SIZE);
+}
+
+/**
+ * write_pack - Writes entries as pack-<sha>.pack and its index.
+ *
+ * @param repo    The repository.
+ * @param options Window and depth settings.
+ * @param entries Objects to pack, in delta search order; offsets and CRCs
+ *                are filled in and the array is left sorted by SHA.
+ * @param count   Number of entries.
+ * @param result  Output statistics and pack name.
+ * @return True once both files are in place and synced, false otherwise. A
+ * pack installed but not synced stays, but the caller must not prune.
+ */
+static bool write_pack(Repository *repo, const RepackOptions *options, RepackEntry *entries, size_t count, RepackResult *result){
+    char *pack_dir = repo_dir(repo, true, "objects", "pack", NULL);
+    if (!pack_dir) { return false; }
+
+    PackOutput *out = safe_malloc(sizeof(PackOutput), 1);
+    size_t slots = options->window ? options->window : 1;
+    RepackSlot *window = safe_calloc(sizeof(RepackSlot), slots);
+    char idx_tmp[MAX_PATH] = "";
+    bool status = false;
+
+    if (!output_open(out, pack_dir)) { goto free_window; }
+
+    unsigned char header[PACK_HEADER_SIZE];
+    memcpy(header, PACK_SIGNATURE, 4);
+    put_be32(header + 4, 2);
+    put_be32(header + 8, (uint32_t)count);
+    if (!output_write(out, header, sizeof(header))) { goto cleanup; }
+
+    size_t head = 0;
+    for (size_t i = 0; i < count; i++){
+        if (!write_entry(repo, options, out, &entries[i], window, &head, result)) { goto cleanup; }
+    }
+
+    unsigned char pack_sha[SHA_SIZE];
+    if (!output_flush(out)) { goto cleanup; }
+    sha1_final(&out->sha, pack_sha);
+    if (!write_all(out->fd, pack_sha, SHA_SIZE)){
+        fprintf(stderr, "write_pack: write to %s failed: %s\n", out->path, strerror(errno));
+        goto cleanup;
+    }
+    if (fsync(out->fd) != 0){
+        fprintf(stderr, "write_pack: cannot sync %s: %s\n", out->path, strerror(errno));
+        goto cleanup;
+    }
+    fchmod(out->fd, 0444);
+    close(out->fd);
+    out->fd = -1;
+
+    qsort(entries, count, sizeof(RepackEntry), compare_sha);
+    int n = snprintf(idx_tmp, sizeof(idx_tmp), "%s/tmp_idx_XXXXXX", pack_dir);
+    int fd = n > 0 && (size_t)n < sizeof(idx_tmp) ? mkstemp(idx_tmp) : -1;
+    if (fd < 0){
+        fprintf(stderr, "write_pack: cannot create index in %s\n", pack_dir);
+        idx_tmp[0] = '\0';
+        goto cleanup;
+    }
+    close(fd);
+    if (!write_index(idx_tmp, entries, count, pack_sha)) { goto cleanup; }
+
+    sha_to_hex(pack_sha, result->name);
+    char name[MAX_NAME];
+    snprintf(name, sizeof(name), "pack-%s.pack", result->name);
+    char *pack_path = path_join(pack_dir, name, NULL);
+    snprintf(name, sizeof(name), "pack-%s.idx", result->name);
+    char *idx_path = path_join(pack_dir, name, NULL);
+
+    if (rename(out->path, pack_path) < 0 || rename(idx_tmp, idx_path) < 0){
+        fprintf(stderr, "write_pack: cannot install %s: %s\n", pack_path, strerror(errno));
+        unlink(pack_path);
+        result->name[0] = '\0';
+    } else {
+        /* Both names must be durable before any copy they replace is removed. */
+        int dir_fd = open(pack_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        status = dir_fd >= 0 && fsync(dir_fd) == 0;
+        if (!status) { fprintf(stderr, "write_pack: cannot sync %s: %s\n", pack_dir, strerror(errno)); }
+        if (dir_fd >= 0) { close(dir_fd); }
+        result->objects = count;
+    }
+    free(pack_path);
+    free(idx_path);
+
+    /* Make the new pack visible to lookups through this repository. */
+    pack_list_free(repo);
+
+cleanup:
+    if (!status){
+        output_abort(out);
+        if (idx_tmp[0]) { unlink(idx_tmp); }
+    }
+    deflateEnd(&out->zs);
+free_window:
+    for (size_t i = 0; i < slots; i++){
+        free(window[i].data);
+        delta_index_free(window[i].index);
+    }
+    free(window);
+    free(out);
+    free(pack_dir);
+    return status;
+}
+
+/**
+ * write_entry - Writes one object, as a delta against the window if that pays off.
+ *
+ * Every slot of the same type whose chain is shorter than options->depth is
+ * tried; each later attempt must beat the best delta so far, and the first
+ * must be under half the object's size. The object then takes over the
+ * oldest slot.
+ *
+ * @param repo    The repository.
+ * @param options Window and depth settings.
+ * @param out     The pack being written.
+ * @param entry   The object; its offset and CRC are filled in.
+ * @param window  The options->window most recently written objects.
+ * @param head    Slot to replace next.
+ * @param result  Statistics.
+ * @return True on success, false on a read or write error.
+ */
+static bool write_entry(Repository *repo, const RepackOptions *options, PackOutput *out, RepackEntry *entry,
+                        RepackSlot *window, size_t *head, RepackResult *result){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(entry->sha, hex);
+    entry->offset = out->offset;
+    out->crc = (uint32_t)crc32(0, NULL, 0);
+
+    /* Too large to hold in the window: stream it straight into the pack. */
+    if (entry->size > REPACK_DELTA_MAX){
+        ObjectStream *stream = object_stream_open(repo, entry->sha);
+        if (!stream || !output_entry_header(out, entry->type, entry->size, 0)){
+            object_stream_close(stream);
+            return false;
+        }
+        const unsigned char *chunk;
+        ssize_t n;
+        bool ok = true;
+        while (ok && (n = object_stream_next(stream, &chunk)) > 0) { ok = output_deflate(out, chunk, (size_t)n, false); }
+        ok = ok && n == 0 && output_deflate(out, NULL, 0, true);
+        object_stream_close(stream);
+        entry->crc = out->crc;
+        return ok;
+    }
+
+    ObjectType type;
+    size_t size;
+    unsigned char *data = object_read(repo, entry->sha, &type, &size);
+    if (!data || type != entry->type || size != entry->size){
+        fprintf(stderr, "write_entry: cannot read %s\n", hex);
+        free(data);
+        return false;
+    }
+
+    unsigned char *best = NULL;
+    size_t best_len = 0;
+    RepackSlot *base = NULL;
+    size_t slots = options->window;
+
+    for (size_t k = 1; size >= REPACK_DELTA_MIN && k <= slots; k++){
+        RepackSlot *slot = &window[(*head + slots - k) % slots];
+        if (!slot->entry || slot->entry->type != type || slot->depth >= options->depth) { continue; }
+        if (slot->entry->size < size / 32) { continue; }
+
+        size_t max_size = best ? best_len - 1 : size / 2 - 20;
+        if (!slot->index) { slot->index = delta_index_create(slot->data, slot->entry->size); }
+        size_t delta_len;
+        unsigned char *delta = delta_create(slot->index, data, size, max_size, &delta_len);
+        if (!delta) { continue; }
+
+        free(best);
+        best = delta;
+        best_len = delta_len;
+        base = slot;
+    }
+
+    bool ok;
+    if (best){
+        ok = output_entry_header(out, PACK_OFS_DELTA, best_len, entry->offset - base->entry->offset) &&
+             output_deflate(out, best, best_len, true);
+        result->deltas++;
+    } else {
+        ok = output_entry_header(out, type, size, 0) && output_deflate(out, data, size, true);
+    }
+    entry->crc = out->crc;
+    free(best);
+
+    if (!slots){
+        free(data);
+        return ok;
+    }
+    size_t depth = base ? base->depth + 1 : 0;
+    RepackSlot *slot = &window[*head];
+    free(slot->data);
+    delta_index_free(slot->index);
+    *slot = (RepackSlot){ .entry = entry, .data = data, .index = NULL, .depth = depth };
+    *head = (*head + 1) % slots;
+    return ok;
+}
+
+/**
+ * write_index - Writes a version 2 pack index and syncs it to disk.
+ *
+ * @param path     File to write (already created).
+ * @param entries  Packed objects sorted by SHA, with offsets and CRCs.
+ * @param count    Number of entries.
+ * @param pack_sha Checksum of the packfile, repeated in the index trailer.
+ * @return True on success, false on a write error.
+ */
+static bool write_index(const char *path, RepackEntry *entries, size_t count, const unsigned char pack_sha[SHA_SIZE]){
+    size_t large = 0;
+    for (size_t i = 0; i < count; i++){
+        if (entries[i].offset >= REPACK_LARGE_OFFSET) { large++; }
+    }
+
+    size_t len = 8 + PACK_IDX_FANOUT * 4 + count * (SHA_SIZE + 8) + large * 8 + 2 * SHA_SIZE;
+    unsigned char *idx = safe_calloc(sizeof(unsigned char), len);
+    memcpy(idx, PACK_IDX_SIGNATURE, 4);
+    put_be32(idx + 4, 2);
+
+    unsigned char *fanout = idx + 8;
+    unsigned char *oids = fanout + PACK_IDX_FANOUT * 4;
+    unsigned char *crcs = oids + count * SHA_SIZE;
+    unsigned char *offsets = crcs + count * 4;
+    unsigned char *large_offsets = offsets + count * 4;
+
+    for (size_t b = 0, i = 0; b < PACK_IDX_FANOUT; b++){
+        while (i < count && entries[i].sha[0] <= b) { i++; }
+        put_be32(fanout + 4 * b, (uint32_t)i);
+    }
+
+    size_t next_large = 0;
+    for (size_t i = 0; i < count; i++){
+        memcpy(oids + i * SHA_SIZE, entries[i].sha, SHA_SIZE);
+        put_be32(crcs + i * 4, entries[i].crc);
+        if (entries[i].offset < REPACK_LARGE_OFFSET){
+            put_be32(offsets + i * 4, (uint32_t)entries[i].offset);
+        } else {
+            put_be32(offsets + i * 4, REPACK_LARGE_OFFSET | (uint32_t)next_large);
+            put_be64(large_offsets + next_large++ * 8, entries[i].offset);
+        }
+    }
+
+    unsigned char *trailer = large_offsets + large * 8;
+    memcpy(trailer, pack_sha, SHA_SIZE);
+    sha1_buffer(idx, len - SHA_SIZE, trailer + SHA_SIZE);
+
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    bool status = fd >= 0 && write_all(fd, idx, len) && fsync(fd) == 0;
+    if (!status) { fprintf(stderr, "write_index: cannot write %s: %s\n", path, strerror(errno)); }
+    if (fd >= 0){
+        fchmod(fd, 0444);
+        close(fd);
+    }
+    free(idx);
+    return status;
+}
+
+/**
+ * prune_loose - Removes loose copies of objects that are now packed.
+ *
+ * @param repo    The repository.
+ * @param entries Every collected loose object.
+ * @param count   Number of entries.
+ * @param result  Statistics.
+ */
+static void prune_loose(Repository *repo, const RepackEntry *entries, size_t count, RepackResult *result){
+    for (size_t i = 0; i < count; i++){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(entries[i].sha, hex);
+        int dir_fd = repo_fanout_fd(repo, entries[i].sha[0], false);
+        if (dir_fd >= 0 && unlinkat(dir_fd, hex + 2, 0) == 0) { result->pruned++; }
+    }
+
+    /* Fan-out directories that are now empty; rmdir() leaves the others. */
+    int objects_fd = repo_objects_fd(repo);
+    for (int b = 0; b < REPO_FANOUT_DIRS; b++){
+        char dir[3];
+        snprintf(dir, sizeof(dir), "%02x", b);
+        if (objects_fd >= 0 && unlinkat(objects_fd, dir, AT_REMOVEDIR) == 0){
+            repo_fanout_forget(repo, (unsigned int)b);
+        }
+    }
+}
+
+/**
+ * remove_packs - Deletes packs that the new one replaces.
+ *
+ * The .idx goes first, so readers stop finding a pack before its data
+ * disappears; the multi-pack-index is removed as it names them.
+ *
+ * @param repo   The repository.
+ * @param paths  The .pack paths of the packs present before repacking.
+ * @param count  Number of paths.
+ * @param keep   Name of the new pack, which may equal an old one.
+ * @param result Statistics.
+ */
+static void remove_packs(Repository *repo, char (*paths)[MAX_PATH], size_t count, const char *keep, RepackResult *result){
+    pack_list_free(repo);
+    for (size_t i = 0; i < count; i++){
+        size_t len = strlen(paths[i]);
+        if (strstr(paths[i], keep) || len < 5 || len + 3 >= MAX_PATH) { continue; }
+
+        const char *exts[] = { ".idx", ".pack", ".bitmap", ".rev" };
+        char path[MAX_PATH];
+        for (size_t e = 0; e < sizeof(exts) / sizeof(exts[0]); e++){
+            snprintf(path, sizeof(path), "%.*s%s", (int)(len - 5), paths[i], exts[e]);
+            unlink(path);
+        }
+        result->packs_removed++;
+    }
+
+    char midx[MAX_PATH];
+    repo_path_buf(repo, midx, sizeof(midx), "objects", "pack", "multi-pack-index", NULL);
+    unlink(midx);
+}
+
+/**
+ * output_open - Creates a temporary packfile in dir and starts hashing it.
+ */
+static bool output_open(PackOutput *out, const char *dir){
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+
+    int n = snprintf(out->path, sizeof(out->path), "%s/tmp_pack_XXXXXX", dir);
+    if (n < 0 || (size_t)n >= sizeof(out->path)) { return false; }
+    out->fd = mkstemp(out->path);
+    if (out->fd < 0){
+        fprintf(stderr, "output_open: cannot create %s: %s\n", out->path, strerror(errno));
+        return false;
+    }
+    if (deflateInit(&out->zs, Z_DEFAULT_COMPRESSION) != Z_OK){
+        close(out->fd);
+        unlink(out->path);
+        out->fd = -1;
+        return false;
+    }
+    sha1_init(&out->sha);
+    return true;
+}
+
+/**
+ * output_write - Appends raw bytes to the pack, updating checksum, CRC and offset.
+ */
+static bool output_write(PackOutput *out, const void *data, size_t len){
+    const unsigned char *p = data;
+    while (len){
+        if (out->buf_len == sizeof(out->buf) && !output_flush(out)) { return false; }
+        size_t take = min(len, sizeof(out->buf) - out->buf_len);
+        memcpy(out->buf + out->buf_len, p, take);
+        sha1_update(&out->sha, p, take);
+        out->crc = (uint32_t)crc32(out->crc, p, (uInt)take);
+        out->buf_len += take;
+        out->offset += take;
+        p += take;
+        len -= take;
+    }
+    return true;
+}
+
+/**
+ * output_deflate - Compresses entry data straight into the output buffer.
+ *
+ * @param out    The pack being written.
+ * @param data   Next piece of the entry's data.
+ * @param len    Size of data.
+ * @param finish True with the last piece, to end the zlib stream.
+ * @return True on success, false on a zlib or write error.
+ */
+static bool output_deflate(PackOutput *out, const unsigned char *data, size_t len, bool finish){
+    z_stream *zs = &out->zs;
+    int ret = Z_OK;
+
+    while (len || finish){
+        size_t take = min(len, (size_t)UINT32_MAX);
+        zs->next_in = (Bytef *)data;
+        zs->avail_in = (uInt)take;
+        data += take;
+        len -= take;
+        int flush = finish && len == 0 ? Z_FINISH : Z_NO_FLUSH;
+
+        do {
+            if (out->buf_len == sizeof(out->buf) && !output_flush(out)) { return false; }
+            unsigned char *start = out->buf + out->buf_len;
+            zs->next_out = start;
+            zs->avail_out = (uInt)(sizeof(out->buf) - out->buf_len);
+            ret = deflate(zs, flush);
+            if (ret == Z_STREAM_ERROR) { return false; }
+
+            size_t produced = (size_t)(zs->next_out - start);
+            sha1_update(&out->sha, start, produced);
+            out->crc = (uint32_t)crc32(out->crc, start, (uInt)produced);
+            out->buf_len += produced;
+            out->offset += produced;
+        } while (zs->avail_in || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+        if (flush == Z_FINISH) { break; }
+    }
+    return true;
+}
+
+/**
+ * output_flush - Writes the buffered bytes to the temporary packfile.
+ */
+static bool output_flush(PackOutput *out){
+    if (!write_all(out->fd, out->buf, out->buf_len)){
+        fprintf(stderr, "output_flush: write to %s failed: %s\n", out->path, strerror(errno));
+        return false;
+    }
+    out->buf_len = 0;
+    return true;
+}
+
+/**
+ * output_entry_header - Writes an entry's type/size varint (and OFS_DELTA distance).
+ *
+ * Also resets the deflate stream for the entry's data.
+ */
+static bool output_entry_header(PackOutput *out, int type, size_t size, uint64_t distance){
+    unsigned char header[32];
+    size_t n = 0;
+    unsigned char c = (unsigned char)((type << 4) | (size & 15));
+    for (size >>= 4; size; size >>= 7){
+        header[n++] = c | 0x80;
+        c = size & 0x7f;
+    }
+    header[n++] = c;
+
+    if (type == PACK_OFS_DELTA){
+        unsigned char buf[10];
+        size_t pos = sizeof(buf) - 1;
+        buf[pos] = distance & 0x7f;
+        while (distance >>= 7) { buf[--pos] = 0x80 | (--distance & 0x7f); }
+        memcpy(header + n, buf + pos, sizeof(buf) - pos);
+        n += sizeof(buf) - pos;
+    }
+
+    deflateReset(&out->zs);
+    return output_write(out, header, n);
+}
+
+/**
+ * output_abort - Closes and removes a partially written packfile.
+ */
+static void output_abort(PackOutput *out){
+    if (out->fd >= 0) { close(out->fd); }
+    if (out->path[0]) { unlink(out->path); }
+    out->fd = -1;
+}
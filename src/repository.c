@@ -1,7 +1,12 @@
 /* repository.c: handles repo functions */
 
 #include "repository.h"
-#include "ini.h"
+#include "abbrev.h"
+#include "commit_graph.h"
+#include "config.h"
+#include "objects.h"
+#include "pack.h"
+#include "refs.h"
 #include "utils.h"
 
 #include <stdio.h>
@@ -9,15 +14,47 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <assert.h>
 
+/* Macros */
+
+#define REPO_GITFILE_PREFIX "gitdir: "
+
+/* Structures */
+
+/* Last successful repo_find() walk, reused while the start and config are unchanged */
+typedef struct {
+    bool          valid;
+    char          start[MAX_PATH];      /* absolute start path, the cache key */
+    char          env[MAX_PATH];        /* discovery_env() during that walk */
+    char          worktree[MAX_PATH];
+    char          gitdir[MAX_PATH];
+    Configuration *config;              /* copy handed out while config_is_current() */
+} RepoDiscovery;
+
+static RepoDiscovery discovery;
+
 /* Forward Declaration of static Functions */
 
-static int handler(void* user, const char* section, const char* name, const char* value);
 static char *build_path(Repository *repo, va_list args);
+static Repository *repo_alloc(void);
+static int cached_dirfd(atomic_int *slot, int parent, const char *name, bool create);
+static bool repo_load_config(Repository *repo, bool force);
+static Repository *repo_open(const char *worktree, const char *gitdir);
+static bool repo_discover(const char *path, const char *ceilings, char worktree[MAX_PATH], char gitdir[MAX_PATH]);
+static bool read_gitfile(const char *file, size_t len, char gitdir[MAX_PATH]);
+static size_t ceiling_list(const char *ceilings, char out[MAX_PATH]);
+static bool is_ceiling(const char *dir, const char *stops, size_t len);
+static bool discovery_key(const char *path, char key[MAX_PATH]);
+static bool discovery_env(char env[MAX_PATH]);
+static Repository *discovery_lookup(const char *start, const char *env);
+static void discovery_store(const char *start, const char *env, const Repository *repo);
 
 /* Functions */
 
@@ -37,8 +74,9 @@ static char *build_path(Repository *repo, va_list args);
  */
 Repository *repo_create(const char *path, bool force){
     if (!path) { return NULL; }
+    TRACE_SCOPE(TRACE_REPO_CREATE);
 
-    Repository *repo = safe_calloc(sizeof(Repository), 1);
+    Repository *repo = repo_alloc();
     strncpy(repo->worktree, path, strlen(path) + 1);
     char *gitdir = path_join(path, ".git", NULL);
     if (gitdir){
@@ -51,24 +89,7 @@ Repository *repo_create(const char *path, bool force){
         goto fail;
     }
 
-    char *config_file_path = path_join(repo->gitdir, "config", NULL);
-
-    if (config_file_path && file_exists(config_file_path)){
-        repo->config = repo_config_create(config_file_path);
-        if (!repo->config){ 
-            free(config_file_path);
-            goto fail; 
-        }
-    } else if (!force){
-       fprintf(stderr, "repo_create: Configuration File is missing\n"); 
-       goto fail;
-    }
-    free(config_file_path);
-
-    if (!force && repo->config->repo_format_version != 0){
-        fprintf(stderr, "repo_create: Unsupported repositoryformatversion: %d\n", repo->config->repo_format_version);
-        goto fail;
-    }
+    if (!repo_load_config(repo, force)) { goto fail; }
 
     return repo;
 
@@ -145,6 +166,8 @@ Repository *repo_init(const char *path){
     fclose(f);
     free(s);
 
+    /* a repository nested below the cached one must win the next walk */
+    discovery.valid = false;
     return repo;
 
 fail:
@@ -153,9 +176,15 @@ fail:
 }
 
 /**
- * repo_find - Recursively searches for a Git repository starting from the given path.
+ * repo_find - Iteratively searches for a Git repository starting from the given path.
  *
- * Walks up the directory tree looking for a ".git" directory.
+ * Resolves the start path once, then walks up a single buffer probing
+ * "<dir>/.git" with one stat() per level; a ".git" file holding
+ * "gitdir: <path>" (linked worktrees, submodules) is followed. GIT_DIR skips
+ * the walk entirely (the worktree is GIT_WORK_TREE, or the start path), and
+ * the walk never ascends into a directory listed in GIT_CEILING_DIRECTORIES.
+ * The last result is cached per process: a repeated call from the same start
+ * costs one stat() of the config, which is only re-parsed when it changed.
  *
  * @param path The directory to start the search from.
  * @param required If true, the function will terminate the program or log a 
@@ -165,89 +194,114 @@ fail:
  */
 Repository *repo_find(const char *path, bool required){
     if (!path) { return NULL; }
-
-    char *real_path = realpath(path, NULL);
-    if (!real_path) { return NULL; }
-
-    char *gitdir = path_join(real_path, ".git", NULL);
-    
-    if (is_directory(gitdir)){
-
-        free(gitdir);
-        Repository *repo = repo_create(real_path, false);
-        free(real_path);
-        return repo;
+    TRACE_SCOPE(TRACE_REPO_FIND);
+
+    char worktree[MAX_PATH], gitdir[MAX_PATH];
+    const char *env_gitdir = getenv("GIT_DIR");
+    if (env_gitdir && *env_gitdir){
+        const char *env_worktree = getenv("GIT_WORK_TREE");
+        if (!realpath(env_worktree && *env_worktree ? env_worktree : path, worktree) ||
+            strlen(env_gitdir) >= MAX_PATH || !is_directory(env_gitdir)){
+            fprintf(stderr, "repo_find: not a git repository: %s\n", env_gitdir);
+            if (required) { exit(EXIT_FAILURE); }
+            return NULL;
+        }
+        strcpy(gitdir, env_gitdir);
+        return repo_open(worktree, gitdir);
     }
 
-    free(gitdir);
-
-    char *parent = path_join(path, "..", NULL);
-    char *real_parent = realpath(parent, NULL);
+    const char *ceilings = getenv("GIT_CEILING_DIRECTORIES");
+    if (!ceilings) { ceilings = ""; }
 
-    free(parent);
-    if (!real_parent){
-        free(real_path);
-        return NULL;
+    char start[MAX_PATH], env[MAX_PATH];
+    if (!discovery_env(env)) { start[0] = '\0'; }
+    else if (discovery_key(path, start)){
+        Repository *repo = discovery_lookup(start, env);
+        if (repo) { return repo; }
     }
 
-    if (streq(real_parent, real_path)){
-        free(real_path);
-        free(real_parent);
+    if (!repo_discover(path, ceilings, worktree, gitdir)){
         if (required){
             fprintf(stderr, "repo_find: no git directory\n");
             exit(EXIT_FAILURE);
         }
         return NULL;
-    } 
-
-    free(real_path);
-    Repository *found= repo_find(real_parent, required);
-    free(real_parent);
-    return found;
+    }
 
+    Repository *repo = repo_open(worktree, gitdir);
+    if (repo && *start){
+        discovery_store(start, env, repo);
+    }
+    return repo;
 }
 
-
+/**
+ * repo_discovery_reset - Forgets the walk cached by repo_find().
+ *
+ * Every command is a new process, so only the benchmarks need this: it
+ * makes the next repo_find() walk up from its start path again.
+ */
+void repo_discovery_reset(void){
+    config_free(discovery.config);
+    memset(&discovery, 0, sizeof(discovery));
+}
 
 /**
  * repo_config_create - Loads repository configuration from an INI file.
  *
- * This function parses a git-style INI configuration file at the specified path,
- * allocating and populating a Configuration struct with values for repository
- * format version, filemode, and bare status.
+ * The global config files are read first (see config_read_global()), then
+ * the file at path, whose values win. Every key lands in the config table;
+ * the core settings the repository needs on each open are also decoded
+ * into the typed fields.
  *
  * @param path The filesystem path to the INI configuration file (e.g., .git/config).
  * @return A pointer to the newly allocated Configuration object, or NULL if the
- * file could not be opened, parsed, or if memory allocation failed.
+ * file could not be opened or parsed.
  * @note The caller is responsible for freeing the returned Configuration pointer 
- * using free() when it is no longer needed.
+ * using config_free() when it is no longer needed.
  */
 Configuration *repo_config_create(const char *path){
+    TRACE_SCOPE(TRACE_CONFIG_CREATE);
     Configuration *config = safe_calloc(sizeof(Configuration), 1);
 
-    if (ini_parse(path, handler, config) < 0){
+    if (!config_read_global(config) || !config_read_file(config, path)){
         fprintf(stderr, "repo_config_create: cannot load %s\n", path);
-        free(config);
+        config_free(config);
         return NULL;
     }
 
+    config->repo_format_version = (int)config_get_int(config, "core.repositoryformatversion", 0);
+    config->filemode = config_get_bool(config, "core.filemode", false);
+    config->bare = config_get_bool(config, "core.bare", false);
+    config->delta_base_cache_limit = config_get_size(config, "core.deltaBaseCacheLimit", DELTA_BASE_CACHE_LIMIT);
     return config;
 }
 
 /**
  * repo_destory - Frees all memory associated with a Repository object.
  *
- * Closes any open file descriptors, frees internal strings, and finally 
+ * Closes any open file descriptors, frees internal strings, unmaps packs,
+ * drops every parsed object along with the arena backing them, and finally 
  * frees the Repository struct itself.
  *
  * @param repo The Repository object to deallocate.
  */
 void repo_destroy(Repository *repo){
     if (!repo) { return; }
-    if (repo->config){
-        free(repo->config);
-        repo->config = NULL;
-    }
+    if (repo->object_batch) { object_batch_commit(repo, NULL); }   /* staged objects are not left under temporary names */
+    config_free(repo->config);
+    repo->config = NULL;
+    pack_list_free(repo);
+    commit_graph_free(repo);
+    packed_refs_free(repo);
+    loose_cache_free(repo);
+    object_cache_free(repo);
+
+    for (int i = 0; i < REPO_FANOUT_DIRS; i++) { repo_fanout_forget(repo, (unsigned int)i); }
+    int fd = atomic_exchange(&repo->objects_fd, -1);
+    if (fd >= 0) { close(fd); }
+    fd = atomic_exchange(&repo->gitdir_fd, -1);
+    if (fd >= 0) { close(fd); }
 
     free(repo);
 }
@@ -270,6 +324,27 @@ char *repo_path(Repository *repo, ...){
     return arg_path;
 }
 
+/**
+ * repo_path_buf - Computes a path under gitdir into a caller-provided buffer.
+ *
+ * The allocation-free form of repo_path() for lookups that run once per
+ * object or ref; a MAX_PATH buffer on the caller's stack always suffices.
+ *
+ * @param repo The repository context.
+ * @param buf  Destination buffer.
+ * @param size Size of buf in bytes.
+ * @param ...  Additional strings to join. The list MUST end with NULL.
+ * @return buf, or NULL if repo is NULL or the path does not fit.
+ */
+char *repo_path_buf(Repository *repo, char *buf, size_t size, ...){
+    if (!repo || !buf) { return NULL; }
+    va_list args;
+    va_start(args, size);
+    size_t len = path_vjoin_buf(buf, size, repo->gitdir, args);
+    va_end(args);
+    return len ? buf : NULL;
+}
+
 /**
  * repo_file - Computes a path under gitdir and ensures the parent directory exists.
  *
@@ -291,6 +366,7 @@ char *repo_file(Repository *repo, bool mkdir, ...){
     va_start(args, mkdir);
     char *path = build_path(repo, args);
     va_end(args);
+    if (!path) { return NULL; }
 
     int ch = '/';
     char *valid_path = path + strlen(repo->gitdir) + 1;
@@ -334,7 +410,8 @@ char *repo_dir(Repository *repo, bool mkdir, ...){
     va_start(args, mkdir);
     char *path = build_path(repo, args);
     va_end(args);
-    
+    if (!path) { return NULL; }
+
     struct stat sb;
     if (stat(path, &sb) == 0){
         if (S_ISDIR(sb.st_mode)){ return path; }
@@ -352,62 +429,375 @@ char *repo_dir(Repository *repo, bool mkdir, ...){
 }
 
 
-/* Static Functions */
+/**
+ * repo_gitdir_fd - Returns a directory handle on gitdir, opening it on first use.
+ *
+ * Lookups relative to the handle (openat() and friends) skip re-resolving
+ * the worktree prefix, which matters on network filesystems.
+ *
+ * @param repo The repository.
+ * @return The descriptor, owned by repo, or -1 if gitdir cannot be opened.
+ */
+int repo_gitdir_fd(Repository *repo){
+    if (!repo) { return -1; }
+    return cached_dirfd(&repo->gitdir_fd, AT_FDCWD, repo->gitdir, false);
+}
 
 /**
- * handler - Callback function for the INI parser to populate a Configuration struct.
- *
- * This function is invoked by the INI parser for every section/name/value triplet 
- * found in the configuration file. It maps specific INI keys (like protocol.version) 
- * to the corresponding fields in the Configuration structure passed via the user pointer.
- *
- * @param user A pointer to the Configuration struct being populated (passed as void*).
- * @param section The name of the current INI section (e.g., "core", "user").
- * @param name The name of the configuration key.
- * @param value The value associated with the key as a string.
- * @return Returns 1 on a successful match and update, or 0 if the section/name 
- * is unknown or an error occurred.
+ * repo_objects_fd - Returns a directory handle on objects/, creating it if needed.
+ *
+ * @param repo The repository.
+ * @return The descriptor, owned by repo, or -1 on failure.
  */
-static int handler(void* user, const char* section, const char* name, const char* value){
-    Configuration *pconfig = (Configuration*) user;
-
-    #define MATCH(s, n) streq(section, s) && streq(name, n)
-    if (MATCH("core", "repositoryformatversion")){
-        pconfig->repo_format_version = atoi(value);
-    } else if (MATCH("core", "filemode")){
-        pconfig->filemode = streq(value, "true");
-    } else if (MATCH("core", "bare")){
-        pconfig->bare = streq(value, "true");
-    }
+int repo_objects_fd(Repository *repo){
+    if (!repo) { return -1; }
+    return cached_dirfd(&repo->objects_fd, repo_gitdir_fd(repo), "objects", true);
+}
+
+/**
+ * repo_fanout_fd - Returns a directory handle on objects/xx.
+ *
+ * @param repo   The repository.
+ * @param byte   First byte of the object name, selecting objects/xx.
+ * @param create If true, missing directories are created.
+ * @return The descriptor, owned by repo, or -1 (errno set) if the directory
+ * does not exist and create is false, or cannot be opened.
+ * @note Safe to call from several threads; a lost race closes the extra fd.
+ */
+int repo_fanout_fd(Repository *repo, unsigned int byte, bool create){
+    if (!repo || byte >= REPO_FANOUT_DIRS) { return -1; }
+    char name[3];
+    snprintf(name, sizeof(name), "%02x", byte);
+    return cached_dirfd(&repo->fanout_fds[byte], repo_objects_fd(repo), name, create);
+}
 
-    return 1;
+/**
+ * repo_fanout_forget - Closes the cached handle on objects/xx.
+ *
+ * Needed once the directory has been removed, or a later write through
+ * the handle would land in (and fail on) the deleted directory.
+ *
+ * @param repo The repository.
+ * @param byte First byte of the object name.
+ * @note Not safe while other threads may still use the handle.
+ */
+void repo_fanout_forget(Repository *repo, unsigned int byte){
+    if (!repo || byte >= REPO_FANOUT_DIRS) { return; }
+    int fd = atomic_exchange(&repo->fanout_fds[byte], -1);
+    if (fd >= 0) { close(fd); }
 }
 
+/* Static Functions */
+
 /**
  * build_path - Variadic helper to construct a filesystem path from multiple components.
  *
- * This function takes a variable list of string segments and joins them using the 
- * system's path separator. It iteratively allocates memory for the growing path, 
- * ensuring each segment is properly appended.
+ * The components are joined under gitdir in a stack buffer, so the only
+ * allocation is the final copy handed to the caller.
  *
  * @param repo The repository context.
  * @param args A va_list of const char* path segments. The list must be NULL-terminated.
- * @return A dynamically allocated string containing the full path, or NULL if the 
- * initial segment is missing.
+ * @return A dynamically allocated string containing the full path, or NULL if it
+ * would not fit in MAX_PATH.
  * @note The caller is responsible for freeing the returned string. This function 
  * consumes the va_list; the caller must handle va_start and va_end.
  */
 static char *build_path(Repository *repo, va_list args){
-    char *path = NULL;
-    char *full_path = NULL;
-    const char *s = va_arg(args, const char *);
-    if (!s) {return safe_strdup(repo->gitdir); }
-    path = path_join(repo->gitdir, s, NULL);
-
-    while ((s = va_arg(args, const char *))){
-        full_path = path_join(path, s, NULL);
-        free(path);
-        path = full_path;
+    char path[MAX_PATH];
+    if (!path_vjoin_buf(path, sizeof(path), repo->gitdir, args)){
+        fprintf(stderr, "build_path: path too long under %s\n", repo->gitdir);
+        return NULL;
+    }
+    return safe_strdup(path);
+}
+
+/**
+ * repo_load_config - Parses <gitdir>/config into repo->config and validates it.
+ *
+ * @param repo  Repository whose gitdir is already set.
+ * @param force If true, a missing config and unknown format versions are accepted.
+ * @return      true on success, false (with a message) otherwise.
+ */
+static bool repo_load_config(Repository *repo, bool force){
+    char config_file_path[MAX_PATH + sizeof("/config")];
+    snprintf(config_file_path, sizeof(config_file_path), "%s/config", repo->gitdir);
+
+    if (file_exists(config_file_path)){
+        repo->config = repo_config_create(config_file_path);
+        if (!repo->config) { return false; }
+    } else if (!force){
+        fprintf(stderr, "repo_create: Configuration File is missing\n");
+        return false;
     }
-    return full_path != NULL ? full_path : path;
-}
\ No newline at end of file
+
+    if (!force && repo->config->repo_format_version != 0){
+        fprintf(stderr, "repo_create: Unsupported repositoryformatversion: %d\n", repo->config->repo_format_version);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * repo_open - Builds a Repository for an already discovered worktree and gitdir.
+ *
+ * Unlike repo_create() the gitdir is not stat()ed again; the caller found it.
+ *
+ * @param worktree Worktree path, shorter than MAX_PATH.
+ * @param gitdir   Git directory path, shorter than MAX_PATH.
+ * @return         The repository, or NULL if its config is missing or unsupported.
+ */
+static Repository *repo_open(const char *worktree, const char *gitdir){
+    Repository *repo = repo_alloc();
+    strcpy(repo->worktree, worktree);
+    strcpy(repo->gitdir, gitdir);
+    if (!repo_load_config(repo, false)){
+        repo_destroy(repo);
+        return NULL;
+    }
+    return repo;
+}
+
+/**
+ * repo_discover - Walks up from path looking for a git directory.
+ *
+ * @param path     Start directory.
+ * @param ceilings GIT_CEILING_DIRECTORIES value, "" for none.
+ * @param worktree Receives the absolute worktree path.
+ * @param gitdir   Receives the git directory path.
+ * @return         true if a repository was found below every ceiling.
+ */
+static bool repo_discover(const char *path, const char *ceilings, char worktree[MAX_PATH], char gitdir[MAX_PATH]){
+    char dir[MAX_PATH], stops[MAX_PATH];
+    trace_count(TRACE_SYSCALLS, 1);
+    if (!realpath(path, dir)) { return false; }
+    size_t stops_len = ceiling_list(ceilings, stops);
+
+    /* dir[0..len) is the directory being probed; "/" is probed with len 0 */
+    size_t len = strlen(dir);
+    if (len == 1) { len = 0; }
+    for (;;){
+        if (len + sizeof("/.git") > MAX_PATH) { return false; }
+        memcpy(dir + len, "/.git", sizeof("/.git"));
+
+        struct stat sb;
+        trace_count(TRACE_SYSCALLS, 1);
+        if (stat(dir, &sb) == 0){
+            bool found = false;
+            if (S_ISDIR(sb.st_mode)){
+                strcpy(gitdir, dir);
+                found = true;
+            } else if (S_ISREG(sb.st_mode)){
+                found = read_gitfile(dir, len, gitdir);
+            }
+            if (found){
+                dir[len ? len : 1] = '\0';
+                strcpy(worktree, dir);
+                return true;
+            }
+        }
+
+        if (len == 0) { return false; }
+        dir[len] = '\0';
+        len = (size_t)(strrchr(dir, '/') - dir);
+        dir[len ? len : 1] = '\0';
+        if (is_ceiling(dir, stops, stops_len)) { return false; }
+    }
+}
+
+/**
+ * read_gitfile - Follows a ".git" file of the form "gitdir: <path>".
+ *
+ * @param file    Path of the ".git" file; file[0..len) is its directory.
+ * @param len     Length of the directory prefix of file.
+ * @param gitdir  Receives the git directory, relative targets resolved against that directory.
+ * @return        true if the file names an existing directory.
+ */
+static bool read_gitfile(const char *file, size_t len, char gitdir[MAX_PATH]){
+    char line[MAX_PATH];
+    FILE *fp = fopen(file, "r");
+    if (!fp) { return false; }
+    bool ok = fgets(line, sizeof(line), fp) != NULL;
+    fclose(fp);
+    trace_count(TRACE_SYSCALLS, 3);
+
+    size_t prefix = strlen(REPO_GITFILE_PREFIX);
+    if (!ok || strncmp(line, REPO_GITFILE_PREFIX, prefix) != 0) { return false; }
+    char *target = line + prefix;
+    target[strcspn(target, "\r\n")] = '\0';
+    if (!*target) { return false; }
+
+    int n = *target == '/' ? snprintf(gitdir, MAX_PATH, "%s", target)
+                           : snprintf(gitdir, MAX_PATH, "%.*s/%s", (int)len, file, target);
+    return n < MAX_PATH && is_directory(gitdir);
+}
+
+/**
+ * ceiling_list - Resolves GIT_CEILING_DIRECTORIES into NUL-separated real paths.
+ *
+ * Relative entries are ignored, as git does. Each entry costs one realpath(),
+ * paid once per walk rather than once per level.
+ *
+ * @param ceilings Colon-separated list.
+ * @param out      Receives the resolved entries, each NUL-terminated.
+ * @return         Bytes used in out.
+ */
+static size_t ceiling_list(const char *ceilings, char out[MAX_PATH]){
+    size_t used = 0;
+    while (*ceilings){
+        size_t n = strcspn(ceilings, ":");
+        char entry[MAX_PATH], real[MAX_PATH];
+        if (n > 0 && n < MAX_PATH && *ceilings == '/'){
+            memcpy(entry, ceilings, n);
+            entry[n] = '\0';
+            if (realpath(entry, real)){
+                size_t real_len = strlen(real) + 1;
+                if (used + real_len <= MAX_PATH){
+                    memcpy(out + used, real, real_len);
+                    used += real_len;
+                }
+            }
+        }
+        ceilings += n;
+        if (*ceilings == ':') { ceilings++; }
+    }
+    return used;
+}
+
+/**
+ * is_ceiling - Tells whether dir is one of the resolved ceiling directories.
+ */
+static bool is_ceiling(const char *dir, const char *stops, size_t len){
+    for (size_t i = 0; i < len; i += strlen(stops + i) + 1){
+        if (streq(dir, stops + i)) { return true; }
+    }
+    return false;
+}
+
+/**
+ * discovery_key - Builds the cache key for a start path.
+ *
+ * Relative paths are anchored at the current directory so a chdir() between
+ * calls can never return another directory's repository.
+ *
+ * @param path  Start path given to repo_find().
+ * @param key   Receives the key; set to "" when it does not fit.
+ * @return      true if a key was built.
+ */
+static bool discovery_key(const char *path, char key[MAX_PATH]){
+    key[0] = '\0';
+    if (*path == '/'){
+        if (strlen(path) >= MAX_PATH) { return false; }
+        strcpy(key, path);
+        return true;
+    }
+    if (!getcwd(key, MAX_PATH)) { key[0] = '\0'; return false; }
+    size_t len = strlen(key);
+    if (len + 1 + strlen(path) >= MAX_PATH) { key[0] = '\0'; return false; }
+    key[len] = '/';
+    strcpy(key + len + 1, path);
+    return true;
+}
+
+/**
+ * discovery_env - Collects the environment a discovery depends on.
+ *
+ * The ceilings shape the walk and HOME, XDG_CONFIG_HOME and
+ * GIT_CONFIG_GLOBAL choose the global config files, so all of them are
+ * part of the cache key.
+ *
+ * @param env Receives the values, newline separated.
+ * @return False if they do not fit, in which case nothing is cached.
+ */
+static bool discovery_env(char env[MAX_PATH]){
+    static const char *names[] = { "GIT_CEILING_DIRECTORIES", "GIT_CONFIG_GLOBAL", "HOME", "XDG_CONFIG_HOME" };
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        const char *value = getenv(names[i]);
+        int n = snprintf(env + len, MAX_PATH - len, "%c%s\n", value ? '=' : '-', value ? value : "");
+        if (n < 0 || (size_t)n >= MAX_PATH - len) { return false; }
+        len += (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * discovery_lookup - Answers repo_find() from the cached discovery.
+ *
+ * config_is_current() stats the repository config (proving the gitdir still
+ * exists) and every global or included file; if any changed the entry is
+ * dropped and the caller walks again.
+ *
+ * @return A new Repository with a copy of the cached config, or NULL on a miss.
+ */
+static Repository *discovery_lookup(const char *start, const char *env){
+    if (!discovery.valid || !streq(discovery.start, start) || !streq(discovery.env, env)) { return NULL; }
+    if (!config_is_current(discovery.config)){
+        discovery.valid = false;
+        return NULL;
+    }
+
+    Repository *repo = repo_alloc();
+    strcpy(repo->worktree, discovery.worktree);
+    strcpy(repo->gitdir, discovery.gitdir);
+    repo->config = config_copy(discovery.config);
+    return repo;
+}
+
+/**
+ * discovery_store - Remembers a successful walk for the next repo_find().
+ */
+static void discovery_store(const char *start, const char *env, const Repository *repo){
+    discovery.valid = false;
+    config_free(discovery.config);
+    discovery.config = NULL;
+    if (!repo->config) { return; }
+
+    strcpy(discovery.start, start);
+    strcpy(discovery.env, env);
+    strcpy(discovery.worktree, repo->worktree);
+    strcpy(discovery.gitdir, repo->gitdir);
+    discovery.config = config_copy(repo->config);
+    discovery.valid = true;
+}
+
+/**
+ * repo_alloc - Allocates a zeroed Repository with every directory handle unopened.
+ */
+static Repository *repo_alloc(void){
+    Repository *repo = safe_calloc(sizeof(Repository), 1);
+    atomic_init(&repo->gitdir_fd, -1);
+    atomic_init(&repo->objects_fd, -1);
+    for (int i = 0; i < REPO_FANOUT_DIRS; i++) { atomic_init(&repo->fanout_fds[i], -1); }
+    return repo;
+}
+
+/**
+ * cached_dirfd - Opens parent/name as a directory once and caches the descriptor.
+ *
+ * @param slot   Cache slot, -1 while unopened.
+ * @param parent Directory the name is relative to (AT_FDCWD for a path).
+ * @param name   Directory name.
+ * @param create If true, a missing directory is created first.
+ * @return The cached descriptor, or -1 on failure.
+ */
+static int cached_dirfd(atomic_int *slot, int parent, const char *name, bool create){
+    int fd = atomic_load(slot);
+    if (fd >= 0) { return fd; }
+    if (parent < 0 && parent != AT_FDCWD) { return -1; }
+
+    fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    trace_count(TRACE_SYSCALLS, 1);
+    if (fd < 0 && errno == ENOENT && create){
+        trace_count(TRACE_SYSCALLS, 2);
+        if (mkdirat(parent, name, 0755) < 0 && errno != EEXIST) { return -1; }
+        fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (fd < 0) { return -1; }
+
+    int expected = -1;
+    if (!atomic_compare_exchange_strong(slot, &expected, fd)){
+        close(fd);
+        return expected;
+    }
+    return fd;
+}
@@ -0,0 +1,556 @@
+/* revwalk.c: walking commit history */
+
+#include "revwalk.h"
+#include "bloom.h"
+#include "commit_graph.h"
+#include "objects.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Forward Declaration of static Functions */
+
+static bool load_commit(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, RevCommit *commit);
+static bool commit_date_of(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t *pos, uint64_t *date);
+static bool commit_tree_of(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, unsigned char tree[SHA_SIZE]);
+static bool simplify(RevWalk *walk, const RevCommit *commit, size_t *first, size_t *last, bool *show);
+static bool treesame(RevWalk *walk, const RevCommit *commit, size_t nth, bool *same);
+static bool paths_maybe_changed(const RevWalk *walk, const BloomFilter *filter);
+static const GitTree *load_tree(RevWalk *walk, const unsigned char sha[SHA_SIZE]);
+static void reserve_parents(RevWalk *walk, size_t count);
+static void queue_push(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, uint64_t date);
+static void queue_pop(RevWalk *walk, RevQueueEntry *entry);
+static bool queue_before(const RevQueueEntry *a, const RevQueueEntry *b);
+
+/* Functions */
+
+/**
+ * revwalk_init - Prepares a walk over a repository's history.
+ *
+ * The commit-graph is used whenever it knows a commit; other commits are
+ * parsed from the object store, so a stale graph only costs speed.
+ *
+ * @param walk The walk to initialize.
+ * @param repo The repository.
+ * @note Call revwalk_release() when done.
+ */
+void revwalk_init(RevWalk *walk, Repository *repo){
+    memset(walk, 0, sizeof(*walk));
+    walk->repo = repo;
+    walk->graph = commit_graph_load(repo);
+}
+
+/**
+ * revwalk_push - Adds a starting point to the walk.
+ *
+ * @param walk The walk.
+ * @param sha  A commit, or a tag pointing (eventually) to one.
+ * @return True if the commit was queued (or already seen), false if it is
+ * not a commit.
+ */
+bool revwalk_push(RevWalk *walk, const unsigned char sha[SHA_SIZE]){
+    if (!walk || !sha) { return false; }
+
+    unsigned char target[SHA_SIZE];
+    uint32_t pos = REVWALK_NO_POS;
+    if (!commit_graph_find(walk->graph, sha, &pos)){
+        GitObject *object = object_peel(walk->repo, sha, OBJ_COMMIT);
+        if (!object){
+            char hex[SHA_HEX_SIZE];
+            sha_to_hex(sha, hex);
+            fprintf(stderr, "revwalk_push: %s is not a commit\n", hex);
+            return false;
+        }
+        sha = object->sha;
+    }
+    memcpy(target, sha, SHA_SIZE);
+
+    if (!sha_set_insert(&walk->seen, target)) { return true; }
+
+    uint64_t date;
+    if (!commit_date_of(walk, target, &pos, &date)) { return false; }
+    queue_push(walk, target, pos, date);
+    return true;
+}
+
+/**
+ * revwalk_limit_paths - Restricts the walk to commits that change some paths.
+ *
+ * History is simplified as git log does by default: a commit is shown when
+ * it differs from every parent at one of the paths (a root, when it has one
+ * of them), and a merge that matches some parent there is hidden and only
+ * that parent is followed. A path names a file or a whole directory.
+ *
+ * A Bloom filter key is prepared for each path and each of its leading
+ * directories; a commit whose commit-graph filter lacks a key of every path
+ * is known to match its first parent without reading a tree.
+ *
+ * @param walk  The walk, before the first revwalk_next().
+ * @param paths Paths relative to the top of the worktree; "." or an empty
+ *              path matches everything and removes the limit.
+ * @param count Number of paths.
+ */
+void revwalk_limit_paths(RevWalk *walk, char *const *paths, size_t count){
+    if (!walk || !count) { return; }
+
+    char **normal = safe_calloc(sizeof(char *), count);
+    size_t keys = 0;
+    for (size_t i = 0; i < count; i++){
+        const char *path = paths[i];
+        while (path[0] == '.' && path[1] == '/') { path += 2; }
+
+        /* "a//b/" names the same entry as "a/b", and must give the same keys */
+        char *copy = safe_malloc(strlen(path) + 1, 1);
+        size_t len = 0;
+        for (const char *c = path; *c; c++){
+            if (*c == '/' && (len == 0 || copy[len - 1] == '/')) { continue; }
+            copy[len++] = *c;
+        }
+        while (len && copy[len - 1] == '/') { len--; }
+        copy[len] = '\0';
+        normal[i] = copy;
+
+        if (!len || streq(copy, ".")){
+            for (size_t j = 0; j <= i; j++) { free(normal[j]); }
+            free(normal);
+            return;
+        }
+        keys++;
+        for (size_t c = 0; c < len; c++) { keys += copy[c] == '/'; }
+    }
+
+    walk->paths = normal;
+    walk->path_count = count;
+    walk->keys = safe_malloc(sizeof(BloomKey), keys);
+    walk->key_ends = safe_malloc(sizeof(size_t), count);
+    for (size_t i = 0, k = 0; i < count; i++){
+        size_t len = strlen(normal[i]);
+        for (size_t end = len; end > 0; end--){
+            if (end == len || normal[i][end] == '/') { bloom_key(&walk->keys[k++], normal[i], end); }
+        }
+        walk->key_ends[i] = k;
+    }
+}
+
+/**
+ * revwalk_next - Returns the next commit in reverse chronological order.
+ *
+ * Commits are produced newest first by committer date, each exactly once;
+ * among equal dates the one queued first comes first, as in git log. With
+ * revwalk_limit_paths(), commits that do not change the paths are skipped
+ * and merges are simplified.
+ *
+ * @param walk   The walk.
+ * @param commit Output; its parents array is valid until the next call.
+ * @return True if a commit was produced, false when the walk is over or
+ * walk->error was set.
+ */
+bool revwalk_next(RevWalk *walk, RevCommit *commit){
+    if (!walk || !commit) { return false; }
+
+    while (!walk->error && walk->count){
+        RevQueueEntry entry;
+        queue_pop(walk, &entry);
+        if (!load_commit(walk, entry.sha, entry.pos, commit)) { return false; }
+
+        size_t first = 0, last = commit->parent_count;
+        bool show = true;
+        if (walk->path_count && !simplify(walk, commit, &first, &last, &show)) { return false; }
+
+        bool positions = commit->commit == NULL;
+        for (size_t i = first; i < last; i++){
+            if (!sha_set_insert(&walk->seen, commit->parents[i])) { continue; }
+
+            uint32_t pos = positions ? walk->positions[i] : REVWALK_NO_POS;
+            uint64_t date;
+            if (!commit_date_of(walk, commit->parents[i], &pos, &date)) { return false; }
+            queue_push(walk, commit->parents[i], pos, date);
+        }
+        if (show) { return true; }
+    }
+    return false;
+}
+
+/**
+ * revwalk_lookup - Reads one commit without queueing anything.
+ *
+ * @param walk   The walk whose graph and buffers are used.
+ * @param sha    The commit.
+ * @param commit Output; its parents array is valid until the walk moves on.
+ * @return True on success, false if the commit cannot be read.
+ */
+bool revwalk_lookup(RevWalk *walk, const unsigned char sha[SHA_SIZE], RevCommit *commit){
+    if (!walk || !sha || !commit) { return false; }
+    return load_commit(walk, sha, REVWALK_NO_POS, commit);
+}
+
+/**
+ * revwalk_release - Frees the queue and bookkeeping of a walk.
+ *
+ * @param walk The walk; parsed commits stay in the repository cache.
+ */
+void revwalk_release(RevWalk *walk){
+    if (!walk) { return; }
+
+    free(walk->queue);
+    free(walk->parents);
+    free(walk->positions);
+    for (size_t i = 0; i < walk->path_count; i++) { free(walk->paths[i]); }
+    free(walk->paths);
+    free(walk->keys);
+    free(walk->key_ends);
+    sha_set_free(&walk->seen);
+    memset(walk, 0, sizeof(*walk));
+}
+
+/**
+ * revwalk_is_ancestor - Tests whether one commit is reachable from another.
+ *
+ * The search goes depth first from the descendant. With generation numbers
+ * from the commit-graph, any commit whose generation is not above the
+ * ancestor's cannot lead to it, so whole regions of history are skipped.
+ *
+ * @param repo       The repository.
+ * @param ancestor   The candidate ancestor.
+ * @param descendant The commit to search from.
+ * @param result     Output, true if ancestor is descendant or one of its ancestors.
+ * @return True if the question could be answered, false if a commit is missing.
+ */
+bool revwalk_is_ancestor(Repository *repo, const unsigned char ancestor[SHA_SIZE], const unsigned char descendant[SHA_SIZE], bool *result){
+    if (!repo || !ancestor || !descendant || !result) { return false; }
+
+    RevWalk walk;
+    revwalk_init(&walk, repo);
+
+    RevCommit commit;
+    bool status = revwalk_lookup(&walk, ancestor, &commit);
+    uint32_t cutoff = status && commit.generation != COMMIT_GRAPH_GENERATION_INFINITY ? commit.generation : 0;
+
+    unsigned char (*stack)[SHA_SIZE] = NULL;
+    size_t depth = 0, capacity = 0;
+    if (status){
+        stack = safe_malloc(SHA_SIZE, capacity = 64);
+        memcpy(stack[depth++], descendant, SHA_SIZE);
+        sha_set_insert(&walk.seen, descendant);
+    }
+
+    *result = false;
+    while (status && depth && !*result){
+        unsigned char sha[SHA_SIZE];
+        memcpy(sha, stack[--depth], SHA_SIZE);
+        if (memcmp(sha, ancestor, SHA_SIZE) == 0){
+            *result = true;
+            break;
+        }
+
+        if (!(status = revwalk_lookup(&walk, sha, &commit))) { break; }
+        if (commit.generation <= cutoff) { continue; }
+
+        for (size_t i = 0; i < commit.parent_count; i++){
+            if (!sha_set_insert(&walk.seen, commit.parents[i])) { continue; }
+            if (depth == capacity){
+                stack = realloc(stack, (capacity *= 2) * SHA_SIZE);
+                MALLOC_CHECK(stack);
+            }
+            memcpy(stack[depth++], commit.parents[i], SHA_SIZE);
+        }
+    }
+
+    free(stack);
+    revwalk_release(&walk);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * load_commit - Fills a RevCommit from the graph, or from the commit object.
+ *
+ * @param walk   The walk.
+ * @param sha    The commit.
+ * @param pos    Its graph position if known, else REVWALK_NO_POS.
+ * @param commit Output.
+ * @return True on success; on failure walk->error is set.
+ */
+static bool load_commit(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, RevCommit *commit){
+    memset(commit, 0, sizeof(*commit));
+    memcpy(commit->sha, sha, SHA_SIZE);
+
+    CommitGraphCommit record;
+    if (walk->graph && (pos != REVWALK_NO_POS || commit_graph_find(walk->graph, sha, &pos)) &&
+        commit_graph_commit(walk->graph, pos, &record)){
+        size_t count = commit_graph_parents(walk->graph, pos, walk->positions, walk->parent_capacity);
+        if (count != SIZE_MAX && count > walk->parent_capacity){
+            reserve_parents(walk, count);
+            count = commit_graph_parents(walk->graph, pos, walk->positions, walk->parent_capacity);
+        }
+        if (count == SIZE_MAX) { goto corrupt; }
+
+        reserve_parents(walk, count);
+        for (size_t i = 0; i < count; i++){
+            memcpy(walk->parents[i], commit_graph_oid(walk->graph, walk->positions[i]), SHA_SIZE);
+        }
+        memcpy(commit->tree, record.tree, SHA_SIZE);
+        commit->date = record.date;
+        commit->generation = record.generation;
+        commit->pos = pos;
+        commit->parent_count = count;
+        commit->parents = (const unsigned char (*)[SHA_SIZE])walk->parents;
+        walk->from_graph++;
+        return true;
+    }
+
+    GitCommit *object = (GitCommit *)object_get(walk->repo, sha);
+    if (!object || object->object.type != OBJ_COMMIT || !commit_tree(object, commit->tree)) { goto corrupt; }
+
+    size_t count = commit_parent_count(object);
+    reserve_parents(walk, count);
+    for (size_t i = 0; i < count; i++){
+        if (!commit_parent(object, i, walk->parents[i])) { goto corrupt; }
+    }
+    commit->date = commit_date(object);
+    commit->generation = COMMIT_GRAPH_GENERATION_INFINITY;
+    commit->pos = REVWALK_NO_POS;
+    commit->parent_count = count;
+    commit->parents = (const unsigned char (*)[SHA_SIZE])walk->parents;
+    commit->commit = object;
+    walk->from_objects++;
+    return true;
+
+corrupt:;
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    fprintf(stderr, "revwalk: cannot read commit %s\n", hex);
+    walk->error = true;
+    return false;
+}
+
+/**
+ * commit_date_of - Finds the committer date a commit is queued under.
+ *
+ * @param walk The walk.
+ * @param sha  The commit.
+ * @param pos  In: graph position if known. Out: position found, or REVWALK_NO_POS.
+ * @param date Output for the date.
+ * @return True on success; on failure walk->error is set.
+ */
+static bool commit_date_of(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t *pos, uint64_t *date){
+    CommitGraphCommit record;
+    if (walk->graph && (*pos != REVWALK_NO_POS || commit_graph_find(walk->graph, sha, pos)) &&
+        commit_graph_commit(walk->graph, *pos, &record)){
+        *date = record.date;
+        return true;
+    }
+    *pos = REVWALK_NO_POS;
+
+    GitCommit *object = (GitCommit *)object_get(walk->repo, sha);
+    if (!object || object->object.type != OBJ_COMMIT){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(sha, hex);
+        fprintf(stderr, "revwalk: cannot read commit %s\n", hex);
+        walk->error = true;
+        return false;
+    }
+    *date = commit_date(object);
+    return true;
+}
+
+/**
+ * commit_tree_of - Finds a commit's root tree without touching the parent buffers.
+ *
+ * @return True on success; on failure walk->error is set.
+ */
+static bool commit_tree_of(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, unsigned char tree[SHA_SIZE]){
+    CommitGraphCommit record;
+    if (walk->graph && (pos != REVWALK_NO_POS || commit_graph_find(walk->graph, sha, &pos)) &&
+        commit_graph_commit(walk->graph, pos, &record)){
+        memcpy(tree, record.tree, SHA_SIZE);
+        return true;
+    }
+
+    GitCommit *object = (GitCommit *)object_get(walk->repo, sha);
+    if (object && object->object.type == OBJ_COMMIT && commit_tree(object, tree)) { return true; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    fprintf(stderr, "revwalk: cannot read commit %s\n", hex);
+    walk->error = true;
+    return false;
+}
+
+/**
+ * simplify - Decides whether a commit is shown and which parents are followed.
+ *
+ * @param first Output: first parent to follow.
+ * @param last  Output: one past the last parent to follow.
+ * @param show  Output: whether the commit changes the paths.
+ * @return True on success; on failure walk->error is set.
+ */
+static bool simplify(RevWalk *walk, const RevCommit *commit, size_t *first, size_t *last, bool *show){
+    bool same;
+    if (commit->parent_count <= 1){
+        if (!treesame(walk, commit, 0, &same)) { return false; }
+        *show = !same;
+        return true;
+    }
+
+    for (size_t i = 0; i < commit->parent_count; i++){
+        if (!treesame(walk, commit, i, &same)) { return false; }
+        if (same){
+            /* the merge took the paths from this parent: what came from the others is not wanted */
+            *first = i;
+            *last = i + 1;
+            *show = false;
+            return true;
+        }
+    }
+    *show = true;
+    return true;
+}
+
+/**
+ * treesame - Tells whether a commit matches its nth parent at every path.
+ *
+ * The first parent is checked against the commit's Bloom filter first;
+ * trees are only read when the filter says the paths may have changed. A
+ * root commit (nth beyond its parents) is compared to the empty tree.
+ *
+ * @return True on success; on failure walk->error is set.
+ */
+static bool treesame(RevWalk *walk, const RevCommit *commit, size_t nth, bool *same){
+    BloomFilter filter;
+    if (nth == 0 && commit->pos != REVWALK_NO_POS && commit_graph_bloom(walk->graph, commit->pos, &filter)){
+        walk->bloom_checked++;
+        if (!paths_maybe_changed(walk, &filter)){
+            walk->bloom_skipped++;
+            *same = true;
+            return true;
+        }
+    }
+
+    unsigned char parent_sha[SHA_SIZE];
+    const GitTree *parent = NULL;
+    if (nth < commit->parent_count){
+        uint32_t pos = commit->commit ? REVWALK_NO_POS : walk->positions[nth];
+        if (!commit_tree_of(walk, commit->parents[nth], pos, parent_sha)) { return false; }
+        if (memcmp(parent_sha, commit->tree, SHA_SIZE) == 0){
+            *same = true;
+            return true;
+        }
+        if (!(parent = load_tree(walk, parent_sha))) { return false; }
+    }
+    const GitTree *tree = load_tree(walk, commit->tree);
+    if (!tree) { return false; }
+
+    *same = true;
+    for (size_t i = 0; *same && i < walk->path_count; i++){
+        TreeLeaf a, b;
+        bool in_a = tree_lookup_path(walk->repo, tree, walk->paths[i], &a);
+        bool in_b = parent && tree_lookup_path(walk->repo, parent, walk->paths[i], &b);
+        *same = in_a == in_b && (!in_a || (a.mode == b.mode && memcmp(a.sha, b.sha, SHA_SIZE) == 0));
+    }
+    return true;
+}
+
+/**
+ * paths_maybe_changed - Tests the walk's paths against a changed-path filter.
+ *
+ * A changed path is stored with all of its leading directories, so a path
+ * may only have changed if the filter has the keys of all of them.
+ */
+static bool paths_maybe_changed(const RevWalk *walk, const BloomFilter *filter){
+    for (size_t i = 0, k = 0; i < walk->path_count; i++){
+        bool maybe = true;
+        for (; k < walk->key_ends[i]; k++){
+            if (maybe && !bloom_maybe_contains(filter, &walk->keys[k])) { maybe = false; }
+        }
+        if (maybe) { return true; }
+    }
+    return false;
+}
+
+/**
+ * load_tree - Reads a tree through the object cache.
+ *
+ * @return The tree, or NULL with walk->error set.
+ */
+static const GitTree *load_tree(RevWalk *walk, const unsigned char sha[SHA_SIZE]){
+    GitTree *tree = (GitTree *)object_get(walk->repo, sha);
+    if (tree && tree->object.type == OBJ_TREE) { return tree; }
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    fprintf(stderr, "revwalk: cannot read tree %s\n", hex);
+    walk->error = true;
+    return NULL;
+}
+
+/**
+ * reserve_parents - Grows the parent buffers to hold count entries.
+ */
+static void reserve_parents(RevWalk *walk, size_t count){
+    if (count <= walk->parent_capacity) { return; }
+
+    size_t capacity = walk->parent_capacity ? walk->parent_capacity : 4;
+    while (capacity < count) { capacity *= 2; }
+    walk->parents = realloc(walk->parents, capacity * SHA_SIZE);
+    walk->positions = realloc(walk->positions, capacity * sizeof(uint32_t));
+    MALLOC_CHECK(walk->parents);
+    MALLOC_CHECK(walk->positions);
+    walk->parent_capacity = capacity;
+}
+
+/**
+ * queue_push - Inserts a commit into the date-ordered heap.
+ */
+static void queue_push(RevWalk *walk, const unsigned char sha[SHA_SIZE], uint32_t pos, uint64_t date){
+    if (walk->count == walk->capacity){
+        walk->capacity = walk->capacity ? 2 * walk->capacity : 64;
+        walk->queue = realloc(walk->queue, walk->capacity * sizeof(RevQueueEntry));
+        MALLOC_CHECK(walk->queue);
+    }
+
+    RevQueueEntry entry = { .date = date, .order = walk->order++, .pos = pos };
+    memcpy(entry.sha, sha, SHA_SIZE);
+
+    size_t i = walk->count++;
+    while (i > 0){
+        size_t parent = (i - 1) / 2;
+        if (!queue_before(&entry, &walk->queue[parent])) { break; }
+        walk->queue[i] = walk->queue[parent];
+        i = parent;
+    }
+    walk->queue[i] = entry;
+}
+
+/**
+ * queue_pop - Removes the newest commit from the heap.
+ */
+static void queue_pop(RevWalk *walk, RevQueueEntry *entry){
+    *entry = walk->queue[0];
+    RevQueueEntry last = walk->queue[--walk->count];
+
+    size_t i = 0;
+    for (;;){
+        size_t child = 2 * i + 1;
+        if (child >= walk->count) { break; }
+        if (child + 1 < walk->count && queue_before(&walk->queue[child + 1], &walk->queue[child])) { child++; }
+        if (!queue_before(&walk->queue[child], &last)) { break; }
+        walk->queue[i] = walk->queue[child];
+        i = child;
+    }
+    if (walk->count) { walk->queue[i] = last; }
+}
+
+/**
+ * queue_before - Heap order: newer dates first, then earlier insertions.
+ */
+static bool queue_before(const RevQueueEntry *a, const RevQueueEntry *b){
+    if (a->date != b->date) { return a->date > b->date; }
+    return a->order < b->order;
+}
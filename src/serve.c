@@ -0,0 +1,260 @@
+/* serve.c: answering object requests from a long-running process */
+
+#include "serve.h"
+#include "abbrev.h"
+#include "objects.h"
+#include "pack.h"
+#include "refs.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Structures */
+
+typedef struct {
+    Repository      *repo;
+    int             fd;
+    bool            check;              /* headers only */
+    struct timespec pack_dir_mtime;     /* objects/pack when the pack list was loaded, 0 if absent */
+    ServeStats      stats;
+    size_t          used;
+    unsigned char   out[SERVE_OUTPUT_BUFFER];
+} Server;
+
+/* Forward Declaration of static Functions */
+
+static bool serve_request(Server *server, char *line);
+static bool serve_lookup(Server *server, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size, ObjectStream **stream);
+static bool serve_pack_dir_changed(Server *server);
+static bool serve_contents(Server *server, ObjectStream *stream, const char *name);
+static bool serve_write(Server *server, const void *data, size_t len);
+static bool serve_flush(Server *server);
+
+/* Functions */
+
+/**
+ * serve_batch - Answers object requests read line by line, like cat-file --batch.
+ *
+ * Each request is "<object>" or "<object> <type>", the object being a full
+ * SHA, a reference name or an abbreviated SHA. The answer is "<sha> <type>
+ * <size>" followed by the contents and a newline, or "<object> missing"
+ * ("<object> ambiguous" for a short SHA several objects share). With a
+ * type, tags (and a commit, for "tree") are peeled to an object of that
+ * type, as `cat-file <type>` does. In check mode only the header line is
+ * written.
+ *
+ * The repository, its mapped packs, parsed config and object cache live for
+ * the whole session. Answers are buffered and only flushed when every
+ * request already received has been answered, just before read() could
+ * block, so a client that pipelines requests gets large writes while an
+ * interactive one still sees each answer immediately. When an object is
+ * missing and objects/pack changed since the packs were listed, the list
+ * is reloaded once, so packs written during the session are found.
+ *
+ * @param repo   The repository to read from.
+ * @param in_fd  Where requests are read, until end of file.
+ * @param out_fd Where answers are written.
+ * @param check  Write headers only (cat-file --batch-check).
+ * @param stats  Receives counts for the session; may be NULL.
+ * @return true if every request was answered, false on I/O or corrupt objects.
+ */
+bool serve_batch(Repository *repo, int in_fd, int out_fd, bool check, ServeStats *stats){
+    if (!repo) { return false; }
+
+    Server *server = safe_calloc(sizeof(Server), 1);
+    server->repo = repo;
+    server->fd = out_fd;
+    server->check = check;
+    serve_pack_dir_changed(server);
+    pack_list(repo);
+
+    size_t capacity = SERVE_INPUT_BUFFER, have = 0;
+    char *in = safe_malloc(capacity, 1);
+    bool status = true, eof = false;
+
+    while (status && !eof){
+        ssize_t n = read(in_fd, in + have, capacity - have);
+        if (n < 0){
+            if (errno == EINTR) { continue; }
+            fprintf(stderr, "serve_batch: read failed: %s\n", strerror(errno));
+            status = false;
+            break;
+        }
+        have += (size_t)n;
+        eof = n == 0;
+        /* a last request without its newline is still answered */
+        if (eof && have && in[have - 1] != '\n'){
+            if (have == capacity){
+                in = realloc(in, ++capacity);
+                MALLOC_CHECK(in);
+            }
+            in[have++] = '\n';
+        }
+
+        char *start = in, *end = in + have, *newline;
+        while (status && (newline = memchr(start, '\n', (size_t)(end - start)))){
+            *newline = '\0';
+            status = serve_request(server, start);
+            start = newline + 1;
+        }
+        have = (size_t)(end - start);
+        memmove(in, start, have);
+        if (have == capacity){
+            capacity *= 2;
+            in = realloc(in, capacity);
+            MALLOC_CHECK(in);
+        }
+
+        /* everything received so far is answered; the next read() may block */
+        if (status) { status = serve_flush(server); }
+    }
+
+    if (stats) { *stats = server->stats; }
+    free(in);
+    free(server);
+    return status;
+}
+
+/* Static Functions */
+
+/**
+ * serve_request - Answers one request line.
+ *
+ * Outside check mode the object is opened as a stream straight away: its
+ * header gives type and size, so each answer inflates the header once.
+ *
+ * @return false only if the answer could not be written in full.
+ */
+static bool serve_request(Server *server, char *line){
+    server->stats.requests++;
+
+    char *name = line, *type_name = strchr(line, ' ');
+    if (type_name) { *type_name++ = '\0'; }
+    ObjectType want = type_name ? object_type_from_name(type_name, strlen(type_name)) : OBJ_NONE;
+
+    unsigned char sha[SHA_SIZE];
+    ObjectStream *stream = NULL;
+    ObjectType type;
+    size_t size;
+    AbbrevStatus abbrev = ABBREV_UNIQUE;
+    bool found = (!type_name || want != OBJ_NONE) &&
+                 (hex_to_sha(name, sha) || ref_resolve(server->repo, name, sha) ||
+                  (abbrev = abbrev_resolve(server->repo, name, strlen(name), want, sha)) == ABBREV_UNIQUE) &&
+                 serve_lookup(server, sha, &type, &size, server->check ? NULL : &stream);
+
+    if (found && want != OBJ_NONE && type != want){
+        /* the tags and commit on the way stay in the object cache, the object peeled to does not */
+        object_stream_close(stream);
+        stream = NULL;
+        found = object_peel_name(server->repo, sha, want, sha) &&
+                serve_lookup(server, sha, &type, &size, server->check ? NULL : &stream);
+    }
+
+    if (!found){
+        /* echo the whole request, as the answer's only key */
+        if (type_name) { type_name[-1] = ' '; }
+        server->stats.missing++;
+        const char *answer = abbrev == ABBREV_AMBIGUOUS ? " ambiguous\n" : " missing\n";
+        return serve_write(server, line, strlen(line)) && serve_write(server, answer, strlen(answer));
+    }
+
+    char header[SHA_HEX_SIZE + 32];
+    sha_to_hex(sha, header);
+    int len = snprintf(header + SHA_HEX_SIZE - 1, sizeof(header) - SHA_HEX_SIZE + 1, " %s %zu\n", object_type_name(type), size);
+    bool status = serve_write(server, header, SHA_HEX_SIZE - 1 + (size_t)len);
+    if (stream) { status = status && serve_contents(server, stream, name); }
+    object_stream_close(stream);
+    return status;
+}
+
+/**
+ * serve_lookup - Finds an object, picking up new packs once on a miss.
+ *
+ * @param stream When not NULL, receives the object opened as a stream;
+ *               otherwise only the header is read.
+ */
+static bool serve_lookup(Server *server, const unsigned char sha[SHA_SIZE], ObjectType *type, size_t *size, ObjectStream **stream){
+    for (int attempt = 0; attempt < 2; attempt++){
+        if (attempt){
+            if (!serve_pack_dir_changed(server)) { return false; }
+            pack_list_free(server->repo);
+            server->stats.rescans++;
+        }
+        if (!stream){
+            if (object_read_header(server->repo, sha, type, size)) { return true; }
+        } else if ((*stream = object_stream_open(server->repo, sha))){
+            *type = (*stream)->type;
+            *size = (*stream)->size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * serve_pack_dir_changed - Tells whether objects/pack changed since the last call.
+ *
+ * One stat() per miss; the directory's mtime moves whenever a pack is
+ * added or removed.
+ */
+static bool serve_pack_dir_changed(Server *server){
+    char path[MAX_PATH];
+    struct stat sb;
+    repo_path_buf(server->repo, path, sizeof(path), "objects", "pack", NULL);
+    struct timespec mtime = stat(path, &sb) == 0 ? sb.st_mtim : (struct timespec){ 0 };
+
+    bool changed = mtime.tv_sec != server->pack_dir_mtime.tv_sec || mtime.tv_nsec != server->pack_dir_mtime.tv_nsec;
+    server->pack_dir_mtime = mtime;
+    return changed;
+}
+
+/**
+ * serve_contents - Copies a stream's body to the output, followed by a newline.
+ *
+ * The header has been written already, so a failure here leaves the
+ * client out of step and ends the session.
+ */
+static bool serve_contents(Server *server, ObjectStream *stream, const char *name){
+    const unsigned char *chunk;
+    ssize_t n;
+    bool status = true;
+    while (status && (n = object_stream_next(stream, &chunk)) > 0){
+        status = serve_write(server, chunk, (size_t)n);
+        server->stats.bytes += (uint64_t)n;
+    }
+    if (status && n < 0){
+        fprintf(stderr, "serve_batch: corrupt object %s\n", name);
+        return false;
+    }
+    return status && serve_write(server, "\n", 1);
+}
+
+/**
+ * serve_write - Appends to the output buffer; data as large as the buffer is written directly.
+ */
+static bool serve_write(Server *server, const void *data, size_t len){
+    if (server->used + len > SERVE_OUTPUT_BUFFER && !serve_flush(server)) { return false; }
+    if (len >= SERVE_OUTPUT_BUFFER){
+        if (write_all(server->fd, data, len)) { return true; }
+        fprintf(stderr, "serve_batch: write failed: %s\n", strerror(errno));
+        return false;
+    }
+    memcpy(server->out + server->used, data, len);
+    server->used += len;
+    return true;
+}
+
+static bool serve_flush(Server *server){
+    if (!server->used) { return true; }
+    bool status = write_all(server->fd, server->out, server->used);
+    if (!status) { fprintf(stderr, "serve_batch: write failed: %s\n", strerror(errno)); }
+    server->used = 0;
+    return status;
+}
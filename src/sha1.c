@@ -0,0 +1,456 @@
+/* sha1.c: SHA-1 with portable, x86 SHA-NI and ARMv8 backends */
+
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA1_HAVE_SHANI 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define SHA1_HAVE_ARMV8 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+/* Macros */
+
+#define ROTL32(x, n)  (((x) << (n)) | ((x) >> (32 - (n))))
+
+#if defined(__clang__)
+#define SHA1_ARMV8_TARGET __attribute__((target("sha2")))
+#else
+#define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+/* Structures */
+
+typedef void (*sha1_blocks_fn)(uint32_t state[5], const unsigned char *data, size_t blocks);
+
+/* Forward Declaration of static Functions */
+
+static void sha1_blocks_portable(uint32_t state[5], const unsigned char *data, size_t blocks);
+#ifdef SHA1_HAVE_SHANI
+static void sha1_blocks_shani(uint32_t state[5], const unsigned char *data, size_t blocks);
+#endif
+#ifdef SHA1_HAVE_ARMV8
+static void sha1_blocks_armv8(uint32_t state[5], const unsigned char *data, size_t blocks);
+#endif
+static void sha1_select_backend(void) __attribute__((constructor));
+
+/* Globals */
+
+static Sha1Backend    active_backend = SHA1_BACKEND_PORTABLE;
+static sha1_blocks_fn sha1_blocks    = sha1_blocks_portable;
+
+/* Functions */
+
+/**
+ * sha1_init - Resets a context to the SHA-1 initial state.
+ *
+ * @param ctx The context to initialize.
+ */
+void sha1_init(Sha1Context *ctx){
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->length = 0;
+    ctx->buffer_len = 0;
+}
+
+/**
+ * sha1_update - Feeds bytes into a running hash.
+ *
+ * Whole blocks are handed straight to the selected backend without being
+ * copied; only a trailing partial block is buffered in the context.
+ *
+ * @param ctx  The running context.
+ * @param data The bytes to hash.
+ * @param len  Number of bytes in data.
+ */
+void sha1_update(Sha1Context *ctx, const void *data, size_t len){
+    const unsigned char *p = data;
+    ctx->length += len;
+
+    if (ctx->buffer_len){
+        size_t take = min(len, SHA1_BLOCK_SIZE - ctx->buffer_len);
+        memcpy(ctx->buffer + ctx->buffer_len, p, take);
+        ctx->buffer_len += take;
+        p += take;
+        len -= take;
+        if (ctx->buffer_len < SHA1_BLOCK_SIZE) { return; }
+        sha1_blocks(ctx->state, ctx->buffer, 1);
+        ctx->buffer_len = 0;
+    }
+
+    if (len >= SHA1_BLOCK_SIZE){
+        size_t blocks = len / SHA1_BLOCK_SIZE;
+        sha1_blocks(ctx->state, p, blocks);
+        p += blocks * SHA1_BLOCK_SIZE;
+        len -= blocks * SHA1_BLOCK_SIZE;
+    }
+
+    if (len){
+        memcpy(ctx->buffer, p, len);
+        ctx->buffer_len = len;
+    }
+}
+
+/**
+ * sha1_final - Pads the message and writes the 20-byte digest.
+ *
+ * @param ctx    The running context; it must be re-initialized before reuse.
+ * @param digest Output buffer for the binary digest.
+ */
+void sha1_final(Sha1Context *ctx, unsigned char digest[SHA_SIZE]){
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad[SHA1_BLOCK_SIZE * 2] = { 0x80 };
+    size_t pad_len = (ctx->buffer_len < 56 ? 56 : 120) - ctx->buffer_len;
+
+    for (int i = 0; i < 8; i++){
+        pad[pad_len + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha1_update(ctx, pad, pad_len + 8);
+
+    for (int i = 0; i < 5; i++){
+        digest[4 * i]     = (unsigned char)(ctx->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)(ctx->state[i]);
+    }
+}
+
+/**
+ * sha1_buffer - Hashes a complete in-memory buffer.
+ *
+ * @param data   The bytes to hash.
+ * @param len    Number of bytes in data.
+ * @param digest Output buffer for the binary digest.
+ */
+void sha1_buffer(const void *data, size_t len, unsigned char digest[SHA_SIZE]){
+    Sha1Context ctx;
+    sha1_init(&ctx);
+    sha1_update(&ctx, data, len);
+    sha1_final(&ctx, digest);
+}
+
+/**
+ * sha1_backend - Reports which block function is currently in use.
+ *
+ * @return The active backend.
+ */
+Sha1Backend sha1_backend(void){
+    return active_backend;
+}
+
+/**
+ * sha1_backend_name - Returns a printable name for a backend.
+ *
+ * @param backend The backend.
+ * @return "portable", "sha-ni" or "armv8", or "unknown".
+ */
+const char *sha1_backend_name(Sha1Backend backend){
+    switch (backend){
+        case SHA1_BACKEND_PORTABLE: return "portable";
+        case SHA1_BACKEND_SHANI:    return "sha-ni";
+        case SHA1_BACKEND_ARMV8:    return "armv8";
+    }
+    return "unknown";
+}
+
+/**
+ * sha1_backend_supported - Checks whether a backend was compiled in and the
+ * running CPU implements the instructions it needs.
+ *
+ * @param backend The backend to check.
+ * @return True if the backend can be used on this machine.
+ */
+bool sha1_backend_supported(Sha1Backend backend){
+    switch (backend){
+        case SHA1_BACKEND_PORTABLE:
+            return true;
+        case SHA1_BACKEND_SHANI:
+#ifdef SHA1_HAVE_SHANI
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#else
+            return false;
+#endif
+        case SHA1_BACKEND_ARMV8:
+#if defined(SHA1_HAVE_ARMV8) && defined(__APPLE__)
+            return true;
+#elif defined(SHA1_HAVE_ARMV8) && defined(__linux__) && defined(HWCAP_SHA1)
+            return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * sha1_set_backend - Forces a specific backend, mainly for tests and benchmarks.
+ *
+ * @param backend The backend to use for subsequent hashing.
+ * @return True if the backend was installed, false if it is unsupported here.
+ * @note Contexts in flight keep working; only the block function changes.
+ */
+bool sha1_set_backend(Sha1Backend backend){
+    if (!sha1_backend_supported(backend)) { return false; }
+
+    switch (backend){
+        case SHA1_BACKEND_PORTABLE:
+            sha1_blocks = sha1_blocks_portable;
+            break;
+        case SHA1_BACKEND_SHANI:
+#ifdef SHA1_HAVE_SHANI
+            sha1_blocks = sha1_blocks_shani;
+#endif
+            break;
+        case SHA1_BACKEND_ARMV8:
+#ifdef SHA1_HAVE_ARMV8
+            sha1_blocks = sha1_blocks_armv8;
+#endif
+            break;
+    }
+    active_backend = backend;
+    return true;
+}
+
+/* Static Functions */
+
+/**
+ * sha1_select_backend - Picks the fastest supported backend at program startup.
+ */
+static void sha1_select_backend(void){
+    if (!sha1_set_backend(SHA1_BACKEND_SHANI) && !sha1_set_backend(SHA1_BACKEND_ARMV8)){
+        sha1_set_backend(SHA1_BACKEND_PORTABLE);
+    }
+}
+
+/**
+ * sha1_blocks_portable - Compresses whole 64-byte blocks in plain C.
+ *
+ * @param state  The five-word hash state, updated in place.
+ * @param data   Pointer to blocks * 64 bytes of input.
+ * @param blocks Number of blocks to compress.
+ */
+static void sha1_blocks_portable(uint32_t state[5], const unsigned char *data, size_t blocks){
+    while (blocks--){
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++){
+            w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) |
+                   ((uint32_t)data[4 * i + 2] << 8) | (uint32_t)data[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++){
+            w[i] = ROTL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+#define PORTABLE_ROUND(f, k, i) \
+        do { \
+            uint32_t t = ROTL32(a, 5) + (f) + e + (k) + w[i]; \
+            e = d; \
+            d = c; \
+            c = ROTL32(b, 30); \
+            b = a; \
+            a = t; \
+        } while (0)
+
+        for (int i = 0; i < 20; i++)  { PORTABLE_ROUND(d ^ (b & (c ^ d)), 0x5A827999, i); }
+        for (int i = 20; i < 40; i++) { PORTABLE_ROUND(b ^ c ^ d, 0x6ED9EBA1, i); }
+        for (int i = 40; i < 60; i++) { PORTABLE_ROUND((b & c) | (d & (b | c)), 0x8F1BBCDC, i); }
+        for (int i = 60; i < 80; i++) { PORTABLE_ROUND(b ^ c ^ d, 0xCA62C1D6, i); }
+#undef PORTABLE_ROUND
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        data += SHA1_BLOCK_SIZE;
+    }
+}
+
+#ifdef SHA1_HAVE_SHANI
+
+/* Four rounds of SHA-NI. Ecur absorbs the message words for this group,
+ * Enext saves ABCD so the following group can derive its E from it. */
+#define SHANI_ROUNDS(Ecur, Enext, M, f) \
+    do { \
+        Ecur = _mm_sha1nexte_epu32(Ecur, M); \
+        Enext = abcd; \
+        abcd = _mm_sha1rnds4_epu32(abcd, Ecur, f); \
+    } while (0)
+
+/**
+ * sha1_blocks_shani - Compresses whole 64-byte blocks with the x86 SHA extensions.
+ *
+ * @param state  The five-word hash state, updated in place.
+ * @param data   Pointer to blocks * 64 bytes of input.
+ * @param blocks Number of blocks to compress.
+ */
+__attribute__((target("sha,sse4.1")))
+static void sha1_blocks_shani(uint32_t state[5], const unsigned char *data, size_t blocks){
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i e1, m0, m1, m2, m3;
+
+    while (blocks--){
+        __m128i abcd_save = abcd;
+        __m128i e0_save = e0;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+        /* Rounds 0-3 */
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        /* Rounds 4-15: first use of the loaded words, schedule begins */
+        SHANI_ROUNDS(e1, e0, m1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        SHANI_ROUNDS(e0, e1, m2, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+        SHANI_ROUNDS(e1, e0, m3, 0);
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        /* Rounds 16-67: steady state, one schedule step per group */
+#define SHANI_STEADY(Ecur, Enext, Mc, Mn1, Mn2, Mn3, f) \
+        SHANI_ROUNDS(Ecur, Enext, Mc, f); \
+        Mn1 = _mm_sha1msg2_epu32(Mn1, Mc); \
+        Mn3 = _mm_sha1msg1_epu32(Mn3, Mc); \
+        Mn2 = _mm_xor_si128(Mn2, Mc)
+
+        SHANI_STEADY(e0, e1, m0, m1, m2, m3, 0);
+        SHANI_STEADY(e1, e0, m1, m2, m3, m0, 1);
+        SHANI_STEADY(e0, e1, m2, m3, m0, m1, 1);
+        SHANI_STEADY(e1, e0, m3, m0, m1, m2, 1);
+        SHANI_STEADY(e0, e1, m0, m1, m2, m3, 1);
+        SHANI_STEADY(e1, e0, m1, m2, m3, m0, 1);
+        SHANI_STEADY(e0, e1, m2, m3, m0, m1, 2);
+        SHANI_STEADY(e1, e0, m3, m0, m1, m2, 2);
+        SHANI_STEADY(e0, e1, m0, m1, m2, m3, 2);
+        SHANI_STEADY(e1, e0, m1, m2, m3, m0, 2);
+        SHANI_STEADY(e0, e1, m2, m3, m0, m1, 2);
+        SHANI_STEADY(e1, e0, m3, m0, m1, m2, 3);
+        SHANI_STEADY(e0, e1, m0, m1, m2, m3, 3);
+#undef SHANI_STEADY
+
+        /* Rounds 68-79: schedule winds down */
+        SHANI_ROUNDS(e1, e0, m1, 3);
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        m3 = _mm_xor_si128(m3, m1);
+        SHANI_ROUNDS(e0, e1, m2, 3);
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHANI_ROUNDS(e1, e0, m3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+        data += SHA1_BLOCK_SIZE;
+    }
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    _mm_storeu_si128((__m128i *)state, abcd);
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#undef SHANI_ROUNDS
+
+#endif /* SHA1_HAVE_SHANI */
+
+#ifdef SHA1_HAVE_ARMV8
+
+/* Four rounds of the ARMv8 SHA-1 instructions. OP is vsha1cq_u32,
+ * vsha1pq_u32 or vsha1mq_u32 depending on the round group. */
+#define ARMV8_ROUNDS(OP, Enext, Ecur, T) \
+    do { \
+        Enext = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+        abcd = OP(abcd, Ecur, T); \
+    } while (0)
+
+/**
+ * sha1_blocks_armv8 - Compresses whole 64-byte blocks with the ARMv8 SHA extensions.
+ *
+ * @param state  The five-word hash state, updated in place.
+ * @param data   Pointer to blocks * 64 bytes of input.
+ * @param blocks Number of blocks to compress.
+ */
+SHA1_ARMV8_TARGET
+static void sha1_blocks_armv8(uint32_t state[5], const unsigned char *data, size_t blocks){
+    const uint32x4_t k0 = vdupq_n_u32(0x5A827999);
+    const uint32x4_t k1 = vdupq_n_u32(0x6ED9EBA1);
+    const uint32x4_t k2 = vdupq_n_u32(0x8F1BBCDC);
+    const uint32x4_t k3 = vdupq_n_u32(0xCA62C1D6);
+
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+    uint32_t e1;
+
+    while (blocks--){
+        uint32x4_t abcd_save = abcd;
+        uint32_t e0_save = e0;
+
+        uint32x4_t m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+        uint32x4_t m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+        uint32x4_t m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+        uint32x4_t m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+        uint32x4_t t0 = vaddq_u32(m0, k0);
+        uint32x4_t t1 = vaddq_u32(m1, k0);
+
+        /* Group g: rounds, next round constant for group g+2, schedule for
+         * words g+3 (su1) and g+4 (su0). */
+        ARMV8_ROUNDS(vsha1cq_u32, e1, e0, t0); t0 = vaddq_u32(m2, k0); m0 = vsha1su0q_u32(m0, m1, m2);
+        ARMV8_ROUNDS(vsha1cq_u32, e0, e1, t1); t1 = vaddq_u32(m3, k0); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+        ARMV8_ROUNDS(vsha1cq_u32, e1, e0, t0); t0 = vaddq_u32(m0, k0); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+        ARMV8_ROUNDS(vsha1cq_u32, e0, e1, t1); t1 = vaddq_u32(m1, k1); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+        ARMV8_ROUNDS(vsha1cq_u32, e1, e0, t0); t0 = vaddq_u32(m2, k1); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1); t1 = vaddq_u32(m3, k1); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+        ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t0); t0 = vaddq_u32(m0, k1); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1); t1 = vaddq_u32(m1, k1); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+        ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t0); t0 = vaddq_u32(m2, k2); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1); t1 = vaddq_u32(m3, k2); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+        ARMV8_ROUNDS(vsha1mq_u32, e1, e0, t0); t0 = vaddq_u32(m0, k2); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+        ARMV8_ROUNDS(vsha1mq_u32, e0, e1, t1); t1 = vaddq_u32(m1, k2); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+        ARMV8_ROUNDS(vsha1mq_u32, e1, e0, t0); t0 = vaddq_u32(m2, k2); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+        ARMV8_ROUNDS(vsha1mq_u32, e0, e1, t1); t1 = vaddq_u32(m3, k3); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+        ARMV8_ROUNDS(vsha1mq_u32, e1, e0, t0); t0 = vaddq_u32(m0, k3); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1); t1 = vaddq_u32(m1, k3); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+        ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t0); t0 = vaddq_u32(m2, k3); m3 = vsha1su1q_u32(m3, m2);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1); t1 = vaddq_u32(m3, k3);
+        ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t0);
+        ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t1);
+
+        e0 += e0_save;
+        abcd = vaddq_u32(abcd_save, abcd);
+        data += SHA1_BLOCK_SIZE;
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+#undef ARMV8_ROUNDS
+
+#endif /* SHA1_HAVE_ARMV8 */
@@ -0,0 +1,1453 @@
+/* status.c: worktree, index and HEAD comparison */
+
+#include "status.h"
+#include "config.h"
+#include "ignore.h"
+#include "index.h"
+#include "objects.h"
+#include "refs.h"
+#include "repository.h"
+#include "sha1.h"
+#include "tree.h"
+#include "utils.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Macros */
+
+#define STATUS_CACHE_LOCK       STATUS_CACHE_FILE ".lock"
+#define STATUS_CACHE_WATCHED    0x1         /* listings are current as of the fsmonitor token */
+#define STATUS_STAMP_CHUNK      256         /* cached directories per validation job */
+#define STATUS_STAMP_SIZE       48
+#define STATUS_NONE             ((size_t)-1)
+#define STATUS_HOOK_OUTPUT      4096
+#define STATUS_FNV_OFFSET       0xcbf29ce484222325ull
+#define STATUS_FNV_PRIME        0x100000001b3ull
+
+/* Structures */
+
+typedef struct {
+    int64_t  mtime_sec;
+    int64_t  ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    uint64_t ino;
+    uint64_t dev;
+    uint64_t size;
+} StatStamp;
+
+typedef struct {
+    const char  *path;          /* relative to the top, no trailing '/'; "" at the top */
+    size_t      path_len;
+    StatStamp   dir;            /* of the directory when it was listed */
+    StatStamp   ignore;         /* of its .gitignore, zero if there was none */
+    uint64_t    tracked;        /* digest of the tracked names directly inside */
+    const char  **names;        /* untracked files (nested repositories as "name/"), then subdirectories */
+    size_t      file_count;
+    size_t      dir_count;
+
+    char        *own_path;      /* path of a record created by this run */
+    char        *storage;       /* names of a listing read by this run */
+    IgnoreList  *rules;
+    size_t      parent;
+    uint64_t    tracked_now;
+    bool        valid;          /* listing still describes the directory */
+    bool        ignore_changed; /* .gitignore differs, so descendants are reread too */
+    bool        reached;
+    signed char has_untracked;  /* -1 until computed */
+} UntrackedDir;
+
+typedef struct {
+    const unsigned char *map;
+    size_t        size;
+    unsigned char tracked_checksum[SHA_SIZE];   /* index the tracked digests were taken from */
+    unsigned char dirty_checksum[SHA_SIZE];     /* index the dirty list was taken from */
+    uint32_t      flags;
+    StatStamp     exclude;      /* .git/info/exclude */
+    StatStamp     excludes_file;/* core.excludesFile */
+    const char    *token;       /* fsmonitor token, NULL if none */
+    const char    **dirty;      /* tracked paths that were not clean */
+    size_t        dirty_count;
+    UntrackedDir  *dirs;        /* sorted by path up to sorted */
+    size_t        count;
+    size_t        capacity;
+    size_t        sorted;
+    Arena         arena;
+} UntrackedCache;
+
+typedef struct {
+    unsigned char *data;
+    size_t        len;
+    size_t        capacity;
+} StatusBuffer;
+
+typedef struct {
+    const unsigned char *pos;
+    const unsigned char *end;
+    bool          ok;
+} CacheReader;
+
+typedef struct {
+    const char    *path;
+    size_t        len;
+    uint32_t      mode;
+    unsigned char sha[SHA_SIZE];
+} HeadEntry;
+
+typedef struct {
+    size_t start;
+    size_t count;
+} SkipRange;
+
+typedef struct {
+    Repository          *repo;
+    const StatusOptions *options;
+    StatusResult        *result;
+    Index               *index;
+    int                 worktree_fd;
+    bool                filemode;
+
+    bool                *check;         /* entries to lstat, NULL for all */
+    char                *worktree;      /* code per index entry */
+    size_t              (*counts)[3];   /* checked, hashed, refreshed per chunk */
+
+    HeadEntry           *head;
+    size_t              head_count;
+    size_t              head_capacity;
+    SkipRange           *skips;
+    size_t              skip_count;
+    size_t              skip_capacity;
+    Arena               arena;
+
+    UntrackedCache      cache;
+    bool                cache_dirty;
+    IgnoreList          *excludes;
+    StatStamp           exclude;
+    StatStamp           excludes_file;
+    size_t              *scan;
+    size_t              scan_count;
+
+    char                *hook_output;   /* token and changed paths, NUL-separated */
+    const char          **changed;
+    size_t              changed_count;
+    const char          *token;         /* saved for the next run */
+    char                token_buf[32];
+    bool                hook_answered;  /* changed lists every change since the cached token */
+} StatusContext;
+
+/* Forward Declaration of static Functions */
+
+static void   tracked_job(void *ctx, size_t chunk);
+static char   tracked_check(StatusContext *s, IndexEntry *entry, size_t counts[3]);
+static bool   tracked_refresh(StatusContext *s);
+static bool   head_collect(StatusContext *s);
+static bool   head_walk(StatusContext *s, const unsigned char sha[SHA_SIZE], char *path, size_t len, size_t depth);
+static void   head_skip(StatusContext *s, const IndexTree *node, const char *path, size_t len);
+static void   tracked_items(StatusContext *s);
+static bool   untracked_collect(StatusContext *s);
+static void   untracked_excludes(StatusContext *s);
+static void   untracked_digests(StatusContext *s);
+static void   untracked_invalidate_changed(StatusContext *s);
+static void   untracked_invalidate_below(StatusContext *s, size_t i);
+static void   validate_job(void *ctx, size_t chunk);
+static void   scan_job(void *ctx, size_t n);
+static void   ensure_rules(StatusContext *s, size_t i);
+static void   untracked_drop_unreached(StatusContext *s);
+static void   untracked_items(StatusContext *s);
+static void   untracked_emit(StatusContext *s, size_t i, char *path);
+static bool   untracked_has_content(StatusContext *s, size_t i);
+static size_t dir_child_path(const UntrackedDir *dir, const char *name, char *buf);
+static size_t cache_lower_bound(const UntrackedCache *cache, const char *path, size_t len, size_t limit);
+static size_t cache_find(const UntrackedCache *cache, const char *path, size_t len, size_t limit);
+static size_t cache_add(UntrackedCache *cache, const char *path, size_t len);
+static void   cache_release(UntrackedDir *dir);
+static void   cache_load(StatusContext *s);
+static bool   cache_parse(StatusContext *s);
+static bool   cache_save(StatusContext *s);
+static void   cache_free(UntrackedCache *cache);
+static void   fsmonitor_query(StatusContext *s);
+static bool   fsmonitor_run(StatusContext *s, const char *token, StatusBuffer *out);
+static void   fsmonitor_mark(StatusContext *s, const char *path, size_t len);
+static void   result_add(StatusResult *result, const char *path, size_t len, char staged, char worktree);
+static int    item_compare(const void *a, const void *b);
+static int    dir_compare(const void *a, const void *b);
+static StatStamp stamp_from(const struct stat *sb);
+static bool   stamp_equal(const StatStamp *a, const StatStamp *b);
+static StatStamp stamp_at(int dir_fd, const char *path);
+static uint64_t name_hash(const char *name, size_t len);
+static void   buffer_put(StatusBuffer *buf, const void *data, size_t len);
+static void   buffer_be32(StatusBuffer *buf, uint32_t value);
+static void   buffer_be64(StatusBuffer *buf, uint64_t value);
+static void   buffer_str(StatusBuffer *buf, const char *s, size_t len);
+static void   buffer_stamp(StatusBuffer *buf, const StatStamp *stamp);
+static uint32_t reader_be32(CacheReader *reader);
+static uint64_t reader_be64(CacheReader *reader);
+static const char *reader_str(CacheReader *reader, size_t *len);
+static StatStamp reader_stamp(CacheReader *reader);
+
+/* Functions */
+
+/**
+ * status_options_init - Fills status options from defaults and config.
+ *
+ * Reads status.showUntrackedFiles, core.untrackedCache and core.fsmonitor.
+ * A boolean core.fsmonitor asks for git's builtin daemon, which is not
+ * available here, so only a hook path enables the monitor.
+ *
+ * @param options The options to fill.
+ * @param repo    Repository whose config applies; may be NULL.
+ */
+void status_options_init(StatusOptions *options, const Repository *repo){
+    options->untracked = UNTRACKED_NORMAL;
+    options->threads = workers_default_count();
+    options->refresh = true;
+    options->untracked_cache = true;
+    options->fsmonitor = NULL;
+
+    const Configuration *config = repo ? repo->config : NULL;
+    if (!config) { return; }
+
+    const char *mode = config_get(config, "status.showUntrackedFiles");
+    bool enabled;
+    if (mode && streq(mode, "no")) { options->untracked = UNTRACKED_NO; }
+    if (mode && streq(mode, "all")) { options->untracked = UNTRACKED_ALL; }
+    options->untracked_cache = config_get_bool(config, "core.untrackedCache", true);
+
+    const char *hook = config_get(config, "core.fsmonitor");
+    if (hook && *hook && !config_parse_bool(hook, &enabled)) { options->fsmonitor = hook; }
+}
+
+/**
+ * status_collect - Compares HEAD, the index and the worktree.
+ *
+ * Tracked files are lstat'd in STATUS_CHUNK batches across the worker pool
+ * and only hashed when their stat data disagrees with the index or they are
+ * racily clean. Subtrees whose cache-tree entry still names the HEAD tree
+ * are not read. Untracked directories are listed breadth-first, one
+ * parallel batch per level, and reused from .git/untracked-cache while their
+ * stat data, .gitignore and tracked names are unchanged. With an fsmonitor
+ * hook, only paths it reports (and those dirty last time) are looked at.
+ *
+ * @param repo    The repository.
+ * @param options What to report and how.
+ * @param result  Receives the items; release with status_result_free().
+ * @return true on success, false on error.
+ */
+bool status_collect(Repository *repo, const StatusOptions *options, StatusResult *result){
+    if (!repo || !options || !result) { return false; }
+    memset(result, 0, sizeof(*result));
+
+    StatusContext s = { .repo = repo, .options = options, .result = result, .worktree_fd = -1 };
+    s.filemode = repo->config ? repo->config->filemode : true;
+    bool status = false;
+
+    s.index = index_read(repo);
+    if (!s.index) { goto done; }
+    s.worktree_fd = open(repo->worktree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (s.worktree_fd < 0){
+        fprintf(stderr, "status_collect: cannot open %s: %s\n", repo->worktree, strerror(errno));
+        goto done;
+    }
+
+    if (options->untracked_cache || options->fsmonitor) { cache_load(&s); }
+    if (options->fsmonitor) { fsmonitor_query(&s); }
+
+    size_t count = s.index->count;
+    size_t chunks = (count + STATUS_CHUNK - 1) / STATUS_CHUNK;
+    s.worktree = safe_malloc(1, count ? count : 1);
+    memset(s.worktree, ' ', count);
+    s.counts = safe_calloc(sizeof(*s.counts), chunks ? chunks : 1);
+    if (!workers_run(options->threads, chunks, tracked_job, &s)) { goto done; }
+    for (size_t i = 0; i < chunks; i++){
+        result->checked += s.counts[i][0];
+        result->hashed += s.counts[i][1];
+        result->refreshed += s.counts[i][2];
+    }
+    if (options->refresh && result->refreshed) { tracked_refresh(&s); }
+
+    if (!head_collect(&s)) { goto done; }
+    tracked_items(&s);
+
+    if (options->untracked != UNTRACKED_NO && !untracked_collect(&s)) { goto done; }
+    if (s.cache_dirty || options->fsmonitor) { cache_save(&s); }
+    status = true;
+
+done:
+    if (s.worktree_fd >= 0) { close(s.worktree_fd); }
+    for (size_t i = 0; i < s.cache.count; i++) { ignore_list_free(s.cache.dirs[i].rules); }
+    ignore_list_free(s.excludes);
+    cache_free(&s.cache);
+    arena_clear(&s.arena);
+    free(s.head);
+    free(s.skips);
+    free(s.scan);
+    free(s.check);
+    free(s.worktree);
+    free(s.counts);
+    free(s.changed);
+    free(s.hook_output);
+    index_free(s.index);
+    if (!status) { status_result_free(result); }
+    return status;
+}
+
+/**
+ * status_result_free - Releases the items of a status run.
+ *
+ * @param result The result; may be NULL.
+ */
+void status_result_free(StatusResult *result){
+    if (!result) { return; }
+    free(result->items);
+    arena_clear(&result->arena);
+    memset(result, 0, sizeof(*result));
+}
+
+/* Static Functions */
+
+/**
+ * tracked_job - Checks one STATUS_CHUNK batch of index entries.
+ */
+static void tracked_job(void *ctx, size_t chunk){
+    StatusContext *s = ctx;
+    size_t start = chunk * STATUS_CHUNK;
+    size_t end = start + STATUS_CHUNK < s->index->count ? start + STATUS_CHUNK : s->index->count;
+
+    for (size_t i = start; i < end; i++){
+        IndexEntry *entry = &s->index->entries[i];
+        if (index_entry_stage(entry) != 0) { s->worktree[i] = 'U'; continue; }
+        if (s->check && !s->check[i]) { continue; }
+        s->worktree[i] = tracked_check(s, entry, s->counts[chunk]);
+    }
+}
+
+/**
+ * tracked_check - Compares one stage 0 entry against its worktree file.
+ *
+ * @return ' ' if unchanged, 'M' modified, 'T' type changed or 'D' deleted.
+ * A clean entry whose stat data went stale is refreshed in place.
+ */
+static char tracked_check(StatusContext *s, IndexEntry *entry, size_t counts[3]){
+    if ((entry->flags & INDEX_FLAG_VALID) || (entry->flags_extended & INDEX_EXT_SKIP_WORKTREE)) { return ' '; }
+
+    struct stat sb;
+    counts[0]++;
+    if (fstatat(s->worktree_fd, entry->name, &sb, AT_SYMLINK_NOFOLLOW) != 0) { return 'D'; }
+
+    uint32_t type = entry->mode & TREE_MODE_TYPE;
+    if (type == TREE_MODE_GITLINK) { return S_ISDIR(sb.st_mode) ? ' ' : 'T'; }
+    if (S_ISDIR(sb.st_mode)) { return 'D'; }
+    uint32_t now = S_ISLNK(sb.st_mode) ? TREE_MODE_SYMLINK : S_ISREG(sb.st_mode) ? 0100000 : 0;
+    if (now != type) { return 'T'; }
+    if (s->filemode && type == 0100000 && !!(entry->mode & 0100) != !!(sb.st_mode & S_IXUSR)) { return 'M'; }
+
+    const struct timespec *written = &s->index->mtime;
+    bool racy = entry->mtime_sec > (uint32_t)written->tv_sec ||
+                (entry->mtime_sec == (uint32_t)written->tv_sec && entry->mtime_nsec >= (uint32_t)written->tv_nsec);
+    bool matches = index_entry_stat_matches(entry, &sb);
+    if (matches && !racy) { return ' '; }
+    if (entry->size && entry->size != (uint32_t)sb.st_size) { return 'M'; }
+
+    unsigned char sha[SHA_SIZE];
+    counts[1]++;
+    if (type == TREE_MODE_SYMLINK){
+        char target[MAX_PATH];
+        ssize_t len = readlinkat(s->worktree_fd, entry->name, target, sizeof(target));
+        if (len < 0 || !object_write_buffer(NULL, OBJ_BLOB, target, (size_t)len, sha)) { return 'M'; }
+    } else {
+        int fd = openat(s->worktree_fd, entry->name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { return 'M'; }
+        bool hashed = object_hash_fd(NULL, fd, OBJ_BLOB, sha);
+        close(fd);
+        if (!hashed) { return 'M'; }
+    }
+    if (memcmp(sha, entry->sha, SHA_SIZE) != 0) { return 'M'; }
+
+    if (!matches){
+        uint32_t mode = entry->mode;
+        index_entry_set_stat(entry, &sb);
+        entry->mode = mode;
+        counts[2]++;
+    }
+    return ' ';
+}
+
+/**
+ * tracked_refresh - Writes refreshed stat data back unless someone holds the index lock.
+ */
+static bool tracked_refresh(StatusContext *s){
+    int dir_fd = repo_gitdir_fd(s->repo);
+    if (dir_fd < 0 || faccessat(dir_fd, "index.lock", F_OK, 0) == 0) { return false; }
+    return index_write(s->repo, s->index);
+}
+
+/**
+ * head_collect - Gathers the HEAD blobs the cache-tree cannot vouch for.
+ *
+ * @return false if HEAD names a missing or malformed tree; an unborn HEAD
+ * leaves the list empty.
+ */
+static bool head_collect(StatusContext *s){
+    unsigned char sha[SHA_SIZE];
+    if (!ref_read(s->repo, "HEAD", sha)) { return true; }
+
+    GitObject *commit = object_peel(s->repo, sha, OBJ_COMMIT);
+    unsigned char tree[SHA_SIZE];
+    if (!commit || !commit_tree((GitCommit *)commit, tree)){
+        fprintf(stderr, "status_collect: HEAD does not name a commit\n");
+        return false;
+    }
+
+    char path[MAX_PATH];
+    path[0] = '\0';
+    if (!head_walk(s, tree, path, 0, 0)) { return false; }
+
+    for (size_t i = 1; i < s->head_count; i++){
+        const HeadEntry *a = &s->head[i - 1], *b = &s->head[i];
+        if (index_name_compare(a->path, a->len, 0, b->path, b->len, 0) > 0){
+            qsort(s->head, s->head_count, sizeof(HeadEntry), item_compare);
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * head_walk - Lists a HEAD tree, skipping subtrees the cache-tree already matches.
+ *
+ * @param path Directory of the tree, no trailing '/'; a MAX_PATH buffer extended in place.
+ */
+static bool head_walk(StatusContext *s, const unsigned char sha[SHA_SIZE], char *path, size_t len, size_t depth){
+    if (depth > INDEX_TREE_DEPTH) { return false; }
+
+    const IndexTree *node = index_tree_find(s->index, path, len);
+    if (node && node->entry_count >= 0 && memcmp(node->sha, sha, SHA_SIZE) == 0){
+        head_skip(s, node, path, len);
+        return true;
+    }
+
+    GitObject *object = object_get(s->repo, sha);
+    if (!object || object->type != OBJ_TREE){
+        fprintf(stderr, "status_collect: missing tree for '%.*s'\n", (int)len, path);
+        return false;
+    }
+    const Tree *tree = &((GitTree *)object)->tree;
+
+    for (size_t i = 0; i < tree->count; i++){
+        const TreeLeaf *leaf = &tree->leaves[i];
+        size_t child = len + (len ? 1 : 0) + leaf->name_len;
+        if (child >= MAX_PATH) { return false; }
+        if (len) { path[len] = '/'; }
+        memcpy(path + child - leaf->name_len, tree_leaf_name(tree, leaf), leaf->name_len);
+        path[child] = '\0';
+
+        if (tree_leaf_is_tree(leaf)){
+            if (!head_walk(s, leaf->sha, path, child, depth + 1)) { return false; }
+        } else {
+            if (s->head_count == s->head_capacity){
+                s->head_capacity = s->head_capacity ? 2 * s->head_capacity : 256;
+                s->head = realloc(s->head, s->head_capacity * sizeof(HeadEntry));
+                MALLOC_CHECK(s->head);
+            }
+            HeadEntry *entry = &s->head[s->head_count++];
+            entry->path = arena_memdup(&s->arena, path, child + 1);
+            entry->len = child;
+            entry->mode = leaf->mode;
+            memcpy(entry->sha, leaf->sha, SHA_SIZE);
+        }
+        path[len] = '\0';
+    }
+    return true;
+}
+
+/**
+ * head_skip - Records the index range a matching cache-tree node covers.
+ *
+ * The range is only trusted if it really spans exactly the entries below path.
+ */
+static void head_skip(StatusContext *s, const IndexTree *node, const char *path, size_t len){
+    const Index *index = s->index;
+    char prefix[MAX_PATH];
+    memcpy(prefix, path, len);
+    prefix[len] = '/';
+    size_t prefix_len = len ? len + 1 : 0;
+
+    size_t start = prefix_len ? index_position(index, prefix, prefix_len) : 0;
+    size_t count = (size_t)node->entry_count;
+    if (start + count > index->count) { return; }
+    if (count && (index->entries[start + count - 1].name_len < prefix_len ||
+                  memcmp(index->entries[start + count - 1].name, prefix, prefix_len) != 0)) { return; }
+    if (start + count < index->count && index->entries[start + count].name_len >= prefix_len &&
+        memcmp(index->entries[start + count].name, prefix, prefix_len) == 0) { return; }
+
+    if (s->skip_count == s->skip_capacity){
+        s->skip_capacity = s->skip_capacity ? 2 * s->skip_capacity : 64;
+        s->skips = realloc(s->skips, s->skip_capacity * sizeof(SkipRange));
+        MALLOC_CHECK(s->skips);
+    }
+    s->skips[s->skip_count].start = start;
+    s->skips[s->skip_count].count = count;
+    s->skip_count++;
+}
+
+/**
+ * tracked_items - Merges the index with the HEAD list into items.
+ */
+static void tracked_items(StatusContext *s){
+    const Index *index = s->index;
+    size_t i = 0, j = 0, k = 0;
+
+    while (i < index->count || j < s->head_count){
+        while (k < s->skip_count && s->skips[k].start < i) { k++; }
+        if (k < s->skip_count && s->skips[k].start == i && s->skips[k].count){
+            for (size_t end = i + s->skips[k].count; i < end; i++){
+                if (s->worktree[i] != ' ' && s->worktree[i] != 'U'){
+                    result_add(s->result, index->entries[i].name, index->entries[i].name_len, ' ', s->worktree[i]);
+                }
+            }
+            k++;
+            continue;
+        }
+
+        const IndexEntry *entry = i < index->count ? &index->entries[i] : NULL;
+        const HeadEntry *head = j < s->head_count ? &s->head[j] : NULL;
+        int cmp = !entry ? 1 : !head ? -1 : index_name_compare(entry->name, entry->name_len, 0, head->path, head->len, 0);
+
+        if (cmp > 0){
+            result_add(s->result, head->path, head->len, 'D', ' ');
+            j++;
+            continue;
+        }
+        if (cmp == 0) { j++; }
+
+        if (index_entry_stage(entry) != 0){
+            result_add(s->result, entry->name, entry->name_len, 'U', 'U');
+            size_t len = entry->name_len;
+            while (i < index->count && index->entries[i].name_len == len && memcmp(index->entries[i].name, entry->name, len) == 0) { i++; }
+            continue;
+        }
+
+        char staged = ' ';
+        if (cmp < 0) { staged = 'A'; }
+        else if ((entry->mode & TREE_MODE_TYPE) != (head->mode & TREE_MODE_TYPE)) { staged = 'T'; }
+        else if (entry->mode != head->mode || memcmp(entry->sha, head->sha, SHA_SIZE) != 0) { staged = 'M'; }
+        if (staged != ' ' || s->worktree[i] != ' ') { result_add(s->result, entry->name, entry->name_len, staged, s->worktree[i]); }
+        i++;
+    }
+}
+
+/**
+ * untracked_collect - Lists untracked paths, reusing the untracked cache.
+ */
+static bool untracked_collect(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    untracked_excludes(s);
+
+    bool index_changed = memcmp(cache->tracked_checksum, s->index->checksum, SHA_SIZE) != 0;
+    bool excludes_changed = !stamp_equal(&cache->exclude, &s->exclude) || !stamp_equal(&cache->excludes_file, &s->excludes_file);
+    if (index_changed || excludes_changed) { s->cache_dirty = true; }
+
+    if (index_changed && cache->count){
+        untracked_digests(s);
+        for (size_t i = 0; i < cache->count; i++){
+            if (cache->dirs[i].tracked_now != cache->dirs[i].tracked) { cache->dirs[i].valid = false; }
+        }
+    }
+    if (excludes_changed){
+        for (size_t i = 0; i < cache->count; i++) { cache->dirs[i].valid = false; }
+    } else if (s->hook_answered && (cache->flags & STATUS_CACHE_WATCHED)){
+        untracked_invalidate_changed(s);
+    } else {
+        size_t chunks = (cache->count + STATUS_STAMP_CHUNK - 1) / STATUS_STAMP_CHUNK;
+        if (!workers_run(s->options->threads, chunks, validate_job, s)) { return false; }
+    }
+    for (size_t i = 0; i < cache->count; i++){
+        if (cache->dirs[i].ignore_changed) { untracked_invalidate_below(s, i); }
+    }
+
+    size_t root = cache_find(cache, "", 0, cache->sorted);
+    if (root == STATUS_NONE) { root = cache_add(cache, "", 0); }
+    cache->dirs[root].parent = STATUS_NONE;
+    cache->dirs[root].reached = true;
+
+    size_t *level = safe_malloc(sizeof(size_t), 1), *next = NULL;
+    size_t level_count = 1, level_capacity = 1, next_count, next_capacity = 0;
+    level[0] = root;
+    s->scan = safe_malloc(sizeof(size_t), 1);
+    size_t scan_capacity = 1;
+
+    while (level_count){
+        s->scan_count = 0;
+        for (size_t n = 0; n < level_count; n++){
+            UntrackedDir *dir = &cache->dirs[level[n]];
+            if (dir->valid) { s->result->dirs_cached++; continue; }
+            if (dir->parent != STATUS_NONE) { ensure_rules(s, dir->parent); }
+            if (s->scan_count == scan_capacity){
+                scan_capacity *= 2;
+                s->scan = realloc(s->scan, scan_capacity * sizeof(size_t));
+                MALLOC_CHECK(s->scan);
+            }
+            s->scan[s->scan_count++] = level[n];
+        }
+        if (s->scan_count){
+            if (!workers_run(s->options->threads, s->scan_count, scan_job, s)) { free(level); free(next); return false; }
+            s->result->dirs_read += s->scan_count;
+            s->cache_dirty = true;
+        }
+
+        next_count = 0;
+        for (size_t n = 0; n < level_count; n++){
+            char path[MAX_PATH];
+            size_t parent = level[n];
+            for (size_t d = 0; d < cache->dirs[parent].dir_count; d++){
+                const UntrackedDir *dir = &cache->dirs[parent];
+                size_t len = dir_child_path(dir, dir->names[dir->file_count + d], path);
+                if (!len) { continue; }
+                size_t child = cache_find(cache, path, len, cache->sorted);
+                if (child == STATUS_NONE || cache->dirs[child].reached) { child = cache_add(cache, path, len); }
+                cache->dirs[child].parent = parent;
+                cache->dirs[child].reached = true;
+
+                if (next_count == next_capacity){
+                    next_capacity = next_capacity ? 2 * next_capacity : 64;
+                    next = realloc(next, next_capacity * sizeof(size_t));
+                    MALLOC_CHECK(next);
+                }
+                next[next_count++] = child;
+            }
+        }
+        size_t *swap = level, swap_capacity = level_capacity;
+        level = next;
+        level_capacity = next_capacity;
+        level_count = next_count;
+        next = swap;
+        next_capacity = swap_capacity;
+    }
+    free(level);
+    free(next);
+
+    size_t before = cache->count;
+    untracked_drop_unreached(s);
+    if (cache->count != before) { s->cache_dirty = true; }
+    if (s->cache_dirty){
+        untracked_digests(s);
+        for (size_t i = 0; i < cache->count; i++) { cache->dirs[i].tracked = cache->dirs[i].tracked_now; }
+        memcpy(cache->tracked_checksum, s->index->checksum, SHA_SIZE);
+        cache->exclude = s->exclude;
+        cache->excludes_file = s->excludes_file;
+    }
+
+    untracked_items(s);
+    return true;
+}
+
+/**
+ * untracked_excludes - Loads core.excludesFile and info/exclude beneath every .gitignore.
+ */
+static void untracked_excludes(StatusContext *s){
+    s->excludes = ignore_list_new(NULL, "", 0);
+
+    char path[MAX_PATH];
+    const char *file = s->repo->config ? config_get(s->repo->config, "core.excludesFile") : NULL;
+    const char *home = getenv("HOME"), *xdg = getenv("XDG_CONFIG_HOME");
+    path[0] = '\0';
+    if (file && file[0] == '~' && file[1] == '/' && home) { path_join_buf(path, sizeof(path), home, file + 2, NULL); }
+    else if (file) { snprintf(path, sizeof(path), "%s", file); }
+    else if (xdg && *xdg) { path_join_buf(path, sizeof(path), xdg, "git", "ignore", NULL); }
+    else if (home) { path_join_buf(path, sizeof(path), home, ".config", "git", "ignore", NULL); }
+
+    struct stat sb;
+    if (path[0]){
+        ignore_list_read(s->excludes, s->worktree_fd, path, &sb);
+        s->excludes_file = stamp_from(&sb);
+    }
+    int dir_fd = repo_gitdir_fd(s->repo);
+    if (dir_fd >= 0){
+        ignore_list_read(s->excludes, dir_fd, "info/exclude", &sb);
+        s->exclude = stamp_from(&sb);
+    }
+}
+
+/**
+ * untracked_digests - Recomputes every record's digest of tracked names from the index.
+ *
+ * Needs the records sorted by path.
+ */
+static void untracked_digests(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    for (size_t i = 0; i < cache->count; i++) { cache->dirs[i].tracked_now = 0; }
+
+    const Index *index = s->index;
+    const char *prev = NULL, *prev_dir = NULL;
+    size_t prev_len = 0, prev_dir_len = 0, record = STATUS_NONE;
+    for (size_t i = 0; i < index->count; i++){
+        const IndexEntry *entry = &index->entries[i];
+        if (prev && prev_len == entry->name_len && memcmp(prev, entry->name, prev_len) == 0) { continue; }
+        prev = entry->name;
+        prev_len = entry->name_len;
+
+        size_t dir_len = entry->name_len;
+        while (dir_len && entry->name[dir_len - 1] != '/') { dir_len--; }
+        size_t base = dir_len;
+        if (dir_len) { dir_len--; }
+        if (!prev_dir || dir_len != prev_dir_len || memcmp(prev_dir, entry->name, dir_len) != 0){
+            record = cache_find(cache, entry->name, dir_len, cache->count);
+            prev_dir = entry->name;
+            prev_dir_len = dir_len;
+        }
+        if (record != STATUS_NONE) { cache->dirs[record].tracked_now ^= name_hash(entry->name + base, entry->name_len - base); }
+    }
+}
+
+/**
+ * untracked_invalidate_changed - Invalidates the records of directories fsmonitor reported.
+ *
+ * A path invalidates its own record, if it is a directory, and that of the
+ * nearest recorded directory above it; a .gitignore invalidates its subtree.
+ */
+static void untracked_invalidate_changed(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    for (size_t c = 0; c < s->changed_count; c++){
+        const char *path = s->changed[c];
+        size_t len = strlen(path);
+        while (len && path[len - 1] == '/') { len--; }
+
+        size_t self = cache_find(cache, path, len, cache->sorted);
+        if (self != STATUS_NONE) { cache->dirs[self].valid = false; }
+
+        size_t base = len;
+        while (base && path[base - 1] != '/') { base--; }
+        bool is_ignore = len - base == 10 && memcmp(path + base, ".gitignore", 10) == 0;
+        size_t dir_len = base ? base - 1 : 0;
+        for (;;){
+            size_t parent = cache_find(cache, path, dir_len, cache->sorted);
+            if (parent != STATUS_NONE){
+                cache->dirs[parent].valid = false;
+                if (is_ignore && dir_len == (base ? base - 1 : 0)) { cache->dirs[parent].ignore_changed = true; }
+                break;
+            }
+            if (!dir_len) { break; }
+            while (dir_len && path[dir_len - 1] != '/') { dir_len--; }
+            if (dir_len) { dir_len--; }
+        }
+    }
+}
+
+/**
+ * untracked_invalidate_below - Invalidates every record under record i.
+ */
+static void untracked_invalidate_below(StatusContext *s, size_t i){
+    UntrackedCache *cache = &s->cache;
+    UntrackedDir *dir = &cache->dirs[i];
+    if (!dir->path_len){
+        for (size_t j = 0; j < cache->count; j++) { cache->dirs[j].valid = false; }
+        return;
+    }
+
+    char prefix[MAX_PATH];
+    if (dir->path_len + 1 >= sizeof(prefix)) { return; }
+    memcpy(prefix, dir->path, dir->path_len);
+    prefix[dir->path_len] = '/';
+    size_t len = dir->path_len + 1;
+    for (size_t j = cache_lower_bound(cache, prefix, len, cache->sorted); j < cache->sorted; j++){
+        if (cache->dirs[j].path_len < len || memcmp(cache->dirs[j].path, prefix, len) != 0) { break; }
+        cache->dirs[j].valid = false;
+    }
+}
+
+/**
+ * validate_job - Compares the stat data of STATUS_STAMP_CHUNK cached directories.
+ */
+static void validate_job(void *ctx, size_t chunk){
+    StatusContext *s = ctx;
+    UntrackedCache *cache = &s->cache;
+    size_t start = chunk * STATUS_STAMP_CHUNK;
+    size_t end = start + STATUS_STAMP_CHUNK < cache->count ? start + STATUS_STAMP_CHUNK : cache->count;
+
+    for (size_t i = start; i < end; i++){
+        UntrackedDir *dir = &cache->dirs[i];
+        char path[MAX_PATH];
+        if (!dir->valid) { continue; }
+
+        StatStamp now = stamp_at(s->worktree_fd, dir->path_len ? dir->path : ".");
+        if (!stamp_equal(&now, &dir->dir)) { dir->valid = false; }
+        if (dir_child_path(dir, ".gitignore", path)){
+            now = stamp_at(s->worktree_fd, path);
+            if (!stamp_equal(&now, &dir->ignore)) { dir->valid = false; dir->ignore_changed = true; }
+        }
+    }
+}
+
+/**
+ * scan_job - Lists one directory: loads its .gitignore and records what is untracked.
+ */
+static void scan_job(void *ctx, size_t n){
+    StatusContext *s = ctx;
+    UntrackedDir *dir = &s->cache.dirs[s->scan[n]];
+    const IgnoreList *parent = dir->parent == STATUS_NONE ? s->excludes : s->cache.dirs[dir->parent].rules;
+
+    free(dir->storage);
+    dir->storage = NULL;
+    dir->names = NULL;
+    dir->file_count = dir->dir_count = 0;
+    dir->valid = true;
+    memset(&dir->dir, 0, sizeof(dir->dir));
+
+    char base[MAX_PATH];
+    size_t base_len = dir->path_len ? dir->path_len + 1 : 0;
+    if (base_len >= sizeof(base)) { return; }
+    memcpy(base, dir->path, dir->path_len);
+    base[dir->path_len] = '/';
+    ignore_list_free(dir->rules);
+    dir->rules = ignore_list_new(parent, base, base_len);
+
+    int fd = openat(s->worktree_fd, dir->path_len ? dir->path : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) { return; }
+    struct stat sb;
+    if (fstat(fd, &sb) == 0) { dir->dir = stamp_from(&sb); }
+    ignore_list_read(dir->rules, fd, ".gitignore", &sb);
+    dir->ignore = stamp_from(&sb);
+
+    DIR *listing = fdopendir(fd);
+    if (!listing) { close(fd); return; }
+
+    char *names = NULL, path[MAX_PATH];
+    size_t names_len = 0, names_capacity = 0;
+    size_t *offsets = NULL, offsets_capacity = 0, file_count = 0, dir_count = 0;
+    bool *is_dirs = NULL;
+    struct dirent *ent;
+    while ((ent = readdir(listing))){
+        const char *name = ent->d_name;
+        if (streq(name, ".") || streq(name, "..") || streq(name, ".git")) { continue; }
+
+        bool is_dir = ent->d_type == DT_DIR;
+        if (ent->d_type == DT_UNKNOWN && fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0) { is_dir = S_ISDIR(sb.st_mode); }
+        size_t len = dir_child_path(dir, name, path);
+        if (!len) { continue; }
+        if (is_dir){
+            const IndexEntry *entry = index_find(s->index, path, len, 0);
+            if (entry && (entry->mode & TREE_MODE_TYPE) == TREE_MODE_GITLINK) { continue; }
+        } else if (index_has_path(s->index, path, len)) { continue; }
+        if (ignore_path(dir->rules, path, len, is_dir)) { continue; }
+
+        char nested[MAX_PATH];
+        bool repo = is_dir && snprintf(nested, sizeof(nested), "%s/.git", name) < (int)sizeof(nested) &&
+                    faccessat(fd, nested, F_OK, AT_SYMLINK_NOFOLLOW) == 0;
+        size_t name_len = strlen(name);
+        if (names_len + name_len + 2 > names_capacity){
+            names_capacity = names_capacity ? 2 * names_capacity + name_len : 1024;
+            names = realloc(names, names_capacity);
+            MALLOC_CHECK(names);
+        }
+        if (file_count + dir_count == offsets_capacity){
+            offsets_capacity = offsets_capacity ? 2 * offsets_capacity : 32;
+            offsets = realloc(offsets, offsets_capacity * sizeof(size_t));
+            is_dirs = realloc(is_dirs, offsets_capacity * sizeof(bool));
+            MALLOC_CHECK(offsets);
+            MALLOC_CHECK(is_dirs);
+        }
+        offsets[file_count + dir_count] = names_len;
+        is_dirs[file_count + dir_count] = is_dir && !repo;
+        memcpy(names + names_len, name, name_len);
+        names_len += name_len;
+        if (repo) { names[names_len++] = '/'; }
+        names[names_len++] = '\0';
+        if (is_dir && !repo) { dir_count++; } else { file_count++; }
+    }
+    closedir(listing);
+
+    size_t total = file_count + dir_count;
+    if (total){
+        /* one block: the pointer array, then the names */
+        dir->storage = safe_malloc(total * sizeof(char *) + names_len, 1);
+        const char **list = (const char **)dir->storage;
+        char *copy = dir->storage + total * sizeof(char *);
+        memcpy(copy, names, names_len);
+        size_t files = 0, dirs = file_count;
+        for (size_t i = 0; i < total; i++){
+            list[is_dirs[i] ? dirs++ : files++] = copy + offsets[i];
+        }
+        dir->names = list;
+        dir->file_count = file_count;
+        dir->dir_count = dir_count;
+    }
+    free(names);
+    free(offsets);
+    free(is_dirs);
+}
+
+/**
+ * ensure_rules - Loads the ignore rules of a record that was not rescanned.
+ */
+static void ensure_rules(StatusContext *s, size_t i){
+    if (s->cache.dirs[i].rules) { return; }
+    size_t parent = s->cache.dirs[i].parent;
+    if (parent != STATUS_NONE) { ensure_rules(s, parent); }
+
+    UntrackedDir *dir = &s->cache.dirs[i];
+    char base[MAX_PATH];
+    size_t base_len = dir->path_len ? dir->path_len + 1 : 0;
+    if (base_len >= sizeof(base) - 10) { return; }
+    memcpy(base, dir->path, dir->path_len);
+    base[dir->path_len] = '/';
+    dir->rules = ignore_list_new(parent == STATUS_NONE ? s->excludes : s->cache.dirs[parent].rules, base, base_len);
+    memcpy(base + base_len, ".gitignore", 11);
+    ignore_list_read(dir->rules, s->worktree_fd, base, NULL);
+}
+
+/**
+ * untracked_drop_unreached - Forgets directories no longer listed, then sorts the records.
+ */
+static void untracked_drop_unreached(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    size_t kept = 0;
+    for (size_t i = 0; i < cache->count; i++){
+        if (!cache->dirs[i].reached){
+            ignore_list_free(cache->dirs[i].rules);
+            cache_release(&cache->dirs[i]);
+            continue;
+        }
+        cache->dirs[kept++] = cache->dirs[i];
+    }
+    cache->count = kept;
+    qsort(cache->dirs, cache->count, sizeof(UntrackedDir), dir_compare);
+    cache->sorted = cache->count;
+    for (size_t i = 0; i < cache->count; i++) { cache->dirs[i].has_untracked = -1; }
+}
+
+/**
+ * untracked_items - Adds the untracked paths, sorted, after the tracked items.
+ */
+static void untracked_items(StatusContext *s){
+    size_t first = s->result->count;
+    size_t root = cache_find(&s->cache, "", 0, s->cache.count);
+    char path[MAX_PATH];
+    if (root != STATUS_NONE) { untracked_emit(s, root, path); }
+    qsort(s->result->items + first, s->result->count - first, sizeof(StatusItem), item_compare);
+}
+
+/**
+ * untracked_emit - Adds what a directory holds; untracked subdirectories
+ * collapse to "dir/" unless every file was asked for.
+ */
+static void untracked_emit(StatusContext *s, size_t i, char *path){
+    const UntrackedDir *dir = &s->cache.dirs[i];
+    for (size_t f = 0; f < dir->file_count; f++){
+        size_t len = dir_child_path(dir, dir->names[f], path);
+        if (len) { result_add(s->result, path, len, '?', '?'); }
+    }
+    for (size_t d = 0; d < dir->dir_count; d++){
+        size_t len = dir_child_path(dir, dir->names[dir->file_count + d], path);
+        size_t child = len ? cache_find(&s->cache, path, len, s->cache.count) : STATUS_NONE;
+        if (child == STATUS_NONE) { continue; }
+
+        if (s->options->untracked == UNTRACKED_ALL || index_has_dir(s->index, path, len)){
+            char sub[MAX_PATH];
+            untracked_emit(s, child, sub);
+        } else if (untracked_has_content(s, child) && len + 1 < MAX_PATH){
+            path[len] = '/';
+            result_add(s->result, path, len + 1, '?', '?');
+        }
+    }
+}
+
+/**
+ * untracked_has_content - Checks whether a directory holds any untracked file at any depth.
+ */
+static bool untracked_has_content(StatusContext *s, size_t i){
+    UntrackedDir *dir = &s->cache.dirs[i];
+    if (dir->has_untracked >= 0) { return dir->has_untracked; }
+
+    bool found = dir->file_count > 0;
+    char path[MAX_PATH];
+    for (size_t d = 0; !found && d < dir->dir_count; d++){
+        size_t len = dir_child_path(dir, dir->names[dir->file_count + d], path);
+        size_t child = len ? cache_find(&s->cache, path, len, s->cache.count) : STATUS_NONE;
+        if (child != STATUS_NONE) { found = untracked_has_content(s, child); }
+        dir = &s->cache.dirs[i];
+    }
+    dir->has_untracked = found;
+    return found;
+}
+
+/**
+ * dir_child_path - Joins a record's path and a name into a MAX_PATH buffer.
+ *
+ * @return Length of the joined path, 0 if it does not fit.
+ */
+static size_t dir_child_path(const UntrackedDir *dir, const char *name, char *buf){
+    size_t name_len = strlen(name);
+    size_t len = dir->path_len ? dir->path_len + 1 + name_len : name_len;
+    if (len >= MAX_PATH) { return 0; }
+    if (dir->path_len){
+        memcpy(buf, dir->path, dir->path_len);
+        buf[dir->path_len] = '/';
+    }
+    memcpy(buf + len - name_len, name, name_len + 1);
+    return len;
+}
+
+/**
+ * cache_lower_bound - Finds the first record in [0, limit) not ordered before path.
+ */
+static size_t cache_lower_bound(const UntrackedCache *cache, const char *path, size_t len, size_t limit){
+    size_t lo = 0, hi = limit;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        const UntrackedDir *dir = &cache->dirs[mid];
+        int cmp = memcmp(dir->path, path, dir->path_len < len ? dir->path_len : len);
+        if (cmp < 0 || (cmp == 0 && dir->path_len < len)) { lo = mid + 1; } else { hi = mid; }
+    }
+    return lo;
+}
+
+/**
+ * cache_find - Looks up the record of a directory among the first limit (sorted) records.
+ *
+ * @return Its position or STATUS_NONE.
+ */
+static size_t cache_find(const UntrackedCache *cache, const char *path, size_t len, size_t limit){
+    size_t pos = cache_lower_bound(cache, path, len, limit);
+    if (pos < limit && cache->dirs[pos].path_len == len && memcmp(cache->dirs[pos].path, path, len) == 0) { return pos; }
+    return STATUS_NONE;
+}
+
+/**
+ * cache_add - Appends an empty, invalid record; the sorted prefix is left alone.
+ */
+static size_t cache_add(UntrackedCache *cache, const char *path, size_t len){
+    if (cache->count == cache->capacity){
+        cache->capacity = cache->capacity ? 2 * cache->capacity : 64;
+        cache->dirs = realloc(cache->dirs, cache->capacity * sizeof(UntrackedDir));
+        MALLOC_CHECK(cache->dirs);
+    }
+    UntrackedDir *dir = &cache->dirs[cache->count];
+    memset(dir, 0, sizeof(*dir));
+    dir->own_path = safe_malloc(len + 1, 1);
+    memcpy(dir->own_path, path, len);
+    dir->own_path[len] = '\0';
+    dir->path = dir->own_path;
+    dir->path_len = len;
+    dir->parent = STATUS_NONE;
+    dir->has_untracked = -1;
+    return cache->count++;
+}
+
+/**
+ * cache_release - Frees what a record owns.
+ */
+static void cache_release(UntrackedDir *dir){
+    free(dir->own_path);
+    free(dir->storage);
+    dir->own_path = dir->storage = NULL;
+}
+
+/**
+ * cache_load - Maps .git/untracked-cache; a missing or damaged file means starting cold.
+ */
+static void cache_load(StatusContext *s){
+    char path[MAX_PATH];
+    if (!repo_path_buf(s->repo, path, sizeof(path), STATUS_CACHE_FILE, NULL)) { return; }
+    s->cache.map = map_file(path, &s->cache.size);
+    if (s->cache.map && !cache_parse(s)){
+        for (size_t i = 0; i < s->cache.count; i++) { cache_release(&s->cache.dirs[i]); }
+        s->cache.count = s->cache.sorted = 0;
+        s->cache.token = NULL;
+        s->cache.dirty_count = 0;
+        s->cache.flags = 0;
+        memset(s->cache.tracked_checksum, 0, SHA_SIZE);
+        memset(s->cache.dirty_checksum, 0, SHA_SIZE);
+    }
+}
+
+/**
+ * cache_parse - Decodes the mapped cache file.
+ *
+ * @return false if the checksum, version or layout is wrong.
+ */
+static bool cache_parse(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    if (cache->size < 12 + SHA_SIZE || get_be32(cache->map) != STATUS_CACHE_SIGNATURE ||
+        get_be32(cache->map + 4) != STATUS_CACHE_VERSION) { return false; }
+    unsigned char sha[SHA_SIZE];
+    sha1_buffer(cache->map, cache->size - SHA_SIZE, sha);
+    if (memcmp(sha, cache->map + cache->size - SHA_SIZE, SHA_SIZE) != 0) { return false; }
+
+    CacheReader reader = { cache->map + 8, cache->map + cache->size - SHA_SIZE, true };
+    cache->flags = reader_be32(&reader);
+    if ((size_t)(reader.end - reader.pos) < 2 * SHA_SIZE) { return false; }
+    memcpy(cache->tracked_checksum, reader.pos, SHA_SIZE);
+    memcpy(cache->dirty_checksum, reader.pos + SHA_SIZE, SHA_SIZE);
+    reader.pos += 2 * SHA_SIZE;
+    cache->exclude = reader_stamp(&reader);
+    cache->excludes_file = reader_stamp(&reader);
+
+    size_t len;
+    cache->token = reader_str(&reader, &len);
+    if (cache->token && !len) { cache->token = NULL; }
+    cache->dirty_count = reader_be32(&reader);
+    if (!reader.ok || cache->dirty_count > (size_t)(reader.end - reader.pos)) { return false; }
+    cache->dirty = arena_alloc(&cache->arena, (cache->dirty_count ? cache->dirty_count : 1) * sizeof(char *));
+    for (size_t i = 0; i < cache->dirty_count; i++) { cache->dirty[i] = reader_str(&reader, &len); }
+
+    size_t count = reader_be32(&reader);
+    if (!reader.ok || count > (size_t)(reader.end - reader.pos) / (2 * STATUS_STAMP_SIZE + 17)) { return false; }
+    cache->dirs = safe_calloc(sizeof(UntrackedDir), count ? count : 1);
+    cache->capacity = count ? count : 1;
+    for (size_t i = 0; i < count && reader.ok; i++){
+        UntrackedDir *dir = &cache->dirs[i];
+        dir->path = reader_str(&reader, &dir->path_len);
+        dir->dir = reader_stamp(&reader);
+        dir->ignore = reader_stamp(&reader);
+        dir->tracked = reader_be64(&reader);
+        dir->file_count = reader_be32(&reader);
+        dir->dir_count = reader_be32(&reader);
+        size_t total = dir->file_count + dir->dir_count;
+        if (!reader.ok || total > (size_t)(reader.end - reader.pos)) { return false; }
+        dir->names = arena_alloc(&cache->arena, (total ? total : 1) * sizeof(char *));
+        for (size_t n = 0; n < total; n++) { dir->names[n] = reader_str(&reader, &len); }
+        dir->parent = STATUS_NONE;
+        dir->has_untracked = -1;
+        dir->valid = true;
+        cache->count = i + 1;
+        if (i && dir_compare(&cache->dirs[i - 1], dir) >= 0) { return false; }
+    }
+    cache->sorted = cache->count;
+    return reader.ok && reader.pos == reader.end && cache->count == count;
+}
+
+/**
+ * cache_save - Writes the records, the fsmonitor token and the dirty list through a lock.
+ *
+ * @return false if the lock is held or the write failed; the next run then starts colder.
+ */
+static bool cache_save(StatusContext *s){
+    UntrackedCache *cache = &s->cache;
+    const StatusOptions *options = s->options;
+    StatusBuffer buf = { 0 };
+    bool keep = options->untracked_cache;
+    bool watched = options->fsmonitor && keep && options->untracked != UNTRACKED_NO;
+
+    buffer_be32(&buf, STATUS_CACHE_SIGNATURE);
+    buffer_be32(&buf, STATUS_CACHE_VERSION);
+    buffer_be32(&buf, watched ? STATUS_CACHE_WATCHED : 0);
+    static const unsigned char zero[SHA_SIZE];
+    buffer_put(&buf, keep ? cache->tracked_checksum : zero, SHA_SIZE);
+    buffer_put(&buf, s->index->checksum, SHA_SIZE);
+    buffer_stamp(&buf, &cache->exclude);
+    buffer_stamp(&buf, &cache->excludes_file);
+    buffer_str(&buf, options->fsmonitor && s->token ? s->token : "", options->fsmonitor && s->token ? strlen(s->token) : 0);
+
+    uint32_t dirty = 0;
+    for (size_t i = 0; options->fsmonitor && i < s->index->count; i++) { dirty += s->worktree[i] != ' ' && s->worktree[i] != 'U'; }
+    buffer_be32(&buf, dirty);
+    for (size_t i = 0; dirty && i < s->index->count; i++){
+        if (s->worktree[i] != ' ' && s->worktree[i] != 'U') { buffer_str(&buf, s->index->entries[i].name, s->index->entries[i].name_len); }
+    }
+
+    size_t count = keep ? cache->count : 0;
+    buffer_be32(&buf, (uint32_t)count);
+    for (size_t i = 0; i < count; i++){
+        const UntrackedDir *dir = &cache->dirs[i];
+        buffer_str(&buf, dir->path, dir->path_len);
+        buffer_stamp(&buf, &dir->dir);
+        buffer_stamp(&buf, &dir->ignore);
+        buffer_be64(&buf, dir->tracked);
+        buffer_be32(&buf, (uint32_t)dir->file_count);
+        buffer_be32(&buf, (uint32_t)dir->dir_count);
+        for (size_t n = 0; n < dir->file_count + dir->dir_count; n++) { buffer_str(&buf, dir->names[n], strlen(dir->names[n])); }
+    }
+    unsigned char sha[SHA_SIZE];
+    sha1_buffer(buf.data, buf.len, sha);
+    buffer_put(&buf, sha, SHA_SIZE);
+
+    int dir_fd = repo_gitdir_fd(s->repo);
+    int fd = dir_fd < 0 ? -1 : openat(dir_fd, STATUS_CACHE_LOCK, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    bool status = fd >= 0;
+    if (status){
+        status = write_all(fd, buf.data, buf.len);
+        status = close(fd) == 0 && status;
+        if (status) { status = renameat(dir_fd, STATUS_CACHE_LOCK, dir_fd, STATUS_CACHE_FILE) == 0; }
+        if (!status) { unlinkat(dir_fd, STATUS_CACHE_LOCK, 0); }
+    }
+    free(buf.data);
+    return status;
+}
+
+/**
+ * cache_free - Releases the records and the mapping.
+ */
+static void cache_free(UntrackedCache *cache){
+    for (size_t i = 0; i < cache->count; i++) { cache_release(&cache->dirs[i]); }
+    free(cache->dirs);
+    arena_clear(&cache->arena);
+    if (cache->map) { munmap((void *)cache->map, cache->size); }
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * fsmonitor_query - Asks the hook what changed since the cached token.
+ *
+ * Without a token, or if the hook fails or reports "/", everything is
+ * checked and a timestamp taken before the scan becomes the next token.
+ * Tracked entries are only narrowed down when the index is the one the
+ * dirty list was taken from.
+ */
+static void fsmonitor_query(StatusContext *s){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(s->token_buf, sizeof(s->token_buf), "%llu", (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec);
+    s->token = s->token_buf;
+
+    StatusBuffer out = { 0 };
+    if (!s->cache.token || !fsmonitor_run(s, s->cache.token, &out)){
+        free(out.data);
+        return;
+    }
+    s->hook_output = (char *)out.data;
+    s->token = s->hook_output;
+
+    size_t pos = strlen(s->hook_output) + 1;
+    size_t capacity = 16;
+    s->changed = safe_malloc(sizeof(char *), capacity);
+    while (pos < out.len){
+        const char *path = s->hook_output + pos;
+        size_t len = strlen(path);
+        pos += len + 1;
+        if (!len) { continue; }
+        if (streq(path, "/")) { s->changed_count = 0; return; }
+        if (strncmp(path, ".git/", 5) == 0 || streq(path, ".git")) { continue; }
+        if (s->changed_count == capacity){
+            capacity *= 2;
+            s->changed = realloc(s->changed, capacity * sizeof(char *));
+            MALLOC_CHECK(s->changed);
+        }
+        s->changed[s->changed_count++] = path;
+    }
+    s->hook_answered = true;
+    s->result->fsmonitor_used = true;
+
+    if (memcmp(s->cache.dirty_checksum, s->index->checksum, SHA_SIZE) != 0) { return; }
+    s->check = safe_calloc(sizeof(bool), s->index->count ? s->index->count : 1);
+    for (size_t i = 0; i < s->changed_count; i++) { fsmonitor_mark(s, s->changed[i], strlen(s->changed[i])); }
+    for (size_t i = 0; i < s->cache.dirty_count; i++) { fsmonitor_mark(s, s->cache.dirty[i], strlen(s->cache.dirty[i])); }
+}
+
+/**
+ * fsmonitor_run - Runs the hook as '<hook> 2 <token>' from the top of the worktree.
+ *
+ * @param out Receives the hook's output, NUL-terminated.
+ * @return true if the hook exited 0 and printed a new token.
+ */
+static bool fsmonitor_run(StatusContext *s, const char *token, StatusBuffer *out){
+    char command[MAX_PATH + 16];
+    snprintf(command, sizeof(command), "%s \"$@\"", s->options->fsmonitor);
+
+    int fds[2];
+    if (pipe(fds) != 0) { return false; }
+    pid_t pid = fork();
+    if (pid < 0){
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0){
+        close(fds[0]);
+        if (dup2(fds[1], STDOUT_FILENO) < 0 || chdir(s->repo->worktree) != 0) { _exit(127); }
+        execl("/bin/sh", "sh", "-c", command, s->options->fsmonitor, STATUS_HOOK_VERSION, token, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    for (;;){
+        if (out->capacity - out->len < STATUS_HOOK_OUTPUT){
+            out->capacity = out->capacity * 2 + STATUS_HOOK_OUTPUT;
+            out->data = realloc(out->data, out->capacity);
+            MALLOC_CHECK(out->data);
+        }
+        ssize_t n = read(fds[0], out->data + out->len, out->capacity - out->len - 1);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        out->len += (size_t)n;
+    }
+    close(fds[0]);
+    out->data[out->len] = '\0';
+
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0){
+        fprintf(stderr, "status: fsmonitor hook '%s' failed, checking everything\n", s->options->fsmonitor);
+        return false;
+    }
+    return out->len > 0 && memchr(out->data, '\0', out->len) && out->data[0];
+}
+
+/**
+ * fsmonitor_mark - Selects the index entries at or below a reported path.
+ */
+static void fsmonitor_mark(StatusContext *s, const char *path, size_t len){
+    const Index *index = s->index;
+    while (len && path[len - 1] == '/') { len--; }
+    for (size_t i = index_position(index, path, len); i < index->count; i++){
+        const IndexEntry *entry = &index->entries[i];
+        if (entry->name_len < len || memcmp(entry->name, path, len) != 0) { break; }
+        if (entry->name_len > len && entry->name[len] != '/'){
+            if (entry->name[len] > '/') { break; }
+            continue;
+        }
+        s->check[i] = true;
+    }
+}
+
+/**
+ * result_add - Appends an item, copying the path into the result's arena.
+ */
+static void result_add(StatusResult *result, const char *path, size_t len, char staged, char worktree){
+    if (result->count == result->capacity){
+        result->capacity = result->capacity ? 2 * result->capacity : 64;
+        result->items = realloc(result->items, result->capacity * sizeof(StatusItem));
+        MALLOC_CHECK(result->items);
+    }
+    char *copy = arena_alloc(&result->arena, len + 1);
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    result->items[result->count].path = copy;
+    result->items[result->count].staged = staged;
+    result->items[result->count].worktree = worktree;
+    result->count++;
+}
+
+/**
+ * item_compare - qsort() order of items and HEAD entries: the path bytes.
+ */
+static int item_compare(const void *a, const void *b){ return strcmp(*(const char * const *)a, *(const char * const *)b); }
+
+/**
+ * dir_compare - qsort() order of cache records: path bytes, shorter first.
+ */
+static int dir_compare(const void *a, const void *b){
+    const UntrackedDir *x = a, *y = b;
+    int cmp = memcmp(x->path, y->path, x->path_len < y->path_len ? x->path_len : y->path_len);
+    if (cmp) { return cmp; }
+    return x->path_len < y->path_len ? -1 : x->path_len > y->path_len;
+}
+
+/**
+ * stamp_from - Keeps the stat fields that reveal a directory or file change.
+ */
+static StatStamp stamp_from(const struct stat *sb){
+    StatStamp stamp = {
+        .mtime_sec = sb->st_mtim.tv_sec, .mtime_nsec = (uint32_t)sb->st_mtim.tv_nsec,
+        .ctime_sec = sb->st_ctim.tv_sec, .ctime_nsec = (uint32_t)sb->st_ctim.tv_nsec,
+        .ino = sb->st_ino, .dev = sb->st_dev, .size = (uint64_t)sb->st_size,
+    };
+    return stamp;
+}
+
+static bool stamp_equal(const StatStamp *a, const StatStamp *b){
+    return a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec && a->ctime_sec == b->ctime_sec &&
+           a->ctime_nsec == b->ctime_nsec && a->ino == b->ino && a->dev == b->dev && a->size == b->size;
+}
+
+/**
+ * stamp_at - lstat()s a path into a stamp, zero if it does not exist.
+ */
+static StatStamp stamp_at(int dir_fd, const char *path){
+    struct stat sb;
+    if (fstatat(dir_fd, path, &sb, AT_SYMLINK_NOFOLLOW) != 0) { memset(&sb, 0, sizeof(sb)); }
+    return stamp_from(&sb);
+}
+
+/**
+ * name_hash - FNV-1a of a name; digests XOR these so order does not matter.
+ */
+static uint64_t name_hash(const char *name, size_t len){
+    uint64_t hash = STATUS_FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) { hash = (hash ^ (unsigned char)name[i]) * STATUS_FNV_PRIME; }
+    return hash;
+}
+
+static void buffer_put(StatusBuffer *buf, const void *data, size_t len){
+    if (buf->len + len > buf->capacity){
+        buf->capacity = 2 * buf->capacity + len + 4096;
+        buf->data = realloc(buf->data, buf->capacity);
+        MALLOC_CHECK(buf->data);
+    }
+    if (len) { memcpy(buf->data + buf->len, data, len); }
+    buf->len += len;
+}
+
+static void buffer_be32(StatusBuffer *buf, uint32_t value){
+    unsigned char bytes[4];
+    put_be32(bytes, value);
+    buffer_put(buf, bytes, sizeof(bytes));
+}
+
+static void buffer_be64(StatusBuffer *buf, uint64_t value){
+    unsigned char bytes[8];
+    put_be64(bytes, value);
+    buffer_put(buf, bytes, sizeof(bytes));
+}
+
+static void buffer_str(StatusBuffer *buf, const char *s, size_t len){
+    buffer_put(buf, s, len);
+    buffer_put(buf, "", 1);
+}
+
+static void buffer_stamp(StatusBuffer *buf, const StatStamp *stamp){
+    buffer_be64(buf, (uint64_t)stamp->mtime_sec);
+    buffer_be32(buf, stamp->mtime_nsec);
+    buffer_be64(buf, (uint64_t)stamp->ctime_sec);
+    buffer_be32(buf, stamp->ctime_nsec);
+    buffer_be64(buf, stamp->ino);
+    buffer_be64(buf, stamp->dev);
+    buffer_be64(buf, stamp->size);
+}
+
+static uint32_t reader_be32(CacheReader *reader){
+    if (!reader->ok || reader->end - reader->pos < 4) { reader->ok = false; return 0; }
+    uint32_t value = get_be32(reader->pos);
+    reader->pos += 4;
+    return value;
+}
+
+static uint64_t reader_be64(CacheReader *reader){
+    if (!reader->ok || reader->end - reader->pos < 8) { reader->ok = false; return 0; }
+    uint64_t value = get_be64(reader->pos);
+    reader->pos += 8;
+    return value;
+}
+
+static const char *reader_str(CacheReader *reader, size_t *len){
+    const unsigned char *nul = reader->ok ? memchr(reader->pos, '\0', (size_t)(reader->end - reader->pos)) : NULL;
+    if (!nul) { reader->ok = false; *len = 0; return ""; }
+    const char *s = (const char *)reader->pos;
+    *len = (size_t)(nul - reader->pos);
+    reader->pos = nul + 1;
+    return s;
+}
+
+static StatStamp reader_stamp(CacheReader *reader){
+    StatStamp stamp;
+    stamp.mtime_sec = (int64_t)reader_be64(reader);
+    stamp.mtime_nsec = reader_be32(reader);
+    stamp.ctime_sec = (int64_t)reader_be64(reader);
+    stamp.ctime_nsec = reader_be32(reader);
+    stamp.ino = reader_be64(reader);
+    stamp.dev = reader_be64(reader);
+    stamp.size = reader_be64(reader);
+    return stamp;
+}
@@ -0,0 +1,162 @@
+/* tree.c: tree object entries */
+
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Forward Declaration of static Functions */
+
+static const TreeLeaf *tree_bisect(const Tree *tree, const char *name, size_t len, uint32_t mode);
+
+/* Functions */
+
+/**
+ * tree_parse - Indexes the entries of a tree body.
+ *
+ * Each "<mode> <name>\0<20-byte SHA>" entry becomes one fixed-size TreeLeaf
+ * holding the decoded mode, a view of the name and the raw SHA; nothing is
+ * converted to hex. Names stay in the body, where they are already NUL
+ * terminated.
+ *
+ * @param tree  Output index; tree->data is set to data.
+ * @param data  The tree body; it must outlive the index.
+ * @param size  Size of data (below 4 GiB).
+ * @param arena Arena the leaf array is allocated from.
+ * @return True on success, false if an entry is malformed.
+ */
+bool tree_parse(Tree *tree, const unsigned char *data, size_t size, Arena *arena){
+    if (!tree || (!data && size) || !arena || size > UINT32_MAX) { return false; }
+
+    /* The shortest entry is "0 x\0" plus the SHA, which bounds the count. */
+    size_t capacity = size / (4 + SHA_SIZE);
+
+    memset(tree, 0, sizeof(*tree));
+    tree->data = data;
+    tree->sorted = true;
+    tree->leaves = capacity ? arena_alloc(arena, capacity * sizeof(TreeLeaf)) : NULL;
+
+    const unsigned char *p = data, *end = data + size;
+    while (p < end){
+        uint32_t mode = 0;
+        const unsigned char *start = p;
+        while (p < end && *p >= '0' && *p <= '7' && p - start < 7) { mode = (mode << 3) | (uint32_t)(*p++ - '0'); }
+        if (p == start || p == end || *p != ' '){
+            fprintf(stderr, "tree_parse: malformed mode at offset %zu\n", (size_t)(start - data));
+            return false;
+        }
+
+        const unsigned char *name = ++p;
+        const unsigned char *nul = memchr(name, '\0', (size_t)(end - name));
+        if (!nul || nul == name || (size_t)(end - nul - 1) < SHA_SIZE){
+            fprintf(stderr, "tree_parse: truncated entry at offset %zu\n", (size_t)(start - data));
+            return false;
+        }
+
+        TreeLeaf *leaf = &tree->leaves[tree->count++];
+        leaf->mode = mode;
+        leaf->name_off = (uint32_t)(name - data);
+        leaf->name_len = (uint32_t)(nul - name);
+        memcpy(leaf->sha, nul + 1, SHA_SIZE);
+        p = nul + 1 + SHA_SIZE;
+
+        if (tree->sorted && tree->count > 1){
+            const TreeLeaf *prev = leaf - 1;
+            if (tree_name_compare(tree_leaf_name(tree, prev), prev->name_len, prev->mode,
+                                  (const char *)name, leaf->name_len, mode) >= 0){
+                tree->sorted = false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * tree_find - Looks up a single path component in a tree.
+ *
+ * Trees written by git are sorted so that a directory "foo" compares as
+ * "foo/", so the name is bisected once as a file and once as a directory.
+ * Trees that are out of order fall back to a linear scan.
+ *
+ * @param tree The parsed tree.
+ * @param name The entry name (no slashes).
+ * @param len  Length of name.
+ * @return The leaf, or NULL if the tree has no such entry.
+ */
+const TreeLeaf *tree_find(const Tree *tree, const char *name, size_t len){
+    if (!tree || !name) { return NULL; }
+
+    if (!tree->sorted){
+        for (size_t i = 0; i < tree->count; i++){
+            const TreeLeaf *leaf = &tree->leaves[i];
+            if (leaf->name_len == len && memcmp(tree_leaf_name(tree, leaf), name, len) == 0) { return leaf; }
+        }
+        return NULL;
+    }
+
+    const TreeLeaf *leaf = tree_bisect(tree, name, len, 0100644);
+    return leaf ? leaf : tree_bisect(tree, name, len, TREE_MODE_TREE);
+}
+
+/**
+ * tree_name_compare - Orders two tree entries the way git sorts them.
+ *
+ * @param a      First name.
+ * @param a_len  Length of a.
+ * @param a_mode Mode of a; directories sort as if followed by '/'.
+ * @param b      Second name.
+ * @param b_len  Length of b.
+ * @param b_mode Mode of b.
+ * @return Negative, zero or positive like memcmp().
+ */
+int tree_name_compare(const char *a, size_t a_len, uint32_t a_mode, const char *b, size_t b_len, uint32_t b_mode){
+    size_t len = min(a_len, b_len);
+    int cmp = memcmp(a, b, len);
+    if (cmp) { return cmp; }
+
+    unsigned char ca = len < a_len ? (unsigned char)a[len] : ((a_mode & TREE_MODE_TYPE) == TREE_MODE_TREE ? '/' : '\0');
+    unsigned char cb = len < b_len ? (unsigned char)b[len] : ((b_mode & TREE_MODE_TYPE) == TREE_MODE_TREE ? '/' : '\0');
+    return (int)ca - (int)cb;
+}
+
+/**
+ * tree_leaf_type - Names the object type a tree entry points to.
+ *
+ * @param leaf The entry.
+ * @return "tree", "commit" (a submodule) or "blob".
+ */
+const char *tree_leaf_type(const TreeLeaf *leaf){
+    switch (leaf->mode & TREE_MODE_TYPE){
+        case TREE_MODE_TREE:    return "tree";
+        case TREE_MODE_GITLINK: return "commit";
+        default:                return "blob";
+    }
+}
+
+/* Static Functions */
+
+/**
+ * tree_bisect - Binary search for an entry of a given kind in a sorted tree.
+ *
+ * @param tree The parsed, sorted tree.
+ * @param name The entry name.
+ * @param len  Length of name.
+ * @param mode Any mode of the kind searched for (tree or not).
+ * @return The leaf, or NULL.
+ */
+static const TreeLeaf *tree_bisect(const Tree *tree, const char *name, size_t len, uint32_t mode){
+    size_t lo = 0, hi = tree->count;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        const TreeLeaf *leaf = &tree->leaves[mid];
+        int cmp = tree_name_compare(tree_leaf_name(tree, leaf), leaf->name_len, leaf->mode, name, len, mode);
+        if (cmp == 0) { return leaf; }
+        if (cmp < 0) { lo = mid + 1; }
+        else         { hi = mid; }
+    }
+    return NULL;
+}
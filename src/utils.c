@@ -7,11 +7,70 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Structures */
+
+typedef struct {
+    atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t ns;                        /* wall time, nested spans included */
+    atomic_uint_fast64_t counters[TRACE_COUNTERS];  /* likewise */
+} TraceStats;
+
+typedef struct {
+    TracePhase phase;
+    uint64_t   start;
+    uint64_t   counters[TRACE_COUNTERS];    /* thread totals when the span began */
+} TraceFrame;
+
+typedef struct {
+    TracePhase phase;
+    uint32_t   tid;
+    uint64_t   start;                       /* since trace_init() */
+    uint64_t   duration;
+    uint64_t   counters[TRACE_COUNTERS];
+} TraceEvent;
+
+bool trace_enabled = false;
+
+static const char *trace_names[TRACE_PHASES] = {
+    "repo_create", "repo_find", "repo_config_create", "ini_parse",
+    "object_read", "object_stream", "object_write", "pack_lookup",
+};
+
+static TraceStats           trace_stats[TRACE_PHASES];
+static atomic_uint_fast64_t trace_totals[TRACE_COUNTERS];
+static uint64_t             trace_origin;
+static char                 *trace_path;    /* Chrome trace output, NULL for the summary */
+static pthread_mutex_t      trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceEvent           *trace_events;  /* under trace_lock */
+static size_t               trace_event_count;
+static size_t               trace_event_capacity;
+static size_t               trace_dropped;
+static atomic_uint          trace_next_tid;
+
+static _Thread_local TraceFrame trace_stack[TRACE_DEPTH];
+static _Thread_local size_t     trace_depth;
+static _Thread_local uint64_t   trace_thread[TRACE_COUNTERS];
+static _Thread_local uint32_t   trace_tid;
+
+/* Forward Declaration of static Functions */
+
+static size_t sha_set_slot(const ShaSet *set, const unsigned char sha[SHA_SIZE]);
+static uint64_t trace_now(void);
+static void trace_record(const TraceFrame *frame, uint64_t duration, const uint64_t *counters);
+static void trace_report(void);
+static void trace_report_chrome(FILE *fp);
 
 /* Functions */
 
@@ -61,6 +120,57 @@ char *path_join(const char *s1, ...){
     return str_joined;
 }
 
+/**
+ * path_join_buf - Joins path components into a caller-provided buffer.
+ *
+ * Same joining rules as path_join() (a '/' between components, empty
+ * components skipped) but nothing is allocated, so it suits hot paths that
+ * build a name per lookup.
+ *
+ * @param buf  Destination buffer.
+ * @param size Size of buf in bytes.
+ * @param s1   First component.
+ * @param ...  Further components. The list MUST end with NULL.
+ * @return The length of the joined path, or 0 (with buf emptied) if s1 is
+ * NULL or the result does not fit.
+ */
+size_t path_join_buf(char *buf, size_t size, const char *s1, ...){
+    va_list args;
+    va_start(args, s1);
+    size_t len = path_vjoin_buf(buf, size, s1, args);
+    va_end(args);
+    return len;
+}
+
+/**
+ * path_vjoin_buf - va_list form of path_join_buf().
+ */
+size_t path_vjoin_buf(char *buf, size_t size, const char *s1, va_list args){
+    if (!buf || size == 0) { return 0; }
+    buf[0] = '\0';
+    if (!s1) { return 0; }
+
+    size_t len = strlen(s1);
+    if (len >= size) { goto overflow; }
+    memcpy(buf, s1, len);
+
+    const char *s;
+    while ((s = va_arg(args, const char *))){
+        size_t s_len = strlen(s);
+        if (s_len == 0) { continue; }
+        if (len + 1 + s_len >= size) { goto overflow; }
+        buf[len++] = '/';
+        memcpy(buf + len, s, s_len);
+        len += s_len;
+    }
+    buf[len] = '\0';
+    return len;
+
+overflow:
+    buf[0] = '\0';
+    return 0;
+}
+
 /**
  * is_directory - Checks if the provided path points to a directory.
  *
@@ -72,6 +182,7 @@ char *path_join(const char *s1, ...){
  * invalid or not a directory. 
  */
 bool is_directory(const char *path){
+    trace_count(TRACE_SYSCALLS, 1);
     if (!path) { return false; }
 
     struct stat sb;
@@ -90,6 +201,7 @@ bool is_directory(const char *path){
  */
 bool file_exists(const char *path){
     if (!path) return false;
+    trace_count(TRACE_SYSCALLS, 1);
     return access(path, F_OK) == 0;
 }
 
@@ -207,19 +319,18 @@ bool remove_directory(const char *path){
             continue;
         }
 
+        /* lstat(): a symbolic link is removed itself, never followed */
         struct stat s;
-        if (stat(sub_path, &s) < 0){
+        if (lstat(sub_path, &s) < 0){
             status = false;
             continue;
         }
 
-        if (S_ISREG(s.st_mode)){
-            if(unlink(sub_path) < 0){
-                fprintf(stderr, "remove_directory: unable to remove %s: %s\n", sub_path, strerror(errno));
-                status = false;
-            }
-        } else if (S_ISDIR(s.st_mode)){
+        if (S_ISDIR(s.st_mode)){
             if (!remove_directory(sub_path)){ status = false; } 
+        } else if (unlink(sub_path) < 0){
+            fprintf(stderr, "remove_directory: unable to remove %s: %s\n", sub_path, strerror(errno));
+            status = false;
         }
     }
 
@@ -231,4 +342,435 @@ bool remove_directory(const char *path){
     }
 
     return status;
-}
\ No newline at end of file
+}
+
+/**
+ * write_all - Writes a whole buffer to a file descriptor.
+ *
+ * Short writes and EINTR are retried until every byte has been written.
+ *
+ * @param fd  The destination file descriptor.
+ * @param buf The bytes to write.
+ * @param len Number of bytes in buf.
+ * @return True if all bytes were written, false on error (errno is set).
+ */
+bool write_all(int fd, const void *buf, size_t len){
+    const char *p = buf;
+    while (len){
+        ssize_t n = write(fd, p, len);
+        if (n < 0){
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * hex_to_sha - Decodes a 40-character hexadecimal object name into raw bytes.
+ *
+ * @param hex The hexadecimal string; upper and lower case digits are accepted.
+ * @param sha Output buffer receiving the 20-byte binary SHA.
+ * @return True if hex held exactly 40 hex digits, false otherwise (sha is 
+ * left in an unspecified state).
+ */
+bool hex_to_sha(const char *hex, unsigned char sha[SHA_SIZE]){
+    if (!hex || !sha) { return false; }
+
+    for (size_t i = 0; i < SHA_SIZE; i++){
+        unsigned char byte = 0;
+        for (int j = 0; j < 2; j++){
+            char c = hex[2 * i + j];
+            byte <<= 4;
+            if (c >= '0' && c <= '9')       { byte |= c - '0'; }
+            else if (c >= 'a' && c <= 'f')  { byte |= c - 'a' + 10; }
+            else if (c >= 'A' && c <= 'F')  { byte |= c - 'A' + 10; }
+            else { return false; }
+        }
+        sha[i] = byte;
+    }
+
+    return hex[2 * SHA_SIZE] == '\0';
+}
+
+/**
+ * sha_to_hex - Encodes a raw 20-byte SHA as a lowercase hexadecimal string.
+ *
+ * @param sha The binary SHA to encode.
+ * @param hex Output buffer of at least SHA_HEX_SIZE bytes; NUL terminated.
+ */
+void sha_to_hex(const unsigned char sha[SHA_SIZE], char hex[SHA_HEX_SIZE]){
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < SHA_SIZE; i++){
+        hex[2 * i]     = digits[sha[i] >> 4];
+        hex[2 * i + 1] = digits[sha[i] & 0xf];
+    }
+    hex[2 * SHA_SIZE] = '\0';
+}
+/**
+ * parse_size - Parses a non-negative byte count with an optional k/m/g suffix.
+ *
+ * Suffixes are case-insensitive and scale by 1024, as in git's config.
+ *
+ * @param s     The string to parse.
+ * @param value Output for the number of bytes.
+ * @return True if s was a complete, non-overflowing size, false otherwise.
+ */
+bool parse_size(const char *s, size_t *value){
+    if (!s || !value || *s < '0' || *s > '9') { return false; }
+
+    errno = 0;
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (errno) { return false; }
+
+    unsigned shift = 0;
+    switch (*end){
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+    }
+    if (*end != '\0' || n > (SIZE_MAX >> shift)) { return false; }
+
+    *value = (size_t)n << shift;
+    return true;
+}
+
+/**
+ * map_file - Maps a whole file read-only.
+ *
+ * @param path The file to map.
+ * @param size Output for the file size.
+ * @return The mapping, or NULL if the file cannot be opened or is empty.
+ */
+const unsigned char *map_file(const char *path, size_t *size){
+    int fd = open(path, O_RDONLY);
+    trace_count(TRACE_SYSCALLS, 1);
+    if (fd < 0) { return NULL; }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || sb.st_size == 0){
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    trace_count(TRACE_SYSCALLS, 3);
+    if (map == MAP_FAILED){
+        fprintf(stderr, "map_file: cannot map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    *size = (size_t)sb.st_size;
+    return map;
+}
+
+/**
+ * arena_alloc - Carves memory out of an arena.
+ *
+ * Memory comes from ARENA_BLOCK_SIZE blocks and is 16-byte aligned.
+ * Requests larger than a quarter block get a block of their own so they do
+ * not waste the remainder of the current one. Nothing is freed individually;
+ * arena_clear() releases everything at once.
+ *
+ * @param arena A zero-initialized or cleared arena.
+ * @param size  Bytes wanted.
+ * @return The memory (uninitialized). Exits on allocation failure like safe_malloc().
+ * @note Not thread-safe.
+ */
+void *arena_alloc(Arena *arena, size_t size){
+    size = (size + 15) & ~(size_t)15;
+
+    if (size > ARENA_BLOCK_SIZE / 4){
+        ArenaBlock *block = safe_malloc(sizeof(ArenaBlock) + size, 1);
+        block->size = block->used = size;
+        block->next = arena->large;
+        arena->large = block;
+        arena->allocated += size;
+        return block->data;
+    }
+
+    if (!arena->head || arena->head->size - arena->head->used < size){
+        ArenaBlock *block = safe_malloc(sizeof(ArenaBlock) + ARENA_BLOCK_SIZE, 1);
+        block->size = ARENA_BLOCK_SIZE;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += size;
+    arena->allocated += size;
+    return ptr;
+}
+
+/**
+ * arena_memdup - Copies a buffer into an arena.
+ *
+ * @param arena The arena.
+ * @param data  Bytes to copy.
+ * @param size  Number of bytes.
+ * @return The copy.
+ */
+void *arena_memdup(Arena *arena, const void *data, size_t size){
+    void *ptr = arena_alloc(arena, size ? size : 1);
+    memcpy(ptr, data, size);
+    return ptr;
+}
+
+/**
+ * arena_clear - Frees every block of an arena.
+ *
+ * @param arena The arena; it is left empty and may be reused.
+ */
+void arena_clear(Arena *arena){
+    if (!arena) { return; }
+
+    ArenaBlock *lists[] = { arena->head, arena->large };
+    for (size_t i = 0; i < 2; i++){
+        ArenaBlock *block = lists[i];
+        while (block){
+            ArenaBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * sha_set_insert - Adds a SHA to a set.
+ *
+ * The table doubles whenever it would become more than half full. The null
+ * SHA cannot be stored; it marks free slots.
+ *
+ * @param set A zero-initialized or freed set.
+ * @param sha The SHA to add.
+ * @return True if the SHA was not in the set yet, false if it already was.
+ */
+bool sha_set_insert(ShaSet *set, const unsigned char sha[SHA_SIZE]){
+    if (2 * (set->count + 1) > set->capacity){
+        ShaSet grown = { .capacity = set->capacity ? 2 * set->capacity : 64 };
+        grown.slots = safe_calloc(SHA_SIZE, grown.capacity);
+        static const unsigned char null_sha[SHA_SIZE];
+        for (size_t i = 0; i < set->capacity; i++){
+            if (memcmp(set->slots[i], null_sha, SHA_SIZE) == 0) { continue; }
+            memcpy(grown.slots[sha_set_slot(&grown, set->slots[i])], set->slots[i], SHA_SIZE);
+            grown.count++;
+        }
+        free(set->slots);
+        *set = grown;
+    }
+
+    size_t slot = sha_set_slot(set, sha);
+    if (memcmp(set->slots[slot], sha, SHA_SIZE) == 0) { return false; }
+    memcpy(set->slots[slot], sha, SHA_SIZE);
+    set->count++;
+    return true;
+}
+
+/**
+ * sha_set_contains - Tests whether a SHA is in a set.
+ *
+ * @param set The set.
+ * @param sha The SHA.
+ * @return True if it was inserted before.
+ */
+bool sha_set_contains(const ShaSet *set, const unsigned char sha[SHA_SIZE]){
+    if (!set->capacity) { return false; }
+    return memcmp(set->slots[sha_set_slot(set, sha)], sha, SHA_SIZE) == 0;
+}
+
+/**
+ * sha_set_free - Releases a set's table.
+ *
+ * @param set The set; it is left empty and may be reused.
+ */
+void sha_set_free(ShaSet *set){
+    if (!set) { return; }
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+/**
+ * trace_init - Turns tracing on when GIT_CLONE_TRACE_PERF asks for it.
+ *
+ * "1" or "true" prints a per-phase summary of wall time, syscalls and
+ * inflated bytes to stderr at exit; an absolute path writes a Chrome
+ * trace-event file there instead (load it in chrome://tracing or Perfetto).
+ * Unset, empty, "0" or "false" leave tracing off, so trace_begin() costs a
+ * single load.
+ *
+ * @return true if tracing is on.
+ * @note Call once from main(), before any thread is started.
+ */
+bool trace_init(void){
+    if (trace_enabled) { return true; }
+
+    const char *value = getenv(TRACE_ENV);
+    if (!value || !*value || streq(value, "0") || strcasecmp(value, "false") == 0) { return false; }
+    if (*value == '/'){
+        trace_path = safe_strdup(value);
+    } else if (!streq(value, "1") && strcasecmp(value, "true") != 0){
+        fprintf(stderr, "trace_init: %s must be 1, true or an absolute path\n", TRACE_ENV);
+        return false;
+    }
+
+    trace_origin = trace_now();
+    atexit(trace_report);
+    trace_enabled = true;
+    return true;
+}
+
+/**
+ * trace_push - Opens a span of a phase on the calling thread.
+ *
+ * @return Its start time, 0 when spans are nested deeper than TRACE_DEPTH
+ *         (the span is then not recorded).
+ */
+uint64_t trace_push(TracePhase phase){
+    if (trace_depth == TRACE_DEPTH) { return 0; }
+    TraceFrame *frame = &trace_stack[trace_depth++];
+    frame->phase = phase;
+    memcpy(frame->counters, trace_thread, sizeof(trace_thread));
+    frame->start = trace_now();
+    return frame->start;
+}
+
+/**
+ * trace_pop - Closes the innermost span of the calling thread.
+ *
+ * @param start What trace_push() returned for it.
+ */
+void trace_pop(uint64_t start){
+    if (!trace_depth || trace_stack[trace_depth - 1].start != start) { return; }
+    const TraceFrame *frame = &trace_stack[--trace_depth];
+    uint64_t duration = trace_now() - frame->start;
+
+    uint64_t counters[TRACE_COUNTERS];
+    TraceStats *stats = &trace_stats[frame->phase];
+    atomic_fetch_add_explicit(&stats->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->ns, duration, memory_order_relaxed);
+    for (int c = 0; c < TRACE_COUNTERS; c++){
+        counters[c] = trace_thread[c] - frame->counters[c];
+        atomic_fetch_add_explicit(&stats->counters[c], counters[c], memory_order_relaxed);
+    }
+    if (trace_path) { trace_record(frame, duration, counters); }
+}
+
+/**
+ * trace_add - Adds to a counter of the calling thread and of the process.
+ */
+void trace_add(TraceCounter counter, uint64_t n){
+    trace_thread[counter] += n;
+    atomic_fetch_add_explicit(&trace_totals[counter], n, memory_order_relaxed);
+}
+
+/* Static Functions */
+
+/**
+ * sha_set_slot - Finds the slot holding a SHA, or the free slot it would go in.
+ *
+ * SHAs are uniformly distributed, so their leading bytes are the hash.
+ */
+static size_t sha_set_slot(const ShaSet *set, const unsigned char sha[SHA_SIZE]){
+    static const unsigned char null_sha[SHA_SIZE];
+    size_t mask = set->capacity - 1;
+    size_t slot = get_be32(sha) & mask;
+    while (memcmp(set->slots[slot], null_sha, SHA_SIZE) != 0 && memcmp(set->slots[slot], sha, SHA_SIZE) != 0){
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static uint64_t trace_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * trace_record - Keeps a finished span for the Chrome trace.
+ */
+static void trace_record(const TraceFrame *frame, uint64_t duration, const uint64_t *counters){
+    if (!trace_tid) { trace_tid = atomic_fetch_add(&trace_next_tid, 1) + 1; }
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_event_count == trace_event_capacity && trace_event_capacity < TRACE_EVENT_MAX){
+        trace_event_capacity = trace_event_capacity ? 2 * trace_event_capacity : 4096;
+        trace_events = realloc(trace_events, trace_event_capacity * sizeof(TraceEvent));
+        MALLOC_CHECK(trace_events);
+    }
+    if (trace_event_count < trace_event_capacity){
+        TraceEvent *event = &trace_events[trace_event_count++];
+        event->phase = frame->phase;
+        event->tid = trace_tid;
+        event->start = frame->start - trace_origin;
+        event->duration = duration;
+        memcpy(event->counters, counters, sizeof(event->counters));
+    } else {
+        trace_dropped++;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/**
+ * trace_report - atexit() handler printing the summary or writing the Chrome trace.
+ *
+ * Every phase's time and counters include the phases nested in it (an
+ * object_read that misses the loose objects includes its pack_lookup), so
+ * the rows do not add up to the total line.
+ */
+static void trace_report(void){
+    trace_enabled = false;
+    if (trace_path){
+        FILE *fp = fopen(trace_path, "w");
+        if (!fp){
+            fprintf(stderr, "trace_report: cannot write %s: %s\n", trace_path, strerror(errno));
+        } else {
+            trace_report_chrome(fp);
+            fclose(fp);
+        }
+        free(trace_path);
+        free(trace_events);
+        return;
+    }
+
+    fprintf(stderr, "trace: %-20s %10s %12s %10s %14s\n", "phase", "calls", "wall ms", "syscalls", "inflated");
+    for (int p = 0; p < TRACE_PHASES; p++){
+        const TraceStats *stats = &trace_stats[p];
+        uint64_t calls = atomic_load(&stats->calls);
+        if (!calls) { continue; }
+        fprintf(stderr, "trace: %-20s %10llu %12.3f %10llu %14llu\n", trace_names[p], (unsigned long long)calls,
+                (double)atomic_load(&stats->ns) / 1e6, (unsigned long long)atomic_load(&stats->counters[TRACE_SYSCALLS]),
+                (unsigned long long)atomic_load(&stats->counters[TRACE_INFLATED]));
+    }
+    fprintf(stderr, "trace: %-20s %10s %12.3f %10llu %14llu\n", "total", "", (double)(trace_now() - trace_origin) / 1e6,
+            (unsigned long long)atomic_load(&trace_totals[TRACE_SYSCALLS]), (unsigned long long)atomic_load(&trace_totals[TRACE_INFLATED]));
+}
+
+/**
+ * trace_report_chrome - Writes the recorded spans as complete ("X") trace events.
+ */
+static void trace_report_chrome(FILE *fp){
+    long pid = (long)getpid();
+    fprintf(fp, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&trace_lock);
+    for (size_t i = 0; i < trace_event_count; i++){
+        const TraceEvent *event = &trace_events[i];
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"git_clone\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"args\":{\"syscalls\":%llu,\"inflated\":%llu}},\n",
+                trace_names[event->phase], pid, event->tid, (double)event->start / 1e3, (double)event->duration / 1e3,
+                (unsigned long long)event->counters[TRACE_SYSCALLS], (unsigned long long)event->counters[TRACE_INFLATED]);
+    }
+    /* a closing metadata event, so the list never ends with a comma */
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"git_clone\"}}\n],\n", pid);
+    fprintf(fp, "\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%zu,\"wall_ns\":%llu,\"syscalls\":%llu,\"inflated\":%llu}}\n",
+            trace_dropped, (unsigned long long)(trace_now() - trace_origin),
+            (unsigned long long)atomic_load(&trace_totals[TRACE_SYSCALLS]), (unsigned long long)atomic_load(&trace_totals[TRACE_INFLATED]));
+    pthread_mutex_unlock(&trace_lock);
+}
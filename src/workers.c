@@ -0,0 +1,116 @@
+/* workers.c: fixed-size thread pool for data-parallel jobs */
+
+#include "workers.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* Structures */
+
+typedef struct {
+    WorkerFn       fn;
+    void          *ctx;
+    size_t         jobs;
+    atomic_size_t  next;
+} WorkerQueue;
+
+/* Forward Declaration of static Functions */
+
+static void *worker_main(void *arg);
+
+/* Functions */
+
+/**
+ * workers_default_count - Returns the number of online CPUs.
+ *
+ * @return The CPU count, or 1 if it cannot be determined.
+ */
+size_t workers_default_count(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+}
+
+/**
+ * workers_parse_count - Parses a thread count given on the command line.
+ *
+ * @param s The count as a string; "0" means one thread per CPU.
+ * @return The thread count, or 0 if s is not a non-negative integer.
+ */
+size_t workers_parse_count(const char *s){
+    if (!s || !*s) { return 0; }
+
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*end != '\0' || n < 0) { return 0; }
+    return n == 0 ? workers_default_count() : (size_t)n;
+}
+
+/**
+ * workers_run - Runs fn(ctx, i) for every i in [0, jobs) on a pool of threads.
+ *
+ * Jobs are handed out one index at a time from a shared atomic counter, so
+ * uneven job costs balance themselves across the pool. The call returns
+ * once every job has completed. With one thread or one job everything runs
+ * on the calling thread.
+ *
+ * @param threads Maximum number of threads to use.
+ * @param jobs    Number of jobs.
+ * @param fn      Job function; it must be safe to call concurrently.
+ * @param ctx     Opaque pointer passed to every call.
+ * @return True once all jobs ran, false if fn is NULL.
+ * @note If threads cannot be started, the ones that did (or the calling
+ * thread) carry the remaining work.
+ */
+bool workers_run(size_t threads, size_t jobs, WorkerFn fn, void *ctx){
+    if (!fn) { return false; }
+
+    WorkerQueue queue = { .fn = fn, .ctx = ctx, .jobs = jobs };
+    atomic_init(&queue.next, 0);
+
+    threads = min(threads, jobs);
+    if (threads <= 1){
+        worker_main(&queue);
+        return true;
+    }
+
+    pthread_t *tids = safe_calloc(sizeof(pthread_t), threads);
+    size_t started = 0;
+    for (; started < threads; started++){
+        if (pthread_create(&tids[started], NULL, worker_main, &queue) != 0) { break; }
+    }
+
+    if (started == 0){
+        worker_main(&queue);
+    }
+    for (size_t i = 0; i < started; i++){
+        pthread_join(tids[i], NULL);
+    }
+
+    free(tids);
+    return true;
+}
+
+/* Static Functions */
+
+/**
+ * worker_main - Thread body: claims job indices until the queue is drained.
+ *
+ * @param arg The shared WorkerQueue.
+ * @return NULL.
+ */
+static void *worker_main(void *arg){
+    WorkerQueue *queue = arg;
+
+    for (;;){
+        size_t i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->jobs) { break; }
+        queue->fn(queue->ctx, i);
+    }
+    return NULL;
+}
@@ -0,0 +1,214 @@
+/* fixtures.c: helpers shared by the unit tests */
+
+#include "fixtures.h"
+#include "repack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Functions */
+
+/**
+ * write_file - Replaces a file with the given bytes.
+ *
+ * @param path Path of the file.
+ * @param data The new contents.
+ * @param len  Number of bytes in data.
+ */
+void write_file(const char *path, const void *data, size_t len){
+    FILE *fp = safe_fopen(path, "wb");
+    assert(fwrite(data, 1, len, fp) == len);
+    fclose(fp);
+}
+
+/**
+ * write_text - Replaces a file with the given text.
+ *
+ * @param path Path of the file.
+ * @param text The new contents.
+ */
+void write_text(const char *path, const char *text){
+    write_file(path, text, strlen(text));
+}
+
+/**
+ * write_old_text - Replaces a file with text dated well in the past.
+ *
+ * The file is backdated so that index entries made from it are never
+ * racily clean.
+ *
+ * @param path Path of the file.
+ * @param text The new contents.
+ */
+void write_old_text(const char *path, const char *text){
+    write_text(path, text);
+
+    struct timespec times[2];
+    clock_gettime(CLOCK_REALTIME, &times[0]);
+    times[0].tv_sec -= 100;
+    times[1] = times[0];
+    assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+}
+
+/**
+ * write_blob - Stores a blob.
+ *
+ * @param repo The repository.
+ * @param data The blob body.
+ * @param len  Number of bytes in data.
+ * @param sha  Output for the blob's SHA.
+ */
+void write_blob(Repository *repo, const void *data, size_t len, unsigned char sha[SHA_SIZE]){
+    assert(object_write_buffer(repo, OBJ_BLOB, data, len, sha) == true);
+}
+
+/**
+ * write_blobs - Stores count small blobs, "<prefix> <i>\n" each.
+ *
+ * @param repo   The repository.
+ * @param prefix Text that sets the blobs of one call apart from the others.
+ * @param count  Number of blobs.
+ * @param shas   Output for their SHAs, in order.
+ */
+void write_blobs(Repository *repo, const char *prefix, size_t count, unsigned char (*shas)[SHA_SIZE]){
+    for (size_t i = 0; i < count; i++){
+        char body[64];
+        int n = sprintf(body, "%s %zu\n", prefix, i);
+        assert(object_write_buffer(repo, OBJ_BLOB, body, (size_t)n, shas[i]) == true);
+    }
+}
+
+/**
+ * write_tree - Stores a tree of the given entries.
+ *
+ * @param repo   The repository.
+ * @param leaves The entries, already in tree order.
+ * @param count  Number of entries.
+ * @param sha    Output for the tree's SHA.
+ */
+void write_tree(Repository *repo, const Leaf *leaves, size_t count, unsigned char sha[SHA_SIZE]){
+    size_t cap = 64 * count + 64, len = 0;
+    unsigned char *body = safe_malloc(cap, 1);
+    for (size_t i = 0; i < count; i++){
+        len += (size_t)sprintf((char *)body + len, "%o %s", leaves[i].mode, leaves[i].name) + 1;
+        memcpy(body + len, leaves[i].sha, SHA_SIZE);
+        len += SHA_SIZE;
+    }
+    assert(object_write_buffer(repo, OBJ_TREE, body, len, sha) == true);
+    free(body);
+}
+
+/**
+ * add_file - Stages a worktree file, hashing it into the object store.
+ *
+ * @param repo  The repository.
+ * @param index The index to add the entry to.
+ * @param top   Directory the name is relative to.
+ * @param name  The entry's name, relative to top.
+ */
+void add_file(Repository *repo, Index *index, const char *top, const char *name){
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", top, name);
+    struct stat sb;
+    assert(lstat(path, &sb) == 0);
+
+    IndexEntry entry = { 0 };
+    index_entry_set_stat(&entry, &sb);
+    entry.name = name;
+    entry.name_len = (uint32_t)strlen(name);
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0 && object_hash_fd(repo, fd, OBJ_BLOB, entry.sha) == true);
+    close(fd);
+    assert(index_add(index, &entry) != NULL);
+}
+
+/**
+ * write_ref - Points a loose ref at an object.
+ *
+ * @param repo The repository.
+ * @param name Full ref name, e.g. "refs/heads/master".
+ * @param sha  The object the ref names.
+ */
+void write_ref(Repository *repo, const char *name, const unsigned char sha[SHA_SIZE]){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    char *path = repo_file(repo, true, name, NULL);
+    FILE *fp = safe_fopen(path, "w");
+    fprintf(fp, "%s\n", hex);
+    fclose(fp);
+    free(path);
+}
+
+/**
+ * pack_loose - Packs every new loose object and prunes the loose copies.
+ *
+ * @param repo The repository; at least one loose object must be new.
+ * @param name Output for the new pack's name, or NULL.
+ */
+void pack_loose(Repository *repo, char name[SHA_HEX_SIZE]){
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true };
+    RepackResult result;
+    assert(repack_loose(repo, &options, &result) == true && result.name[0]);
+    if (name) { memcpy(name, result.name, SHA_HEX_SIZE); }
+}
+
+/**
+ * make_commit - Stores a commit authored and committed at the given date.
+ *
+ * Every commit gets its own message, so two with the same tree, parents
+ * and date still differ.
+ *
+ * @param repo    The repository.
+ * @param tree    The commit's tree.
+ * @param parents The parents, or NULL when count is 0.
+ * @param count   Number of parents.
+ * @param date    Author and committer date, in seconds.
+ * @param sha     Output for the commit's SHA.
+ */
+void make_commit(Repository *repo, const unsigned char tree[SHA_SIZE], unsigned char (*parents)[SHA_SIZE],
+                 size_t count, unsigned long date, unsigned char sha[SHA_SIZE]){
+    static unsigned serial;
+    char body[1024], hex[SHA_HEX_SIZE];
+    sha_to_hex(tree, hex);
+    int n = sprintf(body, "tree %s\n", hex);
+    for (size_t i = 0; i < count; i++){
+        sha_to_hex(parents[i], hex);
+        n += sprintf(body + n, "parent %s\n", hex);
+    }
+    n += sprintf(body + n, "author A <a@example.com> %lu +0000\ncommitter A <a@example.com> %lu +0000\n\nc%u\n", date, date, serial++);
+    assert(object_write_buffer(repo, OBJ_COMMIT, body, (size_t)n, sha) == true);
+}
+
+/**
+ * make_history - Stores a small history over the empty tree.
+ *
+ * r <- a <- b, r <- c, r <- d, o = octopus(b, c, d), h <- o; c and d
+ * share a date. shas receives r, a, b, c, d, o, h in that order and
+ * refs/heads/master points at h.
+ *
+ * @param repo The repository.
+ * @param tree Output for the empty tree's SHA.
+ * @param shas Output for the commits' SHAs.
+ */
+void make_history(Repository *repo, unsigned char tree[SHA_SIZE], unsigned char shas[7][SHA_SIZE]){
+    enum { R, A, B, C, D, O, H };
+    assert(object_write_buffer(repo, OBJ_TREE, "", 0, tree) == true);
+    make_commit(repo, tree, NULL, 0, 100, shas[R]);
+    make_commit(repo, tree, &shas[R], 1, 200, shas[A]);
+    make_commit(repo, tree, &shas[A], 1, 300, shas[B]);
+    make_commit(repo, tree, &shas[R], 1, 250, shas[C]);
+    make_commit(repo, tree, &shas[R], 1, 250, shas[D]);
+    unsigned char octopus[3][SHA_SIZE];
+    memcpy(octopus[0], shas[B], SHA_SIZE);
+    memcpy(octopus[1], shas[C], SHA_SIZE);
+    memcpy(octopus[2], shas[D], SHA_SIZE);
+    make_commit(repo, tree, octopus, 3, 400, shas[O]);
+    make_commit(repo, tree, &shas[O], 1, 500, shas[H]);
+    write_ref(repo, "refs/heads/master", shas[H]);
+}
@@ -0,0 +1,38 @@
+/* fixtures.h: helpers shared by the unit tests */
+
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include "index.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Structures */
+
+typedef struct {
+    uint32_t      mode;
+    const char    *name;
+    unsigned char sha[SHA_SIZE];
+} Leaf;
+
+/* Functions */
+
+void write_file(const char *path, const void *data, size_t len);
+void write_text(const char *path, const char *text);
+void write_old_text(const char *path, const char *text);
+void write_blob(Repository *repo, const void *data, size_t len, unsigned char sha[SHA_SIZE]);
+void write_blobs(Repository *repo, const char *prefix, size_t count, unsigned char (*shas)[SHA_SIZE]);
+void write_tree(Repository *repo, const Leaf *leaves, size_t count, unsigned char sha[SHA_SIZE]);
+void add_file(Repository *repo, Index *index, const char *top, const char *name);
+void write_ref(Repository *repo, const char *name, const unsigned char sha[SHA_SIZE]);
+void pack_loose(Repository *repo, char name[SHA_HEX_SIZE]);
+void make_commit(Repository *repo, const unsigned char tree[SHA_SIZE], unsigned char (*parents)[SHA_SIZE],
+                 size_t count, unsigned long date, unsigned char sha[SHA_SIZE]);
+void make_history(Repository *repo, unsigned char tree[SHA_SIZE], unsigned char shas[7][SHA_SIZE]);
+
+#endif
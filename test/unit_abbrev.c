@@ -0,0 +1,246 @@
+/* unit_abbrev.c: unit test abbreviated object name functions */
+
+#include "abbrev.h"
+#include "midx.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Macros */
+
+#define BLOBS   2000                    /* enough for several pairs to share four digits */
+
+/* Helpers */
+
+static size_t shared_nibbles(const unsigned char *a, const unsigned char *b){
+    size_t n = 0;
+    while (n < 2 * SHA_SIZE && ((a[n / 2] >> (n % 2 ? 0 : 4)) & 0xf) == ((b[n / 2] >> (n % 2 ? 0 : 4)) & 0xf)) { n++; }
+    return n;
+}
+
+/* The unique length of shas[index] found by comparing it to every other object */
+static size_t brute_unique_len(unsigned char (*shas)[SHA_SIZE], size_t count, size_t index, size_t min_len){
+    size_t len = min_len;
+    for (size_t i = 0; i < count; i++){
+        if (memcmp(shas[i], shas[index], SHA_SIZE) == 0) { continue; }
+        size_t common = shared_nibbles(shas[i], shas[index]);
+        if (common + 1 > len) { len = common + 1; }
+    }
+    return len;
+}
+
+/* Finds two objects sharing at least ABBREV_MIN_LEN digits; returns how many they share */
+static size_t find_pair(unsigned char (*shas)[SHA_SIZE], size_t count, size_t *first, size_t *second){
+    size_t best = 0;
+    for (size_t i = 0; i < count; i++){
+        for (size_t j = i + 1; j < count; j++){
+            size_t common = shared_nibbles(shas[i], shas[j]);
+            if (common > best) { best = common; *first = i; *second = j; }
+        }
+    }
+    return best;
+}
+
+/* Checks every way of naming shas against the repository */
+static void check_names(Repository *repo, unsigned char (*shas)[SHA_SIZE], size_t count){
+    for (size_t i = 0; i < count; i++){
+        char hex[SHA_HEX_SIZE];
+        sha_to_hex(shas[i], hex);
+        size_t len = abbrev_unique_len(repo, shas[i], ABBREV_MIN_LEN);
+        assert(len == brute_unique_len(shas, count, i, ABBREV_MIN_LEN));
+        unsigned char found[SHA_SIZE];
+        assert(abbrev_resolve(repo, hex, len, OBJ_NONE, found) == ABBREV_UNIQUE);
+        assert(memcmp(found, shas[i], SHA_SIZE) == 0);
+        if (len > ABBREV_MIN_LEN) { assert(abbrev_resolve(repo, hex, len - 1, OBJ_NONE, found) == ABBREV_AMBIGUOUS); }
+        assert(abbrev_resolve(repo, hex, 2 * SHA_SIZE, OBJ_NONE, found) == ABBREV_UNIQUE);
+    }
+}
+
+/* Tests */
+
+int test_00_abbrev_loose(){
+    printf("Running loose abbreviation tests...\n");
+
+    Repository *repo = repo_init("test_abbrev_loose");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(BLOBS + 1, SHA_SIZE);
+    write_blobs(repo, "loose", BLOBS, shas);
+
+    // Test 1: Every object resolves from its unique length, and not one digit less
+    check_names(repo, shas, BLOBS);
+    printf("Test 1 Passed: Unique lengths\n");
+
+    // Test 2: Objects sharing a prefix are ambiguous until they differ
+    size_t first = 0, second = 0, common = find_pair(shas, BLOBS, &first, &second);
+    assert(common >= ABBREV_MIN_LEN);
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(shas[first], hex);
+    unsigned char found[SHA_SIZE];
+    assert(abbrev_resolve(repo, hex, common, OBJ_NONE, found) == ABBREV_AMBIGUOUS);
+    AbbrevMatches matches = { 0 };
+    assert(abbrev_matches(repo, hex, common, SIZE_MAX, &matches) == true && matches.count >= 2);
+    abbrev_matches_free(&matches);
+    assert(abbrev_resolve(repo, hex, common + 1, OBJ_NONE, found) == ABBREV_UNIQUE);
+    assert(memcmp(found, shas[first], SHA_SIZE) == 0);
+    printf("Test 2 Passed: Ambiguous prefix\n");
+
+    // Test 3: Short, overlong and non-hex prefixes are rejected
+    assert(abbrev_resolve(repo, hex, ABBREV_MIN_LEN - 1, OBJ_NONE, found) == ABBREV_NONE);
+    assert(abbrev_matches(repo, "zzzzzz", 6, SIZE_MAX, &matches) == false);
+    assert(abbrev_matches(repo, hex, 2 * SHA_SIZE + 1, SIZE_MAX, &matches) == false);
+    assert(matches.count == 0);
+    printf("Test 3 Passed: Invalid prefixes\n");
+
+    // Test 4: An object written after a lookup is found in the refreshed listing
+    char body[] = "written later\n";
+    assert(object_write_buffer(repo, OBJ_BLOB, body, strlen(body), shas[BLOBS]) == true);
+    sha_to_hex(shas[BLOBS], hex);
+    assert(abbrev_resolve(repo, hex, 12, OBJ_NONE, found) == ABBREV_UNIQUE);
+    assert(memcmp(found, shas[BLOBS], SHA_SIZE) == 0);
+    check_names(repo, shas, BLOBS + 1);
+    printf("Test 4 Passed: Cache refresh\n");
+
+    free(shas);
+    repo_destroy(repo);
+
+    printf("\nAll loose abbreviation tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_abbrev_packed(){
+    printf("Running packed abbreviation tests...\n");
+
+    Repository *repo = repo_init("test_abbrev_packed");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(2 * BLOBS, SHA_SIZE);
+    write_blobs(repo, "packed", BLOBS, shas);
+    pack_loose(repo, NULL);
+
+    // Test 1: Objects of one pack
+    check_names(repo, shas, BLOBS);
+    printf("Test 1 Passed: Single pack\n");
+
+    // Test 2: Objects spread over two packs and loose
+    write_blobs(repo, "second", BLOBS / 2, shas + BLOBS);
+    pack_loose(repo, NULL);
+    write_blobs(repo, "late", BLOBS / 2, shas + BLOBS + BLOBS / 2);
+    check_names(repo, shas, 2 * BLOBS);
+    printf("Test 2 Passed: Packs and loose objects\n");
+
+    // Test 3: Objects behind a multi-pack-index
+    assert(midx_write(repo, NULL) == true);
+    repo_destroy(repo);
+    repo = repo_find("test_abbrev_packed", true);
+    assert(repo != NULL);
+    check_names(repo, shas, 2 * BLOBS);
+    printf("Test 3 Passed: Multi-pack-index\n");
+
+    free(shas);
+    repo_destroy(repo);
+
+    printf("\nAll packed abbreviation tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_abbrev_type(){
+    printf("Running abbreviation disambiguation tests...\n");
+
+    Repository *repo = repo_init("test_abbrev_type");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(BLOBS, SHA_SIZE);
+    write_blobs(repo, "typed", BLOBS, shas);
+    unsigned char tree[SHA_SIZE], commit[SHA_SIZE], found[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_TREE, "", 0, tree) == true);
+    char tree_hex[SHA_HEX_SIZE], hex[SHA_HEX_SIZE];
+    sha_to_hex(tree, tree_hex);
+
+    // Test 1: A commit sharing four digits with a blob is chosen as a commit-ish
+    size_t blob = BLOBS;
+    for (size_t n = 0; n < 100000 && blob == BLOBS; n++){
+        char body[256];
+        int len = sprintf(body, "tree %s\nauthor A <a@b> 0 +0000\ncommitter A <a@b> 0 +0000\n\nattempt %zu\n", tree_hex, n);
+        assert(object_write_buffer(repo, OBJ_COMMIT, body, (size_t)len, commit) == true);
+        for (size_t i = 0; i < BLOBS && blob == BLOBS; i++){
+            if (shared_nibbles(shas[i], commit) >= ABBREV_MIN_LEN) { blob = i; }
+        }
+    }
+    assert(blob < BLOBS);
+    sha_to_hex(commit, hex);
+    assert(abbrev_resolve(repo, hex, ABBREV_MIN_LEN, OBJ_NONE, found) == ABBREV_AMBIGUOUS);
+    assert(abbrev_resolve(repo, hex, ABBREV_MIN_LEN, OBJ_COMMIT, found) == ABBREV_UNIQUE);
+    assert(memcmp(found, commit, SHA_SIZE) == 0);
+    printf("Test 1 Passed: Commit-ish\n");
+
+    // Test 2: A type that neither object has leaves the prefix ambiguous
+    assert(abbrev_resolve(repo, hex, ABBREV_MIN_LEN, OBJ_TAG, found) == ABBREV_AMBIGUOUS);
+    printf("Test 2 Passed: No match of the type\n");
+
+    free(shas);
+    repo_destroy(repo);
+
+    printf("\nAll abbreviation disambiguation tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_03_abbrev_default_len(){
+    printf("Running default abbreviation length tests...\n");
+
+    Repository *repo = repo_init("test_abbrev_len");
+    assert(repo != NULL);
+    repo_destroy(repo);
+    repo = repo_find("test_abbrev_len", true);
+    assert(repo != NULL && repo->config != NULL);
+
+    // Test 1: Small repositories use seven digits
+    assert(abbrev_default_len(repo) == ABBREV_DEFAULT_LEN);
+    assert(abbrev_default_len(NULL) == ABBREV_DEFAULT_LEN);
+    printf("Test 1 Passed: Automatic length\n");
+
+    // Test 2: core.abbrev is used when numeric and clamped
+    assert(config_set(repo->config, "core.abbrev", "12") == true);
+    assert(abbrev_default_len(repo) == 12);
+    assert(config_set(repo->config, "core.abbrev", "2") == true);
+    assert(abbrev_default_len(repo) == ABBREV_MIN_LEN);
+    assert(config_set(repo->config, "core.abbrev", "99") == true);
+    assert(abbrev_default_len(repo) == 2 * SHA_SIZE);
+    assert(config_set(repo->config, "core.abbrev", "auto") == true);
+    assert(abbrev_default_len(repo) == ABBREV_DEFAULT_LEN);
+    printf("Test 2 Passed: core.abbrev\n");
+
+    repo_destroy(repo);
+
+    printf("\nAll default abbreviation length tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test loose abbreviations\n");
+        fprintf(stderr, "    1. Test packed abbreviations\n");
+        fprintf(stderr, "    2. Test abbreviation disambiguation\n");
+        fprintf(stderr, "    3. Test default abbreviation length\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_abbrev_loose(); break;
+        case 1:  status = test_01_abbrev_packed(); break;
+        case 2:  status = test_02_abbrev_type(); break;
+        case 3:  status = test_03_abbrev_default_len(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
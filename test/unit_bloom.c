@@ -0,0 +1,264 @@
+/* unit_bloom.c: unit test changed-path Bloom filter functions */
+
+#include "bloom.h"
+#include "commit_graph.h"
+#include "objects.h"
+#include "repository.h"
+#include "revwalk.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static bool has_path(const BloomPaths *paths, const char *path){
+    for (size_t i = 0; i < paths->count; i++){
+        if (streq(paths->names + paths->offsets[i], path)) { return true; }
+    }
+    return false;
+}
+
+enum { C1, C2, C3, C4, S, M };
+
+/*
+ * c1 <- c2 <- c3 <- c4 <- m, c3 <- s <- m
+ * c2 changes a, c3 changes d/x, c4 changes nothing, s adds b
+ */
+static void make_path_history(Repository *repo, unsigned char trees[4][SHA_SIZE], unsigned char shas[6][SHA_SIZE]){
+    unsigned char a1[SHA_SIZE], a2[SHA_SIZE], b1[SHA_SIZE], x1[SHA_SIZE], x2[SHA_SIZE], d0[SHA_SIZE], d1[SHA_SIZE];
+    write_blob(repo, "a1\n", 3, a1);
+    write_blob(repo, "a2\n", 3, a2);
+    write_blob(repo, "b1\n", 3, b1);
+    write_blob(repo, "x1\n", 3, x1);
+    write_blob(repo, "x2\n", 3, x2);
+
+    Leaf dir[1] = { { 0100644, "x", { 0 } } };
+    memcpy(dir[0].sha, x1, SHA_SIZE);
+    write_tree(repo, dir, 1, d0);
+    memcpy(dir[0].sha, x2, SHA_SIZE);
+    write_tree(repo, dir, 1, d1);
+
+    Leaf root[3] = { { 0100644, "a", { 0 } }, { 040000, "d", { 0 } } };
+    memcpy(root[0].sha, a1, SHA_SIZE);
+    memcpy(root[1].sha, d0, SHA_SIZE);
+    write_tree(repo, root, 2, trees[0]);
+    memcpy(root[0].sha, a2, SHA_SIZE);
+    write_tree(repo, root, 2, trees[1]);
+    memcpy(root[1].sha, d1, SHA_SIZE);
+    write_tree(repo, root, 2, trees[2]);
+    root[2] = root[1];
+    root[1] = (Leaf){ 0100644, "b", { 0 } };
+    memcpy(root[1].sha, b1, SHA_SIZE);
+    write_tree(repo, root, 3, trees[3]);
+
+    make_commit(repo, trees[0], NULL, 0, 100, shas[C1]);
+    make_commit(repo, trees[1], &shas[C1], 1, 200, shas[C2]);
+    make_commit(repo, trees[2], &shas[C2], 1, 300, shas[C3]);
+    make_commit(repo, trees[2], &shas[C3], 1, 400, shas[C4]);
+    make_commit(repo, trees[3], &shas[C3], 1, 450, shas[S]);
+    unsigned char parents[2][SHA_SIZE];
+    memcpy(parents[0], shas[C4], SHA_SIZE);
+    memcpy(parents[1], shas[S], SHA_SIZE);
+    make_commit(repo, trees[3], parents, 2, 500, shas[M]);
+
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(shas[M], hex);
+    char *path = repo_file(repo, true, "refs", "heads", "master", NULL);
+    FILE *fp = safe_fopen(path, "w");
+    fprintf(fp, "%s\n", hex);
+    fclose(fp);
+    free(path);
+}
+
+/* Walks from m limited to one path, returning how many filters ruled out a comparison */
+static size_t check_log(Repository *repo, unsigned char shas[6][SHA_SIZE], const char *path, const int *expected, size_t count){
+    RevWalk walk;
+    revwalk_init(&walk, repo);
+    char *paths[1] = { (char *)path };
+    revwalk_limit_paths(&walk, paths, 1);
+    assert(revwalk_push(&walk, shas[M]) == true);
+
+    RevCommit commit;
+    size_t n = 0;
+    while (revwalk_next(&walk, &commit)){
+        assert(n < count);
+        assert(memcmp(commit.sha, shas[expected[n]], SHA_SIZE) == 0);
+        n++;
+    }
+    assert(n == count && walk.error == false);
+    size_t skipped = walk.bloom_skipped;
+    revwalk_release(&walk);
+    return skipped;
+}
+
+/* Tests */
+
+int test_00_bloom_filter(){
+    printf("Running Bloom filter tests...\n");
+
+    // Test 1: Hashes and keys match git's
+    assert(bloom_murmur3(0, "", 0) == 0);
+    assert(bloom_murmur3(0, "Hello world!", 12) == 0x627b0c2cu);
+    assert(bloom_murmur3(0, "The quick brown fox jumps over the lazy dog", 43) == 0x2e4ff723u);
+    BloomKey key;
+    bloom_key(&key, "", 0);
+    const uint32_t empty[BLOOM_NUM_HASHES] = { 0x5615800c, 0x5b966560, 0x61174ab4, 0x66983008, 0x6c19155c, 0x7199fab0, 0x771ae004 };
+    assert(memcmp(key.hashes, empty, sizeof(empty)) == 0);
+    printf("Test 1 Passed: Hashes\n");
+
+    // Test 2: Added keys are always found, others mostly not
+    unsigned char data[64] = { 0 };
+    char path[32];
+    for (int i = 0; i < 40; i++){
+        sprintf(path, "dir/file%d", i);
+        bloom_key(&key, path, strlen(path));
+        bloom_add(data, sizeof(data), &key);
+    }
+    BloomFilter filter = { data, sizeof(data) };
+    size_t misses = 0;
+    for (int i = 0; i < 40; i++){
+        sprintf(path, "dir/file%d", i);
+        bloom_key(&key, path, strlen(path));
+        assert(bloom_maybe_contains(&filter, &key) == true);
+        sprintf(path, "other/file%d", i);
+        bloom_key(&key, path, strlen(path));
+        misses += !bloom_maybe_contains(&filter, &key);
+    }
+    assert(misses > 30);
+    filter.len = 0;
+    assert(bloom_maybe_contains(&filter, &key) == true);
+    printf("Test 2 Passed: Add and test\n");
+
+    // Test 3: Changed paths list files and their directories
+    Repository *repo = repo_init("test_bloom");
+    assert(repo != NULL);
+    unsigned char trees[4][SHA_SIZE], shas[6][SHA_SIZE];
+    make_path_history(repo, trees, shas);
+    BloomPaths paths = { 0 };
+    assert(bloom_changed_paths(repo, NULL, trees[0], &paths) == true);
+    assert(paths.count == 3 && paths.changes == 2);
+    assert(has_path(&paths, "a") && has_path(&paths, "d") && has_path(&paths, "d/x"));
+    assert(bloom_changed_paths(repo, trees[1], trees[2], &paths) == true);
+    assert(paths.count == 2 && paths.changes == 1 && has_path(&paths, "d") && has_path(&paths, "d/x"));
+    assert(bloom_changed_paths(repo, trees[2], trees[3], &paths) == true);
+    assert(paths.count == 1 && has_path(&paths, "b"));
+
+    unsigned char *bits;
+    size_t len = bloom_filter_build(&paths, &bits);
+    assert(len == 2);
+    filter = (BloomFilter){ bits, len };
+    bloom_key(&key, "b", 1);
+    assert(bloom_maybe_contains(&filter, &key) == true);
+    free(bits);
+    printf("Test 3 Passed: Changed paths\n");
+
+    // Test 4: No change gives one zero byte, too many one full byte
+    assert(bloom_changed_paths(repo, trees[2], trees[2], &paths) == true);
+    assert(paths.count == 0 && bloom_filter_build(&paths, &bits) == 1 && bits[0] == 0);
+    free(bits);
+
+    Leaf *leaves = safe_calloc(sizeof(Leaf), BLOOM_MAX_CHANGED_PATHS + 1);
+    char (*names)[8] = safe_malloc(8, BLOOM_MAX_CHANGED_PATHS + 1);
+    for (size_t i = 0; i <= BLOOM_MAX_CHANGED_PATHS; i++){
+        sprintf(names[i], "f%04zu", i);
+        leaves[i].mode = 0100644;
+        leaves[i].name = names[i];
+        write_blob(repo, names[i], strlen(names[i]), leaves[i].sha);
+    }
+    unsigned char big[SHA_SIZE];
+    write_tree(repo, leaves, BLOOM_MAX_CHANGED_PATHS + 1, big);
+    assert(bloom_changed_paths(repo, NULL, big, &paths) == true);
+    assert(paths.changes > BLOOM_MAX_CHANGED_PATHS);
+    assert(bloom_filter_build(&paths, &bits) == 1 && bits[0] == 0xff);
+    free(bits);
+    free(names);
+    free(leaves);
+    printf("Test 4 Passed: Empty and large filters\n");
+
+    bloom_paths_clear(&paths);
+    repo_destroy(repo);
+    remove_directory("test_bloom");
+
+    printf("\nAll Bloom filter tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_bloom_log(){
+    printf("Running path-limited log tests...\n");
+
+    Repository *repo = repo_init("test_bloom");
+    assert(repo != NULL);
+    unsigned char trees[4][SHA_SIZE], shas[6][SHA_SIZE];
+    make_path_history(repo, trees, shas);
+
+    const int only_a[] = { C2, C1 }, only_b[] = { S }, only_d[] = { C3, C1 }, all[] = { M, S, C4, C3, C2, C1 };
+
+    // Test 1: History is simplified without a commit-graph
+    assert(check_log(repo, shas, "a", only_a, 2) == 0);
+    assert(check_log(repo, shas, "b", only_b, 1) == 0);
+    assert(check_log(repo, shas, "d", only_d, 2) == 0);
+    assert(check_log(repo, shas, "./d//x/", only_d, 2) == 0);
+    assert(check_log(repo, shas, ".", all, 6) == 0);
+    printf("Test 1 Passed: Simplified history\n");
+
+    // Test 2: Every commit gets a filter
+    CommitGraphStats stats;
+    assert(commit_graph_write(repo, true, &stats) == true);
+    assert(stats.commits == 6 && stats.filters == 6 && stats.filters_large == 0);
+    commit_graph_free(repo);
+    CommitGraph *graph = commit_graph_load(repo);
+    assert(graph != NULL && graph->bloom_index != NULL);
+    uint32_t pos;
+    BloomFilter filter;
+    assert(commit_graph_find(graph, shas[C4], &pos) == true);
+    assert(commit_graph_bloom(graph, pos, &filter) == true && filter.len == 1 && filter.data[0] == 0);
+    assert(commit_graph_find(graph, shas[C1], &pos) == true);
+    assert(commit_graph_bloom(graph, pos, &filter) == true && filter.len == 4);
+    printf("Test 2 Passed: Filters written\n");
+
+    // Test 3: The filters skip tree reads and the answers do not change
+    assert(check_log(repo, shas, "a", only_a, 2) > 0);
+    assert(check_log(repo, shas, "b", only_b, 1) > 0);
+    assert(check_log(repo, shas, "d/x", only_d, 2) > 0);
+    assert(check_log(repo, shas, "missing", NULL, 0) > 0);
+    printf("Test 3 Passed: Filtered history\n");
+
+    // Test 4: A graph written without filters still answers
+    assert(commit_graph_write(repo, false, &stats) == true && stats.filters == 0);
+    commit_graph_free(repo);
+    graph = commit_graph_load(repo);
+    assert(graph != NULL && graph->bloom_index == NULL);
+    assert(check_log(repo, shas, "d", only_d, 2) == 0);
+    printf("Test 4 Passed: Graph without filters\n");
+
+    repo_destroy(repo);
+    remove_directory("test_bloom");
+
+    printf("\nAll path-limited log tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test Bloom filter\n");
+        fprintf(stderr, "    1. Test path-limited log\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_bloom_filter(); break;
+        case 1:  status = test_01_bloom_log(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
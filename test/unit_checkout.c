@@ -0,0 +1,160 @@
+/* unit_checkout.c: unit test checkout functions */
+
+#include "checkout.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Helpers */
+
+static bool file_is(const char *path, const void *data, size_t len){
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { return false; }
+    unsigned char *buf = safe_malloc(len + 1, 1);
+    size_t n = fread(buf, 1, len + 1, fp);
+    fclose(fp);
+    bool same = n == len && memcmp(buf, data, len) == 0;
+    free(buf);
+    return same;
+}
+
+/* Tests */
+
+int test_00_checkout_tree(){
+    printf("Running checkout tree tests...\n");
+
+    Repository *repo = repo_init("test_checkout");
+    assert(repo != NULL);
+
+    size_t big_len = 3 * CHECKOUT_WRITE_BUFFER + 12345;
+    unsigned char *big = safe_malloc(big_len, 1);
+    uint32_t x = 1;
+    for (size_t i = 0; i < big_len; i++) { x = x * 1103515245 + 12345; big[i] = (unsigned char)(x >> 24); }
+
+    Leaf sub[2] = { { .mode = 0100755, .name = "run.sh" }, { .mode = 0100644, .name = "z" } };
+    write_blob(repo, "#!/bin/sh\n", 10, sub[0].sha);
+    write_blob(repo, "", 0, sub[1].sha);
+    Leaf top[5] = { { .mode = 0100644, .name = "big" }, { .mode = 0160000, .name = "module" }, { .mode = 040000, .name = "sub" }, { .mode = 0120000, .name = "to-sub" }, { .mode = 0100644, .name = "top.txt" } };
+    write_blob(repo, big, big_len, top[0].sha);
+    memset(top[1].sha, 0xab, SHA_SIZE);
+    write_tree(repo, sub, 2, top[2].sha);
+    write_blob(repo, "sub/run.sh", 10, top[3].sha);
+    write_blob(repo, "top\n", 4, top[4].sha);
+    unsigned char tree[SHA_SIZE];
+    write_tree(repo, top, 5, tree);
+
+    // Test 1: Files, modes, links and directories are written
+    CheckoutStats stats;
+    assert(checkout_tree(repo, tree, "test_checkout/out/nested", 4, &stats) == true);
+    assert(stats.files == 4 && stats.symlinks == 1 && stats.dirs == 2 && stats.threads == 1);
+    assert(stats.bytes == big_len + 14);
+    assert(file_is("test_checkout/out/nested/top.txt", "top\n", 4) && file_is("test_checkout/out/nested/sub/z", "", 0));
+    assert(file_is("test_checkout/out/nested/big", big, big_len));
+    struct stat sb;
+    assert(stat("test_checkout/out/nested/sub/run.sh", &sb) == 0 && (sb.st_mode & S_IXUSR));
+    assert(stat("test_checkout/out/nested/top.txt", &sb) == 0 && !(sb.st_mode & S_IXUSR));
+    char target[64];
+    ssize_t n = readlink("test_checkout/out/nested/to-sub", target, sizeof(target));
+    assert(n == 10 && memcmp(target, "sub/run.sh", 10) == 0);
+    assert(is_directory("test_checkout/out/nested/module") && is_directory_empty("test_checkout/out/nested/module"));
+    printf("Test 1 Passed: Tree written\n");
+
+    // Test 2: A non-empty target is refused
+    assert(checkout_tree(repo, tree, "test_checkout/out/nested", 4, NULL) == false);
+    assert(checkout_tree(repo, tree, "test_checkout/out/nested/top.txt", 4, NULL) == false);
+    printf("Test 2 Passed: Existing content protected\n");
+
+    // Test 3: A missing blob fails the checkout
+    Leaf broken[1] = { { .mode = 0100644, .name = "gone" } };
+    memset(broken[0].sha, 0xcd, SHA_SIZE);
+    unsigned char bad[SHA_SIZE];
+    write_tree(repo, broken, 1, bad);
+    assert(checkout_tree(repo, bad, "test_checkout/bad", 1, &stats) == false && stats.files == 0);
+    assert(checkout_tree(repo, top[0].sha, "test_checkout/blob", 1, NULL) == false);
+    printf("Test 3 Passed: Missing objects reported\n");
+
+    free(big);
+    repo_destroy(repo);
+    remove_directory("test_checkout");
+
+    printf("\nAll checkout tree tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_checkout_parallel(){
+    printf("Running checkout parallel tests...\n");
+
+    Repository *repo = repo_init("test_checkout_par");
+    assert(repo != NULL);
+
+    enum { DIRS = 8, FILES = 64 };
+    char names[DIRS][FILES][16], dir_names[DIRS][8];
+    Leaf dirs[DIRS], files[FILES];
+    for (size_t d = 0; d < DIRS; d++){
+        for (size_t f = 0; f < FILES; f++){
+            /* zero-padded so that name order is numeric order */
+            snprintf(names[d][f], sizeof(names[d][f]), "f%03zu", f);
+            char data[32];
+            int len = snprintf(data, sizeof(data), "%zu/%zu\n", d, f);
+            files[f] = (Leaf){ .mode = 0100644, .name = names[d][f] };
+            write_blob(repo, data, (size_t)len, files[f].sha);
+        }
+        snprintf(dir_names[d], sizeof(dir_names[d]), "d%zu", d);
+        dirs[d] = (Leaf){ .mode = 040000, .name = dir_names[d] };
+        write_tree(repo, files, FILES, dirs[d].sha);
+    }
+    unsigned char tree[SHA_SIZE];
+    write_tree(repo, dirs, DIRS, tree);
+
+    // Test 1: Enough files spread over the requested workers
+    CheckoutStats stats;
+    assert(checkout_tree(repo, tree, "test_checkout_par/out", 4, &stats) == true);
+    assert(stats.files == DIRS * FILES && stats.dirs == DIRS && stats.threads == 4);
+    printf("Test 1 Passed: %zu files on %zu workers\n", stats.files, stats.threads);
+
+    // Test 2: Every file has its own content
+    for (size_t d = 0; d < DIRS; d++){
+        for (size_t f = 0; f < FILES; f++){
+            char path[64], data[32];
+            snprintf(path, sizeof(path), "test_checkout_par/out/d%zu/f%03zu", d, f);
+            int len = snprintf(data, sizeof(data), "%zu/%zu\n", d, f);
+            assert(file_is(path, data, (size_t)len));
+        }
+    }
+    printf("Test 2 Passed: Contents match\n");
+
+    repo_destroy(repo);
+    remove_directory("test_checkout_par");
+
+    printf("\nAll checkout parallel tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test checkout tree\n");
+        fprintf(stderr, "    1. Test checkout parallel\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_checkout_tree(); break;
+        case 1:  status = test_01_checkout_parallel(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,157 @@
+/* unit_commit_graph.c: unit test commit-graph functions */
+
+#include "commit_graph.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+enum { R, A, B, C, D, O, H };         /* the commits of make_history() */
+
+/* Tests */
+
+int test_00_commit_graph_write(){
+    printf("Running commit_graph_write tests...\n");
+
+    Repository *repo = repo_init("test_graph");
+    assert(repo != NULL);
+    unsigned char tree[SHA_SIZE], shas[7][SHA_SIZE];
+    make_history(repo, tree, shas);
+    write_ref(repo, "refs/heads/side", shas[C]);
+
+    // Test 1: Every reachable commit is written, the octopus uses EDGE
+    CommitGraphStats stats;
+    assert(commit_graph_load(repo) == NULL);
+    assert(commit_graph_write(repo, false, &stats) == true);
+    assert(stats.commits == 7 && stats.edges == 2);
+    CommitGraph *graph = commit_graph_load(repo);
+    assert(graph != NULL && graph->count == 7 && graph->edge_count == 2);
+    printf("Test 1 Passed: Graph written and mapped\n");
+
+    // Test 2: Records carry tree, date and topological level
+    const uint32_t levels[7] = { 1, 2, 3, 2, 2, 4, 5 };
+    const uint64_t dates[7] = { 100, 200, 300, 250, 250, 400, 500 };
+    for (size_t i = 0; i < 7; i++){
+        uint32_t pos;
+        CommitGraphCommit commit;
+        assert(commit_graph_find(graph, shas[i], &pos) == true);
+        assert(memcmp(commit_graph_oid(graph, pos), shas[i], SHA_SIZE) == 0);
+        assert(commit_graph_commit(graph, pos, &commit) == true);
+        assert(memcmp(commit.tree, tree, SHA_SIZE) == 0);
+        assert(commit.generation == levels[i] && commit.date == dates[i]);
+    }
+    assert(commit_graph_find(graph, tree, NULL) == false);
+    printf("Test 2 Passed: Commit records\n");
+
+    // Test 3: Parents in order, including octopus edges
+    uint32_t pos, parents[4];
+    assert(commit_graph_find(graph, shas[5], &pos) == true);
+    assert(commit_graph_parents(graph, pos, parents, 4) == 3);
+    for (size_t i = 0; i < 3; i++){
+        assert(memcmp(commit_graph_oid(graph, parents[i]), shas[2 + i], SHA_SIZE) == 0);
+    }
+    assert(commit_graph_parents(graph, pos, parents, 1) == 3);
+    assert(commit_graph_find(graph, shas[0], &pos) == true);
+    assert(commit_graph_parents(graph, pos, parents, 4) == 0);
+    assert(commit_graph_commit(graph, graph->count, &(CommitGraphCommit){0}) == false);
+    printf("Test 3 Passed: Parent lists\n");
+
+    // Test 4: Rewriting drops the stale mapping
+    assert(commit_graph_write(repo, false, NULL) == true);
+    assert(repo->commit_graph == NULL && repo->commit_graph_loaded == false);
+    assert(commit_graph_load(repo) != NULL);
+    printf("Test 4 Passed: Graph reloaded after rewrite\n");
+
+    repo_destroy(repo);
+    remove_directory("test_graph");
+
+    printf("\nAll commit_graph_write tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_commit_graph_malformed(){
+    printf("Running commit_graph malformed tests...\n");
+
+    Repository *repo = repo_init("test_graph_bad");
+    assert(repo != NULL);
+    unsigned char tree[SHA_SIZE], shas[7][SHA_SIZE];
+    make_history(repo, tree, shas);
+    write_ref(repo, "refs/heads/side", shas[C]);
+    assert(commit_graph_write(repo, false, NULL) == true);
+
+    char *path = repo_path(repo, "objects", "info", "commit-graph", NULL);
+    FILE *fp = safe_fopen(path, "rb");
+    unsigned char buf[4096];
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    assert(len > 100);
+
+    char copy[] = "test_graph_bad/graph";
+
+    // Test 1: Bad signature and truncation
+    buf[0] = 'X';
+    fp = safe_fopen(copy, "wb");
+    fwrite(buf, 1, len, fp);
+    fclose(fp);
+    assert(commit_graph_open(copy) == NULL);
+    buf[0] = 'C';
+    fp = safe_fopen(copy, "wb");
+    fwrite(buf, 1, len / 2, fp);
+    fclose(fp);
+    assert(commit_graph_open(copy) == NULL);
+    assert(commit_graph_open("test_graph_bad/none") == NULL);
+    printf("Test 1 Passed: Bad files rejected\n");
+
+    // Test 2: A parent pointing past the table is reported
+    CommitGraph *graph = commit_graph_open(path);
+    assert(graph != NULL);
+    uint32_t pos, parents[4];
+    assert(commit_graph_find(graph, shas[6], &pos) == true);
+    size_t record = (size_t)(graph->commit_data - graph->map) + (size_t)pos * COMMIT_GRAPH_DATA_SIZE;
+    commit_graph_close(graph);
+
+    put_be32(buf + record + SHA_SIZE, 1000);
+    fp = safe_fopen(copy, "wb");
+    fwrite(buf, 1, len, fp);
+    fclose(fp);
+    graph = commit_graph_open(copy);
+    assert(graph != NULL);
+    assert(commit_graph_parents(graph, pos, parents, 4) == SIZE_MAX);
+    commit_graph_close(graph);
+    printf("Test 2 Passed: Corrupt parent detected\n");
+
+    free(path);
+    repo_destroy(repo);
+    remove_directory("test_graph_bad");
+
+    printf("\nAll commit_graph malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test commit_graph_write\n");
+        fprintf(stderr, "    1. Test commit_graph malformed\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_commit_graph_write(); break;
+        case 1:  status = test_01_commit_graph_malformed(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
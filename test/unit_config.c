@@ -0,0 +1,224 @@
+/* unit_config.c: unit test config functions */
+
+#include "config.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/* Tests */
+
+int test_00_config_set(){
+    printf("Running config_set tests...\n");
+
+    Configuration *config = safe_calloc(sizeof(Configuration), 1);
+
+    // Test 1: Section and name ignore case, the subsection does not
+    assert(config_set(config, "Core.Bare", "true") == true);
+    assert(streq(config_get(config, "core.bare"), "true"));
+    assert(config_set(config, "remote.Origin.URL", "a") == true);
+    assert(streq(config_get(config, "REMOTE.Origin.url"), "a"));
+    assert(config_get(config, "remote.origin.url") == NULL);
+    printf("Test 1 Passed: Key case rules\n");
+
+    // Test 2: Later values replace earlier ones
+    assert(config_set(config, "core.bare", "false") == true);
+    assert(streq(config_get(config, "core.bare"), "false") && config->count == 2);
+    printf("Test 2 Passed: Last value wins\n");
+
+    // Test 3: The table grows past its initial size
+    char key[64], value[64];
+    for (int i = 0; i < 500; i++){
+        snprintf(key, sizeof(key), "section.sub%d.name", i);
+        snprintf(value, sizeof(value), "%d", i);
+        assert(config_set(config, key, value) == true);
+    }
+    for (int i = 0; i < 500; i++){
+        snprintf(key, sizeof(key), "section.sub%d.name", i);
+        snprintf(value, sizeof(value), "%d", i);
+        assert(streq(config_get(config, key), value));
+    }
+    assert(config->count == 502 && config->capacity >= 2 * config->count);
+    printf("Test 3 Passed: Table growth\n");
+
+    // Test 4: Malformed keys
+    assert(config_set(config, "nodot", "x") == false);
+    assert(config_set(config, ".name", "x") == false);
+    assert(config_set(config, "core.", "x") == false);
+    assert(config_get(config, "nodot") == NULL && config_get(NULL, "core.bare") == NULL);
+    printf("Test 4 Passed: Bad keys rejected\n");
+
+    // Test 5: Typed getters
+    config_set(config, "t.yes", "Yes");
+    config_set(config, "t.off", "off");
+    config_set(config, "t.num", "2");
+    config_set(config, "t.size", "8k");
+    config_set(config, "t.neg", "-1");
+    config_set(config, "t.bad", "maybe");
+    assert(config_get_bool(config, "t.yes", false) == true);
+    assert(config_get_bool(config, "t.off", true) == false);
+    assert(config_get_bool(config, "t.num", false) == true);
+    assert(config_get_bool(config, "t.bad", true) == true);
+    assert(config_get_bool(config, "t.unset", true) == true);
+    assert(config_get_int(config, "t.size", 0) == 8192);
+    assert(config_get_int(config, "t.neg", 0) == -1);
+    assert(config_get_int(config, "t.bad", 5) == 5);
+    assert(config_get_size(config, "t.size", 0) == 8192);
+    assert(config_get_size(config, "t.neg", 3) == 3);
+    long n;
+    assert(config_parse_int("9999999999g", &n) == false);
+    printf("Test 5 Passed: Typed getters\n");
+
+    // Test 6: Copies are independent
+    Configuration *copy = config_copy(config);
+    config_set(config, "t.yes", "no");
+    assert(streq(config_get(copy, "t.yes"), "Yes") && copy->count == config->count);
+    config_free(copy);
+    config_free(config);
+    printf("Test 6 Passed: Deep copy\n");
+
+    printf("\nAll config_set tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_config_read_file(){
+    printf("Running config_read_file tests...\n");
+
+    mkdir_p("test_config/sub", 0755);
+    write_text("test_config/main", "[core]\n"
+                                   "\tbare = false\n"
+                                   "\tfilemode = true ; comment\n"
+                                   "[remote \"Up \\\"stream\\\"\"]\n"
+                                   "\turl = \"https://example.com/a b.git\" # comment\n"
+                                   "\tfetch = \"semi;colon\"\n"
+                                   "[include]\n"
+                                   "\tpath = sub/extra\n"
+                                   "[pack]\n"
+                                   "\twindow = 20\n");
+    write_text("test_config/sub/extra", "[pack]\n"
+                                        "\twindow = 5\n"
+                                        "\tdepth = 7\n"
+                                        "\tescapes = a\\tb\n"
+                                        "[include]\n"
+                                        "\tpath = extra\n");
+
+    Configuration *config = safe_calloc(sizeof(Configuration), 1);
+
+    // Test 1: Indented keys, subsections, quoting and comments
+    assert(config_read_file(config, "test_config/main") == true);
+    assert(streq(config_get(config, "core.bare"), "false"));
+    assert(streq(config_get(config, "core.filemode"), "true"));
+    assert(streq(config_get(config, "remote.Up \"stream\".url"), "https://example.com/a b.git"));
+    assert(streq(config_get(config, "remote.Up \"stream\".fetch"), "semi;colon"));
+    printf("Test 1 Passed: Git config syntax\n");
+
+    // Test 2: Includes are read in place, relative to the including file
+    assert(config_get_int(config, "pack.window", 0) == 20);
+    assert(config_get_int(config, "pack.depth", 0) == 7);
+    assert(streq(config_get(config, "pack.escapes"), "a\tb"));
+    printf("Test 2 Passed: include.path followed\n");
+
+    // Test 3: A self-include stops at the depth limit
+    assert(config->source_count == 1 + CONFIG_INCLUDE_DEPTH);
+    printf("Test 3 Passed: Include loop bounded\n");
+
+    // Test 4: Changing any source is noticed
+    assert(config_is_current(config) == true);
+    write_text("test_config/sub/extra", "[pack]\n\twindow = 6\n");
+    assert(config_is_current(config) == false);
+    printf("Test 4 Passed: Source changes detected\n");
+
+    // Test 5: Missing files
+    assert(config_read_file(config, "test_config/none") == false);
+    config_free(config);
+    printf("Test 5 Passed: Missing file reported\n");
+
+    // Test 6: A key without a value is set, and true as a boolean
+    write_text("test_config/bare", "[foo]\n\tflag\n\tnumber\n\tother = x\n[include]\n\tpath\n");
+    config = safe_calloc(sizeof(Configuration), 1);
+    assert(config_read_file(config, "test_config/bare") == true);
+    assert(config_get(config, "foo.flag") == NULL && config_has(config, "Foo.Flag") == true);
+    assert(config_get_bool(config, "foo.flag", false) == true && config_get_int(config, "foo.number", 3) == 3);
+    assert(config_has(config, "foo.unset") == false && streq(config_get(config, "foo.other"), "x"));
+    assert(config_has(config, "include.path") == true);
+    Configuration *copy = config_copy(config);
+    assert(config_has(copy, "foo.flag") == true && config_get(copy, "foo.flag") == NULL);
+    config_free(copy);
+    config_free(config);
+    printf("Test 6 Passed: Valueless keys\n");
+
+    remove_directory("test_config");
+
+    printf("\nAll config_read_file tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_config_global(){
+    printf("Running config_read_global tests...\n");
+
+    Repository *repo = repo_init("test_config_repo");
+    assert(repo != NULL);
+    repo_destroy(repo);
+    write_text("test_config_repo/global", "[user]\n\tname = Global\n[pack]\n\twindow = 3\n");
+    FILE *fp = fopen("test_config_repo/.git/config", "a");
+    fprintf(fp, "[pack]\n\twindow = 9\n");
+    fclose(fp);
+
+    // Test 1: Repository values override global ones
+    setenv("GIT_CONFIG_GLOBAL", "test_config_repo/global", 1);
+    repo = repo_find("test_config_repo", false);
+    assert(repo != NULL);
+    assert(streq(config_get(repo->config, "user.name"), "Global"));
+    assert(config_get_int(repo->config, "pack.window", 0) == 9);
+    assert(repo->config->repo_format_version == 0 && repo->config->bare == false);
+    repo_destroy(repo);
+    printf("Test 1 Passed: Global and repository merged\n");
+
+    // Test 2: A global change invalidates the cached discovery
+    write_text("test_config_repo/global", "[user]\n\tname = Changed\n");
+    repo = repo_find("test_config_repo", false);
+    assert(repo != NULL && streq(config_get(repo->config, "user.name"), "Changed"));
+    repo_destroy(repo);
+    printf("Test 2 Passed: Global change picked up\n");
+
+    // Test 3: An empty override reads no global file
+    setenv("GIT_CONFIG_GLOBAL", "", 1);
+    repo = repo_find("test_config_repo", false);
+    assert(repo != NULL && config_get(repo->config, "user.name") == NULL);
+    repo_destroy(repo);
+    unsetenv("GIT_CONFIG_GLOBAL");
+    printf("Test 3 Passed: Global override\n");
+
+    remove_directory("test_config_repo");
+
+    printf("\nAll config_read_global tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test config_set\n");
+        fprintf(stderr, "    1. Test config_read_file\n");
+        fprintf(stderr, "    2. Test config_read_global\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_config_set(); break;
+        case 1:  status = test_01_config_read_file(); break;
+        case 2:  status = test_02_config_global(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,251 @@
+/* unit_delta.c: unit test delta functions */
+
+#include "delta.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static size_t put_varint(unsigned char *p, size_t v){
+    size_t n = 0;
+    while (v >= 0x80){
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* Tests */
+
+int test_00_delta_apply(){
+    printf("Running delta_apply tests...\n");
+
+    const unsigned char base[] = "the quick brown fox";
+    size_t base_len = sizeof(base) - 1;
+    unsigned char delta[64];
+    size_t n = 0, out_len = 0;
+
+    // Test 1: Copy, insert, copy
+    n += put_varint(delta + n, base_len);
+    n += put_varint(delta + n, 20);
+    delta[n++] = 0x80 | 0x10;               /* copy offset 0, size 4 */
+    delta[n++] = 4;
+    delta[n++] = 5;                         /* insert 5 bytes */
+    memcpy(delta + n, "slow ", 5);
+    n += 5;
+    delta[n++] = 0x80 | 0x01 | 0x10;        /* copy offset 10, size 9 */
+    delta[n++] = 10;
+    delta[n++] = 9;
+    delta[n++] = 0x02;                      /* insert 2 bytes */
+    memcpy(delta + n, "es", 2);
+    n += 2;
+    unsigned char *out = delta_apply(base, base_len, delta, n, &out_len);
+    assert(out != NULL);
+    assert(out_len == 20 && memcmp(out, "the slow brown foxes", 20) == 0);
+    free(out);
+    printf("Test 1 Passed: Copy and insert ops\n");
+
+    // Test 2: A copy with no size bits copies 64 KiB
+    size_t big_len = 2 * DELTA_COPY_MAX;
+    unsigned char *big = safe_malloc(sizeof(unsigned char), big_len);
+    for (size_t i = 0; i < big_len; i++) { big[i] = (unsigned char)(i * 3); }
+    n = 0;
+    n += put_varint(delta + n, big_len);
+    n += put_varint(delta + n, DELTA_COPY_MAX);
+    delta[n++] = 0x80 | 0x02;               /* copy offset 0x100, implicit size */
+    delta[n++] = 0x01;
+    out = delta_apply(big, big_len, delta, n, &out_len);
+    assert(out != NULL && out_len == DELTA_COPY_MAX);
+    assert(memcmp(out, big + 0x100, DELTA_COPY_MAX) == 0);
+    free(out);
+    free(big);
+    printf("Test 2 Passed: Implicit 64 KiB copy\n");
+
+    // Test 3: Empty result
+    n = 0;
+    n += put_varint(delta + n, base_len);
+    n += put_varint(delta + n, 0);
+    out = delta_apply(base, base_len, delta, n, &out_len);
+    assert(out != NULL && out_len == 0);
+    free(out);
+    printf("Test 3 Passed: Empty result\n");
+
+    // Test 4: Header sizes
+    size_t base_size, result_size, used;
+    n = put_varint(delta, 300);
+    n += put_varint(delta + n, 1 << 20);
+    assert(delta_header(delta, n, &base_size, &result_size, &used) == true);
+    assert(base_size == 300 && result_size == (1 << 20) && used == n);
+    assert(delta_header(delta, n - 1, &base_size, &result_size, &used) == false);
+    printf("Test 4 Passed: Header decoded\n");
+
+    printf("\nAll delta_apply tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_delta_malformed(){
+    printf("Running delta malformed tests...\n");
+
+    const unsigned char base[] = "0123456789";
+    size_t base_len = sizeof(base) - 1;
+    unsigned char delta[32];
+    size_t n, out_len;
+
+    // Test 1: Base size mismatch
+    n = put_varint(delta, base_len + 1);
+    n += put_varint(delta + n, 0);
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    printf("Test 1 Passed: Wrong base size rejected\n");
+
+    // Test 2: Copy past the end of the base
+    n = put_varint(delta, base_len);
+    n += put_varint(delta + n, 4);
+    delta[n++] = 0x80 | 0x01 | 0x10;
+    delta[n++] = 8;
+    delta[n++] = 4;
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    printf("Test 2 Passed: Out of range copy rejected\n");
+
+    // Test 3: Ops produce more than announced
+    n = put_varint(delta, base_len);
+    n += put_varint(delta + n, 2);
+    delta[n++] = 3;
+    memcpy(delta + n, "abc", 3);
+    n += 3;
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    printf("Test 3 Passed: Result overflow rejected\n");
+
+    // Test 4: Ops produce less than announced
+    n = put_varint(delta, base_len);
+    n += put_varint(delta + n, 5);
+    delta[n++] = 2;
+    memcpy(delta + n, "ab", 2);
+    n += 2;
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    printf("Test 4 Passed: Short result rejected\n");
+
+    // Test 5: Reserved op and truncated ops
+    n = put_varint(delta, base_len);
+    n += put_varint(delta + n, 1);
+    delta[n++] = 0;
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    n = put_varint(delta, base_len);
+    n += put_varint(delta + n, 4);
+    delta[n++] = 4;
+    delta[n++] = 'a';
+    assert(delta_apply(base, base_len, delta, n, &out_len) == NULL);
+    delta[n - 2] = 0x80 | 0x01 | 0x10;
+    assert(delta_apply(base, base_len, delta, n - 1, &out_len) == NULL);
+    printf("Test 5 Passed: Reserved and truncated ops rejected\n");
+
+    printf("\nAll delta malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_delta_create(){
+    printf("Running delta_create tests...\n");
+
+    // 1. Setup: a base and an edited copy (replace, insert, delete, append)
+    size_t base_len = 200000;
+    unsigned char *base = safe_malloc(sizeof(unsigned char), base_len);
+    uint32_t x = 12345;
+    for (size_t i = 0; i < base_len; i++){
+        x = x * 1103515245 + 12345;
+        base[i] = (unsigned char)(x >> 16);
+    }
+    size_t target_len = 0;
+    unsigned char *target = safe_malloc(sizeof(unsigned char), base_len + 1000);
+    memcpy(target, base, 50000);
+    target_len += 50000;
+    memcpy(target + target_len, "an inserted line of text\n", 26);
+    target_len += 26;
+    memcpy(target + target_len, base + 50000, 90000);
+    target_len += 90000;
+    memcpy(target + target_len, base + 150000, 50000);
+    target_len += 50000;
+    memset(target + 70000, 'z', 10);
+    memcpy(target + target_len, "tail", 4);
+    target_len += 4;
+
+    DeltaIndex *index = delta_index_create(base, base_len);
+    assert(index != NULL);
+
+    // Test 1: Round trip, and the delta is much smaller than the target
+    size_t delta_len, out_len;
+    unsigned char *delta = delta_create(index, target, target_len, 0, &delta_len);
+    assert(delta != NULL);
+    assert(delta_len < 200);
+    unsigned char *out = delta_apply(base, base_len, delta, delta_len, &out_len);
+    assert(out != NULL && out_len == target_len && memcmp(out, target, target_len) == 0);
+    free(out);
+    free(delta);
+    printf("Test 1 Passed: Edited copy encoded in %zu bytes\n", delta_len);
+
+    // Test 2: max_size stops early
+    assert(delta_create(index, target, target_len, 20, &delta_len) == NULL);
+    printf("Test 2 Passed: Size limit enforced\n");
+
+    // Test 3: Unrelated and tiny targets still round trip as inserts
+    const unsigned char tiny[] = "short";
+    delta = delta_create(index, tiny, 5, 0, &delta_len);
+    assert(delta != NULL);
+    out = delta_apply(base, base_len, delta, delta_len, &out_len);
+    assert(out != NULL && out_len == 5 && memcmp(out, tiny, 5) == 0);
+    free(out);
+    free(delta);
+    for (size_t i = 0; i < target_len; i++) { target[i] = (unsigned char)(i % 251); }
+    delta = delta_create(index, target, target_len, 0, &delta_len);
+    assert(delta != NULL);
+    out = delta_apply(base, base_len, delta, delta_len, &out_len);
+    assert(out != NULL && out_len == target_len && memcmp(out, target, target_len) == 0);
+    free(out);
+    free(delta);
+    printf("Test 3 Passed: Literal-only deltas\n");
+
+    // Test 4: Repetitive base (bucket cap) and copies over 64 KiB
+    memset(base, 'a', base_len);
+    delta_index_free(index);
+    index = delta_index_create(base, base_len);
+    delta = delta_create(index, base, base_len, 0, &delta_len);
+    assert(delta != NULL && delta_len < 64);
+    out = delta_apply(base, base_len, delta, delta_len, &out_len);
+    assert(out != NULL && out_len == base_len && memcmp(out, base, base_len) == 0);
+    free(out);
+    free(delta);
+    printf("Test 4 Passed: Long runs split into 64 KiB copies\n");
+
+    delta_index_free(index);
+    free(target);
+    free(base);
+
+    printf("\nAll delta_create tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test delta_apply\n");
+        fprintf(stderr, "    1. Test delta malformed\n");
+        fprintf(stderr, "    2. Test delta_create\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_delta_apply(); break;
+        case 1:  status = test_01_delta_malformed(); break;
+        case 2:  status = test_02_delta_create(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
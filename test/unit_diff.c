@@ -0,0 +1,391 @@
+/* unit_diff.c: unit test tree diff, rename detection and patch functions */
+
+#include "diff.h"
+#include "index.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/* Helpers */
+
+static Leaf leaf(uint32_t mode, const char *name, const unsigned char sha[SHA_SIZE]){
+    Leaf l = { .mode = mode, .name = name };
+    memcpy(l.sha, sha, SHA_SIZE);
+    return l;
+}
+
+static DiffOptions options_for(Repository *repo){
+    DiffOptions options;
+    diff_options_init(&options, repo);
+    options.threads = 4;
+    return options;
+}
+
+static const DiffPair *find_pair(const DiffQueue *queue, const char *path){
+    for (size_t i = 0; i < queue->count; i++){
+        const DiffPair *pair = &queue->pairs[i];
+        if (streq(pair->new.path ? pair->new.path : pair->old.path, path)) { return pair; }
+    }
+    return NULL;
+}
+
+static char *print(Repository *repo, const DiffQueue *queue, const DiffOptions *options){
+    char *text = NULL;
+    size_t size = 0;
+    FILE *fp = open_memstream(&text, &size);
+    assert(fp != NULL);
+    assert(diff_print(repo, queue, options, fp) == true);
+    fclose(fp);
+    return text;
+}
+
+/* A body of numbered lines, some replaced by "changed" */
+static char *numbered(const char *tag, size_t lines, size_t every){
+    char *text = safe_malloc(lines + 1, 32);
+    size_t len = 0;
+    for (size_t i = 0; i < lines; i++){
+        if (every && i % every == 0) { len += (size_t)sprintf(text + len, "changed %zu\n", i); }
+        else { len += (size_t)sprintf(text + len, "%s line %zu\n", tag, i); }
+    }
+    return text;
+}
+
+/* Tests */
+
+int test_00_diff_trees(){
+    printf("Running tree diff tests...\n");
+
+    Repository *repo = repo_init("test_diff_trees");
+    assert(repo != NULL);
+    unsigned char a1[SHA_SIZE], a2[SHA_SIZE], x1[SHA_SIZE], x2[SHA_SIZE], y[SHA_SIZE], keep[SHA_SIZE];
+    unsigned char d1[SHA_SIZE], d2[SHA_SIZE], fd[SHA_SIZE], s[SHA_SIZE], old[SHA_SIZE], new[SHA_SIZE];
+    write_blob(repo, "a1\n", 3, a1);
+    write_blob(repo, "a2\n", 3, a2);
+    write_blob(repo, "x1\n", 3, x1);
+    write_blob(repo, "x2\n", 3, x2);
+    write_blob(repo, "y\n", 2, y);
+    write_blob(repo, "keep\n", 5, keep);
+
+    Leaf dir[1] = { leaf(0100644, "x", x1) };
+    write_tree(repo, dir, 1, d1);
+    dir[0] = leaf(0100644, "x", x2);
+    write_tree(repo, dir, 1, d2);
+    dir[0] = leaf(0100644, "y", y);
+    write_tree(repo, dir, 1, fd);
+    dir[0] = leaf(0100644, "k", keep);
+    write_tree(repo, dir, 1, s);
+
+    Leaf before[6] = { leaf(0100644, "a", a1), leaf(040000, "d", d1), leaf(0100644, "f", y),
+                       leaf(0100644, "gone", keep), leaf(040000, "s", s), leaf(0100644, "t", y) };
+    Leaf after[6] = { leaf(0100644, "a", a2), leaf(040000, "d", d2), leaf(040000, "f", fd),
+                      leaf(0100755, "n", keep), leaf(040000, "s", s), leaf(0120000, "t", y) };
+    write_tree(repo, before, 6, old);
+    write_tree(repo, after, 6, new);
+    DiffQueue queue = { 0 };
+
+    // Test 1: Every kind of change is listed in path order
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true);
+    const char *paths = "a d/x f f/y gone n t";
+    char listed[64] = "";
+    for (size_t i = 0; i < queue.count; i++){
+        const DiffPair *pair = &queue.pairs[i];
+        strcat(listed, i ? " " : "");
+        strcat(listed, pair->new.path ? pair->new.path : pair->old.path);
+    }
+    assert(streq(listed, paths));
+    assert(find_pair(&queue, "a")->status == 'M' && find_pair(&queue, "d/x")->status == 'M');
+    assert(queue.pairs[2].status == 'D' && queue.pairs[3].status == 'A');
+    assert(find_pair(&queue, "gone")->status == 'D' && find_pair(&queue, "n")->status == 'A');
+    assert(find_pair(&queue, "n")->new.mode == 0100755 && find_pair(&queue, "n")->old.mode == 0);
+    printf("Test 1 Passed: Changed paths\n");
+
+    // Test 2: A file turned symlink is a type change
+    const DiffPair *t = find_pair(&queue, "t");
+    assert(t->status == 'T' && t->old.mode == 0100644 && t->new.mode == 0120000);
+    printf("Test 2 Passed: Type change\n");
+
+    // Test 3: The unchanged subtree is never read
+    assert(queue.trees_skipped == 1);
+    diff_queue_free(&queue);
+    assert(diff_tree_to_tree(repo, old, old, &queue) == true);
+    assert(queue.count == 0 && queue.trees_skipped == 2);
+    diff_queue_free(&queue);
+    printf("Test 3 Passed: Unchanged subtrees\n");
+
+    repo_destroy(repo);
+    remove_directory("test_diff_trees");
+
+    printf("\nAll tree diff tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_diff_renames(){
+    printf("Running rename detection tests...\n");
+
+    Repository *repo = repo_init("test_diff_renames");
+    assert(repo != NULL);
+    char *body = numbered("long", 40, 0), *edited = numbered("long", 40, 20), *other = numbered("other", 40, 0);
+    unsigned char dup[SHA_SIZE], lng[SHA_SIZE], lng2[SHA_SIZE], oth[SHA_SIZE], unrelated[SHA_SIZE];
+    write_blob(repo, "duplicate\n", 10, dup);
+    write_blob(repo, body, strlen(body), lng);
+    write_blob(repo, edited, strlen(edited), lng2);
+    write_blob(repo, other, strlen(other), oth);
+    write_blob(repo, "nothing alike\n", 14, unrelated);
+
+    unsigned char x[SHA_SIZE], yd[SHA_SIZE], z[SHA_SIZE], old[SHA_SIZE], new[SHA_SIZE];
+    Leaf xs[2] = { leaf(0100644, "long.c", lng), leaf(0100644, "one", dup) };
+    write_tree(repo, xs, 2, x);
+    Leaf ys[2] = { leaf(0100644, "dup", dup), leaf(0100644, "other", oth) };
+    write_tree(repo, ys, 2, yd);
+    Leaf zs[4] = { leaf(0100644, "dup", dup), leaf(0100644, "long.c", lng2), leaf(0100644, "new", unrelated), leaf(0100644, "other", dup) };
+    write_tree(repo, zs, 4, z);
+    Leaf before[2] = { leaf(040000, "x", x), leaf(040000, "y", yd) };
+    Leaf after[1] = { leaf(040000, "z", z) };
+    write_tree(repo, before, 2, old);
+    write_tree(repo, after, 1, new);
+    DiffOptions options = options_for(repo);
+    DiffQueue queue = { 0 };
+
+    // Test 1: Identical contents pair up, preferring the same basename
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true && queue.count == 8);
+    assert(diff_renames(repo, &queue, &options) == true);
+    const DiffPair *pair = find_pair(&queue, "z/dup");
+    assert(pair->status == 'R' && streq(pair->old.path, "y/dup") && pair->score == DIFF_MAX_SCORE);
+    pair = find_pair(&queue, "z/other");
+    assert(pair->status == 'R' && streq(pair->old.path, "x/one"));
+    printf("Test 1 Passed: Exact renames\n");
+
+    // Test 2: Edited contents pair by similarity; the rest stay added and deleted
+    pair = find_pair(&queue, "z/long.c");
+    assert(pair->status == 'R' && streq(pair->old.path, "x/long.c"));
+    assert(pair->score > DIFF_MAX_SCORE * 9 / 10 && pair->score < DIFF_MAX_SCORE);
+    assert(find_pair(&queue, "z/new")->status == 'A' && find_pair(&queue, "y/other")->status == 'D');
+    assert(queue.count == 5 && queue.renames == 3 && !queue.renames_skipped);
+    printf("Test 2 Passed: Inexact renames\n");
+
+    // Test 3: A threshold above the similarity leaves the edited file alone
+    diff_queue_free(&queue);
+    options.rename_score = DIFF_MAX_SCORE * 99 / 100;
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true && diff_renames(repo, &queue, &options) == true);
+    assert(find_pair(&queue, "z/long.c")->status == 'A' && queue.renames == 2);
+    printf("Test 3 Passed: Rename threshold\n");
+
+    // Test 4: Too many candidates skip inexact detection, not exact renames
+    diff_queue_free(&queue);
+    options.rename_score = DIFF_RENAME_SCORE;
+    options.rename_limit = 1;
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true && diff_renames(repo, &queue, &options) == true);
+    assert(queue.renames_skipped && queue.renames == 2 && find_pair(&queue, "z/long.c")->status == 'A');
+    printf("Test 4 Passed: Rename limit\n");
+
+    // Test 5: Nothing is paired with detection off
+    diff_queue_free(&queue);
+    options.renames = false;
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true && diff_renames(repo, &queue, &options) == true);
+    assert(queue.count == 8 && queue.renames == 0);
+    diff_queue_free(&queue);
+    printf("Test 5 Passed: Renames off\n");
+
+    free(body);
+    free(edited);
+    free(other);
+    repo_destroy(repo);
+    remove_directory("test_diff_renames");
+
+    printf("\nAll rename detection tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_diff_similarity(){
+    printf("Running similarity tests...\n");
+
+    // Test 1: Identical and disjoint buffers
+    const unsigned char *text = (const unsigned char *)"a\nb\nc\nd\n";
+    assert(diff_similarity(text, 8, text, 8, DIFF_RENAME_SCORE) == DIFF_MAX_SCORE);
+    assert(diff_similarity(text, 8, (const unsigned char *)"w\nx\ny\nz\n", 8, 0) == 0);
+    printf("Test 1 Passed: Identical and disjoint\n");
+
+    // Test 2: Copied bytes over the larger size
+    assert(diff_similarity(text, 8, (const unsigned char *)"a\nb\nc\nx\n", 8, 0) == DIFF_MAX_SCORE * 6 / 8);
+    assert(diff_similarity(text, 8, (const unsigned char *)"a\nb\nc\nd\ne\nf\ng\nh\n", 16, 0) == DIFF_MAX_SCORE / 2);
+    printf("Test 2 Passed: Partial copies\n");
+
+    // Test 3: CR before LF is ignored in text, but still counts in the size
+    assert(diff_similarity((const unsigned char *)"a\r\nb\r\n", 6, (const unsigned char *)"a\nb\n", 4, 0) == DIFF_MAX_SCORE * 4 / 6);
+    printf("Test 3 Passed: Line endings\n");
+
+    // Test 4: Sizes too far apart for the minimum are not compared
+    assert(diff_similarity(text, 8, (const unsigned char *)"a\nb\nc\nd\ne\nf\ng\nh\n", 16, DIFF_MAX_SCORE * 6 / 10) == 0);
+    printf("Test 4 Passed: Size filter\n");
+
+    printf("\nAll similarity tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_03_diff_print(){
+    printf("Running patch output tests...\n");
+
+    Repository *repo = repo_init("test_diff_print");
+    assert(repo != NULL);
+    const char *f1 = "int main(){\n    l1;\n    l2;\n    l3;\n    l4;\n    l5;\n    l6;\n    l7;\n    l8;\n    l9;\n}\n";
+    char f2[128];
+    strcpy(f2, f1);
+    *strstr(f2, "l5") = 'L';
+    unsigned char b1[SHA_SIZE], b2[SHA_SIZE], g[SHA_SIZE], h[SHA_SIZE], old[SHA_SIZE], new[SHA_SIZE];
+    write_blob(repo, f1, strlen(f1), b1);
+    write_blob(repo, f2, strlen(f2), b2);
+    write_blob(repo, "x", 1, g);
+    write_blob(repo, "bi\0n", 4, h);
+    Leaf before[2] = { leaf(0100644, "f", b1), leaf(0100644, "h", h) };
+    Leaf after[2] = { leaf(0100644, "f", b2), leaf(0100644, "g", g) };
+    write_tree(repo, before, 2, old);
+    write_tree(repo, after, 2, new);
+    DiffOptions options = options_for(repo);
+    DiffQueue queue = { 0 };
+    assert(diff_tree_to_tree(repo, old, new, &queue) == true && diff_renames(repo, &queue, &options) == true);
+
+    // Test 1: The patch is byte for byte what git prints
+    const char *expected =
+        "diff --git a/f b/f\n"
+        "index 55c69db..feeec68 100644\n"
+        "--- a/f\n"
+        "+++ b/f\n"
+        "@@ -3,7 +3,7 @@ int main(){\n"
+        "     l2;\n     l3;\n     l4;\n"
+        "-    l5;\n"
+        "+    L5;\n"
+        "     l6;\n     l7;\n     l8;\n"
+        "diff --git a/g b/g\n"
+        "new file mode 100644\n"
+        "index 0000000..c1b0730\n"
+        "--- /dev/null\n"
+        "+++ b/g\n"
+        "@@ -0,0 +1 @@\n"
+        "+x\n"
+        "\\ No newline at end of file\n"
+        "diff --git a/h b/h\n"
+        "deleted file mode 100644\n"
+        "index 4456cb3..0000000\n"
+        "Binary files a/h and /dev/null differ\n";
+    char *text = print(repo, &queue, &options);
+    assert(streq(text, expected));
+    free(text);
+    printf("Test 1 Passed: Unified patch\n");
+
+    // Test 2: Zero context keeps only the changed lines
+    options.context = 0;
+    text = print(repo, &queue, &options);
+    assert(strstr(text, "@@ -6 +6 @@ int main(){\n-    l5;\n+    L5;\ndiff --git a/g b/g\n") != NULL);
+    free(text);
+    printf("Test 2 Passed: No context\n");
+
+    // Test 3: Names with and without status
+    options.format = DIFF_FORMAT_NAME_STATUS;
+    text = print(repo, &queue, &options);
+    assert(streq(text, "M\tf\nA\tg\nD\th\n"));
+    free(text);
+    options.format = DIFF_FORMAT_NAME_ONLY;
+    text = print(repo, &queue, &options);
+    assert(streq(text, "f\ng\nh\n"));
+    free(text);
+    printf("Test 3 Passed: Name formats\n");
+
+    diff_queue_free(&queue);
+    repo_destroy(repo);
+    remove_directory("test_diff_print");
+
+    printf("\nAll patch output tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_04_diff_worktree(){
+    printf("Running worktree diff tests...\n");
+
+    Repository *repo = repo_init("test_diff_worktree");
+    assert(repo != NULL);
+    mkdir_p("test_diff_worktree/dir", 0755);
+    write_old_text("test_diff_worktree/a", "alpha\n");
+    write_old_text("test_diff_worktree/c", "gamma\n");
+    write_old_text("test_diff_worktree/dir/b", "beta\n");
+    Index *index = index_new();
+    add_file(repo, index, "test_diff_worktree", "a");
+    add_file(repo, index, "test_diff_worktree", "c");
+    add_file(repo, index, "test_diff_worktree", "dir/b");
+    assert(index_write(repo, index) == true);
+
+    unsigned char dir[SHA_SIZE], tree[SHA_SIZE];
+    Leaf sub[1] = { leaf(0100644, "b", index->entries[2].sha) };
+    write_tree(repo, sub, 1, dir);
+    Leaf top[3] = { leaf(0100644, "a", index->entries[0].sha), leaf(0100644, "c", index->entries[1].sha), leaf(040000, "dir", dir) };
+    write_tree(repo, top, 3, tree);
+    DiffOptions options = options_for(repo);
+    DiffQueue queue = { 0 };
+
+    // Test 1: A clean worktree differs in nothing and hashes nothing
+    assert(diff_tree_to_worktree(repo, tree, &options, &queue) == true);
+    assert(queue.count == 0 && queue.files_hashed == 0);
+    diff_queue_free(&queue);
+    printf("Test 1 Passed: Clean worktree\n");
+
+    // Test 2: Modified, deleted and newly indexed files
+    write_old_text("test_diff_worktree/a", "ALPHA\n");
+    unlink("test_diff_worktree/c");
+    write_old_text("test_diff_worktree/n", "new\n");
+    add_file(repo, index, "test_diff_worktree", "n");
+    assert(index_write(repo, index) == true);
+    assert(diff_tree_to_worktree(repo, tree, &options, &queue) == true);
+    assert(queue.count == 3 && queue.files_hashed == 1);
+    const DiffPair *pair = find_pair(&queue, "a");
+    assert(pair->status == 'M' && pair->new.worktree && !pair->old.worktree);
+    assert(find_pair(&queue, "c")->status == 'D' && find_pair(&queue, "n")->status == 'A');
+    printf("Test 2 Passed: Worktree changes\n");
+
+    // Test 3: The patch reads the worktree side from the file
+    char *text = print(repo, &queue, &options);
+    assert(strstr(text, "--- a/a\n+++ b/a\n@@ -1 +1 @@\n-alpha\n+ALPHA\n") != NULL);
+    assert(strstr(text, "diff --git a/n b/n\nnew file mode 100644\n") != NULL);
+    free(text);
+    diff_queue_free(&queue);
+    printf("Test 3 Passed: Worktree patch\n");
+
+    index_free(index);
+    repo_destroy(repo);
+    remove_directory("test_diff_worktree");
+
+    printf("\nAll worktree diff tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test tree diffs\n");
+        fprintf(stderr, "    1. Test rename detection\n");
+        fprintf(stderr, "    2. Test similarity\n");
+        fprintf(stderr, "    3. Test patch output\n");
+        fprintf(stderr, "    4. Test worktree diffs\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_diff_trees(); break;
+        case 1:  status = test_01_diff_renames(); break;
+        case 2:  status = test_02_diff_similarity(); break;
+        case 3:  status = test_03_diff_print(); break;
+        case 4:  status = test_04_diff_worktree(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
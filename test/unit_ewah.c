@@ -0,0 +1,203 @@
+/* unit_ewah.c: unit test plain and EWAH-compressed bitmap functions */
+
+#include "ewah.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static bool same_bits(const Bitmap *a, const Bitmap *b){
+    size_t len = a->len > b->len ? a->len : b->len;
+    for (size_t i = 0; i < len; i++){
+        uint64_t x = i < a->len ? a->words[i] : 0, y = i < b->len ? b->words[i] : 0;
+        if (x != y) { return false; }
+    }
+    return true;
+}
+
+/* a literal, a run of zeros, a run of ones, then another literal */
+static void make_pattern(Bitmap *bitmap){
+    for (size_t bit = 0; bit < 10; bit++) { bitmap_set(bitmap, bit); }
+    for (size_t bit = 101 * 64; bit < 106 * 64; bit++) { bitmap_set(bitmap, bit); }
+    bitmap_set(bitmap, 106 * 64 + 3);
+}
+
+/* Tests */
+
+int test_00_ewah_encode(){
+    printf("Running EWAH encoding tests...\n");
+
+    // Test 1: A single bit is a marker and one literal, as git writes it
+    Bitmap bitmap = { 0 };
+    bitmap_set(&bitmap, 0);
+    assert(bitmap_test(&bitmap, 0) == true && bitmap_test(&bitmap, 1) == false && bitmap_test(&bitmap, 9999) == false);
+    Ewah ewah = { 0 };
+    ewah_encode(&ewah, &bitmap);
+    assert(ewah.len == 2 && ewah.bits == 64 && ewah.marker == 0);
+    assert(ewah.words[0] == 1ull << 33 && ewah.words[1] == 1);
+    printf("Test 1 Passed: Single bit\n");
+
+    // Test 2: Runs are compressed into markers
+    bitmap_free(&bitmap);
+    make_pattern(&bitmap);
+    assert(bitmap.len == 107 && bitmap_count(&bitmap) == 10 + 5 * 64 + 1);
+    ewah_encode(&ewah, &bitmap);
+    assert(ewah.len == 5 && ewah.bits == 107 * 64);
+    const uint64_t words[5] = { 1ull << 33, 0x3ff, 100ull << 1, (5ull << 1 | 1) | (1ull << 33), 1ull << 3 };
+    assert(memcmp(ewah.words, words, sizeof(words)) == 0 && ewah.marker == 3);
+    printf("Test 2 Passed: Runs and literals\n");
+
+    // Test 3: Serializing and parsing gives the same bitmap back
+    size_t size = ewah_serialized_size(&ewah);
+    assert(size == 8 + 5 * 8 + 4);
+    unsigned char *data = safe_malloc(size + 16, 1);
+    ewah_serialize(&ewah, data);
+    assert(get_be32(data) == 107 * 64 && get_be32(data + 4) == 5 && get_be32(data + size - 4) == 3);
+    Ewah parsed = { 0 };
+    assert(ewah_parse(&parsed, data, size + 16) == size);
+    assert(parsed.len == 5 && parsed.bits == ewah.bits && parsed.marker == 3);
+    Bitmap expanded = { 0 };
+    ewah_or(&expanded, &parsed);
+    assert(same_bits(&expanded, &bitmap) == true);
+    printf("Test 3 Passed: Round trip\n");
+
+    // Test 4: Empty bitmaps have no bits
+    Bitmap empty = { 0 };
+    ewah_encode(&ewah, &empty);
+    assert(ewah.len == 1 && ewah.bits == 0 && ewah.words[0] == 0);
+    ewah_serialize(&ewah, data);
+    assert(ewah_parse(&parsed, data, ewah_serialized_size(&ewah)) == 20 && parsed.len == 1);
+    bitmap_clear(&expanded);
+    ewah_or(&expanded, &parsed);
+    assert(bitmap_count(&expanded) == 0);
+    printf("Test 4 Passed: Empty bitmap\n");
+
+    free(data);
+    ewah_free(&ewah);
+    ewah_free(&parsed);
+    bitmap_free(&bitmap);
+    bitmap_free(&expanded);
+
+    printf("\nAll EWAH encoding tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_bitmap_ops(){
+    printf("Running bitmap operation tests...\n");
+
+    Bitmap a = { 0 }, b = { 0 }, c = { 0 };
+    make_pattern(&a);
+    for (size_t bit = 5; bit < 70; bit++) { bitmap_set(&b, bit); }
+
+    // Test 1: OR and AND NOT
+    bitmap_or(&c, &a);
+    bitmap_or(&c, &b);
+    assert(bitmap_count(&c) == bitmap_count(&a) + 60);
+    assert(bitmap_count_and(&a, &b) == 5 && bitmap_count_and(&b, &a) == 5);
+    bitmap_and_not(&c, &b);
+    assert(bitmap_count(&c) == bitmap_count(&a) - 5);
+    assert(bitmap_test(&c, 4) == true && bitmap_test(&c, 5) == false);
+    printf("Test 1 Passed: OR and AND NOT\n");
+
+    // Test 2: OR and XOR of a compressed bitmap
+    Ewah ewah = { 0 };
+    ewah_encode(&ewah, &b);
+    bitmap_clear(&c);
+    bitmap_or(&c, &a);
+    ewah_xor(&c, &ewah);
+    assert(bitmap_count(&c) == bitmap_count(&a) + 60 - 5);
+    ewah_xor(&c, &ewah);
+    assert(same_bits(&c, &a) == true);
+    ewah_or(&c, &ewah);
+    assert(bitmap_count(&c) == bitmap_count(&a) + 60);
+    printf("Test 2 Passed: Compressed OR and XOR\n");
+
+    // Test 3: Clearing keeps nothing set
+    bitmap_clear(&c);
+    assert(c.len == 0 && bitmap_count(&c) == 0 && bitmap_test(&c, 4) == false);
+    bitmap_set(&c, 200);
+    assert(bitmap_count(&c) == 1);
+    printf("Test 3 Passed: Clear\n");
+
+    ewah_free(&ewah);
+    bitmap_free(&a);
+    bitmap_free(&b);
+    bitmap_free(&c);
+
+    printf("\nAll bitmap operation tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_ewah_damaged(){
+    printf("Running damaged EWAH tests...\n");
+
+    Bitmap bitmap = { 0 };
+    make_pattern(&bitmap);
+    Ewah ewah = { 0 }, parsed = { 0 };
+    ewah_encode(&ewah, &bitmap);
+    size_t size = ewah_serialized_size(&ewah);
+    unsigned char *data = safe_malloc(size, 1), *copy = safe_malloc(size, 1);
+    ewah_serialize(&ewah, data);
+
+    // Test 1: Truncated input
+    for (size_t len = 0; len < size; len++) { assert(ewah_parse(&parsed, data, len) == 0); }
+    printf("Test 1 Passed: Truncated\n");
+
+    // Test 2: A marker index past the words
+    memcpy(copy, data, size);
+    put_be32(copy + size - 4, 5);
+    assert(ewah_parse(&parsed, copy, size) == 0);
+    printf("Test 2 Passed: Bad marker index\n");
+
+    // Test 3: Literals past the words
+    memcpy(copy, data, size);
+    put_be64(copy + 8 + 3 * 8, (5ull << 1 | 1) | (2ull << 33));
+    assert(ewah_parse(&parsed, copy, size) == 0);
+    printf("Test 3 Passed: Literal count overflow\n");
+
+    // Test 4: Runs longer than the bitmap
+    memcpy(copy, data, size);
+    put_be64(copy + 8 + 2 * 8, EWAH_RUNNING_MAX << 1);
+    assert(ewah_parse(&parsed, copy, size) == 0);
+    memcpy(copy, data, size);
+    put_be32(copy, 64);
+    assert(ewah_parse(&parsed, copy, size) == 0);
+    assert(ewah_parse(&parsed, data, size) == size);
+    printf("Test 4 Passed: Oversized runs\n");
+
+    free(data);
+    free(copy);
+    ewah_free(&ewah);
+    ewah_free(&parsed);
+    bitmap_free(&bitmap);
+
+    printf("\nAll damaged EWAH tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test EWAH encoding\n");
+        fprintf(stderr, "    1. Test bitmap operations\n");
+        fprintf(stderr, "    2. Test damaged EWAH\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_ewah_encode(); break;
+        case 1:  status = test_01_bitmap_ops(); break;
+        case 2:  status = test_02_ewah_damaged(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,121 @@
+/* unit_ignore.c: unit test ignore functions */
+
+#include "ignore.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Helpers */
+
+static void add_line(IgnoreList *list, const char *line){ ignore_list_add(list, line, strlen(line)); }
+
+static bool ignored(const IgnoreList *list, const char *path, bool is_dir){ return ignore_path(list, path, strlen(path), is_dir); }
+
+/* Tests */
+
+int test_00_ignore_wildmatch(){
+    printf("Running ignore wildmatch tests...\n");
+
+    // Test 1: Literals, '?' and classes
+    assert(wildmatch("foo", "foo") == true && wildmatch("foo", "fooo") == false);
+    assert(wildmatch("f?o", "fxo") == true && wildmatch("f?o", "f/o") == false);
+    assert(wildmatch("[a-c]x", "bx") == true && wildmatch("[!a-c]x", "bx") == false);
+    assert(wildmatch("[[:digit:]]*", "7up") == true && wildmatch("[[:alpha:]]*", "7up") == false);
+    assert(wildmatch("\\*", "*") == true && wildmatch("\\*", "x") == false);
+    printf("Test 1 Passed: Literals, '?' and classes\n");
+
+    // Test 2: '*' stops at '/', "**" crosses directories
+    assert(wildmatch("*.c", "main.c") == true && wildmatch("*.c", "src/main.c") == false);
+    assert(wildmatch("src/*", "src/a") == true && wildmatch("src/*", "src/a/b") == false);
+    assert(wildmatch("**/x", "x") == true && wildmatch("**/x", "a/b/x") == true);
+    assert(wildmatch("a/**/b", "a/b") == true && wildmatch("a/**/b", "a/x/y/b") == true);
+    assert(wildmatch("a/**", "a/x/y") == true && wildmatch("a/**", "b/x") == false);
+    printf("Test 2 Passed: Stars and double stars\n");
+
+    printf("\nAll ignore wildmatch tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_ignore_lists(){
+    printf("Running ignore list tests...\n");
+
+    // Test 1: Basename, anchored and directory-only patterns
+    IgnoreList *top = ignore_list_new(NULL, "", 0);
+    add_line(top, "# comment");
+    add_line(top, "");
+    add_line(top, "*.o");
+    add_line(top, "/build");
+    add_line(top, "tmp/");
+    add_line(top, "doc/*.html");
+    assert(ignored(top, "a.o", false) == true && ignored(top, "src/deep/a.o", false) == true);
+    assert(ignored(top, "build", true) == true && ignored(top, "src/build", true) == false);
+    assert(ignored(top, "tmp", true) == true && ignored(top, "tmp", false) == false && ignored(top, "x/tmp", true) == true);
+    assert(ignored(top, "doc/a.html", false) == true && ignored(top, "doc/x/a.html", false) == false);
+    assert(ignored(top, "a.c", false) == false);
+    printf("Test 1 Passed: Pattern kinds\n");
+
+    // Test 2: The last matching pattern wins, so '!' re-includes
+    add_line(top, "!keep.o");
+    add_line(top, "trailing   ");
+    assert(ignored(top, "keep.o", false) == false && ignored(top, "sub/keep.o", false) == false);
+    assert(ignored(top, "trailing", false) == true);
+    printf("Test 2 Passed: Negation and trailing spaces\n");
+
+    // Test 3: A nested list is relative to its directory and overrides its parent
+    IgnoreList *sub = ignore_list_new(top, "src/", 4);
+    add_line(sub, "!*.o");
+    add_line(sub, "/gen");
+    assert(ignored(sub, "src/a.o", false) == false && ignored(sub, "src/x/a.o", false) == false);
+    assert(ignored(sub, "src/gen", true) == true && ignored(sub, "src/x/gen", true) == false);
+    assert(ignored(sub, "src/tmp", true) == true);
+    printf("Test 3 Passed: Nested lists\n");
+
+    // Test 4: Patterns are read from a file, relative to a directory handle
+    mkdir_p("test_ignore", 0755);
+    FILE *fp = safe_fopen("test_ignore/.gitignore", "w");
+    fputs("*.log\n!important.log\n", fp);
+    fclose(fp);
+    int fd = open("test_ignore", O_RDONLY | O_DIRECTORY);
+    assert(fd >= 0);
+    IgnoreList *file = ignore_list_new(NULL, "", 0);
+    struct stat sb;
+    assert(ignore_list_read(file, fd, ".gitignore", &sb) == true && sb.st_size == 21);
+    assert(file->count == 2 && ignored(file, "x.log", false) == true && ignored(file, "important.log", false) == false);
+    assert(ignore_list_read(file, fd, "missing", &sb) == false && sb.st_size == 0);
+    close(fd);
+    remove_directory("test_ignore");
+    printf("Test 4 Passed: Ignore files\n");
+
+    ignore_list_free(file);
+    ignore_list_free(sub);
+    ignore_list_free(top);
+
+    printf("\nAll ignore list tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test ignore wildmatch\n");
+        fprintf(stderr, "    1. Test ignore lists\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_ignore_wildmatch(); break;
+        case 1:  status = test_01_ignore_lists(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,279 @@
+/* unit_index.c: unit test index functions */
+
+#include "index.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Helpers */
+
+static IndexEntry make_entry(const char *name, int stage, uint32_t seed){
+    IndexEntry entry = { .mtime_sec = seed, .mtime_nsec = seed * 7, .ino = seed, .mode = 0100644, .size = seed % 1000 };
+    entry.name = name;
+    entry.name_len = (uint32_t)strlen(name);
+    entry.flags = (uint16_t)(stage << INDEX_STAGE_SHIFT);
+    sha1_buffer(name, strlen(name), entry.sha);
+    return entry;
+}
+
+static void fill_index(Index *index, size_t count){
+    char name[64];
+    for (size_t i = 0; i < count; i++){
+        snprintf(name, sizeof(name), "dir%zu/sub/file%05zu.c", i % 7, i);
+        IndexEntry entry = make_entry(name, 0, (uint32_t)i);
+        assert(index_add(index, &entry) != NULL);
+    }
+}
+
+static void check_same(const Index *a, const Index *b){
+    assert(a->count == b->count);
+    for (size_t i = 0; i < a->count; i++){
+        const IndexEntry *x = &a->entries[i], *y = &b->entries[i];
+        assert(x->name_len == y->name_len && memcmp(x->name, y->name, x->name_len) == 0);
+        assert(memcmp(x->sha, y->sha, SHA_SIZE) == 0 && x->mode == y->mode && x->mtime_sec == y->mtime_sec);
+        assert(x->mtime_nsec == y->mtime_nsec && x->ino == y->ino && x->size == y->size);
+        assert(x->flags_extended == y->flags_extended && index_entry_stage(x) == index_entry_stage(y));
+    }
+}
+
+static size_t read_file(const char *path, unsigned char **data){
+    FILE *fp = safe_fopen(path, "rb");
+    fseek(fp, 0, SEEK_END);
+    size_t len = (size_t)ftell(fp);
+    rewind(fp);
+    *data = safe_malloc(len, 1);
+    assert(fread(*data, 1, len, fp) == len);
+    fclose(fp);
+    return len;
+}
+
+/* Tests */
+
+int test_00_index_entries(){
+    printf("Running index entry tests...\n");
+
+    Repository *repo = repo_init("test_index");
+    assert(repo != NULL);
+
+    // Test 1: A missing index reads as empty
+    Index *index = index_read(repo);
+    assert(index != NULL && index->count == 0 && index->map == NULL);
+    printf("Test 1 Passed: Missing index is empty\n");
+
+    // Test 2: Entries stay sorted by name, shorter prefixes first, then stage
+    const char *names[] = { "b", "a/b", "a", "a-b", "a/a" };
+    for (size_t i = 0; i < 5; i++){
+        IndexEntry entry = make_entry(names[i], 0, (uint32_t)i);
+        assert(index_add(index, &entry) != NULL);
+    }
+    IndexEntry conflict = make_entry("c", 2, 9);
+    assert(index_add(index, &conflict) != NULL);
+    conflict.flags = 1 << INDEX_STAGE_SHIFT;
+    assert(index_add(index, &conflict) != NULL);
+    const char *sorted[] = { "a", "a-b", "a/a", "a/b", "b", "c", "c" };
+    assert(index->count == 7);
+    for (size_t i = 0; i < 7; i++){
+        assert(streq(index->entries[i].name, sorted[i]));
+    }
+    assert(index_entry_stage(&index->entries[5]) == 1 && index_entry_stage(&index->entries[6]) == 2);
+    printf("Test 2 Passed: Sorted inserts\n");
+
+    // Test 3: Lookup by name and stage, replacement keeps one entry
+    assert(index_find(index, "a/b", 3, 0) != NULL);
+    assert(index_find(index, "a/", 2, 0) == NULL);
+    assert(index_find(index, "c", 1, 0) == NULL && index_find(index, "c", 1, 2) != NULL);
+    IndexEntry update = make_entry("a/b", 0, 42);
+    assert(index_add(index, &update)->mtime_sec == 42 && index->count == 7);
+    printf("Test 3 Passed: Lookup and replace\n");
+
+    // Test 4: A stage 0 entry resolves the conflict
+    IndexEntry resolved = make_entry("c", 0, 10);
+    IndexEntry *extended = index_add(index, &resolved);
+    extended->flags_extended = INDEX_EXT_INTENT_TO_ADD;
+    assert(index->count == 6 && index_find(index, "c", 1, 2) == NULL && index_find(index, "c", 1, 0) != NULL);
+    printf("Test 4 Passed: Conflict stages dropped\n");
+
+    // Test 5: Written as v3 (extended flags) and read back identically
+    assert(index_write(repo, index) == true);
+    Index *copy = index_read(repo);
+    assert(copy != NULL && copy->version == 3 && copy->blocks == 0);
+    check_same(index, copy);
+    assert(index_verify(copy) == true);
+    assert(copy->entries[0].name >= (const char *)copy->map && copy->entries[0].name < (const char *)copy->map + copy->size);
+    index_free(copy);
+    printf("Test 5 Passed: Round trip\n");
+
+    // Test 6: Stat data decides whether a file needs rehashing
+    struct stat sb;
+    FILE *fp = safe_fopen("test_index/file", "w");
+    fputs("data\n", fp);
+    fclose(fp);
+    assert(lstat("test_index/file", &sb) == 0);
+    IndexEntry entry = make_entry("file", 0, 0);
+    index_entry_set_stat(&entry, &sb);
+    assert(entry.mode == 0100644 && entry.size == 5);
+    assert(index_entry_stat_matches(&entry, &sb) == true);
+    entry.size = 6;
+    assert(index_entry_stat_matches(&entry, &sb) == false);
+    printf("Test 6 Passed: Stat comparison\n");
+
+    // Test 7: A held lock makes the write fail without touching the index
+    int fd = open("test_index/.git/index.lock", O_WRONLY | O_CREAT, 0644);
+    assert(fd >= 0);
+    close(fd);
+    assert(index_write(repo, index) == false);
+    assert(file_exists("test_index/.git/index.lock") == true);
+    unlink("test_index/.git/index.lock");
+    printf("Test 7 Passed: Lock respected\n");
+
+    index_free(index);
+    repo_destroy(repo);
+    remove_directory("test_index");
+
+    printf("\nAll index entry tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_index_parallel(){
+    printf("Running index parallel decode tests...\n");
+
+    Repository *repo = repo_init("test_index_par");
+    assert(repo != NULL);
+    const size_t count = 3 * INDEX_IEOT_BLOCK + 17;
+
+    for (uint32_t version = 2; version <= 4; version += 2){
+        Index *index = index_new();
+        index->version = version;
+        fill_index(index, count);
+        assert(index_write(repo, index) == true);
+
+        // Test 1: The offset table splits the decode into blocks
+        Index *parallel = index_open("test_index_par/.git/index", 4);
+        assert(parallel != NULL && parallel->version == version && parallel->blocks == 4);
+        assert(parallel->entries_end > INDEX_HEADER_SIZE && index_verify(parallel) == true);
+        check_same(index, parallel);
+
+        // Test 2: A serial decode reaches the same entries
+        Index *serial = index_open("test_index_par/.git/index", 1);
+        assert(serial != NULL && serial->blocks == 0 && serial->entries_end == parallel->entries_end);
+        check_same(serial, parallel);
+        printf("Test %u Passed: v%u decoded in %zu blocks and serially\n", version / 2, version, parallel->blocks);
+
+        index_free(serial);
+        index_free(parallel);
+        index_free(index);
+    }
+
+    // Test 3: Rewriting a read index keeps v4 and its blocks
+    Index *index = index_read(repo);
+    assert(index != NULL && index->version == 4);
+    IndexEntry entry = make_entry("dir0/sub/file00000.c", 0, 99);
+    assert(index_add(index, &entry) != NULL);
+    assert(index_write(repo, index) == true);
+    Index *copy = index_open("test_index_par/.git/index", 4);
+    assert(copy != NULL && copy->blocks == 4 && copy->entries[0].mtime_sec == 99);
+    check_same(index, copy);
+    index_free(copy);
+    index_free(index);
+    printf("Test 3 Passed: v4 rewrite\n");
+
+    repo_destroy(repo);
+    remove_directory("test_index_par");
+
+    printf("\nAll index parallel decode tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_index_malformed(){
+    printf("Running index malformed tests...\n");
+
+    Repository *repo = repo_init("test_index_bad");
+    assert(repo != NULL);
+    Index *index = index_new();
+    fill_index(index, 2 * INDEX_IEOT_BLOCK);
+    assert(index_write(repo, index) == true);
+    index_free(index);
+
+    unsigned char *data;
+    size_t len = read_file("test_index_bad/.git/index", &data);
+    const char *copy = "test_index_bad/copy";
+
+    // Test 1: Bad signature, version and truncation
+    data[0] = 'X';
+    write_file(copy, data, len);
+    assert(index_open(copy, 1) == NULL);
+    data[0] = 'D';
+    data[7] = 5;
+    write_file(copy, data, len);
+    assert(index_open(copy, 1) == NULL);
+    data[7] = 2;
+    write_file(copy, data, len / 2);
+    assert(index_open(copy, 1) == NULL);
+    assert(index_open("test_index_bad/none", 1) == NULL);
+    printf("Test 1 Passed: Bad files rejected\n");
+
+    // Test 2: A corrupt offset table falls back to a serial decode
+    size_t eoie = len - SHA_SIZE - INDEX_EXT_HEADER - INDEX_EOIE_SIZE;
+    size_t entries_end = get_be32(data + eoie + 8);
+    assert(memcmp(data + entries_end, "IEOT", 4) == 0);
+    put_be32(data + entries_end + INDEX_EXT_HEADER + 4 + 8, 13);
+    write_file(copy, data, len);
+    index = index_open(copy, 4);
+    assert(index != NULL && index->blocks == 0 && index->count == 2 * INDEX_IEOT_BLOCK);
+    assert(index_verify(index) == false);
+    index_free(index);
+    printf("Test 2 Passed: Bad offset table ignored\n");
+
+    // Test 3: A required extension this reader does not know is an error
+    put_be32(data + entries_end + INDEX_EXT_HEADER + 4 + 8, INDEX_HEADER_SIZE);
+    memcpy(data + entries_end, "ieot", 4);
+    write_file(copy, data, len);
+    assert(index_open(copy, 4) == NULL);
+    memcpy(data + entries_end, "IEOT", 4);
+    printf("Test 3 Passed: Required extension rejected\n");
+
+    // Test 4: A name running past the entries is caught
+    memset(data + INDEX_HEADER_SIZE + INDEX_ENTRY_FIXED, 'x', entries_end - INDEX_HEADER_SIZE - INDEX_ENTRY_FIXED);
+    write_file(copy, data, len);
+    assert(index_open(copy, 1) == NULL);
+    assert(index_open(copy, 4) == NULL);
+    printf("Test 4 Passed: Overlong name rejected\n");
+
+    free(data);
+    repo_destroy(repo);
+    remove_directory("test_index_bad");
+
+    printf("\nAll index malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test index entries\n");
+        fprintf(stderr, "    1. Test index parallel decode\n");
+        fprintf(stderr, "    2. Test index malformed\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_index_entries(); break;
+        case 1:  status = test_01_index_parallel(); break;
+        case 2:  status = test_02_index_malformed(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,148 @@
+/* unit_kvlm.c: unit test kvlm functions */
+
+#include "kvlm.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static const char COMMIT[] =
+    "tree 29ff16c9c14e2652b22f8b78bb08a5a07930c147\n"
+    "parent 206941306e8a8af65b66eaaaea388a7ae24d49a0\n"
+    "parent 1111111111111111111111111111111111111111\n"
+    "author Thibault Polge <thibault@thb.lt> 1527025023 +0200\n"
+    "committer Thibault Polge <thibault@thb.lt> 1527025044 +0200\n"
+    "gpgsig -----BEGIN PGP SIGNATURE-----\n"
+    " \n"
+    " iQIzBAABCAAdFiEExwXquOM8bWb4Q2zVGxM2FxoLkGQFAlsEjZQACgkQGxM2FxoL\n"
+    " -----END PGP SIGNATURE-----\n"
+    "\n"
+    "Create first draft\n"
+    "\n"
+    "Longer description.\n";
+
+static int value_is(const unsigned char *value, size_t len, const char *expected){
+    return len == strlen(expected) && memcmp(value, expected, len) == 0;
+}
+
+/* Tests */
+
+int test_00_kvlm_parse(){
+    printf("Running kvlm_parse tests...\n");
+
+    Arena arena = {0};
+    Kvlm kvlm;
+    const unsigned char *data = (const unsigned char *)COMMIT;
+    size_t len;
+
+    // Test 1: Fields are indexed in order
+    assert(kvlm_parse(&kvlm, data, sizeof(COMMIT) - 1, &arena) == true);
+    assert(kvlm.count == 6 && kvlm.data == data);
+    assert(kvlm_count(&kvlm, "parent") == 2);
+    assert(kvlm_count(&kvlm, "tree") == 1);
+    assert(kvlm_count(&kvlm, "encoding") == 0);
+    printf("Test 1 Passed: Fields counted\n");
+
+    // Test 2: Values are views into the body
+    KvlmField *field = kvlm_get(&kvlm, "parent", 1);
+    assert(field != NULL && field->multiline == false);
+    const unsigned char *value = kvlm_value(&kvlm, field, &arena, &len);
+    assert(value == data + field->value_off);
+    assert(value_is(value, len, "1111111111111111111111111111111111111111"));
+    assert(kvlm_get(&kvlm, "parent", 2) == NULL);
+    assert(kvlm_get(&kvlm, "paren", 0) == NULL);
+    printf("Test 2 Passed: Single-line values\n");
+
+    // Test 3: Continuation lines are folded only on request
+    field = kvlm_get(&kvlm, "gpgsig", 0);
+    assert(field != NULL && field->multiline == true && field->folded == NULL);
+    value = kvlm_value(&kvlm, field, &arena, &len);
+    assert(value_is(value, len,
+        "-----BEGIN PGP SIGNATURE-----\n"
+        "\n"
+        "iQIzBAABCAAdFiEExwXquOM8bWb4Q2zVGxM2FxoLkGQFAlsEjZQACgkQGxM2FxoL\n"
+        "-----END PGP SIGNATURE-----"));
+    assert(field->folded == value);
+    assert(kvlm_value(&kvlm, field, &arena, &len) == value);
+    printf("Test 3 Passed: Multi-line value folded lazily\n");
+
+    // Test 4: Message and summary
+    value = kvlm_message(&kvlm, &len);
+    assert(value_is(value, len, "Create first draft\n\nLonger description.\n"));
+    value = kvlm_summary(&kvlm, &len);
+    assert(value_is(value, len, "Create first draft"));
+    printf("Test 4 Passed: Message and summary\n");
+
+    arena_clear(&arena);
+    printf("\nAll kvlm_parse tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_kvlm_malformed(){
+    printf("Running kvlm malformed tests...\n");
+
+    Arena arena = {0};
+    Kvlm kvlm;
+    size_t len;
+
+    // Test 1: A header line without a space
+    const char bad[] = "tree 29ff16c9c14e2652b22f8b78bb08a5a07930c147\nbogus\n\nmsg\n";
+    assert(kvlm_parse(&kvlm, (const unsigned char *)bad, sizeof(bad) - 1, &arena) == false);
+    const char folded[] = "tree 29ff16c9c14e2652b22f8b78bb08a5a07930c147\nbogus\n continued\n\nmsg\n";
+    assert(kvlm_parse(&kvlm, (const unsigned char *)folded, sizeof(folded) - 1, &arena) == false);
+    printf("Test 1 Passed: Line without a value rejected\n");
+
+    // Test 2: A header line starting with a space but no field before it
+    const char lead[] = " tree x\n\nmsg\n";
+    assert(kvlm_parse(&kvlm, (const unsigned char *)lead, sizeof(lead) - 1, &arena) == false);
+    printf("Test 2 Passed: Empty key rejected\n");
+
+    // Test 3: No blank line means no message
+    const char nomsg[] = "tree 29ff16c9c14e2652b22f8b78bb08a5a07930c147\n";
+    assert(kvlm_parse(&kvlm, (const unsigned char *)nomsg, sizeof(nomsg) - 1, &arena) == true);
+    assert(kvlm.count == 1);
+    kvlm_message(&kvlm, &len);
+    assert(len == 0);
+    printf("Test 3 Passed: Headers without message\n");
+
+    // Test 4: Empty body and missing trailing newline
+    assert(kvlm_parse(&kvlm, NULL, 0, &arena) == true && kvlm.count == 0);
+    const char tail[] = "tag v1.0";
+    assert(kvlm_parse(&kvlm, (const unsigned char *)tail, sizeof(tail) - 1, &arena) == true);
+    KvlmField *field = kvlm_get(&kvlm, "tag", 0);
+    assert(field != NULL);
+    const unsigned char *value = kvlm_value(&kvlm, field, &arena, &len);
+    assert(value_is(value, len, "v1.0"));
+    kvlm_summary(&kvlm, &len);
+    assert(len == 0);
+    printf("Test 4 Passed: Edge-case bodies\n");
+
+    arena_clear(&arena);
+    printf("\nAll kvlm malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test kvlm_parse\n");
+        fprintf(stderr, "    1. Test kvlm malformed\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_kvlm_parse(); break;
+        case 1:  status = test_01_kvlm_malformed(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,216 @@
+/* unit_linediff.c: unit test line diff functions */
+
+#include "linediff.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static LineDiff compute(const char *old, const char *new, LineDiffAlgorithm algorithm){
+    LineDiff diff;
+    assert(linediff_compute(&diff, (const unsigned char *)old, strlen(old), (const unsigned char *)new, strlen(new), algorithm) == true);
+    return diff;
+}
+
+static bool lines_equal(const LineText *a, size_t i, const LineText *b, size_t j){
+    size_t len = linediff_line_len(a, i);
+    return len == linediff_line_len(b, j) && memcmp(linediff_line(a, i), linediff_line(b, j), len) == 0;
+}
+
+/* Changes are ordered, separated by unchanged lines that really are equal */
+static void check_consistent(const LineDiff *diff){
+    size_t i1 = 0, i2 = 0;
+    for (size_t k = 0; k <= diff->count; k++){
+        size_t s1 = k < diff->count ? diff->changes[k].old_start : diff->old.count;
+        size_t s2 = k < diff->count ? diff->changes[k].new_start : diff->new.count;
+        assert(s1 >= i1 && s2 >= i2 && s1 - i1 == s2 - i2);
+        if (k && k < diff->count) { assert(s1 > i1); }
+        for (; i1 < s1; i1++, i2++) { assert(lines_equal(&diff->old, i1, &diff->new, i2)); }
+        if (k == diff->count) { break; }
+        assert(diff->changes[k].old_count || diff->changes[k].new_count);
+        i1 += diff->changes[k].old_count;
+        i2 += diff->changes[k].new_count;
+    }
+    assert(i1 == diff->old.count && i2 == diff->new.count);
+}
+
+static char *random_text(unsigned *seed, size_t lines, unsigned alphabet){
+    char *text = safe_malloc(lines + 1, 16);
+    size_t len = 0;
+    for (size_t i = 0; i < lines; i++) { len += (size_t)sprintf(text + len, "l%u\n", (unsigned)rand_r(seed) % alphabet); }
+    text[len] = '\0';
+    return text;
+}
+
+static char *random_edit(unsigned *seed, const char *text, unsigned alphabet){
+    size_t len = strlen(text);
+    char *out = safe_malloc(2 * len + 256, 1);
+    size_t n = 0;
+    for (const char *p = text; *p; ){
+        const char *nl = strchr(p, '\n');
+        size_t line = (size_t)(nl - p) + 1;
+        unsigned op = (unsigned)rand_r(seed) % 10;
+        if (op == 0){
+            p += line;
+        } else if (op == 1){
+            n += (size_t)sprintf(out + n, "n%u\n", (unsigned)rand_r(seed) % alphabet);
+        } else {
+            memcpy(out + n, p, line);
+            n += line;
+            p += line;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+/* Tests */
+
+int test_00_linediff_basic(){
+    printf("Running basic line diff tests...\n");
+
+    for (int algorithm = LINEDIFF_HISTOGRAM; algorithm <= LINEDIFF_MYERS; algorithm++){
+        const char *name = algorithm == LINEDIFF_HISTOGRAM ? "histogram" : "myers";
+
+        // Test 1: Identical and empty inputs have no changes
+        LineDiff diff = compute("a\nb\n", "a\nb\n", algorithm);
+        assert(diff.count == 0 && diff.old.count == 2 && diff.new.count == 2);
+        linediff_free(&diff);
+        diff = compute("", "", algorithm);
+        assert(diff.count == 0 && diff.old.count == 0);
+        linediff_free(&diff);
+        printf("Test 1 Passed: Identical and empty (%s)\n", name);
+
+        // Test 2: A line inserted in the middle
+        diff = compute("a\nb\nc\n", "a\nb\nx\nc\n", algorithm);
+        assert(diff.count == 1);
+        assert(diff.changes[0].old_start == 2 && diff.changes[0].old_count == 0);
+        assert(diff.changes[0].new_start == 2 && diff.changes[0].new_count == 1);
+        linediff_free(&diff);
+        printf("Test 2 Passed: Insertion (%s)\n", name);
+
+        // Test 3: A replaced line and a deleted one
+        diff = compute("a\nb\nc\nd\ne\n", "a\nB\nc\ne\n", algorithm);
+        assert(diff.count == 2);
+        assert(diff.changes[0].old_start == 1 && diff.changes[0].old_count == 1 && diff.changes[0].new_count == 1);
+        assert(diff.changes[1].old_start == 3 && diff.changes[1].old_count == 1 && diff.changes[1].new_count == 0);
+        check_consistent(&diff);
+        linediff_free(&diff);
+        printf("Test 3 Passed: Replacement and deletion (%s)\n", name);
+
+        // Test 4: A missing final newline makes the last line differ
+        diff = compute("a\nb\n", "a\nb", algorithm);
+        assert(diff.count == 1 && diff.changes[0].old_start == 1 && diff.changes[0].old_count == 1 && diff.changes[0].new_count == 1);
+        assert(linediff_line_len(&diff.new, 1) == 1);
+        linediff_free(&diff);
+        printf("Test 4 Passed: Final newline (%s)\n", name);
+
+        // Test 5: One side empty
+        diff = compute("", "a\nb\n", algorithm);
+        assert(diff.count == 1 && diff.changes[0].old_count == 0 && diff.changes[0].new_count == 2);
+        linediff_free(&diff);
+        diff = compute("a\nb\n", "", algorithm);
+        assert(diff.count == 1 && diff.changes[0].old_count == 2 && diff.changes[0].new_count == 0);
+        linediff_free(&diff);
+        printf("Test 5 Passed: One side empty (%s)\n", name);
+    }
+
+    printf("\nAll basic line diff tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_linediff_compact(){
+    printf("Running line diff compaction tests...\n");
+
+    // Test 1: An inserted block that could sit in two places is moved down
+    LineDiff diff = compute("x\n}\n", "x\n}\ny\n}\n", LINEDIFF_HISTOGRAM);
+    assert(diff.count == 1 && diff.changes[0].new_start == 2 && diff.changes[0].new_count == 2);
+    linediff_free(&diff);
+    printf("Test 1 Passed: Slid to the last position\n");
+
+    // Test 2: A deletion between repeated lines slides down as well
+    diff = compute("a\nb\na\nc\n", "a\nc\n", LINEDIFF_MYERS);
+    assert(diff.count == 1 && diff.changes[0].old_start == 1 && diff.changes[0].old_count == 2);
+    check_consistent(&diff);
+    linediff_free(&diff);
+    printf("Test 2 Passed: Slid deletion\n");
+
+    // Test 3: Lines only differing in the final newline are not equal
+    diff = compute("a\na", "a\na\n", LINEDIFF_HISTOGRAM);
+    assert(diff.count == 1 && diff.changes[0].old_start == 1);
+    linediff_free(&diff);
+    printf("Test 3 Passed: Final newline\n");
+
+    printf("\nAll line diff compaction tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_linediff_random(){
+    printf("Running random line diff tests...\n");
+
+    unsigned seed = 29;
+    size_t changes[2] = { 0, 0 };
+    // Test 1: Random edits of texts with few and many distinct lines stay consistent
+    for (int round = 0; round < 300; round++){
+        unsigned alphabet = round % 3 == 0 ? 3 : round % 3 == 1 ? 40 : 100000;
+        size_t lines = (size_t)(rand_r(&seed) % (round % 10 == 0 ? 5000 : 200));
+        char *old = random_text(&seed, lines, alphabet);
+        char *new = random_edit(&seed, old, alphabet);
+        for (int algorithm = LINEDIFF_HISTOGRAM; algorithm <= LINEDIFF_MYERS; algorithm++){
+            LineDiff diff = compute(old, new, algorithm);
+            check_consistent(&diff);
+            changes[algorithm] += diff.count;
+            if (streq(old, new)) { assert(diff.count == 0); }
+            linediff_free(&diff);
+        }
+        free(old);
+        free(new);
+    }
+    assert(changes[LINEDIFF_HISTOGRAM] > 0 && changes[LINEDIFF_MYERS] > 0);
+    printf("Test 1 Passed: Consistent changes\n");
+
+    // Test 2: Lines repeated past the histogram chain limit fall back to Myers
+    char *old = safe_malloc(LINEDIFF_MAX_CHAIN * 8 + 16, 1), *new = safe_malloc(LINEDIFF_MAX_CHAIN * 8 + 16, 1);
+    size_t n = 0, m = 0;
+    for (int i = 0; i < 2 * LINEDIFF_MAX_CHAIN; i++){
+        n += (size_t)sprintf(old + n, "%c\n", i % 2 ? 'a' : 'b');
+        m += (size_t)sprintf(new + m, "%c\n", i % 3 ? 'a' : 'b');
+    }
+    LineDiff diff = compute(old, new, LINEDIFF_HISTOGRAM);
+    check_consistent(&diff);
+    assert(diff.count > 0);
+    linediff_free(&diff);
+    free(old);
+    free(new);
+    printf("Test 2 Passed: Frequent lines\n");
+
+    printf("\nAll random line diff tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test basic line diffs\n");
+        fprintf(stderr, "    1. Test line diff compaction\n");
+        fprintf(stderr, "    2. Test random line diffs\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_linediff_basic(); break;
+        case 1:  status = test_01_linediff_compact(); break;
+        case 2:  status = test_02_linediff_random(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,199 @@
+/* unit_midx.c: unit test multi-pack-index functions */
+
+#include "midx.h"
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Helpers */
+
+/* Copies objects/pack/pack-<from>.<ext> to pack-<to>.<ext>, dated back by an hour */
+static void copy_pack(const char *from, const char *to){
+    const char *exts[] = { "pack", "idx" };
+    for (int i = 0; i < 2; i++){
+        char src[MAX_PATH], dst[MAX_PATH];
+        sprintf(src, "test_midx/.git/objects/pack/pack-%s.%s", from, exts[i]);
+        sprintf(dst, "test_midx/.git/objects/pack/pack-%s.%s", to, exts[i]);
+        size_t size;
+        const unsigned char *map = map_file(src, &size);
+        assert(map != NULL);
+        int fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0444);
+        assert(fd >= 0 && write_all(fd, map, size) == true);
+        struct timespec times[2] = { { .tv_sec = time(NULL) - 3600 }, { .tv_sec = time(NULL) - 3600 } };
+        assert(futimens(fd, times) == 0);
+        close(fd);
+        munmap((void *)map, size);
+    }
+}
+
+static bool pack_named(const Pack *pack, const char *name){
+    return pack && strstr(pack->path, name) != NULL;
+}
+
+/* Tests */
+
+int test_00_midx_write(){
+    printf("Running multi-pack-index write tests...\n");
+
+    Repository *repo = repo_init("test_midx");
+    assert(repo != NULL);
+
+    unsigned char first[3][SHA_SIZE], second[2][SHA_SIZE], late[1][SHA_SIZE], missing[SHA_SIZE] = { 0 };
+    char first_pack[SHA_HEX_SIZE], second_pack[SHA_HEX_SIZE], late_pack[SHA_HEX_SIZE];
+    const char *copy = "ffffffffffffffffffffffffffffffffffffffff";
+    write_blobs(repo, "first", 3, first);
+    pack_loose(repo, first_pack);
+    write_blobs(repo, "second", 2, second);
+    pack_loose(repo, second_pack);
+    copy_pack(first_pack, copy);
+
+    // Test 1: Every copy is merged into one table, the newer pack winning
+    MidxStats stats;
+    assert(midx_write(repo, &stats) == true);
+    assert(stats.packs == 3 && stats.objects == 5 && stats.duplicates == 3);
+    assert(file_exists("test_midx/.git/objects/pack/multi-pack-index"));
+    printf("Test 1 Passed: Write with duplicates\n");
+
+    // Test 2: Lookups go through the index and read back the objects
+    assert(pack_list(repo) != NULL && repo->midx != NULL && repo->midx->count == 5);
+    for (Pack *pack = repo->packs; pack; pack = pack->next) { assert(pack->in_midx); }
+    for (size_t i = 0; i < 3; i++){
+        uint64_t offset;
+        assert(pack_named(pack_lookup(repo, first[i], &offset), first_pack));
+        char want[64];
+        int n = sprintf(want, "first %zu\n", i);
+        ObjectType type;
+        size_t size;
+        unsigned char *data = object_read(repo, first[i], &type, &size);
+        assert(data && type == OBJ_BLOB && size == (size_t)n && memcmp(data, want, size) == 0);
+        free(data);
+    }
+    for (size_t i = 0; i < 2; i++) { assert(pack_named(pack_lookup(repo, second[i], NULL), second_pack)); }
+    assert(pack_lookup(repo, missing, NULL) == NULL);
+    uint32_t id;
+    assert(midx_find(repo->midx, second[0], &id, NULL) == true && pack_named(repo->midx->packs[id], second_pack));
+    assert(midx_find(repo->midx, missing, &id, NULL) == false);
+    printf("Test 2 Passed: Lookups\n");
+
+    // Test 3: A pack written after the index is still probed
+    write_blobs(repo, "late", 1, late);
+    pack_loose(repo, late_pack);
+    assert(pack_list(repo) != NULL && repo->midx != NULL);
+    Pack *pack = pack_lookup(repo, late[0], NULL);
+    assert(pack_named(pack, late_pack) && !pack->in_midx);
+    assert(pack_named(pack_lookup(repo, first[0], NULL), first_pack));
+    printf("Test 3 Passed: Packs outside the index\n");
+
+    // Test 4: An index naming a removed pack is ignored
+    char path[MAX_PATH];
+    sprintf(path, "test_midx/.git/objects/pack/pack-%s.pack", first_pack);
+    unlink(path);
+    sprintf(path, "test_midx/.git/objects/pack/pack-%s.idx", first_pack);
+    unlink(path);
+    pack_list_free(repo);
+    assert(pack_list(repo) != NULL && repo->midx == NULL);
+    assert(pack_named(pack_lookup(repo, first[1], NULL), copy));
+    assert(pack_named(pack_lookup(repo, second[1], NULL), second_pack));
+    printf("Test 4 Passed: Stale index\n");
+
+    repo_destroy(repo);
+    remove_directory("test_midx");
+
+    printf("\nAll multi-pack-index write tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_midx_open(){
+    printf("Running multi-pack-index open tests...\n");
+
+    Repository *repo = repo_init("test_midx");
+    assert(repo != NULL);
+    unsigned char shas[4][SHA_SIZE];
+    char name[SHA_HEX_SIZE];
+    write_blobs(repo, "blob", 4, shas);
+    pack_loose(repo, name);
+    assert(midx_write(repo, NULL) == true);
+
+    const char *path = "test_midx/.git/objects/pack/multi-pack-index";
+    size_t size;
+    const unsigned char *map = map_file(path, &size);
+    assert(map != NULL);
+    unsigned char *copy = safe_malloc(size, 1);
+    memcpy(copy, map, size);
+    munmap((void *)map, size);
+
+    // Test 1: The header and chunks are parsed
+    MultiPackIndex *midx = midx_open(path);
+    assert(midx && midx->count == 4 && midx->pack_count == 1 && midx->large_count == 0);
+    char want[MAX_PATH];
+    sprintf(want, "pack-%s.idx", name);
+    assert(streq(midx->pack_names[0], want));
+    for (size_t i = 0; i < 4; i++){
+        uint32_t id;
+        uint64_t offset;
+        assert(midx_find(midx, shas[i], &id, &offset) == true && id == 0 && offset >= PACK_HEADER_SIZE);
+    }
+    midx_close(midx);
+    printf("Test 1 Passed: Valid index\n");
+
+    // Test 2: Damaged files are rejected
+    FILE *fp = safe_fopen("test_midx/bad", "w");
+    assert(fwrite(copy, 1, size / 2, fp) == size / 2);
+    fclose(fp);
+    assert(midx_open("test_midx/bad") == NULL);
+
+    copy[4] = 2;
+    fp = safe_fopen("test_midx/bad", "w");
+    assert(fwrite(copy, 1, size, fp) == size);
+    fclose(fp);
+    assert(midx_open("test_midx/bad") == NULL);
+    copy[4] = MIDX_VERSION;
+
+    put_be32(copy + 8, 2);      /* more packs than names */
+    fp = safe_fopen("test_midx/bad", "w");
+    assert(fwrite(copy, 1, size, fp) == size);
+    fclose(fp);
+    assert(midx_open("test_midx/bad") == NULL);
+    assert(midx_open("test_midx/none") == NULL);
+    printf("Test 2 Passed: Damaged index\n");
+
+    free(copy);
+    repo_destroy(repo);
+    remove_directory("test_midx");
+
+    printf("\nAll multi-pack-index open tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test multi-pack-index write\n");
+        fprintf(stderr, "    1. Test multi-pack-index open\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_midx_write(); break;
+        case 1:  status = test_01_midx_open(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -1,6 +1,7 @@
 /* unit_objects.c: unit test object functions */
 
 #include "objects.h"
+#include "repository.h"
 #include "utils.h"
 
 #include <stdio.h>
@@ -8,8 +9,406 @@
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <zlib.h>
 
-int test_00_(){
+/* Helpers */
+
+static void write_loose(Repository *repo, const char *hex, const char *header, const unsigned char *data, size_t len){
+    size_t hlen = strlen(header) + 1;
+    size_t raw_len = hlen + len;
+    unsigned char *raw = safe_malloc(sizeof(unsigned char), raw_len);
+    memcpy(raw, header, hlen);
+    memcpy(raw + hlen, data, len);
+
+    uLongf zlen = compressBound(raw_len);
+    unsigned char *z = safe_malloc(sizeof(unsigned char), zlen);
+    assert(compress(z, &zlen, raw, raw_len) == Z_OK);
+
+    char dir[3] = { hex[0], hex[1], '\0' };
+    char *path = repo_file(repo, true, "objects", dir, hex + 2, NULL);
+    assert(path != NULL);
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fwrite(z, 1, zlen, f);
+    fclose(f);
+
+    free(path);
+    free(z);
+    free(raw);
+}
+
+/* Tests */
+
+int test_00_object_stream(){
+    printf("Running object_stream tests...\n");
+
+    Repository *repo = repo_init("test_obj_stream");
+    assert(repo != NULL);
+
+    // 1. Setup: a blob spanning several output chunks
+    size_t len = 3 * OBJECT_CHUNK_SIZE + 123;
+    unsigned char *data = safe_malloc(sizeof(unsigned char), len);
+    for (size_t i = 0; i < len; i++) { data[i] = (unsigned char)(i * 7 + i / 5); }
+    char header[OBJECT_HEADER_MAX];
+    snprintf(header, sizeof(header), "blob %zu", len);
+
+    const char *hex = "0123456789abcdef0123456789abcdef01234567";
+    unsigned char sha[SHA_SIZE];
+    assert(hex_to_sha(hex, sha));
+    write_loose(repo, hex, header, data, len);
+
+    // Test 1: Header is parsed on open
+    ObjectStream *stream = object_stream_open(repo, sha);
+    assert(stream != NULL);
+    assert(stream->type == OBJ_BLOB);
+    assert(stream->size == len);
+    printf("Test 1 Passed: Header parsed from first chunk\n");
+
+    // Test 2: Body arrives in bounded chunks and matches
+    size_t offset = 0;
+    const unsigned char *chunk;
+    ssize_t n;
+    while ((n = object_stream_next(stream, &chunk)) > 0){
+        assert((size_t)n <= OBJECT_CHUNK_SIZE);
+        assert(offset + (size_t)n <= len);
+        assert(memcmp(chunk, data + offset, (size_t)n) == 0);
+        offset += (size_t)n;
+    }
+    assert(n == 0);
+    assert(offset == len);
+    printf("Test 2 Passed: Streamed body matches in bounded chunks\n");
+
+    // Test 3: End of stream is sticky
+    assert(object_stream_next(stream, &chunk) == 0);
+    printf("Test 3 Passed: End of stream repeats\n");
+    object_stream_close(stream);
+
+    // Test 4: Missing object
+    unsigned char missing[SHA_SIZE] = {0};
+    assert(object_stream_open(repo, missing) == NULL);
+    printf("Test 4 Passed: Missing object returns NULL\n");
+
+    free(data);
+    repo_destroy(repo);
+    remove_directory("test_obj_stream");
+
+    printf("\nAll object_stream tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_object_stream_malformed(){
+    printf("Running object_stream malformed tests...\n");
+
+    Repository *repo = repo_init("test_obj_bad");
+    assert(repo != NULL);
+
+    const unsigned char body[] = "hello world";
+    unsigned char sha[SHA_SIZE];
+
+    // Test 1: Header announces more bytes than the body holds
+    const char *short_hex = "1111111111111111111111111111111111111111";
+    write_loose(repo, short_hex, "blob 20", body, 11);
+    assert(hex_to_sha(short_hex, sha));
+    ObjectStream *stream = object_stream_open(repo, sha);
+    assert(stream != NULL);
+    const unsigned char *chunk;
+    ssize_t n;
+    while ((n = object_stream_next(stream, &chunk)) > 0) {}
+    assert(n == -1);
+    object_stream_close(stream);
+    printf("Test 1 Passed: Short body rejected\n");
+
+    // Test 2: Header announces fewer bytes than the body holds
+    const char *long_hex = "2222222222222222222222222222222222222222";
+    write_loose(repo, long_hex, "blob 3", body, 11);
+    assert(hex_to_sha(long_hex, sha));
+    assert(object_stream_open(repo, sha) == NULL);
+    printf("Test 2 Passed: Long body rejected\n");
+
+    // Test 3: Unknown type
+    const char *type_hex = "3333333333333333333333333333333333333333";
+    write_loose(repo, type_hex, "bogus 11", body, 11);
+    assert(hex_to_sha(type_hex, sha));
+    assert(object_stream_open(repo, sha) == NULL);
+    printf("Test 3 Passed: Unknown type rejected\n");
+
+    repo_destroy(repo);
+    remove_directory("test_obj_bad");
+
+    printf("\nAll object_stream malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_object_read_header(){
+    printf("Running object_read_header tests...\n");
+
+    Repository *repo = repo_init("test_obj_header");
+    assert(repo != NULL);
+
+    size_t len = 2 * OBJECT_CHUNK_SIZE;
+    unsigned char *data = safe_calloc(sizeof(unsigned char), len);
+    char header[OBJECT_HEADER_MAX];
+    snprintf(header, sizeof(header), "commit %zu", len);
+
+    const char *hex = "4444444444444444444444444444444444444444";
+    unsigned char sha[SHA_SIZE];
+    assert(hex_to_sha(hex, sha));
+    write_loose(repo, hex, header, data, len);
+
+    // Test 1: Type and size come from the header alone
+    ObjectType type = OBJ_NONE;
+    size_t size = 0;
+    assert(object_read_header(repo, sha, &type, &size) == true);
+    assert(type == OBJ_COMMIT);
+    assert(size == len);
+    printf("Test 1 Passed: Header probed\n");
+
+    // Test 2: Body length is not checked by the probe
+    const char *bad_hex = "5555555555555555555555555555555555555555";
+    write_loose(repo, bad_hex, "tree 999", data, 4);
+    assert(hex_to_sha(bad_hex, sha));
+    assert(object_read_header(repo, sha, &type, &size) == true);
+    assert(type == OBJ_TREE && size == 999);
+    printf("Test 2 Passed: Probe does not inflate the body\n");
+
+    // Test 3: Missing object
+    unsigned char missing[SHA_SIZE] = {0};
+    assert(object_read_header(repo, missing, &type, &size) == false);
+    printf("Test 3 Passed: Missing object rejected\n");
+
+    free(data);
+    repo_destroy(repo);
+    remove_directory("test_obj_header");
+
+    printf("\nAll object_read_header tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_03_object_write(){
+    printf("Running object_write tests...\n");
+
+    Repository *repo = repo_init("test_obj_write");
+    assert(repo != NULL);
+
+    // Test 1: Hash only, matches git's id for "hello\n"
+    unsigned char sha[SHA_SIZE];
+    char hex[SHA_HEX_SIZE];
+    assert(object_write_buffer(NULL, OBJ_BLOB, "hello\n", 6, sha) == true);
+    sha_to_hex(sha, hex);
+    assert(streq(hex, "ce013625030ba8dba906f756967f9e9ca394464a"));
+    assert(access("test_obj_write/.git/objects/ce", F_OK) != 0);
+    printf("Test 1 Passed: Hash without writing\n");
+
+    // Test 2: Written object reads back through the stream
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, sha) == true);
+    assert(file_exists("test_obj_write/.git/objects/ce/013625030ba8dba906f756967f9e9ca394464a"));
+    ObjectStream *stream = object_stream_open(repo, sha);
+    assert(stream != NULL && stream->type == OBJ_BLOB && stream->size == 6);
+    const unsigned char *chunk;
+    assert(object_stream_next(stream, &chunk) == 6 && memcmp(chunk, "hello\n", 6) == 0);
+    object_stream_close(stream);
+    printf("Test 2 Passed: Written object round trips\n");
+
+    // Test 3: Writing an existing object again succeeds
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, sha) == true);
+    printf("Test 3 Passed: Rewriting an existing object\n");
+
+    // Test 4: Streaming from a file matches hashing the buffer
+    size_t len = 2 * OBJECT_CHUNK_SIZE + 17;
+    unsigned char *data = safe_malloc(sizeof(unsigned char), len);
+    for (size_t i = 0; i < len; i++) { data[i] = (unsigned char)(i ^ (i >> 9)); }
+    FILE *f = fopen("test_obj_write/input.bin", "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+
+    unsigned char expected[SHA_SIZE];
+    assert(object_write_buffer(NULL, OBJ_BLOB, data, len, expected) == true);
+    int fd = open("test_obj_write/input.bin", O_RDONLY);
+    assert(fd >= 0);
+    assert(object_hash_fd(repo, fd, OBJ_BLOB, sha) == true);
+    close(fd);
+    assert(memcmp(sha, expected, SHA_SIZE) == 0);
+    printf("Test 4 Passed: File hash matches buffer hash\n");
+
+    // Test 5: No temporary files are left behind
+    DIR *d = opendir("test_obj_write/.git/objects");
+    assert(d != NULL);
+    for (struct dirent *e = readdir(d); e; e = readdir(d)){
+        assert(strncmp(e->d_name, "tmp_obj_", 8) != 0);
+    }
+    closedir(d);
+    printf("Test 5 Passed: Temporary files cleaned up\n");
+
+    // Test 6: Short input is rejected
+    ObjectWriter *writer = safe_malloc(sizeof(ObjectWriter), 1);
+    assert(object_writer_begin(writer, repo, OBJ_BLOB, 10) == true);
+    assert(object_writer_update(writer, "abc", 3) == true);
+    assert(object_writer_finish(writer, sha) == false);
+    free(writer);
+    printf("Test 6 Passed: Size mismatch rejected\n");
+
+    // Test 7: A fan-out directory removed behind the cached handle is recreated
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, sha) == true);
+    assert(remove_directory("test_obj_write/.git/objects/ce"));
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, sha) == true);
+    assert(file_exists("test_obj_write/.git/objects/ce/013625030ba8dba906f756967f9e9ca394464a"));
+    stream = object_stream_open(repo, sha);
+    assert(stream != NULL);
+    object_stream_close(stream);
+    printf("Test 7 Passed: Stale directory handle recovered\n");
+
+    free(data);
+    repo_destroy(repo);
+    remove_directory("test_obj_write");
+
+    printf("\nAll object_write tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_04_object_get(){
+    printf("Running object_get tests...\n");
+
+    Repository *repo = repo_init("test_obj_get");
+    assert(repo != NULL);
+
+    // 1. Setup: more objects than the initial cache holds at half load
+    size_t count = 3 * OBJECT_CACHE_INITIAL / 2;
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(sizeof(*shas), count);
+    for (size_t i = 0; i < count; i++){
+        char body[32];
+        int n = snprintf(body, sizeof(body), "object %zu\n", i);
+        assert(object_write_buffer(repo, i % 2 ? OBJ_BLOB : OBJ_COMMIT, body, (size_t)n, shas[i]) == true);
+    }
+
+    // Test 1: Parsed once, then served from the cache
+    assert(repo->object_cache == NULL);
+    GitObject *first = object_get(repo, shas[0]);
+    assert(first != NULL);
+    assert(first->type == OBJ_COMMIT && first->size == 9);
+    assert(memcmp(first->data, "object 0\n", 9) == 0);
+    assert(memcmp(first->sha, shas[0], SHA_SIZE) == 0);
+    assert(object_get(repo, shas[0]) == first);
+    assert(repo->object_cache->hits == 1 && repo->object_cache->misses == 1);
+    printf("Test 1 Passed: Second lookup is a cache hit\n");
+
+    // Test 2: Growing the table keeps every object reachable
+    for (size_t i = 0; i < count; i++){
+        GitObject *object = object_get(repo, shas[i]);
+        assert(object != NULL);
+        assert(object->type == (i % 2 ? OBJ_BLOB : OBJ_COMMIT));
+    }
+    assert(repo->object_cache->count == count);
+    assert(repo->object_cache->capacity > OBJECT_CACHE_INITIAL);
+    assert(object_get(repo, shas[0]) == first);
+    printf("Test 2 Passed: %zu objects cached across growth\n", count);
+
+    // Test 3: Bodies live in the repository arena
+    assert(repo->arena.allocated >= count * (sizeof(GitCommit) + 16));
+    printf("Test 3 Passed: Objects allocated from the arena\n");
+
+    // Test 4: Missing objects are not cached
+    unsigned char missing[SHA_SIZE] = {0};
+    assert(object_get(repo, missing) == NULL);
+    assert(repo->object_cache->count == count);
+    printf("Test 4 Passed: Missing object returns NULL\n");
+
+    // Test 5: Unknown types are refused by the parser
+    assert(object_parse(repo, missing, OBJ_NONE, (const unsigned char *)"x", 1) == NULL);
+    printf("Test 5 Passed: Unknown type rejected\n");
+
+    // Test 6: Commit headers are indexed in place
+    const char body[] =
+        "tree 29ff16c9c14e2652b22f8b78bb08a5a07930c147\n"
+        "parent 206941306e8a8af65b66eaaaea388a7ae24d49a0\n"
+        "author A U Thor <a@example.com> 0 +0000\n"
+        "\n"
+        "msg\n";
+    unsigned char commit_sha[SHA_SIZE], sha[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_COMMIT, body, sizeof(body) - 1, commit_sha) == true);
+    GitCommit *commit = (GitCommit *)object_get(repo, commit_sha);
+    assert(commit != NULL && commit->kvlm.data == commit->object.data);
+    assert(commit_tree(commit, sha) == true);
+    assert(sha[0] == 0x29 && sha[SHA_SIZE - 1] == 0x47);
+    assert(commit_parent_count(commit) == 1);
+    assert(commit_parent(commit, 0, sha) == true && sha[0] == 0x20);
+    assert(commit_parent(commit, 1, sha) == false);
+    printf("Test 6 Passed: Commit tree and parents decoded\n");
+
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_obj_get");
+
+    printf("\nAll object_get tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_05_object_batch(){
+    printf("Running object batch tests...\n");
+
+    Repository *repo = repo_init("test_obj_batch");
+    assert(repo != NULL);
+    repo_destroy(repo);
+    repo = repo_find("test_obj_batch", true);
+    assert(repo != NULL && repo->config != NULL);
+
+    // Test 1: Without core.fsyncObjectFiles a batch syncs nothing
+    unsigned char shas[200][SHA_SIZE];
+    char body[32];
+    ObjectBatchStats stats;
+    assert(object_batch_begin(repo) == true);
+    for (size_t i = 0; i < 50; i++){
+        int n = sprintf(body, "unsynced %zu\n", i);
+        assert(object_write_buffer(repo, OBJ_BLOB, body, (size_t)n, shas[i]) == true);
+    }
+    assert(object_batch_commit(repo, &stats) == true);
+    assert(stats.objects == 50 && stats.dirs == 0 && repo->object_batch == NULL);
+    printf("Test 1 Passed: Batch without syncing\n");
+
+    // Test 2: Batches do not nest, and only an open batch commits
+    assert(object_batch_begin(repo) == true);
+    assert(object_batch_begin(repo) == false);
+    assert(object_batch_commit(repo, NULL) == true);
+    assert(object_batch_commit(repo, NULL) == false);
+    printf("Test 2 Passed: One batch at a time\n");
+
+    // Test 3: With core.fsyncObjectFiles each directory written to is synced once
+    assert(config_set(repo->config, "core.fsyncObjectFiles", "true") == true);
+    bool dirs[REPO_FANOUT_DIRS] = { false };
+    size_t expected = 0;
+    assert(object_batch_begin(repo) == true);
+    for (size_t i = 0; i < 200; i++){
+        int n = sprintf(body, "synced %zu\n", i);
+        assert(object_write_buffer(repo, OBJ_BLOB, body, (size_t)n, shas[i]) == true);
+        if (!dirs[shas[i][0]]) { dirs[shas[i][0]] = true; expected++; }
+    }
+    ObjectType type;
+    size_t size;
+    assert(object_read_header(repo, shas[0], &type, &size) == false);
+    assert(object_batch_commit(repo, &stats) == true);
+    assert(stats.objects == 200 && stats.dirs == expected + 1);
+    for (size_t i = 0; i < 200; i++){
+        assert(object_read_header(repo, shas[i], &type, &size) == true && type == OBJ_BLOB);
+    }
+    printf("Test 3 Passed: Objects staged until the batch commits\n");
+
+    // Test 4: Objects that already exist are not counted again
+    assert(object_batch_begin(repo) == true);
+    assert(object_write_buffer(repo, OBJ_BLOB, "synced 0\n", 9, shas[0]) == true);
+    assert(object_batch_commit(repo, &stats) == true);
+    assert(stats.objects == 0 && stats.dirs == 0);
+    printf("Test 4 Passed: Existing objects\n");
+
+    // Test 5: Outside a batch a synced write still succeeds
+    assert(object_write_buffer(repo, OBJ_BLOB, "alone\n", 6, shas[0]) == true);
+    assert(object_read_header(repo, shas[0], &type, &size) == true && size == 6);
+    printf("Test 5 Passed: Per-object sync\n");
+
+    repo_destroy(repo);
+    remove_directory("test_obj_batch");
+
+    printf("\nAll object batch tests passed successfully!\n");
     return EXIT_SUCCESS;
 }
 
@@ -17,7 +416,12 @@ int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
         fprintf(stderr, "Where NUMBER is right of the following:\n");
-        fprintf(stderr, "    0. Test \n");
+        fprintf(stderr, "    0. Test object_stream\n");
+        fprintf(stderr, "    1. Test object_stream malformed\n");
+        fprintf(stderr, "    2. Test object_read_header\n");
+        fprintf(stderr, "    3. Test object_write\n");
+        fprintf(stderr, "    4. Test object_get\n");
+        fprintf(stderr, "    5. Test object batch\n");
         return EXIT_FAILURE;
     }
 
@@ -25,9 +429,14 @@ int main(int argc, char *argv[]) {
     int status = EXIT_FAILURE;
 
     switch (number) {
-        case 0:  status = test_00_(); break;
+        case 0:  status = test_00_object_stream(); break;
+        case 1:  status = test_01_object_stream_malformed(); break;
+        case 2:  status = test_02_object_read_header(); break;
+        case 3:  status = test_03_object_write(); break;
+        case 4:  status = test_04_object_get(); break;
+        case 5:  status = test_05_object_batch(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
     return status;
-}
\ No newline at end of file
+}
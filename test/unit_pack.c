@@ -0,0 +1,491 @@
+/* unit_pack.c: unit test pack functions */
+
+#include "objects.h"
+#include "pack.h"
+#include "repository.h"
+#include "sha1.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Helpers */
+
+typedef struct {
+    int                  type;
+    const unsigned char *data;
+    size_t               len;
+    unsigned char        sha[SHA_SIZE];
+    size_t               base;      /* index of the delta base among the fixtures */
+    uint64_t             offset;
+    uint32_t             crc;
+} PackFixture;
+
+static size_t put_entry_header(unsigned char *p, int type, size_t size){
+    size_t n = 0;
+    unsigned char c = (unsigned char)((type << 4) | (size & 15));
+    size >>= 4;
+    while (size){
+        p[n++] = c | 0x80;
+        c = size & 0x7f;
+        size >>= 7;
+    }
+    p[n++] = c;
+    return n;
+}
+
+static int compare_fixtures(const void *a, const void *b){
+    const PackFixture *x = *(const PackFixture * const *)a;
+    const PackFixture *y = *(const PackFixture * const *)b;
+    return memcmp(x->sha, y->sha, SHA_SIZE);
+}
+
+static size_t put_varint(unsigned char *p, size_t v){
+    size_t n = 0;
+    while (v >= 0x80){
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* Writes a delta turning base into base + extra. */
+static size_t put_append_delta(unsigned char *p, size_t base_len, const char *extra){
+    size_t extra_len = strlen(extra);
+    size_t n = put_varint(p, base_len);
+    n += put_varint(p + n, base_len + extra_len);
+    p[n++] = 0x80 | 0x0f | 0x30;            /* copy 4 offset bytes, 2 size bytes */
+    memset(p + n, 0, 4);
+    n += 4;
+    p[n++] = (unsigned char)base_len;
+    p[n++] = (unsigned char)(base_len >> 8);
+    p[n++] = (unsigned char)extra_len;
+    memcpy(p + n, extra, extra_len);
+    return n + extra_len;
+}
+
+/* Writes objects/pack/pack-test.{pack,idx}; SHAs are computed unless an entry is a delta. */
+static void write_pack(Repository *repo, PackFixture *fixtures, size_t count){
+    size_t cap = PACK_HEADER_SIZE + SHA_SIZE;
+    for (size_t i = 0; i < count; i++) { cap += 16 + SHA_SIZE + compressBound(fixtures[i].len); }
+    unsigned char *pack = safe_malloc(sizeof(unsigned char), cap);
+
+    memcpy(pack, PACK_SIGNATURE, 4);
+    put_be32(pack + 4, 2);
+    put_be32(pack + 8, (uint32_t)count);
+    size_t used = PACK_HEADER_SIZE;
+
+    for (size_t i = 0; i < count; i++){
+        PackFixture *fx = &fixtures[i];
+        if (fx->type < PACK_OFS_DELTA){
+            char header[OBJECT_HEADER_MAX];
+            int hlen = snprintf(header, sizeof(header), "%s %zu", object_type_name((ObjectType)fx->type), fx->len);
+            Sha1Context ctx;
+            sha1_init(&ctx);
+            sha1_update(&ctx, header, (size_t)hlen + 1);
+            sha1_update(&ctx, fx->data, fx->len);
+            sha1_final(&ctx, fx->sha);
+        }
+
+        fx->offset = used;
+        used += put_entry_header(pack + used, fx->type, fx->len);
+        if (fx->type == PACK_OFS_DELTA){
+            uint64_t distance = fx->offset - fixtures[fx->base].offset;
+            unsigned char buf[16];
+            size_t pos = sizeof(buf) - 1;
+            buf[pos] = distance & 0x7f;
+            while (distance >>= 7) { buf[--pos] = 0x80 | (--distance & 0x7f); }
+            memcpy(pack + used, buf + pos, sizeof(buf) - pos);
+            used += sizeof(buf) - pos;
+        } else if (fx->type == PACK_REF_DELTA){
+            memcpy(pack + used, fixtures[fx->base].sha, SHA_SIZE);
+            used += SHA_SIZE;
+        }
+        uLongf zlen = cap - used;
+        assert(compress(pack + used, &zlen, fx->data, fx->len) == Z_OK);
+        used += zlen;
+        fx->crc = (uint32_t)crc32(0, pack + fx->offset, (uInt)(used - fx->offset));
+    }
+    sha1_buffer(pack, used, pack + used);
+    used += SHA_SIZE;
+
+    PackFixture **sorted = safe_malloc(sizeof(PackFixture *), count);
+    for (size_t i = 0; i < count; i++) { sorted[i] = &fixtures[i]; }
+    qsort(sorted, count, sizeof(PackFixture *), compare_fixtures);
+
+    size_t idx_len = 8 + PACK_IDX_FANOUT * 4 + count * (SHA_SIZE + 8) + 2 * SHA_SIZE;
+    unsigned char *idx = safe_calloc(sizeof(unsigned char), idx_len);
+    memcpy(idx, PACK_IDX_SIGNATURE, 4);
+    put_be32(idx + 4, 2);
+    unsigned char *fanout = idx + 8;
+    unsigned char *oids = fanout + PACK_IDX_FANOUT * 4;
+    unsigned char *crcs = oids + count * SHA_SIZE;
+    unsigned char *offsets = crcs + count * 4;
+    for (size_t b = 0, i = 0; b < PACK_IDX_FANOUT; b++){
+        while (i < count && sorted[i]->sha[0] <= b) { i++; }
+        put_be32(fanout + 4 * b, (uint32_t)i);
+    }
+    for (size_t i = 0; i < count; i++){
+        memcpy(oids + i * SHA_SIZE, sorted[i]->sha, SHA_SIZE);
+        put_be32(crcs + i * 4, sorted[i]->crc);
+        put_be32(offsets + i * 4, (uint32_t)sorted[i]->offset);
+    }
+    unsigned char *trailer = offsets + count * 4;
+    memcpy(trailer, pack + used - SHA_SIZE, SHA_SIZE);
+    sha1_buffer(idx, idx_len - SHA_SIZE, trailer + SHA_SIZE);
+
+    char *pack_path = repo_file(repo, true, "objects", "pack", "pack-test.pack", NULL);
+    char *idx_path = repo_file(repo, true, "objects", "pack", "pack-test.idx", NULL);
+    assert(pack_path != NULL && idx_path != NULL);
+    write_file(pack_path, pack, used);
+    write_file(idx_path, idx, idx_len);
+
+    free(idx_path);
+    free(pack_path);
+    free(idx);
+    free(sorted);
+    free(pack);
+}
+
+/* Tests */
+
+int test_00_pack_find(){
+    printf("Running pack_find tests...\n");
+
+    Repository *repo = repo_init("test_pack_find");
+    assert(repo != NULL);
+
+    // 1. Setup: enough small blobs to populate most fan-out buckets
+    size_t count = 600;
+    char (*bodies)[16] = safe_malloc(sizeof(*bodies), count);
+    PackFixture *fixtures = safe_calloc(sizeof(PackFixture), count);
+    for (size_t i = 0; i < count; i++){
+        int n = snprintf(bodies[i], sizeof(bodies[i]), "blob-%zu\n", i);
+        fixtures[i] = (PackFixture){ .type = OBJ_BLOB, .data = (unsigned char *)bodies[i], .len = (size_t)n };
+    }
+    write_pack(repo, fixtures, count);
+
+    // Test 1: The pack is discovered and its index validated
+    Pack *pack = pack_list(repo);
+    assert(pack != NULL && pack->next == NULL);
+    assert(pack->count == count);
+    printf("Test 1 Passed: Pack discovered under objects/pack\n");
+
+    // Test 2: Every object resolves to its own entry offset
+    for (size_t i = 0; i < count; i++){
+        uint64_t offset = 0;
+        assert(pack_lookup(repo, fixtures[i].sha, &offset) == pack);
+        assert(offset == fixtures[i].offset);
+    }
+    printf("Test 2 Passed: All %zu objects found at their offsets\n", count);
+
+    // Test 3: Names absent from the pack, at both ends of the fan-out
+    unsigned char missing[SHA_SIZE];
+    memset(missing, 0x00, SHA_SIZE);
+    assert(pack_find(pack, missing, NULL) == false);
+    memset(missing, 0xff, SHA_SIZE);
+    assert(pack_find(pack, missing, NULL) == false);
+    memcpy(missing, fixtures[0].sha, SHA_SIZE);
+    missing[SHA_SIZE - 1] ^= 1;
+    assert(pack_find(pack, missing, NULL) == false);
+    printf("Test 3 Passed: Missing objects rejected\n");
+
+    // Test 4: Entry headers decode multi-byte sizes
+    unsigned char buf[16];
+    int type;
+    size_t size, header_len;
+    size_t n = put_entry_header(buf, OBJ_TREE, 1234567);
+    assert(pack_entry_header(buf, n, &type, &size, &header_len) == true);
+    assert(type == OBJ_TREE && size == 1234567 && header_len == n);
+    assert(pack_entry_header(buf, n - 1, &type, &size, &header_len) == false);
+    printf("Test 4 Passed: Entry header varint decoded\n");
+
+    free(fixtures);
+    free(bodies);
+    repo_destroy(repo);
+    remove_directory("test_pack_find");
+
+    printf("\nAll pack_find tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_pack_object_stream(){
+    printf("Running packed object_stream tests...\n");
+
+    Repository *repo = repo_init("test_pack_stream");
+    assert(repo != NULL);
+
+    // 1. Setup: a blob spanning several chunks next to a small commit
+    size_t len = 3 * OBJECT_CHUNK_SIZE + 77;
+    unsigned char *data = safe_malloc(sizeof(unsigned char), len);
+    for (size_t i = 0; i < len; i++) { data[i] = (unsigned char)(i * 13 + i / 9); }
+    const char *commit = "tree 4b825dc642cb6eb9a060e54bf8d69288fbee4904\n\nempty\n";
+    PackFixture fixtures[] = {
+        { .type = OBJ_BLOB,   .data = data, .len = len },
+        { .type = OBJ_COMMIT, .data = (const unsigned char *)commit, .len = strlen(commit) },
+    };
+    write_pack(repo, fixtures, 2);
+
+    // Test 1: Header probe uses the pack entry
+    ObjectType type = OBJ_NONE;
+    size_t size = 0;
+    assert(object_read_header(repo, fixtures[1].sha, &type, &size) == true);
+    assert(type == OBJ_COMMIT && size == strlen(commit));
+    printf("Test 1 Passed: Packed header probed\n");
+
+    // Test 2: Body is inflated from the mapping in bounded chunks
+    ObjectStream *stream = object_stream_open(repo, fixtures[0].sha);
+    assert(stream != NULL);
+    assert(stream->type == OBJ_BLOB && stream->size == len);
+    size_t offset = 0;
+    const unsigned char *chunk;
+    ssize_t n;
+    while ((n = object_stream_next(stream, &chunk)) > 0){
+        assert((size_t)n <= OBJECT_CHUNK_SIZE);
+        assert(memcmp(chunk, data + offset, (size_t)n) == 0);
+        offset += (size_t)n;
+    }
+    assert(n == 0 && offset == len);
+    object_stream_close(stream);
+    printf("Test 2 Passed: Packed body streamed\n");
+
+    // Test 3: Loose objects remain reachable alongside packs
+    unsigned char sha[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_BLOB, "loose\n", 6, sha) == true);
+    assert(object_read_header(repo, sha, &type, &size) == true);
+    assert(type == OBJ_BLOB && size == 6);
+    printf("Test 3 Passed: Loose fallback after pack miss\n");
+
+    free(data);
+    repo_destroy(repo);
+    remove_directory("test_pack_stream");
+
+    printf("\nAll packed object_stream tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_pack_malformed(){
+    printf("Running pack malformed tests...\n");
+
+    Repository *repo = repo_init("test_pack_bad");
+    assert(repo != NULL);
+
+    const char *body = "some blob\n";
+    PackFixture fixtures[] = {
+        { .type = OBJ_BLOB, .data = (const unsigned char *)body, .len = strlen(body) },
+    };
+    write_pack(repo, fixtures, 1);
+    char *idx_path = repo_path(repo, "objects", "pack", "pack-test.idx", NULL);
+
+    // Test 1: Wrong index version
+    FILE *f = fopen(idx_path, "r+b");
+    assert(f != NULL);
+    unsigned char version[4];
+    put_be32(version, 1);
+    fseek(f, 4, SEEK_SET);
+    fwrite(version, 1, 4, f);
+    fclose(f);
+    assert(pack_open(idx_path) == NULL);
+    printf("Test 1 Passed: Index version 1 rejected\n");
+
+    // Test 2: Truncated index
+    write_pack(repo, fixtures, 1);
+    assert(truncate(idx_path, 8 + PACK_IDX_FANOUT * 4 + 10) == 0);
+    assert(pack_open(idx_path) == NULL);
+    printf("Test 2 Passed: Truncated index rejected\n");
+
+    // Test 3: A fan-out that decreases would send lookups past the table
+    write_pack(repo, fixtures, 1);
+    f = fopen(idx_path, "r+b");
+    assert(f != NULL);
+    unsigned char bucket[4];
+    put_be32(bucket, 2);
+    fseek(f, 8, SEEK_SET);
+    fwrite(bucket, 1, 4, f);
+    fclose(f);
+    assert(pack_open(idx_path) == NULL);
+    printf("Test 3 Passed: Corrupt fan-out rejected\n");
+
+    // Test 4: Unusable packs are skipped, not fatal
+    unsigned char sha[SHA_SIZE];
+    memcpy(sha, fixtures[0].sha, SHA_SIZE);
+    ObjectType type;
+    size_t size;
+    assert(pack_list(repo) == NULL);
+    assert(object_read_header(repo, sha, &type, &size) == false);
+    printf("Test 4 Passed: Repository without valid packs\n");
+
+    // Test 5: A delta that is its own base is refused, not followed forever
+    pack_list_free(repo);
+    fixtures[0].type = PACK_REF_DELTA;
+    fixtures[0].base = 0;
+    write_pack(repo, fixtures, 1);
+    assert(object_stream_open(repo, sha) == NULL);
+    assert(object_read_header(repo, sha, &type, &size) == false);
+    printf("Test 5 Passed: Delta cycle refused\n");
+
+    free(idx_path);
+    repo_destroy(repo);
+    remove_directory("test_pack_bad");
+
+    printf("\nAll pack malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_03_pack_delta(){
+    printf("Running pack delta tests...\n");
+
+    Repository *repo = repo_init("test_pack_delta");
+    assert(repo != NULL);
+
+    // 1. Setup: a base blob, a 60 deep OFS_DELTA chain and a REF_DELTA on top
+    size_t depth = 60;
+    size_t count = depth + 2;
+    PackFixture *fixtures = safe_calloc(sizeof(PackFixture), count);
+    unsigned char (*deltas)[64] = safe_malloc(sizeof(*deltas), count);
+    char *expect = safe_calloc(sizeof(char), 4096);
+    strcpy(expect, "base\n");
+    fixtures[0] = (PackFixture){ .type = OBJ_BLOB, .data = (unsigned char *)"base\n", .len = 5 };
+
+    for (size_t i = 1; i < count; i++){
+        char extra[16];
+        snprintf(extra, sizeof(extra), "line %zu\n", i);
+        size_t base_len = strlen(expect);
+        fixtures[i].type = i == count - 1 ? PACK_REF_DELTA : PACK_OFS_DELTA;
+        fixtures[i].base = i - 1;
+        fixtures[i].data = deltas[i];
+        fixtures[i].len = put_append_delta(deltas[i], base_len, extra);
+        strcat(expect, extra);
+        assert(object_write_buffer(NULL, OBJ_BLOB, expect, strlen(expect), fixtures[i].sha) == true);
+    }
+    write_pack(repo, fixtures, count);
+
+    // Test 1: Header probe follows the chain without resolving it
+    ObjectType type = OBJ_NONE;
+    size_t size = 0;
+    assert(object_read_header(repo, fixtures[count - 1].sha, &type, &size) == true);
+    assert(type == OBJ_BLOB && size == strlen(expect));
+    assert(repo->delta_cache->used == 0);
+    printf("Test 1 Passed: Delta header probed\n");
+
+    // Test 2: The tip resolves through every link
+    ObjectStream *stream = object_stream_open(repo, fixtures[count - 1].sha);
+    assert(stream != NULL);
+    assert(stream->type == OBJ_BLOB && stream->size == strlen(expect));
+    const unsigned char *chunk;
+    ssize_t n = object_stream_next(stream, &chunk);
+    assert((size_t)n == strlen(expect) && memcmp(chunk, expect, (size_t)n) == 0);
+    assert(object_stream_next(stream, &chunk) == 0);
+    object_stream_close(stream);
+    printf("Test 2 Passed: %zu deep chain resolved\n", depth + 1);
+
+    // Test 3: Intermediate bases are cached, so siblings resolve in one step
+    size_t hits = repo->delta_cache->hits;
+    int entry_type;
+    size_t entry_size;
+    unsigned char *body = pack_read_object(repo, pack_list(repo), fixtures[depth / 2].offset, &entry_type, &entry_size);
+    assert(body != NULL && entry_type == OBJ_BLOB);
+    free(body);
+    assert(repo->delta_cache->hits == hits + 1);
+    printf("Test 3 Passed: Cached base reused\n");
+
+    // Test 4: Every link of the chain reads back correctly
+    for (size_t i = 0; i < count; i++){
+        stream = object_stream_open(repo, fixtures[i].sha);
+        assert(stream != NULL);
+        unsigned char sha[SHA_SIZE];
+        ObjectWriter writer;
+        assert(object_writer_begin(&writer, NULL, stream->type, stream->size) == true);
+        while ((n = object_stream_next(stream, &chunk)) > 0) { object_writer_update(&writer, chunk, (size_t)n); }
+        assert(n == 0);
+        assert(object_writer_finish(&writer, sha) == true);
+        assert(memcmp(sha, fixtures[i].sha, SHA_SIZE) == 0);
+        object_stream_close(stream);
+    }
+    printf("Test 4 Passed: All %zu objects hash back to their names\n", count);
+
+    free(expect);
+    free(deltas);
+    free(fixtures);
+    repo_destroy(repo);
+    remove_directory("test_pack_delta");
+
+    printf("\nAll pack delta tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_04_delta_base_cache(){
+    printf("Running delta_base_cache tests...\n");
+
+    DeltaBaseCache *cache = delta_base_cache_create(100);
+    const Pack *pack = (const Pack *)cache;     /* only used as a key */
+    int type;
+    unsigned char *data;
+    size_t size;
+
+    // Test 1: Put then get returns a private copy
+    unsigned char *body = safe_malloc(sizeof(unsigned char), 40);
+    memset(body, 'a', 40);
+    delta_base_cache_put(cache, pack, 1, OBJ_BLOB, body, 40);
+    assert(delta_base_cache_get(cache, pack, 1, &type, &data, &size) == true);
+    assert(type == OBJ_BLOB && size == 40 && data != body && data[39] == 'a');
+    free(data);
+    assert(delta_base_cache_get(cache, pack, 2, &type, &data, &size) == false);
+    printf("Test 1 Passed: Hit and miss\n");
+
+    // Test 2: Least recently used entries go first once over budget
+    delta_base_cache_put(cache, pack, 2, OBJ_TREE, safe_calloc(sizeof(unsigned char), 40), 40);
+    assert(delta_base_cache_get(cache, pack, 1, &type, &data, &size) == true);
+    free(data);
+    delta_base_cache_put(cache, pack, 3, OBJ_BLOB, safe_calloc(sizeof(unsigned char), 40), 40);
+    assert(cache->used == 80);
+    assert(delta_base_cache_get(cache, pack, 2, &type, &data, &size) == false);
+    assert(delta_base_cache_get(cache, pack, 1, &type, &data, &size) == true);
+    free(data);
+    printf("Test 2 Passed: LRU eviction within budget\n");
+
+    // Test 3: Oversized bodies and duplicates are dropped
+    delta_base_cache_put(cache, pack, 4, OBJ_BLOB, safe_calloc(sizeof(unsigned char), 101), 101);
+    assert(delta_base_cache_get(cache, pack, 4, &type, &data, &size) == false);
+    delta_base_cache_put(cache, pack, 3, OBJ_BLOB, safe_calloc(sizeof(unsigned char), 40), 40);
+    assert(cache->used == 80);
+    printf("Test 3 Passed: Oversized and duplicate puts ignored\n");
+
+    delta_base_cache_destroy(cache);
+
+    printf("\nAll delta_base_cache tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test pack_find\n");
+        fprintf(stderr, "    1. Test pack object_stream\n");
+        fprintf(stderr, "    2. Test pack malformed\n");
+        fprintf(stderr, "    3. Test pack delta\n");
+        fprintf(stderr, "    4. Test delta_base_cache\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_pack_find(); break;
+        case 1:  status = test_01_pack_object_stream(); break;
+        case 2:  status = test_02_pack_malformed(); break;
+        case 3:  status = test_03_pack_delta(); break;
+        case 4:  status = test_04_delta_base_cache(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
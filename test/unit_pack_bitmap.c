@@ -0,0 +1,340 @@
+/* unit_pack_bitmap.c: unit test reachability bitmap functions */
+
+#include "objects.h"
+#include "pack.h"
+#include "pack_bitmap.h"
+#include "repack.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+/* Macros */
+
+#define HISTORY 230
+
+/* Helpers */
+
+typedef struct {
+    unsigned char (*shas)[SHA_SIZE];
+    size_t        count;
+} Listed;
+
+/* a root tree with d/x and f0..f4, where commit i rewrites f<i % 5> and every tenth d/x */
+static void make_tree(Repository *repo, size_t i, unsigned char sha[SHA_SIZE]){
+    unsigned char body[512], blob[SHA_SIZE], dir[SHA_SIZE];
+    char text[32];
+    snprintf(text, sizeof(text), "x%zu\n", i / 10);
+    write_blob(repo, text, strlen(text), blob);
+    memcpy(body, "100644 x", 9);
+    memcpy(body + 9, blob, SHA_SIZE);
+    assert(object_write_buffer(repo, OBJ_TREE, body, 9 + SHA_SIZE, dir) == true);
+
+    size_t len = (size_t)sprintf((char *)body, "40000 d") + 1;
+    memcpy(body + len, dir, SHA_SIZE);
+    len += SHA_SIZE;
+    for (size_t f = 0; f < 5; f++){
+        size_t last = i < f ? 0 : i - (i + 5 - f) % 5;
+        snprintf(text, sizeof(text), "f%zu v%zu\n", f, last);
+        write_blob(repo, text, strlen(text), blob);
+        len += (size_t)sprintf((char *)body + len, "100644 f%zu", f) + 1;
+        memcpy(body + len, blob, SHA_SIZE);
+        len += SHA_SIZE;
+    }
+    assert(object_write_buffer(repo, OBJ_TREE, body, len, sha) == true);
+}
+
+static void make_nth_commit(Repository *repo, size_t i, const unsigned char *parent, unsigned char sha[SHA_SIZE]){
+    unsigned char tree[SHA_SIZE];
+    make_tree(repo, i, tree);
+    char body[512], hex[SHA_HEX_SIZE];
+    sha_to_hex(tree, hex);
+    int n = sprintf(body, "tree %s\n", hex);
+    if (parent){
+        sha_to_hex(parent, hex);
+        n += sprintf(body + n, "parent %s\n", hex);
+    }
+    n += sprintf(body + n, "author A <a@example.com> %zu +0000\ncommitter A <a@example.com> %zu +0000\n\nc%zu\n", 100 + i, 100 + i, i);
+    assert(object_write_buffer(repo, OBJ_COMMIT, body, (size_t)n, sha) == true);
+}
+
+/* HISTORY commits on master, and an annotated tag v1 on commit 50 */
+static void make_chain(Repository *repo, unsigned char (*shas)[SHA_SIZE], unsigned char tag[SHA_SIZE]){
+    for (size_t i = 0; i < HISTORY; i++) { make_nth_commit(repo, i, i ? shas[i - 1] : NULL, shas[i]); }
+    write_ref(repo, "refs/heads/master", shas[HISTORY - 1]);
+
+    char body[256], hex[SHA_HEX_SIZE];
+    sha_to_hex(shas[50], hex);
+    int n = sprintf(body, "object %s\ntype commit\ntag v1\ntagger A <a@example.com> 1 +0000\n\nv1\n", hex);
+    assert(object_write_buffer(repo, OBJ_TAG, body, (size_t)n, tag) == true);
+    write_ref(repo, "refs/tags/v1", tag);
+}
+
+static bool list_object(const unsigned char sha[SHA_SIZE], ObjectType type, void *ctx){
+    (void)type;
+    Listed *listed = ctx;
+    listed->shas = realloc(listed->shas, (listed->count + 1) * SHA_SIZE);
+    MALLOC_CHECK(listed->shas);
+    memcpy(listed->shas[listed->count++], sha, SHA_SIZE);
+    return true;
+}
+
+static int compare_shas(const void *a, const void *b) { return memcmp(a, b, SHA_SIZE); }
+
+/* A failed assertion aborts before the cleanup at the end of a test, so start each from scratch */
+static void fixture_reset(void){
+    if (file_exists("test_pack_bitmap")) { remove_directory("test_pack_bitmap"); }
+}
+
+/* Runs the same walk with and without the bitmap and checks both give the same objects */
+static size_t check_walk(Repository *repo, PackBitmap *bitmap, const unsigned char *tip, const unsigned char *exclude, size_t *bitmaps_used){
+    Listed listed[2] = { { 0 } };
+    size_t counts[2][4];
+    for (int b = 0; b < 2; b++){
+        BitmapWalk walk;
+        bitmap_walk_init(&walk, repo, b ? bitmap : NULL);
+        assert(bitmap_walk_push(&walk, tip, false) == true);
+        if (exclude) { assert(bitmap_walk_push(&walk, exclude, true) == true); }
+        assert(bitmap_walk_run(&walk) == true);
+        counts[b][0] = bitmap_walk_count(&walk, OBJ_COMMIT);
+        counts[b][1] = bitmap_walk_count(&walk, OBJ_TREE);
+        counts[b][2] = bitmap_walk_count(&walk, OBJ_BLOB);
+        counts[b][3] = bitmap_walk_count(&walk, OBJ_NONE);
+        assert(bitmap_walk_for_each(&walk, OBJ_NONE, list_object, &listed[b]) == true);
+        if (b) { *bitmaps_used = walk.bitmaps_used; }
+        else   { assert(walk.bitmaps_used == 0); }
+        bitmap_walk_release(&walk);
+    }
+    assert(memcmp(counts[0], counts[1], sizeof(counts[0])) == 0);
+    assert(counts[0][3] == listed[0].count && listed[0].count == listed[1].count);
+    if (listed[0].count){
+        for (int b = 0; b < 2; b++) { qsort(listed[b].shas, listed[b].count, SHA_SIZE, compare_shas); }
+        assert(memcmp(listed[0].shas, listed[1].shas, listed[0].count * SHA_SIZE) == 0);
+    }
+    free(listed[0].shas);
+    free(listed[1].shas);
+    return counts[0][3];
+}
+
+static unsigned char *load_file(const char *path, size_t *size){
+    FILE *fp = safe_fopen(path, "rb");
+    fseek(fp, 0, SEEK_END);
+    *size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char *data = safe_malloc(*size, 1);
+    assert(fread(data, 1, *size, fp) == *size);
+    fclose(fp);
+    return data;
+}
+
+static void save_file(const char *path, const unsigned char *data, size_t size){
+    FILE *fp = safe_fopen(path, "wb");
+    assert(fwrite(data, 1, size, fp) == size);
+    fclose(fp);
+}
+
+/* Tests */
+
+int test_00_pack_bitmap_write(){
+    printf("Running pack_bitmap_write tests...\n");
+
+    fixture_reset();
+    Repository *repo = repo_init("test_pack_bitmap");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(SHA_SIZE, HISTORY), tag[SHA_SIZE];
+    make_chain(repo, shas, tag);
+
+    // Test 1: repack -a -b writes one pack with a bitmap
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true, .bitmap = true };
+    RepackResult result;
+    assert(repack_all(repo, &options, &result) == true);
+    assert(result.name[0] != '\0' && result.pruned == result.objects);
+    assert(result.bitmaps >= HISTORY / PACK_BITMAP_INTERVAL + 1);
+    PackBitmap *bitmap = pack_bitmap_load(repo);
+    assert(bitmap != NULL && bitmap->count == result.objects && bitmap->entry_count == result.bitmaps);
+    printf("Test 1 Passed: %zu objects, %zu bitmaps\n", result.objects, result.bitmaps);
+
+    // Test 2: The type bitmaps split the pack
+    assert(bitmap_count(&bitmap->types[0]) == HISTORY && bitmap_count(&bitmap->types[3]) == 1);
+    size_t total = 0;
+    for (size_t t = 0; t < 4; t++) { total += bitmap_count(&bitmap->types[t]); }
+    assert(total == bitmap->count);
+    printf("Test 2 Passed: Type bitmaps\n");
+
+    // Test 3: The tips have bitmaps of everything they reach
+    uint32_t pos;
+    assert(pack_position(bitmap->pack, shas[HISTORY - 1], &pos) == true && bitmap->entry_of[pos] >= 0);
+    assert(pack_position(bitmap->pack, shas[50], &pos) == true && bitmap->entry_of[pos] >= 0);
+    Bitmap bits = { 0 };
+    ewah_or(&bits, &bitmap->entries[bitmap->entry_of[pos]].ewah);
+    assert(bitmap_count_and(&bits, &bitmap->types[0]) == 51);
+    bitmap_free(&bits);
+    printf("Test 3 Passed: Tip bitmaps\n");
+
+    // Test 4: Repacking again replaces the pack and its bitmap
+    char old[SHA_HEX_SIZE];
+    memcpy(old, result.name, SHA_HEX_SIZE);
+    pack_bitmap_close(bitmap);
+    assert(repack_all(repo, &options, &result) == true);
+    assert(result.packs_removed == (strcmp(old, result.name) != 0) && result.bitmaps > 0);
+    bitmap = pack_bitmap_load(repo);
+    assert(bitmap != NULL && bitmap->count == result.objects);
+    pack_bitmap_close(bitmap);
+    printf("Test 4 Passed: Rewritten bitmap\n");
+
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_pack_bitmap");
+
+    printf("\nAll pack_bitmap_write tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_bitmap_walk(){
+    printf("Running bitmap_walk tests...\n");
+
+    fixture_reset();
+    Repository *repo = repo_init("test_pack_bitmap");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(SHA_SIZE, HISTORY + 1), tag[SHA_SIZE];
+    make_chain(repo, shas, tag);
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = 0, .prune = true, .bitmap = true };
+    RepackResult result;
+    assert(repack_all(repo, &options, &result) == true);
+    PackBitmap *bitmap = pack_bitmap_load(repo);
+    assert(bitmap != NULL);
+
+    // Test 1: The whole history comes from one stored bitmap
+    size_t used;
+    assert(check_walk(repo, bitmap, shas[HISTORY - 1], NULL, &used) == result.objects - 1);
+    assert(used == 1);
+    printf("Test 1 Passed: Full history\n");
+
+    // Test 2: Excluded commits are subtracted
+    size_t count = check_walk(repo, bitmap, shas[HISTORY - 1], shas[HISTORY - 31], &used);
+    assert(count > 30 && count < result.objects / 2 && used > 0);
+    assert(check_walk(repo, bitmap, shas[HISTORY - 1], shas[HISTORY - 1], &used) == 0);
+    printf("Test 2 Passed: Exclusion\n");
+
+    // Test 3: Commits without a bitmap walk to the nearest one
+    assert(check_walk(repo, bitmap, shas[120], NULL, &used) > 0 && used == 1);
+    assert(check_walk(repo, bitmap, tag, shas[10], &used) > 0);
+    printf("Test 3 Passed: Walk to a bitmap\n");
+
+    // Test 4: Loose objects on top of the pack are walked
+    make_nth_commit(repo, HISTORY, shas[HISTORY - 1], shas[HISTORY]);
+    BitmapWalk walk;
+    bitmap_walk_init(&walk, repo, bitmap);
+    assert(bitmap_walk_push(&walk, shas[HISTORY], false) == true && bitmap_walk_run(&walk) == true);
+    assert(walk.extra_count == 5 && walk.commits_walked == 1 && walk.bitmaps_used == 1);
+    assert(bitmap_walk_count(&walk, OBJ_NONE) == result.objects - 1 + 5);
+    bitmap_walk_release(&walk);
+    assert(check_walk(repo, bitmap, shas[HISTORY], shas[HISTORY - 1], &used) == 5);
+    printf("Test 4 Passed: Loose objects\n");
+
+    // Test 5: Counting commits only skips the trees
+    bitmap_walk_init(&walk, repo, NULL);
+    walk.commits_only = true;
+    assert(bitmap_walk_push(&walk, shas[HISTORY], false) == true && bitmap_walk_run(&walk) == true);
+    assert(bitmap_walk_count(&walk, OBJ_NONE) == HISTORY + 1 && walk.trees_read == 0);
+    bitmap_walk_release(&walk);
+    printf("Test 5 Passed: Commits only\n");
+
+    pack_bitmap_close(bitmap);
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_pack_bitmap");
+
+    printf("\nAll bitmap_walk tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_pack_bitmap_open(){
+    printf("Running pack_bitmap_open tests...\n");
+
+    fixture_reset();
+    Repository *repo = repo_init("test_pack_bitmap");
+    assert(repo != NULL);
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(SHA_SIZE, HISTORY), tag[SHA_SIZE];
+    make_chain(repo, shas, tag);
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true, .bitmap = false };
+    RepackResult result;
+
+    // Test 1: No bitmap unless asked for
+    assert(repack_all(repo, &options, &result) == true && result.bitmaps == 0);
+    assert(pack_bitmap_load(repo) == NULL);
+    printf("Test 1 Passed: No bitmap\n");
+
+    // Test 2: A bitmap must name its pack
+    Pack *pack = pack_list(repo);
+    PackBitmapStats stats;
+    assert(pack != NULL && pack_bitmap_write(repo, pack, &stats) == true && stats.objects == result.objects);
+    char name[MAX_PATH];
+    snprintf(name, sizeof(name), "pack-%s.bitmap", result.name);
+    char *path = repo_path(repo, "objects", "pack", name, NULL);
+    chmod(path, 0644);
+    size_t size;
+    unsigned char *data = load_file(path, &size), *copy = safe_malloc(size, 1);
+    memcpy(copy, data, size);
+    copy[12] ^= 1;
+    save_file(path, copy, size);
+    assert(pack_bitmap_open(pack) == NULL);
+    printf("Test 2 Passed: Checksum mismatch\n");
+
+    // Test 3: Damaged files are refused
+    memcpy(copy, data, size);
+    copy[4] = 9;
+    save_file(path, copy, size);
+    assert(pack_bitmap_open(pack) == NULL);
+    memcpy(copy, data, size);
+    for (size_t cut = PACK_BITMAP_HEADER_SIZE + SHA_SIZE; cut < size; cut += 37){
+        save_file(path, copy, cut);
+        assert(pack_bitmap_open(pack) == NULL);
+    }
+    printf("Test 3 Passed: Damaged files\n");
+
+    // Test 4: The intact file opens again
+    save_file(path, data, size);
+    PackBitmap *bitmap = pack_bitmap_open(pack);
+    assert(bitmap != NULL && bitmap->entry_count == stats.commits);
+    pack_bitmap_close(bitmap);
+    printf("Test 4 Passed: Intact file\n");
+
+    free(data);
+    free(copy);
+    free(path);
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_pack_bitmap");
+
+    printf("\nAll pack_bitmap_open tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test pack_bitmap_write\n");
+        fprintf(stderr, "    1. Test bitmap_walk\n");
+        fprintf(stderr, "    2. Test pack_bitmap_open\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_pack_bitmap_write(); break;
+        case 1:  status = test_01_bitmap_walk(); break;
+        case 2:  status = test_02_pack_bitmap_open(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
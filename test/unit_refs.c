@@ -0,0 +1,293 @@
+/* unit_refs.c: unit test reference functions */
+
+#include "refs.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/* Helpers */
+
+static void write_ref(Repository *repo, const char *name, const char *content){
+    char *path = repo_file(repo, true, name, NULL);
+    assert(path != NULL);
+    FILE *fp = safe_fopen(path, "w");
+    fprintf(fp, "%s\n", content);
+    fclose(fp);
+    free(path);
+}
+
+static bool collect(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    char *names = ctx;
+    strcat(names, name);
+    strcat(names, sha[0] == 0x11 ? "=1 " : "=2 ");
+    return true;
+}
+
+static bool stop_early(const char *name, const unsigned char sha[SHA_SIZE], void *ctx){
+    (void)name;
+    (void)sha;
+    (*(int *)ctx)++;
+    return false;
+}
+
+static void write_packed(Repository *repo, const char *content){
+    char *path = repo_file(repo, false, "packed-refs", NULL);
+    FILE *fp = safe_fopen(path, "w");
+    fputs(content, fp);
+    fclose(fp);
+    free(path);
+    packed_refs_free(repo);
+}
+
+static bool loose_exists(Repository *repo, const char *name){
+    char *path = repo_path(repo, name, NULL);
+    bool exists = file_exists(path);
+    free(path);
+    return exists;
+}
+
+static const char *SHA1 = "1111111111111111111111111111111111111111";
+static const char *SHA2 = "2222222222222222222222222222222222222222";
+
+/* Tests */
+
+int test_00_ref_resolve(){
+    printf("Running ref_resolve tests...\n");
+
+    Repository *repo = repo_init("test_refs");
+    assert(repo != NULL);
+    unsigned char sha[SHA_SIZE];
+
+    // Test 1: HEAD follows the symbolic ref once the branch exists
+    assert(ref_read(repo, "HEAD", sha) == false);
+    write_ref(repo, "refs/heads/master", SHA1);
+    assert(ref_read(repo, "HEAD", sha) == true && sha[0] == 0x11);
+    printf("Test 1 Passed: Symbolic HEAD\n");
+
+    // Test 2: Short names are tried in git's order
+    write_ref(repo, "refs/tags/v1", SHA2);
+    write_ref(repo, "refs/heads/v1", SHA1);
+    assert(ref_resolve(repo, "v1", sha) == true && sha[0] == 0x22);
+    assert(ref_resolve(repo, "heads/v1", sha) == true && sha[0] == 0x11);
+    assert(ref_resolve(repo, "master", sha) == true && sha[0] == 0x11);
+    assert(ref_resolve(repo, "refs/tags/v1", sha) == true && sha[0] == 0x22);
+    printf("Test 2 Passed: Short names resolved\n");
+
+    // Test 3: Missing and hostile names
+    assert(ref_resolve(repo, "nope", sha) == false);
+    assert(ref_resolve(repo, "", sha) == false);
+    assert(ref_resolve(repo, "../config", sha) == false);
+    write_ref(repo, "refs/heads/bad", "not a sha");
+    assert(ref_resolve(repo, "bad", sha) == false);
+    printf("Test 3 Passed: Bad names rejected\n");
+
+    // Test 4: Symbolic ref loops stop
+    write_ref(repo, "refs/heads/loop", "ref: refs/heads/loop");
+    assert(ref_read(repo, "refs/heads/loop", sha) == false);
+    printf("Test 4 Passed: Loops detected\n");
+
+    repo_destroy(repo);
+    remove_directory("test_refs");
+
+    printf("\nAll ref_resolve tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_refs_for_each(){
+    printf("Running refs_for_each tests...\n");
+
+    Repository *repo = repo_init("test_refs_each");
+    assert(repo != NULL);
+
+    // Test 1: Every ref, in name order, dangling ones skipped
+    write_ref(repo, "refs/heads/b", SHA2);
+    write_ref(repo, "refs/heads/a", SHA1);
+    write_ref(repo, "refs/heads/feature/x", SHA1);
+    write_ref(repo, "refs/tags/t", SHA2);
+    write_ref(repo, "refs/heads/gone", "ref: refs/heads/missing");
+    write_ref(repo, "refs/heads/c.lock", SHA1);
+    char names[512] = "";
+    assert(refs_for_each(repo, collect, names) == true);
+    assert(streq(names, "refs/heads/a=1 refs/heads/b=2 refs/heads/feature/x=1 refs/tags/t=2 "));
+    printf("Test 1 Passed: Refs listed in order\n");
+
+    // Test 2: The callback can stop the iteration
+    int calls = 0;
+    assert(refs_for_each(repo, stop_early, &calls) == false);
+    assert(calls == 1);
+    printf("Test 2 Passed: Early stop\n");
+
+    repo_destroy(repo);
+    remove_directory("test_refs_each");
+
+    printf("\nAll refs_for_each tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_packed_refs(){
+    printf("Running packed-refs tests...\n");
+
+    Repository *repo = repo_init("test_refs_packed");
+    assert(repo != NULL);
+    unsigned char sha[SHA_SIZE];
+
+    // Test 1: Packed refs resolve, sorted or not
+    write_packed(repo, "2222222222222222222222222222222222222222 refs/tags/v1\n"
+                       "1111111111111111111111111111111111111111 refs/heads/master\n"
+                       "1111111111111111111111111111111111111111 refs/heads/feature/x\n");
+    assert(ref_read(repo, "refs/tags/v1", sha) == true && sha[0] == 0x22);
+    assert(ref_read(repo, "HEAD", sha) == true && sha[0] == 0x11);
+    assert(ref_resolve(repo, "feature/x", sha) == true && sha[0] == 0x11);
+    assert(ref_resolve(repo, "v2", sha) == false);
+    PackedRefs *packed = packed_refs_load(repo);
+    assert(packed != NULL && packed->count == 3 && packed->fully_peeled == false);
+    assert(streq(packed->refs[0].name, "refs/heads/feature/x") && streq(packed->refs[2].name, "refs/tags/v1"));
+    printf("Test 1 Passed: Packed refs resolved\n");
+
+    // Test 2: Loose refs are merged in, hiding packed ones of the same name
+    write_ref(repo, "refs/heads/master", SHA2);
+    write_ref(repo, "refs/heads/loose", SHA1);
+    assert(ref_read(repo, "refs/heads/master", sha) == true && sha[0] == 0x22);
+    char names[512] = "";
+    assert(refs_for_each(repo, collect, names) == true);
+    assert(streq(names, "refs/heads/feature/x=1 refs/heads/loose=1 refs/heads/master=2 refs/tags/v1=2 "));
+    names[0] = '\0';
+    assert(refs_for_each_prefix(repo, "refs/tags/", collect, names) == true && streq(names, "refs/tags/v1=2 "));
+    names[0] = '\0';
+    assert(refs_for_each_prefix(repo, "refs/heads/l", collect, names) == true && streq(names, "refs/heads/loose=1 "));
+    names[0] = '\0';
+    assert(refs_for_each_prefix(repo, "refs/remotes/", collect, names) == true && streq(names, ""));
+    assert(refs_for_each_prefix(repo, "HEAD", collect, names) == false);
+    printf("Test 2 Passed: Loose and packed merged\n");
+
+    // Test 3: Peeled lines answer without reading the tag
+    write_packed(repo, REFS_PACKED_HEADER
+                       "1111111111111111111111111111111111111111 refs/tags/a\n"
+                       "^2222222222222222222222222222222222222222\n"
+                       "2222222222222222222222222222222222222222 refs/tags/b\n");
+    unsigned char peeled[SHA_SIZE];
+    assert(ref_read(repo, "refs/tags/a", sha) == true && ref_peeled(repo, "refs/tags/a", sha, peeled) == true);
+    assert(peeled[0] == 0x22);
+    assert(ref_read(repo, "refs/tags/b", sha) == true && ref_peeled(repo, "refs/tags/b", sha, peeled) == false);
+    assert(packed_refs_load(repo)->fully_peeled == true);
+    printf("Test 3 Passed: Peeled tags\n");
+
+    // Test 4: Malformed files are refused
+    const char *bad[] = {
+        "^2222222222222222222222222222222222222222\n",
+        "1111111111111111111111111111111111111111 HEAD\n",
+        "11111111111111111111111111111111111111 refs/tags/short\n",
+        "1111111111111111111111111111111111111111 refs/tags/a\n^22\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++){
+        write_packed(repo, bad[i]);
+        assert(packed_refs_load(repo) == NULL);
+        assert(ref_read(repo, "refs/tags/a", sha) == false && refs_for_each(repo, collect, names) == false);
+    }
+    write_packed(repo, "");
+    assert(packed_refs_load(repo) != NULL && ref_read(repo, "refs/heads/master", sha) == true);
+    printf("Test 4 Passed: Malformed files\n");
+
+    repo_destroy(repo);
+    remove_directory("test_refs_packed");
+
+    printf("\nAll packed-refs tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_03_refs_pack(){
+    printf("Running refs_pack tests...\n");
+
+    Repository *repo = repo_init("test_refs_pack");
+    assert(repo != NULL);
+    unsigned char blob[SHA_SIZE], tag[SHA_SIZE], sha[SHA_SIZE], peeled[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_BLOB, "tagged\n", 7, blob) == true);
+    char body[256], hex[SHA_HEX_SIZE];
+    sha_to_hex(blob, hex);
+    int n = sprintf(body, "object %s\ntype blob\ntag t\ntagger A <a@example.com> 1 +0000\n\nt\n", hex);
+    assert(object_write_buffer(repo, OBJ_TAG, body, (size_t)n, tag) == true);
+    sha_to_hex(tag, hex);
+
+    write_ref(repo, "refs/heads/master", SHA1);
+    write_ref(repo, "refs/heads/feature/x", SHA2);
+    write_ref(repo, "refs/heads/alias", "ref: refs/heads/master");
+    write_ref(repo, "refs/tags/t", hex);
+    write_ref(repo, "refs/tags/dir/u", SHA2);
+
+    // Test 1: Tags are packed and their loose files removed
+    PackRefsStats stats;
+    assert(refs_pack(repo, false, true, &stats) == true);
+    assert(stats.packed == 2 && stats.pruned == 2);
+    assert(!loose_exists(repo, "refs/tags/t") && !loose_exists(repo, "refs/tags/dir") && loose_exists(repo, "refs/tags"));
+    assert(loose_exists(repo, "refs/heads/master"));
+    assert(ref_read(repo, "refs/tags/t", sha) == true && memcmp(sha, tag, SHA_SIZE) == 0);
+    assert(ref_peeled(repo, "refs/tags/t", sha, peeled) == true && memcmp(peeled, blob, SHA_SIZE) == 0);
+    assert(ref_resolve(repo, "dir/u", sha) == true && sha[0] == 0x22);
+    printf("Test 1 Passed: Tags packed\n");
+
+    // Test 2: --all packs branches but not symbolic refs
+    assert(refs_pack(repo, true, true, &stats) == true);
+    assert(stats.packed == 4 && stats.pruned == 2);
+    assert(!loose_exists(repo, "refs/heads/feature") && loose_exists(repo, "refs/heads/alias"));
+    assert(ref_read(repo, "HEAD", sha) == true && sha[0] == 0x11);
+    assert(ref_read(repo, "refs/heads/alias", sha) == true && sha[0] == 0x11);
+    char names[512] = "";
+    assert(refs_for_each(repo, collect, names) == true);
+    assert(strstr(names, "refs/heads/alias=1 refs/heads/feature/x=2 refs/heads/master=1 refs/tags/dir/u=2 ") == names);
+    printf("Test 2 Passed: All refs packed\n");
+
+    // Test 3: A loose ref written later wins, then replaces the packed value
+    write_ref(repo, "refs/heads/master", SHA2);
+    assert(ref_read(repo, "refs/heads/master", sha) == true && sha[0] == 0x22);
+    assert(refs_pack(repo, true, false, &stats) == true && stats.packed == 4 && stats.pruned == 0);
+    assert(loose_exists(repo, "refs/heads/master"));
+    assert(packed_refs_find(packed_refs_load(repo), "refs/heads/master")->sha[0] == 0x22);
+    printf("Test 3 Passed: Loose value packed\n");
+
+    // Test 4: A held lock is respected
+    char *lock = repo_file(repo, false, REFS_PACKED_LOCK, NULL);
+    FILE *fp = safe_fopen(lock, "w");
+    fclose(fp);
+    assert(refs_pack(repo, true, true, &stats) == false);
+    assert(loose_exists(repo, "refs/heads/master"));
+    unlink(lock);
+    free(lock);
+    printf("Test 4 Passed: Lock respected\n");
+
+    repo_destroy(repo);
+    remove_directory("test_refs_pack");
+
+    printf("\nAll refs_pack tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test ref_resolve\n");
+        fprintf(stderr, "    1. Test refs_for_each\n");
+        fprintf(stderr, "    2. Test packed-refs\n");
+        fprintf(stderr, "    3. Test refs_pack\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_ref_resolve(); break;
+        case 1:  status = test_01_refs_for_each(); break;
+        case 2:  status = test_02_packed_refs(); break;
+        case 3:  status = test_03_refs_pack(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,177 @@
+/* unit_repack.c: unit test repack functions */
+
+#include "objects.h"
+#include "pack.h"
+#include "repack.h"
+#include "repository.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/* Helpers */
+
+static size_t count_loose(Repository *repo){
+    size_t count = 0;
+    for (int b = 0; b < 256; b++){
+        char dir[3];
+        snprintf(dir, sizeof(dir), "%02x", b);
+        char *path = repo_path(repo, "objects", dir, NULL);
+        if (is_directory(path) && !is_directory_empty(path)) { count++; }
+        free(path);
+    }
+    return count;
+}
+
+/* Tests */
+
+int test_00_repack_loose(){
+    printf("Running repack_loose tests...\n");
+
+    Repository *repo = repo_init("test_repack");
+    assert(repo != NULL);
+
+    // 1. Setup: ten versions of a file, each differing by one line, and a tree naming them
+    size_t versions = 10, len = 8000;
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(sizeof(*shas), versions + 1);
+    char *text = safe_malloc(sizeof(char), len);
+    for (size_t v = 0; v < versions; v++){
+        for (size_t i = 0; i < len; i++) { text[i] = (char)('a' + (i * 7 + i / 80) % 26); }
+        snprintf(text + 100 * v, 20, "version %zu", v);
+        assert(object_write_buffer(repo, OBJ_BLOB, text, len, shas[v]) == true);
+    }
+    unsigned char tree[64];
+    memcpy(tree, "100644 file.txt", 16);
+    memcpy(tree + 16, shas[0], SHA_SIZE);
+    assert(object_write_buffer(repo, OBJ_TREE, tree, 16 + SHA_SIZE, shas[versions]) == true);
+
+    // Test 1: Everything lands in one pack, mostly as deltas
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true };
+    RepackResult result;
+    assert(repack_loose(repo, &options, &result) == true);
+    assert(result.objects == versions + 1);
+    assert(result.deltas >= versions - 1);
+    assert(result.name[0] != '\0');
+    printf("Test 1 Passed: %zu objects packed, %zu as deltas\n", result.objects, result.deltas);
+
+    // Test 2: Loose files are gone and every object reads back from the pack
+    assert(result.pruned == versions + 1);
+    assert(count_loose(repo) == 0);
+    for (size_t v = 0; v <= versions; v++){
+        uint64_t offset;
+        assert(pack_lookup(repo, shas[v], &offset) != NULL);
+        ObjectType type;
+        size_t size;
+        unsigned char *body = object_read(repo, shas[v], &type, &size);
+        assert(body != NULL);
+        unsigned char sha[SHA_SIZE];
+        assert(object_write_buffer(NULL, type, body, size, sha) == true);
+        assert(memcmp(sha, shas[v], SHA_SIZE) == 0);
+        free(body);
+    }
+    printf("Test 2 Passed: Loose objects pruned, pack readable\n");
+
+    // Test 3: Nothing left to pack
+    assert(repack_loose(repo, &options, &result) == true);
+    assert(result.objects == 0 && result.name[0] == '\0');
+    printf("Test 3 Passed: Second repack is a no-op\n");
+
+    // Test 4: Loose copies of packed objects are pruned, not packed again
+    assert(object_write_buffer(repo, OBJ_BLOB, text, len, shas[0]) == true);
+    assert(count_loose(repo) == 1);
+    assert(repack_loose(repo, &options, &result) == true);
+    assert(result.objects == 0 && result.pruned == 1);
+    assert(count_loose(repo) == 0);
+    printf("Test 4 Passed: Redundant loose copy pruned\n");
+
+    free(text);
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_repack");
+
+    printf("\nAll repack_loose tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_repack_options(){
+    printf("Running repack options tests...\n");
+
+    Repository *repo = repo_init("test_repack_opts");
+    assert(repo != NULL);
+
+    // 1. Setup: a chain of similar blobs
+    size_t versions = 6, len = 4000;
+    unsigned char (*shas)[SHA_SIZE] = safe_malloc(sizeof(*shas), versions);
+    char *text = safe_calloc(sizeof(char), len);
+    memset(text, 'q', len);
+    for (size_t v = 0; v < versions; v++){
+        text[v * 10] = 'X';
+        assert(object_write_buffer(repo, OBJ_BLOB, text, len, shas[v]) == true);
+    }
+
+    // Test 1: window 0 stores everything whole and keeps loose files
+    RepackOptions options = { .window = 0, .depth = REPACK_DEPTH, .prune = false };
+    RepackResult result;
+    assert(repack_loose(repo, &options, &result) == true);
+    assert(result.objects == versions && result.deltas == 0 && result.pruned == 0);
+    assert(count_loose(repo) > 0);
+    printf("Test 1 Passed: No deltas without a window\n");
+
+    // Test 2: Depth 1 allows deltas only against whole objects
+    char *pack = repo_path(repo, "objects", "pack", NULL);
+    remove_directory(pack);
+    free(pack);
+    pack_list_free(repo);
+    options = (RepackOptions){ .window = REPACK_WINDOW, .depth = 1, .prune = false };
+    assert(repack_loose(repo, &options, &result) == true);
+    assert(result.objects == versions && result.deltas > 0 && result.deltas <= versions - 1);
+    for (Pack *p = pack_list(repo); p; p = p->next){
+        for (size_t v = 0; v < versions; v++){
+            uint64_t offset;
+            if (!pack_find(p, shas[v], &offset)) { continue; }
+            int type;
+            size_t size, header_len;
+            assert(pack_entry_header(p->pack_map + offset, p->pack_size - offset, &type, &size, &header_len));
+            if (type != PACK_OFS_DELTA) { continue; }
+            /* The base of a depth-1 delta is whole. */
+            const unsigned char *q = p->pack_map + offset + header_len;
+            uint64_t distance = *q & 0x7f;
+            while (*q++ & 0x80) { distance = ((distance + 1) << 7) | (*q & 0x7f); }
+            assert(pack_entry_header(p->pack_map + offset - distance, p->pack_size, &type, &size, &header_len));
+            assert(type == OBJ_BLOB);
+        }
+    }
+    printf("Test 2 Passed: Depth limit respected\n");
+
+    free(text);
+    free(shas);
+    repo_destroy(repo);
+    remove_directory("test_repack_opts");
+
+    printf("\nAll repack options tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test repack_loose\n");
+        fprintf(stderr, "    1. Test repack options\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_repack_loose(); break;
+        case 1:  status = test_01_repack_options(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -20,6 +20,7 @@ int test_00_repo_config_create() {
     fprintf(f, "repositoryformatversion = 0\n");
     fprintf(f, "filemode = true\n");
     fprintf(f, "bare = false\n");
+    fprintf(f, "deltaBaseCacheLimit = 8m\n");
     fclose(f);
 
     Configuration *config = repo_config_create(config_path);
@@ -45,7 +46,11 @@ int test_00_repo_config_create() {
     assert(bad_config == NULL);
     printf("Test 5 Passed: Handled missing file correctly\n");
 
-    free(config);
+    // Test 6: Size suffix, case-insensitive key
+    assert(config->delta_base_cache_limit == (size_t)8 << 20);
+    printf("Test 6 Passed: deltaBaseCacheLimit '8m' parsed\n");
+
+    config_free(config);
     remove(config_path);
 
     printf("\nAll repo_config_create tests passed successfully!\n");
@@ -135,10 +140,18 @@ int test_02_repo_path(){
     free(s3);
 
     // Test 4: NULL safety  
-    char *s4 = repo_path(NULL);
+    char *s4 = repo_path(NULL, NULL);
     assert(s4 == NULL);
     printf("Test 4 passed: NULL safety \n");
 
+    // Test 5: Caller buffer form
+    char buf[MAX_PATH];
+    assert(repo_path_buf(repo, buf, sizeof(buf), "objects", "ab", "cdef", NULL) == buf);
+    assert(streq(buf, "test_repo_zone/.git/objects/ab/cdef"));
+    assert(repo_path_buf(repo, buf, 8, "objects", NULL) == NULL);
+    assert(repo_path_buf(NULL, buf, sizeof(buf), NULL) == NULL);
+    printf("Test 5 passed: Buffer path\n");
+
     repo_destroy(repo);
     
     printf("\nAll path_join tests passed successfully!\n");
@@ -183,7 +196,7 @@ int test_03_repo_dir() {
     printf("Test 3 Passed: Correctly returned NULL for missing dir when mkdir=false\n");
 
     // --- Test 4: Failure when path is blocked by a file ---
-    char *file_path = path_join(gitdir, "blocked_dir");
+    char *file_path = path_join(gitdir, "blocked_dir", NULL);
     FILE *f = fopen(file_path, "w");
     fclose(f);
     char *res4 = repo_dir(&repo, true, "blocked_dir", NULL);
@@ -264,7 +277,7 @@ int test_05_repo_init() {
     printf("Test 1b Passed: All internal .git directories created\n");
 
     // Check Files and Content
-    char *head_path = path_join(test_path, ".git/HEAD");
+    char *head_path = path_join(test_path, ".git/HEAD", NULL);
     FILE *f_head = fopen(head_path, "r");
     assert(f_head != NULL);
     char line[256];
@@ -274,7 +287,7 @@ int test_05_repo_init() {
     free(head_path);
     printf("Test 1c Passed: HEAD file initialized correctly\n");
 
-    char *config_path = path_join(test_path, ".git/config");
+    char *config_path = path_join(test_path, ".git/config", NULL);
     assert(file_exists(config_path));
     free(config_path);
     printf("Test 1d Passed: Config file created\n");
@@ -343,6 +356,115 @@ int test_06_repo_find() {
     return EXIT_SUCCESS;
 }
 
+int test_07_repo_find_env() {
+    printf("Running repo_find environment tests...\n");
+
+    // test_env/.git, test_env/level1/level2, test_env/wt/.git -> "gitdir: ../.git"
+    Repository *initial_repo = repo_init("test_env");
+    assert(initial_repo != NULL);
+    repo_destroy(initial_repo);
+    mkdir_p("test_env/level1/level2", 0755);
+    mkdir_p("test_env/wt", 0755);
+    char *abs_root = realpath("test_env", NULL);
+    char *abs_level1 = realpath("test_env/level1", NULL);
+    assert(abs_root != NULL && abs_level1 != NULL);
+
+    // Test 1: GIT_DIR and GIT_WORK_TREE bypass the walk
+    setenv("GIT_DIR", "test_env/.git", 1);
+    setenv("GIT_WORK_TREE", "test_env/level1", 1);
+    Repository *repo = repo_find("/", false);
+    assert(repo != NULL);
+    assert(streq(repo->gitdir, "test_env/.git") && streq(repo->worktree, abs_level1));
+    repo_destroy(repo);
+    setenv("GIT_DIR", "test_env/level1", 1);
+    assert(repo_find(".", false) == NULL);
+    unsetenv("GIT_DIR");
+    unsetenv("GIT_WORK_TREE");
+    printf("Test 1 Passed: GIT_DIR honoured\n");
+
+    // Test 2: The walk stops below a ceiling, but the start itself is probed
+    setenv("GIT_CEILING_DIRECTORIES", abs_level1, 1);
+    assert(repo_find("test_env/level1/level2", false) == NULL);
+    repo = repo_find("test_env/level1", false);
+    assert(repo != NULL && streq(repo->worktree, abs_root));
+    repo_destroy(repo);
+    unsetenv("GIT_CEILING_DIRECTORIES");
+    repo = repo_find("test_env/level1/level2", false);
+    assert(repo != NULL && streq(repo->worktree, abs_root));
+    repo_destroy(repo);
+    printf("Test 2 Passed: GIT_CEILING_DIRECTORIES honoured\n");
+
+    // Test 3: A .git file redirects to the real git directory
+    FILE *f = fopen("test_env/wt/.git", "w");
+    fprintf(f, "gitdir: ../.git\n");
+    fclose(f);
+    repo = repo_find("test_env/wt", false);
+    assert(repo != NULL);
+    char *abs_gitdir = realpath(repo->gitdir, NULL);
+    assert(abs_gitdir != NULL && strncmp(abs_gitdir, abs_root, strlen(abs_root)) == 0);
+    assert(streq(abs_gitdir + strlen(abs_root), "/.git"));
+    assert(strstr(repo->worktree, "test_env/wt") != NULL);
+    free(abs_gitdir);
+    repo_destroy(repo);
+    printf("Test 3 Passed: gitdir file followed\n");
+
+    // Test 4: Repeated lookups are cached until the config changes
+    repo = repo_find("test_env/level1/level2", false);
+    assert(repo != NULL && repo->config->delta_base_cache_limit == DELTA_BASE_CACHE_LIMIT);
+    repo_destroy(repo);
+    repo = repo_find("test_env/level1/level2", false);
+    assert(repo != NULL && streq(repo->worktree, abs_root));
+    repo_destroy(repo);
+    f = fopen("test_env/.git/config", "a");
+    fprintf(f, "deltaBaseCacheLimit = 1m\n");
+    fclose(f);
+    repo = repo_find("test_env/level1/level2", false);
+    assert(repo != NULL && repo->config->delta_base_cache_limit == (size_t)1 << 20);
+    repo_destroy(repo);
+    printf("Test 4 Passed: Cached discovery revalidated\n");
+
+    free(abs_root);
+    free(abs_level1);
+    remove_directory("test_env");
+
+    printf("\nAll repo_find environment tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_08_repo_dirfds() {
+    printf("Running repository directory handle tests...\n");
+
+    Repository *repo = repo_init("test_dirfds");
+    assert(repo != NULL);
+
+    // Test 1: Handles open lazily and missing fan-out dirs are not created
+    assert(atomic_load(&repo->objects_fd) == -1);
+    assert(repo_fanout_fd(repo, 0xab, false) == -1);
+    assert(repo_objects_fd(repo) >= 0 && atomic_load(&repo->gitdir_fd) >= 0);
+    assert(!is_directory("test_dirfds/.git/objects/ab"));
+    printf("Test 1 Passed: Lazy handles\n");
+
+    // Test 2: Created on request, then cached
+    int fd = repo_fanout_fd(repo, 0xab, true);
+    assert(fd >= 0 && is_directory("test_dirfds/.git/objects/ab"));
+    assert(repo_fanout_fd(repo, 0xab, false) == fd);
+    assert(repo_fanout_fd(repo, REPO_FANOUT_DIRS, true) == -1);
+    printf("Test 2 Passed: Fan-out handle cached\n");
+
+    // Test 3: Forgetting drops the handle of a removed directory
+    assert(rmdir("test_dirfds/.git/objects/ab") == 0);
+    repo_fanout_forget(repo, 0xab);
+    assert(atomic_load(&repo->fanout_fds[0xab]) == -1);
+    assert(repo_fanout_fd(repo, 0xab, false) == -1);
+    printf("Test 3 Passed: Handle forgotten\n");
+
+    repo_destroy(repo);
+    remove_directory("test_dirfds");
+
+    printf("\nAll repository directory handle tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
@@ -354,6 +476,8 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    4. Test repo_file\n");
         fprintf(stderr, "    5. Test repo_init\n");
         fprintf(stderr, "    6. Test repo_find\n");
+        fprintf(stderr, "    7. Test repo_find environment\n");
+        fprintf(stderr, "    8. Test repository directory handles\n");
         return EXIT_FAILURE;
     }
 
@@ -368,6 +492,8 @@ int main(int argc, char *argv[]) {
         case 4:  status = test_04_repo_file(); break;
         case 5:  status = test_05_repo_init(); break;
         case 6:  status = test_06_repo_find(); break;
+        case 7:  status = test_07_repo_find_env(); break;
+        case 8:  status = test_08_repo_dirfds(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
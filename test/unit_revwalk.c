@@ -0,0 +1,153 @@
+/* unit_revwalk.c: unit test history walking functions */
+
+#include "revwalk.h"
+#include "commit_graph.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+enum { R, A, B, C, D, O, H };         /* the commits of make_history() */
+
+static void check_order(Repository *repo, const unsigned char start[SHA_SIZE], unsigned char shas[7][SHA_SIZE],
+                        const int *expected, size_t count, size_t *from_graph, size_t *from_objects){
+    RevWalk walk;
+    revwalk_init(&walk, repo);
+    assert(revwalk_push(&walk, start) == true);
+
+    RevCommit commit;
+    size_t n = 0;
+    while (revwalk_next(&walk, &commit)){
+        assert(n < count);
+        assert(memcmp(commit.sha, shas[expected[n]], SHA_SIZE) == 0);
+        if (expected[n] == O){
+            assert(commit.parent_count == 3);
+            assert(memcmp(commit.parents[2], shas[D], SHA_SIZE) == 0);
+        }
+        n++;
+    }
+    assert(n == count && walk.error == false);
+    *from_graph = walk.from_graph;
+    *from_objects = walk.from_objects;
+    revwalk_release(&walk);
+}
+
+/* Tests */
+
+int test_00_revwalk_order(){
+    printf("Running revwalk order tests...\n");
+
+    Repository *repo = repo_init("test_revwalk");
+    assert(repo != NULL);
+    unsigned char tree[SHA_SIZE], shas[7][SHA_SIZE];
+    make_history(repo, tree, shas);
+
+    const int order[] = { H, O, B, C, D, A, R };
+    size_t from_graph, from_objects;
+
+    // Test 1: Newest first, ties in queue order, every commit once
+    check_order(repo, shas[H], shas, order, 7, &from_graph, &from_objects);
+    assert(from_graph == 0 && from_objects == 7);
+    printf("Test 1 Passed: Date order from commit objects\n");
+
+    // Test 2: The same walk answered entirely by the commit-graph
+    assert(commit_graph_write(repo, false, NULL) == true);
+    check_order(repo, shas[H], shas, order, 7, &from_graph, &from_objects);
+    assert(from_graph == 7 && from_objects == 0);
+    printf("Test 2 Passed: Date order from the commit-graph\n");
+
+    // Test 3: Commits newer than the graph are parsed, the rest is not
+    unsigned char newest[SHA_SIZE];
+    make_commit(repo, tree, &shas[H], 1, 600, newest);
+    RevWalk walk;
+    revwalk_init(&walk, repo);
+    assert(revwalk_push(&walk, newest) == true);
+    RevCommit commit;
+    assert(revwalk_next(&walk, &commit) == true && commit.commit != NULL);
+    assert(commit.generation == COMMIT_GRAPH_GENERATION_INFINITY);
+    for (size_t i = 0; i < 7; i++){
+        assert(revwalk_next(&walk, &commit) == true && commit.commit == NULL);
+        assert(memcmp(commit.sha, shas[order[i]], SHA_SIZE) == 0);
+    }
+    assert(revwalk_next(&walk, &commit) == false && walk.error == false);
+    assert(walk.from_objects == 1 && walk.from_graph == 7);
+    revwalk_release(&walk);
+    printf("Test 3 Passed: Mixed graph and object walk\n");
+
+    // Test 4: Tags are peeled, non-commits rejected
+    revwalk_init(&walk, repo);
+    assert(revwalk_push(&walk, tree) == false);
+    revwalk_release(&walk);
+    printf("Test 4 Passed: Non-commit start rejected\n");
+
+    repo_destroy(repo);
+    remove_directory("test_revwalk");
+
+    printf("\nAll revwalk order tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_revwalk_is_ancestor(){
+    printf("Running revwalk_is_ancestor tests...\n");
+
+    Repository *repo = repo_init("test_revwalk_anc");
+    assert(repo != NULL);
+    unsigned char tree[SHA_SIZE], shas[7][SHA_SIZE];
+    make_history(repo, tree, shas);
+
+    for (int pass = 0; pass < 2; pass++){
+        bool result;
+
+        // Test 1: Ancestors are found
+        assert(revwalk_is_ancestor(repo, shas[R], shas[H], &result) == true && result == true);
+        assert(revwalk_is_ancestor(repo, shas[D], shas[O], &result) == true && result == true);
+        assert(revwalk_is_ancestor(repo, shas[H], shas[H], &result) == true && result == true);
+
+        // Test 2: Non-ancestors are not
+        assert(revwalk_is_ancestor(repo, shas[H], shas[R], &result) == true && result == false);
+        assert(revwalk_is_ancestor(repo, shas[C], shas[B], &result) == true && result == false);
+        assert(revwalk_is_ancestor(repo, shas[C], shas[D], &result) == true && result == false);
+
+        printf("Test %d Passed: Ancestry %s the commit-graph\n", pass + 1, pass ? "with" : "without");
+        assert(commit_graph_write(repo, false, NULL) == true);
+    }
+
+    // Test 3: Missing commits are an error
+    bool result;
+    assert(revwalk_is_ancestor(repo, tree, shas[H], &result) == false);
+    printf("Test 3 Passed: Missing commit reported\n");
+
+    repo_destroy(repo);
+    remove_directory("test_revwalk_anc");
+
+    printf("\nAll revwalk_is_ancestor tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test revwalk order\n");
+        fprintf(stderr, "    1. Test revwalk_is_ancestor\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_revwalk_order(); break;
+        case 1:  status = test_01_revwalk_is_ancestor(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
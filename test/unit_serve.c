@@ -0,0 +1,225 @@
+/* unit_serve.c: unit test batch object serving functions */
+
+#include "serve.h"
+#include "objects.h"
+#include "repack.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* Helpers */
+
+typedef struct {
+    Repository *repo;
+    int        in_fd;
+    int        out_fd;
+    bool       status;
+    ServeStats stats;
+} ServeThread;
+
+static void *serve_thread(void *ctx){
+    ServeThread *thread = ctx;
+    thread->status = serve_batch(thread->repo, thread->in_fd, thread->out_fd, false, &thread->stats);
+    close(thread->out_fd);
+    return NULL;
+}
+
+/* Runs one batch session from a file of requests into a file of answers */
+static unsigned char *serve_file(Repository *repo, const char *requests, bool check, ServeStats *stats, size_t *len){
+    write_file("test_serve/requests", requests, strlen(requests));
+    int in = open("test_serve/requests", O_RDONLY);
+    int out = open("test_serve/answers", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(in >= 0 && out >= 0);
+    assert(serve_batch(repo, in, out, check, stats) == true);
+    close(in);
+    close(out);
+
+    FILE *fp = safe_fopen("test_serve/answers", "rb");
+    fseek(fp, 0, SEEK_END);
+    *len = (size_t)ftell(fp);
+    rewind(fp);
+    unsigned char *data = safe_malloc(*len + 1, 1);
+    assert(fread(data, 1, *len, fp) == *len);
+    fclose(fp);
+    return data;
+}
+
+/* Appends "<sha> <type> <size>\n" and, unless check, the body and a newline */
+static size_t expect(unsigned char *buf, size_t len, const unsigned char sha[SHA_SIZE], const char *type,
+                     const void *body, size_t size, bool check){
+    char hex[SHA_HEX_SIZE];
+    sha_to_hex(sha, hex);
+    len += (size_t)sprintf((char *)buf + len, "%s %s %zu\n", hex, type, size);
+    if (!check){
+        memcpy(buf + len, body, size);
+        len += size;
+        buf[len++] = '\n';
+    }
+    return len;
+}
+
+/* Tests */
+
+int test_00_serve_batch(){
+    printf("Running serve batch tests...\n");
+
+    Repository *repo = repo_init("test_serve");
+    assert(repo != NULL);
+
+    unsigned char blob[SHA_SIZE], big[SHA_SIZE], tree[SHA_SIZE], commit[SHA_SIZE], tag[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, blob) == true);
+    size_t big_len = 3 * SERVE_OUTPUT_BUFFER + 7;
+    unsigned char *big_data = safe_malloc(big_len, 1);
+    for (size_t i = 0; i < big_len; i++) { big_data[i] = (unsigned char)(i * 7 + i / 251); }
+    assert(object_write_buffer(repo, OBJ_BLOB, big_data, big_len, big) == true);
+
+    unsigned char tree_body[64];
+    size_t tree_len = (size_t)sprintf((char *)tree_body, "100644 hello") + 1;
+    memcpy(tree_body + tree_len, blob, SHA_SIZE);
+    tree_len += SHA_SIZE;
+    assert(object_write_buffer(repo, OBJ_TREE, tree_body, tree_len, tree) == true);
+
+    char text[512], hex[SHA_HEX_SIZE + 1];
+    sha_to_hex(tree, hex);
+    int commit_len = sprintf(text, "tree %s\nauthor A <a@example.com> 1 +0000\ncommitter A <a@example.com> 1 +0000\n\nc\n", hex);
+    assert(object_write_buffer(repo, OBJ_COMMIT, text, (size_t)commit_len, commit) == true);
+    char commit_body[512];
+    memcpy(commit_body, text, (size_t)commit_len);
+    sha_to_hex(commit, hex);
+    int tag_len = sprintf(text, "object %s\ntype commit\ntag v1\ntagger A <a@example.com> 1 +0000\n\nt\n", hex);
+    assert(object_write_buffer(repo, OBJ_TAG, text, (size_t)tag_len, tag) == true);
+    char tag_body[512];
+    memcpy(tag_body, text, (size_t)tag_len);
+    sha_to_hex(tag, hex);
+    strcat(hex, "\n");
+    write_file("test_serve/.git/refs/tags/v1", hex, strlen(hex));
+
+    char requests[1024], blob_hex[SHA_HEX_SIZE], big_hex[SHA_HEX_SIZE], tree_hex[SHA_HEX_SIZE];
+    sha_to_hex(blob, blob_hex);
+    sha_to_hex(big, big_hex);
+    sha_to_hex(tree, tree_hex);
+    sprintf(requests, "%s\n%s\nv1 tree\nv1 commit\n%s tree\n%s\n%s\nv1 bogus\nv1",
+            blob_hex, tree_hex, blob_hex, "0000000000000000000000000000000000000000", big_hex);
+
+    unsigned char *want = safe_malloc(2 * big_len, 1);
+    for (int check = 0; check < 2; check++){
+        size_t len = 0;
+        len = expect(want, len, blob, "blob", "hello\n", 6, check);
+        len = expect(want, len, tree, "tree", tree_body, tree_len, check);
+        len = expect(want, len, tree, "tree", tree_body, tree_len, check);
+        len = expect(want, len, commit, "commit", commit_body, (size_t)commit_len, check);
+        len += (size_t)sprintf((char *)want + len, "%s tree missing\n0000000000000000000000000000000000000000 missing\n", blob_hex);
+        len = expect(want, len, big, "blob", big_data, big_len, check);
+        len += (size_t)sprintf((char *)want + len, "v1 bogus missing\n");
+        len = expect(want, len, tag, "tag", tag_body, (size_t)tag_len, check);
+
+        // Test 1 (contents) and Test 2 (check): one answer per request, in order
+        ServeStats stats;
+        size_t got_len;
+        unsigned char *got = serve_file(repo, requests, check, &stats, &got_len);
+        assert(got_len == len && memcmp(got, want, len) == 0);
+        assert(stats.requests == 9 && stats.missing == 3);
+        assert(stats.bytes == (check ? 0 : 6 + 2 * tree_len + (size_t)commit_len + big_len + (size_t)tag_len));
+        free(got);
+        /* peeling v1 parsed the tag and commit only, not the tree served */
+        assert(repo->object_cache && repo->object_cache->count == 2);
+        if (!check) { printf("Test 1 Passed: Contents, peeling and misses\n"); }
+        else        { printf("Test 2 Passed: Headers only\n"); }
+    }
+
+    // Test 3: No input, no output
+    ServeStats stats;
+    size_t got_len;
+    free(serve_file(repo, "", false, &stats, &got_len));
+    assert(got_len == 0 && stats.requests == 0);
+    printf("Test 3 Passed: Empty session\n");
+
+    free(want);
+    free(big_data);
+    repo_destroy(repo);
+    remove_directory("test_serve");
+
+    printf("\nAll serve batch tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_serve_rescan(){
+    printf("Running serve rescan tests...\n");
+
+    Repository *repo = repo_init("test_serve_rescan");
+    assert(repo != NULL);
+    unsigned char blob[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_BLOB, "data\n", 5, blob) == true);
+    char request[SHA_HEX_SIZE + 1], want[128];
+    sha_to_hex(blob, request);
+    int want_len = sprintf(want, "%s blob 5\ndata\n\n", request);
+    strcat(request, "\n");
+
+    int requests[2], answers[2];
+    assert(pipe(requests) == 0 && pipe(answers) == 0);
+    ServeThread thread = { .repo = repo, .in_fd = requests[0], .out_fd = answers[1] };
+    pthread_t id;
+    assert(pthread_create(&id, NULL, serve_thread, &thread) == 0);
+
+    // Test 1: An answer is flushed before the server waits for more requests
+    char got[128];
+    assert(write_all(requests[1], request, SHA_HEX_SIZE) == true);
+    ssize_t n = 0;
+    while (n < want_len) { n += read(answers[0], got + n, sizeof(got) - (size_t)n); }
+    assert(n == want_len && memcmp(got, want, (size_t)want_len) == 0);
+    printf("Test 1 Passed: Interactive answer\n");
+
+    // Test 2: A pack written during the session is found once the loose copy is gone
+    Repository *other = repo_find("test_serve_rescan", true);
+    RepackOptions options = { .window = REPACK_WINDOW, .depth = REPACK_DEPTH, .prune = true };
+    RepackResult result;
+    assert(repack_loose(other, &options, &result) == true && result.pruned == 1);
+    repo_destroy(other);
+
+    assert(write_all(requests[1], request, SHA_HEX_SIZE) == true);
+    close(requests[1]);
+    n = 0;
+    ssize_t r;
+    while ((r = read(answers[0], got + n, sizeof(got) - (size_t)n)) > 0) { n += r; }
+    assert(n == want_len && memcmp(got, want, (size_t)want_len) == 0);
+    pthread_join(id, NULL);
+    assert(thread.status == true && thread.stats.rescans == 1 && thread.stats.missing == 0);
+    close(requests[0]);
+    close(answers[0]);
+    printf("Test 2 Passed: New packs picked up\n");
+
+    repo_destroy(repo);
+    remove_directory("test_serve_rescan");
+
+    printf("\nAll serve rescan tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test serve batch\n");
+        fprintf(stderr, "    1. Test serve rescan\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_serve_batch(); break;
+        case 1:  status = test_01_serve_rescan(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
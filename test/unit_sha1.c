@@ -0,0 +1,137 @@
+/* unit_sha1.c: unit test sha1 functions */
+
+#include "sha1.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static const Sha1Backend BACKENDS[] = {
+    SHA1_BACKEND_PORTABLE,
+    SHA1_BACKEND_SHANI,
+    SHA1_BACKEND_ARMV8,
+};
+
+static void digest_hex(const void *data, size_t len, char hex[SHA_HEX_SIZE]){
+    unsigned char digest[SHA_SIZE];
+    sha1_buffer(data, len, digest);
+    sha_to_hex(digest, hex);
+}
+
+/* Tests */
+
+int test_00_sha1_vectors(){
+    printf("Running sha1 vector tests...\n");
+
+    const char *inputs[] = {
+        "",
+        "abc",
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        "blob 6\0hello\n",
+    };
+    const size_t lengths[] = { 0, 3, 56, 13 };
+    const char *expected[] = {
+        "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+        "a9993e364706816aba3e25717850c26c9cd0d89d",
+        "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+        "ce013625030ba8dba906f756967f9e9ca394464a",
+    };
+
+    for (size_t b = 0; b < sizeof(BACKENDS) / sizeof(BACKENDS[0]); b++){
+        if (!sha1_set_backend(BACKENDS[b])){
+            printf("Backend %s not supported here, skipped\n", sha1_backend_name(BACKENDS[b]));
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++){
+            char hex[SHA_HEX_SIZE];
+            digest_hex(inputs[i], lengths[i], hex);
+            assert(streq(hex, expected[i]));
+        }
+        printf("Test %zu Passed: %s backend matches known vectors\n", b + 1, sha1_backend_name(BACKENDS[b]));
+    }
+
+    printf("\nAll sha1 vector tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_sha1_incremental(){
+    printf("Running sha1 incremental tests...\n");
+
+    // 1. Setup: one million 'a' characters
+    size_t len = 1000000;
+    unsigned char *data = safe_malloc(sizeof(unsigned char), len);
+    memset(data, 'a', len);
+
+    // Test 1: Odd-sized updates straddle block boundaries
+    for (size_t b = 0; b < sizeof(BACKENDS) / sizeof(BACKENDS[0]); b++){
+        if (!sha1_set_backend(BACKENDS[b])) { continue; }
+
+        Sha1Context ctx;
+        sha1_init(&ctx);
+        size_t offset = 0, step = 1;
+        while (offset < len){
+            size_t take = min(step, len - offset);
+            sha1_update(&ctx, data + offset, take);
+            offset += take;
+            step = (step * 7 + 3) % 1000 + 1;
+        }
+        unsigned char digest[SHA_SIZE];
+        char hex[SHA_HEX_SIZE];
+        sha1_final(&ctx, digest);
+        sha_to_hex(digest, hex);
+        assert(streq(hex, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+    }
+    printf("Test 1 Passed: Chunked updates of 1M 'a'\n");
+
+    // Test 2: Every backend agrees on every length up to a few blocks
+    for (size_t i = 0; i < len; i++) { data[i] = (unsigned char)(i * 31 + (i >> 3)); }
+    for (size_t n = 0; n < 300; n++){
+        char reference[SHA_HEX_SIZE];
+        sha1_set_backend(SHA1_BACKEND_PORTABLE);
+        digest_hex(data, n, reference);
+        for (size_t b = 1; b < sizeof(BACKENDS) / sizeof(BACKENDS[0]); b++){
+            if (!sha1_set_backend(BACKENDS[b])) { continue; }
+            char hex[SHA_HEX_SIZE];
+            digest_hex(data, n, hex);
+            assert(streq(hex, reference));
+        }
+    }
+    printf("Test 2 Passed: Backends agree for lengths 0-299\n");
+
+    // Test 3: Unsupported backends are refused
+    sha1_set_backend(SHA1_BACKEND_PORTABLE);
+    assert(sha1_backend() == SHA1_BACKEND_PORTABLE);
+    assert(sha1_set_backend((Sha1Backend)42) == false);
+    assert(sha1_backend() == SHA1_BACKEND_PORTABLE);
+    printf("Test 3 Passed: Unknown backend rejected\n");
+
+    free(data);
+
+    printf("\nAll sha1 incremental tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test sha1 vectors\n");
+        fprintf(stderr, "    1. Test sha1 incremental\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_sha1_vectors(); break;
+        case 1:  status = test_01_sha1_incremental(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -0,0 +1,334 @@
+/* unit_status.c: unit test status functions */
+
+#include "status.h"
+#include "index.h"
+#include "objects.h"
+#include "repository.h"
+#include "utils.h"
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Helpers */
+
+static bool write_index_tree(Repository *repo, const Index *index, size_t *pos, const char *prefix, size_t prefix_len, unsigned char sha[SHA_SIZE]){
+    unsigned char body[8192];
+    size_t len = 0;
+    while (*pos < index->count){
+        const IndexEntry *entry = &index->entries[*pos];
+        if (entry->name_len <= prefix_len || strncmp(entry->name, prefix, prefix_len) != 0) { break; }
+        const char *name = entry->name + prefix_len;
+        const char *slash = strchr(name, '/');
+        unsigned char child[SHA_SIZE];
+        if (slash){
+            assert(write_index_tree(repo, index, pos, entry->name, (size_t)(slash - entry->name) + 1, child));
+            len += (size_t)sprintf((char *)body + len, "40000 %.*s", (int)(slash - name), name) + 1;
+        } else {
+            memcpy(child, entry->sha, SHA_SIZE);
+            len += (size_t)sprintf((char *)body + len, "%o %s", entry->mode, name) + 1;
+            (*pos)++;
+        }
+        memcpy(body + len, child, SHA_SIZE);
+        len += SHA_SIZE;
+    }
+    return object_write_buffer(repo, OBJ_TREE, body, len, sha);
+}
+
+static void commit_index(Repository *repo, const Index *index){
+    unsigned char tree[SHA_SIZE], commit[SHA_SIZE];
+    size_t pos = 0;
+    assert(write_index_tree(repo, index, &pos, "", 0, tree));
+
+    char hex[SHA_HEX_SIZE], body[256];
+    sha_to_hex(tree, hex);
+    int len = snprintf(body, sizeof(body), "tree %s\nauthor A <a@b> 0 +0000\ncommitter A <a@b> 0 +0000\n\nmsg\n", hex);
+    assert(object_write_buffer(repo, OBJ_COMMIT, body, (size_t)len, commit));
+
+    char *path = repo_file(repo, true, "refs", "heads", "master", NULL);
+    FILE *fp = safe_fopen(path, "w");
+    sha_to_hex(commit, hex);
+    fprintf(fp, "%s\n", hex);
+    fclose(fp);
+    free(path);
+}
+
+static StatusOptions options_for(const Repository *repo, UntrackedMode mode){
+    StatusOptions options;
+    status_options_init(&options, repo);
+    options.untracked = mode;
+    options.threads = 4;
+    return options;
+}
+
+static bool has_item(const StatusResult *result, const char *path, char staged, char worktree){
+    for (size_t i = 0; i < result->count; i++){
+        const StatusItem *item = &result->items[i];
+        if (streq(item->path, path)) { return item->staged == staged && item->worktree == worktree; }
+    }
+    return false;
+}
+
+/* Tests */
+
+int test_00_status_tracked(){
+    printf("Running status tracked tests...\n");
+
+    Repository *repo = repo_init("test_status");
+    assert(repo != NULL);
+    mkdir_p("test_status/dir", 0755);
+    write_old_text("test_status/a", "alpha\n");
+    write_old_text("test_status/dir/b", "beta\n");
+    write_old_text("test_status/c", "gamma\n");
+    Index *index = index_new();
+    add_file(repo, index, "test_status", "a");
+    add_file(repo, index, "test_status", "c");
+    add_file(repo, index, "test_status", "dir/b");
+    assert(index_write(repo, index) == true);
+    StatusOptions options = options_for(repo, UNTRACKED_NO);
+    StatusResult result;
+
+    // Test 1: Without a commit everything in the index is added
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && has_item(&result, "a", 'A', ' ') && has_item(&result, "dir/b", 'A', ' '));
+    status_result_free(&result);
+    printf("Test 1 Passed: Unborn branch\n");
+
+    // Test 2: A clean tree after committing needs no hashing
+    commit_index(repo, index);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 0 && result.checked == 3 && result.hashed == 0);
+    status_result_free(&result);
+    printf("Test 2 Passed: Clean after commit\n");
+
+    // Test 3: Modified, deleted and type-changed files
+    write_old_text("test_status/a", "ALPHA\n");
+    unlink("test_status/dir/b");
+    unlink("test_status/c");
+    assert(symlink("a", "test_status/c") == 0);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && has_item(&result, "a", ' ', 'M') && has_item(&result, "dir/b", ' ', 'D') && has_item(&result, "c", ' ', 'T'));
+    assert(result.hashed == 1 && result.refreshed == 0);
+    status_result_free(&result);
+    printf("Test 3 Passed: Worktree changes\n");
+
+    // Test 4: Touched but unchanged files are refreshed once
+    write_old_text("test_status/a", "alpha\n");
+    write_old_text("test_status/dir/b", "beta\n");
+    unlink("test_status/c");
+    write_old_text("test_status/c", "gamma\n");
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 0 && result.hashed == 3 && result.refreshed == 3);
+    status_result_free(&result);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 0 && result.hashed == 0 && result.refreshed == 0);
+    status_result_free(&result);
+    printf("Test 4 Passed: Stat data refreshed\n");
+
+    // Test 5: Staged changes compare the index against HEAD
+    index_free(index);
+    index = index_read(repo);
+    write_old_text("test_status/a", "staged\n");
+    write_old_text("test_status/new", "new\n");
+    add_file(repo, index, "test_status", "a");
+    add_file(repo, index, "test_status", "new");
+    assert(index_write(repo, index) == true);
+    write_old_text("test_status/a", "staged and more\n");
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 2 && has_item(&result, "a", 'M', 'M') && has_item(&result, "new", 'A', ' '));
+    assert(streq(result.items[0].path, "a") && streq(result.items[1].path, "new"));
+    status_result_free(&result);
+    printf("Test 5 Passed: Staged changes\n");
+
+    index_free(index);
+    repo_destroy(repo);
+    remove_directory("test_status");
+
+    printf("\nAll status tracked tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_status_untracked(){
+    printf("Running status untracked tests...\n");
+
+    Repository *repo = repo_init("test_status_un");
+    assert(repo != NULL);
+    mkdir_p("test_status_un/dir", 0755);
+    mkdir_p("test_status_un/un/deep", 0755);
+    mkdir_p("test_status_un/empty", 0755);
+    write_old_text("test_status_un/.gitignore", "*.log\n");
+    write_old_text("test_status_un/dir/tracked", "t\n");
+    write_old_text("test_status_un/dir/x", "x\n");
+    write_old_text("test_status_un/dir/x.log", "l\n");
+    write_old_text("test_status_un/new.txt", "n\n");
+    write_old_text("test_status_un/un/deep/f", "f\n");
+    Index *index = index_new();
+    add_file(repo, index, "test_status_un", ".gitignore");
+    add_file(repo, index, "test_status_un", "dir/tracked");
+    assert(index_write(repo, index) == true);
+    commit_index(repo, index);
+    StatusOptions options = options_for(repo, UNTRACKED_NORMAL);
+    StatusResult result;
+
+    // Test 1: Untracked directories collapse, ignored files are left out
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && streq(result.items[0].path, "dir/x") && streq(result.items[1].path, "new.txt"));
+    assert(streq(result.items[2].path, "un/") && result.items[2].staged == '?' && result.dirs_read == 5);
+    status_result_free(&result);
+    printf("Test 1 Passed: Normal mode\n");
+
+    // Test 2: Every file when asked for
+    options.untracked = UNTRACKED_ALL;
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && streq(result.items[2].path, "un/deep/f"));
+    printf("Test 2 Passed: All mode\n");
+
+    // Test 3: A warm cache lists nothing
+    assert(file_exists("test_status_un/.git/untracked-cache") == true);
+    status_result_free(&result);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && result.dirs_read == 0 && result.dirs_cached == 5);
+    status_result_free(&result);
+    printf("Test 3 Passed: Warm cache\n");
+
+    // Test 4: Only the changed directory is read again
+    write_old_text("test_status_un/un/deep/g", "g\n");
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 4 && has_item(&result, "un/deep/g", '?', '?') && result.dirs_read == 1);
+    status_result_free(&result);
+    printf("Test 4 Passed: Changed directory reread\n");
+
+    // Test 5: Tracking a file rereads its directory without a stat change
+    write_old_text("test_status_un/new.txt", "n\n");
+    add_file(repo, index, "test_status_un", "new.txt");
+    assert(index_write(repo, index) == true);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 4 && has_item(&result, "new.txt", 'A', ' ') && result.dirs_read == 1);
+    status_result_free(&result);
+    printf("Test 5 Passed: Index change noticed\n");
+
+    // Test 6: A changed .gitignore rereads everything below it
+    FILE *fp = safe_fopen("test_status_un/.gitignore", "a");
+    fputs("deep/\n", fp);
+    fclose(fp);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && has_item(&result, ".gitignore", ' ', 'M') && !has_item(&result, "un/deep/f", '?', '?'));
+    assert(result.dirs_read == 4);
+    status_result_free(&result);
+    printf("Test 6 Passed: Ignore change\n");
+
+    // Test 7: A damaged cache file is ignored
+    fp = safe_fopen("test_status_un/.git/untracked-cache", "r+");
+    fputs("junk", fp);
+    fclose(fp);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 3 && result.dirs_read == 4);
+    status_result_free(&result);
+    printf("Test 7 Passed: Damaged cache\n");
+
+    index_free(index);
+    repo_destroy(repo);
+    remove_directory("test_status_un");
+
+    printf("\nAll status untracked tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_status_fsmonitor(){
+    printf("Running status fsmonitor tests...\n");
+
+    Repository *repo = repo_init("test_status_fs");
+    assert(repo != NULL);
+    write_old_text("test_status_fs/a", "a\n");
+    write_old_text("test_status_fs/b", "b\n");
+    write_old_text("test_status_fs/c", "c\n");
+    Index *index = index_new();
+    add_file(repo, index, "test_status_fs", "a");
+    add_file(repo, index, "test_status_fs", "b");
+    add_file(repo, index, "test_status_fs", "c");
+    assert(index_write(repo, index) == true);
+    commit_index(repo, index);
+
+    /* reports the paths listed in .git/changed, or fails if .git/fail exists */
+    FILE *fp = safe_fopen("test_status_fs/.git/hook", "w");
+    fputs("#!/bin/sh\n[ -e .git/fail ] && exit 1\nprintf 'token-%s\\0' \"$2\"\n"
+          "[ -e .git/changed ] && tr '\\n' '\\0' < .git/changed\nexit 0\n", fp);
+    fclose(fp);
+    chmod("test_status_fs/.git/hook", 0755);
+    StatusOptions options = options_for(repo, UNTRACKED_NO);
+    options.fsmonitor = ".git/hook";
+    StatusResult result;
+
+    // Test 1: Without a token every entry is checked
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 0 && result.checked == 3 && result.fsmonitor_used == false);
+    status_result_free(&result);
+    printf("Test 1 Passed: First run\n");
+
+    // Test 2: Nothing reported, nothing checked
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 0 && result.checked == 0 && result.fsmonitor_used == true);
+    status_result_free(&result);
+    printf("Test 2 Passed: Quiet hook\n");
+
+    // Test 3: Only the reported path is checked
+    write_old_text("test_status_fs/b", "changed\n");
+    fp = safe_fopen("test_status_fs/.git/changed", "w");
+    fputs("b\n", fp);
+    fclose(fp);
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 1 && has_item(&result, "b", ' ', 'M') && result.checked == 1);
+    status_result_free(&result);
+    unlink("test_status_fs/.git/changed");
+    printf("Test 3 Passed: Reported path\n");
+
+    // Test 4: A dirty path stays checked after the hook stops reporting it
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 1 && has_item(&result, "b", ' ', 'M') && result.checked == 1);
+    status_result_free(&result);
+    printf("Test 4 Passed: Dirty list\n");
+
+    // Test 5: A failing hook means checking everything
+    fp = safe_fopen("test_status_fs/.git/fail", "w");
+    fclose(fp);
+    write_old_text("test_status_fs/c", "unreported\n");
+    assert(status_collect(repo, &options, &result) == true);
+    assert(result.count == 2 && has_item(&result, "c", ' ', 'M') && result.checked == 3 && result.fsmonitor_used == false);
+    status_result_free(&result);
+    printf("Test 5 Passed: Failing hook\n");
+
+    index_free(index);
+    repo_destroy(repo);
+    remove_directory("test_status_fs");
+
+    printf("\nAll status fsmonitor tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test status tracked\n");
+        fprintf(stderr, "    1. Test status untracked\n");
+        fprintf(stderr, "    2. Test status fsmonitor\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_status_tracked(); break;
+        case 1:  status = test_01_status_untracked(); break;
+        case 2:  status = test_02_status_fsmonitor(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
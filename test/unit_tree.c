@@ -0,0 +1,196 @@
+/* unit_tree.c: unit test tree functions */
+
+#include "objects.h"
+#include "repository.h"
+#include "tree.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+static size_t put_entry(unsigned char *p, const char *mode, const char *name, unsigned char fill){
+    size_t n = (size_t)sprintf((char *)p, "%s %s", mode, name) + 1;
+    memset(p + n, fill, SHA_SIZE);
+    return n + SHA_SIZE;
+}
+
+/* Tests */
+
+int test_00_tree_parse(){
+    printf("Running tree_parse tests...\n");
+
+    Arena arena = {0};
+    Tree tree;
+    unsigned char body[512];
+    size_t n = 0;
+
+    /* git order: "foo" the directory sorts as "foo/", after "foo.c" */
+    n += put_entry(body + n, "100644", "README", 0x01);
+    n += put_entry(body + n, "100644", "foo.c", 0x02);
+    n += put_entry(body + n, "40000", "foo", 0x03);
+    n += put_entry(body + n, "120000", "link", 0x04);
+    n += put_entry(body + n, "160000", "sub", 0x05);
+    n += put_entry(body + n, "100755", "zz", 0x06);
+
+    // Test 1: Leaves decoded in body order
+    assert(tree_parse(&tree, body, n, &arena) == true);
+    assert(tree.count == 6 && tree.sorted == true);
+    assert(tree.leaves[2].mode == TREE_MODE_TREE);
+    assert(streq(tree_leaf_name(&tree, &tree.leaves[2]), "foo") && tree.leaves[2].name_len == 3);
+    assert(tree.leaves[2].sha[0] == 0x03 && tree.leaves[2].sha[SHA_SIZE - 1] == 0x03);
+    assert(tree.leaves[5].mode == 0100755);
+    printf("Test 1 Passed: Leaves decoded\n");
+
+    // Test 2: Names are views into the body
+    assert((const unsigned char *)tree_leaf_name(&tree, &tree.leaves[0]) > body);
+    assert((const unsigned char *)tree_leaf_name(&tree, &tree.leaves[0]) < body + n);
+    printf("Test 2 Passed: Names not copied\n");
+
+    // Test 3: Types follow the mode
+    assert(streq(tree_leaf_type(&tree.leaves[0]), "blob"));
+    assert(streq(tree_leaf_type(&tree.leaves[2]), "tree"));
+    assert(streq(tree_leaf_type(&tree.leaves[3]), "blob"));
+    assert(streq(tree_leaf_type(&tree.leaves[4]), "commit"));
+    assert(tree_leaf_is_tree(&tree.leaves[2]) && !tree_leaf_is_tree(&tree.leaves[1]));
+    printf("Test 3 Passed: Entry types\n");
+
+    // Test 4: Bisecting finds files and directories alike
+    const char *names[] = { "README", "foo.c", "foo", "link", "sub", "zz" };
+    for (size_t i = 0; i < 6; i++){
+        assert(tree_find(&tree, names[i], strlen(names[i])) == &tree.leaves[i]);
+    }
+    assert(tree_find(&tree, "fo", 2) == NULL);
+    assert(tree_find(&tree, "foo.", 4) == NULL);
+    assert(tree_find(&tree, "zzz", 3) == NULL);
+    printf("Test 4 Passed: Binary search lookup\n");
+
+    // Test 5: Out of order trees are still searchable
+    n = 0;
+    n += put_entry(body + n, "100644", "b", 0x01);
+    n += put_entry(body + n, "100644", "a", 0x02);
+    assert(tree_parse(&tree, body, n, &arena) == true);
+    assert(tree.sorted == false);
+    assert(tree_find(&tree, "a", 1) == &tree.leaves[1]);
+    printf("Test 5 Passed: Unsorted fallback\n");
+
+    // Test 6: Empty tree
+    assert(tree_parse(&tree, NULL, 0, &arena) == true && tree.count == 0);
+    assert(tree_find(&tree, "a", 1) == NULL);
+    printf("Test 6 Passed: Empty tree\n");
+
+    arena_clear(&arena);
+    printf("\nAll tree_parse tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_tree_malformed(){
+    printf("Running tree malformed tests...\n");
+
+    Arena arena = {0};
+    Tree tree;
+    unsigned char body[128];
+    size_t n;
+
+    // Test 1: SHA cut short
+    n = put_entry(body, "100644", "a", 0x01);
+    assert(tree_parse(&tree, body, n - 1, &arena) == false);
+    printf("Test 1 Passed: Truncated SHA rejected\n");
+
+    // Test 2: Mode that is not octal
+    n = put_entry(body, "10064x", "a", 0x01);
+    assert(tree_parse(&tree, body, n, &arena) == false);
+    n = put_entry(body, "", "a", 0x01);
+    assert(tree_parse(&tree, body, n, &arena) == false);
+    printf("Test 2 Passed: Bad mode rejected\n");
+
+    // Test 3: Empty name or missing terminator
+    n = put_entry(body, "100644", "", 0x01);
+    assert(tree_parse(&tree, body, n, &arena) == false);
+    memcpy(body, "100644 abc", 10);
+    assert(tree_parse(&tree, body, 10, &arena) == false);
+    printf("Test 3 Passed: Bad name rejected\n");
+
+    arena_clear(&arena);
+    printf("\nAll tree malformed tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_02_tree_lookup_path(){
+    printf("Running tree_lookup_path tests...\n");
+
+    Repository *repo = repo_init("test_tree_path");
+    assert(repo != NULL);
+
+    // 1. Setup: a/b/c.txt plus a/d
+    unsigned char blob[SHA_SIZE], inner[SHA_SIZE], outer[SHA_SIZE], root[SHA_SIZE];
+    assert(object_write_buffer(repo, OBJ_BLOB, "hello\n", 6, blob) == true);
+
+    unsigned char body[256];
+    size_t n = 0;
+    n += put_entry(body + n, "100644", "c.txt", 0);
+    memcpy(body + n - SHA_SIZE, blob, SHA_SIZE);
+    assert(object_write_buffer(repo, OBJ_TREE, body, n, inner) == true);
+
+    n = 0;
+    n += put_entry(body + n, "40000", "b", 0);
+    memcpy(body + n - SHA_SIZE, inner, SHA_SIZE);
+    n += put_entry(body + n, "100644", "d", 0);
+    memcpy(body + n - SHA_SIZE, blob, SHA_SIZE);
+    assert(object_write_buffer(repo, OBJ_TREE, body, n, outer) == true);
+
+    n = 0;
+    n += put_entry(body + n, "40000", "a", 0);
+    memcpy(body + n - SHA_SIZE, outer, SHA_SIZE);
+    assert(object_write_buffer(repo, OBJ_TREE, body, n, root) == true);
+
+    GitTree *tree = (GitTree *)object_get(repo, root);
+    assert(tree != NULL && tree->object.type == OBJ_TREE && tree->tree.count == 1);
+
+    // Test 1: Nested paths resolve
+    TreeLeaf leaf;
+    assert(tree_lookup_path(repo, tree, "a/b/c.txt", &leaf) == true);
+    assert(memcmp(leaf.sha, blob, SHA_SIZE) == 0 && leaf.mode == 0100644);
+    assert(tree_lookup_path(repo, tree, "a/b", &leaf) == true);
+    assert(memcmp(leaf.sha, inner, SHA_SIZE) == 0 && tree_leaf_is_tree(&leaf));
+    assert(tree_lookup_path(repo, tree, "/a//d/", &leaf) == true);
+    printf("Test 1 Passed: Paths resolved\n");
+
+    // Test 2: Missing paths and paths through blobs fail
+    assert(tree_lookup_path(repo, tree, "a/x", &leaf) == false);
+    assert(tree_lookup_path(repo, tree, "a/d/e", &leaf) == false);
+    assert(tree_lookup_path(repo, tree, "", &leaf) == false);
+    printf("Test 2 Passed: Missing paths rejected\n");
+
+    repo_destroy(repo);
+    remove_directory("test_tree_path");
+
+    printf("\nAll tree_lookup_path tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test tree_parse\n");
+        fprintf(stderr, "    1. Test tree malformed\n");
+        fprintf(stderr, "    2. Test tree_lookup_path\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_tree_parse(); break;
+        case 1:  status = test_01_tree_malformed(); break;
+        case 2:  status = test_02_tree_lookup_path(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
@@ -42,10 +42,25 @@ int test_00_path_join() {
     free(s4);
 
     // Test 5: Check for NULL return on NULL input
-    char *s5 = path_join(NULL);
+    char *s5 = path_join(NULL, NULL);
     assert(s5 == NULL);
     printf("Test 5 Passed: NULL safety\n");
 
+    // Test 6: Buffer form joins the same way without allocating
+    char buf[16];
+    assert(path_join_buf(buf, sizeof(buf), "git", "", "init", NULL) == 8);
+    assert(streq(buf, "git/init"));
+    assert(path_join_buf(buf, sizeof(buf), "Standalone", NULL) == 10);
+    assert(streq(buf, "Standalone"));
+    printf("Test 6 Passed: Buffer join\n");
+
+    // Test 7: Buffer form refuses to truncate
+    assert(path_join_buf(buf, sizeof(buf), "0123456789", "abcde", NULL) == 0);
+    assert(streq(buf, ""));
+    assert(path_join_buf(buf, sizeof(buf), "0123456789", "abcd", NULL) == 15);
+    assert(path_join_buf(buf, sizeof(buf), NULL, NULL) == 0);
+    printf("Test 7 Passed: Buffer overflow rejected\n");
+
     printf("\nAll path_join tests passed successfully!\n");
 
     return EXIT_SUCCESS;
@@ -248,6 +263,188 @@ int test_05_remove_directory() {
     return EXIT_SUCCESS;
 }
 
+int test_06_sha_hex() {
+    printf("Running sha hex tests...\n");
+
+    const char *hex = "0123456789abcdefABCDEF0123456789abcdef01";
+    unsigned char sha[SHA_SIZE];
+    char out[SHA_HEX_SIZE];
+
+    // Test 1: Round trip (output is lowercase)
+    assert(hex_to_sha(hex, sha) == true);
+    assert(sha[0] == 0x01 && sha[7] == 0xef && sha[19] == 0x01);
+    sha_to_hex(sha, out);
+    assert(streq(out, "0123456789abcdefabcdef0123456789abcdef01"));
+    printf("Test 1 Passed: Hex round trip\n");
+
+    // Test 2: Wrong length
+    assert(hex_to_sha("0123", sha) == false);
+    assert(hex_to_sha("0123456789abcdefABCDEF0123456789abcdef0123", sha) == false);
+    printf("Test 2 Passed: Wrong length rejected\n");
+
+    // Test 3: Non-hex digit
+    assert(hex_to_sha("0123456789abcdefABCDEF0123456789abcdef0g", sha) == false);
+    printf("Test 3 Passed: Non-hex digit rejected\n");
+
+    // Test 4: NULL handling
+    assert(hex_to_sha(NULL, sha) == false);
+    printf("Test 4 Passed: NULL handled\n");
+
+    printf("\nAll sha hex tests passed!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_07_parse_size() {
+    printf("Running parse_size tests...\n");
+
+    size_t value = 0;
+
+    // Test 1: Plain and suffixed sizes
+    assert(parse_size("0", &value) == true && value == 0);
+    assert(parse_size("4096", &value) == true && value == 4096);
+    assert(parse_size("96m", &value) == true && value == (size_t)96 << 20);
+    assert(parse_size("2K", &value) == true && value == 2048);
+    assert(parse_size("1g", &value) == true && value == (size_t)1 << 30);
+    printf("Test 1 Passed: Sizes and k/m/g suffixes\n");
+
+    // Test 2: Garbage and signs are rejected
+    assert(parse_size("", &value) == false);
+    assert(parse_size("-1", &value) == false);
+    assert(parse_size("12x", &value) == false);
+    assert(parse_size("1mb", &value) == false);
+    assert(parse_size(NULL, &value) == false);
+    printf("Test 2 Passed: Invalid sizes rejected\n");
+
+    // Test 3: Overflow
+    assert(parse_size("99999999999999999999", &value) == false);
+    assert(parse_size("18446744073709551615g", &value) == false);
+    printf("Test 3 Passed: Overflow rejected\n");
+
+    printf("\nAll parse_size tests passed!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_08_arena() {
+    printf("Running arena tests...\n");
+
+    Arena arena = {0};
+
+    // Test 1: Small allocations are aligned and do not overlap
+    unsigned char *a = arena_alloc(&arena, 3);
+    unsigned char *b = arena_alloc(&arena, 40);
+    assert(((uintptr_t)a & 15) == 0 && ((uintptr_t)b & 15) == 0);
+    assert(b >= a + 3);
+    memset(a, 1, 3);
+    memset(b, 2, 40);
+    assert(a[2] == 1 && b[0] == 2);
+    printf("Test 1 Passed: Aligned, disjoint allocations\n");
+
+    // Test 2: Many allocations span several blocks
+    for (size_t i = 0; i < 100000; i++){
+        size_t *p = arena_alloc(&arena, sizeof(size_t) * 4);
+        p[0] = i;
+        p[3] = i;
+    }
+    assert(arena.head != NULL && arena.head->next != NULL);
+    printf("Test 2 Passed: Blocks chained\n");
+
+    // Test 3: Large requests get their own block; memdup copies
+    char *big = arena_alloc(&arena, ARENA_BLOCK_SIZE);
+    memset(big, 'x', ARENA_BLOCK_SIZE);
+    assert(arena.large != NULL && arena.large->data == (unsigned char *)big);
+    char *copy = arena_memdup(&arena, "hello", 6);
+    assert(streq(copy, "hello"));
+    printf("Test 3 Passed: Large blocks and memdup\n");
+
+    // Test 4: Clear releases everything and the arena is reusable
+    arena_clear(&arena);
+    assert(arena.head == NULL && arena.large == NULL && arena.allocated == 0);
+    assert(arena_alloc(&arena, 8) != NULL);
+    arena_clear(&arena);
+    printf("Test 4 Passed: Cleared and reused\n");
+
+    printf("\nAll arena tests passed!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_09_sha_set() {
+    printf("Running sha_set tests...\n");
+
+    ShaSet set = {0};
+    unsigned char sha[SHA_SIZE] = {0};
+
+    // Test 1: Insert reports whether the SHA is new
+    sha[0] = 0xab;
+    assert(sha_set_contains(&set, sha) == false);
+    assert(sha_set_insert(&set, sha) == true);
+    assert(sha_set_insert(&set, sha) == false);
+    assert(sha_set_contains(&set, sha) == true && set.count == 1);
+    printf("Test 1 Passed: Insert and contains\n");
+
+    // Test 2: Growth keeps every member, including colliding prefixes
+    for (uint32_t i = 0; i < 10000; i++){
+        unsigned char key[SHA_SIZE] = {0};
+        put_be32(key, i % 16);          /* many share a slot */
+        put_be32(key + 16, i + 1);
+        assert(sha_set_insert(&set, key) == true);
+    }
+    assert(set.count == 10001 && set.capacity >= 2 * set.count);
+    for (uint32_t i = 0; i < 10000; i++){
+        unsigned char key[SHA_SIZE] = {0};
+        put_be32(key, i % 16);
+        put_be32(key + 16, i + 1);
+        assert(sha_set_contains(&set, key) == true);
+    }
+    sha[1] = 1;
+    assert(sha_set_contains(&set, sha) == false);
+    printf("Test 2 Passed: %zu SHAs across growth\n", set.count);
+
+    // Test 3: Free leaves an empty, reusable set
+    sha_set_free(&set);
+    assert(set.count == 0 && set.slots == NULL);
+    assert(sha_set_insert(&set, sha) == true);
+    sha_set_free(&set);
+    printf("Test 3 Passed: Freed and reused\n");
+
+    printf("\nAll sha_set tests passed!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_10_trace() {
+    printf("Running trace tests...\n");
+
+    // Test 1: Spans are free and unrecorded until tracing is turned on
+    unsetenv(TRACE_ENV);
+    assert(trace_init() == false && trace_begin(TRACE_REPO_FIND) == 0);
+    setenv(TRACE_ENV, "yes", 1);
+    assert(trace_init() == false && trace_enabled == false);
+    printf("Test 1 Passed: Off by default\n");
+
+    // Test 2: Spans nest up to TRACE_DEPTH, deeper ones are not recorded
+    setenv(TRACE_ENV, "1", 1);
+    assert(trace_init() == true && trace_enabled == true);
+    uint64_t spans[TRACE_DEPTH + 1];
+    for (size_t i = 0; i <= TRACE_DEPTH; i++) { spans[i] = trace_begin(TRACE_OBJECT_READ); }
+    for (size_t i = 0; i < TRACE_DEPTH; i++) { assert(spans[i] != 0); }
+    assert(spans[TRACE_DEPTH] == 0);
+    trace_count(TRACE_INFLATED, 100);
+    for (size_t i = TRACE_DEPTH + 1; i-- > 0;) { trace_end(spans[i]); }
+    printf("Test 2 Passed: Nesting bounded\n");
+
+    // Test 3: A scope closes its span on every path out of the block
+    {
+        TRACE_SCOPE(TRACE_PACK_LOOKUP);
+        assert(trace_scope != 0);
+    }
+    uint64_t after = trace_begin(TRACE_PACK_LOOKUP);
+    assert(after != 0);
+    trace_end(after);
+    printf("Test 3 Passed: Scoped spans\n");
+
+    printf("\nAll trace tests passed!\n");
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
@@ -258,6 +455,11 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    3. Test mkdir_p\n");
         fprintf(stderr, "    4. Test is_directory_empty\n");
         fprintf(stderr, "    5. Test remove_directory\n");
+        fprintf(stderr, "    6. Test sha hex\n");
+        fprintf(stderr, "    7. Test parse_size\n");
+        fprintf(stderr, "    8. Test arena\n");
+        fprintf(stderr, "    9. Test sha_set\n");
+        fprintf(stderr, "   10. Test trace\n");
         return EXIT_FAILURE;
     }
 
@@ -271,6 +473,11 @@ int main(int argc, char *argv[]) {
         case 3:  status = test_03_mkdir_p(); break;
         case 4:  status = test_04_is_directory_empty(); break;
         case 5:  status = test_05_remove_directory(); break;
+        case 6:  status = test_06_sha_hex(); break;
+        case 7:  status = test_07_parse_size(); break;
+        case 8:  status = test_08_arena(); break;
+        case 9:  status = test_09_sha_set(); break;
+        case 10: status = test_10_trace(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
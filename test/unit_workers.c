@@ -0,0 +1,109 @@
+/* unit_workers.c: unit test worker pool functions */
+
+#include "workers.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <assert.h>
+
+/* Helpers */
+
+typedef struct {
+    atomic_int *hits;
+    atomic_int calls;
+} CountCtx;
+
+static void count_job(void *ctx, size_t index){
+    CountCtx *c = ctx;
+    atomic_fetch_add(&c->hits[index], 1);
+    atomic_fetch_add(&c->calls, 1);
+}
+
+/* Tests */
+
+int test_00_workers_run(){
+    printf("Running workers_run tests...\n");
+
+    size_t jobs = 10000;
+    CountCtx ctx;
+    ctx.hits = safe_calloc(sizeof(atomic_int), jobs);
+    atomic_init(&ctx.calls, 0);
+
+    // Test 1: Every index runs exactly once on several threads
+    assert(workers_run(4, jobs, count_job, &ctx) == true);
+    assert(atomic_load(&ctx.calls) == (int)jobs);
+    for (size_t i = 0; i < jobs; i++) { assert(atomic_load(&ctx.hits[i]) == 1); }
+    printf("Test 1 Passed: Each job ran once with 4 threads\n");
+
+    // Test 2: More threads than jobs
+    memset(ctx.hits, 0, sizeof(atomic_int) * jobs);
+    atomic_store(&ctx.calls, 0);
+    assert(workers_run(64, 3, count_job, &ctx) == true);
+    assert(atomic_load(&ctx.calls) == 3);
+    printf("Test 2 Passed: Thread count capped by job count\n");
+
+    // Test 3: No jobs and single thread
+    atomic_store(&ctx.calls, 0);
+    assert(workers_run(8, 0, count_job, &ctx) == true);
+    assert(atomic_load(&ctx.calls) == 0);
+    assert(workers_run(1, 5, count_job, &ctx) == true);
+    assert(atomic_load(&ctx.calls) == 5);
+    printf("Test 3 Passed: Zero jobs and inline execution\n");
+
+    // Test 4: NULL job function
+    assert(workers_run(2, 2, NULL, NULL) == false);
+    printf("Test 4 Passed: NULL function rejected\n");
+
+    free(ctx.hits);
+
+    printf("\nAll workers_run tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int test_01_workers_parse_count(){
+    printf("Running workers_parse_count tests...\n");
+
+    // Test 1: Explicit counts
+    assert(workers_parse_count("1") == 1);
+    assert(workers_parse_count("32") == 32);
+    printf("Test 1 Passed: Explicit counts\n");
+
+    // Test 2: Zero means one per CPU
+    assert(workers_parse_count("0") == workers_default_count());
+    assert(workers_default_count() >= 1);
+    printf("Test 2 Passed: Zero maps to CPU count\n");
+
+    // Test 3: Invalid input
+    assert(workers_parse_count("-3") == 0);
+    assert(workers_parse_count("4x") == 0);
+    assert(workers_parse_count("") == 0);
+    assert(workers_parse_count(NULL) == 0);
+    printf("Test 3 Passed: Invalid counts rejected\n");
+
+    printf("\nAll workers_parse_count tests passed successfully!\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test workers_run\n");
+        fprintf(stderr, "    1. Test workers_parse_count\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_workers_run(); break;
+        case 1:  status = test_01_workers_parse_count(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}